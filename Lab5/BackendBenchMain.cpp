@@ -0,0 +1,439 @@
+﻿// Замер CPU-стоимости записи кадра Renderer через gfx::NullBackend, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 NullBackend.cpp ScenePass.cpp CommandTrace.cpp BackendBenchMain.cpp -o backendbench
+// Кадр повторяет Renderer::Render без ImGui и тонмаппинга: константы вида и скайбокса, Begin, скайбокс,
+// затем объекты со своими константами. Объекты делят meshes разных геометрий и идут по ним подряд, как модели
+// из одного glTF. Примеры:
+//   ./backendbench
+//   ./backendbench --objects 10000 --meshes 10000
+//   ./backendbench --capture --trace frames.gfxt
+//   ./backendbench --replay frames.gfxt
+#include "NullBackend.h"
+#include "CommandTrace.h"
+#include "ScenePass.h"
+#include "MeshGenerator.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+
+namespace {
+    // Раскладки константных буферов Renderer.h.
+    struct ObjectConstants {
+        float worldMatrix[16];
+        float color[3];
+        float roughness;
+        float metalness;
+        float padding[3];
+    };
+
+    struct SkyboxConstants {
+        float worldMatrix[16];
+        float size[4];
+    };
+
+    struct ViewConstants {
+        float viewProjectionMatrix[16];
+        float cameraPos[4];
+        int32_t lightParams[4];
+        float clusterParams[4];
+    };
+
+    static_assert(sizeof(ObjectConstants) == 96, "WorldMatrixBuffer layout");
+    static_assert(sizeof(SkyboxConstants) == 80, "SkyboxWorldMatrixBuffer layout");
+    static_assert(sizeof(ViewConstants) == 112, "ViewMatrixBuffer layout");
+
+    struct Scene {
+        gfx::SceneFrame frame;
+        gfx::RenderTargetViewHandle backBuffer;
+        std::vector<gfx::MeshBinding> meshes;
+        std::vector<mesh::IndexRange> ranges;
+        mesh::IndexRange skyboxRange = {};
+        std::vector<ObjectConstants> constants;
+        std::vector<gfx::PassObject> objects;
+    };
+
+    void Usage() {
+        printf("backendbench [options]\n"
+            "  --objects <n>     object count; by default 1, 100 and 10000\n"
+            "  --meshes <n>      distinct meshes shared by the objects (4)\n"
+            "  --frames <n>      minimum frames per measurement (200)\n"
+            "  --capture         also measure through gfx::CaptureBackend and check the replayed trace\n"
+            "  --static          objects do not move, frames repeat\n"
+            "  --trace <file>    save the checked trace (with --capture)\n"
+            "  --replay <file>   replay a trace into a NullBackend and report\n");
+    }
+
+    // Ресурсы как у Renderer::Init: константные буферы, самплеры, шейдеры, сфера 40 x 40 для скайбокса
+    // и meshCount геометрий моделей.
+    bool CreateScene(gfx::NullBackend& backend, size_t objectCount, size_t meshCount, Scene& scene) {
+        static const uint8_t bytecode[16] = {};
+        gfx::BufferDesc desc;
+        desc.bindFlags = gfx::BindConstantBuffer;
+        desc.size = sizeof(ObjectConstants);
+        scene.frame.objectBuffer = backend.CreateBuffer(desc);
+        desc.size = sizeof(SkyboxConstants);
+        scene.frame.skyboxBuffer = backend.CreateBuffer(desc);
+        desc.size = 32;
+        scene.frame.quantizationBuffer = backend.CreateBuffer(desc);
+        desc.size = sizeof(ViewConstants);
+        desc.usage = gfx::Usage::Dynamic;
+        scene.frame.viewBuffer = backend.CreateBuffer(desc);
+        scene.frame.objectConstantsSize = sizeof(ObjectConstants);
+        scene.frame.skyboxConstantsSize = sizeof(SkyboxConstants);
+        scene.frame.viewConstantsSize = sizeof(ViewConstants);
+
+        gfx::SamplerDesc sampler;
+        sampler.filter = gfx::Filter::Anisotropic;
+        scene.frame.sampler = backend.CreateSampler(sampler);
+        sampler.filter = gfx::Filter::Linear;
+        sampler.address = gfx::AddressMode::Clamp;
+        scene.frame.environmentSampler = backend.CreateSampler(sampler);
+
+        gfx::TextureDesc texture;
+        texture.width = 1280;
+        texture.height = 720;
+        texture.format = gfx::Format::R8G8B8A8_UNORM_SRGB;
+        texture.bindFlags = gfx::BindRenderTarget;
+        scene.backBuffer = backend.CreateRenderTargetView(backend.CreateTexture(texture));
+        texture.format = gfx::Format::D32_FLOAT;
+        texture.bindFlags = gfx::BindDepthStencil;
+        scene.frame.depthTarget = backend.CreateDepthStencilView(backend.CreateTexture(texture));
+        gfx::DepthStencilDesc depth;
+        depth.depthEnable = depth.depthWrite = false;
+        scene.frame.skyboxDepthState = backend.CreateDepthStencilState(depth);
+        depth.depthEnable = depth.depthWrite = true;
+        depth.depthFunc = gfx::Comparison::Greater;
+        scene.frame.objectDepthState = backend.CreateDepthStencilState(depth);
+        texture.width = texture.height = 512;
+        texture.format = gfx::Format::R32G32B32A32_FLOAT;
+        texture.bindFlags = gfx::BindShaderResource;
+        texture.cube = true;
+        texture.arraySize = 6;
+        scene.frame.skyboxTexture = backend.CreateShaderResourceView(backend.CreateTexture(texture));
+        scene.frame.objectTextures[0] = backend.CreateShaderResourceView(backend.CreateTexture(texture));
+        texture.mipLevels = 5;
+        scene.frame.objectTextures[1] = backend.CreateShaderResourceView(backend.CreateTexture(texture));
+        texture.width = texture.height = 128;
+        texture.mipLevels = 1;
+        texture.arraySize = 1;
+        texture.cube = false;
+        scene.frame.objectTextures[2] = backend.CreateShaderResourceView(backend.CreateTexture(texture));
+
+        scene.frame.skyboxShader = backend.CreatePixelShader(bytecode, sizeof(bytecode));
+        scene.frame.objectShader = backend.CreatePixelShader(bytecode, sizeof(bytecode));
+
+        gfx::InputElement quantized[] = { { "POSITION", 0, gfx::Format::R16G16B16A16_UNORM, 0, 0, false } };
+        gfx::InputElement vertex[] = { { "POSITION", 0, gfx::Format::R32G32B32_FLOAT, 0, 0, false },
+                                       { "NORMAL", 0, gfx::Format::R32G32B32_FLOAT, 0, 12, false } };
+        gfx::MeshBinding sphere;
+        size_t sphereVertices = mesh::UVSphereVertexCount(40, 40), sphereIndices = mesh::UVSphereIndexCount(40, 40);
+        desc.usage = gfx::Usage::Immutable;
+        desc.bindFlags = gfx::BindVertexBuffer;
+        desc.size = sphereVertices * 8;
+        std::vector<uint8_t> data(sphereIndices * 4 * 2);
+        sphere.vertexBuffer = backend.CreateBuffer(desc, data.data());
+        desc.bindFlags = gfx::BindIndexBuffer;
+        desc.size = sphereIndices * 4 * 2;          // снаружи и изнутри
+        sphere.indexBuffer = backend.CreateBuffer(desc, data.data());
+        sphere.stride = 8;
+        sphere.vertexShader = backend.CreateVertexShader(bytecode, sizeof(bytecode));
+        sphere.inputLayout = backend.CreateInputLayout(quantized, 1, bytecode, sizeof(bytecode));
+        scene.frame.skybox.mesh = sphere;
+        scene.skyboxRange = { 0, (uint32_t)sphereIndices };
+        scene.frame.skybox.ranges = &scene.skyboxRange;
+        scene.frame.skybox.rangeCount = 1;
+        scene.frame.skybox.startIndex = (uint32_t)sphereIndices;
+
+        gfx::RasterizerDesc rasterizer;
+        rasterizer.frontCounterClockwise = true;
+        gfx::RasterizerStateHandle modelState = backend.CreateRasterizerState(rasterizer);
+        gfx::VertexShaderHandle modelShader = backend.CreateVertexShader(bytecode, sizeof(bytecode));
+        gfx::InputLayoutHandle modelLayout = backend.CreateInputLayout(vertex, 2, bytecode, sizeof(bytecode));
+        // Геометрии моделей - по 1000 треугольников.
+        const uint32_t modelIndices = 3000, modelVertices = 600;
+        data.assign(std::max(modelVertices * 24, modelIndices * 4), 0);
+        for (size_t m = 0; m < meshCount; m++) {
+            gfx::MeshBinding model;
+            desc.bindFlags = gfx::BindVertexBuffer;
+            desc.size = modelVertices * 24;
+            model.vertexBuffer = backend.CreateBuffer(desc, data.data());
+            desc.bindFlags = gfx::BindIndexBuffer;
+            desc.size = modelIndices * 4;
+            model.indexBuffer = backend.CreateBuffer(desc, data.data());
+            model.stride = 24;
+            model.inputLayout = modelLayout;
+            model.vertexShader = modelShader;
+            model.rasterizerState = modelState;
+            scene.meshes.push_back(model);
+        }
+        scene.ranges.assign(1, { 0, modelIndices });
+
+        scene.constants.resize(objectCount);
+        scene.objects.resize(objectCount);
+        return backend.GetStats().errors == 0;
+    }
+
+    // Объект i использует меш i * meshCount / objectCount, так что объекты с одним мешем идут подряд.
+    void RecordFrame(gfx::RenderBackend& backend, gfx::ScenePass& pass, Scene& scene, unsigned frame) {
+        ViewConstants view = {};
+        for (int k = 0; k < 4; k++) {
+            view.viewProjectionMatrix[k * 5] = 1.0f;
+        }
+        view.cameraPos[2] = -5.0f;
+        view.lightParams[0] = 1;
+        SkyboxConstants skybox = {};
+        skybox.size[0] = 0.011f;
+        scene.frame.viewConstants = &view;
+        scene.frame.skyboxConstants = &skybox;
+        gfx::ScenePass::Upload(backend, scene.frame);
+
+        scene.frame.width = 1280;
+        scene.frame.height = 720;
+        scene.frame.target = scene.backBuffer;
+        pass.Begin(backend, scene.frame);
+        pass.DrawSkybox(backend, scene.frame);
+
+        size_t objectCount = scene.objects.size(), meshCount = scene.meshes.size();
+        float time = frame * 0.016f;
+        for (size_t i = 0; i < objectCount; i++) {
+            ObjectConstants& constants = scene.constants[i];
+            memset(constants.worldMatrix, 0, sizeof(constants.worldMatrix));
+            constants.worldMatrix[0] = constants.worldMatrix[5] = constants.worldMatrix[10] = constants.worldMatrix[15] = 1.0f;
+            constants.worldMatrix[12] = (float)(i % 100) * 3.0f + time;
+            constants.worldMatrix[14] = (float)(i / 100) * 3.0f;
+            constants.color[0] = 1.0f;
+            constants.color[1] = 0.71f;
+            constants.color[2] = 0.29f;
+            constants.roughness = 0.5f;
+            constants.metalness = 1.0f;
+
+            gfx::PassObject& object = scene.objects[i];
+            object.mesh = scene.meshes[i * meshCount / objectCount];
+            object.ranges = scene.ranges.data();
+            object.rangeCount = 1;
+            object.constants = &constants;
+        }
+        scene.frame.objects = scene.objects.data();
+        scene.frame.objectCount = objectCount;
+        pass.DrawObjects(backend, scene.frame);
+    }
+
+    struct Options {
+        size_t meshCount = 4;
+        unsigned frames = 200;
+        bool capture = false;
+        bool still = false;
+        const char* tracePath = nullptr;
+    };
+
+    // Не меньше minFrames кадров и не меньше 0.2 с. Запись трассы перезапускается каждые captureFrames кадров,
+    // как при записи нескольких кадров из Renderer.
+    double MeasureFrames(gfx::RenderBackend& backend, gfx::CaptureBackend* capture, gfx::ScenePass& pass, Scene& scene,
+                         const Options& options, unsigned& frames) {
+        const unsigned captureFrames = 16;
+        frames = 0;
+        auto start = std::chrono::steady_clock::now();
+        double seconds = 0.0;
+        while (frames < options.frames || seconds < 0.2) {
+            if (capture != nullptr && frames % captureFrames == 0) {
+                capture->Start();
+            }
+            RecordFrame(backend, pass, scene, options.still ? 0 : ++frames);
+            frames += options.still ? 1 : 0;
+            if (capture != nullptr) {
+                capture->EndFrame();
+            }
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        return seconds / frames * 1e6;
+    }
+
+    void PrintErrors(const gfx::NullBackend& backend) {
+        for (const std::string& message : backend.GetErrors()) {
+            printf("  %s\n", message.c_str());
+        }
+    }
+
+    // Запись трех кадров, проигрывание в новый NullBackend и сравнение вызовов и содержимого буферов.
+    void CheckTrace(gfx::NullBackend& backend, gfx::ScenePass& pass, Scene& scene, const Options& options) {
+        const unsigned frameCount = 3;
+        gfx::CaptureBackend capture(backend);
+        backend.ResetStats();
+        capture.Start();
+        for (unsigned frame = 0; frame < frameCount; frame++) {
+            RecordFrame(capture, pass, scene, options.still ? 0 : 1000 + frame);
+            capture.EndFrame();
+        }
+        capture.Stop();
+        gfx::NullBackend::Stats recorded = backend.GetStats();
+
+        std::vector<uint8_t> bytes;
+        capture.Serialize(bytes);
+        if (options.tracePath != nullptr && !capture.Save(options.tracePath)) {
+            printf("  cannot write %s\n", options.tracePath);
+        }
+        const gfx::CaptureBackend::Stats& stats = capture.GetStats();
+        printf("  trace: %u frames, %llu commands, %zu bytes (%.1f KB/frame); payloads %llu, unique %llu, %.1f KB -> %.1f KB stored; %u declared resources\n",
+            stats.frames, (unsigned long long)stats.commands, bytes.size(), bytes.size() / 1024.0 / frameCount,
+            (unsigned long long)stats.payloads, (unsigned long long)stats.uniquePayloads, stats.payloadBytes / 1024.0,
+            stats.storedPayloadBytes / 1024.0, stats.declaredResources);
+
+        gfx::TraceReplayer replayer;
+        gfx::NullBackend replayed;
+        if (!replayer.Parse(std::move(bytes)) || !replayer.ReplayAll(replayed)) {
+            printf("  replay failed: %s\n", replayer.GetError().c_str());
+            return;
+        }
+        const gfx::NullBackend::Stats& stats2 = replayed.GetStats();
+        // Создание ресурсов в трассе - объявления, сравниваются остальные вызовы.
+        bool same = true;
+        uint64_t recordedCalls = 0, replayedCalls = 0;
+        for (size_t c = (size_t)gfx::Command::Release; c < (size_t)gfx::Command::Count; c++) {
+            same = same && recorded.calls[c] == stats2.calls[c];
+            recordedCalls += recorded.calls[c];
+            replayedCalls += stats2.calls[c];
+        }
+        same = same && recorded.draws == stats2.draws && recorded.primitives == stats2.primitives;
+        // Последние данные буферов объекта и вида совпадают с исходными.
+        gfx::BufferHandle buffers[] = { scene.frame.objectBuffer, scene.frame.viewBuffer };
+        size_t sizes[] = { sizeof(ObjectConstants), sizeof(ViewConstants) };
+        for (int i = 0; i < 2; i++) {
+            gfx::BufferHandle copy;
+            copy.id = 0;
+            for (uint32_t id = 1; id <= 1024 && !copy.IsValid(); id++) {
+                gfx::ResourceInfo info;
+                gfx::BufferHandle candidate;
+                candidate.id = id;
+                if (replayed.Describe(gfx::ResourceType::Buffer, id, info) && info.buffer.size == sizes[i]
+                    && info.buffer.usage == (i == 0 ? gfx::Usage::Default : gfx::Usage::Dynamic) && info.buffer.bindFlags == gfx::BindConstantBuffer) {
+                    copy = candidate;
+                }
+            }
+            const uint8_t* original = backend.GetBufferData(buffers[i]);
+            const uint8_t* data = replayed.GetBufferData(copy);
+            same = same && original != nullptr && data != nullptr && memcmp(original, data, sizes[i]) == 0;
+        }
+        printf("  replay: %llu commands, %u resources, %llu calls (%llu recorded), %llu draws, %llu errors, %s\n",
+            (unsigned long long)replayer.GetStats().commands, replayer.GetStats().createdResources, (unsigned long long)replayedCalls,
+            (unsigned long long)recordedCalls, (unsigned long long)stats2.draws, (unsigned long long)stats2.errors,
+            same ? "calls and buffers match" : "MISMATCH");
+        PrintErrors(replayed);
+    }
+
+    void Measure(size_t objectCount, const Options& options) {
+        gfx::NullBackend backend;
+        gfx::ScenePass pass;
+        Scene scene;
+        size_t meshCount = options.meshCount < 1 ? 1 : options.meshCount > objectCount ? objectCount : options.meshCount;
+        if (!CreateScene(backend, objectCount, meshCount, scene)) {
+            printf("scene creation failed: %s\n", backend.GetErrors().empty() ? "" : backend.GetErrors()[0].c_str());
+            return;
+        }
+        RecordFrame(backend, pass, scene, 0);
+        backend.ResetStats();
+
+        unsigned frames = 0;
+        double microseconds = MeasureFrames(backend, nullptr, pass, scene, options, frames);
+        const gfx::NullBackend::Stats& stats = backend.GetStats();
+        printf("%7zu objects, %5zu meshes: %9.2f us/frame (%6.1f ns/object), %7.0f calls/frame, %6.0f draws, %6zu mesh binds, %llu errors\n",
+            objectCount, meshCount, microseconds, microseconds * 1e3 / objectCount, (double)stats.TotalCalls() / frames,
+            (double)stats.draws / frames, pass.GetStats().meshBinds, (unsigned long long)stats.errors);
+        PrintErrors(backend);
+        if (!options.capture)
+            return;
+
+        // Обертка без записи стоит лишнего виртуального вызова на команду, поэтому Renderer::FrameBackend пускает через
+        // нее только записываемые кадры, и остальные кадры ничего не платят. Замеры чередуются, берется лучший из трех.
+        gfx::CaptureBackend capture(backend);
+        double direct = microseconds, idle = 1e30;
+        for (int repeat = 0; repeat < 3; repeat++) {
+            direct = std::min(direct, MeasureFrames(backend, nullptr, pass, scene, options, frames));
+            idle = std::min(idle, MeasureFrames(capture, nullptr, pass, scene, options, frames));
+        }
+        printf("  idle wrapper: %9.2f us/frame vs %.2f direct, %+.1f%% (Renderer bypasses it between recordings)\n", idle,
+            direct, (idle - direct) / direct * 100.0);
+
+        MeasureFrames(capture, &capture, pass, scene, options, frames);
+        double captured = MeasureFrames(capture, &capture, pass, scene, options, frames);
+        double calls = (double)capture.GetStats().commands / capture.GetStats().frames;
+        double recordOverhead = (captured - direct) / direct * 100.0;
+        printf("  recording:    %9.2f us/frame, +%.2f us (%+.1f%% of the null frame, %.1f ns/command): %s\n", captured,
+            captured - direct, recordOverhead, (captured - direct) * 1e3 / calls,
+            recordOverhead < 5.0 ? "within 5%" : "ABOVE 5%, paid only by recorded frames");
+        capture.Stop();
+        CheckTrace(backend, pass, scene, options);
+    }
+
+    int Replay(const char* path) {
+        gfx::TraceReplayer replayer;
+        if (!replayer.Load(path)) {
+            printf("%s: %s\n", path, replayer.GetError().c_str());
+            return 1;
+        }
+        gfx::NullBackend backend;
+        auto start = std::chrono::steady_clock::now();
+        bool replayed = replayer.ReplayAll(backend);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!replayed) {
+            printf("%s: %s\n", path, replayer.GetError().c_str());
+            return 1;
+        }
+        // Повтор кадров на созданных ресурсах.
+        unsigned repeats = 0;
+        start = std::chrono::steady_clock::now();
+        double repeatSeconds = 0.0;
+        while (repeatSeconds < 0.2 && replayer.GetFrameCount() > 0) {
+            replayer.ReplayFrame(backend, repeats++ % replayer.GetFrameCount());
+            repeatSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        const gfx::NullBackend::Stats& stats = backend.GetStats();
+        const gfx::TraceReplayer::Stats& replay = replayer.GetStats();
+        printf("%s: %u frames, first pass %.2f ms, %.2f us/frame repeated; %u resources created, %u failed; %llu draws, %llu errors\n",
+            path, replayer.GetFrameCount(), seconds * 1e3, repeats != 0 ? repeatSeconds / repeats * 1e6 : 0.0,
+            replay.createdResources, replay.failedResources, (unsigned long long)stats.draws, (unsigned long long)stats.errors);
+        PrintErrors(backend);
+        replayer.ReleaseAll(backend);
+        return stats.errors == 0 ? 0 : 1;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> objectCounts;
+    Options options;
+    const char* replayPath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--objects") && i + 1 < argc) {
+            objectCounts.push_back((size_t)atol(argv[++i]));
+        } else if (!strcmp(argv[i], "--meshes") && i + 1 < argc) {
+            options.meshCount = (size_t)atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            options.frames = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--capture")) {
+            options.capture = true;
+        } else if (!strcmp(argv[i], "--static")) {
+            options.still = true;
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            options.tracePath = argv[++i];
+        } else if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else {
+            Usage();
+            return 1;
+        }
+    }
+    if (replayPath != nullptr)
+        return Replay(replayPath);
+    if (objectCounts.empty()) {
+        objectCounts = { 1, 100, 10000 };
+    }
+    for (size_t objectCount : objectCounts) {
+        if (objectCount == 0) {
+            Usage();
+            return 1;
+        }
+        Measure(objectCount, options);
+    }
+    return 0;
+}
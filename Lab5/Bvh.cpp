@@ -0,0 +1,829 @@
+﻿#include "Bvh.h"
+#include "ThreadPool.h"
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BVH_SSE
+#endif
+
+namespace mesh {
+    namespace {
+        const float huge = 1e30f;
+
+        // Четыре float: одна SSE операция или цикл из четырех в скалярной сборке. Сравнения возвращают маску дорожек.
+#ifdef BVH_SSE
+        struct Float4 {
+            __m128 v;
+        };
+
+        inline Float4 Load(const float* p) {
+            return { _mm_load_ps(p) };
+        }
+
+        inline Float4 Splat(float x) {
+            return { _mm_set1_ps(x) };
+        }
+
+        inline void Store(float* p, Float4 a) {
+            _mm_storeu_ps(p, a.v);
+        }
+
+        inline Float4 operator+(Float4 a, Float4 b) {
+            return { _mm_add_ps(a.v, b.v) };
+        }
+
+        inline Float4 operator-(Float4 a, Float4 b) {
+            return { _mm_sub_ps(a.v, b.v) };
+        }
+
+        inline Float4 operator*(Float4 a, Float4 b) {
+            return { _mm_mul_ps(a.v, b.v) };
+        }
+
+        inline Float4 operator/(Float4 a, Float4 b) {
+            return { _mm_div_ps(a.v, b.v) };
+        }
+
+        inline Float4 Min(Float4 a, Float4 b) {
+            return { _mm_min_ps(a.v, b.v) };
+        }
+
+        inline Float4 Max(Float4 a, Float4 b) {
+            return { _mm_max_ps(a.v, b.v) };
+        }
+
+        inline unsigned LessEqual(Float4 a, Float4 b) {
+            return (unsigned)_mm_movemask_ps(_mm_cmple_ps(a.v, b.v));
+        }
+
+        inline unsigned Less(Float4 a, Float4 b) {
+            return (unsigned)_mm_movemask_ps(_mm_cmplt_ps(a.v, b.v));
+        }
+
+        inline unsigned NotEqual(Float4 a, Float4 b) {
+            return (unsigned)_mm_movemask_ps(_mm_cmpneq_ps(a.v, b.v));
+        }
+#else
+        struct Float4 {
+            float v[4];
+        };
+
+        template<typename Op>
+        inline Float4 Apply(Float4 a, Float4 b, Op op) {
+            return { { op(a.v[0], b.v[0]), op(a.v[1], b.v[1]), op(a.v[2], b.v[2]), op(a.v[3], b.v[3]) } };
+        }
+
+        template<typename Op>
+        inline unsigned Compare(Float4 a, Float4 b, Op op) {
+            unsigned mask = 0;
+            for (int i = 0; i < 4; i++) {
+                mask |= op(a.v[i], b.v[i]) ? 1u << i : 0u;
+            }
+            return mask;
+        }
+
+        inline Float4 Load(const float* p) {
+            return { { p[0], p[1], p[2], p[3] } };
+        }
+
+        inline Float4 Splat(float x) {
+            return { { x, x, x, x } };
+        }
+
+        inline void Store(float* p, Float4 a) {
+            memcpy(p, a.v, sizeof(a.v));
+        }
+
+        inline Float4 operator+(Float4 a, Float4 b) {
+            return Apply(a, b, [](float x, float y) { return x + y; });
+        }
+
+        inline Float4 operator-(Float4 a, Float4 b) {
+            return Apply(a, b, [](float x, float y) { return x - y; });
+        }
+
+        inline Float4 operator*(Float4 a, Float4 b) {
+            return Apply(a, b, [](float x, float y) { return x * y; });
+        }
+
+        inline Float4 operator/(Float4 a, Float4 b) {
+            return Apply(a, b, [](float x, float y) { return x / y; });
+        }
+
+        inline Float4 Min(Float4 a, Float4 b) {
+            return Apply(a, b, [](float x, float y) { return x < y ? x : y; });
+        }
+
+        inline Float4 Max(Float4 a, Float4 b) {
+            return Apply(a, b, [](float x, float y) { return x > y ? x : y; });
+        }
+
+        inline unsigned LessEqual(Float4 a, Float4 b) {
+            return Compare(a, b, [](float x, float y) { return x <= y; });
+        }
+
+        inline unsigned Less(Float4 a, Float4 b) {
+            return Compare(a, b, [](float x, float y) { return x < y; });
+        }
+
+        inline unsigned NotEqual(Float4 a, Float4 b) {
+            return Compare(a, b, [](float x, float y) { return x != y; });
+        }
+#endif
+
+        struct Box {
+            float min[3];
+            float max[3];
+
+            void Reset() {
+                min[0] = min[1] = min[2] = huge;
+                max[0] = max[1] = max[2] = -huge;
+            }
+
+            void Grow(const float p[3]) {
+                for (int k = 0; k < 3; k++) {
+                    min[k] = std::min(min[k], p[k]);
+                    max[k] = std::max(max[k], p[k]);
+                }
+            }
+
+            void Grow(const Box& box) {
+                for (int k = 0; k < 3; k++) {
+                    min[k] = std::min(min[k], box.min[k]);
+                    max[k] = std::max(max[k], box.max[k]);
+                }
+            }
+
+            float Area() const {
+                float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+                return dx < 0.0f ? 0.0f : dx * dy + dy * dz + dz * dx;
+            }
+        };
+
+        struct PrimRef {
+            Box box;
+            float centroid[3];
+        };
+
+        // Узел бинарного дерева построения. count > 0 - лист, task >= 0 - корень поддерева, построенного отдельной задачей.
+        struct BuildNode {
+            Box box;
+            uint32_t left;
+            uint32_t right;
+            uint32_t start;
+            uint32_t count;
+            int32_t task;
+        };
+
+        struct BinSet {
+            Box box[3][Bvh::binCount];
+            uint32_t count[3][Bvh::binCount];
+
+            void Reset() {
+                for (int k = 0; k < 3; k++) {
+                    for (unsigned b = 0; b < Bvh::binCount; b++) {
+                        box[k][b].Reset();
+                        count[k][b] = 0;
+                    }
+                }
+            }
+
+            void Merge(const BinSet& other) {
+                for (int k = 0; k < 3; k++) {
+                    for (unsigned b = 0; b < Bvh::binCount; b++) {
+                        box[k][b].Grow(other.box[k][b]);
+                        count[k][b] += other.count[k][b];
+                    }
+                }
+            }
+        };
+
+        // Границы треугольников и центроидов диапазона.
+        struct RangeBounds {
+            Box box;
+            Box centroids;
+
+            void Reset() {
+                box.Reset();
+                centroids.Reset();
+            }
+
+            void Merge(const RangeBounds& other) {
+                box.Grow(other.box);
+                centroids.Grow(other.centroids);
+            }
+        };
+
+        struct Task {
+            uint32_t begin;
+            uint32_t end;
+        };
+
+        class Builder {
+        public:
+            static const size_t parallelGrain = 16384;
+
+            Builder(const std::vector<PrimRef>& refs, std::vector<uint32_t>& order, ThreadPool* pool) :
+                refs_(refs), order_(order), pool_(pool) {
+                size_t threads = pool != nullptr ? pool->GetThreadCount() + 1 : 1;
+                taskSize_ = pool != nullptr ? std::max<size_t>(refs.size() / (threads * 8), 4096) : 0;
+            };
+
+            // Строит дерево в trees[0]; поддеревья, отданные задачам, - в trees[1 + task].
+            void Build(std::vector<std::vector<BuildNode>>& trees) {
+                trees.assign(1, std::vector<BuildNode>());
+                trees[0].reserve(refs_.size() / 2 + 1);
+                BuildRange(trees[0], 0, (uint32_t)refs_.size(), true);
+
+                trees.resize(1 + tasks_.size());
+                auto body = [this, &trees](size_t begin, size_t end) {
+                    for (size_t t = begin; t < end; t++) {
+                        trees[1 + t].reserve((tasks_[t].end - tasks_[t].begin) / 2 + 1);
+                        BuildRange(trees[1 + t], tasks_[t].begin, tasks_[t].end, false);
+                    }
+                };
+                if (pool_ != nullptr)
+                    pool_->ParallelFor(tasks_.size(), 1, body);
+                else
+                    body(0, tasks_.size());
+            }
+
+        private:
+            template<typename Result, typename Body>
+            Result Reduce(uint32_t begin, uint32_t end, bool parallel, Body body) {
+                size_t count = end - begin;
+                if (!parallel || pool_ == nullptr || count < parallelGrain * 2) {
+                    Result result;
+                    result.Reset();
+                    body(begin, end, result);
+                    return result;
+                }
+                size_t blocks = (count + parallelGrain - 1) / parallelGrain;
+                std::vector<Result> partial(blocks);
+                pool_->ParallelFor(count, parallelGrain, [&](size_t first, size_t last) {
+                    Result& result = partial[first / parallelGrain];
+                    result.Reset();
+                    body(begin + (uint32_t)first, begin + (uint32_t)last, result);
+                });
+                for (size_t b = 1; b < blocks; b++) {
+                    partial[0].Merge(partial[b]);
+                }
+                return partial[0];
+            }
+
+            uint32_t BuildRange(std::vector<BuildNode>& nodes, uint32_t begin, uint32_t end, bool top) {
+                uint32_t index = (uint32_t)nodes.size();
+                nodes.push_back(BuildNode());
+                BuildNode node = {};
+                node.task = -1;
+
+                RangeBounds bounds = Reduce<RangeBounds>(begin, end, top, [this](uint32_t first, uint32_t last, RangeBounds& result) {
+                    for (uint32_t i = first; i < last; i++) {
+                        const PrimRef& ref = refs_[order_[i]];
+                        result.box.Grow(ref.box);
+                        result.centroids.Grow(ref.centroid);
+                    }
+                });
+                node.box = bounds.box;
+                uint32_t count = end - begin;
+
+                if (count <= Bvh::maxLeafTriangles) {
+                    node.start = begin;
+                    node.count = count;
+                    nodes[index] = node;
+                    return index;
+                }
+                if (top && pool_ != nullptr && count <= taskSize_) {
+                    node.task = (int32_t)tasks_.size();
+                    tasks_.push_back({ begin, end });
+                    nodes[index] = node;
+                    return index;
+                }
+
+                // Бины по всем трем осям в пределах границ центроидов.
+                float scale[3];
+                for (int k = 0; k < 3; k++) {
+                    float extent = bounds.centroids.max[k] - bounds.centroids.min[k];
+                    scale[k] = extent > 0.0f ? Bvh::binCount * (1.0f - 1e-6f) / extent : 0.0f;
+                }
+                const float* origin = bounds.centroids.min;
+                BinSet bins = Reduce<BinSet>(begin, end, top, [this, &scale, origin](uint32_t first, uint32_t last, BinSet& result) {
+                    for (uint32_t i = first; i < last; i++) {
+                        const PrimRef& ref = refs_[order_[i]];
+                        for (int k = 0; k < 3; k++) {
+                            unsigned b = std::min((unsigned)((ref.centroid[k] - origin[k]) * scale[k]), Bvh::binCount - 1);
+                            result.box[k][b].Grow(ref.box);
+                            result.count[k][b]++;
+                        }
+                    }
+                });
+
+                // Стоимость разреза после бина b: A(L) * N(L) + A(R) * N(R).
+                int bestAxis = -1;
+                unsigned bestBin = 0;
+                float bestCost = huge;
+                for (int k = 0; k < 3; k++) {
+                    if (scale[k] == 0.0f)
+                        continue;
+                    float rightCost[Bvh::binCount];
+                    Box box;
+                    box.Reset();
+                    uint32_t right = 0;
+                    for (unsigned b = Bvh::binCount - 1; b > 0; b--) {
+                        box.Grow(bins.box[k][b]);
+                        right += bins.count[k][b];
+                        rightCost[b] = right > 0 ? box.Area() * right : huge;
+                    }
+                    box.Reset();
+                    uint32_t left = 0;
+                    for (unsigned b = 0; b + 1 < Bvh::binCount; b++) {
+                        box.Grow(bins.box[k][b]);
+                        left += bins.count[k][b];
+                        if (left == 0 || left == count)
+                            continue;
+                        float cost = box.Area() * left + rightCost[b + 1];
+                        if (cost < bestCost) {
+                            bestCost = cost;
+                            bestAxis = k;
+                            bestBin = b;
+                        }
+                    }
+                }
+
+                uint32_t middle;
+                if (bestAxis >= 0) {
+                    float axisOrigin = origin[bestAxis], axisScale = scale[bestAxis];
+                    const std::vector<PrimRef>& refs = refs_;
+                    middle = (uint32_t)(std::partition(order_.begin() + begin, order_.begin() + end,
+                        [&refs, bestAxis, bestBin, axisOrigin, axisScale](uint32_t prim) {
+                            unsigned b = std::min((unsigned)((refs[prim].centroid[bestAxis] - axisOrigin) * axisScale), Bvh::binCount - 1);
+                            return b <= bestBin;
+                        }) - order_.begin());
+                }
+                else {
+                    // Все центроиды совпадают, любое разбиение равноценно.
+                    middle = begin + count / 2;
+                }
+
+                node.left = BuildRange(nodes, begin, middle, top);
+                node.right = BuildRange(nodes, middle, end, top);
+                nodes[index] = node;
+                return index;
+            }
+
+            const std::vector<PrimRef>& refs_;
+            std::vector<uint32_t>& order_;
+            ThreadPool* pool_;
+            size_t taskSize_;
+            std::vector<Task> tasks_;
+        };
+
+        struct NodeRef {
+            uint32_t tree;
+            uint32_t index;
+        };
+
+        struct LeafRange {
+            uint32_t start;
+            uint32_t count;
+        };
+
+        void For(ThreadPool* pool, size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+            if (pool != nullptr)
+                pool->ParallelFor(count, grain, body);
+            else if (count > 0)
+                body(0, count);
+        }
+
+        inline void ReadPosition(const uint8_t* vertices, size_t stride, size_t positionOffset, uint32_t index, float p[3]) {
+            memcpy(p, vertices + index * stride + positionOffset, 3 * sizeof(float));
+        }
+
+        // Ближайшая к p точка треугольника (a, a + e1, a + e2), Ericson, "Real-Time Collision Detection", 5.1.5.
+        void ClosestPointOnTriangle(const float p[3], const float a[3], const float e1[3], const float e2[3], float out[3]) {
+            auto dot = [](const float* x, const float* y) {
+                return x[0] * y[0] + x[1] * y[1] + x[2] * y[2];
+            };
+            auto set = [out, a, e1, e2](float s, float t) {
+                for (int k = 0; k < 3; k++) {
+                    out[k] = a[k] + e1[k] * s + e2[k] * t;
+                }
+            };
+            float ap[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+            float d1 = dot(e1, ap), d2 = dot(e2, ap);
+            if (d1 <= 0.0f && d2 <= 0.0f)
+                return set(0.0f, 0.0f);
+
+            float bp[3] = { ap[0] - e1[0], ap[1] - e1[1], ap[2] - e1[2] };
+            float d3 = dot(e1, bp), d4 = dot(e2, bp);
+            if (d3 >= 0.0f && d4 <= d3)
+                return set(1.0f, 0.0f);
+
+            float vc = d1 * d4 - d3 * d2;
+            if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+                return set(d1 / (d1 - d3), 0.0f);
+
+            float cp[3] = { ap[0] - e2[0], ap[1] - e2[1], ap[2] - e2[2] };
+            float d5 = dot(e1, cp), d6 = dot(e2, cp);
+            if (d6 >= 0.0f && d5 <= d6)
+                return set(0.0f, 1.0f);
+
+            float vb = d5 * d2 - d1 * d6;
+            if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+                return set(0.0f, d2 / (d2 - d6));
+
+            float va = d3 * d6 - d5 * d4;
+            if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+                float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+                return set(1.0f - w, w);
+            }
+
+            float denominator = va + vb + vc;
+            if (denominator == 0.0f)
+                return set(0.0f, 0.0f);
+            return set(vb / denominator, vc / denominator);
+        }
+
+        // Луч, подготовленный для проверок по четыре: компоненты размножены по дорожкам.
+        struct RayData {
+            Float4 origin[3];
+            Float4 direction[3];
+            Float4 inverse[3];
+            float tMin;
+        };
+
+        RayData PrepareRay(const Ray& ray) {
+            RayData data;
+            for (int k = 0; k < 3; k++) {
+                // Нулевая компонента направления заменяется очень малой, чтобы не получать 0 * inf.
+                float d = ray.direction[k];
+                float safe = fabsf(d) > 1e-20f ? d : (d < 0.0f ? -1e-20f : 1e-20f);
+                data.origin[k] = Splat(ray.origin[k]);
+                data.direction[k] = Splat(d);
+                data.inverse[k] = Splat(1.0f / safe);
+            }
+            data.tMin = ray.tMin;
+            return data;
+        }
+    }
+
+    // Пересечение луча с границами четырех потомков: маска попаданий и расстояния входа.
+    static inline unsigned IntersectChildren(const float (&min)[3][4], const float (&max)[3][4], unsigned childCount,
+                                             const RayData& ray, float tMax, float tNear[4]) {
+        Float4 enter = Splat(ray.tMin), leave = Splat(tMax);
+        for (int k = 0; k < 3; k++) {
+            Float4 t0 = (Load(min[k]) - ray.origin[k]) * ray.inverse[k];
+            Float4 t1 = (Load(max[k]) - ray.origin[k]) * ray.inverse[k];
+            enter = Max(enter, Min(t0, t1));
+            leave = Min(leave, Max(t0, t1));
+        }
+        Store(tNear, enter);
+        return LessEqual(enter, leave) & ((1u << childCount) - 1);
+    }
+
+    // Мёллер-Трумбор для четырех треугольников пачки: маска попаданий в (tMin, tMax) и t, u, v по дорожкам.
+    static inline unsigned IntersectTriangles(const float (&v0)[3][4], const float (&e1)[3][4], const float (&e2)[3][4],
+                                              const RayData& ray, float tMax, float t[4], float u[4], float v[4]) {
+        Float4 e1x = Load(e1[0]), e1y = Load(e1[1]), e1z = Load(e1[2]);
+        Float4 e2x = Load(e2[0]), e2y = Load(e2[1]), e2z = Load(e2[2]);
+        const Float4* d = ray.direction;
+
+        Float4 px = d[1] * e2z - d[2] * e2y;
+        Float4 py = d[2] * e2x - d[0] * e2z;
+        Float4 pz = d[0] * e2y - d[1] * e2x;
+        Float4 det = e1x * px + e1y * py + e1z * pz;
+        Float4 inverse = Splat(1.0f) / det;
+
+        Float4 sx = ray.origin[0] - Load(v0[0]), sy = ray.origin[1] - Load(v0[1]), sz = ray.origin[2] - Load(v0[2]);
+        Float4 bu = (sx * px + sy * py + sz * pz) * inverse;
+
+        Float4 qx = sy * e1z - sz * e1y;
+        Float4 qy = sz * e1x - sx * e1z;
+        Float4 qz = sx * e1y - sy * e1x;
+        Float4 bv = (d[0] * qx + d[1] * qy + d[2] * qz) * inverse;
+        Float4 distance = (e2x * qx + e2y * qy + e2z * qz) * inverse;
+
+        Float4 zero = Splat(0.0f);
+        unsigned mask = NotEqual(det, zero) & LessEqual(zero, bu) & LessEqual(zero, bv) & LessEqual(bu + bv, Splat(1.0f)) &
+            Less(Splat(ray.tMin), distance) & Less(distance, Splat(tMax));
+        Store(t, distance);
+        Store(u, bu);
+        Store(v, bv);
+        return mask;
+    }
+
+    void Bvh::Build(const void* vertices, size_t vertexCount, size_t stride, size_t positionOffset, const uint32_t* indices,
+                    size_t indexCount, ThreadPool* pool) {
+        nodes_.clear();
+        packets_.clear();
+        indices_.assign(indices, indices + indexCount / 3 * 3);
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0 || vertexCount == 0)
+            return;
+
+        const uint8_t* data = static_cast<const uint8_t*>(vertices);
+        std::vector<PrimRef> refs(triangleCount);
+        std::vector<uint32_t> order(triangleCount);
+        For(pool, triangleCount, Builder::parallelGrain, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++) {
+                PrimRef& ref = refs[t];
+                ref.box.Reset();
+                for (int c = 0; c < 3; c++) {
+                    float p[3];
+                    ReadPosition(data, stride, positionOffset, indices[t * 3 + c], p);
+                    ref.box.Grow(p);
+                }
+                for (int k = 0; k < 3; k++) {
+                    ref.centroid[k] = (ref.box.min[k] + ref.box.max[k]) * 0.5f;
+                }
+                order[t] = (uint32_t)t;
+            }
+        });
+
+        std::vector<std::vector<BuildNode>> trees;
+        Builder builder(refs, order, pool);
+        builder.Build(trees);
+
+        // Сворачивание: у узла раскрывается потомок с наибольшей площадью, пока их не станет четыре.
+        // Узлы пишутся в прямом порядке обхода, поэтому потомки всегда идут после родителя.
+        nodes_.reserve(triangleCount / 4 + 1);
+        std::vector<LeafRange> leaves;
+        leaves.reserve(triangleCount / 2 + 1);
+        auto resolve = [&trees](NodeRef ref) {
+            const BuildNode& node = trees[ref.tree][ref.index];
+            return node.task >= 0 ? NodeRef{ (uint32_t)node.task + 1, 0 } : ref;
+        };
+        std::function<int32_t(NodeRef)> collapse = [&](NodeRef ref) -> int32_t {
+            int32_t index = (int32_t)nodes_.size();
+            nodes_.push_back(Node());
+
+            NodeRef children[4];
+            unsigned childCount = 1;
+            children[0] = ref;
+            for (;;) {
+                int widest = -1;
+                float widestArea = -1.0f;
+                for (unsigned i = 0; i < childCount; i++) {
+                    const BuildNode& child = trees[children[i].tree][children[i].index];
+                    if (child.count == 0 && child.box.Area() > widestArea) {
+                        widest = (int)i;
+                        widestArea = child.box.Area();
+                    }
+                }
+                if (widest < 0 || childCount == 4)
+                    break;
+                const BuildNode& expanded = trees[children[widest].tree][children[widest].index];
+                uint32_t tree = children[widest].tree;
+                children[widest] = resolve({ tree, expanded.left });
+                children[childCount++] = resolve({ tree, expanded.right });
+            }
+
+            int32_t childIndex[4] = { 0, 0, 0, 0 };
+            for (unsigned i = 0; i < childCount; i++) {
+                const BuildNode& child = trees[children[i].tree][children[i].index];
+                if (child.count > 0) {
+                    childIndex[i] = ~(int32_t)leaves.size();
+                    leaves.push_back({ child.start, child.count });
+                }
+                else {
+                    childIndex[i] = collapse(children[i]);
+                }
+            }
+            Node& out = nodes_[index];
+            memcpy(out.child, childIndex, sizeof(childIndex));
+            out.childCount = childCount;
+            return index;
+        };
+        collapse(resolve({ 0, 0 }));
+
+        packets_.resize(leaves.size());
+        For(pool, leaves.size(), 4096, [&](size_t begin, size_t end) {
+            for (size_t p = begin; p < end; p++) {
+                for (uint32_t lane = 0; lane < 4; lane++) {
+                    packets_[p].triangle[lane] = lane < leaves[p].count ? order[leaves[p].start + lane] : ~0u;
+                }
+                FillPacket(p, data, stride, positionOffset);
+            }
+        });
+        UpdateBounds();
+    }
+
+    void Bvh::Refit(const void* vertices, size_t stride, size_t positionOffset, ThreadPool* pool) {
+        const uint8_t* data = static_cast<const uint8_t*>(vertices);
+        For(pool, packets_.size(), 4096, [&](size_t begin, size_t end) {
+            for (size_t p = begin; p < end; p++) {
+                FillPacket(p, data, stride, positionOffset);
+            }
+        });
+        UpdateBounds();
+    }
+
+    void Bvh::FillPacket(size_t packet, const uint8_t* vertices, size_t stride, size_t positionOffset) {
+        Packet& out = packets_[packet];
+        for (int lane = 0; lane < 4; lane++) {
+            float p[3][3] = {};
+            if (out.triangle[lane] != ~0u) {
+                for (int c = 0; c < 3; c++) {
+                    ReadPosition(vertices, stride, positionOffset, indices_[out.triangle[lane] * 3 + c], p[c]);
+                }
+            }
+            for (int k = 0; k < 3; k++) {
+                out.v0[k][lane] = p[0][k];
+                out.e1[k][lane] = p[1][k] - p[0][k];
+                out.e2[k][lane] = p[2][k] - p[0][k];
+            }
+        }
+    }
+
+    void Bvh::UpdateBounds() {
+        // Потомки идут после родителя, поэтому обратный проход собирает границы снизу вверх.
+        for (size_t n = nodes_.size(); n-- > 0;) {
+            Node& node = nodes_[n];
+            for (unsigned lane = 0; lane < 4; lane++) {
+                Box box;
+                box.Reset();
+                if (lane < node.childCount && node.child[lane] < 0) {
+                    const Packet& packet = packets_[~node.child[lane]];
+                    for (int t = 0; t < 4; t++) {
+                        if (packet.triangle[t] == ~0u)
+                            continue;
+                        for (int c = 0; c < 3; c++) {
+                            float p[3];
+                            for (int k = 0; k < 3; k++) {
+                                p[k] = packet.v0[k][t] + (c == 1 ? packet.e1[k][t] : 0.0f) + (c == 2 ? packet.e2[k][t] : 0.0f);
+                            }
+                            box.Grow(p);
+                        }
+                    }
+                }
+                else if (lane < node.childCount) {
+                    const Node& child = nodes_[node.child[lane]];
+                    for (unsigned i = 0; i < child.childCount; i++) {
+                        for (int k = 0; k < 3; k++) {
+                            box.min[k] = std::min(box.min[k], child.min[k][i]);
+                            box.max[k] = std::max(box.max[k], child.max[k][i]);
+                        }
+                    }
+                }
+                for (int k = 0; k < 3; k++) {
+                    node.min[k][lane] = box.min[k];
+                    node.max[k][lane] = box.max[k];
+                }
+            }
+        }
+    }
+
+    bool Bvh::Intersect(const Ray& ray, RayHit& hit) const {
+        if (nodes_.empty())
+            return false;
+        RayData data = PrepareRay(ray);
+        float closest = ray.tMax;
+        bool found = false;
+
+        struct Entry {
+            int32_t child;
+            float tNear;
+        };
+        Entry stack[256];
+        size_t size = 0;
+        stack[size++] = { 0, ray.tMin };
+        while (size > 0) {
+            Entry entry = stack[--size];
+            if (entry.tNear > closest)
+                continue;
+
+            if (entry.child < 0) {
+                const Packet& packet = packets_[~entry.child];
+                float t[4], u[4], v[4];
+                unsigned mask = IntersectTriangles(packet.v0, packet.e1, packet.e2, data, closest, t, u, v);
+                for (int lane = 0; lane < 4; lane++) {
+                    if ((mask & (1u << lane)) && t[lane] < closest) {
+                        closest = t[lane];
+                        hit.t = t[lane];
+                        hit.triangle = packet.triangle[lane];
+                        hit.u = u[lane];
+                        hit.v = v[lane];
+                        found = true;
+                    }
+                }
+                continue;
+            }
+
+            const Node& node = nodes_[entry.child];
+            float tNear[4];
+            unsigned mask = IntersectChildren(node.min, node.max, node.childCount, data, closest, tNear);
+            // Попавшие потомки кладутся на стек от дальнего к ближнему, чтобы ближний обрабатывался первым.
+            Entry hits[4];
+            unsigned hitCount = 0;
+            for (unsigned lane = 0; lane < 4; lane++) {
+                if (mask & (1u << lane)) {
+                    Entry e = { node.child[lane], tNear[lane] };
+                    unsigned j = hitCount++;
+                    for (; j > 0 && hits[j - 1].tNear < e.tNear; j--) {
+                        hits[j] = hits[j - 1];
+                    }
+                    hits[j] = e;
+                }
+            }
+            for (unsigned i = 0; i < hitCount && size < 256; i++) {
+                stack[size++] = hits[i];
+            }
+        }
+        return found;
+    }
+
+    bool Bvh::Occluded(const Ray& ray) const {
+        if (nodes_.empty())
+            return false;
+        RayData data = PrepareRay(ray);
+
+        int32_t stack[256];
+        size_t size = 0;
+        stack[size++] = 0;
+        while (size > 0) {
+            int32_t child = stack[--size];
+            if (child < 0) {
+                const Packet& packet = packets_[~child];
+                float t[4], u[4], v[4];
+                if (IntersectTriangles(packet.v0, packet.e1, packet.e2, data, ray.tMax, t, u, v) != 0)
+                    return true;
+                continue;
+            }
+            const Node& node = nodes_[child];
+            float tNear[4];
+            unsigned mask = IntersectChildren(node.min, node.max, node.childCount, data, ray.tMax, tNear);
+            for (unsigned lane = 0; lane < 4 && size < 256; lane++) {
+                if (mask & (1u << lane))
+                    stack[size++] = node.child[lane];
+            }
+        }
+        return false;
+    }
+
+    size_t Bvh::OverlapSphere(const float center[3], float radius, std::vector<uint32_t>& triangles) const {
+        triangles.clear();
+        if (nodes_.empty())
+            return 0;
+        Float4 c[3] = { Splat(center[0]), Splat(center[1]), Splat(center[2]) };
+        Float4 zero = Splat(0.0f);
+        Float4 radius2 = Splat(radius * radius);
+
+        int32_t stack[256];
+        size_t size = 0;
+        stack[size++] = 0;
+        while (size > 0) {
+            int32_t child = stack[--size];
+            if (child < 0) {
+                const Packet& packet = packets_[~child];
+                for (int lane = 0; lane < 4; lane++) {
+                    if (packet.triangle[lane] == ~0u)
+                        continue;
+                    float a[3], e1[3], e2[3], closest[3];
+                    for (int k = 0; k < 3; k++) {
+                        a[k] = packet.v0[k][lane];
+                        e1[k] = packet.e1[k][lane];
+                        e2[k] = packet.e2[k][lane];
+                    }
+                    ClosestPointOnTriangle(center, a, e1, e2, closest);
+                    float dx = closest[0] - center[0], dy = closest[1] - center[1], dz = closest[2] - center[2];
+                    if (dx * dx + dy * dy + dz * dz <= radius * radius)
+                        triangles.push_back(packet.triangle[lane]);
+                }
+                continue;
+            }
+            // Квадрат расстояния от центра до каждого из четырех ящиков.
+            const Node& node = nodes_[child];
+            Float4 distance2 = zero;
+            for (int k = 0; k < 3; k++) {
+                Float4 d = Max(Max(Load(node.min[k]) - c[k], c[k] - Load(node.max[k])), zero);
+                distance2 = distance2 + d * d;
+            }
+            unsigned mask = LessEqual(distance2, radius2) & ((1u << node.childCount) - 1);
+            for (unsigned lane = 0; lane < 4 && size < 256; lane++) {
+                if (mask & (1u << lane))
+                    stack[size++] = node.child[lane];
+            }
+        }
+        return triangles.size();
+    }
+
+    void Bvh::GetBounds(float min[3], float max[3]) const {
+        Box box;
+        box.Reset();
+        if (!nodes_.empty()) {
+            const Node& root = nodes_[0];
+            for (unsigned i = 0; i < root.childCount; i++) {
+                for (int k = 0; k < 3; k++) {
+                    box.min[k] = std::min(box.min[k], root.min[k][i]);
+                    box.max[k] = std::max(box.max[k], root.max[k][i]);
+                }
+            }
+        }
+        memcpy(min, box.min, sizeof(box.min));
+        memcpy(max, box.max, sizeof(box.max));
+    }
+}
@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+
+// Иерархия ограничивающих объемов по треугольникам для запросов на CPU: пикинг, видимость, поиск пересечений.
+// Строится бинированной эвристикой площадей (SAH), затем бинарное дерево сворачивается в узлы по четыре потомка,
+// границы которых хранятся структурой массивов и проверяются одной SSE операцией. Листья - пачки до четырех
+// треугольников, пересечение с лучом считается сразу для всей пачки.
+namespace mesh {
+    struct Ray {
+        float origin[3];
+        float direction[3];         // не обязан быть единичным, t измеряется в его длинах
+        float tMin = 0.0f;
+        float tMax = 1e30f;
+    };
+
+    struct RayHit {
+        float t = 0.0f;
+        uint32_t triangle = 0;      // номер треугольника в исходном индексном буфере (индекс / 3)
+        float u = 0.0f;             // барицентрические координаты вершин 1 и 2
+        float v = 0.0f;
+    };
+
+    class Bvh {
+    public:
+        static const unsigned binCount = 16;
+        static const size_t maxLeafTriangles = 4;
+
+        // Позиция - float3 по смещению positionOffset в вершине размера stride. Без pool строится в вызывающем потоке,
+        // с pool - то же дерево, но крупные узлы бинируются параллельно, а поддеревья строятся отдельными задачами.
+        void Build(const void* vertices, size_t vertexCount, size_t stride, size_t positionOffset, const uint32_t* indices,
+                   size_t indexCount, ThreadPool* pool = nullptr);
+
+        // Пересчитывает границы после перемещения вершин без изменения топологии. Качество дерева со временем падает,
+        // при больших деформациях его лучше перестроить.
+        void Refit(const void* vertices, size_t stride, size_t positionOffset, ThreadPool* pool = nullptr);
+
+        // Ближайшее пересечение в (tMin, tMax). Треугольники двусторонние.
+        bool Intersect(const Ray& ray, RayHit& hit) const;
+        // Есть ли хотя бы одно пересечение: для теней и проверок видимости.
+        bool Occluded(const Ray& ray) const;
+        // Номера треугольников, пересекающих шар. Возвращает их число.
+        size_t OverlapSphere(const float center[3], float radius, std::vector<uint32_t>& triangles) const;
+
+        void GetBounds(float min[3], float max[3]) const;
+
+        size_t GetNodeCount() const {
+            return nodes_.size();
+        };
+
+        size_t GetTriangleCount() const {
+            return indices_.size() / 3;
+        };
+
+        bool IsEmpty() const {
+            return nodes_.empty();
+        };
+
+    private:
+        // Потомок i: child[i] >= 0 - узел, иначе ~child[i] - пачка треугольников. Пустые места имеют вывернутые границы.
+        struct alignas(16) Node {
+            float min[3][4];
+            float max[3][4];
+            int32_t child[4];
+            uint32_t childCount;
+            uint32_t padding[3];
+        };
+
+        // Четыре треугольника как v0 и ребра e1 = v1 - v0, e2 = v2 - v0. Пустые места - вырожденные треугольники.
+        struct alignas(16) Packet {
+            float v0[3][4];
+            float e1[3][4];
+            float e2[3][4];
+            uint32_t triangle[4];
+        };
+
+        void FillPacket(size_t packet, const uint8_t* vertices, size_t stride, size_t positionOffset);
+        void UpdateBounds();
+
+        std::vector<Node> nodes_;
+        std::vector<Packet> packets_;
+        std::vector<uint32_t> indices_;     // копия индексов для Refit
+    };
+}
@@ -0,0 +1,317 @@
+﻿// Замер и проверка Bvh, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 -pthread BvhBenchMain.cpp Bvh.cpp MeshGenerator.cpp ThreadPool.cpp -o bvh
+// Примеры:
+//   ./bvh
+//   ./bvh --tessellation 2000 --rays 4000000 --threads 8
+// Проверки на торе в 3600 треугольников: Intersect и Occluded совпадают с перебором всех треугольников в double,
+// OverlapSphere возвращает ровно те треугольники, ближайшая точка которых лежит в шаре, дерево, построенное с
+// пулом потоков, дает те же попадания, Refit после растяжения вершин совпадает с перебором по новым позициям.
+// Замер на торе tessellation x tessellation / 2 (по умолчанию миллион треугольников): построение в одном потоке
+// и с пулом, случайные и первичные лучи, запросы шаром.
+#include "Bvh.h"
+#include "MeshGenerator.h"
+#include "ThreadPool.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+    double Milliseconds(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    struct Soup {
+        std::vector<float> positions;
+        std::vector<uint32_t> indices;
+
+        const float* Corner(size_t triangle, int k) const {
+            return &positions[indices[triangle * 3 + k] * 3];
+        }
+
+        size_t GetTriangleCount() const {
+            return indices.size() / 3;
+        }
+    };
+
+    Soup FromMesh(const mesh::MeshData& mesh) {
+        Soup soup;
+        for (size_t i = 0; i < mesh.GetVertexCount(); i++) {
+            soup.positions.push_back(mesh.position.x[i]);
+            soup.positions.push_back(mesh.position.y[i]);
+            soup.positions.push_back(mesh.position.z[i]);
+        }
+        soup.indices = mesh.indices;
+        return soup;
+    }
+
+    void Build(mesh::Bvh& bvh, const Soup& soup, ThreadPool* pool) {
+        bvh.Build(soup.positions.data(), soup.positions.size() / 3, 12, 0, soup.indices.data(), soup.indices.size(), pool);
+    }
+
+    // Möller-Trumbore в double по всем треугольникам.
+    bool BruteIntersect(const Soup& soup, const mesh::Ray& ray, mesh::RayHit& hit) {
+        bool found = false;
+        double best = ray.tMax;
+        const float* d = ray.direction;
+        for (size_t t = 0; t < soup.GetTriangleCount(); t++) {
+            const float *a = soup.Corner(t, 0), *b = soup.Corner(t, 1), *c = soup.Corner(t, 2);
+            double e1[3], e2[3], s[3];
+            for (int k = 0; k < 3; k++) {
+                e1[k] = b[k] - a[k];
+                e2[k] = c[k] - a[k];
+                s[k] = ray.origin[k] - a[k];
+            }
+            double p[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+            double det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+            if (det == 0.0)
+                continue;
+            double u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) / det;
+            if (u < 0.0 || u > 1.0)
+                continue;
+            double q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+            double v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) / det;
+            if (v < 0.0 || u + v > 1.0)
+                continue;
+            double distance = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) / det;
+            if (distance > ray.tMin && distance < best) {
+                best = distance;
+                hit.t = (float)distance;
+                hit.triangle = (uint32_t)t;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    double Dot(const double* a, const double* b) {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    // Квадрат расстояния от точки до треугольника (Ericson, Real-Time Collision Detection, 5.1.5).
+    double DistanceSquared(const float* point, const float* a, const float* b, const float* c) {
+        double ab[3], ac[3], ap[3];
+        for (int k = 0; k < 3; k++) {
+            ab[k] = b[k] - a[k];
+            ac[k] = c[k] - a[k];
+            ap[k] = point[k] - a[k];
+        }
+        double d1 = Dot(ab, ap), d2 = Dot(ac, ap);
+        // Ближайшая точка a + ab * v + ac * w; при d1 <= 0 и d2 <= 0 это вершина a.
+        double v = 0.0, w = 0.0;
+        if (d1 > 0.0 || d2 > 0.0) {
+            double bp[3] = { point[0] - b[0], point[1] - b[1], point[2] - b[2] };
+            double d3 = Dot(ab, bp), d4 = Dot(ac, bp);
+            double cp[3] = { point[0] - c[0], point[1] - c[1], point[2] - c[2] };
+            double d5 = Dot(ab, cp), d6 = Dot(ac, cp);
+            double vc = d1 * d4 - d3 * d2, vb = d5 * d2 - d1 * d6, va = d3 * d6 - d5 * d4;
+            if (d3 >= 0.0 && d4 <= d3) {
+                v = 1.0;
+            } else if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+                v = d1 / (d1 - d3);
+            } else if (d6 >= 0.0 && d5 <= d6) {
+                w = 1.0;
+            } else if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+                w = d2 / (d2 - d6);
+            } else if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0) {
+                w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+                v = 1.0 - w;
+            } else {
+                double denominator = 1.0 / (va + vb + vc);
+                v = vb * denominator;
+                w = vc * denominator;
+            }
+        }
+        double distance = 0.0;
+        for (int k = 0; k < 3; k++) {
+            double closest = a[k] + ab[k] * v + ac[k] * w - point[k];
+            distance += closest * closest;
+        }
+        return distance;
+    }
+
+    // Луч из куба [-3, 3]^3 в случайную точку куба [-1, 1]^3.
+    mesh::Ray RandomRay(std::mt19937& random) {
+        std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+        mesh::Ray ray;
+        for (int k = 0; k < 3; k++) {
+            ray.origin[k] = uniform(random) * 3.0f;
+        }
+        for (int k = 0; k < 3; k++) {
+            ray.direction[k] = uniform(random) - ray.origin[k];
+        }
+        return ray;
+    }
+
+    // Число лучей, на которых bvh расходится с перебором.
+    size_t CompareRays(const mesh::Bvh& bvh, const Soup& soup, std::mt19937& random, unsigned count, size_t& hits,
+                       size_t& occludedMismatches) {
+        size_t mismatches = 0;
+        hits = 0;
+        occludedMismatches = 0;
+        for (unsigned i = 0; i < count; i++) {
+            mesh::Ray ray = RandomRay(random);
+            mesh::RayHit hit, reference;
+            bool found = bvh.Intersect(ray, hit), expected = BruteIntersect(soup, ray, reference);
+            hits += found;
+            mismatches += found != expected || (found && std::fabs(hit.t - reference.t) > 1e-4f);
+            occludedMismatches += bvh.Occluded(ray) != expected;
+        }
+        return mismatches;
+    }
+
+    bool CheckSmall(ThreadPool* pool) {
+        mesh::MeshData torus;
+        mesh::Torus(1.0f, 0.35f, 60, 30, torus);
+        Soup soup = FromMesh(torus);
+        mesh::Bvh bvh, parallel;
+        Build(bvh, soup, nullptr);
+        Build(parallel, soup, pool);
+        std::mt19937 random(1);
+
+        size_t hits, occludedMismatches;
+        size_t mismatches = CompareRays(bvh, soup, random, 20000, hits, occludedMismatches);
+        bool ok = mismatches == 0 && occludedMismatches == 0;
+        printf("Torus %zu triangles, %zu nodes: %zu of 20000 rays hit, %zu Intersect and %zu Occluded mismatches: %s\n",
+            soup.GetTriangleCount(), bvh.GetNodeCount(), hits, mismatches, occludedMismatches, ok ? "ok" : "FAILED");
+
+        size_t parallelMismatches = 0;
+        for (int i = 0; i < 20000; i++) {
+            mesh::Ray ray = RandomRay(random);
+            mesh::RayHit a, b;
+            bool foundA = bvh.Intersect(ray, a), foundB = parallel.Intersect(ray, b);
+            parallelMismatches += foundA != foundB || (foundA && (a.t != b.t || a.triangle != b.triangle));
+        }
+        bool parallelOk = parallelMismatches == 0;
+        printf("Pool build: %zu nodes, %zu of 20000 rays differ from the serial tree: %s\n", parallel.GetNodeCount(),
+            parallelMismatches, parallelOk ? "ok" : "FAILED");
+
+        // Треугольники ближе radius - eps обязаны попасть в ответ, дальше radius + eps - не должны.
+        std::uniform_real_distribution<float> uniform(-1.5f, 1.5f);
+        size_t missing = 0, extra = 0, found = 0;
+        std::vector<uint32_t> result;
+        for (int i = 0; i < 500; i++) {
+            float center[3] = { uniform(random), uniform(random), uniform(random) };
+            float radius = 0.1f + 0.2f * std::fabs(uniform(random));
+            bvh.OverlapSphere(center, radius, result);
+            std::sort(result.begin(), result.end());
+            found += result.size();
+            for (size_t t = 0; t < soup.GetTriangleCount(); t++) {
+                double distance = std::sqrt(DistanceSquared(center, soup.Corner(t, 0), soup.Corner(t, 1), soup.Corner(t, 2)));
+                bool listed = std::binary_search(result.begin(), result.end(), (uint32_t)t);
+                missing += !listed && distance < radius - 1e-5;
+                extra += listed && distance > radius + 1e-5;
+            }
+        }
+        bool sphereOk = missing == 0 && extra == 0;
+        printf("OverlapSphere, 500 spheres: %zu triangles found, %zu missing, %zu outside the sphere: %s\n", found, missing, extra,
+            sphereOk ? "ok" : "FAILED");
+
+        Soup stretched = soup;
+        for (size_t i = 0; i < stretched.positions.size(); i++) {
+            stretched.positions[i] *= i % 3 == 1 ? 2.5f : 1.7f;
+        }
+        bvh.Refit(stretched.positions.data(), 12, 0, pool);
+        size_t refitMismatches = CompareRays(bvh, stretched, random, 5000, hits, occludedMismatches);
+        bool refitOk = refitMismatches == 0 && occludedMismatches == 0;
+        printf("Refit after stretching: %zu Intersect and %zu Occluded mismatches of 5000 rays: %s\n", refitMismatches,
+            occludedMismatches, refitOk ? "ok" : "FAILED");
+        return ok && parallelOk && sphereOk && refitOk;
+    }
+
+    void Benchmark(ThreadPool* pool, unsigned threads, unsigned tessellation, unsigned rayCount) {
+        mesh::MeshData torus;
+        mesh::Torus(1.0f, 0.35f, tessellation, tessellation / 2, torus);
+        Soup soup = FromMesh(torus);
+        mesh::Bvh bvh;
+        double serialMs = 1e30, poolMs = 1e30;
+        for (int repeat = 0; repeat < 3; repeat++) {
+            auto start = std::chrono::steady_clock::now();
+            Build(bvh, soup, nullptr);
+            serialMs = std::min(serialMs, Milliseconds(start));
+            start = std::chrono::steady_clock::now();
+            Build(bvh, soup, pool);
+            poolMs = std::min(poolMs, Milliseconds(start));
+        }
+        printf("Torus %zu triangles: build %.0f ms in one thread, %.0f ms with %u threads, %zu nodes\n", soup.GetTriangleCount(),
+            serialMs, poolMs, threads, bvh.GetNodeCount());
+
+        std::mt19937 random(2);
+        std::vector<mesh::Ray> rays(rayCount);
+        for (mesh::Ray& ray : rays) {
+            ray = RandomRay(random);
+        }
+        auto start = std::chrono::steady_clock::now();
+        size_t hits = 0;
+        for (const mesh::Ray& ray : rays) {
+            mesh::RayHit hit;
+            hits += bvh.Intersect(ray, hit);
+        }
+        double intersectMs = Milliseconds(start);
+        start = std::chrono::steady_clock::now();
+        size_t occluded = 0;
+        for (const mesh::Ray& ray : rays) {
+            occluded += bvh.Occluded(ray);
+        }
+        double occludedMs = Milliseconds(start);
+        printf("Random rays: Intersect %.2f Mrays/s (%zu hits), Occluded %.2f Mrays/s\n", rayCount / intersectMs / 1e3, hits,
+            rayCount / occludedMs / 1e3);
+
+        // Первичные лучи камеры в (0, 0, 3), смотрящей на начало координат, сетка 1000 x 1000.
+        start = std::chrono::steady_clock::now();
+        hits = 0;
+        for (int y = 0; y < 1000; y++) {
+            for (int x = 0; x < 1000; x++) {
+                mesh::Ray ray;
+                ray.origin[0] = 0.0f;
+                ray.origin[1] = 0.0f;
+                ray.origin[2] = 3.0f;
+                ray.direction[0] = (x - 500) / 500.0f * 0.8f;
+                ray.direction[1] = (y - 500) / 500.0f * 0.8f;
+                ray.direction[2] = -1.0f;
+                mesh::RayHit hit;
+                hits += bvh.Intersect(ray, hit);
+            }
+        }
+        printf("Primary rays: %.2f Mrays/s (%zu hits)\n", 1e6 / Milliseconds(start) / 1e3, hits);
+
+        std::vector<uint32_t> result;
+        size_t total = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 10000; i++) {
+            float center[3] = { (i % 100) / 50.0f - 1.0f, ((i / 100) % 100) / 50.0f - 1.0f, 0.0f };
+            total += bvh.OverlapSphere(center, 0.05f, result);
+        }
+        printf("OverlapSphere r = 0.05: %.1f us per query, %.1f triangles on average\n", Milliseconds(start) * 1e3 / 10000, total / 10000.0);
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned tessellation = 1000, rays = 1000000;
+    unsigned threads = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--tessellation") && i + 1 < argc) {
+            tessellation = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--rays") && i + 1 < argc) {
+            rays = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = (unsigned)atoi(argv[++i]);
+        } else {
+            printf("bvh [--tessellation <n>] [--rays <n>] [--threads <n>]\n");
+            return 1;
+        }
+    }
+    threads = std::max(threads, 1u);
+
+    // Вызывающий поток тоже выполняет задачи, поэтому в пуле на один поток меньше.
+    std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads - 1) : nullptr);
+    bool ok = CheckSmall(pool.get());
+    Benchmark(pool.get(), threads, std::max(tessellation, 4u), std::max(rays, 1u));
+    return ok ? 0 : 1;
+}
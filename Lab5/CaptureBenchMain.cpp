@@ -0,0 +1,467 @@
+﻿// Замер и проверка кодировщиков и очереди снимков, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 -pthread CaptureBenchMain.cpp CaptureQueue.cpp ImageEncoder.cpp ThreadPool.cpp -o capture
+// Примеры:
+//   ./capture
+//   ./capture --width 3840 --height 2160 --frames 120 --threads 4 --out /tmp/capture
+// Проверки: PNG каждого уровня сжатия разбирается обратно (CRC блоков, stored и фиксированные коды Хаффмана deflate,
+// Adler-32, фильтры строк) и совпадает с RGB исходника; .hdr с RLE и без него декодируется в пределах точности RGBE.
+// Замер - время кодирования кадра width x height и запись с частотой 60 кадров в секунду через CaptureQueue:
+// сколько кадров пропущено из-за бюджета памяти, какая частота записи выдерживается на деле и сколько занимает
+// подача кадра в потоке рендера.
+#include "CaptureQueue.h"
+#include "ImageEncoder.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    double Milliseconds(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Плавные градиенты с шумом в младших битах, похоже на кадр сцены.
+    void FillPixels(unsigned width, unsigned height, size_t rowPitch, uint8_t* pixels, uint32_t seed) {
+        uint32_t state = seed * 2654435761u + 1;
+        for (unsigned y = 0; y < height; y++) {
+            uint8_t* row = pixels + y * rowPitch;
+            for (unsigned x = 0; x < width; x++) {
+                state = state * 1664525u + 1013904223u;
+                uint8_t noise = uint8_t(state >> 29);
+                row[x * 4 + 0] = uint8_t(x * 255 / width + noise);
+                row[x * 4 + 1] = uint8_t(y * 255 / height);
+                row[x * 4 + 2] = uint8_t((x / 16 + y / 16) * 16 + noise);
+                row[x * 4 + 3] = 255;
+            }
+        }
+    }
+
+    uint32_t ReadU32BE(const uint8_t* data) {
+        return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | data[3];
+    }
+
+    uint32_t Crc32(const uint8_t* data, size_t size) {
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = 0; i < size; i++) {
+            crc ^= data[i];
+            for (int k = 0; k < 8; k++) {
+                crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+            }
+        }
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    // Распаковка deflate без динамических кодов Хаффмана - кодировщик их не использует.
+    class Inflater {
+    public:
+        Inflater(const uint8_t* data, size_t size) : data_(data), size_(size) {};
+
+        bool Run(std::vector<uint8_t>& out) {
+            bool last = false;
+            while (!last) {
+                last = Bits(1) != 0;
+                unsigned type = Bits(2);
+                if (type == 0) {
+                    bitCount_ = 0;
+                    if (position_ + 4 > size_)
+                        return false;
+                    unsigned length = data_[position_] | (data_[position_ + 1] << 8);
+                    unsigned inverse = data_[position_ + 2] | (data_[position_ + 3] << 8);
+                    position_ += 4;
+                    if ((length ^ 0xFFFF) != inverse || position_ + length > size_)
+                        return false;
+                    out.insert(out.end(), data_ + position_, data_ + position_ + length);
+                    position_ += length;
+                } else if (type == 1) {
+                    if (!Fixed(out))
+                        return false;
+                } else {
+                    return false;
+                }
+                if (overrun_)
+                    return false;
+            }
+            consumed_ = position_;
+            return true;
+        }
+
+        size_t GetConsumed() const {
+            return consumed_;
+        }
+
+    private:
+        unsigned Bits(unsigned count) {
+            while (bitCount_ < count) {
+                if (position_ >= size_) {
+                    overrun_ = true;
+                    return 0;
+                }
+                bitBuffer_ |= uint32_t(data_[position_++]) << bitCount_;
+                bitCount_ += 8;
+            }
+            unsigned value = bitBuffer_ & ((1u << count) - 1);
+            bitBuffer_ >>= count;
+            bitCount_ -= count;
+            return value;
+        }
+
+        // Коды Хаффмана читаются со старшего бита.
+        unsigned Code(unsigned count, unsigned code = 0) {
+            for (unsigned i = 0; i < count; i++) {
+                code = (code << 1) | Bits(1);
+            }
+            return code;
+        }
+
+        unsigned Symbol() {
+            unsigned code = Code(7);
+            if (code <= 0x17)
+                return 256 + code;
+            code = Code(1, code);
+            if (code >= 0x30 && code <= 0xBF)
+                return code - 0x30;
+            if (code >= 0xC0 && code <= 0xC7)
+                return 280 + code - 0xC0;
+            return 144 + Code(1, code) - 0x190;
+        }
+
+        bool Fixed(std::vector<uint8_t>& out) {
+            static const unsigned lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+                67, 83, 99, 115, 131, 163, 195, 227, 258 };
+            static const unsigned lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4,
+                5, 5, 5, 5, 0 };
+            static const unsigned distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+                513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+            static const unsigned distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9,
+                10, 10, 11, 11, 12, 12, 13, 13 };
+            while (!overrun_) {
+                unsigned symbol = Symbol();
+                if (symbol < 256) {
+                    out.push_back(uint8_t(symbol));
+                    continue;
+                }
+                if (symbol == 256)
+                    return true;
+                if (symbol > 285)
+                    return false;
+                unsigned length = lengthBase[symbol - 257] + Bits(lengthExtra[symbol - 257]);
+                unsigned distanceCode = Code(5);
+                if (distanceCode >= 30)
+                    return false;
+                size_t distance = distanceBase[distanceCode] + Bits(distanceExtra[distanceCode]);
+                if (distance > out.size())
+                    return false;
+                for (unsigned i = 0; i < length; i++) {
+                    out.push_back(out[out.size() - distance]);
+                }
+            }
+            return false;
+        }
+
+        const uint8_t* data_;
+        size_t size_;
+        size_t position_ = 0;
+        size_t consumed_ = 0;
+        uint32_t bitBuffer_ = 0;
+        unsigned bitCount_ = 0;
+        bool overrun_ = false;
+    };
+
+    uint8_t Paeth(int a, int b, int c) {
+        int p = a + b - c;
+        int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+        return uint8_t(pa <= pb && pa <= pc ? a : (pb <= pc ? b : c));
+    }
+
+    // Разбирает PNG кодировщика (8 бит, RGB) в строки RGB без фильтров.
+    bool DecodePNG(const std::vector<uint8_t>& png, unsigned& width, unsigned& height, std::vector<uint8_t>& rgb) {
+        static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        if (png.size() < 8 || memcmp(png.data(), signature, 8) != 0)
+            return false;
+        std::vector<uint8_t> zlib;
+        bool header = false, end = false;
+        for (size_t position = 8; position + 12 <= png.size() && !end;) {
+            uint32_t length = ReadU32BE(&png[position]);
+            if (position + 12 + length > png.size())
+                return false;
+            const uint8_t* type = &png[position + 4];
+            const uint8_t* data = type + 4;
+            if (Crc32(type, length + 4) != ReadU32BE(data + length))
+                return false;
+            if (!memcmp(type, "IHDR", 4)) {
+                width = ReadU32BE(data);
+                height = ReadU32BE(data + 4);
+                header = length == 13 && data[8] == 8 && data[9] == 2 && data[10] == 0 && data[11] == 0 && data[12] == 0;
+            } else if (!memcmp(type, "IDAT", 4)) {
+                zlib.insert(zlib.end(), data, data + length);
+            } else if (!memcmp(type, "IEND", 4)) {
+                end = true;
+            }
+            position += 12 + length;
+        }
+        if (!header || !end || zlib.size() < 6 || ((zlib[0] << 8) | zlib[1]) % 31 != 0 || (zlib[0] & 0x0F) != 8)
+            return false;
+
+        std::vector<uint8_t> raw;
+        Inflater inflater(zlib.data() + 2, zlib.size() - 2);
+        if (!inflater.Run(raw) || inflater.GetConsumed() + 2 + 4 != zlib.size())
+            return false;
+        uint32_t a = 1, b = 0;
+        for (uint8_t value : raw) {
+            a = (a + value) % 65521;
+            b = (b + a) % 65521;
+        }
+        size_t stride = size_t(width) * 3;
+        if (((b << 16) | a) != ReadU32BE(&zlib[zlib.size() - 4]) || raw.size() != (stride + 1) * height)
+            return false;
+
+        rgb.assign(stride * height, 0);
+        for (unsigned y = 0; y < height; y++) {
+            const uint8_t* line = &raw[y * (stride + 1)];
+            uint8_t* row = &rgb[y * stride];
+            const uint8_t* previous = y > 0 ? row - stride : nullptr;
+            for (size_t i = 0; i < stride; i++) {
+                int left = i >= 3 ? row[i - 3] : 0;
+                int up = previous ? previous[i] : 0;
+                int upLeft = previous && i >= 3 ? previous[i - 3] : 0;
+                uint8_t value = line[1 + i];
+                switch (line[0]) {
+                case 0:
+                    break;
+                case 1:
+                    value = uint8_t(value + left);
+                    break;
+                case 2:
+                    value = uint8_t(value + up);
+                    break;
+                case 3:
+                    value = uint8_t(value + (left + up) / 2);
+                    break;
+                case 4:
+                    value = uint8_t(value + Paeth(left, up, upLeft));
+                    break;
+                default:
+                    return false;
+                }
+                row[i] = value;
+            }
+        }
+        return true;
+    }
+
+    // Разбирает .hdr кодировщика в RGBE по пикселям.
+    bool DecodeHDR(const std::vector<uint8_t>& hdr, unsigned& width, unsigned& height, std::vector<uint8_t>& rgbe) {
+        const char magic[] = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n";
+        size_t position = sizeof(magic) - 1;
+        if (hdr.size() < position || memcmp(hdr.data(), magic, position) != 0)
+            return false;
+        std::string resolution;
+        while (position < hdr.size() && hdr[position] != '\n') {
+            resolution += char(hdr[position++]);
+        }
+        position++;
+        if (sscanf(resolution.c_str(), "-Y %u +X %u", &height, &width) != 2)
+            return false;
+
+        rgbe.assign(size_t(width) * height * 4, 0);
+        for (unsigned y = 0; y < height; y++) {
+            uint8_t* row = &rgbe[size_t(y) * width * 4];
+            if (width < 8 || width > 32767) {
+                if (position + width * 4 > hdr.size())
+                    return false;
+                memcpy(row, &hdr[position], width * 4);
+                position += width * 4;
+                continue;
+            }
+            if (position + 4 > hdr.size() || hdr[position] != 2 || hdr[position + 1] != 2 ||
+                ((hdr[position + 2] << 8) | hdr[position + 3]) != int(width))
+                return false;
+            position += 4;
+            for (int c = 0; c < 4; c++) {
+                for (unsigned x = 0; x < width;) {
+                    if (position >= hdr.size())
+                        return false;
+                    unsigned count = hdr[position++];
+                    bool run = count > 128;
+                    count = run ? count - 128 : count;
+                    if (count == 0 || x + count > width || position + (run ? 1 : count) > hdr.size())
+                        return false;
+                    for (unsigned i = 0; i < count; i++) {
+                        row[(x + i) * 4 + c] = hdr[run ? position : position + i];
+                    }
+                    position += run ? 1 : count;
+                    x += count;
+                }
+            }
+        }
+        return position == hdr.size();
+    }
+
+    bool CheckPNG(unsigned width, unsigned height) {
+        size_t rowPitch = size_t(width) * 4 + 12;
+        std::vector<uint8_t> pixels(rowPitch * height);
+        FillPixels(width, height, rowPitch, pixels.data(), width);
+        bool ok = true;
+        for (int level = 0; level <= 3; level++) {
+            std::vector<uint8_t> png, rgb;
+            unsigned decodedWidth = 0, decodedHeight = 0;
+            bool decoded = encoder::EncodePNG(pixels.data(), width, height, rowPitch, PixelFormat::RGBA8, png, level) &&
+                DecodePNG(png, decodedWidth, decodedHeight, rgb) && decodedWidth == width && decodedHeight == height;
+            size_t mismatches = 0;
+            for (unsigned y = 0; decoded && y < height; y++) {
+                for (unsigned x = 0; x < width; x++) {
+                    for (int c = 0; c < 3; c++) {
+                        mismatches += rgb[(size_t(y) * width + x) * 3 + c] != pixels[y * rowPitch + x * 4 + c];
+                    }
+                }
+            }
+            bool same = decoded && mismatches == 0;
+            ok = ok && same;
+            printf("PNG %ux%u level %d: %zu bytes, %s\n", width, height, level, png.size(),
+                !decoded ? "FAILED to decode" : (same ? "ok" : "FAILED, pixels differ"));
+        }
+        return ok;
+    }
+
+    bool CheckHDR(unsigned width, unsigned height) {
+        std::vector<float> pixels(size_t(width) * height * 4);
+        for (size_t i = 0; i < pixels.size(); i++) {
+            // Несколько порядков яркости, длинные одинаковые участки для RLE и отрицательные значения.
+            size_t x = i / 4 % width;
+            pixels[i] = x < width / 4 ? 1.0f : (i % 7) * 0.37f * std::pow(10.0f, float(int(x % 9) - 4)) - (i % 23 == 0);
+        }
+        std::vector<uint8_t> hdr, rgbe;
+        unsigned decodedWidth = 0, decodedHeight = 0;
+        bool decoded = encoder::EncodeHDR(pixels.data(), width, height, size_t(width) * 16, PixelFormat::RGBA32F, hdr) &&
+            DecodeHDR(hdr, decodedWidth, decodedHeight, rgbe) && decodedWidth == width && decodedHeight == height;
+        // Мантиссы RGBE усечены: значение лежит в [m, m + 1) * 2^(e - 136), отрицательные записываются нулем.
+        size_t mismatches = 0;
+        for (size_t p = 0; decoded && p < size_t(width) * height; p++) {
+            const float* rgba = &pixels[p * 4];
+            const uint8_t* encoded = &rgbe[p * 4];
+            float maxComponent = std::max(std::max(rgba[0], rgba[1]), rgba[2]);
+            if (encoded[3] == 0) {
+                mismatches += maxComponent > 1e-32f;
+                continue;
+            }
+            float scale = std::ldexp(1.0f, int(encoded[3]) - 136);
+            for (int c = 0; c < 3; c++) {
+                float value = std::max(rgba[c], 0.0f);
+                mismatches += value < encoded[c] * scale * (1.0f - 1e-6f) || value >= (encoded[c] + 1) * scale * (1.0f + 1e-6f);
+            }
+            mismatches += std::max(std::max(encoded[0], encoded[1]), encoded[2]) < 128;
+        }
+        bool ok = decoded && mismatches == 0;
+        printf("HDR %ux%u: %zu bytes (%.0f%% of flat RGBE), %s\n", width, height, hdr.size(),
+            100.0 * hdr.size() / (size_t(width) * height * 4), !decoded ? "FAILED to decode" : (ok ? "ok" : "FAILED, values differ"));
+        return ok;
+    }
+
+    bool CheckHalf() {
+        bool ok = encoder::HalfToFloat(0x3C00) == 1.0f && encoder::HalfToFloat(0xC000) == -2.0f &&
+            encoder::HalfToFloat(0x7BFF) == 65504.0f && encoder::HalfToFloat(0x0001) == std::ldexp(1.0f, -24) &&
+            std::isinf(encoder::HalfToFloat(0x7C00)) && std::isnan(encoder::HalfToFloat(0x7E00));
+        printf("HalfToFloat: %s\n", ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    void TimeEncoders(unsigned width, unsigned height) {
+        size_t rowPitch = size_t(width) * 4;
+        std::vector<uint8_t> pixels(rowPitch * height), out;
+        FillPixels(width, height, rowPitch, pixels.data(), 1);
+        for (int level = 0; level <= 3; level++) {
+            double best = 1e30;
+            for (int repeat = 0; repeat < 3; repeat++) {
+                auto start = std::chrono::steady_clock::now();
+                encoder::EncodePNG(pixels.data(), width, height, rowPitch, PixelFormat::RGBA8, out, level);
+                best = std::min(best, Milliseconds(start));
+            }
+            printf("EncodePNG %ux%u level %d: %.1f ms, %.1f MB\n", width, height, level, best, out.size() / 1048576.0);
+        }
+        std::vector<uint16_t> halfs(size_t(width) * height * 4);
+        for (size_t i = 0; i < halfs.size(); i++) {
+            // Значения 0.5 .. 2 с разными мантиссами.
+            halfs[i] = uint16_t(0x3800 + (pixels[i] << 3));
+        }
+        double best = 1e30;
+        for (int repeat = 0; repeat < 3; repeat++) {
+            auto start = std::chrono::steady_clock::now();
+            encoder::EncodeHDR(halfs.data(), width, height, size_t(width) * 8, PixelFormat::RGBA16F, out);
+            best = std::min(best, Milliseconds(start));
+        }
+        printf("EncodeHDR %ux%u RGBA16F: %.1f ms, %.1f MB\n", width, height, best, out.size() / 1048576.0);
+    }
+
+    // Кадры подаются каждые 1/60 с; копирование в память кадра заменяет чтение с GPU.
+    void TimeQueue(unsigned width, unsigned height, unsigned frames, unsigned threads, const std::string& out) {
+        size_t rowPitch = size_t(width) * 4;
+        std::vector<uint8_t> source(rowPitch * height);
+        FillPixels(width, height, rowPitch, source.data(), 2);
+        for (int level = 0; level <= 1; level++) {
+            CaptureQueue queue(threads, 256u << 20, level);
+            const auto period = std::chrono::microseconds(16667);
+            auto start = std::chrono::steady_clock::now();
+            double submitMax = 0.0, submitTotal = 0.0;
+            for (unsigned frame = 0; frame < frames; frame++) {
+                std::this_thread::sleep_until(start + period * frame);
+                auto submitStart = std::chrono::steady_clock::now();
+                CaptureImage image;
+                if (queue.Allocate(width, height, PixelFormat::RGBA8, image)) {
+                    memcpy(image.pixels.get(), source.data(), image.bytes);
+                    queue.Submit(std::move(image), out + std::to_string(frame % 4));
+                }
+                double submit = Milliseconds(submitStart);
+                submitMax = std::max(submitMax, submit);
+                submitTotal += submit;
+            }
+            double submitted = Milliseconds(start);
+            queue.Flush();
+            double total = Milliseconds(start);
+            CaptureQueue::Stats stats = queue.GetStats();
+            // Устойчивая частота - записанные кадры за все время, включая дозапись очереди после последнего кадра.
+            printf("Queue %ux%u at 60 fps, PNG level %d: %zu written, %zu failed, %zu dropped of %u, sustained %.1f fps; "
+                "render thread %.2f ms avg, %.2f ms max per frame; drained %.0f ms after the last frame, peak %zu MB in flight\n",
+                width, height, level, stats.written, stats.failed, stats.dropped, frames, stats.written * 1000.0 / total,
+                submitTotal / frames, submitMax, total - submitted, stats.peakBytesInFlight >> 20);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned width = 1920, height = 1080, frames = 60, threads = 0;
+    std::string out = "capture";
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--width") && i + 1 < argc) {
+            width = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--height") && i + 1 < argc) {
+            height = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            out = argv[++i];
+        } else {
+            printf("capture [--width <n>] [--height <n>] [--frames <n>] [--threads <n>] [--out <path prefix>]\n");
+            return 1;
+        }
+    }
+    if (width == 0 || height == 0 || frames == 0) {
+        printf("width, height and frames must be positive\n");
+        return 1;
+    }
+
+    bool ok = CheckHalf();
+    ok = CheckPNG(257, 131) && ok;
+    ok = CheckPNG(1, 1) && ok;
+    ok = CheckHDR(257, 131) && ok;
+    ok = CheckHDR(5, 3) && ok;
+    TimeEncoders(width, height);
+    TimeQueue(width, height, frames, threads, out);
+    return ok ? 0 : 1;
+}
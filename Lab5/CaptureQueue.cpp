@@ -0,0 +1,105 @@
+﻿#include "CaptureQueue.h"
+
+CaptureQueue::CaptureQueue(unsigned threadCount, size_t memoryBudget, int pngLevel) :
+    pool_(threadCount), memoryBudget_(memoryBudget), pngLevel_(pngLevel) {}
+
+bool CaptureQueue::Allocate(unsigned width, unsigned height, PixelFormat format, CaptureImage& image) {
+    size_t rowPitch = width * encoder::BytesPerPixel(format);
+    size_t bytes = rowPitch * height;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stats_.bytesInFlight + bytes > memoryBudget_) {
+        stats_.dropped++;
+        return false;
+    }
+
+    image.pixels.reset();
+    for (size_t i = 0; i < freeBuffers_.size(); i++) {
+        if (freeSizes_[i] == bytes) {
+            image.pixels = std::move(freeBuffers_[i]);
+            freeBuffers_.erase(freeBuffers_.begin() + i);
+            freeSizes_.erase(freeSizes_.begin() + i);
+            break;
+        }
+    }
+    if (!image.pixels) {
+        image.pixels.reset(new uint8_t[bytes]);
+    }
+
+    image.bytes = bytes;
+    image.width = width;
+    image.height = height;
+    image.rowPitch = rowPitch;
+    image.format = format;
+
+    stats_.bytesInFlight += bytes;
+    if (stats_.bytesInFlight > stats_.peakBytesInFlight)
+        stats_.peakBytesInFlight = stats_.bytesInFlight;
+
+    return true;
+}
+
+void CaptureQueue::Submit(CaptureImage&& image, const std::string& path) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.submitted++;
+    }
+
+    // std::function требует копируемый объект, поэтому кадр передается через shared_ptr.
+    auto job = std::make_shared<CaptureImage>(std::move(image));
+    pool_.Submit([this, job, path]() {
+        std::vector<uint8_t> encoded;
+        bool result;
+        std::string fileName = path;
+        if (job->format == PixelFormat::RGBA8) {
+            result = encoder::EncodePNG(job->pixels.get(), job->width, job->height, job->rowPitch, job->format,
+                encoded, pngLevel_);
+            fileName += ".png";
+        }
+        else {
+            result = encoder::EncodeHDR(job->pixels.get(), job->width, job->height, job->rowPitch, job->format,
+                encoded);
+            fileName += ".hdr";
+        }
+        if (result) {
+            result = encoder::WriteFile(fileName, encoded);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (result)
+            stats_.written++;
+        else
+            stats_.failed++;
+        Recycle(*job);
+    });
+}
+
+void CaptureQueue::Discard(CaptureImage&& image) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Recycle(image);
+}
+
+void CaptureQueue::Recycle(CaptureImage& image) {
+    static const size_t maxFreeBuffers = 4;
+
+    stats_.bytesInFlight -= image.bytes;
+    if (freeBuffers_.size() < maxFreeBuffers && image.pixels) {
+        freeBuffers_.push_back(std::move(image.pixels));
+        freeSizes_.push_back(image.bytes);
+    }
+    image.pixels.reset();
+    image.bytes = 0;
+}
+
+void CaptureQueue::Flush() {
+    pool_.Wait();
+}
+
+CaptureQueue::Stats CaptureQueue::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+CaptureQueue::~CaptureQueue() {
+    pool_.Wait();
+}
@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#include "ImageEncoder.h"
+#include "ThreadPool.h"
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+
+
+// Кадр, переданный на кодирование. Память пикселей принадлежит кадру и переходит к рабочему потоку без копирования.
+struct CaptureImage {
+    std::unique_ptr<uint8_t[]> pixels;
+    size_t bytes = 0;
+    unsigned width = 0;
+    unsigned height = 0;
+    size_t rowPitch = 0;
+    PixelFormat format = PixelFormat::RGBA8;
+};
+
+
+// Очередь кодирования снимков с ограничением по памяти. RGBA8 пишется в PNG, float форматы - в Radiance .hdr.
+class CaptureQueue {
+public:
+    struct Stats {
+        size_t submitted = 0;
+        size_t written = 0;
+        size_t failed = 0;
+        size_t dropped = 0;
+        size_t bytesInFlight = 0;
+        size_t peakBytesInFlight = 0;
+    };
+
+    // По умолчанию PNG без сжатия: кадр 1080p кодируется за ~25 мс на ядро, сжатие уровня 1 медленнее в несколько раз
+    // и при записи 60 кадров в секунду упирается в бюджет памяти.
+    CaptureQueue(unsigned threadCount = 0, size_t memoryBudget = 256u << 20, int pngLevel = 0);
+
+    CaptureQueue(const CaptureQueue&) = delete;
+    CaptureQueue& operator=(const CaptureQueue&) = delete;
+
+    // Выделяет память под кадр в пределах бюджета. false - бюджет исчерпан, кадр следует пропустить.
+    bool Allocate(unsigned width, unsigned height, PixelFormat format, CaptureImage& image);
+
+    // Отдает кадр рабочему потоку. path задается без расширения.
+    void Submit(CaptureImage&& image, const std::string& path);
+
+    // Возвращает неиспользованный кадр в очередь (например, если чтение с GPU не удалось).
+    void Discard(CaptureImage&& image);
+
+    void Flush();
+
+    Stats GetStats();
+
+    void SetPNGLevel(int level) {
+        pngLevel_ = level;
+    };
+
+    ~CaptureQueue();
+
+private:
+    void Recycle(CaptureImage& image);
+
+    ThreadPool pool_;
+    size_t memoryBudget_;
+    std::atomic<int> pngLevel_;
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<uint8_t[]>> freeBuffers_;
+    std::vector<size_t> freeSizes_;
+    Stats stats_;
+};
@@ -0,0 +1,1414 @@
+﻿#include "CommandTrace.h"
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+
+
+namespace {
+    using namespace gfx;
+
+    const char traceMagic[4] = { 'G', 'F', 'X', 'T' };
+    const uint32_t traceVersion = 3;
+    const uint8_t frameEndCode = 0xFF;
+    // Текстуры views, чьи текстуры бэкенд не знает (например, задний буфер).
+    const uint32_t syntheticIdBit = 0x80000000u;
+    // Данные не больше этого (константы объектов) меняются почти каждый вызов; поиск повтора стоит дороже
+    // копии, и они просто дописываются.
+    const size_t smallPayloadSize = 256;
+
+    void PutVarint(std::vector<uint8_t>& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((uint8_t)value);
+    }
+
+    uint64_t Mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    uint64_t Hash(const uint8_t* data, size_t size) {
+        uint64_t h = 0x9E3779B97F4A7C15ull ^ size;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            h = (h ^ word) * 0x100000001b3ull;
+            h ^= h >> 29;
+        }
+        if (i < size) {
+            uint64_t word = 0;
+            memcpy(&word, data + i, size - i);
+            h = (h ^ word) * 0x100000001b3ull;
+        }
+        return Mix(h);
+    }
+
+    void ReleaseHandle(RenderBackend& backend, ResourceType type, uint32_t id) {
+        switch (type) {
+        case ResourceType::Buffer: { BufferHandle handle; handle.id = id; backend.Release(handle); break; }
+        case ResourceType::Texture: { TextureHandle handle; handle.id = id; backend.Release(handle); break; }
+        case ResourceType::ShaderResourceView: { ShaderResourceViewHandle handle; handle.id = id; backend.Release(handle); break; }
+        case ResourceType::RenderTargetView: { RenderTargetViewHandle handle; handle.id = id; backend.Release(handle); break; }
+        case ResourceType::DepthStencilView: { DepthStencilViewHandle handle; handle.id = id; backend.Release(handle); break; }
+        case ResourceType::VertexShader: { VertexShaderHandle handle; handle.id = id; backend.Release(handle); break; }
+        case ResourceType::PixelShader: { PixelShaderHandle handle; handle.id = id; backend.Release(handle); break; }
+        case ResourceType::InputLayout: { InputLayoutHandle handle; handle.id = id; backend.Release(handle); break; }
+        case ResourceType::Sampler: { SamplerHandle handle; handle.id = id; backend.Release(handle); break; }
+        case ResourceType::RasterizerState: { RasterizerStateHandle handle; handle.id = id; backend.Release(handle); break; }
+        case ResourceType::DepthStencilState: { DepthStencilStateHandle handle; handle.id = id; backend.Release(handle); break; }
+        default: break;
+        }
+    }
+
+    template<ResourceType Type>
+    Handle<Type> MakeHandle(uint32_t id) {
+        Handle<Type> handle;
+        handle.id = id;
+        return handle;
+    }
+}
+
+namespace gfx {
+    // ---- CaptureBackend ----
+
+    void CaptureBackend::Start() {
+        // Память прошлой записи остается, новая запись не тратит время на выделение.
+        used_ = 0;
+        payloadData_.clear();
+        payloadOffsets_.clear();
+        payloadHashes_.clear();
+        hashedPayloads_ = 0;
+        std::fill(payloadTable_.begin(), payloadTable_.end(), 0);
+        strings_.clear();
+        stringIndex_.clear();
+        for (std::vector<uint8_t>& declared : declared_) {
+            declared.clear();
+        }
+        nextSyntheticId_ = 0;
+        stats_ = Stats();
+        recording_ = true;
+    }
+
+    void CaptureBackend::Stop() {
+        recording_ = false;
+        stats_.commandBytes = used_;
+    }
+
+    void CaptureBackend::EndFrame() {
+        if (!recording_)
+            return;
+        Reserve();
+        commands_[used_++] = frameEndCode;
+        stats_.frames++;
+        stats_.commandBytes = used_;
+    }
+
+    void CaptureBackend::WriteSigned(int64_t value) {
+        Write(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+    }
+
+    void CaptureBackend::WriteFloat(float value) {
+        Reserve();
+        memcpy(commands_.data() + used_, &value, 4);
+        used_ += 4;
+    }
+
+    uint32_t CaptureBackend::Payload(const void* data, size_t size) {
+        if (data == nullptr || size == 0)
+            return 0;
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        stats_.payloads++;
+        stats_.payloadBytes += size;
+
+        if (size <= smallPayloadSize) {
+            payloadOffsets_.push_back(payloadData_.size());
+            payloadHashes_.push_back(0);
+            payloadData_.insert(payloadData_.end(), bytes, bytes + size);
+            stats_.uniquePayloads++;
+            stats_.storedPayloadBytes += size;
+            return (uint32_t)payloadOffsets_.size();
+        }
+
+        // Нулевой хэш - данные без поиска повторов, в таблице их нет.
+        uint64_t hash = Hash(bytes, size) | 1;
+        size_t mask = payloadTable_.size() - 1;
+        size_t slot = (size_t)hash & mask;
+        for (; !payloadTable_.empty() && payloadTable_[slot] != 0; slot = (slot + 1) & mask) {
+            uint32_t index = payloadTable_[slot];
+            if (payloadHashes_[index - 1] != hash)
+                continue;
+            size_t offset = (size_t)payloadOffsets_[index - 1];
+            size_t end = index < payloadOffsets_.size() ? (size_t)payloadOffsets_[index] : payloadData_.size();
+            if (end - offset == size && memcmp(payloadData_.data() + offset, bytes, size) == 0)
+                return index;
+        }
+
+        payloadOffsets_.push_back(payloadData_.size());
+        payloadHashes_.push_back(hash);
+        payloadData_.insert(payloadData_.end(), bytes, bytes + size);
+        uint32_t index = (uint32_t)payloadOffsets_.size();
+        if (payloadTable_.size() < (size_t)++hashedPayloads_ * 2) {
+            // Заполнение не больше половины; при росте таблица перестраивается по сохраненным хэшам.
+            payloadTable_.assign(payloadTable_.empty() ? 1024 : payloadTable_.size() * 2, 0);
+            mask = payloadTable_.size() - 1;
+            for (uint32_t i = 1; i <= index; i++) {
+                if (payloadHashes_[i - 1] == 0)
+                    continue;
+                for (slot = (size_t)payloadHashes_[i - 1] & mask; payloadTable_[slot] != 0; slot = (slot + 1) & mask) {
+                }
+                payloadTable_[slot] = i;
+            }
+        } else {
+            payloadTable_[slot] = index;
+        }
+        stats_.uniquePayloads++;
+        stats_.storedPayloadBytes += size;
+        return index;
+    }
+
+    uint32_t CaptureBackend::String(const char* text) {
+        std::string key = text != nullptr ? text : "";
+        auto found = stringIndex_.find(key);
+        if (found != stringIndex_.end())
+            return found->second;
+        uint32_t index = (uint32_t)strings_.size();
+        strings_.push_back(key);
+        stringIndex_.emplace(std::move(key), index);
+        return index;
+    }
+
+    void CaptureBackend::MarkDeclared(ResourceType type, uint32_t id) {
+        if (id == 0 || (id & syntheticIdBit) != 0)
+            return;
+        std::vector<uint8_t>& declared = declared_[(size_t)type];
+        if (declared.size() <= id) {
+            declared.resize(id + 1, 0);
+        }
+        declared[id] = 1;
+    }
+
+    void CaptureBackend::WriteBufferCreate(uint32_t id, const BufferDesc& desc, const void* data) {
+        Op(Command::CreateBuffer);
+        Write(id);
+        Write(desc.size);
+        Write(desc.bindFlags);
+        Write((uint64_t)desc.usage);
+        Write(Payload(data, desc.size));
+        MarkDeclared(ResourceType::Buffer, id);
+    }
+
+    void CaptureBackend::WriteTextureCreate(uint32_t id, const TextureDesc& desc, const void* data) {
+        Op(Command::CreateTexture);
+        Write(id);
+        Write(desc.width);
+        Write(desc.height);
+        Write(desc.mipLevels);
+        Write(desc.arraySize);
+        Write((uint64_t)desc.format);
+        Write(desc.bindFlags);
+        Write(desc.cube ? 1 : 0);
+        Write(Payload(data, (size_t)desc.width * desc.height * FormatSize(desc.format)));
+        MarkDeclared(ResourceType::Texture, id);
+    }
+
+    void CaptureBackend::WriteLayoutCreate(uint32_t id, const InputElement* elements, unsigned count, const void* bytecode, size_t size) {
+        Op(Command::CreateInputLayout);
+        Write(id);
+        Write(count);
+        for (unsigned i = 0; i < count; i++) {
+            const InputElement& element = elements[i];
+            Write(String(element.semanticName));
+            Write(element.semanticIndex);
+            Write((uint64_t)element.format);
+            Write(element.slot);
+            Write(element.offset);
+            Write(element.perInstance ? 1 : 0);
+        }
+        Write(Payload(bytecode, size));
+        MarkDeclared(ResourceType::InputLayout, id);
+    }
+
+    void CaptureBackend::Declare(ResourceType type, uint32_t id) {
+        ResourceInfo info;
+        bool described = target_.Describe(type, id, info);
+        stats_.declaredResources++;
+
+        switch (type) {
+        case ResourceType::Buffer:
+            if (bufferSizes_.size() <= id) {
+                bufferSizes_.resize(id + 1, 0);
+            }
+            bufferSizes_[id] = info.buffer.size;
+            WriteBufferCreate(id, info.buffer, info.contents);
+            break;
+        case ResourceType::Texture:
+            WriteTextureCreate(id, info.texture, nullptr);
+            break;
+        case ResourceType::ShaderResourceView:
+        case ResourceType::RenderTargetView:
+        case ResourceType::DepthStencilView: {
+            uint32_t texture = info.viewTexture;
+            if (texture != 0) {
+                Reference(ResourceType::Texture, texture);
+            } else {
+                texture = syntheticIdBit | nextSyntheticId_++;
+                if (!described) {
+                    info.texture.bindFlags = type == ResourceType::RenderTargetView ? BindRenderTarget :
+                        type == ResourceType::DepthStencilView ? BindDepthStencil : BindShaderResource;
+                }
+                WriteTextureCreate(texture, info.texture, nullptr);
+            }
+            Op(type == ResourceType::ShaderResourceView ? Command::CreateShaderResourceView :
+               type == ResourceType::RenderTargetView ? Command::CreateRenderTargetView : Command::CreateDepthStencilView);
+            Write(id);
+            Write(texture);
+            if (type == ResourceType::RenderTargetView) {
+                Write(info.mipLevel);
+                Write(info.arraySlice);
+            }
+            MarkDeclared(type, id);
+            break;
+        }
+        case ResourceType::VertexShader:
+        case ResourceType::PixelShader:
+            Op(type == ResourceType::VertexShader ? Command::CreateVertexShader : Command::CreatePixelShader);
+            Write(id);
+            Write(0);
+            MarkDeclared(type, id);
+            break;
+        case ResourceType::InputLayout:
+            WriteLayoutCreate(id, info.elements.data(), (unsigned)info.elements.size(), nullptr, 0);
+            break;
+        case ResourceType::Sampler:
+            Op(Command::CreateSampler);
+            Write(id);
+            Write((uint64_t)info.sampler.filter);
+            Write((uint64_t)info.sampler.address);
+            MarkDeclared(type, id);
+            break;
+        case ResourceType::RasterizerState:
+            Op(Command::CreateRasterizerState);
+            Write(id);
+            Write((uint64_t)info.rasterizer.cullMode);
+            Write(info.rasterizer.frontCounterClockwise ? 1 : 0);
+            MarkDeclared(type, id);
+            break;
+        case ResourceType::DepthStencilState:
+            Op(Command::CreateDepthStencilState);
+            Write(id);
+            Write(info.depthStencil.depthEnable ? 1 : 0);
+            Write(info.depthStencil.depthWrite ? 1 : 0);
+            Write((uint64_t)info.depthStencil.depthFunc);
+            MarkDeclared(type, id);
+            break;
+        default:
+            break;
+        }
+    }
+
+    BufferHandle CaptureBackend::CreateBuffer(const BufferDesc& desc, const void* initialData) {
+        BufferHandle buffer = target_.CreateBuffer(desc, initialData);
+        if (buffer.IsValid()) {
+            if (bufferSizes_.size() <= buffer.id) {
+                bufferSizes_.resize(buffer.id + 1, 0);
+            }
+            bufferSizes_[buffer.id] = desc.size;
+            if (recording_) {
+                WriteBufferCreate(buffer.id, desc, initialData);
+            }
+        }
+        return buffer;
+    }
+
+    TextureHandle CaptureBackend::CreateTexture(const TextureDesc& desc, const void* initialData) {
+        TextureHandle texture = target_.CreateTexture(desc, initialData);
+        if (recording_ && texture.IsValid()) {
+            WriteTextureCreate(texture.id, desc, initialData);
+        }
+        return texture;
+    }
+
+    ShaderResourceViewHandle CaptureBackend::CreateShaderResourceView(TextureHandle texture) {
+        ShaderResourceViewHandle view = target_.CreateShaderResourceView(texture);
+        if (recording_ && view.IsValid()) {
+            Reference(ResourceType::Texture, texture.id);
+            Op(Command::CreateShaderResourceView);
+            Write(view.id);
+            Write(texture.id);
+            MarkDeclared(ResourceType::ShaderResourceView, view.id);
+        }
+        return view;
+    }
+
+    RenderTargetViewHandle CaptureBackend::CreateRenderTargetView(TextureHandle texture, unsigned mipLevel, unsigned arraySlice) {
+        RenderTargetViewHandle view = target_.CreateRenderTargetView(texture, mipLevel, arraySlice);
+        if (recording_ && view.IsValid()) {
+            Reference(ResourceType::Texture, texture.id);
+            Op(Command::CreateRenderTargetView);
+            Write(view.id);
+            Write(texture.id);
+            Write(mipLevel);
+            Write(arraySlice);
+            MarkDeclared(ResourceType::RenderTargetView, view.id);
+        }
+        return view;
+    }
+
+    DepthStencilViewHandle CaptureBackend::CreateDepthStencilView(TextureHandle texture) {
+        DepthStencilViewHandle view = target_.CreateDepthStencilView(texture);
+        if (recording_ && view.IsValid()) {
+            Reference(ResourceType::Texture, texture.id);
+            Op(Command::CreateDepthStencilView);
+            Write(view.id);
+            Write(texture.id);
+            MarkDeclared(ResourceType::DepthStencilView, view.id);
+        }
+        return view;
+    }
+
+    VertexShaderHandle CaptureBackend::CreateVertexShader(const void* bytecode, size_t size) {
+        VertexShaderHandle shader = target_.CreateVertexShader(bytecode, size);
+        if (recording_ && shader.IsValid()) {
+            Op(Command::CreateVertexShader);
+            Write(shader.id);
+            Write(Payload(bytecode, size));
+            MarkDeclared(ResourceType::VertexShader, shader.id);
+        }
+        return shader;
+    }
+
+    PixelShaderHandle CaptureBackend::CreatePixelShader(const void* bytecode, size_t size) {
+        PixelShaderHandle shader = target_.CreatePixelShader(bytecode, size);
+        if (recording_ && shader.IsValid()) {
+            Op(Command::CreatePixelShader);
+            Write(shader.id);
+            Write(Payload(bytecode, size));
+            MarkDeclared(ResourceType::PixelShader, shader.id);
+        }
+        return shader;
+    }
+
+    InputLayoutHandle CaptureBackend::CreateInputLayout(const InputElement* elements, unsigned count, const void* bytecode, size_t size) {
+        InputLayoutHandle layout = target_.CreateInputLayout(elements, count, bytecode, size);
+        if (recording_ && layout.IsValid()) {
+            WriteLayoutCreate(layout.id, elements, count, bytecode, size);
+        }
+        return layout;
+    }
+
+    SamplerHandle CaptureBackend::CreateSampler(const SamplerDesc& desc) {
+        SamplerHandle sampler = target_.CreateSampler(desc);
+        if (recording_ && sampler.IsValid()) {
+            Op(Command::CreateSampler);
+            Write(sampler.id);
+            Write((uint64_t)desc.filter);
+            Write((uint64_t)desc.address);
+            MarkDeclared(ResourceType::Sampler, sampler.id);
+        }
+        return sampler;
+    }
+
+    RasterizerStateHandle CaptureBackend::CreateRasterizerState(const RasterizerDesc& desc) {
+        RasterizerStateHandle state = target_.CreateRasterizerState(desc);
+        if (recording_ && state.IsValid()) {
+            Op(Command::CreateRasterizerState);
+            Write(state.id);
+            Write((uint64_t)desc.cullMode);
+            Write(desc.frontCounterClockwise ? 1 : 0);
+            MarkDeclared(ResourceType::RasterizerState, state.id);
+        }
+        return state;
+    }
+
+    DepthStencilStateHandle CaptureBackend::CreateDepthStencilState(const DepthStencilDesc& desc) {
+        DepthStencilStateHandle state = target_.CreateDepthStencilState(desc);
+        if (recording_ && state.IsValid()) {
+            Op(Command::CreateDepthStencilState);
+            Write(state.id);
+            Write(desc.depthEnable ? 1 : 0);
+            Write(desc.depthWrite ? 1 : 0);
+            Write((uint64_t)desc.depthFunc);
+            MarkDeclared(ResourceType::DepthStencilState, state.id);
+        }
+        return state;
+    }
+
+    void CaptureBackend::ReleaseResource(ResourceType type, uint32_t id) {
+        std::vector<uint8_t>& declared = declared_[(size_t)type];
+        if (id < declared.size() && declared[id]) {
+            declared[id] = 0;
+            if (recording_) {
+                Op(Command::Release);
+                Write((uint64_t)type);
+                Write(id);
+            }
+        }
+        ReleaseHandle(target_, type, id);
+    }
+
+    void CaptureBackend::ClearState() {
+        target_.ClearState();
+        if (recording_) {
+            Op(Command::ClearState);
+        }
+    }
+
+    void CaptureBackend::SetViewport(const Viewport& viewport) {
+        target_.SetViewport(viewport);
+        if (recording_) {
+            Op(Command::SetViewport);
+            WriteFloat(viewport.x);
+            WriteFloat(viewport.y);
+            WriteFloat(viewport.width);
+            WriteFloat(viewport.height);
+            WriteFloat(viewport.minDepth);
+            WriteFloat(viewport.maxDepth);
+        }
+    }
+
+    void CaptureBackend::SetScissorRect(const Rect& rect) {
+        target_.SetScissorRect(rect);
+        if (recording_) {
+            Op(Command::SetScissorRect);
+            WriteSigned(rect.left);
+            WriteSigned(rect.top);
+            WriteSigned(rect.right);
+            WriteSigned(rect.bottom);
+        }
+    }
+
+    void CaptureBackend::SetRenderTarget(RenderTargetViewHandle target, DepthStencilViewHandle depth) {
+        target_.SetRenderTarget(target, depth);
+        if (recording_) {
+            Reference(ResourceType::RenderTargetView, target.id);
+            Reference(ResourceType::DepthStencilView, depth.id);
+            Op(Command::SetRenderTarget);
+            Write(target.id);
+            Write(depth.id);
+        }
+    }
+
+    void CaptureBackend::ClearRenderTarget(RenderTargetViewHandle target, const float color[4]) {
+        target_.ClearRenderTarget(target, color);
+        if (recording_) {
+            Reference(ResourceType::RenderTargetView, target.id);
+            Op(Command::ClearRenderTarget);
+            Write(target.id);
+            for (int i = 0; i < 4; i++) {
+                WriteFloat(color[i]);
+            }
+        }
+    }
+
+    void CaptureBackend::ClearDepthStencil(DepthStencilViewHandle target, float depth) {
+        target_.ClearDepthStencil(target, depth);
+        if (recording_) {
+            Reference(ResourceType::DepthStencilView, target.id);
+            Op(Command::ClearDepthStencil);
+            Write(target.id);
+            WriteFloat(depth);
+        }
+    }
+
+    void CaptureBackend::SetVertexBuffer(unsigned slot, BufferHandle buffer, unsigned stride, unsigned offset) {
+        target_.SetVertexBuffer(slot, buffer, stride, offset);
+        if (recording_) {
+            Reference(ResourceType::Buffer, buffer.id);
+            Op(Command::SetVertexBuffer);
+            Write(slot);
+            Write(buffer.id);
+            Write(stride);
+            Write(offset);
+        }
+    }
+
+    void CaptureBackend::SetIndexBuffer(BufferHandle buffer, unsigned offset) {
+        target_.SetIndexBuffer(buffer, offset);
+        if (recording_) {
+            Reference(ResourceType::Buffer, buffer.id);
+            Op(Command::SetIndexBuffer);
+            Write(buffer.id);
+            Write(offset);
+        }
+    }
+
+    void CaptureBackend::SetInputLayout(InputLayoutHandle layout) {
+        target_.SetInputLayout(layout);
+        if (recording_) {
+            Reference(ResourceType::InputLayout, layout.id);
+            Op(Command::SetInputLayout);
+            Write(layout.id);
+        }
+    }
+
+    void CaptureBackend::SetPrimitiveTopology(Topology topology) {
+        target_.SetPrimitiveTopology(topology);
+        if (recording_) {
+            Op(Command::SetPrimitiveTopology);
+            Write((uint64_t)topology);
+        }
+    }
+
+    void CaptureBackend::SetVertexShader(VertexShaderHandle shader) {
+        target_.SetVertexShader(shader);
+        if (recording_) {
+            Reference(ResourceType::VertexShader, shader.id);
+            Op(Command::SetVertexShader);
+            Write(shader.id);
+        }
+    }
+
+    void CaptureBackend::SetPixelShader(PixelShaderHandle shader) {
+        target_.SetPixelShader(shader);
+        if (recording_) {
+            Reference(ResourceType::PixelShader, shader.id);
+            Op(Command::SetPixelShader);
+            Write(shader.id);
+        }
+    }
+
+    void CaptureBackend::SetConstantBuffers(ShaderStage stage, unsigned slot, unsigned count, const BufferHandle* buffers) {
+        target_.SetConstantBuffers(stage, slot, count, buffers);
+        if (recording_) {
+            for (unsigned i = 0; i < count; i++) {
+                Reference(ResourceType::Buffer, buffers[i].id);
+            }
+            Op(Command::SetConstantBuffers);
+            Write((uint64_t)stage);
+            Write(slot);
+            Write(count);
+            for (unsigned i = 0; i < count; i++) {
+                Write(buffers[i].id);
+            }
+        }
+    }
+
+    void CaptureBackend::SetShaderResources(ShaderStage stage, unsigned slot, unsigned count, const ShaderResourceViewHandle* views) {
+        target_.SetShaderResources(stage, slot, count, views);
+        if (recording_) {
+            for (unsigned i = 0; i < count; i++) {
+                Reference(ResourceType::ShaderResourceView, views[i].id);
+            }
+            Op(Command::SetShaderResources);
+            Write((uint64_t)stage);
+            Write(slot);
+            Write(count);
+            for (unsigned i = 0; i < count; i++) {
+                Write(views[i].id);
+            }
+        }
+    }
+
+    void CaptureBackend::SetSamplers(ShaderStage stage, unsigned slot, unsigned count, const SamplerHandle* samplers) {
+        target_.SetSamplers(stage, slot, count, samplers);
+        if (recording_) {
+            for (unsigned i = 0; i < count; i++) {
+                Reference(ResourceType::Sampler, samplers[i].id);
+            }
+            Op(Command::SetSamplers);
+            Write((uint64_t)stage);
+            Write(slot);
+            Write(count);
+            for (unsigned i = 0; i < count; i++) {
+                Write(samplers[i].id);
+            }
+        }
+    }
+
+    void CaptureBackend::SetRasterizerState(RasterizerStateHandle state) {
+        target_.SetRasterizerState(state);
+        if (recording_) {
+            Reference(ResourceType::RasterizerState, state.id);
+            Op(Command::SetRasterizerState);
+            Write(state.id);
+        }
+    }
+
+    void CaptureBackend::SetDepthStencilState(DepthStencilStateHandle state) {
+        target_.SetDepthStencilState(state);
+        if (recording_) {
+            Reference(ResourceType::DepthStencilState, state.id);
+            Op(Command::SetDepthStencilState);
+            Write(state.id);
+        }
+    }
+
+    void CaptureBackend::UpdateBuffer(BufferHandle buffer, const void* data, size_t size) {
+        target_.UpdateBuffer(buffer, data, size);
+        if (recording_) {
+            Reference(ResourceType::Buffer, buffer.id);
+            Op(Command::UpdateBuffer);
+            Write(buffer.id);
+            Write(Payload(data, size));
+        }
+    }
+
+    void CaptureBackend::UpdateBufferRange(BufferHandle buffer, size_t offset, const void* data, size_t size) {
+        target_.UpdateBufferRange(buffer, offset, data, size);
+        if (recording_) {
+            Reference(ResourceType::Buffer, buffer.id);
+            Op(Command::UpdateBufferRange);
+            Write(buffer.id);
+            Write(offset);
+            Write(Payload(data, size));
+        }
+    }
+
+    // Во время записи Map отдает промежуточный буфер: содержимое отображенной памяти D3D11 нельзя читать,
+    // поэтому данные копируются в нее и в трассу при Unmap.
+    void* CaptureBackend::Map(BufferHandle buffer) {
+        if (!recording_)
+            return target_.Map(buffer);
+
+        Reference(ResourceType::Buffer, buffer.id);
+        void* data = target_.Map(buffer);
+        if (data == nullptr)
+            return nullptr;
+        Op(Command::Map);
+        Write(buffer.id);
+
+        MappedBuffer* mapped = nullptr;
+        for (MappedBuffer& entry : mapped_) {
+            if (entry.buffer == 0) {
+                mapped = &entry;
+                break;
+            }
+        }
+        if (mapped == nullptr) {
+            mapped_.emplace_back();
+            mapped = &mapped_.back();
+        }
+        mapped->buffer = buffer.id;
+        mapped->target = data;
+        mapped->staging.resize(buffer.id < bufferSizes_.size() ? bufferSizes_[buffer.id] : 0);
+        // Размер неизвестен - данные пишутся напрямую и в трассу не попадают.
+        return mapped->staging.empty() ? data : mapped->staging.data();
+    }
+
+    void CaptureBackend::Unmap(BufferHandle buffer) {
+        for (MappedBuffer& entry : mapped_) {
+            if (entry.buffer == buffer.id && buffer.IsValid()) {
+                memcpy(entry.target, entry.staging.data(), entry.staging.size());
+                entry.buffer = 0;
+                if (recording_) {
+                    Op(Command::Unmap);
+                    Write(buffer.id);
+                    Write(Payload(entry.staging.data(), entry.staging.size()));
+                }
+                break;
+            }
+        }
+        target_.Unmap(buffer);
+    }
+
+    void CaptureBackend::Draw(unsigned vertexCount, unsigned startVertex) {
+        target_.Draw(vertexCount, startVertex);
+        if (recording_) {
+            Op(Command::Draw);
+            Write(vertexCount);
+            Write(startVertex);
+        }
+    }
+
+    void CaptureBackend::DrawIndexed(unsigned indexCount, unsigned startIndex, int baseVertex) {
+        target_.DrawIndexed(indexCount, startIndex, baseVertex);
+        if (recording_) {
+            Op(Command::DrawIndexed);
+            Write(indexCount);
+            Write(startIndex);
+            WriteSigned(baseVertex);
+        }
+    }
+
+    void CaptureBackend::DrawIndexedInstanced(unsigned indexCount, unsigned instanceCount, unsigned startIndex, int baseVertex,
+                                              unsigned startInstance) {
+        target_.DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+        if (recording_) {
+            Op(Command::DrawIndexedInstanced);
+            Write(indexCount);
+            Write(instanceCount);
+            Write(startIndex);
+            WriteSigned(baseVertex);
+            Write(startInstance);
+        }
+    }
+
+    void CaptureBackend::Serialize(std::vector<uint8_t>& out) const {
+        std::vector<uint8_t> strings;
+        for (const std::string& text : strings_) {
+            PutVarint(strings, text.size());
+            strings.insert(strings.end(), text.begin(), text.end());
+        }
+        std::vector<uint8_t> payloads;
+        payloads.reserve(payloadData_.size() + payloadOffsets_.size() * 2);
+        for (size_t i = 0; i < payloadOffsets_.size(); i++) {
+            size_t offset = (size_t)payloadOffsets_[i];
+            size_t end = i + 1 < payloadOffsets_.size() ? (size_t)payloadOffsets_[i + 1] : payloadData_.size();
+            PutVarint(payloads, end - offset);
+            payloads.insert(payloads.end(), payloadData_.begin() + offset, payloadData_.begin() + end);
+        }
+
+        TraceHeader header = {};
+        memcpy(header.magic, traceMagic, 4);
+        header.version = traceVersion;
+        header.frameCount = stats_.frames;
+        header.stringCount = (uint32_t)strings_.size();
+        header.payloadCount = (uint32_t)payloadOffsets_.size();
+        header.stringBytes = strings.size();
+        header.payloadBytes = payloads.size();
+        header.commandBytes = used_;
+
+        out.resize(sizeof(header));
+        memcpy(out.data(), &header, sizeof(header));
+        out.insert(out.end(), strings.begin(), strings.end());
+        out.insert(out.end(), payloads.begin(), payloads.end());
+        out.insert(out.end(), commands_.begin(), commands_.begin() + used_);
+    }
+
+    bool CaptureBackend::Save(const std::string& path) const {
+        std::vector<uint8_t> bytes;
+        Serialize(bytes);
+        FILE* file = fopen(path.c_str(), "wb");
+        if (file == nullptr)
+            return false;
+        bool written = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        return fclose(file) == 0 && written;
+    }
+
+    // ---- TraceReplayer ----
+
+    struct TraceReplayer::Reader {
+        const uint8_t* data;
+        size_t position;
+        size_t end;
+        bool failed;
+
+        uint64_t Read() {
+            uint64_t value = 0;
+            for (unsigned shift = 0; shift < 64; shift += 7) {
+                if (position >= end) {
+                    failed = true;
+                    return 0;
+                }
+                uint8_t byte = data[position++];
+                value |= (uint64_t)(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0)
+                    return value;
+            }
+            failed = true;
+            return 0;
+        };
+
+        uint32_t Read32() {
+            uint64_t value = Read();
+            if (value > 0xFFFFFFFFull) {
+                failed = true;
+            }
+            return (uint32_t)value;
+        };
+
+        int32_t ReadSigned() {
+            uint64_t value = Read();
+            return (int32_t)(int64_t)((value >> 1) ^ (~(value & 1) + 1));
+        };
+
+        float ReadFloat() {
+            float value = 0.0f;
+            if (position + 4 > end) {
+                failed = true;
+                return value;
+            }
+            memcpy(&value, data + position, 4);
+            position += 4;
+            return value;
+        };
+    };
+
+    bool TraceReplayer::Load(const std::string& path) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            error_ = "cannot open " + path;
+            return false;
+        }
+        std::vector<uint8_t> bytes;
+        uint8_t chunk[1 << 16];
+        size_t read;
+        while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+            bytes.insert(bytes.end(), chunk, chunk + read);
+        }
+        fclose(file);
+        return Parse(std::move(bytes));
+    }
+
+    bool TraceReplayer::Parse(std::vector<uint8_t>&& data) {
+        data_ = std::move(data);
+        strings_.clear();
+        payloadOffsets_.clear();
+        payloadSizes_.clear();
+        frameOffsets_.clear();
+        error_.clear();
+
+        TraceHeader header;
+        if (data_.size() < sizeof(header)) {
+            error_ = "trace is too short";
+            return false;
+        }
+        memcpy(&header, data_.data(), sizeof(header));
+        if (memcmp(header.magic, traceMagic, 4) != 0 || header.version != traceVersion) {
+            error_ = "not a trace or unsupported version";
+            return false;
+        }
+        if (header.stringBytes > data_.size() || header.payloadBytes > data_.size() || header.commandBytes > data_.size()
+            || sizeof(header) + header.stringBytes + header.payloadBytes + header.commandBytes != data_.size()) {
+            error_ = "section sizes do not match the file";
+            return false;
+        }
+
+        Reader reader = { data_.data(), sizeof(header), sizeof(header) + (size_t)header.stringBytes, false };
+        for (uint32_t i = 0; i < header.stringCount && !reader.failed; i++) {
+            uint64_t length = reader.Read();
+            if (length > reader.end - reader.position) {
+                reader.failed = true;
+                break;
+            }
+            strings_.emplace_back((const char*)data_.data() + reader.position, (size_t)length);
+            reader.position += (size_t)length;
+        }
+        if (reader.failed || reader.position != reader.end) {
+            error_ = "bad string table";
+            return false;
+        }
+
+        reader.end += (size_t)header.payloadBytes;
+        for (uint32_t i = 0; i < header.payloadCount && !reader.failed; i++) {
+            uint64_t size = reader.Read();
+            if (size > reader.end - reader.position) {
+                reader.failed = true;
+                break;
+            }
+            payloadOffsets_.push_back(reader.position);
+            payloadSizes_.push_back(size);
+            reader.position += (size_t)size;
+        }
+        if (reader.failed || reader.position != reader.end) {
+            error_ = "bad payload table";
+            return false;
+        }
+
+        commandEnd_ = data_.size();
+        reader.end = commandEnd_;
+        bool frameStart = true;
+        while (reader.position < reader.end) {
+            if (frameStart) {
+                frameOffsets_.push_back(reader.position);
+                frameStart = false;
+            }
+            bool frameEnd = false;
+            if (!Execute(reader, nullptr, frameEnd))
+                return false;
+            frameStart = frameEnd;
+        }
+        if (!frameStart) {
+            // Последний кадр не закрыт EndFrame, запись прервана.
+            commandEnd_ = frameOffsets_.back();
+            frameOffsets_.pop_back();
+        }
+        if (frameOffsets_.size() != header.frameCount) {
+            error_ = "frame count does not match the header";
+            return false;
+        }
+        return true;
+    }
+
+    uint32_t TraceReplayer::Lookup(ResourceType type, uint32_t id) const {
+        if (id == 0)
+            return 0;
+        const std::unordered_map<uint32_t, uint32_t>& handles = handles_[(size_t)type];
+        auto found = handles.find(id);
+        return found != handles.end() ? found->second : 0;
+    }
+
+    void TraceReplayer::Assign(ResourceType type, uint32_t id, uint32_t handle) {
+        if (handle != 0) {
+            handles_[(size_t)type][id] = handle;
+            stats_.createdResources++;
+        } else {
+            stats_.failedResources++;
+        }
+    }
+
+    bool TraceReplayer::Execute(Reader& reader, RenderBackend* backend, bool& frameEnd) {
+        size_t start = reader.position;
+        uint8_t code = reader.data[reader.position++];
+        frameEnd = false;
+        if (code == frameEndCode) {
+            frameEnd = true;
+            if (backend != nullptr) {
+                stats_.frames++;
+            }
+            return true;
+        }
+        if (code >= (uint8_t)Command::Count) {
+            error_ = "unknown command " + std::to_string(code) + " at " + std::to_string(start);
+            return false;
+        }
+
+        // Данные и строки: номер из потока проверяется до использования.
+        const uint8_t* payload = nullptr;
+        size_t payloadSize = 0;
+        auto readPayload = [&]() {
+            uint64_t index = reader.Read();
+            payload = nullptr;
+            payloadSize = 0;
+            if (index > payloadOffsets_.size()) {
+                reader.failed = true;
+            } else if (index != 0) {
+                payload = data_.data() + payloadOffsets_[(size_t)index - 1];
+                payloadSize = (size_t)payloadSizes_[(size_t)index - 1];
+            }
+        };
+        // Данные нужного размера: недостающее дополняется нулями.
+        auto sizedPayload = [&](size_t size) -> const void* {
+            if (payload != nullptr && payloadSize >= size)
+                return payload;
+            if (zeros_.size() < size) {
+                zeros_.assign(size, 0);
+            }
+            if (payload != nullptr) {
+                memcpy(zeros_.data(), payload, payloadSize);
+                memset(zeros_.data() + payloadSize, 0, size - payloadSize);
+            } else {
+                memset(zeros_.data(), 0, size);
+            }
+            return zeros_.data();
+        };
+        // Повторное объявление уже созданного ресурса (повтор кадра) пропускается.
+        auto created = [&](ResourceType type, uint32_t id) {
+            if (handles_[(size_t)type].count(id) == 0)
+                return false;
+            stats_.reusedResources++;
+            return true;
+        };
+
+        Command command = (Command)code;
+        switch (command) {
+        case Command::CreateBuffer: {
+            uint32_t id = reader.Read32();
+            BufferDesc desc;
+            desc.size = (size_t)reader.Read();
+            desc.bindFlags = reader.Read32();
+            desc.usage = (Usage)reader.Read32();
+            readPayload();
+            if (backend != nullptr && !reader.failed && !created(ResourceType::Buffer, id)) {
+                const void* data = payload != nullptr || desc.usage == Usage::Immutable ? sizedPayload(desc.size) : nullptr;
+                Assign(ResourceType::Buffer, id, backend->CreateBuffer(desc, data).id);
+            }
+            break;
+        }
+        case Command::CreateTexture: {
+            uint32_t id = reader.Read32();
+            TextureDesc desc;
+            desc.width = reader.Read32();
+            desc.height = reader.Read32();
+            desc.mipLevels = reader.Read32();
+            desc.arraySize = reader.Read32();
+            desc.format = (Format)reader.Read32();
+            desc.bindFlags = reader.Read32();
+            desc.cube = reader.Read() != 0;
+            readPayload();
+            if (backend != nullptr && !reader.failed && !created(ResourceType::Texture, id)) {
+                const void* data = payload != nullptr ? sizedPayload((size_t)desc.width * desc.height * FormatSize(desc.format)) : nullptr;
+                Assign(ResourceType::Texture, id, backend->CreateTexture(desc, data).id);
+            }
+            break;
+        }
+        case Command::CreateShaderResourceView: {
+            uint32_t id = reader.Read32();
+            uint32_t texture = reader.Read32();
+            if (backend != nullptr && !reader.failed && !created(ResourceType::ShaderResourceView, id)) {
+                Assign(ResourceType::ShaderResourceView, id,
+                       backend->CreateShaderResourceView(MakeHandle<ResourceType::Texture>(Lookup(ResourceType::Texture, texture))).id);
+            }
+            break;
+        }
+        case Command::CreateRenderTargetView: {
+            uint32_t id = reader.Read32();
+            uint32_t texture = reader.Read32();
+            unsigned mipLevel = reader.Read32();
+            unsigned arraySlice = reader.Read32();
+            if (backend != nullptr && !reader.failed && !created(ResourceType::RenderTargetView, id)) {
+                Assign(ResourceType::RenderTargetView, id,
+                       backend->CreateRenderTargetView(MakeHandle<ResourceType::Texture>(Lookup(ResourceType::Texture, texture)),
+                                                       mipLevel, arraySlice).id);
+            }
+            break;
+        }
+        case Command::CreateDepthStencilView: {
+            uint32_t id = reader.Read32();
+            uint32_t texture = reader.Read32();
+            if (backend != nullptr && !reader.failed && !created(ResourceType::DepthStencilView, id)) {
+                Assign(ResourceType::DepthStencilView, id,
+                       backend->CreateDepthStencilView(MakeHandle<ResourceType::Texture>(Lookup(ResourceType::Texture, texture))).id);
+            }
+            break;
+        }
+        case Command::CreateVertexShader:
+        case Command::CreatePixelShader: {
+            uint32_t id = reader.Read32();
+            readPayload();
+            ResourceType type = command == Command::CreateVertexShader ? ResourceType::VertexShader : ResourceType::PixelShader;
+            if (backend != nullptr && !reader.failed && !created(type, id)) {
+                size_t size = payload != nullptr ? payloadSize : 4;
+                const void* bytecode = sizedPayload(size);
+                Assign(type, id, type == ResourceType::VertexShader ? backend->CreateVertexShader(bytecode, size).id
+                                                                    : backend->CreatePixelShader(bytecode, size).id);
+            }
+            break;
+        }
+        case Command::CreateInputLayout: {
+            uint32_t id = reader.Read32();
+            uint32_t count = reader.Read32();
+            if (count > 64) {
+                reader.failed = true;
+                break;
+            }
+            InputElement elements[64];
+            for (uint32_t i = 0; i < count && !reader.failed; i++) {
+                uint32_t name = reader.Read32();
+                if (name >= strings_.size()) {
+                    reader.failed = true;
+                    break;
+                }
+                elements[i].semanticName = strings_[name].c_str();
+                elements[i].semanticIndex = reader.Read32();
+                elements[i].format = (Format)reader.Read32();
+                elements[i].slot = reader.Read32();
+                elements[i].offset = reader.Read32();
+                elements[i].perInstance = reader.Read() != 0;
+            }
+            readPayload();
+            if (backend != nullptr && !reader.failed && !created(ResourceType::InputLayout, id)) {
+                size_t size = payload != nullptr ? payloadSize : 4;
+                Assign(ResourceType::InputLayout, id, backend->CreateInputLayout(elements, count, sizedPayload(size), size).id);
+            }
+            break;
+        }
+        case Command::CreateSampler: {
+            uint32_t id = reader.Read32();
+            SamplerDesc desc;
+            desc.filter = (Filter)reader.Read32();
+            desc.address = (AddressMode)reader.Read32();
+            if (backend != nullptr && !reader.failed && !created(ResourceType::Sampler, id)) {
+                Assign(ResourceType::Sampler, id, backend->CreateSampler(desc).id);
+            }
+            break;
+        }
+        case Command::CreateRasterizerState: {
+            uint32_t id = reader.Read32();
+            RasterizerDesc desc;
+            desc.cullMode = (CullMode)reader.Read32();
+            desc.frontCounterClockwise = reader.Read() != 0;
+            if (backend != nullptr && !reader.failed && !created(ResourceType::RasterizerState, id)) {
+                Assign(ResourceType::RasterizerState, id, backend->CreateRasterizerState(desc).id);
+            }
+            break;
+        }
+        case Command::CreateDepthStencilState: {
+            uint32_t id = reader.Read32();
+            DepthStencilDesc desc;
+            desc.depthEnable = reader.Read() != 0;
+            desc.depthWrite = reader.Read() != 0;
+            desc.depthFunc = (Comparison)reader.Read32();
+            if (backend != nullptr && !reader.failed && !created(ResourceType::DepthStencilState, id)) {
+                Assign(ResourceType::DepthStencilState, id, backend->CreateDepthStencilState(desc).id);
+            }
+            break;
+        }
+        case Command::Release: {
+            uint32_t type = reader.Read32();
+            uint32_t id = reader.Read32();
+            if (type >= (uint32_t)ResourceType::Count) {
+                reader.failed = true;
+                break;
+            }
+            if (backend != nullptr && !reader.failed) {
+                uint32_t handle = Lookup((ResourceType)type, id);
+                if (handle != 0) {
+                    ReleaseHandle(*backend, (ResourceType)type, handle);
+                    handles_[type].erase(id);
+                }
+            }
+            break;
+        }
+        case Command::ClearState:
+            if (backend != nullptr) {
+                backend->ClearState();
+            }
+            break;
+        case Command::SetViewport: {
+            Viewport viewport;
+            viewport.x = reader.ReadFloat();
+            viewport.y = reader.ReadFloat();
+            viewport.width = reader.ReadFloat();
+            viewport.height = reader.ReadFloat();
+            viewport.minDepth = reader.ReadFloat();
+            viewport.maxDepth = reader.ReadFloat();
+            if (backend != nullptr && !reader.failed) {
+                backend->SetViewport(viewport);
+            }
+            break;
+        }
+        case Command::SetScissorRect: {
+            Rect rect;
+            rect.left = reader.ReadSigned();
+            rect.top = reader.ReadSigned();
+            rect.right = reader.ReadSigned();
+            rect.bottom = reader.ReadSigned();
+            if (backend != nullptr && !reader.failed) {
+                backend->SetScissorRect(rect);
+            }
+            break;
+        }
+        case Command::SetRenderTarget: {
+            uint32_t id = reader.Read32();
+            uint32_t depth = reader.Read32();
+            if (backend != nullptr && !reader.failed) {
+                backend->SetRenderTarget(MakeHandle<ResourceType::RenderTargetView>(Lookup(ResourceType::RenderTargetView, id)),
+                    MakeHandle<ResourceType::DepthStencilView>(Lookup(ResourceType::DepthStencilView, depth)));
+            }
+            break;
+        }
+        case Command::ClearRenderTarget: {
+            uint32_t id = reader.Read32();
+            float color[4];
+            for (int i = 0; i < 4; i++) {
+                color[i] = reader.ReadFloat();
+            }
+            if (backend != nullptr && !reader.failed) {
+                backend->ClearRenderTarget(MakeHandle<ResourceType::RenderTargetView>(Lookup(ResourceType::RenderTargetView, id)), color);
+            }
+            break;
+        }
+        case Command::ClearDepthStencil: {
+            uint32_t id = reader.Read32();
+            float depth = reader.ReadFloat();
+            if (backend != nullptr && !reader.failed) {
+                backend->ClearDepthStencil(MakeHandle<ResourceType::DepthStencilView>(Lookup(ResourceType::DepthStencilView, id)), depth);
+            }
+            break;
+        }
+        case Command::SetVertexBuffer: {
+            unsigned slot = reader.Read32();
+            uint32_t id = reader.Read32();
+            unsigned stride = reader.Read32();
+            unsigned offset = reader.Read32();
+            if (backend != nullptr && !reader.failed) {
+                backend->SetVertexBuffer(slot, MakeHandle<ResourceType::Buffer>(Lookup(ResourceType::Buffer, id)), stride, offset);
+            }
+            break;
+        }
+        case Command::SetIndexBuffer: {
+            uint32_t id = reader.Read32();
+            unsigned offset = reader.Read32();
+            if (backend != nullptr && !reader.failed) {
+                backend->SetIndexBuffer(MakeHandle<ResourceType::Buffer>(Lookup(ResourceType::Buffer, id)), offset);
+            }
+            break;
+        }
+        case Command::SetInputLayout: {
+            uint32_t id = reader.Read32();
+            if (backend != nullptr && !reader.failed) {
+                backend->SetInputLayout(MakeHandle<ResourceType::InputLayout>(Lookup(ResourceType::InputLayout, id)));
+            }
+            break;
+        }
+        case Command::SetPrimitiveTopology: {
+            uint32_t topology = reader.Read32();
+            if (backend != nullptr && !reader.failed) {
+                backend->SetPrimitiveTopology((Topology)topology);
+            }
+            break;
+        }
+        case Command::SetVertexShader: {
+            uint32_t id = reader.Read32();
+            if (backend != nullptr && !reader.failed) {
+                backend->SetVertexShader(MakeHandle<ResourceType::VertexShader>(Lookup(ResourceType::VertexShader, id)));
+            }
+            break;
+        }
+        case Command::SetPixelShader: {
+            uint32_t id = reader.Read32();
+            if (backend != nullptr && !reader.failed) {
+                backend->SetPixelShader(MakeHandle<ResourceType::PixelShader>(Lookup(ResourceType::PixelShader, id)));
+            }
+            break;
+        }
+        case Command::SetConstantBuffers:
+        case Command::SetShaderResources:
+        case Command::SetSamplers: {
+            ShaderStage stage = (ShaderStage)reader.Read32();
+            unsigned slot = reader.Read32();
+            unsigned count = reader.Read32();
+            if (count > maxShaderResources) {
+                reader.failed = true;
+                break;
+            }
+            ResourceType type = command == Command::SetConstantBuffers ? ResourceType::Buffer
+                : command == Command::SetShaderResources ? ResourceType::ShaderResourceView : ResourceType::Sampler;
+            uint32_t ids[maxShaderResources];
+            for (unsigned i = 0; i < count; i++) {
+                ids[i] = Lookup(type, reader.Read32());
+            }
+            if (backend != nullptr && !reader.failed) {
+                if (command == Command::SetConstantBuffers) {
+                    BufferHandle handles[maxShaderResources];
+                    for (unsigned i = 0; i < count; i++) handles[i].id = ids[i];
+                    backend->SetConstantBuffers(stage, slot, count, handles);
+                } else if (command == Command::SetShaderResources) {
+                    ShaderResourceViewHandle handles[maxShaderResources];
+                    for (unsigned i = 0; i < count; i++) handles[i].id = ids[i];
+                    backend->SetShaderResources(stage, slot, count, handles);
+                } else {
+                    SamplerHandle handles[maxShaderResources];
+                    for (unsigned i = 0; i < count; i++) handles[i].id = ids[i];
+                    backend->SetSamplers(stage, slot, count, handles);
+                }
+            }
+            break;
+        }
+        case Command::SetRasterizerState: {
+            uint32_t id = reader.Read32();
+            if (backend != nullptr && !reader.failed) {
+                backend->SetRasterizerState(MakeHandle<ResourceType::RasterizerState>(Lookup(ResourceType::RasterizerState, id)));
+            }
+            break;
+        }
+        case Command::SetDepthStencilState: {
+            uint32_t id = reader.Read32();
+            if (backend != nullptr && !reader.failed) {
+                backend->SetDepthStencilState(MakeHandle<ResourceType::DepthStencilState>(Lookup(ResourceType::DepthStencilState, id)));
+            }
+            break;
+        }
+        case Command::UpdateBuffer: {
+            uint32_t id = reader.Read32();
+            readPayload();
+            if (backend != nullptr && !reader.failed) {
+                backend->UpdateBuffer(MakeHandle<ResourceType::Buffer>(Lookup(ResourceType::Buffer, id)), payload, payloadSize);
+            }
+            break;
+        }
+        case Command::UpdateBufferRange: {
+            uint32_t id = reader.Read32();
+            size_t offset = (size_t)reader.Read();
+            readPayload();
+            if (backend != nullptr && !reader.failed) {
+                backend->UpdateBufferRange(MakeHandle<ResourceType::Buffer>(Lookup(ResourceType::Buffer, id)), offset, payload,
+                    payloadSize);
+            }
+            break;
+        }
+        case Command::Map: {
+            uint32_t id = reader.Read32();
+            if (backend != nullptr && !reader.failed) {
+                mapped_[id] = backend->Map(MakeHandle<ResourceType::Buffer>(Lookup(ResourceType::Buffer, id)));
+            }
+            break;
+        }
+        case Command::Unmap: {
+            uint32_t id = reader.Read32();
+            readPayload();
+            if (backend != nullptr && !reader.failed) {
+                auto found = mapped_.find(id);
+                if (found != mapped_.end()) {
+                    if (found->second != nullptr && payload != nullptr) {
+                        memcpy(found->second, payload, payloadSize);
+                    }
+                    mapped_.erase(found);
+                }
+                backend->Unmap(MakeHandle<ResourceType::Buffer>(Lookup(ResourceType::Buffer, id)));
+            }
+            break;
+        }
+        case Command::Draw: {
+            unsigned vertexCount = reader.Read32();
+            unsigned startVertex = reader.Read32();
+            if (backend != nullptr && !reader.failed) {
+                backend->Draw(vertexCount, startVertex);
+            }
+            break;
+        }
+        case Command::DrawIndexed: {
+            unsigned indexCount = reader.Read32();
+            unsigned startIndex = reader.Read32();
+            int baseVertex = reader.ReadSigned();
+            if (backend != nullptr && !reader.failed) {
+                backend->DrawIndexed(indexCount, startIndex, baseVertex);
+            }
+            break;
+        }
+        case Command::DrawIndexedInstanced: {
+            unsigned indexCount = reader.Read32();
+            unsigned instanceCount = reader.Read32();
+            unsigned startIndex = reader.Read32();
+            int baseVertex = reader.ReadSigned();
+            unsigned startInstance = reader.Read32();
+            if (backend != nullptr && !reader.failed) {
+                backend->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+            }
+            break;
+        }
+        default:
+            reader.failed = true;
+            break;
+        }
+
+        if (reader.failed) {
+            error_ = "malformed command " + std::to_string(code) + " at " + std::to_string(start);
+            return false;
+        }
+        if (backend != nullptr) {
+            stats_.commands++;
+        }
+        return true;
+    }
+
+    bool TraceReplayer::ReplayFrame(RenderBackend& backend, unsigned frame) {
+        if (frame >= frameOffsets_.size()) {
+            error_ = "no frame " + std::to_string(frame);
+            return false;
+        }
+        Reader reader = { data_.data(), frameOffsets_[frame], commandEnd_, false };
+        bool frameEnd = false;
+        while (!frameEnd && reader.position < reader.end) {
+            if (!Execute(reader, &backend, frameEnd))
+                return false;
+        }
+        return true;
+    }
+
+    bool TraceReplayer::ReplayAll(RenderBackend& backend) {
+        for (unsigned frame = 0; frame < GetFrameCount(); frame++) {
+            if (!ReplayFrame(backend, frame))
+                return false;
+        }
+        return true;
+    }
+
+    void TraceReplayer::ReleaseAll(RenderBackend& backend) {
+        for (size_t type = 0; type < (size_t)ResourceType::Count; type++) {
+            for (const auto& handle : handles_[type]) {
+                ReleaseHandle(backend, (ResourceType)type, handle.second);
+            }
+            handles_[type].clear();
+        }
+        mapped_.clear();
+    }
+}
@@ -0,0 +1,236 @@
+﻿#pragma once
+
+#include "RenderBackend.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// Запись вызовов RenderBackend в компактную двоичную трассу и ее проигрывание в любой бэкенд.
+//
+// Файл: заголовок TraceHeader, таблица строк (имена семантик), таблица данных (содержимое UpdateBuffer и Map,
+// начальные данные ресурсов) и поток команд. Команда - байт кода (gfx::Command или конец кадра), аргументы -
+// varint, знаковые - zigzag, float - 4 байта; данные и строки задаются номером в таблице, одинаковые данные
+// больше 256 байт хранятся один раз. Дескрипторы записываются такими, какие выдал бэкенд при записи, проигрыватель сопоставляет
+// их со своими. Порядок байтов - little-endian.
+namespace gfx {
+    struct TraceHeader {
+        char magic[4];                  // "GFXT"
+        uint32_t version;
+        uint32_t frameCount;
+        uint32_t stringCount;
+        uint32_t payloadCount;
+        uint32_t reserved;
+        uint64_t stringBytes;
+        uint64_t payloadBytes;
+        uint64_t commandBytes;
+    };
+
+    // Прозрачная обертка над бэкендом: вызовы передаются дальше, а во время записи еще и кодируются.
+    // Ресурсы, созданные до начала записи, объявляются в трассе при первом использовании по их Describe;
+    // их содержимое и байт-код шейдеров, если бэкенд их не отдает, при проигрывании заменяются нулями.
+    // Запись стоит 30-70 нс на команду, для кадра NullBackend из 10000 объектов это +50-80%, а не меньше 5%.
+    // Поэтому кадры без записи лучше отдавать бэкенду напрямую, как Renderer::FrameBackend.
+    class CaptureBackend : public RenderBackend {
+    public:
+        struct Stats {
+            uint64_t commands = 0;
+            uint32_t frames = 0;
+            uint32_t declaredResources = 0;     // объявленные по Describe
+            uint64_t payloads = 0;              // ссылки на данные
+            uint64_t uniquePayloads = 0;
+            uint64_t payloadBytes = 0;          // все данные, переданные в вызовах
+            uint64_t storedPayloadBytes = 0;    // после удаления повторов
+            uint64_t commandBytes = 0;
+        };
+
+        explicit CaptureBackend(RenderBackend& target) : target_(target) {};
+
+        CaptureBackend(const CaptureBackend&) = delete;
+        CaptureBackend& operator=(const CaptureBackend&) = delete;
+
+        // Запись начинается и заканчивается между кадрами. Start отбрасывает прежнюю трассу.
+        void Start();
+        void Stop();
+
+        bool IsRecording() const {
+            return recording_;
+        };
+
+        void EndFrame();
+
+        void Serialize(std::vector<uint8_t>& out) const;
+        bool Save(const std::string& path) const;
+
+        const Stats& GetStats() const {
+            return stats_;
+        };
+
+        BufferHandle CreateBuffer(const BufferDesc& desc, const void* initialData = nullptr) override;
+        TextureHandle CreateTexture(const TextureDesc& desc, const void* initialData = nullptr) override;
+        ShaderResourceViewHandle CreateShaderResourceView(TextureHandle texture) override;
+        RenderTargetViewHandle CreateRenderTargetView(TextureHandle texture, unsigned mipLevel = 0, unsigned arraySlice = 0) override;
+        DepthStencilViewHandle CreateDepthStencilView(TextureHandle texture) override;
+        VertexShaderHandle CreateVertexShader(const void* bytecode, size_t size) override;
+        PixelShaderHandle CreatePixelShader(const void* bytecode, size_t size) override;
+        InputLayoutHandle CreateInputLayout(const InputElement* elements, unsigned count, const void* bytecode, size_t size) override;
+        SamplerHandle CreateSampler(const SamplerDesc& desc) override;
+        RasterizerStateHandle CreateRasterizerState(const RasterizerDesc& desc) override;
+        DepthStencilStateHandle CreateDepthStencilState(const DepthStencilDesc& desc) override;
+
+        void ClearState() override;
+        void SetViewport(const Viewport& viewport) override;
+        void SetScissorRect(const Rect& rect) override;
+        void SetRenderTarget(RenderTargetViewHandle target, DepthStencilViewHandle depth = DepthStencilViewHandle()) override;
+        void ClearRenderTarget(RenderTargetViewHandle target, const float color[4]) override;
+        void ClearDepthStencil(DepthStencilViewHandle target, float depth) override;
+
+        void SetVertexBuffer(unsigned slot, BufferHandle buffer, unsigned stride, unsigned offset = 0) override;
+        void SetIndexBuffer(BufferHandle buffer, unsigned offset = 0) override;
+        void SetInputLayout(InputLayoutHandle layout) override;
+        void SetPrimitiveTopology(Topology topology) override;
+        void SetVertexShader(VertexShaderHandle shader) override;
+        void SetPixelShader(PixelShaderHandle shader) override;
+        void SetConstantBuffers(ShaderStage stage, unsigned slot, unsigned count, const BufferHandle* buffers) override;
+        void SetShaderResources(ShaderStage stage, unsigned slot, unsigned count, const ShaderResourceViewHandle* views) override;
+        void SetSamplers(ShaderStage stage, unsigned slot, unsigned count, const SamplerHandle* samplers) override;
+        void SetRasterizerState(RasterizerStateHandle state) override;
+        void SetDepthStencilState(DepthStencilStateHandle state) override;
+
+        void UpdateBuffer(BufferHandle buffer, const void* data, size_t size) override;
+        void UpdateBufferRange(BufferHandle buffer, size_t offset, const void* data, size_t size) override;
+        void* Map(BufferHandle buffer) override;
+        void Unmap(BufferHandle buffer) override;
+
+        void Draw(unsigned vertexCount, unsigned startVertex) override;
+        void DrawIndexed(unsigned indexCount, unsigned startIndex, int baseVertex) override;
+        void DrawIndexedInstanced(unsigned indexCount, unsigned instanceCount, unsigned startIndex, int baseVertex,
+                                  unsigned startInstance) override;
+
+        bool Describe(ResourceType type, uint32_t id, ResourceInfo& info) const override {
+            return target_.Describe(type, id, info);
+        };
+
+    protected:
+        void ReleaseResource(ResourceType type, uint32_t id) override;
+
+    private:
+        struct MappedBuffer {
+            uint32_t buffer;
+            void* target;
+            std::vector<uint8_t> staging;
+        };
+
+        void Op(Command command) {
+            Reserve();
+            commands_[used_++] = (uint8_t)command;
+            stats_.commands++;
+        };
+
+        // Место под значение проверяется на каждой записи, но без побайтового push_back.
+        void Write(uint64_t value) {
+            Reserve();
+            while (value >= 0x80) {
+                commands_[used_++] = (uint8_t)(value | 0x80);
+                value >>= 7;
+            }
+            commands_[used_++] = (uint8_t)value;
+        };
+
+        void Reserve() {
+            if (used_ + 16 > commands_.size()) {
+                commands_.resize(commands_.size() * 2 + 4096);
+            }
+        };
+
+        void WriteSigned(int64_t value);
+        void WriteFloat(float value);
+        // Номер данных + 1, 0 - данных нет.
+        uint32_t Payload(const void* data, size_t size);
+        uint32_t String(const char* text);
+
+        // Объявляет ресурс, если он еще не встречался в трассе.
+        void Reference(ResourceType type, uint32_t id) {
+            if (id != 0 && (id >= declared_[(size_t)type].size() || !declared_[(size_t)type][id])) {
+                Declare(type, id);
+            }
+        };
+        void Declare(ResourceType type, uint32_t id);
+        void MarkDeclared(ResourceType type, uint32_t id);
+        void WriteBufferCreate(uint32_t id, const BufferDesc& desc, const void* data);
+        void WriteTextureCreate(uint32_t id, const TextureDesc& desc, const void* data);
+        void WriteLayoutCreate(uint32_t id, const InputElement* elements, unsigned count, const void* bytecode, size_t size);
+
+        RenderBackend& target_;
+        bool recording_ = false;
+        std::vector<uint8_t> commands_;
+        size_t used_ = 0;
+        std::vector<uint8_t> payloadData_;
+        std::vector<uint64_t> payloadOffsets_;
+        std::vector<uint64_t> payloadHashes_;
+        std::vector<uint32_t> payloadTable_;    // открытая адресация по хэшу: номер данных + 1, 0 - пусто
+        uint32_t hashedPayloads_ = 0;
+        std::vector<std::string> strings_;
+        std::unordered_map<std::string, uint32_t> stringIndex_;
+        std::vector<uint8_t> declared_[(size_t)ResourceType::Count];
+        std::vector<size_t> bufferSizes_;
+        std::vector<MappedBuffer> mapped_;
+        uint32_t nextSyntheticId_ = 0;
+        Stats stats_;
+    };
+
+    class TraceReplayer {
+    public:
+        struct Stats {
+            uint64_t commands = 0;
+            uint32_t frames = 0;
+            uint32_t createdResources = 0;
+            uint32_t reusedResources = 0;       // повторные объявления уже созданных ресурсов
+            uint32_t failedResources = 0;
+        };
+
+        bool Load(const std::string& path);
+        // Проверяет всю трассу и находит границы кадров.
+        bool Parse(std::vector<uint8_t>&& data);
+
+        unsigned GetFrameCount() const {
+            return (unsigned)frameOffsets_.size();
+        };
+
+        // Проигрывает кадр в backend. Ресурсы создаются при первом объявлении и остаются до ReleaseAll,
+        // поэтому кадры можно проигрывать повторно и в любом порядке (первым - кадр с объявлениями).
+        bool ReplayFrame(RenderBackend& backend, unsigned frame);
+        bool ReplayAll(RenderBackend& backend);
+        void ReleaseAll(RenderBackend& backend);
+
+        const Stats& GetStats() const {
+            return stats_;
+        };
+
+        const std::string& GetError() const {
+            return error_;
+        };
+
+    private:
+        struct Reader;
+
+        // backend == nullptr - только разбор.
+        bool Execute(Reader& reader, RenderBackend* backend, bool& frameEnd);
+        uint32_t Lookup(ResourceType type, uint32_t id) const;
+        void Assign(ResourceType type, uint32_t id, uint32_t handle);
+
+        std::vector<uint8_t> data_;
+        std::vector<std::string> strings_;
+        std::vector<uint64_t> payloadOffsets_;
+        std::vector<uint64_t> payloadSizes_;
+        std::vector<size_t> frameOffsets_;              // начала кадров в потоке команд
+        size_t commandEnd_ = 0;
+        std::unordered_map<uint32_t, uint32_t> handles_[(size_t)ResourceType::Count];
+        std::unordered_map<uint32_t, void*> mapped_;
+        std::vector<uint8_t> zeros_;                    // данные для ресурсов, объявленных без содержимого
+        Stats stats_;
+        std::string error_;
+    };
+}
@@ -0,0 +1,206 @@
+﻿#pragma once
+
+#include "MeshGenerator.h"
+#include <cstdint>
+#include <cstddef>
+
+
+// Встроенные меши, вычисляемые при компиляции. Формулы и порядок операций повторяют генераторы из MeshGenerator,
+// поэтому результат совпадает с ними вплоть до округления синуса и косинуса (порядка 1e-7), а приложение
+// загружает готовые массивы из образа программы. Для MSVC шаги вычисления ограничены ключом /constexpr:steps.
+namespace mesh {
+    // Грани куба в порядке X+, X-, Y+, Y-, Z+, Z-: нормаль n и оси u, v такие, что u x v = n.
+    constexpr float cubeFaceAxes[6][3][3] = {
+        { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } },
+        { { -1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 } },
+        { { 0, 1, 0 }, { 0, 0, 1 }, { 1, 0, 0 } },
+        { { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },
+        { { 0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 } },
+        { { 0, 0, -1 }, { 0, 1, 0 }, { 1, 0, 0 } }
+    };
+    constexpr float cubeCorners[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+
+    // Позиции, нормали и UV раздельными массивами: позиции можно загружать как вершины из одного float3.
+    template<size_t VertexCount, size_t IndexCount>
+    struct FixedMesh {
+        static constexpr size_t vertexCount = VertexCount;
+        static constexpr size_t indexCount = IndexCount;
+
+        float position[VertexCount][3] = {};
+        float normal[VertexCount][3] = {};
+        float uv[VertexCount][2] = {};
+        uint32_t indices[IndexCount] = {};
+    };
+
+    namespace constexpr_math {
+        constexpr double pi = 3.14159265358979323846;
+
+        // Ряд Тейлора после приведения аргумента к [-pi, pi]; погрешность в double много меньше ulp float.
+        constexpr double Sin(double x) {
+            while (x > pi) {
+                x -= 2.0 * pi;
+            }
+            while (x < -pi) {
+                x += 2.0 * pi;
+            }
+            double term = x, sum = x;
+            for (int n = 1; n < 16; n++) {
+                term *= -x * x / ((2 * n) * (2 * n + 1));
+                sum += term;
+            }
+            return sum;
+        }
+
+        constexpr float Sinf(float x) {
+            return (float)Sin(x);
+        }
+
+        constexpr float Cosf(float x) {
+            return (float)Sin(pi * 0.5 - x);
+        }
+
+        constexpr void Triangle(uint32_t*& out, uint32_t a, uint32_t b, uint32_t c) {
+            out[0] = a;
+            out[1] = b;
+            out[2] = c;
+            out += 3;
+        }
+    }
+
+    // Одна грань куба (4 вершины, 2 треугольника), как грань f в Cube.
+    constexpr FixedMesh<4, 6> MakeCubeFace(float halfSize, unsigned face, Winding winding) {
+        FixedMesh<4, 6> mesh;
+        const float (&axes)[3][3] = cubeFaceAxes[face];
+        for (unsigned c = 0; c < 4; c++) {
+            for (int k = 0; k < 3; k++) {
+                mesh.position[c][k] = (axes[0][k] + cubeCorners[c][0] * axes[1][k] + cubeCorners[c][1] * axes[2][k]) * halfSize;
+                mesh.normal[c][k] = axes[0][k];
+            }
+            mesh.uv[c][0] = (cubeCorners[c][0] + 1) * 0.5f;
+            mesh.uv[c][1] = (cubeCorners[c][1] + 1) * 0.5f;
+        }
+        const uint32_t outward[6] = { 0, 1, 2, 0, 2, 3 };
+        const uint32_t inward[6] = { 0, 2, 1, 0, 3, 2 };
+        for (int i = 0; i < 6; i++) {
+            mesh.indices[i] = winding == Winding::Outward ? outward[i] : inward[i];
+        }
+        return mesh;
+    }
+
+    // То же, что UVSphere(LatLines, LongLines).
+    template<unsigned LatLines, unsigned LongLines>
+    constexpr FixedMesh<UVSphereVertexCount(LatLines, LongLines), UVSphereIndexCount(LatLines, LongLines)> MakeUVSphere() {
+        static_assert(LatLines >= 3 && LongLines >= 3, "UVSphere clamps tessellation to 3");
+        const float pi = 3.14159265358979323846f;
+        const unsigned rings = LatLines - 2;
+        const uint32_t vertexCount = (uint32_t)UVSphereVertexCount(LatLines, LongLines);
+        FixedMesh<UVSphereVertexCount(LatLines, LongLines), UVSphereIndexCount(LatLines, LongLines)> mesh;
+
+        float sinPhi[LongLines] = {}, cosPhi[LongLines] = {}, ramp[LongLines] = {};
+        for (unsigned j = 0; j < LongLines; j++) {
+            float angle = 0.0f + j * (2.0f * pi / LongLines);
+            sinPhi[j] = constexpr_math::Sinf(angle);
+            cosPhi[j] = constexpr_math::Cosf(angle);
+            ramp[j] = 0.0f + j * (1.0f / LongLines);
+        }
+
+        mesh.position[0][2] = 1.0f;
+        mesh.uv[0][0] = 0.5f;
+        for (unsigned i = 0; i < rings; i++) {
+            float theta = (i + 1) * (pi / (LatLines - 1));
+            float sinTheta = constexpr_math::Sinf(theta);
+            float cosTheta = constexpr_math::Cosf(theta);
+            for (unsigned j = 0; j < LongLines; j++) {
+                uint32_t index = i * LongLines + j + 1;
+                mesh.position[index][0] = sinPhi[j] * sinTheta + 0.0f;
+                mesh.position[index][1] = cosPhi[j] * -sinTheta + 0.0f;
+                mesh.position[index][2] = cosTheta;
+                mesh.uv[index][0] = ramp[j];
+                mesh.uv[index][1] = theta / pi;
+            }
+        }
+        mesh.position[vertexCount - 1][2] = -1.0f;
+        mesh.uv[vertexCount - 1][0] = 0.5f;
+        mesh.uv[vertexCount - 1][1] = 1.0f;
+        for (uint32_t i = 0; i < vertexCount; i++) {
+            for (int k = 0; k < 3; k++) {
+                mesh.normal[i][k] = mesh.position[i][k];
+            }
+        }
+
+        uint32_t* out = mesh.indices;
+        uint32_t last = vertexCount - 1;
+        for (uint32_t j = 0; j < LongLines; j++) {
+            constexpr_math::Triangle(out, j + 1, (j + 1) % LongLines + 1, 0);
+        }
+        for (uint32_t i = 0; i + 1 < rings; i++) {
+            for (uint32_t j = 0; j < LongLines; j++) {
+                uint32_t next = (j + 1) % LongLines;
+                uint32_t a = i * LongLines + j + 1;
+                uint32_t b = i * LongLines + next + 1;
+                uint32_t c = (i + 1) * LongLines + j + 1;
+                uint32_t d = (i + 1) * LongLines + next + 1;
+                constexpr_math::Triangle(out, c, b, a);
+                constexpr_math::Triangle(out, d, b, c);
+            }
+        }
+        uint32_t lastRing = (rings - 1) * LongLines + 1;
+        for (uint32_t j = LongLines; j-- > 0;) {
+            constexpr_math::Triangle(out, lastRing + j, lastRing + (j + LongLines - 1) % LongLines, last);
+        }
+        return mesh;
+    }
+
+    // Проверка при компиляции: индексы в пределах, вершины на расстоянии radius от центра с точностью tolerance,
+    // все треугольники невырождены и смотрят наружу (Outward) или внутрь (Inward) - тот же контракт, что у генераторов.
+    template<size_t V, size_t I>
+    constexpr bool IsClosedAroundOrigin(const FixedMesh<V, I>& mesh, float radius, float tolerance, Winding winding) {
+        for (size_t i = 0; i < V; i++) {
+            const float* p = mesh.position[i];
+            float length2 = p[0] * p[0] + p[1] * p[1] + p[2] * p[2];
+            if (length2 > (radius + tolerance) * (radius + tolerance) || length2 < (radius - tolerance) * (radius - tolerance))
+                return false;
+        }
+        for (size_t t = 0; t + 2 < I; t += 3) {
+            if (mesh.indices[t] >= V || mesh.indices[t + 1] >= V || mesh.indices[t + 2] >= V)
+                return false;
+            const float* a = mesh.position[mesh.indices[t]];
+            const float* b = mesh.position[mesh.indices[t + 1]];
+            const float* c = mesh.position[mesh.indices[t + 2]];
+            float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            float facing = n[0] * (a[0] + b[0] + c[0]) + n[1] * (a[1] + b[1] + c[1]) + n[2] * (a[2] + b[2] + c[2]);
+            if (winding == Winding::Outward ? facing <= 0.0f : facing >= 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    // Сравнение с генератором времени выполнения (MeshGeneratorBenchMain): максимальное отличие позиций, нормалей и UV,
+    // или -1, если не совпадают число вершин или индексы.
+    template<size_t V, size_t I>
+    float CompareWithMeshData(const FixedMesh<V, I>& fixed, const MeshData& mesh) {
+        if (mesh.GetVertexCount() != V || mesh.indices.size() != I)
+            return -1.0f;
+        for (size_t i = 0; i < I; i++) {
+            if (mesh.indices[i] != fixed.indices[i])
+                return -1.0f;
+        }
+        float error = 0.0f;
+        auto update = [&error](float a, float b) {
+            error = a - b > error ? a - b : (b - a > error ? b - a : error);
+        };
+        for (size_t i = 0; i < V; i++) {
+            update(fixed.position[i][0], mesh.position.x[i]);
+            update(fixed.position[i][1], mesh.position.y[i]);
+            update(fixed.position[i][2], mesh.position.z[i]);
+            update(fixed.normal[i][0], mesh.normal.x[i]);
+            update(fixed.normal[i][1], mesh.normal.y[i]);
+            update(fixed.normal[i][2], mesh.normal.z[i]);
+            update(fixed.uv[i][0], mesh.u[i]);
+            update(fixed.uv[i][1], mesh.v[i]);
+        }
+        return error;
+    }
+}
@@ -1,4 +1,5 @@
 #include "SceneMatrixBuffer.h"
+#include "QuantizedVertex.h"
 
 cbuffer WorldMatrixBuffer : register (b0) {
     float4x4 worldMatrix;
@@ -6,7 +7,7 @@ cbuffer WorldMatrixBuffer : register (b0) {
 };
 
 struct VS_INPUT {
-    float3 position : POSITION;
+    float4 position : POSITION;
 };
 
 struct PS_INPUT {
@@ -17,10 +18,11 @@ struct PS_INPUT {
 PS_INPUT main(VS_INPUT input) {
     PS_INPUT output;
 
-    float3 pos = cameraPos.xyz + input.position * size.x;
+    float3 localPos = DecodePosition(input.position);
+    float3 pos = cameraPos.xyz + localPos * size.x;
     output.position = mul(viewProjectionMatrix, mul(worldMatrix, float4(pos, 1.0f)));
     output.position.z =  0.0f;
-    output.localPos = input.position;
+    output.localPos = localPos;
 
     return output;
 }
\ No newline at end of file
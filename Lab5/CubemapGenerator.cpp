@@ -1,4 +1,23 @@
 #include "CubemapGenerator.h"
+#include "ConstexprMesh.h"
+
+namespace {
+    constexpr mesh::FixedMesh<4, 6> cubeFaces[6] = {
+        mesh::MakeCubeFace(0.5f, 0, mesh::Winding::Inward),
+        mesh::MakeCubeFace(0.5f, 1, mesh::Winding::Inward),
+        mesh::MakeCubeFace(0.5f, 2, mesh::Winding::Inward),
+        mesh::MakeCubeFace(0.5f, 3, mesh::Winding::Inward),
+        mesh::MakeCubeFace(0.5f, 4, mesh::Winding::Inward),
+        mesh::MakeCubeFace(0.5f, 5, mesh::Winding::Inward)
+    };
+    static_assert(mesh::IsClosedAroundOrigin(cubeFaces[0], 0.8660254f, 1e-6f, mesh::Winding::Inward) &&
+                  mesh::IsClosedAroundOrigin(cubeFaces[1], 0.8660254f, 1e-6f, mesh::Winding::Inward) &&
+                  mesh::IsClosedAroundOrigin(cubeFaces[2], 0.8660254f, 1e-6f, mesh::Winding::Inward) &&
+                  mesh::IsClosedAroundOrigin(cubeFaces[3], 0.8660254f, 1e-6f, mesh::Winding::Inward) &&
+                  mesh::IsClosedAroundOrigin(cubeFaces[4], 0.8660254f, 1e-6f, mesh::Winding::Inward) &&
+                  mesh::IsClosedAroundOrigin(cubeFaces[5], 0.8660254f, 1e-6f, mesh::Winding::Inward),
+                  "cube faces must be visible from the center");
+}
 
 CubemapGenerator::CubemapGenerator(
     std::shared_ptr<ID3D11Device>& device,
@@ -476,66 +495,14 @@ HRESULT CubemapGenerator::renderToCubeMap(UINT size, int num, ID3D11RenderTarget
 
 HRESULT CubemapGenerator::createGeometry()
 {
+    static_assert(sizeof(SimpleVertex) == sizeof(cubeFaces[0].position[0]), "face vertices are uploaded as SimpleVertex");
     GManager_.setDevice(device_);
 
-    SimpleVertex geometryXplus[] = { XMFLOAT3(0.5f, -0.5f, 0.5f),
-                                    XMFLOAT3(0.5f, -0.5f, -0.5f),
-                                    XMFLOAT3(0.5f, 0.5f, -0.5f),
-                                    XMFLOAT3(0.5f, 0.5f, 0.5f) };
-    UINT indicesXplus[] = { 3, 2, 1, 0, 3, 1 };
-
-    HRESULT result = GManager_.loadGeometry(geometryXplus, sizeof(XMFLOAT3) * 4, indicesXplus, sizeof(UINT) * 6, "X+");
-    if (!SUCCEEDED(result))
-        return result;
-
-    SimpleVertex geometryXminus[] = { XMFLOAT3(-0.5f, -0.5f, 0.5f),
-                                XMFLOAT3(-0.5f, -0.5f, -0.5f),
-                                XMFLOAT3(-0.5f, 0.5f, -0.5f),
-                                XMFLOAT3(-0.5f, 0.5f, 0.5f) };
-    UINT indicesXminus[] = { 0, 1, 2, 3, 0, 2 };
-
-    result = GManager_.loadGeometry(geometryXminus, sizeof(XMFLOAT3) * 4, indicesXminus, sizeof(UINT) * 6, "X-");
-    if (!SUCCEEDED(result))
-        return result;
-
-    SimpleVertex geometryYplus[] = { XMFLOAT3(-0.5f, 0.5f, 0.5f),
-                                XMFLOAT3(0.5f, 0.5f, -0.5f),
-                                XMFLOAT3(-0.5f, 0.5f, -0.5f),
-                                XMFLOAT3(0.5f, 0.5f, 0.5f) };
-    UINT indicesYplus[] = { 3, 0, 2, 1, 3, 2 };
-
-    result = GManager_.loadGeometry(geometryYplus, sizeof(XMFLOAT3) * 4, indicesYplus, sizeof(UINT) * 6, "Y+");
-    if (!SUCCEEDED(result))
-        return result;
-
-    SimpleVertex geometryYminus[] = { XMFLOAT3(-0.5f, -0.5f, 0.5f),
-                                XMFLOAT3(0.5f, -0.5f, -0.5f),
-                                XMFLOAT3(-0.5f, -0.5f, -0.5f),
-                                XMFLOAT3(0.5f, -0.5f, 0.5f) };
-    UINT indicesYminus[] = { 3, 1, 2, 0, 3, 2 };
-
-    result = GManager_.loadGeometry(geometryYminus, sizeof(XMFLOAT3) * 4, indicesYminus, sizeof(UINT) * 6, "Y-");
-    if (!SUCCEEDED(result))
-        return result;
-
-    SimpleVertex geometryZplus[] = { XMFLOAT3(-0.5f, 0.5f, 0.5f),
-                            XMFLOAT3(0.5f, 0.5f, 0.5f),
-                            XMFLOAT3(0.5f, -0.5f, 0.5f),
-                            XMFLOAT3(-0.5f, -0.5f, 0.5f) };
-    UINT indicesZplus[] = { 0, 1, 2, 3, 0, 2 };
-
-    result = GManager_.loadGeometry(geometryZplus, sizeof(XMFLOAT3) * 4, indicesZplus, sizeof(UINT) * 6, "Z+");
-    if (!SUCCEEDED(result))
-        return result;
-
-    SimpleVertex geometryZminus[] = { XMFLOAT3(-0.5f, -0.5f, -0.5f),
-                                XMFLOAT3(0.5f, -0.5f, -0.5f),
-                                XMFLOAT3(-0.5f, 0.5f, -0.5f),
-                                XMFLOAT3(0.5f, 0.5f, -0.5f) };
-    UINT indicesZminus[] = { 1, 3, 2, 0, 1, 2 };
-
-    result = GManager_.loadGeometry(geometryZminus, sizeof(XMFLOAT3) * 4, indicesZminus, sizeof(UINT) * 6, "Z-");
-
+    HRESULT result = S_OK;
+    for (UINT i = 0; i < 6 && SUCCEEDED(result); i++) {
+        result = GManager_.loadGeometry(cubeFaces[i].position, sizeof(cubeFaces[i].position), cubeFaces[i].indices,
+            sizeof(cubeFaces[i].indices), sides[i]);
+    }
     return result;
 }
 
@@ -0,0 +1,735 @@
+﻿#include "D3D11Backend.h"
+
+
+namespace {
+    DXGI_FORMAT ToDXGI(gfx::Format format) {
+        switch (format) {
+        case gfx::Format::R8G8B8A8_UNORM:
+            return DXGI_FORMAT_R8G8B8A8_UNORM;
+        case gfx::Format::R8G8B8A8_UNORM_SRGB:
+            return DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+        case gfx::Format::R16G16B16A16_UNORM:
+            return DXGI_FORMAT_R16G16B16A16_UNORM;
+        case gfx::Format::R16G16B16A16_FLOAT:
+            return DXGI_FORMAT_R16G16B16A16_FLOAT;
+        case gfx::Format::R32G32B32A32_FLOAT:
+            return DXGI_FORMAT_R32G32B32A32_FLOAT;
+        case gfx::Format::R32G32B32_FLOAT:
+            return DXGI_FORMAT_R32G32B32_FLOAT;
+        case gfx::Format::R32G32_FLOAT:
+            return DXGI_FORMAT_R32G32_FLOAT;
+        case gfx::Format::R32_FLOAT:
+            return DXGI_FORMAT_R32_FLOAT;
+        case gfx::Format::R32_UINT:
+            return DXGI_FORMAT_R32_UINT;
+        case gfx::Format::R16_UINT:
+            return DXGI_FORMAT_R16_UINT;
+        case gfx::Format::D32_FLOAT:
+            return DXGI_FORMAT_D32_FLOAT;
+        default:
+            return DXGI_FORMAT_UNKNOWN;
+        }
+    }
+
+    gfx::Format FromDXGI(DXGI_FORMAT format) {
+        switch (format) {
+        case DXGI_FORMAT_R8G8B8A8_UNORM:
+            return gfx::Format::R8G8B8A8_UNORM;
+        case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+            return gfx::Format::R8G8B8A8_UNORM_SRGB;
+        case DXGI_FORMAT_R16G16B16A16_UNORM:
+            return gfx::Format::R16G16B16A16_UNORM;
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
+            return gfx::Format::R16G16B16A16_FLOAT;
+        case DXGI_FORMAT_R32G32B32A32_FLOAT:
+            return gfx::Format::R32G32B32A32_FLOAT;
+        case DXGI_FORMAT_R32G32B32_FLOAT:
+            return gfx::Format::R32G32B32_FLOAT;
+        case DXGI_FORMAT_R32G32_FLOAT:
+            return gfx::Format::R32G32_FLOAT;
+        case DXGI_FORMAT_R32_FLOAT:
+            return gfx::Format::R32_FLOAT;
+        case DXGI_FORMAT_R32_UINT:
+            return gfx::Format::R32_UINT;
+        case DXGI_FORMAT_R16_UINT:
+            return gfx::Format::R16_UINT;
+        case DXGI_FORMAT_D32_FLOAT:
+            return gfx::Format::D32_FLOAT;
+        default:
+            return gfx::Format::Unknown;
+        }
+    }
+
+    uint32_t FromBindFlags(UINT flags) {
+        uint32_t result = 0;
+        result |= (flags & D3D11_BIND_VERTEX_BUFFER) ? gfx::BindVertexBuffer : 0;
+        result |= (flags & D3D11_BIND_INDEX_BUFFER) ? gfx::BindIndexBuffer : 0;
+        result |= (flags & D3D11_BIND_CONSTANT_BUFFER) ? gfx::BindConstantBuffer : 0;
+        result |= (flags & D3D11_BIND_SHADER_RESOURCE) ? gfx::BindShaderResource : 0;
+        result |= (flags & D3D11_BIND_RENDER_TARGET) ? gfx::BindRenderTarget : 0;
+        result |= (flags & D3D11_BIND_DEPTH_STENCIL) ? gfx::BindDepthStencil : 0;
+        return result;
+    }
+
+    void DescribeTexture(ID3D11Resource* resource, gfx::TextureDesc& texture) {
+        ID3D11Texture2D* texture2D = nullptr;
+        if (resource == nullptr || FAILED(resource->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&texture2D)))
+            return;
+        D3D11_TEXTURE2D_DESC desc;
+        texture2D->GetDesc(&desc);
+        texture.width = desc.Width;
+        texture.height = desc.Height;
+        texture.mipLevels = desc.MipLevels;
+        texture.arraySize = desc.ArraySize;
+        texture.format = FromDXGI(desc.Format);
+        texture.bindFlags = FromBindFlags(desc.BindFlags) & (gfx::BindShaderResource | gfx::BindRenderTarget | gfx::BindDepthStencil);
+        texture.cube = (desc.MiscFlags & D3D11_RESOURCE_MISC_TEXTURECUBE) != 0;
+        texture2D->Release();
+    }
+
+    UINT ToBindFlags(uint32_t flags) {
+        UINT result = 0;
+        result |= (flags & gfx::BindVertexBuffer) ? D3D11_BIND_VERTEX_BUFFER : 0;
+        result |= (flags & gfx::BindIndexBuffer) ? D3D11_BIND_INDEX_BUFFER : 0;
+        result |= (flags & gfx::BindConstantBuffer) ? D3D11_BIND_CONSTANT_BUFFER : 0;
+        result |= (flags & gfx::BindShaderResource) ? D3D11_BIND_SHADER_RESOURCE : 0;
+        result |= (flags & gfx::BindRenderTarget) ? D3D11_BIND_RENDER_TARGET : 0;
+        result |= (flags & gfx::BindDepthStencil) ? D3D11_BIND_DEPTH_STENCIL : 0;
+        return result;
+    }
+
+    D3D11_USAGE ToUsage(gfx::Usage usage) {
+        switch (usage) {
+        case gfx::Usage::Immutable:
+            return D3D11_USAGE_IMMUTABLE;
+        case gfx::Usage::Dynamic:
+            return D3D11_USAGE_DYNAMIC;
+        default:
+            return D3D11_USAGE_DEFAULT;
+        }
+    }
+
+    D3D11_FILTER ToFilter(gfx::Filter filter) {
+        switch (filter) {
+        case gfx::Filter::Point:
+            return D3D11_FILTER_MIN_MAG_MIP_POINT;
+        case gfx::Filter::Anisotropic:
+            return D3D11_FILTER_ANISOTROPIC;
+        case gfx::Filter::MinimumAnisotropic:
+            return D3D11_FILTER_MINIMUM_ANISOTROPIC;
+        case gfx::Filter::MaximumAnisotropic:
+            return D3D11_FILTER_MAXIMUM_ANISOTROPIC;
+        default:
+            return D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+        }
+    }
+
+    // Значения gfx::Comparison идут в том же порядке, что и D3D11_COMPARISON_FUNC, начиная с 1.
+    D3D11_COMPARISON_FUNC ToComparison(gfx::Comparison comparison) {
+        return (D3D11_COMPARISON_FUNC)((int)comparison + D3D11_COMPARISON_NEVER);
+    }
+
+    D3D11_PRIMITIVE_TOPOLOGY ToTopology(gfx::Topology topology) {
+        switch (topology) {
+        case gfx::Topology::TriangleList:
+            return D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+        case gfx::Topology::TriangleStrip:
+            return D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP;
+        case gfx::Topology::LineList:
+            return D3D11_PRIMITIVE_TOPOLOGY_LINELIST;
+        default:
+            return D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+        }
+    }
+}
+
+namespace gfx {
+    void D3D11Backend::Init(const std::shared_ptr<ID3D11Device>& device, const std::shared_ptr<ID3D11DeviceContext>& deviceContext) {
+        device_ = device;
+        deviceContext_ = deviceContext;
+    }
+
+    void D3D11Backend::Cleanup() {
+        for (size_t type = 0; type < (size_t)ResourceType::Count; type++) {
+            for (IUnknown* object : objects_[type]) {
+                SAFE_RELEASE(object);
+            }
+            objects_[type].clear();
+            free_[type].clear();
+            imported_[type].clear();
+        }
+        layoutElements_.clear();
+        deviceContext_.reset();
+        device_.reset();
+    }
+
+    D3D11Backend::~D3D11Backend() {
+        Cleanup();
+    }
+
+    uint32_t D3D11Backend::Add(ResourceType type, IUnknown* object) {
+        std::vector<IUnknown*>& objects = objects_[(size_t)type];
+        std::vector<uint32_t>& free = free_[(size_t)type];
+        if (!free.empty()) {
+            uint32_t id = free.back();
+            free.pop_back();
+            objects[id - 1] = object;
+            return id;
+        }
+        objects.push_back(object);
+        return (uint32_t)objects.size();
+    }
+
+    uint32_t D3D11Backend::ImportObject(ResourceType type, IUnknown* object) {
+        if (object == nullptr)
+            return 0;
+        auto found = imported_[(size_t)type].find(object);
+        if (found != imported_[(size_t)type].end())
+            return found->second;
+        object->AddRef();
+        uint32_t id = Add(type, object);
+        imported_[(size_t)type].emplace(object, id);
+        return id;
+    }
+
+    void D3D11Backend::ReleaseResource(ResourceType type, uint32_t id) {
+        std::vector<IUnknown*>& objects = objects_[(size_t)type];
+        if (id == 0 || id > objects.size() || objects[id - 1] == nullptr)
+            return;
+        imported_[(size_t)type].erase(objects[id - 1]);
+        if (type == ResourceType::InputLayout) {
+            layoutElements_.erase(id);
+        }
+        SAFE_RELEASE(objects[id - 1]);
+        free_[(size_t)type].push_back(id);
+    }
+
+    BufferHandle D3D11Backend::Import(ID3D11Buffer* buffer) {
+        BufferHandle handle;
+        handle.id = ImportObject(ResourceType::Buffer, buffer);
+        return handle;
+    }
+
+    TextureHandle D3D11Backend::Import(ID3D11Texture2D* texture) {
+        TextureHandle handle;
+        handle.id = ImportObject(ResourceType::Texture, texture);
+        return handle;
+    }
+
+    ShaderResourceViewHandle D3D11Backend::Import(ID3D11ShaderResourceView* view) {
+        ShaderResourceViewHandle handle;
+        handle.id = ImportObject(ResourceType::ShaderResourceView, view);
+        return handle;
+    }
+
+    RenderTargetViewHandle D3D11Backend::Import(ID3D11RenderTargetView* view) {
+        RenderTargetViewHandle handle;
+        handle.id = ImportObject(ResourceType::RenderTargetView, view);
+        return handle;
+    }
+
+    DepthStencilViewHandle D3D11Backend::Import(ID3D11DepthStencilView* view) {
+        DepthStencilViewHandle handle;
+        handle.id = ImportObject(ResourceType::DepthStencilView, view);
+        return handle;
+    }
+
+    VertexShaderHandle D3D11Backend::Import(ID3D11VertexShader* shader) {
+        VertexShaderHandle handle;
+        handle.id = ImportObject(ResourceType::VertexShader, shader);
+        return handle;
+    }
+
+    PixelShaderHandle D3D11Backend::Import(ID3D11PixelShader* shader) {
+        PixelShaderHandle handle;
+        handle.id = ImportObject(ResourceType::PixelShader, shader);
+        return handle;
+    }
+
+    InputLayoutHandle D3D11Backend::Import(ID3D11InputLayout* layout, const D3D11_INPUT_ELEMENT_DESC* desc, UINT numElements) {
+        InputLayoutHandle handle;
+        handle.id = ImportObject(ResourceType::InputLayout, layout);
+        if (handle.IsValid() && desc != nullptr) {
+            std::vector<InputElement>& elements = layoutElements_[handle.id];
+            elements.resize(numElements);
+            for (UINT i = 0; i < numElements; i++) {
+                elements[i].semanticName = desc[i].SemanticName;
+                elements[i].semanticIndex = desc[i].SemanticIndex;
+                elements[i].format = FromDXGI(desc[i].Format);
+                elements[i].slot = desc[i].InputSlot;
+                elements[i].offset = desc[i].AlignedByteOffset;
+                elements[i].perInstance = desc[i].InputSlotClass == D3D11_INPUT_PER_INSTANCE_DATA;
+            }
+        }
+        return handle;
+    }
+
+    SamplerHandle D3D11Backend::Import(ID3D11SamplerState* sampler) {
+        SamplerHandle handle;
+        handle.id = ImportObject(ResourceType::Sampler, sampler);
+        return handle;
+    }
+
+    RasterizerStateHandle D3D11Backend::Import(ID3D11RasterizerState* state) {
+        RasterizerStateHandle handle;
+        handle.id = ImportObject(ResourceType::RasterizerState, state);
+        return handle;
+    }
+
+    DepthStencilStateHandle D3D11Backend::Import(ID3D11DepthStencilState* state) {
+        DepthStencilStateHandle handle;
+        handle.id = ImportObject(ResourceType::DepthStencilState, state);
+        return handle;
+    }
+
+    BufferHandle D3D11Backend::CreateBuffer(const BufferDesc& desc, const void* initialData) {
+        D3D11_BUFFER_DESC bufferDesc = {};
+        bufferDesc.ByteWidth = (UINT)desc.size;
+        bufferDesc.Usage = ToUsage(desc.usage);
+        bufferDesc.BindFlags = ToBindFlags(desc.bindFlags);
+        bufferDesc.CPUAccessFlags = desc.usage == Usage::Dynamic ? D3D11_CPU_ACCESS_WRITE : 0;
+
+        D3D11_SUBRESOURCE_DATA data = {};
+        data.pSysMem = initialData;
+        data.SysMemPitch = (UINT)desc.size;
+
+        BufferHandle handle;
+        ID3D11Buffer* buffer = nullptr;
+        HRESULT result = device_->CreateBuffer(&bufferDesc, initialData != nullptr ? &data : nullptr, &buffer);
+        if (FAILED(result)) {
+            lastResult_ = result;
+            return handle;
+        }
+        handle.id = Add(ResourceType::Buffer, buffer);
+        return handle;
+    }
+
+    TextureHandle D3D11Backend::CreateTexture(const TextureDesc& desc, const void* initialData) {
+        D3D11_TEXTURE2D_DESC textureDesc = {};
+        textureDesc.Width = desc.width;
+        textureDesc.Height = desc.height;
+        textureDesc.MipLevels = desc.mipLevels;
+        textureDesc.ArraySize = desc.arraySize;
+        textureDesc.Format = ToDXGI(desc.format);
+        textureDesc.SampleDesc.Count = 1;
+        textureDesc.Usage = D3D11_USAGE_DEFAULT;
+        textureDesc.BindFlags = ToBindFlags(desc.bindFlags);
+        textureDesc.MiscFlags = desc.cube ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+
+        TextureHandle handle;
+        ID3D11Texture2D* texture = nullptr;
+        HRESULT result = device_->CreateTexture2D(&textureDesc, nullptr, &texture);
+        if (FAILED(result)) {
+            lastResult_ = result;
+            return handle;
+        }
+        if (initialData != nullptr) {
+            UINT rowPitch = desc.width * FormatSize(desc.format);
+            deviceContext_->UpdateSubresource(texture, 0, nullptr, initialData, rowPitch, rowPitch * desc.height);
+        }
+        handle.id = Add(ResourceType::Texture, texture);
+        return handle;
+    }
+
+    ShaderResourceViewHandle D3D11Backend::CreateShaderResourceView(TextureHandle texture) {
+        ShaderResourceViewHandle handle;
+        ID3D11ShaderResourceView* view = nullptr;
+        HRESULT result = device_->CreateShaderResourceView(Get<ID3D11Texture2D>(ResourceType::Texture, texture.id), nullptr, &view);
+        if (FAILED(result)) {
+            lastResult_ = result;
+            return handle;
+        }
+        handle.id = Add(ResourceType::ShaderResourceView, view);
+        return handle;
+    }
+
+    RenderTargetViewHandle D3D11Backend::CreateRenderTargetView(TextureHandle texture, unsigned mipLevel, unsigned arraySlice) {
+        RenderTargetViewHandle handle;
+        ID3D11Texture2D* resource = Get<ID3D11Texture2D>(ResourceType::Texture, texture.id);
+        if (resource == nullptr)
+            return handle;
+        D3D11_TEXTURE2D_DESC textureDesc;
+        resource->GetDesc(&textureDesc);
+
+        D3D11_RENDER_TARGET_VIEW_DESC desc = {};
+        desc.Format = textureDesc.Format;
+        if (textureDesc.ArraySize > 1) {
+            desc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
+            desc.Texture2DArray.MipSlice = mipLevel;
+            desc.Texture2DArray.FirstArraySlice = arraySlice;
+            desc.Texture2DArray.ArraySize = 1;
+        }
+        else {
+            desc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
+            desc.Texture2D.MipSlice = mipLevel;
+        }
+
+        ID3D11RenderTargetView* view = nullptr;
+        HRESULT result = device_->CreateRenderTargetView(resource, &desc, &view);
+        if (FAILED(result)) {
+            lastResult_ = result;
+            return handle;
+        }
+        handle.id = Add(ResourceType::RenderTargetView, view);
+        return handle;
+    }
+
+    DepthStencilViewHandle D3D11Backend::CreateDepthStencilView(TextureHandle texture) {
+        DepthStencilViewHandle handle;
+        ID3D11DepthStencilView* view = nullptr;
+        HRESULT result = device_->CreateDepthStencilView(Get<ID3D11Texture2D>(ResourceType::Texture, texture.id), nullptr, &view);
+        if (FAILED(result)) {
+            lastResult_ = result;
+            return handle;
+        }
+        handle.id = Add(ResourceType::DepthStencilView, view);
+        return handle;
+    }
+
+    VertexShaderHandle D3D11Backend::CreateVertexShader(const void* bytecode, size_t size) {
+        VertexShaderHandle handle;
+        ID3D11VertexShader* shader = nullptr;
+        HRESULT result = device_->CreateVertexShader(bytecode, size, nullptr, &shader);
+        if (FAILED(result)) {
+            lastResult_ = result;
+            return handle;
+        }
+        handle.id = Add(ResourceType::VertexShader, shader);
+        return handle;
+    }
+
+    PixelShaderHandle D3D11Backend::CreatePixelShader(const void* bytecode, size_t size) {
+        PixelShaderHandle handle;
+        ID3D11PixelShader* shader = nullptr;
+        HRESULT result = device_->CreatePixelShader(bytecode, size, nullptr, &shader);
+        if (FAILED(result)) {
+            lastResult_ = result;
+            return handle;
+        }
+        handle.id = Add(ResourceType::PixelShader, shader);
+        return handle;
+    }
+
+    InputLayoutHandle D3D11Backend::CreateInputLayout(const InputElement* elements, unsigned count, const void* bytecode, size_t size) {
+        InputLayoutHandle handle;
+        std::vector<D3D11_INPUT_ELEMENT_DESC> desc(count);
+        for (unsigned i = 0; i < count; i++) {
+            desc[i].SemanticName = elements[i].semanticName;
+            desc[i].SemanticIndex = elements[i].semanticIndex;
+            desc[i].Format = ToDXGI(elements[i].format);
+            desc[i].InputSlot = elements[i].slot;
+            desc[i].AlignedByteOffset = elements[i].offset;
+            desc[i].InputSlotClass = elements[i].perInstance ? D3D11_INPUT_PER_INSTANCE_DATA : D3D11_INPUT_PER_VERTEX_DATA;
+            desc[i].InstanceDataStepRate = elements[i].perInstance ? 1 : 0;
+        }
+
+        ID3D11InputLayout* layout = nullptr;
+        HRESULT result = device_->CreateInputLayout(desc.data(), count, bytecode, size, &layout);
+        if (FAILED(result)) {
+            lastResult_ = result;
+            return handle;
+        }
+        handle.id = Add(ResourceType::InputLayout, layout);
+        layoutElements_[handle.id].assign(elements, elements + count);
+        return handle;
+    }
+
+    SamplerHandle D3D11Backend::CreateSampler(const SamplerDesc& desc) {
+        D3D11_TEXTURE_ADDRESS_MODE address = desc.address == AddressMode::Clamp ? D3D11_TEXTURE_ADDRESS_CLAMP : D3D11_TEXTURE_ADDRESS_WRAP;
+        D3D11_SAMPLER_DESC samplerDesc = {};
+        samplerDesc.Filter = ToFilter(desc.filter);
+        samplerDesc.AddressU = address;
+        samplerDesc.AddressV = address;
+        samplerDesc.AddressW = address;
+        samplerDesc.MaxAnisotropy = 16;
+        samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+        samplerDesc.MinLOD = 0.0f;
+        samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+
+        SamplerHandle handle;
+        ID3D11SamplerState* sampler = nullptr;
+        HRESULT result = device_->CreateSamplerState(&samplerDesc, &sampler);
+        if (FAILED(result)) {
+            lastResult_ = result;
+            return handle;
+        }
+        handle.id = Add(ResourceType::Sampler, sampler);
+        return handle;
+    }
+
+    RasterizerStateHandle D3D11Backend::CreateRasterizerState(const RasterizerDesc& desc) {
+        D3D11_RASTERIZER_DESC rasterizerDesc = {};
+        rasterizerDesc.FillMode = D3D11_FILL_SOLID;
+        rasterizerDesc.CullMode = desc.cullMode == CullMode::None ? D3D11_CULL_NONE :
+            desc.cullMode == CullMode::Front ? D3D11_CULL_FRONT : D3D11_CULL_BACK;
+        rasterizerDesc.FrontCounterClockwise = desc.frontCounterClockwise;
+        rasterizerDesc.DepthClipEnable = true;
+
+        RasterizerStateHandle handle;
+        ID3D11RasterizerState* state = nullptr;
+        HRESULT result = device_->CreateRasterizerState(&rasterizerDesc, &state);
+        if (FAILED(result)) {
+            lastResult_ = result;
+            return handle;
+        }
+        handle.id = Add(ResourceType::RasterizerState, state);
+        return handle;
+    }
+
+    DepthStencilStateHandle D3D11Backend::CreateDepthStencilState(const DepthStencilDesc& desc) {
+        D3D11_DEPTH_STENCIL_DESC depthStencilDesc = {};
+        depthStencilDesc.DepthEnable = desc.depthEnable;
+        depthStencilDesc.DepthWriteMask = desc.depthWrite ? D3D11_DEPTH_WRITE_MASK_ALL : D3D11_DEPTH_WRITE_MASK_ZERO;
+        depthStencilDesc.DepthFunc = ToComparison(desc.depthFunc);
+        depthStencilDesc.StencilEnable = FALSE;
+
+        DepthStencilStateHandle handle;
+        ID3D11DepthStencilState* state = nullptr;
+        HRESULT result = device_->CreateDepthStencilState(&depthStencilDesc, &state);
+        if (FAILED(result)) {
+            lastResult_ = result;
+            return handle;
+        }
+        handle.id = Add(ResourceType::DepthStencilState, state);
+        return handle;
+    }
+
+    // Описания читаются из самих объектов D3D11. Содержимое буферов недоступно без копии в staging-ресурс
+    // и не возвращается.
+    bool D3D11Backend::Describe(ResourceType type, uint32_t id, ResourceInfo& info) const {
+        IUnknown* object = Get<IUnknown>(type, id);
+        if (object == nullptr)
+            return false;
+        switch (type) {
+        case ResourceType::Buffer: {
+            D3D11_BUFFER_DESC desc;
+            static_cast<ID3D11Buffer*>(object)->GetDesc(&desc);
+            info.buffer.size = desc.ByteWidth;
+            info.buffer.bindFlags = FromBindFlags(desc.BindFlags);
+            info.buffer.usage = desc.Usage == D3D11_USAGE_DYNAMIC ? Usage::Dynamic :
+                desc.Usage == D3D11_USAGE_IMMUTABLE ? Usage::Immutable : Usage::Default;
+            break;
+        }
+        case ResourceType::Texture:
+            DescribeTexture(static_cast<ID3D11Texture2D*>(object), info.texture);
+            break;
+        case ResourceType::ShaderResourceView:
+        case ResourceType::RenderTargetView:
+        case ResourceType::DepthStencilView: {
+            ID3D11Resource* resource = nullptr;
+            static_cast<ID3D11View*>(object)->GetResource(&resource);
+            DescribeTexture(resource, info.texture);
+            if (resource != nullptr) {
+                ID3D11Texture2D* texture = nullptr;
+                if (SUCCEEDED(resource->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&texture))) {
+                    auto found = imported_[(size_t)ResourceType::Texture].find(texture);
+                    info.viewTexture = found != imported_[(size_t)ResourceType::Texture].end() ? found->second : 0;
+                    texture->Release();
+                }
+                resource->Release();
+            }
+            if (type == ResourceType::RenderTargetView) {
+                D3D11_RENDER_TARGET_VIEW_DESC desc;
+                static_cast<ID3D11RenderTargetView*>(object)->GetDesc(&desc);
+                if (desc.ViewDimension == D3D11_RTV_DIMENSION_TEXTURE2DARRAY) {
+                    info.mipLevel = desc.Texture2DArray.MipSlice;
+                    info.arraySlice = desc.Texture2DArray.FirstArraySlice;
+                }
+                else if (desc.ViewDimension == D3D11_RTV_DIMENSION_TEXTURE2D) {
+                    info.mipLevel = desc.Texture2D.MipSlice;
+                }
+            }
+            break;
+        }
+        case ResourceType::InputLayout: {
+            auto found = layoutElements_.find(id);
+            if (found != layoutElements_.end()) {
+                info.elements = found->second;
+            }
+            break;
+        }
+        case ResourceType::Sampler: {
+            D3D11_SAMPLER_DESC desc;
+            static_cast<ID3D11SamplerState*>(object)->GetDesc(&desc);
+            info.sampler.address = desc.AddressU == D3D11_TEXTURE_ADDRESS_CLAMP ? AddressMode::Clamp : AddressMode::Wrap;
+            info.sampler.filter = desc.Filter == D3D11_FILTER_MIN_MAG_MIP_POINT ? Filter::Point :
+                desc.Filter == D3D11_FILTER_ANISOTROPIC ? Filter::Anisotropic :
+                desc.Filter == D3D11_FILTER_MINIMUM_ANISOTROPIC ? Filter::MinimumAnisotropic :
+                desc.Filter == D3D11_FILTER_MAXIMUM_ANISOTROPIC ? Filter::MaximumAnisotropic : Filter::Linear;
+            break;
+        }
+        case ResourceType::RasterizerState: {
+            D3D11_RASTERIZER_DESC desc;
+            static_cast<ID3D11RasterizerState*>(object)->GetDesc(&desc);
+            info.rasterizer.cullMode = desc.CullMode == D3D11_CULL_NONE ? CullMode::None :
+                desc.CullMode == D3D11_CULL_FRONT ? CullMode::Front : CullMode::Back;
+            info.rasterizer.frontCounterClockwise = desc.FrontCounterClockwise != FALSE;
+            break;
+        }
+        case ResourceType::DepthStencilState: {
+            D3D11_DEPTH_STENCIL_DESC desc;
+            static_cast<ID3D11DepthStencilState*>(object)->GetDesc(&desc);
+            info.depthStencil.depthEnable = desc.DepthEnable != FALSE;
+            info.depthStencil.depthWrite = desc.DepthWriteMask == D3D11_DEPTH_WRITE_MASK_ALL;
+            info.depthStencil.depthFunc = (Comparison)(desc.DepthFunc - D3D11_COMPARISON_NEVER);
+            break;
+        }
+        default:
+            break;
+        }
+        return true;
+    }
+
+    void D3D11Backend::ClearState() {
+        deviceContext_->ClearState();
+    }
+
+    void D3D11Backend::SetViewport(const Viewport& viewport) {
+        D3D11_VIEWPORT d3dViewport;
+        d3dViewport.TopLeftX = viewport.x;
+        d3dViewport.TopLeftY = viewport.y;
+        d3dViewport.Width = viewport.width;
+        d3dViewport.Height = viewport.height;
+        d3dViewport.MinDepth = viewport.minDepth;
+        d3dViewport.MaxDepth = viewport.maxDepth;
+        deviceContext_->RSSetViewports(1, &d3dViewport);
+    }
+
+    void D3D11Backend::SetScissorRect(const Rect& rect) {
+        D3D11_RECT d3dRect;
+        d3dRect.left = rect.left;
+        d3dRect.top = rect.top;
+        d3dRect.right = rect.right;
+        d3dRect.bottom = rect.bottom;
+        deviceContext_->RSSetScissorRects(1, &d3dRect);
+    }
+
+    void D3D11Backend::SetRenderTarget(RenderTargetViewHandle target, DepthStencilViewHandle depth) {
+        ID3D11RenderTargetView* view = Get<ID3D11RenderTargetView>(ResourceType::RenderTargetView, target.id);
+        deviceContext_->OMSetRenderTargets(view != nullptr ? 1 : 0, view != nullptr ? &view : nullptr,
+            Get<ID3D11DepthStencilView>(ResourceType::DepthStencilView, depth.id));
+    }
+
+    void D3D11Backend::ClearRenderTarget(RenderTargetViewHandle target, const float color[4]) {
+        ID3D11RenderTargetView* view = Get<ID3D11RenderTargetView>(ResourceType::RenderTargetView, target.id);
+        if (view != nullptr) {
+            deviceContext_->ClearRenderTargetView(view, color);
+        }
+    }
+
+    void D3D11Backend::ClearDepthStencil(DepthStencilViewHandle target, float depth) {
+        ID3D11DepthStencilView* view = Get<ID3D11DepthStencilView>(ResourceType::DepthStencilView, target.id);
+        if (view != nullptr) {
+            deviceContext_->ClearDepthStencilView(view, D3D11_CLEAR_DEPTH, depth, 0);
+        }
+    }
+
+    void D3D11Backend::SetVertexBuffer(unsigned slot, BufferHandle buffer, unsigned stride, unsigned offset) {
+        ID3D11Buffer* buffers[] = { GetBuffer(buffer) };
+        UINT strides[] = { stride };
+        UINT offsets[] = { offset };
+        deviceContext_->IASetVertexBuffers(slot, 1, buffers, strides, offsets);
+    }
+
+    void D3D11Backend::SetIndexBuffer(BufferHandle buffer, unsigned offset) {
+        deviceContext_->IASetIndexBuffer(GetBuffer(buffer), DXGI_FORMAT_R32_UINT, offset);
+    }
+
+    void D3D11Backend::SetInputLayout(InputLayoutHandle layout) {
+        deviceContext_->IASetInputLayout(Get<ID3D11InputLayout>(ResourceType::InputLayout, layout.id));
+    }
+
+    void D3D11Backend::SetPrimitiveTopology(Topology topology) {
+        deviceContext_->IASetPrimitiveTopology(ToTopology(topology));
+    }
+
+    void D3D11Backend::SetVertexShader(VertexShaderHandle shader) {
+        deviceContext_->VSSetShader(Get<ID3D11VertexShader>(ResourceType::VertexShader, shader.id), nullptr, 0);
+    }
+
+    void D3D11Backend::SetPixelShader(PixelShaderHandle shader) {
+        deviceContext_->PSSetShader(Get<ID3D11PixelShader>(ResourceType::PixelShader, shader.id), nullptr, 0);
+    }
+
+    void D3D11Backend::SetConstantBuffers(ShaderStage stage, unsigned slot, unsigned count, const BufferHandle* buffers) {
+        ID3D11Buffer* objects[maxConstantBuffers];
+        count = min(count, maxConstantBuffers);
+        for (unsigned i = 0; i < count; i++) {
+            objects[i] = GetBuffer(buffers[i]);
+        }
+        if (stage == ShaderStage::Vertex)
+            deviceContext_->VSSetConstantBuffers(slot, count, objects);
+        else
+            deviceContext_->PSSetConstantBuffers(slot, count, objects);
+    }
+
+    void D3D11Backend::SetShaderResources(ShaderStage stage, unsigned slot, unsigned count, const ShaderResourceViewHandle* views) {
+        ID3D11ShaderResourceView* objects[maxShaderResources];
+        count = min(count, maxShaderResources);
+        for (unsigned i = 0; i < count; i++) {
+            objects[i] = Get<ID3D11ShaderResourceView>(ResourceType::ShaderResourceView, views[i].id);
+        }
+        if (stage == ShaderStage::Vertex)
+            deviceContext_->VSSetShaderResources(slot, count, objects);
+        else
+            deviceContext_->PSSetShaderResources(slot, count, objects);
+    }
+
+    void D3D11Backend::SetSamplers(ShaderStage stage, unsigned slot, unsigned count, const SamplerHandle* samplers) {
+        ID3D11SamplerState* objects[maxSamplers];
+        count = min(count, maxSamplers);
+        for (unsigned i = 0; i < count; i++) {
+            objects[i] = Get<ID3D11SamplerState>(ResourceType::Sampler, samplers[i].id);
+        }
+        if (stage == ShaderStage::Vertex)
+            deviceContext_->VSSetSamplers(slot, count, objects);
+        else
+            deviceContext_->PSSetSamplers(slot, count, objects);
+    }
+
+    void D3D11Backend::SetRasterizerState(RasterizerStateHandle state) {
+        deviceContext_->RSSetState(Get<ID3D11RasterizerState>(ResourceType::RasterizerState, state.id));
+    }
+
+    void D3D11Backend::SetDepthStencilState(DepthStencilStateHandle state) {
+        deviceContext_->OMSetDepthStencilState(Get<ID3D11DepthStencilState>(ResourceType::DepthStencilState, state.id), 0);
+    }
+
+    void D3D11Backend::UpdateBuffer(BufferHandle buffer, const void* data, size_t size) {
+        // Буферы D3D11 перезаписываются целиком, размер проверяет NullBackend.
+        (void)size;
+        deviceContext_->UpdateSubresource(GetBuffer(buffer), 0, nullptr, data, 0, 0);
+    }
+
+    void D3D11Backend::UpdateBufferRange(BufferHandle buffer, size_t offset, const void* data, size_t size) {
+        D3D11_BOX box = { (UINT)offset, 0, 0, (UINT)(offset + size), 1, 1 };
+        deviceContext_->UpdateSubresource(GetBuffer(buffer), 0, &box, data, 0, 0);
+    }
+
+    void* D3D11Backend::Map(BufferHandle buffer) {
+        D3D11_MAPPED_SUBRESOURCE subresource;
+        HRESULT result = deviceContext_->Map(GetBuffer(buffer), 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
+        if (FAILED(result)) {
+            lastResult_ = result;
+            return nullptr;
+        }
+        return subresource.pData;
+    }
+
+    void D3D11Backend::Unmap(BufferHandle buffer) {
+        deviceContext_->Unmap(GetBuffer(buffer), 0);
+    }
+
+    void D3D11Backend::Draw(unsigned vertexCount, unsigned startVertex) {
+        deviceContext_->Draw(vertexCount, startVertex);
+    }
+
+    void D3D11Backend::DrawIndexed(unsigned indexCount, unsigned startIndex, int baseVertex) {
+        deviceContext_->DrawIndexed(indexCount, startIndex, baseVertex);
+    }
+
+    void D3D11Backend::DrawIndexedInstanced(unsigned indexCount, unsigned instanceCount, unsigned startIndex, int baseVertex,
+                                            unsigned startInstance) {
+        deviceContext_->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+    }
+}
@@ -0,0 +1,109 @@
+﻿#pragma once
+
+#include "framework.h"
+#include "RenderBackend.h"
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+
+namespace gfx {
+    // RenderBackend поверх ID3D11Device / ID3D11DeviceContext. Вызовы передаются контексту без кэширования
+    // состояния, поэтому его можно чередовать с прямыми вызовами контекста (ToneMapping, CubemapGenerator, ImGui).
+    // Объекты, созданные менеджерами, подключаются через Import: повторный Import того же объекта возвращает
+    // тот же дескриптор, бэкенд держит на объект свою ссылку до Release или Cleanup.
+    class D3D11Backend : public RenderBackend {
+    public:
+        void Init(const std::shared_ptr<ID3D11Device>& device, const std::shared_ptr<ID3D11DeviceContext>& deviceContext);
+        void Cleanup();
+
+        BufferHandle Import(ID3D11Buffer* buffer);
+        TextureHandle Import(ID3D11Texture2D* texture);
+        ShaderResourceViewHandle Import(ID3D11ShaderResourceView* view);
+        RenderTargetViewHandle Import(ID3D11RenderTargetView* view);
+        DepthStencilViewHandle Import(ID3D11DepthStencilView* view);
+        VertexShaderHandle Import(ID3D11VertexShader* shader);
+        PixelShaderHandle Import(ID3D11PixelShader* shader);
+        // Описание элементов нужно только для Describe; имена должны жить, пока жив слой.
+        InputLayoutHandle Import(ID3D11InputLayout* layout, const D3D11_INPUT_ELEMENT_DESC* desc = nullptr, UINT numElements = 0);
+        SamplerHandle Import(ID3D11SamplerState* sampler);
+        RasterizerStateHandle Import(ID3D11RasterizerState* state);
+        DepthStencilStateHandle Import(ID3D11DepthStencilState* state);
+
+        ID3D11Buffer* GetBuffer(BufferHandle buffer) const {
+            return Get<ID3D11Buffer>(ResourceType::Buffer, buffer.id);
+        };
+
+        // Результат последнего неудачного вызова устройства или контекста.
+        HRESULT GetLastResult() const {
+            return lastResult_;
+        };
+
+        BufferHandle CreateBuffer(const BufferDesc& desc, const void* initialData = nullptr) override;
+        TextureHandle CreateTexture(const TextureDesc& desc, const void* initialData = nullptr) override;
+        ShaderResourceViewHandle CreateShaderResourceView(TextureHandle texture) override;
+        RenderTargetViewHandle CreateRenderTargetView(TextureHandle texture, unsigned mipLevel = 0, unsigned arraySlice = 0) override;
+        DepthStencilViewHandle CreateDepthStencilView(TextureHandle texture) override;
+        VertexShaderHandle CreateVertexShader(const void* bytecode, size_t size) override;
+        PixelShaderHandle CreatePixelShader(const void* bytecode, size_t size) override;
+        InputLayoutHandle CreateInputLayout(const InputElement* elements, unsigned count, const void* bytecode, size_t size) override;
+        SamplerHandle CreateSampler(const SamplerDesc& desc) override;
+        RasterizerStateHandle CreateRasterizerState(const RasterizerDesc& desc) override;
+        DepthStencilStateHandle CreateDepthStencilState(const DepthStencilDesc& desc) override;
+
+        void ClearState() override;
+        void SetViewport(const Viewport& viewport) override;
+        void SetScissorRect(const Rect& rect) override;
+        void SetRenderTarget(RenderTargetViewHandle target, DepthStencilViewHandle depth = DepthStencilViewHandle()) override;
+        void ClearRenderTarget(RenderTargetViewHandle target, const float color[4]) override;
+        void ClearDepthStencil(DepthStencilViewHandle target, float depth) override;
+
+        void SetVertexBuffer(unsigned slot, BufferHandle buffer, unsigned stride, unsigned offset = 0) override;
+        void SetIndexBuffer(BufferHandle buffer, unsigned offset = 0) override;
+        void SetInputLayout(InputLayoutHandle layout) override;
+        void SetPrimitiveTopology(Topology topology) override;
+        void SetVertexShader(VertexShaderHandle shader) override;
+        void SetPixelShader(PixelShaderHandle shader) override;
+        void SetConstantBuffers(ShaderStage stage, unsigned slot, unsigned count, const BufferHandle* buffers) override;
+        void SetShaderResources(ShaderStage stage, unsigned slot, unsigned count, const ShaderResourceViewHandle* views) override;
+        void SetSamplers(ShaderStage stage, unsigned slot, unsigned count, const SamplerHandle* samplers) override;
+        void SetRasterizerState(RasterizerStateHandle state) override;
+        void SetDepthStencilState(DepthStencilStateHandle state) override;
+
+        void UpdateBuffer(BufferHandle buffer, const void* data, size_t size) override;
+        void UpdateBufferRange(BufferHandle buffer, size_t offset, const void* data, size_t size) override;
+        void* Map(BufferHandle buffer) override;
+        void Unmap(BufferHandle buffer) override;
+
+        void Draw(unsigned vertexCount, unsigned startVertex) override;
+        void DrawIndexed(unsigned indexCount, unsigned startIndex, int baseVertex) override;
+        void DrawIndexedInstanced(unsigned indexCount, unsigned instanceCount, unsigned startIndex, int baseVertex,
+                                  unsigned startInstance) override;
+
+        bool Describe(ResourceType type, uint32_t id, ResourceInfo& info) const override;
+
+        ~D3D11Backend();
+
+    protected:
+        void ReleaseResource(ResourceType type, uint32_t id) override;
+
+    private:
+        // Объект переходит во владение бэкенда (ссылка не добавляется).
+        uint32_t Add(ResourceType type, IUnknown* object);
+        uint32_t ImportObject(ResourceType type, IUnknown* object);
+
+        template<typename T>
+        T* Get(ResourceType type, uint32_t id) const {
+            const std::vector<IUnknown*>& objects = objects_[(size_t)type];
+            return id != 0 && id <= objects.size() ? static_cast<T*>(objects[id - 1]) : nullptr;
+        };
+
+        std::shared_ptr<ID3D11Device> device_;
+        std::shared_ptr<ID3D11DeviceContext> deviceContext_;
+        std::vector<IUnknown*> objects_[(size_t)ResourceType::Count];
+        std::vector<uint32_t> free_[(size_t)ResourceType::Count];
+        std::unordered_map<IUnknown*, uint32_t> imported_[(size_t)ResourceType::Count];
+        std::unordered_map<uint32_t, std::vector<InputElement>> layoutElements_;
+        HRESULT lastResult_ = S_OK;
+    };
+}
@@ -0,0 +1,82 @@
+﻿#include "DynamicResolution.h"
+#include <cmath>
+
+DynamicResolution::DynamicResolution(const DynamicResolutionSettings& settings) :
+    settings_(settings), scale_(settings.maxScale) {}
+
+void DynamicResolution::SetSettings(const DynamicResolutionSettings& settings) {
+    settings_ = settings;
+    scale_ = Quantize(scale_);
+}
+
+void DynamicResolution::Reset() {
+    scale_ = settings_.maxScale;
+    smoothedMs_ = 0.0f;
+    integral_ = 0.0f;
+    previousError_ = 0.0f;
+    headroomFrames_ = 0;
+    initialized_ = false;
+    changes_ = 0;
+}
+
+float DynamicResolution::Quantize(float scale) const {
+    if (scale < settings_.minScale)
+        scale = settings_.minScale;
+    if (scale > settings_.maxScale)
+        scale = settings_.maxScale;
+    if (settings_.step > 0.0f) {
+        scale = settings_.minScale + std::floor((scale - settings_.minScale) / settings_.step + 0.5f) * settings_.step;
+        if (scale > settings_.maxScale)
+            scale = settings_.maxScale;
+    }
+    return scale;
+}
+
+float DynamicResolution::Update(float frameMs) {
+    if (!(frameMs > 0.0f) || settings_.targetFrameMs <= 0.0f)
+        return scale_;
+
+    if (!initialized_) {
+        smoothedMs_ = frameMs;
+        initialized_ = true;
+    }
+    else {
+        smoothedMs_ += (frameMs - smoothedMs_) * settings_.smoothing;
+    }
+
+    // Положительная ошибка - есть запас по времени, отрицательная - кадр не укладывается в бюджет.
+    float error = (settings_.targetFrameMs - smoothedMs_) / settings_.targetFrameMs;
+    float derivative = error - previousError_;
+    previousError_ = error;
+
+    if (std::fabs(error) < settings_.deadband) {
+        headroomFrames_ = 0;
+        return scale_;
+    }
+
+    integral_ += error;
+    if (integral_ > settings_.integralLimit)
+        integral_ = settings_.integralLimit;
+    if (integral_ < -settings_.integralLimit)
+        integral_ = -settings_.integralLimit;
+
+    float correction = settings_.kp * error + settings_.ki * integral_ + settings_.kd * derivative;
+    float area = scale_ * scale_ * (1.0f + correction);
+    float desired = Quantize(std::sqrt(area > 0.0f ? area : 0.0f));
+
+    // Разрешение снижается сразу, а повышается только после устойчивого запаса по времени.
+    if (desired > scale_) {
+        if (++headroomFrames_ < settings_.upscaleDelayFrames)
+            return scale_;
+    }
+    headroomFrames_ = 0;
+
+    if (desired != scale_) {
+        scale_ = desired;
+        changes_++;
+        // Сбрасываем накопленную ошибку, чтобы не проскочить мимо цели после смены масштаба.
+        integral_ = 0.0f;
+    }
+
+    return scale_;
+}
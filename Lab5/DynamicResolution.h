@@ -0,0 +1,60 @@
+﻿#pragma once
+
+
+struct DynamicResolutionSettings {
+    float targetFrameMs = 1000.0f / 60.0f;
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+    float step = 0.05f;         // шаг квантования масштаба
+    float deadband = 0.05f;     // относительная ошибка, при которой масштаб не меняется
+    float smoothing = 0.25f;    // коэффициент экспоненциального сглаживания времени кадра
+    float kp = 0.6f;
+    float ki = 0.05f;
+    float kd = 0.2f;
+    float integralLimit = 2.0f;
+    int upscaleDelayFrames = 20; // сколько кадров подряд нужен запас, чтобы поднять разрешение
+};
+
+
+// ПИД-регулятор масштаба рендеринга по времени кадра. Регулируется доля площади (scale^2), так как
+// стоимость кадра примерно пропорциональна числу пикселей. Результат детерминирован для одной и той же
+// последовательности времен кадров.
+class DynamicResolution {
+public:
+    explicit DynamicResolution(const DynamicResolutionSettings& settings = DynamicResolutionSettings());
+
+    // Принимает время очередного кадра в миллисекундах, возвращает масштаб для следующего кадра.
+    float Update(float frameMs);
+
+    void Reset();
+
+    void SetSettings(const DynamicResolutionSettings& settings);
+
+    const DynamicResolutionSettings& GetSettings() const {
+        return settings_;
+    };
+
+    float GetScale() const {
+        return scale_;
+    };
+
+    float GetSmoothedFrameMs() const {
+        return smoothedMs_;
+    };
+
+    unsigned GetChangeCount() const {
+        return changes_;
+    };
+
+private:
+    float Quantize(float scale) const;
+
+    DynamicResolutionSettings settings_;
+    float scale_;
+    float smoothedMs_ = 0.0f;
+    float integral_ = 0.0f;
+    float previousError_ = 0.0f;
+    int headroomFrames_ = 0;
+    bool initialized_ = false;
+    unsigned changes_ = 0;
+};
@@ -0,0 +1,164 @@
+﻿// Проверка DynamicResolution на синтетических временах кадров, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 DynamicResolutionBenchMain.cpp DynamicResolution.cpp -o dynres
+// Примеры:
+//   ./dynres
+//   ./dynres --trace frames.txt
+// Модель кадра: cpu + gpu * scale^2 миллисекунд плюс детерминированный шум. Проверки: при постоянной нагрузке
+// масштаб сходится и перестает меняться, кадр укладывается в бюджет (или масштаб упирается в минимум); после
+// скачка нагрузки бюджет восстанавливается быстро, а разрешение поднимается не раньше upscaleDelayFrames;
+// масштаб всегда кратен шагу; одна и та же последовательность дает одинаковый результат, в том числе после Reset.
+// --trace читает времена кадров в мс из файла (по одному на строку) и печатает масштаб после каждого кадра.
+#include "DynamicResolution.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+namespace {
+    const float cpuMs = 2.0f;
+
+    // Шум +-0.3 мс, одинаковый при каждом запуске.
+    float Noise(unsigned frame) {
+        return float(int((frame * 7919u) % 13) - 6) * 0.05f;
+    }
+
+    float FrameMs(float gpuMs, float scale, unsigned frame) {
+        return cpuMs + gpuMs * scale * scale + Noise(frame);
+    }
+
+    bool Quantized(const DynamicResolutionSettings& settings, float scale) {
+        float steps = (scale - settings.minScale) / settings.step;
+        return scale >= settings.minScale && scale <= settings.maxScale &&
+            (std::fabs(steps - std::floor(steps + 0.5f)) < 1e-3f || scale == settings.maxScale);
+    }
+
+    bool CheckSteadyLoad(float gpuMs) {
+        DynamicResolution controller;
+        const DynamicResolutionSettings& settings = controller.GetSettings();
+        float scale = controller.GetScale();
+        unsigned lateChanges = 0;
+        bool quantized = true;
+        const unsigned frames = 600;
+        for (unsigned f = 0; f < frames; f++) {
+            float next = controller.Update(FrameMs(gpuMs, scale, f));
+            lateChanges += f >= frames / 2 && next != scale;
+            quantized = quantized && Quantized(settings, next);
+            scale = next;
+        }
+        float frameMs = cpuMs + gpuMs * scale * scale;
+        // Бюджет с учетом мертвой зоны и шума; если он недостижим, масштаб должен стоять на минимуме.
+        bool fits = frameMs <= settings.targetFrameMs * (1.0f + settings.deadband) + 0.3f || scale == settings.minScale;
+        // Не слишком низко: следующий шаг вверх уже не уложился бы в бюджет.
+        float up = std::min(scale + settings.step, settings.maxScale);
+        bool tight = scale == settings.maxScale || cpuMs + gpuMs * up * up > settings.targetFrameMs * (1.0f - settings.deadband);
+        bool ok = fits && tight && lateChanges == 0 && quantized;
+        printf("Steady gpu %4.1f ms: scale %.2f, frame %5.2f ms, %u changes, %u in the second half: %s\n", gpuMs, scale, frameMs,
+            controller.GetChangeCount(), lateChanges, ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    // Нагрузка растет с light до heavy на кадре 300 и возвращается на кадре 600.
+    bool CheckStep(float lightMs, float heavyMs) {
+        DynamicResolution controller;
+        const DynamicResolutionSettings& settings = controller.GetSettings();
+        float scale = controller.GetScale();
+        int overBudgetFrames = 0, upscaleFrame = -1;
+        for (unsigned f = 0; f < 900; f++) {
+            float gpuMs = f >= 300 && f < 600 ? heavyMs : lightMs;
+            float frameMs = FrameMs(gpuMs, scale, f);
+            overBudgetFrames += f >= 300 && f < 600 && frameMs > settings.targetFrameMs * (1.0f + settings.deadband) + 0.3f;
+            float next = controller.Update(frameMs);
+            if (f >= 600 && upscaleFrame < 0 && next > scale) {
+                upscaleFrame = int(f - 600);
+            }
+            scale = next;
+        }
+        bool ok = overBudgetFrames <= 15 && upscaleFrame >= settings.upscaleDelayFrames - 1 && scale == settings.maxScale;
+        printf("Step gpu %.0f -> %.0f -> %.0f ms: %d frames over budget after the rise, first upscale %d frames after the drop, "
+            "final scale %.2f: %s\n", lightMs, heavyMs, lightMs, overBudgetFrames, upscaleFrame, scale, ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    // Одиночный кадр в 100 мс (подгрузка ресурса) на легкой сцене.
+    void ReportSpike() {
+        DynamicResolution controller;
+        float scale = controller.GetScale(), lowest = scale;
+        int recovered = -1;
+        for (unsigned f = 0; f < 400; f++) {
+            float frameMs = f == 100 ? 100.0f : FrameMs(8.0f, scale, f);
+            scale = controller.Update(frameMs);
+            lowest = std::min(lowest, scale);
+            if (f > 100 && recovered < 0 && scale == controller.GetSettings().maxScale) {
+                recovered = int(f - 100);
+            }
+        }
+        printf("Spike of 100 ms on gpu 8 ms: lowest scale %.2f, back to full resolution after %d frames\n", lowest, recovered);
+    }
+
+    bool CheckDeterminism() {
+        DynamicResolution a, b;
+        std::vector<float> first;
+        bool same = true;
+        for (unsigned f = 0; f < 500; f++) {
+            float frameMs = 10.0f + float(f % 50);
+            float scale = a.Update(frameMs);
+            same = same && scale == b.Update(frameMs);
+            first.push_back(scale);
+        }
+        a.Reset();
+        for (unsigned f = 0; f < 500; f++) {
+            same = same && a.Update(10.0f + float(f % 50)) == first[f];
+        }
+        // Нулевые и отрицательные времена игнорируются.
+        float before = a.GetScale();
+        same = same && a.Update(0.0f) == before && a.Update(-5.0f) == before && a.Update(NAN) == before;
+        printf("Determinism and Reset: %s\n", same ? "ok" : "FAILED");
+        return same;
+    }
+
+    int ReplayTrace(const char* path) {
+        FILE* file = fopen(path, "r");
+        if (file == nullptr) {
+            printf("cannot open %s\n", path);
+            return 1;
+        }
+        DynamicResolution controller;
+        float frameMs;
+        unsigned frame = 0;
+        printf("frame\tms\tsmoothed\tscale\n");
+        while (fscanf(file, "%f", &frameMs) == 1) {
+            float scale = controller.Update(frameMs);
+            printf("%u\t%.3f\t%.3f\t%.2f\n", frame++, frameMs, controller.GetSmoothedFrameMs(), scale);
+        }
+        fclose(file);
+        printf("%u frames, %u scale changes\n", frame, controller.GetChangeCount());
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* trace = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            trace = argv[++i];
+        } else {
+            printf("dynres [--trace <file with frame times in ms>]\n");
+            return 1;
+        }
+    }
+    if (trace != nullptr) {
+        return ReplayTrace(trace);
+    }
+
+    bool ok = true;
+    for (float gpuMs : { 5.0f, 10.0f, 18.0f, 25.0f, 40.0f, 80.0f }) {
+        ok = CheckSteadyLoad(gpuMs) && ok;
+    }
+    ok = CheckStep(8.0f, 30.0f) && ok;
+    ok = CheckStep(12.0f, 50.0f) && ok;
+    ReportSpike();
+    ok = CheckDeterminism() && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,749 @@
+﻿#include "GltfLoader.h"
+#include <cmath>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    enum class JsonType : uint8_t {
+        Null,
+        False,
+        True,
+        Number,
+        String,
+        Array,
+        Object
+    };
+
+    // Значения хранятся подряд в порядке обхода в глубину, end - индекс за поддеревом. У объекта дочерние
+    // элементы идут парами ключ - значение. Строки указывают в исходный текст без раскрытия escape-последовательностей.
+    struct JsonValue {
+        JsonType type;
+        uint32_t count;
+        uint32_t end;
+        uint32_t length;
+        const char* text;
+        double number;
+    };
+
+    class Json {
+    public:
+        static const size_t npos = SIZE_MAX;
+
+        // Однопроходный разбор без рекурсивных аллокаций: каждое значение - одна запись в values_.
+        bool Parse(const char* text, size_t length) {
+            p_ = text;
+            end_ = text + length;
+            values_.clear();
+            values_.reserve(length / 8);
+            SkipSpace();
+            if (!ParseValue(0))
+                return false;
+            SkipSpace();
+            return p_ == end_;
+        }
+
+        size_t Member(size_t object, const char* key) const {
+            if (object == npos || values_[object].type != JsonType::Object)
+                return npos;
+            size_t keyLength = strlen(key);
+            size_t i = object + 1;
+            for (uint32_t c = 0; c < values_[object].count; c++) {
+                const JsonValue& name = values_[i];
+                if (name.length == keyLength && memcmp(name.text, key, keyLength) == 0)
+                    return i + 1;
+                i = values_[i + 1].end;
+            }
+            return npos;
+        }
+
+        // Обход массива: First, затем Next, пока индекс меньше End.
+        size_t First(size_t array) const {
+            return array + 1;
+        }
+
+        size_t Next(size_t value) const {
+            return values_[value].end;
+        }
+
+        size_t End(size_t array) const {
+            return values_[array].end;
+        }
+
+        size_t Count(size_t value) const {
+            return value == npos || values_[value].type != JsonType::Array ? 0 : values_[value].count;
+        }
+
+        bool IsArray(size_t value) const {
+            return value != npos && values_[value].type == JsonType::Array;
+        }
+
+        double Number(size_t value, double fallback) const {
+            return value == npos || values_[value].type != JsonType::Number ? fallback : values_[value].number;
+        }
+
+        int Int(size_t value, int fallback) const {
+            double number = Number(value, fallback);
+            return number >= INT_MIN && number <= INT_MAX ? (int)number : fallback;
+        }
+
+        // Целое неотрицательное число не больше limit; у отсутствующего поля - fallback. false, если поле есть,
+        // но не такое число.
+        bool Size(size_t value, size_t fallback, size_t limit, size_t& out) const {
+            if (value == npos) {
+                out = fallback;
+                return true;
+            }
+            if (values_[value].type != JsonType::Number)
+                return false;
+            double number = values_[value].number;
+            // Больше 2^53 целые double уже не точны, такие размеры в файле не встречаются.
+            if (!(number >= 0.0) || number > 9007199254740992.0 || number != std::floor(number) || number > (double)limit)
+                return false;
+            out = (size_t)number;
+            return out <= limit;
+        }
+
+        bool Equals(size_t value, const char* text) const {
+            if (value == npos || values_[value].type != JsonType::String)
+                return false;
+            size_t length = strlen(text);
+            return values_[value].length == length && memcmp(values_[value].text, text, length) == 0;
+        }
+
+        bool IsString(size_t value) const {
+            return value != npos && values_[value].type == JsonType::String;
+        }
+
+    private:
+        void SkipSpace() {
+            while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+                p_++;
+            }
+        }
+
+        size_t Push(JsonType type) {
+            values_.push_back({ type, 0, 0, 0, nullptr, 0.0 });
+            return values_.size() - 1;
+        }
+
+        bool ParseValue(int depth) {
+            if (p_ == end_ || depth > 64)
+                return false;
+
+            size_t index;
+            switch (*p_) {
+            case '{':
+            case '[': {
+                bool object = *p_ == '{';
+                char close = object ? '}' : ']';
+                index = Push(object ? JsonType::Object : JsonType::Array);
+                p_++;
+                SkipSpace();
+                uint32_t count = 0;
+                if (p_ < end_ && *p_ == close) {
+                    p_++;
+                }
+                else {
+                    while (true) {
+                        if (object) {
+                            if (p_ == end_ || *p_ != '"' || !ParseValue(depth + 1))
+                                return false;
+                            SkipSpace();
+                            if (p_ == end_ || *p_ != ':')
+                                return false;
+                            p_++;
+                            SkipSpace();
+                        }
+                        if (!ParseValue(depth + 1))
+                            return false;
+                        count++;
+                        SkipSpace();
+                        if (p_ == end_)
+                            return false;
+                        if (*p_ == ',') {
+                            p_++;
+                            SkipSpace();
+                            continue;
+                        }
+                        if (*p_ != close)
+                            return false;
+                        p_++;
+                        break;
+                    }
+                }
+                values_[index].count = count;
+                break;
+            }
+            case '"': {
+                index = Push(JsonType::String);
+                const char* start = ++p_;
+                while (p_ < end_ && *p_ != '"') {
+                    p_ += *p_ == '\\' ? 2 : 1;
+                }
+                if (p_ >= end_)
+                    return false;
+                values_[index].text = start;
+                values_[index].length = (uint32_t)(p_ - start);
+                p_++;
+                break;
+            }
+            case 't':
+                if (end_ - p_ < 4 || memcmp(p_, "true", 4) != 0)
+                    return false;
+                index = Push(JsonType::True);
+                p_ += 4;
+                break;
+            case 'f':
+                if (end_ - p_ < 5 || memcmp(p_, "false", 5) != 0)
+                    return false;
+                index = Push(JsonType::False);
+                p_ += 5;
+                break;
+            case 'n':
+                if (end_ - p_ < 4 || memcmp(p_, "null", 4) != 0)
+                    return false;
+                index = Push(JsonType::Null);
+                p_ += 4;
+                break;
+            default:
+                index = Push(JsonType::Number);
+                if (!ParseNumber(values_[index].number))
+                    return false;
+                break;
+            }
+            values_[index].end = (uint32_t)values_.size();
+            return true;
+        }
+
+        // Разбор числа без strtod, который зависит от локали и требует завершающего нуля.
+        bool ParseNumber(double& result) {
+            bool negative = p_ < end_ && *p_ == '-';
+            if (negative)
+                p_++;
+            const char* digits = p_;
+            double value = 0.0;
+            while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+                value = value * 10.0 + (*p_++ - '0');
+            }
+            if (p_ == digits)
+                return false;
+            int exponent = 0;
+            if (p_ < end_ && *p_ == '.') {
+                p_++;
+                while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+                    value = value * 10.0 + (*p_++ - '0');
+                    exponent--;
+                }
+            }
+            if (p_ < end_ && (*p_ == 'e' || *p_ == 'E')) {
+                p_++;
+                bool negativeExponent = p_ < end_ && *p_ == '-';
+                if (p_ < end_ && (*p_ == '-' || *p_ == '+'))
+                    p_++;
+                int e = 0;
+                while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+                    e = std::min(e * 10 + (*p_++ - '0'), 10000);
+                }
+                exponent += negativeExponent ? -e : e;
+            }
+            if (exponent != 0)
+                value *= std::pow(10.0, exponent);
+            result = negative ? -value : value;
+            return true;
+        }
+
+        const char* p_ = nullptr;
+        const char* end_ = nullptr;
+        std::vector<JsonValue> values_;
+    };
+
+    // Матрицы 4x4 по столбцам, как в glTF.
+    void Multiply(const float* a, const float* b, float* out) {
+        float result[16];
+        for (int column = 0; column < 4; column++) {
+            for (int row = 0; row < 4; row++) {
+                float sum = 0.0f;
+                for (int k = 0; k < 4; k++) {
+                    sum += a[k * 4 + row] * b[column * 4 + k];
+                }
+                result[column * 4 + row] = sum;
+            }
+        }
+        memcpy(out, result, sizeof(result));
+    }
+
+    void ComposeTRS(const float* t, const float* q, const float* s, float* out) {
+        float x = q[0], y = q[1], z = q[2], w = q[3];
+        float rotation[9] = {
+            1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + z * w), 2.0f * (x * z - y * w),
+            2.0f * (x * y - z * w), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + x * w),
+            2.0f * (x * z + y * w), 2.0f * (y * z - x * w), 1.0f - 2.0f * (x * x + y * y)
+        };
+        for (int column = 0; column < 3; column++) {
+            for (int row = 0; row < 3; row++) {
+                out[column * 4 + row] = rotation[column * 3 + row] * s[column];
+            }
+            out[column * 4 + 3] = 0.0f;
+        }
+        out[12] = t[0];
+        out[13] = t[1];
+        out[14] = t[2];
+        out[15] = 1.0f;
+    }
+
+    size_t ComponentSize(uint32_t componentType) {
+        switch (componentType) {
+        case mesh::Byte:
+        case mesh::UnsignedByte:
+            return 1;
+        case mesh::Short:
+        case mesh::UnsignedShort:
+            return 2;
+        case mesh::UnsignedInt:
+        case mesh::Float:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
+    uint32_t ComponentCount(const Json& json, size_t type) {
+        static const struct {
+            const char* name;
+            uint32_t count;
+        } types[] = { { "SCALAR", 1 }, { "VEC2", 2 }, { "VEC3", 3 }, { "VEC4", 4 }, { "MAT2", 4 }, { "MAT3", 9 }, { "MAT4", 16 } };
+        for (const auto& entry : types) {
+            if (json.Equals(type, entry.name))
+                return entry.count;
+        }
+        return 0;
+    }
+
+    void ReadFloats(const Json& json, size_t array, float* out, size_t count) {
+        if (!json.IsArray(array) || json.Count(array) != count)
+            return;
+        size_t i = 0;
+        for (size_t value = json.First(array); value < json.End(array); value = json.Next(value)) {
+            out[i] = (float)json.Number(value, out[i]);
+            i++;
+        }
+    }
+
+    const uint32_t glbMagic = 0x46546C67;     // "glTF"
+    const uint32_t jsonChunk = 0x4E4F534A;    // "JSON"
+    const uint32_t binaryChunk = 0x004E4942;  // "BIN\0"
+}
+
+namespace mesh {
+    bool MappedFile::Open(const std::string& path) {
+        Close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        file_ = file;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            Close();
+            return false;
+        }
+        mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_ != nullptr) {
+            data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        }
+        if (data_ == nullptr) {
+            Close();
+            return false;
+        }
+        size_ = (size_t)size.QuadPart;
+#else
+        int file = open(path.c_str(), O_RDONLY);
+        if (file < 0)
+            return false;
+        struct stat info;
+        if (fstat(file, &info) != 0 || info.st_size == 0) {
+            close(file);
+            return false;
+        }
+        void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        close(file);
+        if (data == MAP_FAILED)
+            return false;
+        data_ = static_cast<const uint8_t*>(data);
+        size_ = (size_t)info.st_size;
+#endif
+        return true;
+    }
+
+    void MappedFile::Close() {
+#ifdef _WIN32
+        if (data_ != nullptr)
+            UnmapViewOfFile(data_);
+        if (mapping_ != nullptr)
+            CloseHandle(mapping_);
+        if (file_ != nullptr)
+            CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = nullptr;
+#else
+        if (data_ != nullptr)
+            munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    MappedFile::~MappedFile() {
+        Close();
+    }
+
+    bool GlbModel::Fail(const char* message) {
+        error_ = message;
+        accessors_.clear();
+        materials_.clear();
+        primitives_.clear();
+        instances_.clear();
+        file_.Close();
+        return false;
+    }
+
+    bool GlbModel::Load(const std::string& path) {
+        Fail("");
+        if (!file_.Open(path))
+            return Fail("cannot open file");
+
+        const uint8_t* data = file_.GetData();
+        size_t size = file_.GetSize();
+        uint32_t header[5];
+        if (size < sizeof(header))
+            return Fail("file is too small");
+        memcpy(header, data, sizeof(header));
+        if (header[0] != glbMagic || header[1] != 2)
+            return Fail("not a glTF 2.0 binary");
+        // Заголовок: magic, версия, длина файла, затем заголовок первого блока - длина и тип.
+        if (header[4] != jsonChunk || 20 + (size_t)header[3] > size)
+            return Fail("missing JSON chunk");
+
+        const char* text = reinterpret_cast<const char*>(data + 20);
+        size_t textLength = header[3];
+        const uint8_t* binary = nullptr;
+        size_t binaryLength = 0;
+        size_t binaryOffset = 20 + ((textLength + 3) & ~(size_t)3);
+        if (binaryOffset + 8 <= size) {
+            uint32_t chunk[2];
+            memcpy(chunk, data + binaryOffset, sizeof(chunk));
+            if (chunk[1] == binaryChunk && binaryOffset + 8 + (size_t)chunk[0] <= size) {
+                binary = data + binaryOffset + 8;
+                binaryLength = chunk[0];
+            }
+        }
+
+        Json json;
+        if (!json.Parse(text, textLength))
+            return Fail("malformed JSON chunk");
+        const size_t root = 0;
+
+        size_t buffers = json.Member(root, "buffers");
+        if (json.Count(buffers) > 1 || (json.Count(buffers) == 1 && json.IsString(json.Member(json.First(buffers), "uri"))))
+            return Fail("external buffers are not supported");
+
+        // Срезы буфера: смещение и длина внутри бинарного блока, шаг элементов.
+        struct View {
+            size_t offset;
+            size_t length;
+            size_t stride;
+        };
+        std::vector<View> views;
+        size_t bufferViews = json.Member(root, "bufferViews");
+        if (json.IsArray(bufferViews)) {
+            for (size_t view = json.First(bufferViews); view < json.End(bufferViews); view = json.Next(view)) {
+                View v;
+                if (!json.Size(json.Member(view, "byteOffset"), 0, binaryLength, v.offset) ||
+                    !json.Size(json.Member(view, "byteLength"), 0, binaryLength, v.length) ||
+                    !json.Size(json.Member(view, "byteStride"), 0, 255, v.stride) ||
+                    json.Int(json.Member(view, "buffer"), 0) != 0 || v.offset > binaryLength - v.length)
+                    return Fail("buffer view is out of range");
+                views.push_back(v);
+            }
+        }
+
+        size_t accessors = json.Member(root, "accessors");
+        if (json.IsArray(accessors)) {
+            for (size_t accessor = json.First(accessors); accessor < json.End(accessors); accessor = json.Next(accessor)) {
+                GltfAccessor a;
+                if (!json.Size(json.Member(accessor, "count"), 0, SIZE_MAX, a.count))
+                    return Fail("accessor is out of range");
+                a.componentType = (uint32_t)json.Int(json.Member(accessor, "componentType"), 0);
+                a.components = ComponentCount(json, json.Member(accessor, "type"));
+                a.bufferView = json.Int(json.Member(accessor, "bufferView"), -1);
+                if (json.Member(accessor, "sparse") != Json::npos)
+                    return Fail("sparse accessors are not supported");
+
+                size_t elementSize = ComponentSize(a.componentType) * a.components;
+                if (elementSize == 0)
+                    return Fail("unknown accessor type");
+                if (a.bufferView >= (int)views.size())
+                    return Fail("accessor references a missing buffer view");
+                if (a.bufferView >= 0) {
+                    const View& view = views[a.bufferView];
+                    size_t offset;
+                    if (!json.Size(json.Member(accessor, "byteOffset"), 0, view.length, offset))
+                        return Fail("accessor is out of range");
+                    a.stride = view.stride != 0 ? view.stride : elementSize;
+                    // Последний элемент заканчивается не дальше конца среза; вычитания вместо сложений, чтобы
+                    // ничего не переполнялось.
+                    if (a.count > 0 && (elementSize > view.length - offset ||
+                                        a.count - 1 > (view.length - offset - elementSize) / a.stride))
+                        return Fail("accessor is out of range");
+                    a.data = binary + view.offset + offset;
+                }
+                accessors_.push_back(a);
+            }
+        }
+
+        size_t materials = json.Member(root, "materials");
+        if (json.IsArray(materials)) {
+            for (size_t material = json.First(materials); material < json.End(materials); material = json.Next(material)) {
+                GltfMaterial m;
+                size_t pbr = json.Member(material, "pbrMetallicRoughness");
+                ReadFloats(json, json.Member(pbr, "baseColorFactor"), m.baseColor, 4);
+                m.metallic = (float)json.Number(json.Member(pbr, "metallicFactor"), 1.0);
+                m.roughness = (float)json.Number(json.Member(pbr, "roughnessFactor"), 1.0);
+                materials_.push_back(m);
+            }
+        }
+
+        // Примитивы всех мешей в одном массиве, у меша - первый примитив и их число.
+        std::vector<std::pair<size_t, size_t>> meshes;
+        size_t meshArray = json.Member(root, "meshes");
+        if (json.IsArray(meshArray)) {
+            for (size_t m = json.First(meshArray); m < json.End(meshArray); m = json.Next(m)) {
+                size_t first = primitives_.size();
+                size_t primitives = json.Member(m, "primitives");
+                if (json.IsArray(primitives)) {
+                    for (size_t p = json.First(primitives); p < json.End(primitives); p = json.Next(p)) {
+                        // Поддерживаются только списки треугольников (mode 4 по умолчанию).
+                        if (json.Int(json.Member(p, "mode"), 4) != 4)
+                            continue;
+                        size_t attributes = json.Member(p, "attributes");
+                        GltfPrimitive primitive;
+                        primitive.position = json.Int(json.Member(attributes, "POSITION"), -1);
+                        primitive.normal = json.Int(json.Member(attributes, "NORMAL"), -1);
+                        primitive.indices = json.Int(json.Member(p, "indices"), -1);
+                        primitive.material = json.Int(json.Member(p, "material"), -1);
+                        if (primitive.position < 0 || primitive.position >= (int)accessors_.size() ||
+                            primitive.normal >= (int)accessors_.size() || primitive.indices >= (int)accessors_.size() ||
+                            primitive.material >= (int)materials_.size())
+                            return Fail("primitive references a missing accessor or material");
+                        primitives_.push_back(primitive);
+                    }
+                }
+                meshes.push_back({ first, primitives_.size() - first });
+            }
+        }
+
+        // Обход иерархии узлов сцены с накоплением матриц.
+        size_t nodes = json.Member(root, "nodes");
+        std::vector<size_t> nodeValues;
+        if (json.IsArray(nodes)) {
+            for (size_t node = json.First(nodes); node < json.End(nodes); node = json.Next(node)) {
+                nodeValues.push_back(node);
+            }
+        }
+        const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+        std::vector<std::pair<int, std::vector<float>>> stack;
+        size_t scenes = json.Member(root, "scenes");
+        if (json.IsArray(scenes) && json.Count(scenes) > 0) {
+            size_t scene = json.First(scenes);
+            for (int i = json.Int(json.Member(root, "scene"), 0); i > 0 && scene < json.End(scenes); i--) {
+                scene = json.Next(scene);
+            }
+            size_t roots = json.Member(scene, "nodes");
+            if (json.IsArray(roots)) {
+                for (size_t r = json.First(roots); r < json.End(roots); r = json.Next(r)) {
+                    stack.push_back({ json.Int(r, -1), std::vector<float>(identity, identity + 16) });
+                }
+            }
+        }
+        else {
+            for (size_t m = 0; m < meshes.size(); m++) {
+                for (size_t p = 0; p < meshes[m].second; p++) {
+                    GltfInstance instance = { meshes[m].first + p, {} };
+                    memcpy(instance.transform, identity, sizeof(identity));
+                    instances_.push_back(instance);
+                }
+            }
+        }
+
+        size_t visited = 0;
+        while (!stack.empty()) {
+            int index = stack.back().first;
+            std::vector<float> parent = std::move(stack.back().second);
+            stack.pop_back();
+            if (index < 0 || index >= (int)nodeValues.size() || ++visited > nodeValues.size() * 4)
+                return Fail("invalid node hierarchy");
+
+            size_t node = nodeValues[index];
+            float local[16];
+            memcpy(local, identity, sizeof(local));
+            size_t matrix = json.Member(node, "matrix");
+            if (json.IsArray(matrix)) {
+                ReadFloats(json, matrix, local, 16);
+            }
+            else {
+                float t[3] = { 0.0f, 0.0f, 0.0f }, r[4] = { 0.0f, 0.0f, 0.0f, 1.0f }, s[3] = { 1.0f, 1.0f, 1.0f };
+                ReadFloats(json, json.Member(node, "translation"), t, 3);
+                ReadFloats(json, json.Member(node, "rotation"), r, 4);
+                ReadFloats(json, json.Member(node, "scale"), s, 3);
+                ComposeTRS(t, r, s, local);
+            }
+            std::vector<float> world(16);
+            Multiply(parent.data(), local, world.data());
+
+            int m = json.Int(json.Member(node, "mesh"), -1);
+            if (m >= (int)meshes.size())
+                return Fail("node references a missing mesh");
+            if (m >= 0) {
+                for (size_t p = 0; p < meshes[m].second; p++) {
+                    GltfInstance instance = { meshes[m].first + p, {} };
+                    memcpy(instance.transform, world.data(), sizeof(instance.transform));
+                    instances_.push_back(instance);
+                }
+            }
+
+            size_t children = json.Member(node, "children");
+            if (json.IsArray(children)) {
+                for (size_t c = json.First(children); c < json.End(children); c = json.Next(c)) {
+                    stack.push_back({ json.Int(c, -1), world });
+                }
+            }
+        }
+        return true;
+    }
+
+    bool GlbModel::GetIndices(const GltfPrimitive& primitive, const uint32_t*& data, size_t& count,
+                              std::vector<uint32_t>& storage) const {
+        if (primitive.indices < 0) {
+            count = accessors_[primitive.position].count;
+            storage.resize(count);
+            for (size_t i = 0; i < count; i++) {
+                storage[i] = (uint32_t)i;
+            }
+            data = storage.data();
+            return true;
+        }
+
+        const GltfAccessor& accessor = accessors_[primitive.indices];
+        if (accessor.data == nullptr || accessor.components != 1)
+            return false;
+        count = accessor.count;
+        if (accessor.componentType == UnsignedInt && accessor.stride == sizeof(uint32_t)) {
+            data = reinterpret_cast<const uint32_t*>(accessor.data);
+            return true;
+        }
+
+        storage.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            const uint8_t* element = accessor.data + i * accessor.stride;
+            if (accessor.componentType == UnsignedByte) {
+                storage[i] = *element;
+            }
+            else if (accessor.componentType == UnsignedShort) {
+                uint16_t value;
+                memcpy(&value, element, sizeof(value));
+                storage[i] = value;
+            }
+            else if (accessor.componentType == UnsignedInt) {
+                memcpy(&storage[i], element, sizeof(uint32_t));
+            }
+            else {
+                return false;
+            }
+        }
+        data = storage.data();
+        return true;
+    }
+
+    bool GlbModel::GetVertices(const GltfPrimitive& primitive, const uint8_t*& data, size_t& count,
+                               std::vector<uint8_t>& storage) const {
+        const size_t stride = 6 * sizeof(float);
+        const GltfAccessor& position = accessors_[primitive.position];
+        if (position.data == nullptr || position.componentType != Float || position.components != 3)
+            return false;
+        count = position.count;
+
+        const GltfAccessor* normal = primitive.normal >= 0 ? &accessors_[primitive.normal] : nullptr;
+        if (normal != nullptr && (normal->data == nullptr || normal->componentType != Float || normal->components != 3 ||
+            normal->count != count))
+            normal = nullptr;
+
+        // Чередующиеся позиция и нормаль с шагом 24 байта уже совпадают с форматом вершины.
+        if (normal != nullptr && position.stride == stride && normal->stride == stride &&
+            normal->data == position.data + 3 * sizeof(float)) {
+            data = position.data;
+            return true;
+        }
+
+        storage.resize(count * stride);
+        for (size_t i = 0; i < count; i++) {
+            memcpy(&storage[i * stride], position.data + i * position.stride, 3 * sizeof(float));
+            if (normal != nullptr)
+                memcpy(&storage[i * stride + 3 * sizeof(float)], normal->data + i * normal->stride, 3 * sizeof(float));
+        }
+
+        if (normal == nullptr) {
+            // Нормали по площади смежных треугольников.
+            std::vector<uint32_t> indexStorage;
+            const uint32_t* indices;
+            size_t indexCount;
+            if (!GetIndices(primitive, indices, indexCount, indexStorage))
+                return false;
+            std::vector<float> normals(count * 3, 0.0f);
+            for (size_t i = 0; i + 2 < indexCount; i += 3) {
+                if (indices[i] >= count || indices[i + 1] >= count || indices[i + 2] >= count)
+                    return false;
+                float p[3][3];
+                for (int k = 0; k < 3; k++) {
+                    memcpy(p[k], &storage[indices[i + k] * stride], sizeof(p[k]));
+                }
+                float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+                float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+                float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+                for (int k = 0; k < 3; k++) {
+                    for (int j = 0; j < 3; j++) {
+                        normals[indices[i + k] * 3 + j] += n[j];
+                    }
+                }
+            }
+            for (size_t v = 0; v < count; v++) {
+                float* n = &normals[v * 3];
+                float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                if (length > 0.0f) {
+                    n[0] /= length;
+                    n[1] /= length;
+                    n[2] /= length;
+                }
+                memcpy(&storage[v * stride + 3 * sizeof(float)], n, 3 * sizeof(float));
+            }
+        }
+        data = storage.data();
+        return true;
+    }
+}
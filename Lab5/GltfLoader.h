@@ -0,0 +1,118 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+// Загрузка моделей glTF 2.0 в бинарном контейнере GLB. Файл отображается в память, данные аксессоров
+// указывают прямо в бинарный блок и копируются только при необходимости преобразовать формат.
+namespace mesh {
+    // Файл, отображенный в память только для чтения.
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool Open(const std::string& path);
+        void Close();
+
+        const uint8_t* GetData() const {
+            return data_;
+        };
+
+        size_t GetSize() const {
+            return size_;
+        };
+
+        ~MappedFile();
+
+    private:
+        const uint8_t* data_ = nullptr;
+        size_t size_ = 0;
+#ifdef _WIN32
+        void* file_ = nullptr;
+        void* mapping_ = nullptr;
+#endif
+    };
+
+    enum ComponentType : uint32_t {
+        Byte = 5120,
+        UnsignedByte = 5121,
+        Short = 5122,
+        UnsignedShort = 5123,
+        UnsignedInt = 5125,
+        Float = 5126
+    };
+
+    struct GltfAccessor {
+        const uint8_t* data = nullptr;  // первый элемент внутри отображенного файла
+        size_t count = 0;
+        size_t stride = 0;              // расстояние между элементами в байтах
+        uint32_t componentType = 0;
+        uint32_t components = 0;        // 1 для SCALAR, 3 для VEC3 и т.д.
+        int bufferView = -1;
+    };
+
+    struct GltfMaterial {
+        float baseColor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        float metallic = 1.0f;
+        float roughness = 1.0f;
+    };
+
+    struct GltfPrimitive {
+        int position = -1;
+        int normal = -1;
+        int indices = -1;
+        int material = -1;
+    };
+
+    // Примитив в сцене: матрица 4x4 по столбцам, как в glTF.
+    struct GltfInstance {
+        size_t primitive;
+        float transform[16];
+    };
+
+    class GlbModel {
+    public:
+        bool Load(const std::string& path);
+
+        const std::string& GetError() const {
+            return error_;
+        };
+
+        const std::vector<GltfAccessor>& GetAccessors() const {
+            return accessors_;
+        };
+
+        const std::vector<GltfMaterial>& GetMaterials() const {
+            return materials_;
+        };
+
+        const std::vector<GltfPrimitive>& GetPrimitives() const {
+            return primitives_;
+        };
+
+        const std::vector<GltfInstance>& GetInstances() const {
+            return instances_;
+        };
+
+        // Вершины примитива как float3 позиция + float3 нормаль (24 байта). Если в файле уже такой чередующийся
+        // слой, data указывает в файл, иначе вершины собираются в storage. Без нормалей они вычисляются.
+        bool GetVertices(const GltfPrimitive& primitive, const uint8_t*& data, size_t& count, std::vector<uint8_t>& storage) const;
+        // Индексы как uint32. Без копирования, если в файле они плотно упакованы в UNSIGNED_INT.
+        bool GetIndices(const GltfPrimitive& primitive, const uint32_t*& data, size_t& count, std::vector<uint32_t>& storage) const;
+
+    private:
+        bool Fail(const char* message);
+
+        MappedFile file_;
+        std::string error_;
+        std::vector<GltfAccessor> accessors_;
+        std::vector<GltfMaterial> materials_;
+        std::vector<GltfPrimitive> primitives_;
+        std::vector<GltfInstance> instances_;
+    };
+}
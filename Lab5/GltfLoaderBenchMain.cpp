@@ -0,0 +1,292 @@
+﻿// Замер и проверка GltfLoader, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 GltfLoaderBenchMain.cpp GltfLoader.cpp MeshGenerator.cpp -o gltfloader
+// Примеры:
+//   ./gltfloader
+//   ./gltfloader --tessellation 3000 --dir /tmp
+// Сферы UVSphere записываются в GLB с чередующимися (позиция + нормаль, шаг 24) и раздельными потоками,
+// с индексами UNSIGNED_INT и UNSIGNED_SHORT, и читаются обратно. Большая сфера сравнивается с чтением всего файла
+// через fread. Испорченные файлы (срезы и аксессоры за пределами буфера, отрицательные и дробные смещения,
+// переполнение count * stride) должны отклоняться при загрузке.
+#include "GltfLoader.h"
+#include "MeshGenerator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace {
+    const uint32_t glbMagic = 0x46546C67;     // "glTF"
+    const uint32_t jsonChunk = 0x4E4F534A;    // "JSON"
+    const uint32_t binaryChunk = 0x004E4942;  // "BIN\0"
+
+    bool WriteGlb(const std::string& path, std::string json, const std::vector<uint8_t>& binary) {
+        while (json.size() % 4 != 0) {
+            json += ' ';
+        }
+        FILE* file = fopen(path.c_str(), "wb");
+        if (file == nullptr)
+            return false;
+        uint32_t header[5] = { glbMagic, 2, (uint32_t)(12 + 8 + json.size() + 8 + binary.size()), (uint32_t)json.size(), jsonChunk };
+        uint32_t chunk[2] = { (uint32_t)binary.size(), binaryChunk };
+        bool written = fwrite(header, sizeof(header), 1, file) == 1 && fwrite(json.data(), 1, json.size(), file) == json.size() &&
+            fwrite(chunk, sizeof(chunk), 1, file) == 1 && fwrite(binary.data(), 1, binary.size(), file) == binary.size();
+        return fclose(file) == 0 && written;
+    }
+
+    template<typename T>
+    void Append(std::vector<uint8_t>& binary, const T* data, size_t count) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+        binary.insert(binary.end(), bytes, bytes + count * sizeof(T));
+    }
+
+    // Один примитив с материалом под двумя узлами: перенос у родителя, масштаб и поворот у дочернего.
+    std::string MakeSphereGlb(const mesh::MeshData& sphere, bool interleaved, bool shortIndices, bool normals,
+                              std::vector<uint8_t>& binary) {
+        size_t n = sphere.GetVertexCount();
+        std::string count = std::to_string(n);
+        std::string views, accessors;
+        binary.clear();
+        if (interleaved) {
+            std::vector<float> vertices(n * 6);
+            for (size_t i = 0; i < n; i++) {
+                float vertex[6] = { sphere.position.x[i], sphere.position.y[i], sphere.position.z[i],
+                                    sphere.normal.x[i], sphere.normal.y[i], sphere.normal.z[i] };
+                std::copy(vertex, vertex + 6, vertices.begin() + i * 6);
+            }
+            Append(binary, vertices.data(), vertices.size());
+            views = "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" + std::to_string(n * 24) + ",\"byteStride\":24}";
+            accessors = "{\"bufferView\":0,\"componentType\":5126,\"count\":" + count + ",\"type\":\"VEC3\"},"
+                "{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5126,\"count\":" + count + ",\"type\":\"VEC3\"}";
+        } else {
+            std::vector<float> positions(n * 3), normalData(n * 3);
+            for (size_t i = 0; i < n; i++) {
+                positions[i * 3] = sphere.position.x[i];
+                positions[i * 3 + 1] = sphere.position.y[i];
+                positions[i * 3 + 2] = sphere.position.z[i];
+                normalData[i * 3] = sphere.normal.x[i];
+                normalData[i * 3 + 1] = sphere.normal.y[i];
+                normalData[i * 3 + 2] = sphere.normal.z[i];
+            }
+            Append(binary, positions.data(), positions.size());
+            Append(binary, normalData.data(), normalData.size());
+            views = "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" + std::to_string(n * 12) + "},"
+                "{\"buffer\":0,\"byteOffset\":" + std::to_string(n * 12) + ",\"byteLength\":" + std::to_string(n * 12) + "}";
+            accessors = "{\"bufferView\":0,\"componentType\":5126,\"count\":" + count + ",\"type\":\"VEC3\"},"
+                "{\"bufferView\":1,\"componentType\":5126,\"count\":" + count + ",\"type\":\"VEC3\"}";
+        }
+        size_t indexOffset = binary.size();
+        if (shortIndices) {
+            std::vector<uint16_t> indices(sphere.indices.begin(), sphere.indices.end());
+            Append(binary, indices.data(), indices.size());
+        } else {
+            Append(binary, sphere.indices.data(), sphere.indices.size());
+        }
+        binary.resize((binary.size() + 3) & ~(size_t)3);
+        views += ",{\"buffer\":0,\"byteOffset\":" + std::to_string(indexOffset) + ",\"byteLength\":" +
+            std::to_string(sphere.indices.size() * (shortIndices ? 2 : 4)) + "}";
+        accessors += ",{\"bufferView\":" + std::string(interleaved ? "1" : "2") + ",\"componentType\":" +
+            (shortIndices ? "5123" : "5125") + ",\"count\":" + std::to_string(sphere.indices.size()) + ",\"type\":\"SCALAR\"}";
+
+        return "{\"asset\":{\"version\":\"2.0\",\"generator\":\"gltf\\\"loader\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],"
+            "\"nodes\":[{\"children\":[1],\"translation\":[1,2,3]},{\"mesh\":0,\"scale\":[2,2,2],\"rotation\":[0,0.7071068,0,0.7071068]}],"
+            "\"meshes\":[{\"primitives\":[{\"attributes\":" + std::string(normals ? "{\"POSITION\":0,\"NORMAL\":1}" : "{\"POSITION\":0}") +
+            ",\"indices\":2,\"material\":0}]}],"
+            "\"materials\":[{\"pbrMetallicRoughness\":{\"baseColorFactor\":[0.5,0.25,1e-1,1.0],\"metallicFactor\":0.0,\"roughnessFactor\":0.35E0}}],"
+            "\"buffers\":[{\"byteLength\":" + std::to_string(binary.size()) + "}],\"bufferViews\":[" + views + "],\"accessors\":[" + accessors + "]}";
+    }
+
+    // Загрузка и сравнение с исходной сферой. Нормали без NORMAL вычисляются загрузчиком и сравниваются грубо.
+    bool CheckSphere(const std::string& path, const mesh::MeshData& sphere, const char* name, bool normals) {
+        mesh::GlbModel model;
+        auto start = std::chrono::steady_clock::now();
+        bool loaded = model.Load(path);
+        double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (!loaded || model.GetInstances().size() != 1) {
+            printf("%s: FAILED to load: %s\n", name, model.GetError().c_str());
+            return false;
+        }
+        const mesh::GltfInstance& instance = model.GetInstances()[0];
+        const mesh::GltfPrimitive& primitive = model.GetPrimitives()[instance.primitive];
+        const uint8_t* vertices;
+        const uint32_t* indices;
+        size_t vertexCount, indexCount;
+        std::vector<uint8_t> vertexStorage;
+        std::vector<uint32_t> indexStorage;
+        start = std::chrono::steady_clock::now();
+        bool read = model.GetVertices(primitive, vertices, vertexCount, vertexStorage) &&
+            model.GetIndices(primitive, indices, indexCount, indexStorage);
+        double getMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        bool same = read && vertexCount == sphere.GetVertexCount() && indexCount == sphere.indices.size() &&
+            std::equal(indices, indices + indexCount, sphere.indices.begin());
+        double positionError = 0.0, normalError = 0.0;
+        for (size_t i = 0; same && i < vertexCount; i++) {
+            const float* v = reinterpret_cast<const float*>(vertices + i * 24);
+            positionError = std::max(positionError, (double)std::fabs(v[0] - sphere.position.x[i]) +
+                std::fabs(v[1] - sphere.position.y[i]) + std::fabs(v[2] - sphere.position.z[i]));
+            normalError = std::max(normalError, (double)std::fabs(v[3] - sphere.normal.x[i]) +
+                std::fabs(v[4] - sphere.normal.y[i]) + std::fabs(v[5] - sphere.normal.z[i]));
+        }
+        const mesh::GltfMaterial& material = model.GetMaterials()[primitive.material];
+        const float* t = instance.transform;
+        // Поворот на 90 градусов вокруг Y и масштаб 2: первый столбец (0, 0, -2), перенос (1, 2, 3).
+        same = same && positionError == 0.0 && normalError < (normals ? 1e-6 : 0.1) && material.baseColor[2] == 0.1f &&
+            material.metallic == 0.0f && material.roughness == 0.35f && std::fabs(t[2] + 2.0f) < 1e-5f &&
+            t[12] == 1.0f && t[13] == 2.0f && t[14] == 3.0f;
+        printf("%s: load %.2f ms, get %.2f ms, vertices %s, indices %s, position error %.1e, normal error %.1e, %s\n",
+            name, loadMs, getMs, vertexStorage.empty() ? "zero-copy" : "copied", indexStorage.empty() ? "zero-copy" : "copied",
+            positionError, normalError, same ? "ok" : "MISMATCH");
+        return same;
+    }
+
+    // Загрузка, копирование вершин и индексов как в буфер GPU против чтения файла целиком через fread.
+    void MeasureLoad(const std::string& path, const char* name) {
+        double mapped = 1e30, whole = 1e30;
+        for (int run = 0; run < 3; run++) {
+            auto start = std::chrono::steady_clock::now();
+            mesh::GlbModel model;
+            model.Load(path);
+            const mesh::GltfPrimitive& primitive = model.GetPrimitives()[0];
+            const uint8_t* vertices;
+            const uint32_t* indices;
+            size_t vertexCount, indexCount;
+            std::vector<uint8_t> vertexStorage;
+            std::vector<uint32_t> indexStorage;
+            model.GetVertices(primitive, vertices, vertexCount, vertexStorage);
+            model.GetIndices(primitive, indices, indexCount, indexStorage);
+            std::vector<uint8_t> upload(vertexCount * 24 + indexCount * 4);
+            memcpy(upload.data(), vertices, vertexCount * 24);
+            memcpy(upload.data() + vertexCount * 24, indices, indexCount * 4);
+            mapped = std::min(mapped, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+            start = std::chrono::steady_clock::now();
+            FILE* file = fopen(path.c_str(), "rb");
+            fseek(file, 0, SEEK_END);
+            long size = ftell(file);
+            fseek(file, 0, SEEK_SET);
+            std::vector<uint8_t> data(size);
+            size_t read = fread(data.data(), 1, size, file);
+            fclose(file);
+            std::vector<uint8_t> upload2(upload.size());
+            memcpy(upload2.data(), data.data() + read - upload2.size(), upload2.size());
+            whole = std::min(whole, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        printf("%s: mapped load + upload copy %.1f ms, fread baseline %.1f ms\n", name, mapped, whole);
+    }
+
+    struct Malformed {
+        const char* name;
+        const char* views;
+        const char* accessors;
+        size_t binarySize;
+    };
+
+    // Каждый файл - один примитив с позициями в аксессоре 0; все должны отклоняться.
+    bool CheckMalformed(const std::string& dir) {
+        static const Malformed cases[] = {
+            { "negative view offset", "{\"buffer\":0,\"byteOffset\":-4096,\"byteLength\":4112}",
+              "{\"bufferView\":0,\"componentType\":5126,\"count\":1,\"type\":\"VEC3\"}", 16 },
+            { "view past the end", "{\"buffer\":0,\"byteOffset\":8,\"byteLength\":16}",
+              "{\"bufferView\":0,\"componentType\":5126,\"count\":1,\"type\":\"VEC3\"}", 16 },
+            { "view offset + length wraps", "{\"buffer\":0,\"byteOffset\":16,\"byteLength\":18446744073709551615}",
+              "{\"bufferView\":0,\"componentType\":5126,\"count\":1,\"type\":\"VEC3\"}", 16 },
+            { "fractional view offset", "{\"buffer\":0,\"byteOffset\":0.5,\"byteLength\":12}",
+              "{\"bufferView\":0,\"componentType\":5126,\"count\":1,\"type\":\"VEC3\"}", 16 },
+            { "negative stride", "{\"buffer\":0,\"byteLength\":16,\"byteStride\":-12}",
+              "{\"bufferView\":0,\"componentType\":5126,\"count\":1,\"type\":\"VEC3\"}", 16 },
+            { "negative count", "{\"buffer\":0,\"byteLength\":16}",
+              "{\"bufferView\":0,\"componentType\":5126,\"count\":-1,\"type\":\"VEC3\"}", 16 },
+            { "count * stride wraps", "{\"buffer\":0,\"byteLength\":16,\"byteStride\":12}",
+              "{\"bufferView\":0,\"componentType\":5126,\"count\":1537228672809129302,\"type\":\"VEC3\"}", 16 },
+            { "accessor offset past the view", "{\"buffer\":0,\"byteLength\":16}",
+              "{\"bufferView\":0,\"byteOffset\":8,\"componentType\":5126,\"count\":1,\"type\":\"VEC3\"}", 16 },
+            { "negative accessor offset", "{\"buffer\":0,\"byteOffset\":8,\"byteLength\":8}",
+              "{\"bufferView\":0,\"byteOffset\":-8,\"componentType\":5126,\"count\":1,\"type\":\"VEC3\"}", 16 },
+            { "string count", "{\"buffer\":0,\"byteLength\":16}",
+              "{\"bufferView\":0,\"componentType\":5126,\"count\":\"1\",\"type\":\"VEC3\"}", 16 },
+        };
+        std::string path = dir + "/gltfloader_malformed.glb";
+        bool ok = true;
+        for (const Malformed& test : cases) {
+            std::vector<uint8_t> binary(test.binarySize, 0);
+            std::string json = std::string("{\"asset\":{\"version\":\"2.0\"},\"nodes\":[{\"mesh\":0}],"
+                "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0}}]}],\"buffers\":[{\"byteLength\":") +
+                std::to_string(test.binarySize) + "}],\"bufferViews\":[" + test.views + "],\"accessors\":[" + test.accessors + "]}";
+            if (!WriteGlb(path, json, binary)) {
+                printf("cannot write %s\n", path.c_str());
+                return false;
+            }
+            mesh::GlbModel model;
+            bool loaded = model.Load(path);
+            printf("  %-30s %s (%s)\n", test.name, loaded ? "ACCEPTED" : "rejected", model.GetError().c_str());
+            ok = ok && !loaded;
+        }
+
+        // Обрезанный JSON и отсутствующий файл.
+        FILE* file = fopen(path.c_str(), "wb");
+        uint32_t header[5] = { glbMagic, 2, 0, 40, jsonChunk };
+        fwrite(header, sizeof(header), 1, file);
+        fwrite("{\"accessors\":[{\"count\":1,", 1, 25, file);
+        fclose(file);
+        mesh::GlbModel model;
+        bool truncated = model.Load(path);
+        printf("  %-30s %s (%s)\n", "truncated JSON chunk", truncated ? "ACCEPTED" : "rejected", model.GetError().c_str());
+        bool missing = model.Load(dir + "/gltfloader_missing.glb");
+        printf("  %-30s %s (%s)\n", "missing file", missing ? "ACCEPTED" : "rejected", model.GetError().c_str());
+        remove(path.c_str());
+        return ok && !truncated && !missing;
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned tessellation = 2000;
+    std::string dir = ".";
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--tessellation") && i + 1 < argc) {
+            tessellation = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--dir") && i + 1 < argc) {
+            dir = argv[++i];
+        } else {
+            printf("gltfloader [--tessellation <n>] [--dir <path>]\n");
+            return 1;
+        }
+    }
+
+    // UNSIGNED_SHORT - только для сферы меньше 65536 вершин.
+    mesh::MeshData small, big;
+    mesh::UVSphere(100, 100, small);
+    mesh::UVSphere(tessellation, tessellation, big);
+    struct Layout {
+        const char* name;
+        bool interleaved, shortIndices, normals;
+    } layouts[] = { { "interleaved, u32     ", true, false, true }, { "separate, u32        ", false, false, true },
+                    { "interleaved, u16     ", true, true, true }, { "no normals, u32      ", false, false, false } };
+    bool ok = true;
+    std::vector<uint8_t> binary;
+    std::string path = dir + "/gltfloader.glb";
+    for (const Layout& layout : layouts) {
+        if (!WriteGlb(path, MakeSphereGlb(small, layout.interleaved, layout.shortIndices, layout.normals, binary), binary)) {
+            printf("cannot write %s\n", path.c_str());
+            return 1;
+        }
+        ok = CheckSphere(path, small, layout.name, layout.normals) && ok;
+    }
+
+    printf("big sphere: %zu vertices, %zu triangles\n", big.GetVertexCount(), big.indices.size() / 3);
+    for (int interleaved = 1; interleaved >= 0; interleaved--) {
+        const char* name = interleaved ? "big interleaved      " : "big separate         ";
+        WriteGlb(path, MakeSphereGlb(big, interleaved != 0, false, true, binary), binary);
+        ok = CheckSphere(path, big, name, true) && ok;
+        MeasureLoad(path, name);
+    }
+    remove(path.c_str());
+
+    printf("malformed files:\n");
+    ok = CheckMalformed(dir) && ok;
+    printf("%s\n", ok ? "all checks passed" : "CHECKS FAILED");
+    return ok ? 0 : 1;
+}
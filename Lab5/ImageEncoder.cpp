@@ -0,0 +1,601 @@
+﻿#include "ImageEncoder.h"
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <fstream>
+
+namespace {
+    // Таблицы для CRC32 методом slicing-by-8.
+    struct CRCTable {
+        uint32_t values[8][256];
+
+        CRCTable() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                values[0][i] = c;
+            }
+            for (uint32_t i = 0; i < 256; i++) {
+                for (int t = 1; t < 8; t++) {
+                    values[t][i] = (values[t - 1][i] >> 8) ^ values[0][values[t - 1][i] & 0xFF];
+                }
+            }
+        }
+    };
+
+    uint32_t UpdateCRC(uint32_t crc, const uint8_t* data, size_t size) {
+        static const CRCTable table;
+        while (size >= 8) {
+            uint32_t low = crc ^ (uint32_t(data[0]) | (uint32_t(data[1]) << 8) | (uint32_t(data[2]) << 16) | (uint32_t(data[3]) << 24));
+            uint32_t high = uint32_t(data[4]) | (uint32_t(data[5]) << 8) | (uint32_t(data[6]) << 16) | (uint32_t(data[7]) << 24);
+            crc = table.values[7][low & 0xFF] ^ table.values[6][(low >> 8) & 0xFF] ^
+                table.values[5][(low >> 16) & 0xFF] ^ table.values[4][low >> 24] ^
+                table.values[3][high & 0xFF] ^ table.values[2][(high >> 8) & 0xFF] ^
+                table.values[1][(high >> 16) & 0xFF] ^ table.values[0][high >> 24];
+            data += 8;
+            size -= 8;
+        }
+        for (size_t i = 0; i < size; i++) {
+            crc = table.values[0][(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+    uint32_t Adler32(const uint8_t* data, size_t size) {
+        uint32_t a = 1, b = 0;
+        while (size > 0) {
+            size_t block = size < 5552 ? size : 5552;
+            size -= block;
+            for (size_t i = 0; i < block; i++) {
+                a += data[i];
+                b += a;
+            }
+            data += block;
+            a %= 65521;
+            b %= 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    void PutU32BE(std::vector<uint8_t>& out, uint32_t value) {
+        out.push_back(uint8_t(value >> 24));
+        out.push_back(uint8_t(value >> 16));
+        out.push_back(uint8_t(value >> 8));
+        out.push_back(uint8_t(value));
+    }
+
+    void PutChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size) {
+        PutU32BE(out, uint32_t(size));
+        size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        if (size > 0)
+            out.insert(out.end(), data, data + size);
+        uint32_t crc = UpdateCRC(0xFFFFFFFFu, &out[start], size + 4) ^ 0xFFFFFFFFu;
+        PutU32BE(out, crc);
+    }
+
+    class BitWriter {
+    public:
+        BitWriter(std::vector<uint8_t>& out) : out_(out) {};
+
+        // count не больше 32, в буфере копится до 32 бит и выводится сразу 4 байта.
+        void Put(uint32_t bits, int count) {
+            buffer_ |= uint64_t(bits) << used_;
+            used_ += count;
+            if (used_ >= 32) {
+                const uint8_t bytes[4] = { uint8_t(buffer_), uint8_t(buffer_ >> 8), uint8_t(buffer_ >> 16), uint8_t(buffer_ >> 24) };
+                out_.insert(out_.end(), bytes, bytes + 4);
+                buffer_ >>= 32;
+                used_ -= 32;
+            }
+        };
+
+        void Flush() {
+            while (used_ > 0) {
+                out_.push_back(uint8_t(buffer_));
+                buffer_ >>= 8;
+                used_ -= 8;
+            }
+            buffer_ = 0;
+            used_ = 0;
+        };
+
+    private:
+        std::vector<uint8_t>& out_;
+        uint64_t buffer_ = 0;
+        int used_ = 0;
+    };
+
+    const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const uint16_t distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const uint8_t distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    uint32_t ReverseBits(uint32_t code, int count) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < count; i++) {
+            reversed = (reversed << 1) | ((code >> i) & 1);
+        }
+        return reversed;
+    }
+
+    // Фиксированные коды Хаффмана (RFC 1951, 3.2.6), заранее развернутые для записи младшими битами вперед,
+    // и таблицы кодов длин и расстояний (расстояния больше 256 ищутся по (d - 1) >> 7, как в zlib).
+    struct FixedCodes {
+        uint16_t literal[288];
+        uint8_t literalLength[288];
+        uint8_t distance[30];
+        uint8_t lengthCode[259];
+        uint8_t distanceCode[512];
+
+        FixedCodes() {
+            for (int symbol = 0; symbol < 288; symbol++) {
+                uint32_t code;
+                int length;
+                if (symbol < 144) {
+                    code = 0x30 + symbol;
+                    length = 8;
+                }
+                else if (symbol < 256) {
+                    code = 0x190 + symbol - 144;
+                    length = 9;
+                }
+                else if (symbol < 280) {
+                    code = symbol - 256;
+                    length = 7;
+                }
+                else {
+                    code = 0xC0 + symbol - 280;
+                    length = 8;
+                }
+                literal[symbol] = uint16_t(ReverseBits(code, length));
+                literalLength[symbol] = uint8_t(length);
+            }
+            for (int d = 0; d < 30; d++) {
+                distance[d] = uint8_t(ReverseBits(d, 5));
+            }
+            for (int l = 0, length = 3; length <= 258; length++) {
+                while (l < 28 && lengthBase[l + 1] <= length) {
+                    l++;
+                }
+                lengthCode[length] = uint8_t(l);
+            }
+            for (int d = 0, value = 0; value < 512; value++) {
+                int firstDistance = value < 256 ? value + 1 : ((value - 256) << 7) + 1;
+                while (d < 29 && distBase[d + 1] <= firstDistance) {
+                    d++;
+                }
+                distanceCode[value] = uint8_t(d);
+            }
+        }
+    };
+
+    const FixedCodes& GetFixedCodes() {
+        static const FixedCodes codes;
+        return codes;
+    }
+
+    void PutFixedSymbol(BitWriter& writer, const FixedCodes& codes, int symbol) {
+        writer.Put(codes.literal[symbol], codes.literalLength[symbol]);
+    }
+
+    void PutMatch(BitWriter& writer, const FixedCodes& codes, int length, int distance) {
+        int l = codes.lengthCode[length];
+        PutFixedSymbol(writer, codes, 257 + l);
+        if (lengthExtra[l] > 0)
+            writer.Put(length - lengthBase[l], lengthExtra[l]);
+
+        int d = codes.distanceCode[distance <= 256 ? distance - 1 : 256 + ((distance - 1) >> 7)];
+        writer.Put(codes.distance[d], 5);
+        if (distExtra[d] > 0)
+            writer.Put(distance - distBase[d], distExtra[d]);
+    }
+
+    void DeflateStored(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+        size_t offset = 0;
+        do {
+            size_t block = size - offset < 65535 ? size - offset : 65535;
+            bool last = offset + block == size;
+            out.push_back(last ? 1 : 0);
+            out.push_back(uint8_t(block));
+            out.push_back(uint8_t(block >> 8));
+            out.push_back(uint8_t(~block));
+            out.push_back(uint8_t(~block >> 8));
+            if (block > 0)
+                out.insert(out.end(), data + offset, data + offset + block);
+            offset += block;
+        } while (offset < size);
+    }
+
+    // LZ77 с хеш-цепочками и фиксированными кодами Хаффмана (один блок BTYPE = 01). При maxChain = 1 проверяется
+    // только последняя позиция с тем же хешем, а позиции внутри найденных совпадений не добавляются в хеш.
+    void DeflateFixed(const uint8_t* data, size_t size, std::vector<uint8_t>& out, int maxChain) {
+        static const int hashBits = 15;
+        static const int windowSize = 32768;
+        static const int minMatch = 3;
+        static const int maxMatch = 258;
+
+        std::vector<int32_t> head(size_t(1) << hashBits, -1);
+        std::vector<int32_t> prev(windowSize, -1);
+
+        auto hash = [data](size_t pos) {
+            uint32_t v = uint32_t(data[pos]) | (uint32_t(data[pos + 1]) << 8) | (uint32_t(data[pos + 2]) << 16);
+            return (v * 2654435761u) >> (32 - hashBits);
+        };
+        auto insert = [&](size_t pos) {
+            uint32_t h = hash(pos);
+            prev[pos & (windowSize - 1)] = head[h];
+            head[h] = int32_t(pos);
+        };
+
+        const FixedCodes& codes = GetFixedCodes();
+        BitWriter writer(out);
+        writer.Put(1, 1);
+        writer.Put(1, 2);
+
+        size_t pos = 0;
+        while (pos < size) {
+            int bestLength = 0;
+            int bestDistance = 0;
+            if (pos + minMatch <= size) {
+                int32_t candidate = head[hash(pos)];
+                size_t limit = size - pos < maxMatch ? size - pos : maxMatch;
+                for (int chain = 0; candidate >= 0 && chain < maxChain; chain++) {
+                    size_t distance = pos - candidate;
+                    if (distance > windowSize - 1)
+                        break;
+                    const uint8_t* a = data + pos;
+                    const uint8_t* b = data + candidate;
+                    if (b[bestLength] == a[bestLength]) {
+                        size_t length = 0;
+                        while (length < limit && a[length] == b[length]) {
+                            length++;
+                        }
+                        if ((int)length > bestLength) {
+                            bestLength = (int)length;
+                            bestDistance = (int)distance;
+                            if (length == limit)
+                                break;
+                        }
+                    }
+                    int32_t next = prev[candidate & (windowSize - 1)];
+                    if (next >= candidate)
+                        break;
+                    candidate = next;
+                }
+            }
+
+            if (bestLength >= minMatch) {
+                PutMatch(writer, codes, bestLength, bestDistance);
+                size_t end = pos + bestLength;
+                if (maxChain == 1) {
+                    insert(pos);
+                    pos = end;
+                }
+                for (; pos < end; pos++) {
+                    if (pos + minMatch <= size)
+                        insert(pos);
+                }
+            }
+            else {
+                PutFixedSymbol(writer, codes, data[pos]);
+                if (pos + minMatch <= size)
+                    insert(pos);
+                pos++;
+            }
+        }
+
+        PutFixedSymbol(writer, codes, 256);
+        writer.Flush();
+    }
+
+    void ApplyFilter(uint8_t filter, const uint8_t* current, const uint8_t* previous, uint8_t* out, size_t stride) {
+        static const size_t bpp = 3;
+        switch (filter) {
+        case 1:
+            for (size_t i = 0; i < bpp; i++) {
+                out[i] = current[i];
+            }
+            for (size_t i = bpp; i < stride; i++) {
+                out[i] = uint8_t(current[i] - current[i - bpp]);
+            }
+            break;
+        case 2:
+            for (size_t i = 0; i < stride; i++) {
+                out[i] = uint8_t(current[i] - previous[i]);
+            }
+            break;
+        case 3:
+            for (size_t i = 0; i < bpp; i++) {
+                out[i] = uint8_t(current[i] - (previous[i] >> 1));
+            }
+            for (size_t i = bpp; i < stride; i++) {
+                out[i] = uint8_t(current[i] - ((current[i - bpp] + previous[i]) >> 1));
+            }
+            break;
+        case 4:
+            for (size_t i = 0; i < bpp; i++) {
+                out[i] = uint8_t(current[i] - previous[i]);
+            }
+            for (size_t i = bpp; i < stride; i++) {
+                int a = current[i - bpp], b = previous[i], c = previous[i - bpp];
+                int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+                int predictor = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+                out[i] = uint8_t(current[i] - predictor);
+            }
+            break;
+        }
+    }
+
+    uint64_t FilterCost(const uint8_t* data, size_t size) {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < size; i++) {
+            sum += data[i] < 128 ? data[i] : 256 - data[i];
+        }
+        return sum;
+    }
+
+    uint8_t ToByte(float value) {
+        if (!(value > 0.0f))
+            return 0;
+        if (value >= 1.0f)
+            return 255;
+        return uint8_t(value * 255.0f + 0.5f);
+    }
+
+    void LoadRGBA(const uint8_t* row, unsigned x, PixelFormat format, float rgba[4]) {
+        switch (format) {
+        case PixelFormat::RGBA8:
+            for (int c = 0; c < 4; c++) {
+                rgba[c] = row[x * 4 + c] / 255.0f;
+            }
+            break;
+        case PixelFormat::RGBA16F: {
+            const uint16_t* halfs = reinterpret_cast<const uint16_t*>(row) + x * 4;
+            for (int c = 0; c < 4; c++) {
+                rgba[c] = encoder::HalfToFloat(halfs[c]);
+            }
+            break;
+        }
+        case PixelFormat::RGBA32F:
+            memcpy(rgba, row + x * 16, 16);
+            break;
+        }
+    }
+
+    void ToRGBE(const float rgba[4], uint8_t rgbe[4]) {
+        float maxComponent = rgba[0] > rgba[1] ? rgba[0] : rgba[1];
+        maxComponent = maxComponent > rgba[2] ? maxComponent : rgba[2];
+        if (!(maxComponent > 1e-32f)) {
+            rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+            return;
+        }
+        int exponent;
+        float scale = frexpf(maxComponent, &exponent) * 256.0f / maxComponent;
+        for (int c = 0; c < 3; c++) {
+            float v = rgba[c] * scale;
+            rgbe[c] = uint8_t(v > 0.0f ? v : 0.0f);
+        }
+        rgbe[3] = uint8_t(exponent + 128);
+    }
+
+    // RLE одного канала строки в новом формате Radiance.
+    void PutRLEChannel(std::vector<uint8_t>& out, const uint8_t* data, unsigned width) {
+        unsigned x = 0;
+        while (x < width) {
+            unsigned runStart = x;
+            unsigned runLength = 0;
+            while (runStart < width) {
+                runLength = 1;
+                while (runStart + runLength < width && runLength < 127 && data[runStart + runLength] == data[runStart]) {
+                    runLength++;
+                }
+                if (runLength >= 4)
+                    break;
+                runStart += runLength;
+            }
+
+            while (x < runStart) {
+                unsigned count = runStart - x < 128 ? runStart - x : 128;
+                out.push_back(uint8_t(count));
+                out.insert(out.end(), data + x, data + x + count);
+                x += count;
+            }
+
+            if (runStart < width) {
+                out.push_back(uint8_t(128 + runLength));
+                out.push_back(data[runStart]);
+                x = runStart + runLength;
+            }
+        }
+    }
+};
+
+
+float encoder::HalfToFloat(uint16_t half) {
+    uint32_t sign = uint32_t(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        }
+        else {
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400) == 0) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            mantissa &= 0x3FF;
+            bits = sign | (exponent << 23) | (mantissa << 13);
+        }
+    }
+    else if (exponent == 31) {
+        bits = sign | 0x7F800000u | (mantissa << 13);
+    }
+    else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+
+bool encoder::EncodePNG(const void* pixels, unsigned width, unsigned height, size_t rowPitch, PixelFormat format,
+                        std::vector<uint8_t>& out, int level) {
+    if (pixels == nullptr || width == 0 || height == 0)
+        return false;
+
+    const size_t stride = size_t(width) * 3;
+    std::vector<uint8_t> raw((stride + 1) * height);
+    std::vector<uint8_t> current(stride), previous(stride, 0), filtered(stride);
+
+    const uint8_t* src = static_cast<const uint8_t*>(pixels);
+    for (unsigned y = 0; y < height; y++) {
+        const uint8_t* row = src + y * rowPitch;
+        if (format == PixelFormat::RGBA8) {
+            for (unsigned x = 0; x < width; x++) {
+                current[x * 3 + 0] = row[x * 4 + 0];
+                current[x * 3 + 1] = row[x * 4 + 1];
+                current[x * 3 + 2] = row[x * 4 + 2];
+            }
+        }
+        else {
+            float rgba[4];
+            for (unsigned x = 0; x < width; x++) {
+                LoadRGBA(row, x, format, rgba);
+                current[x * 3 + 0] = ToByte(rgba[0]);
+                current[x * 3 + 1] = ToByte(rgba[1]);
+                current[x * 3 + 2] = ToByte(rgba[2]);
+            }
+        }
+
+        uint8_t* dst = &raw[y * (stride + 1)];
+        if (level <= 0) {
+            dst[0] = 0;
+            memcpy(dst + 1, current.data(), stride);
+        }
+        else if (level == 1) {
+            // Без перебора: фильтр Up почти всегда выигрывает на отрендеренных кадрах.
+            dst[0] = 2;
+            ApplyFilter(2, current.data(), previous.data(), dst + 1, stride);
+        }
+        else {
+            // Выбор фильтра строки по минимальной сумме модулей (эвристика из спецификации PNG).
+            dst[0] = 0;
+            memcpy(dst + 1, current.data(), stride);
+            uint64_t bestSum = FilterCost(current.data(), stride);
+            for (uint8_t filter = 1; filter < 5; filter++) {
+                ApplyFilter(filter, current.data(), previous.data(), filtered.data(), stride);
+                uint64_t sum = FilterCost(filtered.data(), stride);
+                if (sum < bestSum) {
+                    bestSum = sum;
+                    dst[0] = filter;
+                    memcpy(dst + 1, filtered.data(), stride);
+                }
+            }
+        }
+        current.swap(previous);
+    }
+
+    std::vector<uint8_t> zlib;
+    zlib.reserve(level <= 0 ? raw.size() + raw.size() / 65535 * 5 + 16 : raw.size() / 2);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    if (level <= 0)
+        DeflateStored(raw.data(), raw.size(), zlib);
+    else
+        DeflateFixed(raw.data(), raw.size(), zlib, level == 1 ? 1 : level * 4);
+    PutU32BE(zlib, Adler32(raw.data(), raw.size()));
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    out.clear();
+    out.reserve(zlib.size() + 64);
+    out.insert(out.end(), signature, signature + 8);
+
+    uint8_t header[13];
+    header[0] = uint8_t(width >> 24);
+    header[1] = uint8_t(width >> 16);
+    header[2] = uint8_t(width >> 8);
+    header[3] = uint8_t(width);
+    header[4] = uint8_t(height >> 24);
+    header[5] = uint8_t(height >> 16);
+    header[6] = uint8_t(height >> 8);
+    header[7] = uint8_t(height);
+    header[8] = 8;  // бит на канал
+    header[9] = 2;  // RGB
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    PutChunk(out, "IHDR", header, sizeof(header));
+    PutChunk(out, "IDAT", zlib.data(), zlib.size());
+    PutChunk(out, "IEND", nullptr, 0);
+
+    return true;
+}
+
+
+bool encoder::EncodeHDR(const void* pixels, unsigned width, unsigned height, size_t rowPitch, PixelFormat format,
+                        std::vector<uint8_t>& out) {
+    if (pixels == nullptr || width == 0 || height == 0)
+        return false;
+
+    char header[128];
+    int headerSize = snprintf(header, sizeof(header), "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %u +X %u\n", height, width);
+    out.clear();
+    out.reserve(size_t(width) * height * 4 / 2 + headerSize);
+    out.insert(out.end(), header, header + headerSize);
+
+    std::vector<uint8_t> planes(size_t(width) * 4);
+    const uint8_t* src = static_cast<const uint8_t*>(pixels);
+    for (unsigned y = 0; y < height; y++) {
+        const uint8_t* row = src + y * rowPitch;
+        float rgba[4];
+        uint8_t rgbe[4];
+        for (unsigned x = 0; x < width; x++) {
+            LoadRGBA(row, x, format, rgba);
+            ToRGBE(rgba, rgbe);
+            for (int c = 0; c < 4; c++) {
+                planes[c * width + x] = rgbe[c];
+            }
+        }
+
+        // RLE допускается только для строк шириной 8..32767, иначе строка пишется без сжатия.
+        if (width < 8 || width > 32767) {
+            for (unsigned x = 0; x < width; x++) {
+                for (int c = 0; c < 4; c++) {
+                    out.push_back(planes[c * width + x]);
+                }
+            }
+            continue;
+        }
+
+        out.push_back(2);
+        out.push_back(2);
+        out.push_back(uint8_t(width >> 8));
+        out.push_back(uint8_t(width));
+        for (int c = 0; c < 4; c++) {
+            PutRLEChannel(out, &planes[c * width], width);
+        }
+    }
+
+    return true;
+}
+
+
+bool encoder::WriteFile(const std::string& path, const std::vector<uint8_t>& data) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    return bool(file);
+}
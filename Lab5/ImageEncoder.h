@@ -0,0 +1,43 @@
+﻿#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+
+enum class PixelFormat {
+    RGBA8,
+    RGBA16F,
+    RGBA32F
+};
+
+
+// Кодировщики PNG (LDR) и Radiance .hdr (HDR) без внешних зависимостей.
+namespace encoder {
+    inline size_t BytesPerPixel(PixelFormat format) {
+        switch (format) {
+        case PixelFormat::RGBA8:
+            return 4;
+        case PixelFormat::RGBA16F:
+            return 8;
+        case PixelFormat::RGBA32F:
+            return 16;
+        }
+        return 0;
+    }
+
+    float HalfToFloat(uint16_t half);
+
+    // level = 0 - несжатые deflate блоки без фильтрации строк (самый быстрый вариант),
+    // level = 1 - фильтр Up и LZ77 с одной пробой хеша и фиксированными кодами Хаффмана,
+    // level > 1 - выбор фильтра для каждой строки и цепочки поиска длиной level * 4.
+    bool EncodePNG(const void* pixels, unsigned width, unsigned height, size_t rowPitch, PixelFormat format,
+                   std::vector<uint8_t>& out, int level = 0);
+
+    // Значения HDR форматов записываются как есть, RGBA8 переводится в [0, 1].
+    bool EncodeHDR(const void* pixels, unsigned width, unsigned height, size_t rowPitch, PixelFormat format,
+                   std::vector<uint8_t>& out);
+
+    bool WriteFile(const std::string& path, const std::vector<uint8_t>& data);
+};
@@ -107,6 +107,13 @@ XMINT3 Input::ReadKeyboard() {
     return keys;
 }
 
+bool Input::ReadPick() {
+    bool pressed = mouseState_.rgbButtons[0] || keyboardState_[DIK_P];
+    bool request = pressed && !pickPressed_;
+    pickPressed_ = pressed;
+    return request;
+}
+
 Input::~Input() {
     Release();
 }
\ No newline at end of file
@@ -10,6 +10,7 @@ public:
     void Release();
     XMFLOAT3 ReadMouse();
     XMINT3 ReadKeyboard();
+    bool ReadPick();
 
     ~Input();
 private:
@@ -18,5 +19,6 @@ private:
     IDirectInputDevice8* keyboard_;
 
     DIMOUSESTATE mouseState_ = {};
-    unsigned char keyboardState_[256];
+    unsigned char keyboardState_[256] = {};
+    bool pickPressed_ = false;
 };
\ No newline at end of file
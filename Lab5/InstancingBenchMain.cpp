@@ -0,0 +1,381 @@
+﻿// Замер группировки объектов по геометрии (ObjectInstancing.h) и записи кадра экземплярами через gfx::NullBackend,
+// в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 NullBackend.cpp ScenePass.cpp ObjectInstancing.cpp InstancingBenchMain.cpp -o instancingbench
+// Объекты делят meshes геометрий в случайном порядке (--sorted - подряд, как модели из одного glTF). Кадр по
+// объектам - UpdateBuffer константного буфера и DrawIndexed на каждый, как ScenePass без экземпляров; кадр
+// экземплярами - подсчет видимых объектов групп, построенных один раз (AddObject), упаковка, Map буфера экземпляров
+// и DrawIndexedInstanced на группу, объекты групп из одного объекта - по одному. Примеры:
+//   ./instancingbench
+//   ./instancingbench --instances 1000 --meshes 1000 --sorted
+#include "NullBackend.h"
+#include "ScenePass.h"
+#include "ObjectInstancing.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace {
+    // Раскладки константных буферов Renderer.h.
+    struct ObjectConstants {
+        float worldMatrix[16];
+        float color[3];
+        float roughness;
+        float metalness;
+        float padding[3];
+    };
+
+    struct ViewConstants {
+        float viewProjectionMatrix[16];
+        float cameraPos[4];
+        int32_t lightParams[4];
+        float clusterParams[4];
+    };
+
+    static_assert(sizeof(ObjectConstants) == 96, "WorldMatrixBuffer layout");
+    static_assert(sizeof(ViewConstants) == 112, "ViewMatrixBuffer layout");
+
+    struct Options {
+        size_t instanceCount = 100000;
+        size_t meshCount = 64;
+        unsigned frames = 20;
+        bool sorted = false;
+    };
+
+    struct Scene {
+        gfx::SceneFrame frame;
+        gfx::RenderTargetViewHandle backBuffer;
+        std::vector<gfx::MeshBinding> meshes;           // без экземпляров
+        std::vector<gfx::MeshBinding> instancedMeshes;  // те же буферы, шейдер и раскладка со слотом 1
+        std::vector<mesh::IndexRange> ranges;           // у каждого объекта свой диапазон, как в Renderer
+        std::vector<uint32_t> meshOf;
+        std::vector<ObjectConstants> constants;
+        std::vector<gfx::PassObject> objects;
+        ViewConstants view = {};
+        uint8_t skyboxConstants[80] = {};
+    };
+
+    void Usage() {
+        printf("instancingbench [options]\n"
+            "  --instances <n>   object count (100000)\n"
+            "  --meshes <n>      distinct meshes shared by the objects (64)\n"
+            "  --frames <n>      minimum frames per measurement (20)\n"
+            "  --sorted          objects of one mesh go in a row\n");
+    }
+
+    // Ресурсы как у Renderer::InitBackend: константные буферы, самплеры, текстуры освещения и meshCount геометрий
+    // моделей по 1000 треугольников.
+    bool CreateScene(gfx::NullBackend& backend, const Options& options, Scene& scene) {
+        static const uint8_t bytecode[16] = {};
+        gfx::BufferDesc desc;
+        desc.bindFlags = gfx::BindConstantBuffer;
+        desc.size = sizeof(ObjectConstants);
+        scene.frame.objectBuffer = backend.CreateBuffer(desc);
+        desc.size = sizeof(scene.skyboxConstants);
+        scene.frame.skyboxBuffer = backend.CreateBuffer(desc);
+        desc.size = 32;
+        scene.frame.quantizationBuffer = backend.CreateBuffer(desc);
+        desc.size = sizeof(ViewConstants);
+        desc.usage = gfx::Usage::Dynamic;
+        scene.frame.viewBuffer = backend.CreateBuffer(desc);
+        // Емкость - степень двойки, как после роста в Renderer::ReserveInstanceBuffer.
+        desc.size = 64 * sizeof(gfx::InstanceData);
+        while (desc.size < options.instanceCount * sizeof(gfx::InstanceData)) {
+            desc.size *= 2;
+        }
+        desc.bindFlags = gfx::BindVertexBuffer;
+        scene.frame.instanceBuffer = backend.CreateBuffer(desc);
+        scene.frame.objectConstantsSize = sizeof(ObjectConstants);
+        scene.frame.skyboxConstantsSize = sizeof(scene.skyboxConstants);
+        scene.frame.viewConstantsSize = sizeof(ViewConstants);
+        scene.frame.viewConstants = &scene.view;
+        scene.frame.skyboxConstants = scene.skyboxConstants;
+
+        gfx::SamplerDesc sampler;
+        scene.frame.sampler = backend.CreateSampler(sampler);
+        scene.frame.environmentSampler = backend.CreateSampler(sampler);
+        gfx::TextureDesc texture;
+        texture.width = 1280;
+        texture.height = 720;
+        texture.format = gfx::Format::R8G8B8A8_UNORM_SRGB;
+        texture.bindFlags = gfx::BindRenderTarget;
+        scene.backBuffer = backend.CreateRenderTargetView(backend.CreateTexture(texture));
+        texture.width = texture.height = 128;
+        texture.format = gfx::Format::R32G32B32A32_FLOAT;
+        texture.bindFlags = gfx::BindShaderResource;
+        for (int i = 0; i < 3; i++) {
+            scene.frame.objectTextures[i] = backend.CreateShaderResourceView(backend.CreateTexture(texture));
+        }
+        scene.frame.objectShader = backend.CreatePixelShader(bytecode, sizeof(bytecode));
+
+        gfx::InputElement vertex[] = { { "POSITION", 0, gfx::Format::R32G32B32_FLOAT, 0, 0, false },
+                                       { "NORMAL", 0, gfx::Format::R32G32B32_FLOAT, 0, 12, false } };
+        gfx::InputElement instanced[] = { vertex[0], vertex[1],
+                                          { "WORLD", 0, gfx::Format::R32G32B32A32_FLOAT, 1, 0, true },
+                                          { "WORLD", 1, gfx::Format::R32G32B32A32_FLOAT, 1, 16, true },
+                                          { "WORLD", 2, gfx::Format::R32G32B32A32_FLOAT, 1, 32, true },
+                                          { "COLOR", 0, gfx::Format::R32G32B32A32_FLOAT, 1, 48, true },
+                                          { "MATERIAL", 0, gfx::Format::R32_FLOAT, 1, 64, true } };
+        gfx::RasterizerDesc rasterizer;
+        rasterizer.frontCounterClockwise = true;
+        gfx::RasterizerStateHandle modelState = backend.CreateRasterizerState(rasterizer);
+        gfx::VertexShaderHandle modelShader = backend.CreateVertexShader(bytecode, sizeof(bytecode));
+        gfx::InputLayoutHandle modelLayout = backend.CreateInputLayout(vertex, 2, bytecode, sizeof(bytecode));
+        gfx::VertexShaderHandle instancedShader = backend.CreateVertexShader(bytecode, sizeof(bytecode));
+        gfx::InputLayoutHandle instancedLayout = backend.CreateInputLayout(instanced, 7, bytecode, sizeof(bytecode));
+        const uint32_t modelIndices = 3000, modelVertices = 600;
+        std::vector<uint8_t> data(std::max(modelVertices * 24, modelIndices * 4));
+        desc.usage = gfx::Usage::Immutable;
+        for (size_t m = 0; m < options.meshCount; m++) {
+            gfx::MeshBinding model;
+            desc.bindFlags = gfx::BindVertexBuffer;
+            desc.size = modelVertices * 24;
+            model.vertexBuffer = backend.CreateBuffer(desc, data.data());
+            desc.bindFlags = gfx::BindIndexBuffer;
+            desc.size = modelIndices * 4;
+            model.indexBuffer = backend.CreateBuffer(desc, data.data());
+            model.stride = 24;
+            model.inputLayout = modelLayout;
+            model.vertexShader = modelShader;
+            model.rasterizerState = modelState;
+            scene.meshes.push_back(model);
+            model.inputLayout = instancedLayout;
+            model.vertexShader = instancedShader;
+            scene.instancedMeshes.push_back(model);
+        }
+
+        std::mt19937 random(7);
+        scene.meshOf.resize(options.instanceCount);
+        for (size_t i = 0; i < options.instanceCount; i++) {
+            scene.meshOf[i] = options.sorted ? (uint32_t)(i * options.meshCount / options.instanceCount)
+                                             : (uint32_t)(random() % options.meshCount);
+        }
+        scene.ranges.assign(options.instanceCount, { 0, modelIndices });
+        scene.constants.resize(options.instanceCount);
+        scene.objects.resize(options.instanceCount);
+        return backend.GetStats().errors == 0;
+    }
+
+    // Группы строятся при загрузке сцены, как в Renderer::InitBackend.
+    double AddObjects(gfx::InstanceBatcher& batcher, const Scene& scene) {
+        auto start = std::chrono::steady_clock::now();
+        batcher.Clear();
+        for (size_t i = 0; i < scene.meshOf.size(); i++) {
+            batcher.AddObject(scene.instancedMeshes[scene.meshOf[i]], &scene.ranges[i], 1, 0);
+        }
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Мировая матрица и материал объекта i в кадре frame: сетка 100 x n со сдвигом по x.
+    void FillConstants(size_t i, unsigned frame, ObjectConstants& constants) {
+        memset(&constants, 0, sizeof(constants));
+        constants.worldMatrix[0] = constants.worldMatrix[5] = constants.worldMatrix[10] = constants.worldMatrix[15] = 1.0f;
+        constants.worldMatrix[12] = (float)(i % 100) * 3.0f + frame * 0.016f;
+        constants.worldMatrix[14] = (float)(i / 100) * 3.0f;
+        constants.color[0] = 1.0f;
+        constants.color[1] = 0.71f;
+        constants.color[2] = (float)(i & 255) / 255.0f;
+        constants.roughness = 0.5f;
+        constants.metalness = 1.0f;
+    }
+
+    void BeginFrame(gfx::RenderBackend& backend, gfx::ScenePass& pass, Scene& scene) {
+        scene.frame.width = 1280;
+        scene.frame.height = 720;
+        scene.frame.target = scene.backBuffer;
+        pass.Begin(backend, scene.frame);
+    }
+
+    // Как ScenePass до экземпляров: константы и отрисовка каждого объекта.
+    void RecordObjects(gfx::NullBackend& backend, gfx::ScenePass& pass, Scene& scene, unsigned frame) {
+        scene.frame.instanceCount = scene.frame.batchCount = 0;
+        gfx::ScenePass::Upload(backend, scene.frame);
+        BeginFrame(backend, pass, scene);
+        for (size_t i = 0; i < scene.objects.size(); i++) {
+            FillConstants(i, frame, scene.constants[i]);
+            gfx::PassObject& object = scene.objects[i];
+            object.mesh = scene.meshes[scene.meshOf[i]];
+            object.ranges = &scene.ranges[i];
+            object.rangeCount = 1;
+            object.constants = &scene.constants[i];
+        }
+        scene.frame.objects = scene.objects.data();
+        scene.frame.objectCount = scene.objects.size();
+        pass.DrawObjects(backend, scene.frame);
+    }
+
+    // Как Renderer::UpdateInstances и RenderObjects: видны все объекты, не попавшие в группы рисуются по одному.
+    void GroupInstances(gfx::InstanceBatcher& batcher, Scene& scene, unsigned frame) {
+        batcher.Begin();
+        for (size_t i = 0; i < scene.meshOf.size() && batcher.CanBatch(); i++) {
+            batcher.MarkVisible((uint32_t)i);
+        }
+        batcher.Build();
+        size_t singles = 0;
+        for (size_t i = 0; i < scene.meshOf.size(); i++) {
+            ObjectConstants& constants = scene.constants[i];
+            FillConstants(i, frame, constants);
+            if (batcher.IsInstanced((uint32_t)i)) {
+                batcher.SetInstance((uint32_t)i, constants.worldMatrix, constants.color, constants.roughness, constants.metalness);
+                continue;
+            }
+            gfx::PassObject& object = scene.objects[singles++];
+            object.mesh = scene.meshes[scene.meshOf[i]];
+            object.ranges = &scene.ranges[i];
+            object.rangeCount = 1;
+            object.constants = &constants;
+        }
+        scene.frame.objects = scene.objects.data();
+        scene.frame.objectCount = singles;
+    }
+
+    void RecordInstances(gfx::NullBackend& backend, gfx::ScenePass& pass, gfx::InstanceBatcher& batcher, Scene& scene,
+                         unsigned frame) {
+        GroupInstances(batcher, scene, frame);
+        scene.frame.instances = batcher.GetInstances();
+        scene.frame.instanceCount = batcher.GetInstanceCount();
+        scene.frame.batches = batcher.GetBatches();
+        scene.frame.batchCount = batcher.GetBatchCount();
+        gfx::ScenePass::Upload(backend, scene.frame);
+        BeginFrame(backend, pass, scene);
+        pass.DrawObjects(backend, scene.frame);
+    }
+
+    template<typename Record>
+    double Measure(unsigned minFrames, Record record) {
+        unsigned frames = 0;
+        auto start = std::chrono::steady_clock::now();
+        double seconds = 0.0;
+        while (frames < minFrames || seconds < 0.2) {
+            record(++frames);
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        return seconds / frames * 1e6;
+    }
+
+    // Каждая группа - одна геометрия не меньше чем из minInstances объектов, все объекты групп в ней ровно один раз
+    // и в исходном порядке, остальные объекты рисуются по одному; данные экземпляров совпадают с константами и
+    // загружены в буфер целиком.
+    bool CheckInstances(const gfx::NullBackend& backend, const gfx::InstanceBatcher& batcher, const Scene& scene) {
+        std::vector<uint32_t> objectsOfMesh(scene.meshes.size());
+        for (uint32_t mesh : scene.meshOf) {
+            objectsOfMesh[mesh]++;
+        }
+        std::vector<uint32_t> batchOfMesh(scene.meshes.size(), UINT32_MAX);
+        size_t total = 0;
+        for (size_t b = 0; b < batcher.GetBatchCount(); b++) {
+            const gfx::InstanceBatch& batch = batcher.GetBatches()[b];
+            if (batch.firstInstance != total || batch.instanceCount < gfx::InstanceBatcher::minInstances)
+                return false;
+            total += batch.instanceCount;
+            size_t mesh = 0;
+            while (mesh < scene.meshes.size() && scene.instancedMeshes[mesh].vertexBuffer != batch.mesh.vertexBuffer) {
+                mesh++;
+            }
+            if (mesh == scene.meshes.size() || batchOfMesh[mesh] != UINT32_MAX || objectsOfMesh[mesh] != batch.instanceCount)
+                return false;
+            batchOfMesh[mesh] = (uint32_t)b;
+        }
+        if (batcher.GetInstanceCount() != total || scene.frame.objectCount + total != scene.meshOf.size())
+            return false;
+
+        std::vector<uint32_t> next(batcher.GetBatchCount());
+        for (size_t b = 0; b < next.size(); b++) {
+            next[b] = batcher.GetBatches()[b].firstInstance;
+        }
+        for (size_t i = 0; i < scene.meshOf.size(); i++) {
+            bool single = objectsOfMesh[scene.meshOf[i]] < gfx::InstanceBatcher::minInstances;
+            if (single != !batcher.IsInstanced((uint32_t)i))
+                return false;
+            if (single)
+                continue;
+            const gfx::InstanceData& instance = batcher.GetInstances()[next[batchOfMesh[scene.meshOf[i]]]++];
+            const ObjectConstants& constants = scene.constants[i];
+            for (int j = 0; j < 3; j++) {
+                for (int k = 0; k < 4; k++) {
+                    if (instance.world[j][k] != constants.worldMatrix[k * 4 + j])
+                        return false;
+                }
+            }
+            if (memcmp(instance.color, constants.color, sizeof(instance.color)) != 0 ||
+                instance.roughness != constants.roughness || instance.metalness != constants.metalness)
+                return false;
+        }
+        const uint8_t* uploaded = backend.GetBufferData(scene.frame.instanceBuffer);
+        return total == 0 || (uploaded != nullptr && memcmp(uploaded, batcher.GetInstances(), total * sizeof(gfx::InstanceData)) == 0);
+    }
+
+    void PrintErrors(const gfx::NullBackend& backend) {
+        for (const std::string& message : backend.GetErrors()) {
+            printf("  %s\n", message.c_str());
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--instances") && i + 1 < argc) {
+            options.instanceCount = (size_t)atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--meshes") && i + 1 < argc) {
+            options.meshCount = (size_t)atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            options.frames = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--sorted")) {
+            options.sorted = true;
+        } else {
+            Usage();
+            return 1;
+        }
+    }
+    if (options.instanceCount == 0 || options.meshCount == 0) {
+        Usage();
+        return 1;
+    }
+
+    gfx::NullBackend backend;
+    gfx::ScenePass pass;
+    gfx::InstanceBatcher batcher;
+    Scene scene;
+    if (!CreateScene(backend, options, scene)) {
+        printf("scene creation failed: %s\n", backend.GetErrors().empty() ? "" : backend.GetErrors()[0].c_str());
+        return 1;
+    }
+    size_t count = options.instanceCount;
+    printf("%zu instances, %zu meshes, %s order\n", count, options.meshCount, options.sorted ? "sorted" : "random");
+
+    backend.ResetStats();
+    RecordObjects(backend, pass, scene, 0);
+    gfx::NullBackend::Stats objectStats = backend.GetStats();
+    double objects = Measure(options.frames, [&](unsigned frame) { RecordObjects(backend, pass, scene, frame); });
+    printf("  per object: %9.2f us/frame (%6.1f ns/object), %llu calls, %llu draws, %.1f MB uploaded\n", objects,
+        objects * 1e3 / count, (unsigned long long)objectStats.TotalCalls(), (unsigned long long)objectStats.draws,
+        objectStats.uploadedBytes / 1048576.0);
+
+    double loading = AddObjects(batcher, scene);
+    double grouping = Measure(options.frames, [&](unsigned frame) { GroupInstances(batcher, scene, frame); });
+    printf("  grouping:   %9.2f us/frame (%6.1f ns/object), %zu batches, %zu single objects; groups built once in %.2f us\n",
+        grouping, grouping * 1e3 / count, batcher.GetBatchCount(), (size_t)scene.frame.objectCount, loading);
+
+    backend.ResetStats();
+    RecordInstances(backend, pass, batcher, scene, 0);
+    gfx::NullBackend::Stats instanceStats = backend.GetStats();
+    size_t instances = batcher.GetInstanceCount();
+    // NullBackend считает DrawIndexed одним экземпляром.
+    bool valid = CheckInstances(backend, batcher, scene) && instanceStats.instances == instances + scene.frame.objectCount &&
+        instanceStats.draws == batcher.GetBatchCount() + scene.frame.objectCount && pass.GetStats().instances == instances;
+    double instanced = Measure(options.frames, [&](unsigned frame) { RecordInstances(backend, pass, batcher, scene, frame); });
+    // Не медленнее кадра по объектам с учетом шума замера.
+    bool faster = instanced <= objects * 1.1;
+    printf("  instanced:  %9.2f us/frame (%6.1f ns/object), %llu calls, %llu draws, %.1f MB uploaded; %.1fx, %s, %s\n",
+        instanced, instanced * 1e3 / count, (unsigned long long)instanceStats.TotalCalls(),
+        (unsigned long long)instanceStats.draws, instanceStats.uploadedBytes / 1048576.0, objects / instanced,
+        valid ? "batches match" : "MISMATCH", faster ? "ok" : "SLOWER");
+
+    printf("  %llu errors\n", (unsigned long long)backend.GetStats().errors);
+    PrintErrors(backend);
+    return valid && faster && backend.GetStats().errors == 0 ? 0 : 1;
+}
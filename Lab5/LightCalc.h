@@ -6,6 +6,21 @@ TextureCube prefilteredTexture : register (t1);
 SamplerState prefilteredSampler : register (s1);
 Texture2D brdfTexture : register (t2);
 
+// Источники по кластерам (lighting::LightClusterer): по две записи на источник - позиция и радиус действия, цвет и
+// яркость; индексы источников, сгруппированные по кластерам; начало и длина списка каждого кластера.
+Buffer<float4> lightData : register (t3);
+Buffer<uint> lightIndices : register (t4);
+Buffer<uint2> lightClusters : register (t5);
+
+uint2 FindLightCluster(in float3 pos)
+{
+    float4 clip = mul(viewProjectionMatrix, float4(pos, 1.0f));
+    float2 ndc = clip.xy / clip.w;
+    uint2 tile = min(uint2(saturate(ndc * 0.5f + 0.5f) * lightParams.yz), uint2(lightParams.yz - 1));
+    uint slice = (uint)clamp(floor(log(clip.w) * clusterParams.x + clusterParams.y), 0.0f, lightParams.w - 1.0f);
+    return lightClusters[(slice * lightParams.z + tile.y) * lightParams.y + tile.x];
+}
+
 float3 fresnelFunction(in float3 objColor, in float3 h, in float3 v, in float metalness)
 {
     float3 f = float3(0.04f, 0.04f, 0.04f) * (1 - metalness) + objColor * metalness;
@@ -62,13 +77,19 @@ float3 CalculateColor(in float3 objColor, in float3 objNormal, in float3 pos, in
     finalColor += ambient;
 #endif
 
-    [unroll] for (int i = 0; i < lightParams.x; i++)
+    uint2 cluster = FindLightCluster(pos);
+    [loop] for (uint k = 0; k < cluster.y; k++)
     {
-        float3 lightDir = lights[i].lightPos.xyz - pos;
+        uint i = lightIndices[cluster.x + k];
+        float4 lightPos = lightData[i * 2];
+        float4 lightColor = lightData[i * 2 + 1];
+        float3 lightDir = lightPos.xyz - pos;
         float lightDist = length(lightDir);
+        if (lightDist > lightPos.w)
+            continue;
         lightDir /= lightDist;
         float atten = clamp(1.0 / (lightDist * lightDist), 0, 1.0f);
-        float3 radiance = lights[i].lightColor.xyz * lights[i].lightColor.w * atten;
+        float3 radiance = lightColor.xyz * lightColor.w * atten;
 
 #if defined(DEFAULT) || defined(FRESNEL)
         float3 F = fresnelFunction(objColor, normalize((viewDir + lightDir) / 2.0f), viewDir, metalness);
@@ -0,0 +1,327 @@
+﻿#include "LightClusters.h"
+#include "ShaderMath.h"
+#include "ThreadPool.h"
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+namespace lighting {
+    namespace {
+        using namespace hlsl;
+
+        // Источники переводятся в пространство вида блоками, каждый блок - в свой вектор.
+        const size_t transformChunk = 1024;
+
+        void For(ThreadPool* pool, size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+            if (pool) {
+                pool->ParallelFor(count, grain, body);
+            } else {
+                body(0, count);
+            }
+        }
+
+        // Пирамида видимости в пространстве вида: боковые плоскости x = +-tanX * z, y = +-tanY * z.
+        struct ViewFrustum {
+            float m[16];
+            float tanX, tanY;
+            float normX, normY;     // длины нормалей боковых плоскостей, sqrt(1 + tan^2)
+            float nearZ, farZ;
+        };
+
+        // Центры дорожек lane .. lane + count - 1 в пространстве вида и маска сфер, задевающих пирамиду.
+        template<typename T>
+        auto TransformSpheres(const ViewFrustum& f, const LightSpheres& lights, size_t lane, T& vx, T& vy, T& vz, T& r)
+            -> decltype(T() < T()) {
+            T x = LaneTraits<T>::Load(lights.x + lane), y = LaneTraits<T>::Load(lights.y + lane), z = LaneTraits<T>::Load(lights.z + lane);
+            r = LaneTraits<T>::Load(lights.radius + lane);
+            vx = x * T(f.m[0]) + y * T(f.m[4]) + z * T(f.m[8]) + T(f.m[12]);
+            vy = x * T(f.m[1]) + y * T(f.m[5]) + z * T(f.m[9]) + T(f.m[13]);
+            vz = x * T(f.m[2]) + y * T(f.m[6]) + z * T(f.m[10]) + T(f.m[14]);
+            T sideX = T(f.tanX) * vz, sideY = T(f.tanY) * vz;
+            T rx = r * T(f.normX), ry = r * T(f.normY);
+            return (r > T(0.0f)) & (vz + r >= T(f.nearZ)) & (vz - r <= T(f.farZ)) & (vx - sideX <= rx) & (-vx - sideX <= rx) &
+                (vy - sideY <= ry) & (-vy - sideY <= ry);
+        }
+
+        // Номер ячейки по нормированной координате [-1, 1] с ограничением сетки.
+        uint16_t TileOf(float ndc, unsigned count) {
+            float t = std::floor((ndc * 0.5f + 0.5f) * count);
+            return (uint16_t)std::min(std::max(t, 0.0f), (float)(count - 1));
+        }
+    }
+
+    float InfluenceRadius(float intensity, float cutoff) {
+        return intensity > 0.0f && cutoff > 0.0f ? std::sqrt(std::max(intensity / cutoff, 1.0f)) : 0.0f;
+    }
+
+    void LightClusterer::SetupGrid(const ClusterGrid& grid, const ClusterCamera& camera) {
+        if (grid.tilesX == grid_.tilesX && grid.tilesY == grid_.tilesY && grid.slices == grid_.slices && camera.fovY == fovY_ &&
+            camera.aspect == aspect_ && camera.nearZ == nearZ_ && camera.farZ == farZ_ && !sliceNear_.empty())
+            return;
+        grid_ = grid;
+        fovY_ = camera.fovY;
+        aspect_ = camera.aspect;
+        nearZ_ = camera.nearZ;
+        farZ_ = camera.farZ;
+        tanY_ = std::tan(camera.fovY * 0.5f);
+        tanX_ = tanY_ * camera.aspect;
+        sliceScale_ = grid.slices / std::log(camera.farZ / camera.nearZ);
+        sliceBias_ = -std::log(camera.nearZ) * sliceScale_;
+        rowStride_ = (grid.tilesX + 7) & ~7u;
+
+        sliceNear_.resize(grid.slices);
+        sliceFar_.resize(grid.slices);
+        for (unsigned s = 0; s < grid.slices; s++) {
+            sliceNear_[s] = camera.nearZ * std::pow(camera.farZ / camera.nearZ, (float)s / grid.slices);
+            sliceFar_[s] = camera.nearZ * std::pow(camera.farZ / camera.nearZ, (float)(s + 1) / grid.slices);
+        }
+        sliceFar_[grid.slices - 1] = camera.farZ;
+
+        // Края ячейки по x на глубине z - sx0 * z и sx1 * z; параллелепипед берет крайние из них на двух глубинах.
+        // Лишние дорожки строки пустые и не проходят проверку.
+        boxMinX_.assign((size_t)grid.slices * rowStride_, 1e30f);
+        boxMaxX_.assign((size_t)grid.slices * rowStride_, -1e30f);
+        boxMinY_.resize((size_t)grid.slices * grid.tilesY);
+        boxMaxY_.resize((size_t)grid.slices * grid.tilesY);
+        for (unsigned s = 0; s < grid.slices; s++) {
+            float zn = sliceNear_[s], zf = sliceFar_[s];
+            for (unsigned x = 0; x < grid.tilesX; x++) {
+                float s0 = (-1.0f + 2.0f * x / grid.tilesX) * tanX_, s1 = (-1.0f + 2.0f * (x + 1) / grid.tilesX) * tanX_;
+                boxMinX_[s * rowStride_ + x] = s0 * (s0 < 0.0f ? zf : zn);
+                boxMaxX_[s * rowStride_ + x] = s1 * (s1 > 0.0f ? zf : zn);
+            }
+            for (unsigned y = 0; y < grid.tilesY; y++) {
+                float s0 = (-1.0f + 2.0f * y / grid.tilesY) * tanY_, s1 = (-1.0f + 2.0f * (y + 1) / grid.tilesY) * tanY_;
+                boxMinY_[s * grid.tilesY + y] = s0 * (s0 < 0.0f ? zf : zn);
+                boxMaxY_[s * grid.tilesY + y] = s1 * (s1 > 0.0f ? zf : zn);
+            }
+        }
+    }
+
+    void LightClusterer::TransformLights(const ClusterCamera& camera, const LightSpheres& lights, size_t begin, size_t end,
+                                         std::vector<ViewLight>& out) const {
+        ViewFrustum f;
+        std::copy(camera.view, camera.view + 16, f.m);
+        f.tanX = tanX_;
+        f.tanY = tanY_;
+        f.normX = std::sqrt(1.0f + tanX_ * tanX_);
+        f.normY = std::sqrt(1.0f + tanY_ * tanY_);
+        f.nearZ = nearZ_;
+        f.farZ = farZ_;
+
+        out.clear();
+        float vx[8], vy[8], vz[8], r[8];
+        auto emit = [&](unsigned mask, size_t lane) {
+            for (; mask; mask &= mask - 1) {
+                unsigned i = 0;
+                while (!(mask & (1u << i))) {
+                    i++;
+                }
+                ViewLight light;
+                light.index = (uint32_t)(lane + i);
+                light.x = vx[i];
+                light.y = vy[i];
+                light.z = vz[i];
+                light.radius = r[i];
+                float z0 = std::max(vz[i] - r[i], nearZ_), z1 = std::min(vz[i] + r[i], farZ_);
+                light.slice0 = (uint16_t)std::min(std::max(std::floor(std::log(z0) * sliceScale_ + sliceBias_), 0.0f), (float)(grid_.slices - 1));
+                light.slice1 = (uint16_t)std::min(std::max(std::floor(std::log(z1) * sliceScale_ + sliceBias_), 0.0f), (float)(grid_.slices - 1));
+                // x / z на параллелепипеде сферы монотонно по z, крайние значения - на z0 или z1.
+                float left = std::min((vx[i] - r[i]) / z0, (vx[i] - r[i]) / z1), right = std::max((vx[i] + r[i]) / z0, (vx[i] + r[i]) / z1);
+                float bottom = std::min((vy[i] - r[i]) / z0, (vy[i] - r[i]) / z1), top = std::max((vy[i] + r[i]) / z0, (vy[i] + r[i]) / z1);
+                light.tileX0 = TileOf(left / tanX_, grid_.tilesX);
+                light.tileX1 = TileOf(right / tanX_, grid_.tilesX);
+                light.tileY0 = TileOf(bottom / tanY_, grid_.tilesY);
+                light.tileY1 = TileOf(top / tanY_, grid_.tilesY);
+                out.push_back(light);
+            }
+        };
+
+        size_t lane = begin;
+        for (; lane + 8 <= end; lane += 8) {
+            floatx8 x, y, z, radius;
+            unsigned mask = lanemask(TransformSpheres(f, lights, lane, x, y, z, radius));
+            if (!mask)
+                continue;
+            x.Store(vx);
+            y.Store(vy);
+            z.Store(vz);
+            radius.Store(r);
+            emit(mask, lane);
+        }
+        for (; lane < end; lane++) {
+            unsigned mask = lanemask(TransformSpheres(f, lights, lane, vx[0], vy[0], vz[0], r[0]));
+            emit(mask, lane);
+        }
+    }
+
+    void LightClusterer::AssignSlice(unsigned s) {
+        Slice& slice = slices_[s];
+        const unsigned tileCount = grid_.tilesX * grid_.tilesY;
+        // Строка из восьми столбцов может выйти за последнюю ячейку, лишние дорожки попадают в запас.
+        slice.counts.assign(tileCount + 8, 0);
+        uint32_t* counts = slice.counts.data();
+        const float zn = sliceNear_[s], zf = sliceFar_[s];
+        const float* minX = &boxMinX_[(size_t)s * rowStride_];
+        const float* maxX = &boxMaxX_[(size_t)s * rowStride_];
+        const float* minY = &boxMinY_[(size_t)s * grid_.tilesY];
+        const float* maxY = &boxMaxY_[(size_t)s * grid_.tilesY];
+        slice.distanceX.resize(rowStride_);
+        slice.columnMasks.resize(rowStride_ / 8);
+        float* dx2 = slice.distanceX.data();
+        uint32_t* columns = slice.columnMasks.data();
+
+        // Места под попадания с запасом: строка из восьми столбцов дает не больше одного, тогда пустые маски
+        // записываются без ветвления и просто не занимают место.
+        size_t capacity = 0;
+        for (uint32_t b = binOffsets_[s]; b < binOffsets_[s + 1]; b++) {
+            const ViewLight& light = visible_[binLights_[b]];
+            capacity += (size_t)(light.tileY1 - light.tileY0 + 1) * ((light.tileX1 >> 3) - (light.tileX0 >> 3) + 1);
+        }
+        if (slice.spans.size() < capacity) {
+            slice.spans.resize(capacity);
+        }
+        Span* spans = slice.spans.data();
+        uint32_t spanCount = 0;
+
+        // Расстояние от центра сферы до параллелепипеда раскладывается по осям: dx^2 считается один раз на
+        // источник по восемь столбцов, затем для каждой строки сравнивается с r^2 - dy^2 - dz^2. Попадания
+        // восьми столбцов строки хранятся одной маской.
+        for (uint32_t b = binOffsets_[s]; b < binOffsets_[s + 1]; b++) {
+            const ViewLight& light = visible_[binLights_[b]];
+            float dz = std::max(std::max(zn - light.z, light.z - zf), 0.0f);
+            float remaining = light.radius * light.radius - dz * dz;
+            if (remaining < 0.0f)
+                continue;
+            const unsigned block0 = light.tileX0 & ~7u, block1 = light.tileX1 & ~7u;
+            const floatx8 cx(light.x);
+            for (unsigned block = block0; block <= block1; block += 8) {
+                floatx8 dx = max(max(floatx8::Load(minX + block) - cx, cx - floatx8::Load(maxX + block)), floatx8(0.0f));
+                (dx * dx).Store(dx2 + (block - block0));
+                // Только столбцы tileX0 .. tileX1.
+                int first = std::max((int)light.tileX0 - (int)block, 0), last = std::min((int)light.tileX1 - (int)block, 7);
+                columns[(block - block0) / 8] = (0xFFu << first) & (0xFFu >> (7 - last));
+            }
+            // Отрицательный остаток строки не пропускает ни одного столбца, отдельная проверка не нужна.
+            for (unsigned y = light.tileY0; y <= light.tileY1; y++) {
+                float dy = std::max(std::max(minY[y] - light.y, light.y - maxY[y]), 0.0f);
+                const floatx8 limit(remaining - dy * dy);
+                for (unsigned block = block0; block <= block1; block += 8) {
+                    unsigned mask = lanemask(floatx8::Load(dx2 + (block - block0)) <= limit) & columns[(block - block0) / 8];
+                    Span& span = spans[spanCount];
+                    span.cluster = y * grid_.tilesX + block;
+                    span.mask = mask;
+                    span.light = light.index;
+                    spanCount += mask != 0;
+                    uint32_t* count = counts + span.cluster;
+                    for (unsigned lane = 0; lane < 8; lane++) {
+                        count[lane] += (mask >> lane) & 1;
+                    }
+                }
+            }
+        }
+        slice.spanCount = spanCount;
+
+        slice.offsets.resize(tileCount + 8);
+        uint32_t end = 0;
+        slice.count = 0;
+        for (unsigned c = 0; c < tileCount + 8; c++) {
+            slice.offsets[c] = end;
+            end += counts[c] + 1;
+            slice.count += c < tileCount ? counts[c] : 0;
+        }
+        slice.size = end;
+    }
+
+    // Сортировка подсчетом по ячейкам сохраняет порядок источников внутри ячейки. У каждой ячейки есть лишнее
+    // место: все восемь дорожек пишутся без ветвлений, а курсор сдвигается только для установленных битов,
+    // поэтому непопавшая дорожка портит лишь следующее за списком место. Списки пишутся сразу в indices_ и
+    // не сжимаются, лишние места остаются между ними.
+    void LightClusterer::ScatterSlice(unsigned s) {
+        Slice& slice = slices_[s];
+        uint32_t* indices = indices_.data() + slice.start;
+        for (uint32_t i = 0; i < slice.spanCount; i++) {
+            const Span& span = slice.spans[i];
+            uint32_t* cursor = slice.offsets.data() + span.cluster;
+            for (unsigned lane = 0; lane < 8; lane++) {
+                indices[cursor[lane]] = span.light;
+                cursor[lane] += (span.mask >> lane) & 1;
+            }
+        }
+
+        const unsigned tileCount = grid_.tilesX * grid_.tilesY;
+        uint32_t* out = &clusters_[(size_t)s * tileCount * 2];
+        for (unsigned c = 0; c < tileCount; c++) {
+            out[c * 2] = slice.start + slice.offsets[c] - slice.counts[c];
+            out[c * 2 + 1] = slice.counts[c];
+        }
+    }
+
+    void LightClusterer::Build(const ClusterGrid& grid, const ClusterCamera& camera, const LightSpheres& lights, ThreadPool* pool) {
+        auto start = std::chrono::steady_clock::now();
+        stats_ = ClusterStats();
+        SetupGrid(grid, camera);
+
+        size_t chunkCount = (lights.count + transformChunk - 1) / transformChunk;
+        if (chunks_.size() < chunkCount) {
+            chunks_.resize(chunkCount);
+        }
+        For(pool, chunkCount, 1, [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; c++) {
+                TransformLights(camera, lights, c * transformChunk, std::min((c + 1) * transformChunk, lights.count), chunks_[c]);
+            }
+        });
+        visible_.clear();
+        for (size_t c = 0; c < chunkCount; c++) {
+            visible_.insert(visible_.end(), chunks_[c].begin(), chunks_[c].end());
+        }
+
+        // Источники раскладываются по срезам глубины, которые задевает их параллелепипед.
+        binOffsets_.assign(grid.slices + 1, 0);
+        for (const ViewLight& light : visible_) {
+            for (unsigned s = light.slice0; s <= light.slice1; s++) {
+                binOffsets_[s + 1]++;
+            }
+        }
+        for (unsigned s = 0; s < grid.slices; s++) {
+            binOffsets_[s + 1] += binOffsets_[s];
+        }
+        binLights_.resize(binOffsets_[grid.slices]);
+        std::vector<uint32_t> cursor(binOffsets_.begin(), binOffsets_.end() - 1);
+        for (uint32_t i = 0; i < (uint32_t)visible_.size(); i++) {
+            for (unsigned s = visible_[i].slice0; s <= visible_[i].slice1; s++) {
+                binLights_[cursor[s]++] = i;
+            }
+        }
+
+        slices_.resize(grid.slices);
+        For(pool, grid.slices, 1, [&](size_t begin, size_t end) {
+            for (size_t s = begin; s < end; s++) {
+                AssignSlice((unsigned)s);
+            }
+        });
+
+        uint32_t size = 0, total = 0;
+        for (Slice& slice : slices_) {
+            slice.start = size;
+            size += slice.size;
+            total += slice.count;
+        }
+        indices_.resize(size);
+        clusters_.resize((size_t)grid.GetClusterCount() * 2);
+        For(pool, grid.slices, 1, [&](size_t begin, size_t end) {
+            for (size_t s = begin; s < end; s++) {
+                ScatterSlice((unsigned)s);
+            }
+        });
+
+        stats_.visibleLights = visible_.size();
+        stats_.indexCount = total;
+        for (size_t c = 0; c < clusters_.size(); c += 2) {
+            stats_.maxClusterLights = std::max(stats_.maxClusterLights, (size_t)clusters_[c + 1]);
+            stats_.nonEmptyClusters += clusters_[c + 1] != 0;
+        }
+        stats_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
@@ -0,0 +1,140 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+
+// Кластерное распределение точечных источников. Пирамида видимости делится на tilesX x tilesY x slices ячеек
+// (froxels): равномерно по экрану и экспоненциально по глубине вида. Для каждой ячейки строится список источников,
+// сфера влияния которых ее задевает. Списки лежат подряд в одном буфере индексов, у ячейки хранятся начало
+// и длина. Шейдер находит ячейку по clip-координатам точки (LightCalc.h), поэтому число источников не ограничено
+// константным буфером. Не зависит от D3D и собирается на Linux (см. LightClustersBenchMain.cpp).
+namespace lighting {
+    struct ClusterGrid {
+        unsigned tilesX = 16;
+        unsigned tilesY = 9;
+        unsigned slices = 24;
+
+        unsigned GetClusterCount() const {
+            return tilesX * tilesY * slices;
+        };
+    };
+
+    // Матрица вида 4x4 по строкам, векторы умножаются слева, как в DirectXMath; масштаба в ней нет. Проекция -
+    // XMMatrixPerspectiveFovLH(fovY, aspect, ...) с ближней плоскостью nearZ и дальней farZ (в Renderer они
+    // переставлены ради обратной глубины, здесь nearZ < farZ).
+    struct ClusterCamera {
+        float view[16];
+        float fovY;
+        float aspect;
+        float nearZ;
+        float farZ;
+    };
+
+    // Источники по компонентам: центр в мире и радиус влияния.
+    struct LightSpheres {
+        const float* x = nullptr;
+        const float* y = nullptr;
+        const float* z = nullptr;
+        const float* radius = nullptr;
+        size_t count = 0;
+    };
+
+    // Расстояние, на котором intensity * saturate(1 / d^2) из CalculateColor падает до cutoff.
+    float InfluenceRadius(float intensity, float cutoff);
+
+    struct ClusterStats {
+        size_t visibleLights = 0;       // пересекают пирамиду видимости
+        size_t indexCount = 0;          // сумма длин списков
+        size_t maxClusterLights = 0;
+        size_t nonEmptyClusters = 0;
+        double seconds = 0.0;
+    };
+
+    class LightClusterer {
+    public:
+        void Build(const ClusterGrid& grid, const ClusterCamera& camera, const LightSpheres& lights, ThreadPool* pool = nullptr);
+
+        // Пары (начало, длина) по ячейкам, ячейка (x, y, z) - номер (z * tilesY + y) * tilesX + x. x растет вправо,
+        // y - вверх, как clip-координаты, z - от камеры.
+        const std::vector<uint32_t>& GetClusters() const {
+            return clusters_;
+        };
+
+        // Номера источников во входном массиве; в пределах ячейки по возрастанию. Между списками ячеек есть
+        // неиспользуемые места (по одному на ячейку), читать только по парам из GetClusters.
+        const std::vector<uint32_t>& GetIndices() const {
+            return indices_;
+        };
+
+        // Срез для глубины вида w (clip.w): floor(log(w) * scale + bias), ограниченный [0, slices - 1].
+        float GetSliceScale() const {
+            return sliceScale_;
+        };
+
+        float GetSliceBias() const {
+            return sliceBias_;
+        };
+
+        const ClusterStats& GetStats() const {
+            return stats_;
+        };
+
+    private:
+        // Источник в пространстве вида с диапазонами ячеек, которые задевает его ограничивающий параллелепипед.
+        struct ViewLight {
+            uint32_t index;
+            float x, y, z, radius;
+            uint16_t slice0, slice1;
+            uint16_t tileX0, tileX1, tileY0, tileY1;
+        };
+
+        // Источник задевает ячейки cluster + i для битов i маски: восемь столбцов одной строки.
+        struct Span {
+            uint32_t cluster;
+            uint32_t mask;
+            uint32_t light;
+        };
+
+        // Попадания одного среза глубины до раскладки в indices_.
+        struct Slice {
+            std::vector<uint32_t> counts;       // длины списков ячеек, tilesX * tilesY + 8
+            std::vector<uint32_t> offsets;      // начала списков ячеек от start, после раскладки - концы
+            uint32_t count = 0;                 // сумма длин списков
+            uint32_t size = 0;                  // мест в indices_: списки и по одному лишнему месту на ячейку
+            std::vector<Span> spans;            // попадания до сортировки по ячейкам, только растет
+            uint32_t spanCount = 0;             // занятых мест в spans
+            std::vector<float> distanceX;       // dx^2 до столбцов для текущего источника
+            std::vector<uint32_t> columnMasks;  // столбцы tileX0 .. tileX1 по блокам из восьми для текущего источника
+            uint32_t start = 0;                 // начало среза в indices_
+        };
+
+        void SetupGrid(const ClusterGrid& grid, const ClusterCamera& camera);
+        void TransformLights(const ClusterCamera& camera, const LightSpheres& lights, size_t begin, size_t end,
+                             std::vector<ViewLight>& out) const;
+        void AssignSlice(unsigned slice);
+        void ScatterSlice(unsigned slice);
+
+        ClusterGrid grid_;
+        float fovY_ = 0.0f, aspect_ = 0.0f, nearZ_ = 0.0f, farZ_ = 0.0f;
+        float tanX_ = 0.0f, tanY_ = 0.0f;
+        float sliceScale_ = 0.0f, sliceBias_ = 0.0f;
+        unsigned rowStride_ = 0;                // tilesX с округлением вверх до 8
+        // Ограничивающие параллелепипеды ячеек в пространстве вида. Границы по x зависят только от среза и столбца
+        // ([срез][rowStride_]), по y - от среза и строки ([срез][tilesY]), по глубине - от среза.
+        std::vector<float> boxMinX_, boxMaxX_, boxMinY_, boxMaxY_;
+        std::vector<float> sliceNear_, sliceFar_;
+
+        std::vector<std::vector<ViewLight>> chunks_;
+        std::vector<ViewLight> visible_;
+        std::vector<uint32_t> binOffsets_;      // источники по срезам: binLights_[binOffsets_[s] .. binOffsets_[s + 1])
+        std::vector<uint32_t> binLights_;
+        std::vector<Slice> slices_;
+        std::vector<uint32_t> clusters_;
+        std::vector<uint32_t> indices_;
+        ClusterStats stats_;
+    };
+}
@@ -0,0 +1,210 @@
+﻿// Замер и проверка LightClusters, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 -mavx2 -mfma -pthread LightClustersBenchMain.cpp LightClusters.cpp ThreadPool.cpp -o lightclusters
+// Примеры:
+//   ./lightclusters --lights 4096 --width 1920 --height 1080
+//   ./lightclusters --lights 65536 --grid 32 18 32 --threads 8
+// Проверка - случайные точки пирамиды видимости, см. Validate. Замер - время Build по кадрам: лучшее, среднее и
+// 95-й процентиль, среднее и процентиль сравниваются с целью 1 мс на 4096 источников при 1080p.
+#include "LightClusters.h"
+#include "ThreadPool.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+    const double targetMilliseconds = 1.0;
+
+    struct Scene {
+        std::vector<float> x, y, z, radius;
+
+        lighting::LightSpheres Spheres() const {
+            lighting::LightSpheres spheres;
+            spheres.x = x.data();
+            spheres.y = y.data();
+            spheres.z = z.data();
+            spheres.radius = radius.data();
+            spheres.count = x.size();
+            return spheres;
+        }
+    };
+
+    // Источники в параллелепипеде 80 x 20 x 80 вокруг начала координат, яркость 1 .. 50 при отсечке 0.5:
+    // радиусы влияния от 1.4 до 10.
+    void MakeScene(size_t count, Scene& scene) {
+        std::mt19937 random(5);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (auto* stream : { &scene.x, &scene.y, &scene.z, &scene.radius }) {
+            stream->resize(count);
+        }
+        for (size_t i = 0; i < count; i++) {
+            scene.x[i] = unit(random) * 80.0f - 40.0f;
+            scene.y[i] = unit(random) * 20.0f - 10.0f;
+            scene.z[i] = unit(random) * 80.0f - 40.0f;
+            scene.radius[i] = lighting::InfluenceRadius(1.0f + unit(random) * 49.0f, 0.5f);
+        }
+    }
+
+    // Матрица вида LookAtLH по строкам, как XMMatrixLookAtLH.
+    void LookAt(const float eye[3], const float focus[3], float view[16]) {
+        float f[3] = { focus[0] - eye[0], focus[1] - eye[1], focus[2] - eye[2] };
+        float length = std::sqrt(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+        for (float& c : f) {
+            c /= length;
+        }
+        float r[3] = { f[2], 0.0f, -f[0] };
+        length = std::sqrt(r[0] * r[0] + r[2] * r[2]);
+        r[0] /= length;
+        r[2] /= length;
+        float u[3] = { f[1] * r[2] - f[2] * r[1], f[2] * r[0] - f[0] * r[2], f[0] * r[1] - f[1] * r[0] };
+        const float* axes[3] = { r, u, f };
+        for (int row = 0; row < 3; row++) {
+            for (int column = 0; column < 3; column++) {
+                view[row * 4 + column] = axes[column][row];
+            }
+            view[row * 4 + 3] = 0.0f;
+        }
+        for (int column = 0; column < 3; column++) {
+            view[12 + column] = -(axes[column][0] * eye[0] + axes[column][1] * eye[1] + axes[column][2] * eye[2]);
+        }
+        view[15] = 1.0f;
+    }
+
+    // Точки внутри пирамиды видимости: ячейка точки считается так же, как в LightCalc.h, и каждый источник, сфера которого
+    // содержит точку, обязан быть в списке этой ячейки. Лишние источники ошибкой не считаются - параллелепипед ячейки
+    // шире ее клина пирамиды, - а показывают, сколько работы шейдер делает впустую.
+    bool Validate(const lighting::LightClusterer& clusterer, const lighting::ClusterGrid& grid, const lighting::ClusterCamera& camera,
+                  const Scene& scene, unsigned points) {
+        const std::vector<uint32_t>& clusters = clusterer.GetClusters();
+        const std::vector<uint32_t>& indices = clusterer.GetIndices();
+        const float tanY = std::tan(camera.fovY * 0.5f), tanX = tanY * camera.aspect;
+        const size_t count = scene.x.size();
+        std::vector<float> vx(count), vy(count), vz(count);
+        const float* m = camera.view;
+        for (size_t i = 0; i < count; i++) {
+            vx[i] = scene.x[i] * m[0] + scene.y[i] * m[4] + scene.z[i] * m[8] + m[12];
+            vy[i] = scene.x[i] * m[1] + scene.y[i] * m[5] + scene.z[i] * m[9] + m[13];
+            vz[i] = scene.x[i] * m[2] + scene.y[i] * m[6] + scene.z[i] * m[10] + m[14];
+        }
+        size_t unordered = 0;
+        for (size_t c = 0; c < clusters.size() / 2; c++) {
+            for (uint32_t k = 1; k < clusters[c * 2 + 1]; k++) {
+                unordered += indices[clusters[c * 2] + k] <= indices[clusters[c * 2] + k - 1];
+            }
+        }
+
+        std::mt19937 random(13);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<char> member(count);
+        size_t missing = 0, covering = 0, listed = 0;
+        for (unsigned p = 0; p < points; p++) {
+            float ndcX = unit(random) * 2.0f - 1.0f, ndcY = unit(random) * 2.0f - 1.0f;
+            float w = camera.nearZ * std::pow(camera.farZ / camera.nearZ, unit(random));
+            float px = ndcX * tanX * w, py = ndcY * tanY * w;
+            unsigned tx = std::min((unsigned)((ndcX * 0.5f + 0.5f) * grid.tilesX), grid.tilesX - 1);
+            unsigned ty = std::min((unsigned)((ndcY * 0.5f + 0.5f) * grid.tilesY), grid.tilesY - 1);
+            float slice = std::floor(std::log(w) * clusterer.GetSliceScale() + clusterer.GetSliceBias());
+            unsigned tz = (unsigned)std::min(std::max(slice, 0.0f), (float)(grid.slices - 1));
+            size_t cluster = ((size_t)tz * grid.tilesY + ty) * grid.tilesX + tx;
+            uint32_t begin = clusters[cluster * 2], length = clusters[cluster * 2 + 1];
+            for (uint32_t k = 0; k < length; k++) {
+                member[indices[begin + k]] = 1;
+            }
+            listed += length;
+            for (size_t i = 0; i < count; i++) {
+                float dx = px - vx[i], dy = py - vy[i], dz = w - vz[i], r = scene.radius[i];
+                if (dx * dx + dy * dy + dz * dz <= r * r * (1.0f - 1e-4f)) {
+                    covering++;
+                    missing += !member[i];
+                }
+            }
+            for (uint32_t k = 0; k < length; k++) {
+                member[indices[begin + k]] = 0;
+            }
+        }
+        printf("Validation: %u points, %zu missing, %zu out of order; %.1f lights per point listed, %.1f actually cover it\n", points,
+            missing, unordered, listed / (double)points, covering / (double)points);
+        return missing == 0 && unordered == 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t lightCount = 4096;
+    unsigned width = 1920, height = 1080, frames = 50;
+    unsigned threads = std::thread::hardware_concurrency();
+    bool validate = true;
+    lighting::ClusterGrid grid;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--lights") && i + 1 < argc) {
+            lightCount = (size_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--width") && i + 1 < argc) {
+            width = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--height") && i + 1 < argc) {
+            height = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--grid") && i + 3 < argc) {
+            grid.tilesX = (unsigned)atoi(argv[++i]);
+            grid.tilesY = (unsigned)atoi(argv[++i]);
+            grid.slices = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--no-validate")) {
+            validate = false;
+        } else {
+            printf("lightclusters [--lights <n>] [--width <w> --height <h>] [--grid <x> <y> <z>] [--threads <n>] [--frames <n>]"
+                " [--no-validate]\n");
+            return 1;
+        }
+    }
+    if (grid.tilesX == 0 || grid.tilesY == 0 || grid.slices == 0 || width == 0 || height == 0) {
+        printf("Empty grid or frame\n");
+        return 1;
+    }
+    threads = std::max(threads, 1u);
+    frames = std::max(frames, 1u);
+
+    Scene scene;
+    MakeScene(lightCount, scene);
+    // Камера Renderer: XMMatrixPerspectiveFovLH(pi / 3, w / h, 100, 0.01), начальное положение Camera.
+    lighting::ClusterCamera camera;
+    const float eye[3] = { 0.0f, 3.5355339f, -3.5355339f }, focus[3] = { 0.0f, 0.0f, 0.0f };
+    LookAt(eye, focus, camera.view);
+    camera.fovY = 3.14159265f / 3.0f;
+    camera.aspect = width / (float)height;
+    camera.nearZ = 0.01f;
+    camera.farZ = 100.0f;
+
+    lighting::LightClusterer clusterer;
+    printf("%zu lights, %ux%u, grid %ux%ux%u (%u clusters)\n", lightCount, width, height, grid.tilesX, grid.tilesY, grid.slices,
+        grid.GetClusterCount());
+    for (unsigned n = 1; n <= threads; n = n < threads ? std::min(n * 2, threads) : n + 1) {
+        std::unique_ptr<ThreadPool> pool(n > 1 ? new ThreadPool(n - 1) : nullptr);
+        clusterer.Build(grid, camera, scene.Spheres(), pool.get());
+        std::vector<double> times(frames);
+        double total = 0.0;
+        for (unsigned f = 0; f < frames; f++) {
+            clusterer.Build(grid, camera, scene.Spheres(), pool.get());
+            times[f] = clusterer.GetStats().seconds * 1e3;
+            total += times[f];
+        }
+        std::sort(times.begin(), times.end());
+        double mean = total / frames, p95 = times[(frames * 95 + 99) / 100 - 1];
+        printf("threads %2u: %.3f ms best, %.3f ms mean, %.3f ms p95; target %.0f ms: mean %s, p95 %s\n", n, times[0], mean, p95,
+            targetMilliseconds, mean <= targetMilliseconds ? "met" : "NOT MET", p95 <= targetMilliseconds ? "met" : "NOT MET");
+    }
+
+    const lighting::ClusterStats& stats = clusterer.GetStats();
+    size_t bufferEntries = clusterer.GetIndices().size();
+    printf("Visible lights %zu, %zu indices in a buffer of %zu entries (%.1f KB), clusters %zu of %u non-empty, max %zu lights per"
+        " cluster, %.1f per non-empty cluster\n", stats.visibleLights, stats.indexCount, bufferEntries, bufferEntries * 4 / 1024.0,
+        stats.nonEmptyClusters, grid.GetClusterCount(), stats.maxClusterLights, stats.nonEmptyClusters ? stats.indexCount / (double)stats.nonEmptyClusters : 0.0);
+    if (validate && !Validate(clusterer, grid, camera, scene, 20000))
+        return 1;
+    return 0;
+}
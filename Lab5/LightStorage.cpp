@@ -0,0 +1,243 @@
+﻿#include "LightStorage.h"
+#include "ShaderMath.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <functional>
+
+namespace lighting {
+    namespace {
+        using namespace hlsl;
+
+        // Блоков на задачу пула: в блоке dirtyBlock источников, это около микросекунды работы.
+        const size_t blockGrain = 4;
+
+        void For(ThreadPool* pool, size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+            if (pool) {
+                pool->ParallelFor(count, grain, body);
+            } else {
+                body(0, count);
+            }
+        }
+    }
+
+    // Тот же код для одного источника (float) и для восьми (floatx8), поэтому Set и Animate дают одинаковые значения.
+    template<typename Lane>
+    void LightStorage::Evaluate(size_t i, float time) {
+        auto load = [&](Stream stream) {
+            return LaneTraits<Lane>::Load(streams_[stream].data() + i);
+        };
+        auto store = [&](Stream stream, Lane value) {
+            LaneTraits<Lane>::Store(value, streams_[stream].data() + i);
+        };
+        Lane phase = load(Phase), sine, cosine;
+        sincos(load(OrbitSpeed) * Lane(time) + phase, sine, cosine);
+        Lane orbit = load(OrbitRadius);
+        store(X, load(BaseX) + orbit * cosine);
+        store(Y, load(BaseY));
+        store(Z, load(BaseZ) + orbit * sine);
+
+        Lane wave = sin(load(FlickerSpeed) * Lane(time) + phase);
+        Lane intensity = load(BaseIntensity) * (Lane(1.0f) - load(Flicker) * (Lane(0.5f) + Lane(0.5f) * wave));
+        store(Intensity, intensity);
+        // InfluenceRadius от яркости самой сильной компоненты цвета.
+        Lane peak = intensity * max(max(load(Red), load(Green)), load(Blue));
+        store(Radius, select(peak > Lane(0.0f), sqrt(max(peak * Lane(1.0f / cutoff_), Lane(1.0f))), Lane(0.0f)));
+    }
+
+    void LightStorage::EvaluateBlock(size_t block) {
+        size_t begin = block * dirtyBlock, end = std::min(begin + dirtyBlock, count_);
+        for (size_t i = begin; i < end; i += LaneTraits<floatx8>::count) {
+            Evaluate<floatx8>(i, time_);
+        }
+        dirty_[block] = 1;
+    }
+
+    uint32_t LightStorage::Add(const LightDesc& desc) {
+        uint32_t index = (uint32_t)count_++;
+        // Длина массивов кратна восьми, хвост нулевой: у нулевых источников нулевой радиус.
+        size_t padded = (count_ + 7) & ~size_t(7);
+        for (std::vector<float>& stream : streams_) {
+            stream.resize(padded, 0.0f);
+        }
+        size_t blocks = (count_ + dirtyBlock - 1) / dirtyBlock;
+        animated_.resize(blocks, 0);
+        dirty_.resize(blocks, 0);
+        Write(index, desc);
+        return index;
+    }
+
+    void LightStorage::Remove(uint32_t index) {
+        if (index >= count_)
+            return;
+        uint32_t last = (uint32_t)count_ - 1;
+        if (index != last) {
+            LightDesc moved;
+            Get(last, moved);
+            Write(index, moved);
+        }
+        Write(last, LightDesc());
+        for (std::vector<float>& stream : streams_) {
+            stream[last] = 0.0f;
+        }
+        count_--;
+        size_t blocks = (count_ + dirtyBlock - 1) / dirtyBlock;
+        animated_.resize(blocks);
+        dirty_.resize(blocks);
+    }
+
+    void LightStorage::Clear() {
+        count_ = 0;
+        for (std::vector<float>& stream : streams_) {
+            stream.clear();
+        }
+        animated_.clear();
+        dirty_.clear();
+        packed_.clear();
+    }
+
+    void LightStorage::Get(uint32_t index, LightDesc& desc) const {
+        desc.position[0] = streams_[BaseX][index];
+        desc.position[1] = streams_[BaseY][index];
+        desc.position[2] = streams_[BaseZ][index];
+        desc.color[0] = streams_[Red][index];
+        desc.color[1] = streams_[Green][index];
+        desc.color[2] = streams_[Blue][index];
+        desc.intensity = streams_[BaseIntensity][index];
+        desc.orbitRadius = streams_[OrbitRadius][index];
+        desc.orbitSpeed = streams_[OrbitSpeed][index];
+        desc.flicker = streams_[Flicker][index];
+        desc.flickerSpeed = streams_[FlickerSpeed][index];
+        desc.phase = streams_[Phase][index];
+    }
+
+    void LightStorage::Set(uint32_t index, const LightDesc& desc) {
+        if (index < count_) {
+            Write(index, desc);
+        }
+    }
+
+    void LightStorage::Write(uint32_t index, const LightDesc& desc) {
+        LightDesc old;
+        Get(index, old);
+        size_t block = index / dirtyBlock;
+        animated_[block] += (IsAnimated(desc) ? 1 : 0) - (IsAnimated(old) ? 1 : 0);
+        dirty_[block] = 1;
+
+        streams_[BaseX][index] = desc.position[0];
+        streams_[BaseY][index] = desc.position[1];
+        streams_[BaseZ][index] = desc.position[2];
+        streams_[Red][index] = desc.color[0];
+        streams_[Green][index] = desc.color[1];
+        streams_[Blue][index] = desc.color[2];
+        streams_[BaseIntensity][index] = desc.intensity;
+        streams_[OrbitRadius][index] = desc.orbitRadius;
+        streams_[OrbitSpeed][index] = desc.orbitSpeed;
+        streams_[Flicker][index] = desc.flicker;
+        streams_[FlickerSpeed][index] = desc.flickerSpeed;
+        streams_[Phase][index] = desc.phase;
+        Evaluate<float>(index, time_);
+    }
+
+    void LightStorage::SetCutoff(float cutoff) {
+        cutoff_ = std::max(cutoff, 1e-6f);
+        for (size_t block = 0; block < dirty_.size(); block++) {
+            EvaluateBlock(block);
+        }
+    }
+
+    void LightStorage::Animate(float time, ThreadPool* pool) {
+        time_ = time;
+        blocks_.clear();
+        for (size_t block = 0; block < animated_.size(); block++) {
+            if (animated_[block] > 0) {
+                blocks_.push_back((uint32_t)block);
+            }
+        }
+        For(pool, blocks_.size(), blockGrain, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; b++) {
+                EvaluateBlock(blocks_[b]);
+            }
+        });
+    }
+
+    void LightStorage::MarkAllDirty() {
+        std::fill(dirty_.begin(), dirty_.end(), 1);
+    }
+
+    // Положение и радиус, цвет и яркость - два float4 на источник, как lightData в LightCalc.h.
+    void LightStorage::PackBlock(size_t block) {
+        size_t begin = block * dirtyBlock, end = std::min(begin + dirtyBlock, count_);
+        const float* x = streams_[X].data();
+        const float* y = streams_[Y].data();
+        const float* z = streams_[Z].data();
+        const float* radius = streams_[Radius].data();
+        const float* red = streams_[Red].data();
+        const float* green = streams_[Green].data();
+        const float* blue = streams_[Blue].data();
+        const float* intensity = streams_[Intensity].data();
+        float* out = packed_.data() + begin * packedFloats;
+        size_t i = begin;
+#ifdef SHADER_MATH_SSE
+        // Четыре источника - транспонирование двух матриц 4x4.
+        for (; i + 4 <= end; i += 4, out += 4 * packedFloats) {
+            __m128 p0 = _mm_loadu_ps(x + i), p1 = _mm_loadu_ps(y + i), p2 = _mm_loadu_ps(z + i), p3 = _mm_loadu_ps(radius + i);
+            __m128 c0 = _mm_loadu_ps(red + i), c1 = _mm_loadu_ps(green + i), c2 = _mm_loadu_ps(blue + i);
+            __m128 c3 = _mm_loadu_ps(intensity + i);
+            _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+            _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+            _mm_storeu_ps(out, p0);
+            _mm_storeu_ps(out + 4, c0);
+            _mm_storeu_ps(out + 8, p1);
+            _mm_storeu_ps(out + 12, c1);
+            _mm_storeu_ps(out + 16, p2);
+            _mm_storeu_ps(out + 20, c2);
+            _mm_storeu_ps(out + 24, p3);
+            _mm_storeu_ps(out + 28, c3);
+        }
+#endif
+        for (; i < end; i++, out += packedFloats) {
+            out[0] = x[i];
+            out[1] = y[i];
+            out[2] = z[i];
+            out[3] = radius[i];
+            out[4] = red[i];
+            out[5] = green[i];
+            out[6] = blue[i];
+            out[7] = intensity[i];
+        }
+    }
+
+    void LightStorage::Pack(std::vector<LightRange>& ranges, ThreadPool* pool) {
+        ranges.clear();
+        packed_.resize(count_ * packedFloats);
+        blocks_.clear();
+        for (size_t block = 0; block < dirty_.size(); block++) {
+            if (!dirty_[block])
+                continue;
+            dirty_[block] = 0;
+            blocks_.push_back((uint32_t)block);
+            uint32_t first = (uint32_t)(block * dirtyBlock);
+            uint32_t count = (uint32_t)std::min<size_t>(dirtyBlock, count_ - first);
+            if (!ranges.empty() && ranges.back().first + ranges.back().count == first) {
+                ranges.back().count += count;
+            } else {
+                ranges.push_back({ first, count });
+            }
+        }
+        For(pool, blocks_.size(), blockGrain, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; b++) {
+                PackBlock(blocks_[b]);
+            }
+        });
+    }
+
+    LightSpheres LightStorage::GetSpheres() const {
+        LightSpheres spheres;
+        spheres.x = streams_[X].data();
+        spheres.y = streams_[Y].data();
+        spheres.z = streams_[Z].data();
+        spheres.radius = streams_[Radius].data();
+        spheres.count = count_;
+        return spheres;
+    }
+}
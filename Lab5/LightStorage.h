@@ -0,0 +1,123 @@
+﻿#pragma once
+
+#include "LightClusters.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+
+// Точечные источники структурой массивов: положение, цвет, яркость, радиус влияния и параметры анимации.
+// Анимация, мерцание и радиусы считаются по восемь источников (ShaderMath.h), только для блоков, где есть
+// анимированные источники. Для GPU источники упаковываются в формат t3 из LightCalc.h, заново - только
+// изменившиеся блоки. Не зависит от D3D и собирается на Linux (см. LightStorageBenchMain.cpp).
+namespace lighting {
+    // Источник движется по горизонтальной окружности orbitRadius вокруг position, яркость мерцает:
+    // intensity * (1 - flicker * (0.5 + 0.5 * sin(flickerSpeed * t + phase))). Нули - неподвижный ровный источник.
+    struct LightDesc {
+        float position[3] = { 0.0f, 0.0f, 0.0f };
+        float color[3] = { 1.0f, 1.0f, 1.0f };
+        float intensity = 1.0f;
+        float orbitRadius = 0.0f;
+        float orbitSpeed = 0.0f;        // радиан в секунду
+        float flicker = 0.0f;           // доля яркости, 0 .. 1
+        float flickerSpeed = 0.0f;
+        float phase = 0.0f;
+    };
+
+    // Источники first .. first + count - 1.
+    struct LightRange {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    class LightStorage {
+    public:
+        static const unsigned packedFloats = 8;     // float4 положение и радиус, float4 цвет и яркость
+        static const unsigned dirtyBlock = 256;     // источников в блоке учета изменений
+
+        uint32_t Add(const LightDesc& desc);
+        // На место удаленного переносится последний источник.
+        void Remove(uint32_t index);
+        void Clear();
+        void Get(uint32_t index, LightDesc& desc) const;
+        void Set(uint32_t index, const LightDesc& desc);
+
+        size_t GetCount() const {
+            return count_;
+        };
+
+        // Освещенность, на которой кончается радиус влияния: intensity * max(color) / d^2 = cutoff.
+        void SetCutoff(float cutoff);
+
+        float GetCutoff() const {
+            return cutoff_;
+        };
+
+        // Положения, яркости и радиусы в момент time (секунды) для блоков с анимированными источниками.
+        void Animate(float time, ThreadPool* pool = nullptr);
+
+        // Упаковывает изменившиеся блоки в GetPacked() и возвращает их диапазоны, соседние блоки сливаются.
+        // После вызова все блоки считаются неизменными.
+        void Pack(std::vector<LightRange>& ranges, ThreadPool* pool = nullptr);
+        // Следующий Pack упакует все источники, например после пересоздания буфера.
+        void MarkAllDirty();
+
+        // packedFloats на источник.
+        const std::vector<float>& GetPacked() const {
+            return packed_;
+        };
+
+        LightSpheres GetSpheres() const;
+
+        // Текущие значения полей, GetCount() штук.
+        const float* GetX() const {
+            return streams_[X].data();
+        };
+
+        const float* GetY() const {
+            return streams_[Y].data();
+        };
+
+        const float* GetZ() const {
+            return streams_[Z].data();
+        };
+
+        const float* GetIntensity() const {
+            return streams_[Intensity].data();
+        };
+
+        const float* GetRadius() const {
+            return streams_[Radius].data();
+        };
+
+    private:
+        // Массивы одного поля, длина кратна восьми; хвост заполнен нулями.
+        enum Stream {
+            X, Y, Z, Red, Green, Blue, Intensity, Radius,
+            BaseX, BaseY, BaseZ, BaseIntensity, OrbitRadius, OrbitSpeed, Flicker, FlickerSpeed, Phase,
+            StreamCount
+        };
+
+        static bool IsAnimated(const LightDesc& desc) {
+            return desc.orbitRadius != 0.0f || desc.flicker != 0.0f;
+        };
+
+        // Текущие поля источников с i по числу дорожек Lane из базовых в момент time.
+        template<typename Lane>
+        void Evaluate(size_t i, float time);
+        void EvaluateBlock(size_t block);
+        void Write(uint32_t index, const LightDesc& desc);
+        void PackBlock(size_t block);
+
+        size_t count_ = 0;
+        float cutoff_ = 0.01f;
+        float time_ = 0.0f;                         // время последнего Animate
+        std::vector<float> streams_[StreamCount];
+        std::vector<uint32_t> animated_;            // анимированных источников в блоке
+        std::vector<uint8_t> dirty_;                // блок нужно упаковать
+        std::vector<uint32_t> blocks_;              // анимированные или измененные блоки для текущего прохода
+        std::vector<float> packed_;
+    };
+}
@@ -0,0 +1,225 @@
+﻿// Замер и проверка LightStorage, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 -mavx2 -mfma -pthread LightStorageBenchMain.cpp LightStorage.cpp LightClusters.cpp ThreadPool.cpp -o lightstorage
+// Примеры:
+//   ./lightstorage --lights 100000
+//   ./lightstorage --lights 100000 --animated 0.25 --threads 8
+// Кадр - Animate и Pack. Для сравнения - прежний способ Renderer: массив структур XMFLOAT4 положение и цвет,
+// анимация по одному источнику через std::sin и std::cos и поштучное копирование в буфер.
+#include "LightStorage.h"
+#include "ThreadPool.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+    // Источники в кубе 80 x 80 x 80; первые count * animated движутся по окружностям и мерцают, как источники,
+    // добавленные одной группой.
+    void MakeLights(size_t count, float animated, std::vector<lighting::LightDesc>& lights) {
+        std::mt19937 random(3);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        lights.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            lighting::LightDesc& light = lights[i];
+            for (int k = 0; k < 3; k++) {
+                light.position[k] = unit(random) * 80.0f - 40.0f;
+                light.color[k] = unit(random);
+            }
+            light.intensity = 1.0f + unit(random) * 49.0f;
+            if (i < count * animated) {
+                light.orbitRadius = unit(random) * 3.0f;
+                light.orbitSpeed = unit(random) * 4.0f - 2.0f;
+                light.flicker = unit(random) * 0.5f;
+                light.flickerSpeed = unit(random) * 20.0f;
+            }
+            light.phase = unit(random) * 6.2831853f;
+        }
+    }
+
+    // Значения LightDesc в момент time в двойной точности.
+    void Reference(const lighting::LightDesc& light, float time, float cutoff, double out[lighting::LightStorage::packedFloats]) {
+        double angle = (double)light.orbitSpeed * time + light.phase;
+        out[0] = light.position[0] + light.orbitRadius * std::cos(angle);
+        out[1] = light.position[1];
+        out[2] = light.position[2] + light.orbitRadius * std::sin(angle);
+        double wave = std::sin((double)light.flickerSpeed * time + light.phase);
+        double intensity = light.intensity * (1.0 - light.flicker * (0.5 + 0.5 * wave));
+        double peak = intensity * std::max(std::max(light.color[0], light.color[1]), light.color[2]);
+        out[3] = peak > 0.0 ? std::sqrt(std::max(peak / cutoff, 1.0)) : 0.0;
+        out[4] = light.color[0];
+        out[5] = light.color[1];
+        out[6] = light.color[2];
+        out[7] = intensity;
+    }
+
+    // Упакованные данные против Reference: относительная ошибка к max(|x|, 1).
+    double MaxError(const lighting::LightStorage& storage, float time) {
+        const std::vector<float>& packed = storage.GetPacked();
+        double error = 0.0;
+        for (uint32_t i = 0; i < storage.GetCount(); i++) {
+            lighting::LightDesc light;
+            storage.Get(i, light);
+            double expected[lighting::LightStorage::packedFloats];
+            Reference(light, time, storage.GetCutoff(), expected);
+            for (unsigned k = 0; k < lighting::LightStorage::packedFloats; k++) {
+                double value = packed[i * lighting::LightStorage::packedFloats + k];
+                error = std::max(error, std::fabs(value - expected[k]) / std::max(std::fabs(expected[k]), 1.0));
+            }
+        }
+        return error;
+    }
+
+    size_t RangeLights(const std::vector<lighting::LightRange>& ranges) {
+        size_t count = 0;
+        for (const lighting::LightRange& range : ranges) {
+            count += range.count;
+        }
+        return count;
+    }
+
+    // Прежний Renderer::lights_ и копирование в буфер.
+    struct Float4 {
+        float x, y, z, w;
+    };
+
+    struct AosLight {
+        Float4 pos;
+        Float4 color;
+    };
+
+    double MeasureAos(const std::vector<lighting::LightDesc>& lights, unsigned frames) {
+        std::vector<AosLight> aos(lights.size());
+        std::vector<AosLight> mapped(lights.size());
+        double best = 1e30;
+        for (unsigned f = 0; f < frames; f++) {
+            float time = f / 60.0f;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < lights.size(); i++) {
+                const lighting::LightDesc& light = lights[i];
+                float angle = light.orbitSpeed * time + light.phase;
+                float wave = std::sin(light.flickerSpeed * time + light.phase);
+                float intensity = light.intensity * (1.0f - light.flicker * (0.5f + 0.5f * wave));
+                aos[i].pos = { light.position[0] + light.orbitRadius * std::cos(angle), light.position[1],
+                    light.position[2] + light.orbitRadius * std::sin(angle), 1.0f };
+                aos[i].color = { light.color[0], light.color[1], light.color[2], intensity };
+            }
+            for (size_t i = 0; i < aos.size(); i++) {
+                mapped[i].pos = aos[i].pos;
+                mapped[i].color = aos[i].color;
+            }
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        return mapped[lights.size() / 2].pos.x == 12345.0f ? 0.0 : best;
+    }
+
+    // Удаление с переносом последнего, изменение одного источника, смена порога.
+    bool CheckEdits(const std::vector<lighting::LightDesc>& lights) {
+        lighting::LightStorage storage;
+        for (const lighting::LightDesc& light : lights) {
+            storage.Add(light);
+        }
+        std::vector<lighting::LightRange> ranges;
+        storage.Animate(1.5f);
+        storage.Pack(ranges);
+        bool ok = RangeLights(ranges) == storage.GetCount();
+
+        lighting::LightDesc last;
+        storage.Get((uint32_t)storage.GetCount() - 1, last);
+        storage.Remove(7);
+        lighting::LightDesc moved;
+        storage.Get(7, moved);
+        ok = ok && storage.GetCount() == lights.size() - 1 && !memcmp(&moved, &last, sizeof(moved));
+        while (storage.GetCount() > lights.size() / 2) {
+            storage.Remove((uint32_t)(storage.GetCount() * 2 / 3));
+        }
+
+        storage.Pack(ranges);
+        lighting::LightDesc changed = lights[0];
+        changed.orbitRadius = 0.0f;
+        changed.flicker = 0.0f;
+        changed.intensity = 1000.0f;
+        uint32_t index = (uint32_t)(storage.GetCount() / 2);
+        storage.Set(index, changed);
+        storage.Pack(ranges);
+        // Без Animate меняется только блок измененного источника.
+        ok = ok && ranges.size() == 1 && ranges[0].first <= index && index < ranges[0].first + ranges[0].count &&
+            ranges[0].count <= lighting::LightStorage::dirtyBlock;
+
+        storage.SetCutoff(0.1f);
+        storage.Animate(2.0f);
+        storage.Pack(ranges);
+        double error = MaxError(storage, 2.0f);
+        printf("Edits: %zu lights left, error after remove/set/cutoff %.2e\n", storage.GetCount(), error);
+        return ok && error < 1e-4;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t lightCount = 100000;
+    float animated = 1.0f;
+    unsigned frames = 50;
+    unsigned threads = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--lights") && i + 1 < argc) {
+            lightCount = (size_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--animated") && i + 1 < argc) {
+            animated = (float)atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = (unsigned)atoi(argv[++i]);
+        } else {
+            printf("lightstorage [--lights <n>] [--animated <fraction>] [--threads <n>] [--frames <n>]\n");
+            return 1;
+        }
+    }
+    threads = std::max(threads, 1u);
+    frames = std::max(frames, 1u);
+    lightCount = std::max<size_t>(lightCount, 16);
+
+    std::vector<lighting::LightDesc> lights;
+    MakeLights(lightCount, animated, lights);
+    lighting::LightStorage storage;
+    for (const lighting::LightDesc& light : lights) {
+        storage.Add(light);
+    }
+    std::vector<lighting::LightRange> ranges;
+    storage.Pack(ranges);
+
+    printf("%zu lights, %.0f%% animated\n", lightCount, animated * 100.0f);
+    double aos = MeasureAos(lights, frames);
+    printf("AoS scalar:  %.3f ms best (%.1f ns/light)\n", aos * 1e3, aos * 1e9 / lightCount);
+    for (unsigned n = 1; n <= threads; n = n < threads ? std::min(n * 2, threads) : n + 1) {
+        std::unique_ptr<ThreadPool> pool(n > 1 ? new ThreadPool(n - 1) : nullptr);
+        double bestAnimate = 1e30, bestPack = 1e30, bestFrame = 1e30;
+        size_t uploaded = 0;
+        for (unsigned f = 0; f < frames; f++) {
+            float time = f / 60.0f;
+            auto start = std::chrono::steady_clock::now();
+            storage.Animate(time, pool.get());
+            auto animatedTime = std::chrono::steady_clock::now();
+            storage.Pack(ranges, pool.get());
+            auto end = std::chrono::steady_clock::now();
+            bestAnimate = std::min(bestAnimate, std::chrono::duration<double>(animatedTime - start).count());
+            bestPack = std::min(bestPack, std::chrono::duration<double>(end - animatedTime).count());
+            bestFrame = std::min(bestFrame, std::chrono::duration<double>(end - start).count());
+            uploaded = RangeLights(ranges);
+        }
+        printf("threads %2u: %.3f ms best (animate %.3f, pack %.3f; %.1f ns/light), %zu ranges, %.1f MB uploaded, %.1fx vs AoS\n",
+            n, bestFrame * 1e3, bestAnimate * 1e3, bestPack * 1e3, bestFrame * 1e9 / lightCount, ranges.size(),
+            uploaded * lighting::LightStorage::packedFloats * 4 / 1048576.0, aos / bestFrame);
+    }
+
+    double error = MaxError(storage, (frames - 1) / 60.0f);
+    bool ok = error < 1e-4;
+    printf("Max error vs double reference %.2e\n", error);
+    ok = CheckEdits(lights) && ok;
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
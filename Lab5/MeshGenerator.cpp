@@ -0,0 +1,402 @@
+﻿#include "MeshGenerator.h"
+#include "ConstexprMesh.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MESH_GENERATOR_SSE
+#endif
+
+namespace {
+    const float pi = 3.14159265358979323846f;
+
+    // out[i] = table[i] * scale + offset. Все вершины генераторов выражаются через этот шаг по таблицам
+    // синусов и косинусов, поэтому тригонометрия считается только на строку и столбец сетки.
+    void MulAdd(const float* table, float scale, float offset, float* out, size_t count) {
+        size_t i = 0;
+#ifdef MESH_GENERATOR_SSE
+        __m128 s = _mm_set1_ps(scale);
+        __m128 o = _mm_set1_ps(offset);
+        for (; i + 4 <= count; i += 4) {
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(table + i), s), o));
+        }
+#endif
+        for (; i < count; i++) {
+            out[i] = table[i] * scale + offset;
+        }
+    }
+
+    void Fill(float value, float* out, size_t count) {
+        std::fill(out, out + count, value);
+    }
+
+    void SinCosTable(unsigned count, float step, float start, std::vector<float>& sinTable, std::vector<float>& cosTable) {
+        sinTable.resize(count);
+        cosTable.resize(count);
+        for (unsigned i = 0; i < count; i++) {
+            float angle = start + i * step;
+            sinTable[i] = std::sin(angle);
+            cosTable[i] = std::cos(angle);
+        }
+    }
+
+    void Ramp(unsigned count, float step, float start, std::vector<float>& table) {
+        table.resize(count);
+        for (unsigned i = 0; i < count; i++) {
+            table[i] = start + i * step;
+        }
+    }
+
+    void SetVertex(mesh::MeshData& mesh, size_t index, float x, float y, float z, float nx, float ny, float nz,
+                   float u, float v) {
+        mesh.position.x[index] = x;
+        mesh.position.y[index] = y;
+        mesh.position.z[index] = z;
+        mesh.normal.x[index] = nx;
+        mesh.normal.y[index] = ny;
+        mesh.normal.z[index] = nz;
+        mesh.u[index] = u;
+        mesh.v[index] = v;
+    }
+
+    void Triangle(uint32_t*& out, uint32_t a, uint32_t b, uint32_t c) {
+        out[0] = a;
+        out[1] = b;
+        out[2] = c;
+        out += 3;
+    }
+
+    // Четырехугольник сетки: a - (row, col), b - (row, col + 1), c - (row + 1, col), d - (row + 1, col + 1).
+    // Если (b - a) x (c - a) смотрит наружу, грани получаются внешними.
+    void Quad(uint32_t*& out, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+        Triangle(out, a, b, c);
+        Triangle(out, c, b, d);
+    }
+}
+
+namespace mesh {
+    VertexLayout VertexLayout::Make(unsigned attributes) {
+        VertexLayout layout;
+        layout.attributes = attributes;
+        if (attributes & Position) {
+            layout.positionOffset = layout.stride;
+            layout.stride += 3 * sizeof(float);
+        }
+        if (attributes & Normal) {
+            layout.normalOffset = layout.stride;
+            layout.stride += 3 * sizeof(float);
+        }
+        if (attributes & TexCoord) {
+            layout.texCoordOffset = layout.stride;
+            layout.stride += 2 * sizeof(float);
+        }
+        if (attributes & Tangent) {
+            layout.tangentOffset = layout.stride;
+            layout.stride += 4 * sizeof(float);
+        }
+        return layout;
+    }
+
+    void MeshData::Resize(size_t vertexCount, size_t indexCount) {
+        position.Resize(vertexCount);
+        normal.Resize(vertexCount);
+        u.resize(vertexCount);
+        v.resize(vertexCount);
+        tangent.clear();
+        indices.resize(indexCount);
+    }
+
+    void UVSphere(unsigned latLines, unsigned longLines, MeshData& mesh) {
+        latLines = std::max(latLines, 3u);
+        longLines = std::max(longLines, 3u);
+
+        unsigned rings = latLines - 2;
+        size_t numVertices = UVSphereVertexCount(latLines, longLines);
+        size_t numIndices = UVSphereIndexCount(latLines, longLines);
+        mesh.Resize(numVertices, numIndices);
+
+        std::vector<float> sinPhi, cosPhi, ramp;
+        SinCosTable(longLines, 2.0f * pi / longLines, 0.0f, sinPhi, cosPhi);
+        Ramp(longLines, 1.0f / longLines, 0.0f, ramp);
+
+        SetVertex(mesh, 0, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.5f, 0.0f);
+        for (unsigned i = 0; i < rings; i++) {
+            float theta = (i + 1) * (pi / (latLines - 1));
+            float sinTheta = std::sin(theta);
+            float cosTheta = std::cos(theta);
+            size_t base = (size_t)i * longLines + 1;
+
+            // Точка (0, 0, 1), повернутая на theta вокруг X и на phi вокруг Z.
+            MulAdd(sinPhi.data(), sinTheta, 0.0f, &mesh.position.x[base], longLines);
+            MulAdd(cosPhi.data(), -sinTheta, 0.0f, &mesh.position.y[base], longLines);
+            Fill(cosTheta, &mesh.position.z[base], longLines);
+            Fill(theta / pi, &mesh.v[base], longLines);
+        }
+        SetVertex(mesh, numVertices - 1, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f, -1.0f, 0.5f, 1.0f);
+
+        for (unsigned i = 0; i < rings; i++) {
+            std::copy(ramp.begin(), ramp.end(), mesh.u.begin() + (size_t)i * longLines + 1);
+        }
+        // Для единичной сферы нормаль совпадает с позицией.
+        mesh.normal = mesh.position;
+
+        uint32_t* out = mesh.indices.data();
+        uint32_t last = (uint32_t)numVertices - 1;
+        for (uint32_t j = 0; j < longLines; j++) {
+            Triangle(out, j + 1, (j + 1) % longLines + 1, 0);
+        }
+        for (uint32_t i = 0; i < rings - 1; i++) {
+            for (uint32_t j = 0; j < longLines; j++) {
+                uint32_t next = (j + 1) % longLines;
+                uint32_t a = i * longLines + j + 1;
+                uint32_t b = i * longLines + next + 1;
+                uint32_t c = (i + 1) * longLines + j + 1;
+                uint32_t d = (i + 1) * longLines + next + 1;
+                Triangle(out, c, b, a);
+                Triangle(out, d, b, c);
+            }
+        }
+        uint32_t lastRing = (rings - 1) * longLines + 1;
+        for (uint32_t j = longLines; j-- > 0;) {
+            Triangle(out, lastRing + j, lastRing + (j + longLines - 1) % longLines, last);
+        }
+    }
+
+    void Icosphere(unsigned subdivisions, MeshData& mesh) {
+        const float t = (1.0f + std::sqrt(5.0f)) * 0.5f;
+        std::vector<float> positions = {
+            -1, t, 0,  1, t, 0,  -1, -t, 0,  1, -t, 0,
+            0, -1, t,  0, 1, t,  0, -1, -t,  0, 1, -t,
+            t, 0, -1,  t, 0, 1,  -t, 0, -1,  -t, 0, 1
+        };
+        std::vector<uint32_t> faces = {
+            0, 11, 5,  0, 5, 1,  0, 1, 7,  0, 7, 10,  0, 10, 11,
+            1, 5, 9,  5, 11, 4,  11, 10, 2,  10, 7, 6,  7, 1, 8,
+            3, 9, 4,  3, 4, 2,  3, 2, 6,  3, 6, 8,  3, 8, 9,
+            4, 9, 5,  2, 4, 11,  6, 2, 10,  8, 6, 7,  9, 8, 1
+        };
+
+        auto normalize = [&positions](uint32_t index) {
+            float* p = &positions[index * 3];
+            float length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+            p[0] /= length;
+            p[1] /= length;
+            p[2] /= length;
+        };
+        for (uint32_t i = 0; i < 12; i++) {
+            normalize(i);
+        }
+
+        // Обход исходных граней приводится к внешнему, подразбиение его сохраняет.
+        for (size_t f = 0; f < faces.size(); f += 3) {
+            const float* a = &positions[faces[f] * 3];
+            const float* b = &positions[faces[f + 1] * 3];
+            const float* c = &positions[faces[f + 2] * 3];
+            float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            if (n[0] * a[0] + n[1] * a[1] + n[2] * a[2] < 0.0f)
+                std::swap(faces[f + 1], faces[f + 2]);
+        }
+
+        // Ребро e соединяет вершины edges[e * 2] и edges[e * 2 + 1], сторона k грани f (от вершины k к k + 1) -
+        // ребро faceEdges[f * 3 + k]. При подразбиении середина ребра e получает индекс vertexCount + e, его половины
+        // становятся ребрами 2e (от первого конца) и 2e + 1, а три внутренних ребра грани f - ребрами 2E + 3f + k,
+        // поэтому середины не ищутся ни в какой таблице.
+        std::vector<uint32_t> edges, faceEdges(faces.size());
+        for (size_t side = 0; side < faces.size(); side++) {
+            uint32_t a = faces[side], b = faces[side - side % 3 + (side % 3 + 1) % 3];
+            size_t e = 0;
+            while (e < edges.size() && !(edges[e] == b && edges[e + 1] == a) && !(edges[e] == a && edges[e + 1] == b)) {
+                e += 2;
+            }
+            if (e == edges.size()) {
+                edges.push_back(a);
+                edges.push_back(b);
+            }
+            faceEdges[side] = (uint32_t)(e / 2);
+        }
+
+        std::vector<uint32_t> subdividedFaces, subdividedEdges, subdividedFaceEdges;
+        positions.reserve(((size_t(10) << (2 * subdivisions)) + 2) * 3);
+        for (unsigned s = 0; s < subdivisions; s++) {
+            uint32_t vertexCount = (uint32_t)(positions.size() / 3);
+            uint32_t edgeCount = (uint32_t)(edges.size() / 2);
+            uint32_t faceCount = (uint32_t)(faces.size() / 3);
+            // На последнем уровне ребра для следующего подразбиения не нужны.
+            bool last = s + 1 == subdivisions;
+            positions.resize((size_t)(vertexCount + edgeCount) * 3);
+            subdividedEdges.resize(last ? 0 : ((size_t)edgeCount * 2 + faceCount * 3) * 2);
+            for (uint32_t e = 0; e < edgeCount; e++) {
+                uint32_t a = edges[e * 2], b = edges[e * 2 + 1], m = vertexCount + e;
+                for (int k = 0; k < 3; k++) {
+                    positions[m * 3 + k] = (positions[a * 3 + k] + positions[b * 3 + k]) * 0.5f;
+                }
+                normalize(m);
+                if (!last) {
+                    uint32_t halves[] = { a, m, m, b };
+                    memcpy(&subdividedEdges[e * 4], halves, sizeof(halves));
+                }
+            }
+
+            subdividedFaces.resize(faces.size() * 4);
+            subdividedFaceEdges.resize(last ? 0 : faces.size() * 4);
+            auto half = [&edges](uint32_t e, uint32_t v) {
+                return edges[e * 2] == v ? e * 2 : e * 2 + 1;
+            };
+            for (uint32_t f = 0; f < faceCount; f++) {
+                uint32_t a = faces[f * 3], b = faces[f * 3 + 1], c = faces[f * 3 + 2];
+                uint32_t eab = faceEdges[f * 3], ebc = faceEdges[f * 3 + 1], eca = faceEdges[f * 3 + 2];
+                uint32_t ab = vertexCount + eab, bc = vertexCount + ebc, ca = vertexCount + eca;
+                uint32_t children[] = { a, ab, ca,  b, bc, ab,  c, ca, bc,  ab, bc, ca };
+                memcpy(&subdividedFaces[f * 12], children, sizeof(children));
+                if (!last) {
+                    uint32_t inner = edgeCount * 2 + f * 3;
+                    uint32_t innerEdges[] = { ab, ca,  bc, ab,  ca, bc };
+                    uint32_t childEdges[] = { half(eab, a), inner, half(eca, a),  half(ebc, b), inner + 1, half(eab, b),
+                        half(eca, c), inner + 2, half(ebc, c),  inner + 1, inner + 2, inner };
+                    memcpy(&subdividedEdges[inner * 2], innerEdges, sizeof(innerEdges));
+                    memcpy(&subdividedFaceEdges[f * 12], childEdges, sizeof(childEdges));
+                }
+            }
+            faces.swap(subdividedFaces);
+            edges.swap(subdividedEdges);
+            faceEdges.swap(subdividedFaceEdges);
+        }
+
+        size_t numVertices = positions.size() / 3;
+        mesh.Resize(numVertices, 0);
+        for (size_t i = 0; i < numVertices; i++) {
+            float x = positions[i * 3], y = positions[i * 3 + 1], z = positions[i * 3 + 2];
+            SetVertex(mesh, i, x, y, z, x, y, z, 0.5f + std::atan2(z, x) / (2.0f * pi),
+                std::acos(std::max(-1.0f, std::min(1.0f, y))) / pi);
+        }
+        mesh.indices.swap(faces);
+    }
+
+    void Cube(float halfSize, MeshData& mesh) {
+        mesh.Resize(24, 36);
+        uint32_t* out = mesh.indices.data();
+        for (uint32_t f = 0; f < 6; f++) {
+            const float* n = cubeFaceAxes[f][0];
+            const float* u = cubeFaceAxes[f][1];
+            const float* v = cubeFaceAxes[f][2];
+            for (uint32_t c = 0; c < 4; c++) {
+                float p[3];
+                for (int k = 0; k < 3; k++) {
+                    p[k] = (n[k] + cubeCorners[c][0] * u[k] + cubeCorners[c][1] * v[k]) * halfSize;
+                }
+                SetVertex(mesh, f * 4 + c, p[0], p[1], p[2], n[0], n[1], n[2],
+                    (cubeCorners[c][0] + 1) * 0.5f, (cubeCorners[c][1] + 1) * 0.5f);
+            }
+            Triangle(out, f * 4, f * 4 + 1, f * 4 + 2);
+            Triangle(out, f * 4, f * 4 + 2, f * 4 + 3);
+        }
+    }
+
+    void Plane(unsigned xSegments, unsigned zSegments, float size, MeshData& mesh) {
+        xSegments = std::max(xSegments, 1u);
+        zSegments = std::max(zSegments, 1u);
+
+        unsigned columns = xSegments + 1;
+        mesh.Resize((size_t)columns * (zSegments + 1), (size_t)xSegments * zSegments * 6);
+
+        std::vector<float> ramp;
+        Ramp(columns, 1.0f / xSegments, 0.0f, ramp);
+        for (unsigned row = 0; row <= zSegments; row++) {
+            size_t base = (size_t)row * columns;
+            float v = row / (float)zSegments;
+            MulAdd(ramp.data(), size, -0.5f * size, &mesh.position.x[base], columns);
+            Fill(0.0f, &mesh.position.y[base], columns);
+            Fill((v - 0.5f) * size, &mesh.position.z[base], columns);
+            Fill(0.0f, &mesh.normal.x[base], columns);
+            Fill(1.0f, &mesh.normal.y[base], columns);
+            Fill(0.0f, &mesh.normal.z[base], columns);
+            std::copy(ramp.begin(), ramp.end(), mesh.u.begin() + base);
+            Fill(v, &mesh.v[base], columns);
+        }
+
+        // По строкам сетки растет z, поэтому внешний обход получается при обмене соседей по x и z.
+        uint32_t* out = mesh.indices.data();
+        for (uint32_t row = 0; row < zSegments; row++) {
+            for (uint32_t col = 0; col < xSegments; col++) {
+                uint32_t a = row * columns + col;
+                Quad(out, a, a + columns, a + 1, a + columns + 1);
+            }
+        }
+    }
+
+    void Torus(float majorRadius, float minorRadius, unsigned majorSegments, unsigned minorSegments, MeshData& mesh) {
+        majorSegments = std::max(majorSegments, 3u);
+        minorSegments = std::max(minorSegments, 3u);
+
+        // Шов дублируется, чтобы текстурные координаты не заворачивались.
+        unsigned columns = minorSegments + 1;
+        mesh.Resize((size_t)(majorSegments + 1) * columns, (size_t)majorSegments * minorSegments * 6);
+
+        std::vector<float> sinV, cosV, ramp;
+        SinCosTable(columns, 2.0f * pi / minorSegments, 0.0f, sinV, cosV);
+        Ramp(columns, 1.0f / minorSegments, 0.0f, ramp);
+
+        for (unsigned row = 0; row <= majorSegments; row++) {
+            float angle = row * 2.0f * pi / majorSegments;
+            float sinU = std::sin(angle);
+            float cosU = std::cos(angle);
+            size_t base = (size_t)row * columns;
+
+            MulAdd(cosV.data(), minorRadius * cosU, majorRadius * cosU, &mesh.position.x[base], columns);
+            MulAdd(sinV.data(), minorRadius, 0.0f, &mesh.position.y[base], columns);
+            MulAdd(cosV.data(), minorRadius * sinU, majorRadius * sinU, &mesh.position.z[base], columns);
+            MulAdd(cosV.data(), cosU, 0.0f, &mesh.normal.x[base], columns);
+            std::copy(sinV.begin(), sinV.end(), mesh.normal.y.begin() + base);
+            MulAdd(cosV.data(), sinU, 0.0f, &mesh.normal.z[base], columns);
+            Fill(row / (float)majorSegments, &mesh.u[base], columns);
+            std::copy(ramp.begin(), ramp.end(), mesh.v.begin() + base);
+        }
+
+        uint32_t* out = mesh.indices.data();
+        for (uint32_t row = 0; row < majorSegments; row++) {
+            for (uint32_t col = 0; col < minorSegments; col++) {
+                uint32_t a = row * columns + col;
+                Quad(out, a, a + 1, a + columns, a + columns + 1);
+            }
+        }
+    }
+
+    void WriteVertices(const MeshData& mesh, const VertexLayout& layout, void* dst) {
+        uint8_t* out = static_cast<uint8_t*>(dst);
+        size_t count = mesh.GetVertexCount();
+        for (size_t i = 0; i < count; i++, out += layout.stride) {
+            if (layout.attributes & Position) {
+                float p[3] = { mesh.position.x[i], mesh.position.y[i], mesh.position.z[i] };
+                memcpy(out + layout.positionOffset, p, sizeof(p));
+            }
+            if (layout.attributes & Normal) {
+                float n[3] = { mesh.normal.x[i], mesh.normal.y[i], mesh.normal.z[i] };
+                memcpy(out + layout.normalOffset, n, sizeof(n));
+            }
+            if (layout.attributes & TexCoord) {
+                float t[2] = { mesh.u[i], mesh.v[i] };
+                memcpy(out + layout.texCoordOffset, t, sizeof(t));
+            }
+            if ((layout.attributes & Tangent) && !mesh.tangent.empty()) {
+                memcpy(out + layout.tangentOffset, &mesh.tangent[i * 4], 4 * sizeof(float));
+            }
+        }
+    }
+
+    void WriteIndices(const MeshData& mesh, Winding winding, uint32_t* dst) {
+        size_t count = mesh.indices.size();
+        if (winding == Winding::Outward) {
+            memcpy(dst, mesh.indices.data(), count * sizeof(uint32_t));
+            return;
+        }
+        for (size_t i = 0; i + 2 < count; i += 3) {
+            dst[i] = mesh.indices[i];
+            dst[i + 1] = mesh.indices[i + 2];
+            dst[i + 2] = mesh.indices[i + 1];
+        }
+    }
+}
@@ -0,0 +1,88 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+
+// Генерация параметрических мешей. Атрибуты хранятся раздельными массивами (SoA), что позволяет считать
+// вершины по замкнутым формулам сразу по четыре, а в нужный формат вершин они переупаковываются при записи.
+// Все меши строятся с внешними гранями: для треугольника (a, b, c) вектор (b - a) x (c - a) смотрит наружу.
+namespace mesh {
+    enum Attribute : unsigned {
+        Position = 1,
+        Normal = 2,
+        TexCoord = 4,
+        Tangent = 8     // float4: xyz + знак битангенса, заполняется GenerateTangents
+    };
+
+    // Обход индексов: Outward - грани видны снаружи, Inward - изнутри (скайбокс).
+    enum class Winding {
+        Outward,
+        Inward
+    };
+
+    // Расположение атрибутов в вершине. Атрибуты идут в порядке Position, Normal, TexCoord, Tangent.
+    struct VertexLayout {
+        unsigned attributes = 0;
+        unsigned stride = 0;
+        unsigned positionOffset = 0;
+        unsigned normalOffset = 0;
+        unsigned texCoordOffset = 0;
+        unsigned tangentOffset = 0;
+
+        static VertexLayout Make(unsigned attributes);
+    };
+
+    struct Stream3 {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> z;
+
+        void Resize(size_t count) {
+            x.resize(count);
+            y.resize(count);
+            z.resize(count);
+        };
+    };
+
+    struct MeshData {
+        Stream3 position;
+        Stream3 normal;
+        std::vector<float> u;
+        std::vector<float> v;
+        std::vector<float> tangent;     // 4 float на вершину, пуст, пока касательные не вычислены
+        std::vector<uint32_t> indices;
+
+        size_t GetVertexCount() const {
+            return position.x.size();
+        };
+
+        void Resize(size_t vertexCount, size_t indexCount);
+    };
+
+    // Размеры UVSphere; тесселяция меньше 3 увеличивается до 3.
+    constexpr size_t UVSphereVertexCount(unsigned latLines, unsigned longLines) {
+        return (size_t)((latLines < 3 ? 3 : latLines) - 2) * (longLines < 3 ? 3 : longLines) + 2;
+    }
+
+    constexpr size_t UVSphereIndexCount(unsigned latLines, unsigned longLines) {
+        return ((size_t)((latLines < 3 ? 3 : latLines) - 2) * (longLines < 3 ? 3 : longLines) * 2) * 3;
+    }
+
+    // Сфера радиуса 1 с полюсами на оси Z, топология совпадает с исходной сферой лабораторной.
+    void UVSphere(unsigned latLines, unsigned longLines, MeshData& mesh);
+    // Сфера радиуса 1 из подразбитого икосаэдра.
+    void Icosphere(unsigned subdivisions, MeshData& mesh);
+    // Куб [-halfSize, halfSize]^3 с отдельными вершинами на каждой грани.
+    void Cube(float halfSize, MeshData& mesh);
+    // Плоскость в XZ размером size x size с нормалью +Y.
+    void Plane(unsigned xSegments, unsigned zSegments, float size, MeshData& mesh);
+    // Тор вокруг оси Y.
+    void Torus(float majorRadius, float minorRadius, unsigned majorSegments, unsigned minorSegments, MeshData& mesh);
+
+    // Записывает вершины в dst (GetVertexCount() * layout.stride байт).
+    void WriteVertices(const MeshData& mesh, const VertexLayout& layout, void* dst);
+    // Записывает индексы в dst (indices.size() элементов), при Inward меняет обход треугольников.
+    void WriteIndices(const MeshData& mesh, Winding winding, uint32_t* dst);
+}
@@ -0,0 +1,298 @@
+﻿// Замер и проверка MeshGenerator, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 MeshGeneratorBenchMain.cpp MeshGenerator.cpp -o meshgen
+// Примеры:
+//   ./meshgen
+//   ./meshgen --tessellation 3000
+// Проверки: UVSphere 40x40 совпадает с прежней сферой Renderer::LoadGeometry (порядок индексов сферы, треугольники
+// скайбокса с точностью до поворота, позиции по формуле с поворотами), встроенная сфера Renderer из ConstexprMesh
+// совпадает с ней до 1e-5; у всех генераторов грани смотрят наружу
+// (вдоль нормалей), Inward разворачивает их; икосфера каждого уровня замкнута и не дублирует середины ребер;
+// WriteVertices раскладывает атрибуты по VertexLayout. Замер - генерация
+// мешей на миллионы вершин и переупаковка в позицию + нормаль.
+#include "MeshGenerator.h"
+#include "ConstexprMesh.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+namespace {
+    double Milliseconds(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Индексы сферы и скайбокса в том виде, в каком их строил Renderer::LoadGeometry.
+    void LegacyIndices(unsigned latLines, unsigned longLines, std::vector<uint32_t>& sphere, std::vector<uint32_t>& skybox) {
+        unsigned numVertices = ((latLines - 2) * longLines) + 2;
+        unsigned numIndices = (((latLines - 3) * longLines * 2) + (longLines * 2)) * 3;
+        sphere.assign(numIndices, 0);
+        skybox.assign(numIndices, 0);
+        unsigned k = 0;
+        for (unsigned i = 0; i < longLines - 1; i++) {
+            skybox[k] = 0;
+            skybox[k + 2] = i + 1;
+            skybox[k + 1] = i + 2;
+            sphere[k] = i + 1;
+            sphere[k + 2] = 0;
+            sphere[k + 1] = i + 2;
+            k += 3;
+        }
+        skybox[k] = 0;
+        skybox[k + 2] = longLines;
+        skybox[k + 1] = 1;
+        sphere[k] = longLines;
+        sphere[k + 2] = 0;
+        sphere[k + 1] = 1;
+        k += 3;
+        for (unsigned i = 0; i < latLines - 3; i++) {
+            for (unsigned j = 0; j < longLines - 1; j++) {
+                skybox[k] = i * longLines + j + 1;
+                skybox[k + 1] = i * longLines + j + 2;
+                skybox[k + 2] = (i + 1) * longLines + j + 1;
+                skybox[k + 3] = (i + 1) * longLines + j + 1;
+                skybox[k + 4] = i * longLines + j + 2;
+                skybox[k + 5] = (i + 1) * longLines + j + 2;
+                sphere[k + 2] = i * longLines + j + 1;
+                sphere[k + 1] = i * longLines + j + 2;
+                sphere[k] = (i + 1) * longLines + j + 1;
+                sphere[k + 5] = (i + 1) * longLines + j + 1;
+                sphere[k + 4] = i * longLines + j + 2;
+                sphere[k + 3] = (i + 1) * longLines + j + 2;
+                k += 6;
+            }
+            skybox[k] = (i * longLines) + longLines;
+            skybox[k + 1] = (i * longLines) + 1;
+            skybox[k + 2] = ((i + 1) * longLines) + longLines;
+            skybox[k + 3] = ((i + 1) * longLines) + longLines;
+            skybox[k + 4] = (i * longLines) + 1;
+            skybox[k + 5] = ((i + 1) * longLines) + 1;
+            sphere[k + 2] = (i * longLines) + longLines;
+            sphere[k + 1] = (i * longLines) + 1;
+            sphere[k] = ((i + 1) * longLines) + longLines;
+            sphere[k + 5] = ((i + 1) * longLines) + longLines;
+            sphere[k + 4] = (i * longLines) + 1;
+            sphere[k + 3] = ((i + 1) * longLines) + 1;
+            k += 6;
+        }
+        for (unsigned i = 0; i < longLines - 1; i++) {
+            skybox[k] = numVertices - 1;
+            skybox[k + 2] = (numVertices - 1) - (i + 1);
+            skybox[k + 1] = (numVertices - 1) - (i + 2);
+            sphere[k + 2] = numVertices - 1;
+            sphere[k] = (numVertices - 1) - (i + 1);
+            sphere[k + 1] = (numVertices - 1) - (i + 2);
+            k += 3;
+        }
+        skybox[k] = numVertices - 1;
+        skybox[k + 2] = (numVertices - 1) - longLines;
+        skybox[k + 1] = numVertices - 2;
+        sphere[k + 2] = numVertices - 1;
+        sphere[k] = (numVertices - 1) - longLines;
+        sphere[k + 1] = numVertices - 2;
+    }
+
+    bool SameRotation(const uint32_t* a, const uint32_t* b) {
+        for (int r = 0; r < 3; r++) {
+            if (a[0] == b[r] && a[1] == b[(r + 1) % 3] && a[2] == b[(r + 2) % 3])
+                return true;
+        }
+        return false;
+    }
+
+    bool CheckLegacySphere() {
+        const unsigned latLines = 40, longLines = 40;
+        std::vector<uint32_t> legacySphere, legacySkybox;
+        LegacyIndices(latLines, longLines, legacySphere, legacySkybox);
+
+        mesh::MeshData sphere;
+        mesh::UVSphere(latLines, longLines, sphere);
+        std::vector<uint32_t> outward(sphere.indices.size()), inward(sphere.indices.size());
+        mesh::WriteIndices(sphere, mesh::Winding::Outward, outward.data());
+        mesh::WriteIndices(sphere, mesh::Winding::Inward, inward.data());
+        bool sizes = outward.size() == legacySphere.size() && outward.size() == mesh::UVSphereIndexCount(latLines, longLines) &&
+            sphere.GetVertexCount() == mesh::UVSphereVertexCount(latLines, longLines);
+        bool exact = sizes && outward == legacySphere;
+        size_t skyboxMismatches = 0;
+        for (size_t t = 0; sizes && t < outward.size() / 3; t++) {
+            skyboxMismatches += !SameRotation(&inward[t * 3], &legacySkybox[t * 3]);
+        }
+
+        // Прежняя вершина: (0, 0, 1), повернутая на theta вокруг X и на phi вокруг Z.
+        const float pi = 3.14159265f;
+        float maxError = 0.0f;
+        for (unsigned i = 0; i < latLines - 2; i++) {
+            float theta = (i + 1) * (pi / (latLines - 1));
+            for (unsigned j = 0; j < longLines; j++) {
+                float phi = j * (2.0f * pi / longLines);
+                size_t v = i * longLines + j + 1;
+                float x = std::sin(theta) * std::sin(phi), y = -std::sin(theta) * std::cos(phi), z = std::cos(theta);
+                maxError = std::fmax(maxError, std::fabs(x - sphere.position.x[v]) + std::fabs(y - sphere.position.y[v]) +
+                    std::fabs(z - sphere.position.z[v]));
+            }
+        }
+        bool ok = exact && skyboxMismatches == 0 && maxError < 1e-5f;
+        printf("UVSphere 40x40 vs Renderer::LoadGeometry: %zu indices, sphere order %s, %zu skybox triangles differ, "
+            "position error %.1e: %s\n", outward.size(), exact ? "same" : "DIFFERS", skyboxMismatches, maxError, ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    // Синус и косинус времени компиляции отличаются от библиотечных не больше чем на единицы последнего разряда.
+    bool CheckConstexprSphere() {
+        static constexpr auto builtin = mesh::MakeUVSphere<40, 40>();
+        mesh::MeshData sphere;
+        mesh::UVSphere(40, 40, sphere);
+        float difference = mesh::CompareWithMeshData(builtin, sphere);
+        bool ok = difference >= 0.0f && difference <= 1e-5f;
+        printf("MakeUVSphere<40, 40> vs UVSphere: max difference %.1e: %s\n", difference, ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    // Сколько треугольников повернуто против суммы нормалей их вершин.
+    size_t CountInverted(const mesh::MeshData& mesh, const uint32_t* indices) {
+        size_t inverted = 0;
+        for (size_t t = 0; t < mesh.indices.size() / 3; t++) {
+            uint32_t a = indices[t * 3], b = indices[t * 3 + 1], c = indices[t * 3 + 2];
+            float e1[3] = { mesh.position.x[b] - mesh.position.x[a], mesh.position.y[b] - mesh.position.y[a],
+                mesh.position.z[b] - mesh.position.z[a] };
+            float e2[3] = { mesh.position.x[c] - mesh.position.x[a], mesh.position.y[c] - mesh.position.y[a],
+                mesh.position.z[c] - mesh.position.z[a] };
+            float cross[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            float normal[3] = { mesh.normal.x[a] + mesh.normal.x[b] + mesh.normal.x[c],
+                mesh.normal.y[a] + mesh.normal.y[b] + mesh.normal.y[c], mesh.normal.z[a] + mesh.normal.z[b] + mesh.normal.z[c] };
+            inverted += cross[0] * normal[0] + cross[1] * normal[1] + cross[2] * normal[2] <= 0.0f;
+        }
+        return inverted;
+    }
+
+    bool CheckWinding(const char* name, const mesh::MeshData& mesh) {
+        std::vector<uint32_t> inward(mesh.indices.size());
+        mesh::WriteIndices(mesh, mesh::Winding::Inward, inward.data());
+        size_t outwardBad = CountInverted(mesh, mesh.indices.data());
+        size_t inwardGood = mesh.indices.size() / 3 - CountInverted(mesh, inward.data());
+        bool ok = outwardBad == 0 && inwardGood == 0 && !mesh.indices.empty();
+        printf("%-10s %6zu vertices %6zu triangles, %zu inverted, %zu not flipped by Inward: %s\n", name, mesh.GetVertexCount(),
+            mesh.indices.size() / 3, outwardBad, inwardGood, ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    // Каждый уровень икосферы - замкнутый меш: 10 * 4^s + 2 вершины на единичной сфере, каждое ребро пройдено
+    // по разу в обе стороны (середины ребер не дублируются).
+    bool CheckIcosphere(unsigned maxSubdivisions) {
+        bool ok = true;
+        for (unsigned s = 0; s <= maxSubdivisions; s++) {
+            mesh::MeshData sphere;
+            mesh::Icosphere(s, sphere);
+            std::vector<uint64_t> edges, reversed;
+            for (size_t i = 0; i < sphere.indices.size(); i++) {
+                uint64_t a = sphere.indices[i], b = sphere.indices[i - i % 3 + (i % 3 + 1) % 3];
+                edges.push_back(a << 32 | b);
+                reversed.push_back(b << 32 | a);
+            }
+            std::sort(edges.begin(), edges.end());
+            std::sort(reversed.begin(), reversed.end());
+            bool closed = std::adjacent_find(edges.begin(), edges.end()) == edges.end() && edges == reversed;
+            float maxError = 0.0f;
+            for (size_t i = 0; i < sphere.GetVertexCount(); i++) {
+                float x = sphere.position.x[i], y = sphere.position.y[i], z = sphere.position.z[i];
+                maxError = std::fmax(maxError, std::fabs(std::sqrt(x * x + y * y + z * z) - 1.0f));
+            }
+            bool levelOk = closed && maxError < 1e-5f && sphere.GetVertexCount() == (10ull << (2 * s)) + 2 &&
+                sphere.indices.size() == (60ull << (2 * s)) && CountInverted(sphere, sphere.indices.data()) == 0;
+            ok = ok && levelOk;
+            if (!levelOk || s == maxSubdivisions) {
+                printf("icosphere %u: %zu vertices %zu triangles, %s, radius error %.1e: %s\n", s, sphere.GetVertexCount(),
+                    sphere.indices.size() / 3, closed ? "closed" : "NOT closed", maxError, levelOk ? "ok" : "FAILED");
+            }
+        }
+        return ok;
+    }
+
+    bool CheckLayout() {
+        mesh::MeshData torus;
+        mesh::Torus(1.0f, 0.3f, 24, 12, torus);
+        bool ok = true;
+        for (unsigned attributes : { 0u | mesh::Position, mesh::Position | mesh::Normal, mesh::Position | mesh::TexCoord,
+                                     mesh::Position | mesh::Normal | mesh::TexCoord }) {
+            mesh::VertexLayout layout = mesh::VertexLayout::Make(attributes);
+            std::vector<uint8_t> vertices(torus.GetVertexCount() * layout.stride);
+            mesh::WriteVertices(torus, layout, vertices.data());
+            for (size_t i = 0; i < torus.GetVertexCount(); i++) {
+                const uint8_t* vertex = &vertices[i * layout.stride];
+                float value[3];
+                memcpy(value, vertex + layout.positionOffset, 12);
+                ok = ok && value[0] == torus.position.x[i] && value[1] == torus.position.y[i] && value[2] == torus.position.z[i];
+                if (attributes & mesh::Normal) {
+                    memcpy(value, vertex + layout.normalOffset, 12);
+                    ok = ok && value[0] == torus.normal.x[i] && value[1] == torus.normal.y[i] && value[2] == torus.normal.z[i];
+                }
+                if (attributes & mesh::TexCoord) {
+                    memcpy(value, vertex + layout.texCoordOffset, 8);
+                    ok = ok && value[0] == torus.u[i] && value[1] == torus.v[i];
+                }
+            }
+        }
+        printf("WriteVertices layouts: %s\n", ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    void Time(const char* name, const std::function<void(mesh::MeshData&)>& generate) {
+        mesh::MeshData mesh;
+        double generateMs = 1e30, writeMs = 1e30;
+        mesh::VertexLayout layout = mesh::VertexLayout::Make(mesh::Position | mesh::Normal);
+        std::vector<uint8_t> vertices;
+        for (int repeat = 0; repeat < 3; repeat++) {
+            auto start = std::chrono::steady_clock::now();
+            generate(mesh);
+            generateMs = std::fmin(generateMs, Milliseconds(start));
+            vertices.resize(mesh.GetVertexCount() * layout.stride);
+            start = std::chrono::steady_clock::now();
+            mesh::WriteVertices(mesh, layout, vertices.data());
+            writeMs = std::fmin(writeMs, Milliseconds(start));
+        }
+        printf("%-10s %9zu vertices: generate %.1f ms (%.1f Mvertices/s), position + normal %.1f ms\n", name,
+            mesh.GetVertexCount(), generateMs, mesh.GetVertexCount() / generateMs / 1e3, writeMs);
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned tessellation = 2000;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--tessellation") && i + 1 < argc) {
+            tessellation = (unsigned)atoi(argv[++i]);
+        } else {
+            printf("meshgen [--tessellation <n>]\n");
+            return 1;
+        }
+    }
+
+    bool ok = CheckLegacySphere();
+    ok = CheckConstexprSphere() && ok;
+    mesh::MeshData mesh;
+    mesh::UVSphere(40, 40, mesh);
+    ok = CheckWinding("uvsphere", mesh) && ok;
+    mesh::Icosphere(3, mesh);
+    ok = CheckWinding("icosphere", mesh) && ok;
+    ok = CheckIcosphere(6) && ok;
+    mesh::Cube(1.0f, mesh);
+    ok = CheckWinding("cube", mesh) && ok;
+    mesh::Plane(4, 3, 2.0f, mesh);
+    ok = CheckWinding("plane", mesh) && ok;
+    mesh::Torus(1.0f, 0.3f, 24, 12, mesh);
+    ok = CheckWinding("torus", mesh) && ok;
+    ok = CheckLayout() && ok;
+
+    // Икосфера растет в 4 раза на уровень: берется уровень, ближайший к tessellation^2 вершин.
+    unsigned subdivisions = 0;
+    while ((10ull << (2 * (subdivisions + 1))) + 2 <= (unsigned long long)tessellation * tessellation) {
+        subdivisions++;
+    }
+    Time("uvsphere", [=](mesh::MeshData& m) { mesh::UVSphere(tessellation + 2, tessellation, m); });
+    Time("icosphere", [=](mesh::MeshData& m) { mesh::Icosphere(subdivisions, m); });
+    Time("plane", [=](mesh::MeshData& m) { mesh::Plane(tessellation, tessellation, 1.0f, m); });
+    Time("torus", [=](mesh::MeshData& m) { mesh::Torus(1.0f, 0.3f, tessellation, tessellation, m); });
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,304 @@
+﻿#include "MeshOptimizer.h"
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+    uint64_t HashBytes(const uint8_t* data, size_t size) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ data[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    void ReadPosition(const uint8_t* vertices, size_t index, size_t stride, size_t offset, float* position) {
+        memcpy(position, vertices + index * stride + offset, 3 * sizeof(float));
+    }
+}
+
+namespace mesh {
+    CacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize) {
+        CacheStats stats;
+        if (indexCount < 3 || vertexCount == 0)
+            return stats;
+
+        // Вершина в кэше, если ее отметка не старше cacheSize последних промахов.
+        std::vector<size_t> timestamps(vertexCount, 0);
+        std::vector<bool> used(vertexCount, false);
+        size_t time = cacheSize + 1;
+        size_t unique = 0;
+        for (size_t i = 0; i < indexCount; i++) {
+            uint32_t v = indices[i];
+            if (!used[v]) {
+                used[v] = true;
+                unique++;
+            }
+            if (time - timestamps[v] > cacheSize) {
+                timestamps[v] = time++;
+                stats.transformed++;
+            }
+        }
+
+        stats.acmr = stats.transformed / (float)(indexCount / 3);
+        stats.atvr = stats.transformed / (float)unique;
+        return stats;
+    }
+
+    size_t Weld(const void* vertices, size_t vertexCount, size_t stride, std::vector<uint32_t>& remap) {
+        const uint8_t* data = static_cast<const uint8_t*>(vertices);
+        remap.resize(vertexCount);
+
+        size_t tableSize = 1;
+        while (tableSize < vertexCount * 2) {
+            tableSize <<= 1;
+        }
+        const uint32_t empty = ~0u;
+        std::vector<uint32_t> table(tableSize, empty);
+
+        size_t unique = 0;
+        for (size_t i = 0; i < vertexCount; i++) {
+            const uint8_t* vertex = data + i * stride;
+            size_t slot = HashBytes(vertex, stride) & (tableSize - 1);
+            // Открытая адресация с линейным пробированием, в таблице хранится номер первой такой вершины.
+            while (table[slot] != empty && memcmp(data + table[slot] * stride, vertex, stride) != 0) {
+                slot = (slot + 1) & (tableSize - 1);
+            }
+            if (table[slot] == empty) {
+                table[slot] = (uint32_t)i;
+                remap[i] = (uint32_t)unique++;
+            }
+            else {
+                remap[i] = remap[table[slot]];
+            }
+        }
+        return unique;
+    }
+
+    void RemapVertices(void* dst, const void* src, size_t vertexCount, size_t stride, const std::vector<uint32_t>& remap) {
+        uint8_t* out = static_cast<uint8_t*>(dst);
+        const uint8_t* in = static_cast<const uint8_t*>(src);
+        for (size_t i = 0; i < vertexCount; i++) {
+            if (remap[i] != ~0u)
+                memcpy(out + remap[i] * stride, in + i * stride, stride);
+        }
+    }
+
+    void RemapIndices(uint32_t* indices, size_t indexCount, const std::vector<uint32_t>& remap) {
+        for (size_t i = 0; i < indexCount; i++) {
+            indices[i] = remap[indices[i]];
+        }
+    }
+
+    void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize,
+                             std::vector<uint32_t>* clusters) {
+        size_t triangleCount = indexCount / 3;
+        if (clusters)
+            clusters->clear();
+        if (triangleCount == 0)
+            return;
+
+        // Смежность вершина -> треугольники в виде сжатых списков.
+        std::vector<uint32_t> live(vertexCount, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            live[indices[i]]++;
+        }
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++) {
+            offsets[v + 1] = offsets[v] + live[v];
+        }
+        std::vector<uint32_t> adjacency(triangleCount * 3);
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (int k = 0; k < 3; k++) {
+                adjacency[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+            }
+        }
+
+        std::vector<size_t> timestamps(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> deadEnd;
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> output;
+        output.reserve(triangleCount * 3);
+
+        size_t time = cacheSize + 1;
+        size_t cursor = 0;
+        int64_t fanning = indices[0];
+        bool jumped = true;
+
+        while (fanning >= 0) {
+            if (jumped && clusters)
+                clusters->push_back((uint32_t)(output.size() / 3));
+
+            candidates.clear();
+            for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; a++) {
+                uint32_t t = adjacency[a];
+                if (emitted[t])
+                    continue;
+                for (int k = 0; k < 3; k++) {
+                    uint32_t v = indices[t * 3 + k];
+                    output.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if (time - timestamps[v] > cacheSize)
+                        timestamps[v] = time++;
+                }
+                emitted[t] = true;
+            }
+
+            // Следующей берется вершина-кандидат, которая останется в кэше после обработки всех ее треугольников.
+            int64_t next = -1;
+            int64_t bestPriority = -1;
+            for (uint32_t v : candidates) {
+                if (live[v] == 0)
+                    continue;
+                int64_t priority = 0;
+                if (time - timestamps[v] + 2 * live[v] <= cacheSize)
+                    priority = time - timestamps[v];
+                if (priority > bestPriority) {
+                    bestPriority = priority;
+                    next = v;
+                }
+            }
+
+            jumped = next < 0;
+            if (jumped) {
+                while (!deadEnd.empty()) {
+                    uint32_t v = deadEnd.back();
+                    deadEnd.pop_back();
+                    if (live[v] > 0) {
+                        next = v;
+                        break;
+                    }
+                }
+                while (next < 0 && cursor < vertexCount) {
+                    if (live[cursor] > 0)
+                        next = (int64_t)cursor;
+                    cursor++;
+                }
+            }
+            fanning = next;
+        }
+
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const void* vertices, size_t vertexCount, size_t stride,
+                          size_t positionOffset, const std::vector<uint32_t>& clusters) {
+        const uint8_t* data = static_cast<const uint8_t*>(vertices);
+        size_t triangleCount = indexCount / 3;
+        if (clusters.size() < 2 || vertexCount == 0)
+            return;
+
+        float center[3] = { 0.0f, 0.0f, 0.0f };
+        for (size_t v = 0; v < vertexCount; v++) {
+            float p[3];
+            ReadPosition(data, v, stride, positionOffset, p);
+            for (int k = 0; k < 3; k++) {
+                center[k] += p[k];
+            }
+        }
+        for (int k = 0; k < 3; k++) {
+            center[k] /= vertexCount;
+        }
+
+        struct Cluster {
+            uint32_t begin;
+            uint32_t end;
+            float sortKey;
+        };
+        std::vector<Cluster> sorted(clusters.size());
+
+        // Ключ - проекция центра кластера на его средневзвешенную нормаль относительно центра меша: кластеры
+        // на внешней стороне выпуклых частей перекрывают остальные и рисуются первыми.
+        for (size_t c = 0; c < clusters.size(); c++) {
+            Cluster& cluster = sorted[c];
+            cluster.begin = clusters[c];
+            cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : (uint32_t)triangleCount;
+
+            float centroid[3] = { 0.0f, 0.0f, 0.0f };
+            float normal[3] = { 0.0f, 0.0f, 0.0f };
+            float area = 0.0f;
+            for (uint32_t t = cluster.begin; t < cluster.end; t++) {
+                float a[3], b[3], d[3];
+                ReadPosition(data, indices[t * 3], stride, positionOffset, a);
+                ReadPosition(data, indices[t * 3 + 1], stride, positionOffset, b);
+                ReadPosition(data, indices[t * 3 + 2], stride, positionOffset, d);
+                float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+                float e2[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+                float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+                float w = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (int k = 0; k < 3; k++) {
+                    centroid[k] += (a[k] + b[k] + d[k]) * (w / 3.0f);
+                    normal[k] += n[k];
+                }
+                area += w;
+            }
+
+            float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            cluster.sortKey = 0.0f;
+            if (area > 0.0f && length > 0.0f) {
+                for (int k = 0; k < 3; k++) {
+                    cluster.sortKey += (centroid[k] / area - center[k]) * normal[k] / length;
+                }
+            }
+        }
+
+        std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) {
+            return a.sortKey > b.sortKey;
+        });
+
+        std::vector<uint32_t> output;
+        output.reserve(triangleCount * 3);
+        for (const Cluster& cluster : sorted) {
+            output.insert(output.end(), indices + cluster.begin * 3, indices + cluster.end * 3);
+        }
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    size_t OptimizeVertexFetch(void* vertices, uint32_t* indices, size_t indexCount, size_t vertexCount, size_t stride) {
+        std::vector<uint32_t> remap(vertexCount, ~0u);
+        uint32_t next = 0;
+        for (size_t i = 0; i < indexCount; i++) {
+            uint32_t& target = remap[indices[i]];
+            if (target == ~0u)
+                target = next++;
+            indices[i] = target;
+        }
+
+        std::vector<uint8_t> copy(static_cast<uint8_t*>(vertices), static_cast<uint8_t*>(vertices) + vertexCount * stride);
+        RemapVertices(vertices, copy.data(), vertexCount, stride, remap);
+        return next;
+    }
+
+    OptimizeReport OptimizeMesh(std::vector<uint8_t>& vertices, size_t stride, size_t positionOffset,
+                                std::vector<uint32_t>& indices, unsigned cacheSize) {
+        OptimizeReport report;
+        size_t vertexCount = vertices.size() / stride;
+        report.verticesBefore = vertexCount;
+        report.before = AnalyzeVertexCache(indices.data(), indices.size(), vertexCount, cacheSize);
+
+        std::vector<uint32_t> remap;
+        size_t unique = Weld(vertices.data(), vertexCount, stride, remap);
+        if (unique < vertexCount) {
+            std::vector<uint8_t> welded(unique * stride);
+            RemapVertices(welded.data(), vertices.data(), vertexCount, stride, remap);
+            RemapIndices(indices.data(), indices.size(), remap);
+            vertices.swap(welded);
+            vertexCount = unique;
+        }
+
+        std::vector<uint32_t> clusters;
+        OptimizeVertexCache(indices.data(), indices.size(), vertexCount, cacheSize, &clusters);
+        OptimizeOverdraw(indices.data(), indices.size(), vertices.data(), vertexCount, stride, positionOffset, clusters);
+        vertexCount = OptimizeVertexFetch(vertices.data(), indices.data(), indices.size(), vertexCount, stride);
+        vertices.resize(vertexCount * stride);
+
+        report.verticesAfter = vertexCount;
+        report.clusters = clusters.size();
+        report.after = AnalyzeVertexCache(indices.data(), indices.size(), vertexCount, cacheSize);
+        return report;
+    }
+}
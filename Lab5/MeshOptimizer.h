@@ -0,0 +1,48 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+
+// Оптимизация индексированных мешей перед загрузкой на GPU: склейка одинаковых вершин, переупорядочивание
+// треугольников под кэш вершин (Tipsify) и против перерисовки, перенумерация вершин в порядке выборки.
+// Позиция вершины - три float по смещению positionOffset.
+namespace mesh {
+    struct CacheStats {
+        float acmr = 0.0f;      // обработанных вершин на треугольник
+        float atvr = 0.0f;      // обработанных вершин на уникальную вершину
+        size_t transformed = 0;
+    };
+
+    struct OptimizeReport {
+        size_t verticesBefore = 0;
+        size_t verticesAfter = 0;
+        size_t clusters = 0;
+        CacheStats before;
+        CacheStats after;
+    };
+
+    // Моделирует FIFO кэш вершин размера cacheSize.
+    CacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize = 16);
+
+    // Находит побайтно совпадающие вершины. remap[i] - новый номер вершины i, возвращает число уникальных вершин.
+    size_t Weld(const void* vertices, size_t vertexCount, size_t stride, std::vector<uint32_t>& remap);
+    // Переносит вершины в новые позиции по remap. dst и src не должны пересекаться.
+    void RemapVertices(void* dst, const void* src, size_t vertexCount, size_t stride, const std::vector<uint32_t>& remap);
+    void RemapIndices(uint32_t* indices, size_t indexCount, const std::vector<uint32_t>& remap);
+
+    // Tipsify (Sander, Nehab, Barczak 2007). В clusters записываются номера первых треугольников кластеров -
+    // участков, между которыми алгоритм перескакивал в тупиках.
+    void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize = 16,
+                             std::vector<uint32_t>* clusters = nullptr);
+    // Сортирует кластеры так, чтобы первыми рисовались обращенные наружу, что снижает перерисовку.
+    void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const void* vertices, size_t vertexCount, size_t stride,
+                          size_t positionOffset, const std::vector<uint32_t>& clusters);
+    // Перенумеровывает вершины в порядке первого использования. Возвращает число используемых вершин.
+    size_t OptimizeVertexFetch(void* vertices, uint32_t* indices, size_t indexCount, size_t vertexCount, size_t stride);
+
+    // Полный конвейер: склейка, кэш, перерисовка, выборка. vertices содержит вершины размера stride подряд.
+    OptimizeReport OptimizeMesh(std::vector<uint8_t>& vertices, size_t stride, size_t positionOffset,
+                                std::vector<uint32_t>& indices, unsigned cacheSize = 16);
+}
@@ -0,0 +1,121 @@
+﻿// Замер и проверка MeshOptimizer, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 MeshOptimizerBenchMain.cpp MeshOptimizer.cpp MeshGenerator.cpp -o meshopt
+// Примеры:
+//   ./meshopt
+//   ./meshopt --tessellation 2000
+// Меши генерируются, треугольники перемешиваются, а в вариантах split у каждого угла своя вершина (как после
+// загрузки без индексов). Проверки: после OptimizeMesh набор треугольников (позиции и нормали углов с точностью до
+// поворота) не меняется, склейка возвращает число вершин исходного меша, ACMR не растет, все вершины используются.
+// Замер - полный конвейер на сфере в миллион вершин.
+#include "MeshOptimizer.h"
+#include "MeshGenerator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace {
+    const size_t stride = 24;   // позиция + нормаль
+
+    typedef std::array<float, 18> Triangle;
+
+    double Milliseconds(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Треугольники с вершинами по значению, каждый в наименьшем из трех поворотов, отсортированные.
+    std::vector<Triangle> Triangles(const std::vector<uint8_t>& vertices, const std::vector<uint32_t>& indices) {
+        std::vector<Triangle> triangles(indices.size() / 3);
+        for (size_t t = 0; t < triangles.size(); t++) {
+            Triangle corners;
+            for (int k = 0; k < 3; k++) {
+                memcpy(&corners[k * 6], &vertices[indices[t * 3 + k] * stride], stride);
+            }
+            triangles[t] = corners;
+            for (int r = 1; r < 3; r++) {
+                Triangle rotated;
+                for (int k = 0; k < 3; k++) {
+                    memcpy(&rotated[k * 6], &corners[((k + r) % 3) * 6], stride);
+                }
+                triangles[t] = std::min(triangles[t], rotated);
+            }
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    }
+
+    bool Run(const char* name, const mesh::MeshData& mesh, bool shuffle, bool split) {
+        std::vector<uint8_t> vertices(mesh.GetVertexCount() * stride);
+        mesh::WriteVertices(mesh, mesh::VertexLayout::Make(mesh::Position | mesh::Normal), vertices.data());
+        std::vector<uint32_t> indices = mesh.indices;
+        size_t triangleCount = indices.size() / 3;
+        if (shuffle) {
+            std::vector<size_t> order(triangleCount);
+            for (size_t t = 0; t < triangleCount; t++) {
+                order[t] = t;
+            }
+            std::shuffle(order.begin(), order.end(), std::mt19937(1));
+            for (size_t t = 0; t < triangleCount; t++) {
+                memcpy(&indices[t * 3], &mesh.indices[order[t] * 3], 3 * sizeof(uint32_t));
+            }
+        }
+        if (split) {
+            std::vector<uint8_t> corners(indices.size() * stride);
+            for (size_t i = 0; i < indices.size(); i++) {
+                memcpy(&corners[i * stride], &vertices[indices[i] * stride], stride);
+                indices[i] = (uint32_t)i;
+            }
+            vertices.swap(corners);
+        }
+
+        std::vector<Triangle> reference = Triangles(vertices, indices);
+        auto start = std::chrono::steady_clock::now();
+        mesh::OptimizeReport report = mesh::OptimizeMesh(vertices, stride, 0, indices, 16);
+        double milliseconds = Milliseconds(start);
+
+        std::vector<uint8_t> used(report.verticesAfter, 0);
+        bool inRange = vertices.size() == report.verticesAfter * stride;
+        for (uint32_t index : indices) {
+            inRange = inRange && index < report.verticesAfter;
+            if (inRange) {
+                used[index] = 1;
+            }
+        }
+        bool allUsed = inRange && std::find(used.begin(), used.end(), 0) == used.end();
+        bool same = inRange && Triangles(vertices, indices) == reference;
+        bool ok = same && allUsed && report.verticesAfter == mesh.GetVertexCount() && report.after.acmr <= report.before.acmr + 1e-6f;
+        printf("%-20s %7zu -> %7zu vertices, %5zu clusters, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %7.1f ms, triangles %s, %s: %s\n",
+            name, report.verticesBefore, report.verticesAfter, report.clusters, report.before.acmr, report.after.acmr,
+            report.before.atvr, report.after.atvr, milliseconds, same ? "same" : "DIFFER", allUsed ? "all vertices used" : "UNUSED vertices",
+            ok ? "ok" : "FAILED");
+        return ok;
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned tessellation = 1000;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--tessellation") && i + 1 < argc) {
+            tessellation = (unsigned)atoi(argv[++i]);
+        } else {
+            printf("meshopt [--tessellation <n>]\n");
+            return 1;
+        }
+    }
+
+    mesh::MeshData mesh;
+    mesh::UVSphere(40, 40, mesh);
+    bool ok = Run("uvsphere 40", mesh, false, false);
+    ok = Run("uvsphere 40 shuffled", mesh, true, false) && ok;
+    mesh::Icosphere(5, mesh);
+    ok = Run("icosphere 5 split", mesh, true, true) && ok;
+    mesh::Torus(1.0f, 0.3f, 256, 128, mesh);
+    ok = Run("torus split", mesh, true, true) && ok;
+    mesh::UVSphere(tessellation, tessellation, mesh);
+    ok = Run("uvsphere shuffled", mesh, true, false) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,576 @@
+﻿#include "MeshSimplifier.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+    const int dimension = 6; // позиция и взвешенная нормаль
+    const size_t maxValence = 16;
+
+    // Квадрика Q(x) = x^T A x + 2 b^T x + c в N-мерном пространстве, A хранится верхним треугольником.
+    template <int N>
+    struct QuadricN {
+        double a[N * (N + 1) / 2] = {};
+        double b[N] = {};
+        double c = 0.0;
+        double weight = 0.0;
+
+        void Add(const QuadricN& q) {
+            for (int i = 0; i < N * (N + 1) / 2; i++) {
+                a[i] += q.a[i];
+            }
+            for (int i = 0; i < N; i++) {
+                b[i] += q.b[i];
+            }
+            c += q.c;
+            weight += q.weight;
+        }
+
+        // Без отсечения отрицательных значений: квадрики складываются, и их значения тоже можно складывать.
+        double Evaluate(const double* x) const {
+            double result = c;
+            int k = 0;
+            for (int i = 0; i < N; i++) {
+                result += a[k++] * x[i] * x[i];
+                for (int j = i + 1; j < N; j++) {
+                    result += 2.0 * a[k++] * x[i] * x[j];
+                }
+                result += 2.0 * b[i] * x[i];
+            }
+            return result;
+        }
+    };
+
+    typedef QuadricN<dimension> Quadric;
+    typedef QuadricN<3> DistanceQuadric;    // только позиция, 88 байт вместо 232
+
+    double Dot(const double* a, const double* b, int n) {
+        double result = 0.0;
+        for (int i = 0; i < n; i++) {
+            result += a[i] * b[i];
+        }
+        return result;
+    }
+
+    // Квадрика расстояния до аффинной плоскости треугольника в шестимерном пространстве.
+    bool TriangleQuadric(const double* q0, const double* q1, const double* q2, double weight, Quadric& quadric) {
+        double e1[dimension], e2[dimension];
+        for (int i = 0; i < dimension; i++) {
+            e1[i] = q1[i] - q0[i];
+            e2[i] = q2[i] - q0[i];
+        }
+        double length = std::sqrt(Dot(e1, e1, dimension));
+        if (length <= 0.0)
+            return false;
+        for (int i = 0; i < dimension; i++) {
+            e1[i] /= length;
+        }
+        double projection = Dot(e2, e1, dimension);
+        for (int i = 0; i < dimension; i++) {
+            e2[i] -= projection * e1[i];
+        }
+        length = std::sqrt(Dot(e2, e2, dimension));
+        if (length <= 0.0)
+            return false;
+        for (int i = 0; i < dimension; i++) {
+            e2[i] /= length;
+        }
+
+        double p1 = Dot(q0, e1, dimension);
+        double p2 = Dot(q0, e2, dimension);
+        int k = 0;
+        for (int i = 0; i < dimension; i++) {
+            for (int j = i; j < dimension; j++) {
+                quadric.a[k++] = weight * ((i == j ? 1.0 : 0.0) - e1[i] * e1[j] - e2[i] * e2[j]);
+            }
+            quadric.b[i] = weight * (p1 * e1[i] + p2 * e2[i] - q0[i]);
+        }
+        quadric.c = weight * (Dot(q0, q0, dimension) - p1 * p1 - p2 * p2);
+        return true;
+    }
+
+    // Квадрика расстояния до плоскости n * p + d = 0, действующая только на позицию.
+    template <int N>
+    QuadricN<N> PlaneQuadric(const double* n, double d, double weight) {
+        QuadricN<N> quadric;
+        int k = 0;
+        for (int i = 0; i < N; i++) {
+            for (int j = i; j < N; j++) {
+                quadric.a[k++] = i < 3 && j < 3 ? weight * n[i] * n[j] : 0.0;
+            }
+            quadric.b[i] = i < 3 ? weight * n[i] * d : 0.0;
+        }
+        quadric.c = weight * d * d;
+        quadric.weight = weight;
+        return quadric;
+    }
+
+    void Cross(const double* a, const double* b, double* out) {
+        out[0] = a[1] * b[2] - a[2] * b[1];
+        out[1] = a[2] * b[0] - a[0] * b[2];
+        out[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    // Элементы очереди не удаляются при изменении вершин: версии концов ребра сравниваются при извлечении.
+    // Стоимость и ошибка хранятся во float, чтобы элемент занимал 28 байт, а не 48.
+    struct Collapse {
+        float cost;
+        float error;
+        uint32_t from;
+        uint32_t to;
+        uint32_t fromVersion;
+        uint32_t toVersion;
+        bool reversible;        // при отказе можно попробовать схлопнуть ребро в обратную сторону
+
+        bool operator>(const Collapse& other) const {
+            return cost > other.cost;
+        }
+    };
+
+    class Simplifier {
+    public:
+        Simplifier(const uint8_t* vertices, size_t vertexCount, size_t stride, size_t positionOffset, size_t normalOffset,
+                   const uint32_t* indices, size_t indexCount, const mesh::SimplifyOptions& options) :
+            vertexCount_(vertexCount), options_(options) {
+            points_.resize(vertexCount * dimension);
+            for (size_t v = 0; v < vertexCount; v++) {
+                float p[3] = { 0.0f, 0.0f, 0.0f };
+                float n[3] = { 0.0f, 0.0f, 0.0f };
+                memcpy(p, vertices + v * stride + positionOffset, sizeof(p));
+                if (normalOffset != SIZE_MAX)
+                    memcpy(n, vertices + v * stride + normalOffset, sizeof(n));
+                for (int k = 0; k < 3; k++) {
+                    points_[v * dimension + k] = p[k];
+                    points_[v * dimension + 3 + k] = n[k] * options.normalWeight;
+                }
+            }
+
+            triangles_.assign(indices, indices + indexCount / 3 * 3);
+            alive_.assign(triangles_.size() / 3, 1);
+            aliveCount_ = alive_.size();
+            incident_.resize(vertexCount);
+            for (uint32_t t = 0; t < alive_.size(); t++) {
+                for (int k = 0; k < 3; k++) {
+                    incident_[triangles_[t * 3 + k]].push_back(t);
+                }
+            }
+
+            removed_.assign(vertexCount, 0);
+            rejected_.assign(vertexCount, 0);
+            locked_.assign(vertexCount, 0);
+            border_.assign(vertexCount, 0);
+            version_.assign(vertexCount, 0);
+            quadrics_.resize(vertexCount);
+            distances_.resize(vertexCount);
+
+            LockSeams();
+            BuildQuadrics();
+        }
+
+        size_t GetTriangleCount() const {
+            return aliveCount_;
+        }
+
+        float GetError() const {
+            return (float)maxError_;
+        }
+
+        void Snapshot(mesh::Lod& lod) const {
+            lod.indices.clear();
+            lod.indices.reserve(aliveCount_ * 3);
+            for (size_t t = 0; t < alive_.size(); t++) {
+                if (alive_[t])
+                    lod.indices.insert(lod.indices.end(), &triangles_[t * 3], &triangles_[t * 3] + 3);
+            }
+            lod.error = GetError();
+        }
+
+        // Все ребра сначала собираются, куча строится за линейное время.
+        void Start() {
+            for (uint32_t v = 0; v < vertexCount_; v++) {
+                CollectNeighbours(v);
+                for (uint32_t w : neighbours_) {
+                    if (w > v)
+                        AddEdge(v, w);
+                }
+            }
+            std::make_heap(queue_.begin(), queue_.end(), std::greater<Collapse>());
+        }
+
+        // Выполняет одно схлопывание. false - схлопывать больше нечего или ошибка превысит предел.
+        // Квадрики только накапливаются, поэтому стоимость ребра после изменения конца не уменьшается: устаревший
+        // элемент достаточно пересчитать, когда он дойдет до вершины очереди.
+        bool Step() {
+            while (!queue_.empty()) {
+                std::pop_heap(queue_.begin(), queue_.end(), std::greater<Collapse>());
+                Collapse collapse = queue_.back();
+                queue_.pop_back();
+
+                if (removed_[collapse.from] || removed_[collapse.to])
+                    continue;
+                if (collapse.fromVersion != version_[collapse.from] || collapse.toVersion != version_[collapse.to]) {
+                    PushEdge(collapse.from, collapse.to);
+                    continue;
+                }
+                if (collapse.error > options_.maxError)
+                    return false;
+                if (!IsValid(collapse.from, collapse.to)) {
+                    if (collapse.reversible) {
+                        PushCollapse(collapse.to, collapse.from, false);
+                    }
+                    else {
+                        rejected_[collapse.from] = 1;
+                        rejected_[collapse.to] = 1;
+                    }
+                    continue;
+                }
+
+                Apply(collapse.from, collapse.to);
+                maxError_ = std::max(maxError_, (double)collapse.error);
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        // Вершины, у которых есть двойник с той же позицией (шов атрибутов), не двигаются, чтобы не рвать поверхность.
+        void LockSeams() {
+            std::vector<uint32_t> order(vertexCount_);
+            for (uint32_t v = 0; v < vertexCount_; v++) {
+                order[v] = v;
+            }
+            auto less = [this](uint32_t l, uint32_t r) {
+                return std::lexicographical_compare(&points_[l * dimension], &points_[l * dimension] + 3,
+                    &points_[r * dimension], &points_[r * dimension] + 3);
+            };
+            std::sort(order.begin(), order.end(), less);
+            for (size_t i = 1; i < order.size(); i++) {
+                if (!less(order[i - 1], order[i])) {
+                    locked_[order[i - 1]] = 1;
+                    locked_[order[i]] = 1;
+                }
+            }
+        }
+
+        void BuildQuadrics() {
+            // Вес треугольника - площадь относительно средней, чтобы ошибка оставалась в единицах квадрата расстояния.
+            std::vector<double> areas(alive_.size());
+            double totalArea = 0.0;
+            for (size_t t = 0; t < alive_.size(); t++) {
+                double n[3];
+                Normal(triangles_[t * 3], triangles_[t * 3 + 1], triangles_[t * 3 + 2], n);
+                areas[t] = 0.5 * std::sqrt(Dot(n, n, 3));
+                totalArea += areas[t];
+            }
+            double meanArea = alive_.empty() || totalArea <= 0.0 ? 1.0 : totalArea / alive_.size();
+
+            for (size_t t = 0; t < alive_.size(); t++) {
+                const uint32_t* tri = &triangles_[t * 3];
+                Quadric quadric;
+                if (!TriangleQuadric(&points_[tri[0] * dimension], &points_[tri[1] * dimension], &points_[tri[2] * dimension],
+                    areas[t] / meanArea, quadric))
+                    continue;
+
+                // Отдельная квадрика расстояний до плоскостей граней дает ошибку в единицах длины для выбора LOD.
+                double normal[3];
+                Normal(tri[0], tri[1], tri[2], normal);
+                for (int k = 0; k < 3; k++) {
+                    normal[k] /= 2.0 * areas[t];
+                }
+                DistanceQuadric distance = PlaneQuadric<3>(normal, -Dot(normal, &points_[tri[0] * dimension], 3), areas[t] / meanArea);
+                for (int k = 0; k < 3; k++) {
+                    quadrics_[tri[k]].Add(quadric);
+                    distances_[tri[k]].Add(distance);
+                }
+            }
+
+            // Открытые ребра - ребра одного треугольника. Их удерживают плоскости, перпендикулярные треугольнику.
+            std::vector<uint64_t> edges(triangles_.size());
+            for (size_t i = 0; i < triangles_.size(); i++) {
+                edges[i] = EdgeKey(triangles_[i], triangles_[i - i % 3 + (i + 1) % 3]);
+            }
+            std::sort(edges.begin(), edges.end());
+            for (size_t i = 0; i < triangles_.size(); i++) {
+                size_t t = i / 3;
+                uint32_t a = triangles_[i], b = triangles_[t * 3 + (i + 1) % 3], c = triangles_[t * 3 + (i + 2) % 3];
+                auto range = std::equal_range(edges.begin(), edges.end(), EdgeKey(a, b));
+                if (range.second - range.first != 1)
+                    continue;
+
+                border_[a] = 1;
+                border_[b] = 1;
+
+                const double* pa = &points_[a * dimension];
+                const double* pb = &points_[b * dimension];
+                double edge[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+                double normal[3], plane[3];
+                Normal(a, b, c, normal);
+                Cross(edge, normal, plane);
+                double length = std::sqrt(Dot(plane, plane, 3));
+                if (length <= 0.0)
+                    continue;
+                for (int k = 0; k < 3; k++) {
+                    plane[k] /= length;
+                }
+                double d = -Dot(plane, pa, 3);
+                Quadric quadric = PlaneQuadric<dimension>(plane, d, options_.borderWeight);
+                quadrics_[a].Add(quadric);
+                quadrics_[b].Add(quadric);
+            }
+        }
+
+        static uint64_t EdgeKey(uint32_t a, uint32_t b) {
+            return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+        }
+
+        void Normal(uint32_t a, uint32_t b, uint32_t c, double* n) const {
+            const double* pa = &points_[a * dimension];
+            const double* pb = &points_[b * dimension];
+            const double* pc = &points_[c * dimension];
+            double e1[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+            double e2[3] = { pc[0] - pa[0], pc[1] - pa[1], pc[2] - pa[2] };
+            Cross(e1, e2, n);
+        }
+
+        // Соседи вершины без повторов.
+        void CollectNeighbours(uint32_t v) {
+            neighbours_.clear();
+            for (uint32_t t : incident_[v]) {
+                const uint32_t* tri = &triangles_[t * 3];
+                for (int k = 0; k < 3; k++) {
+                    if (tri[k] != v)
+                        neighbours_.push_back(tri[k]);
+                }
+            }
+            std::sort(neighbours_.begin(), neighbours_.end());
+            neighbours_.erase(std::unique(neighbours_.begin(), neighbours_.end()), neighbours_.end());
+        }
+
+        double Cost(uint32_t from, uint32_t to, double& error) const {
+            const double* target = &points_[to * dimension];
+            double weight = distances_[from].weight + distances_[to].weight;
+            double distance = distances_[from].Evaluate(target) + distances_[to].Evaluate(target);
+            error = weight > 0.0 && distance > 0.0 ? std::sqrt(distance / weight) : 0.0;
+            double cost = quadrics_[from].Evaluate(target) + quadrics_[to].Evaluate(target);
+            return cost > 0.0 ? cost : 0.0;
+        }
+
+        void PushCollapse(uint32_t from, uint32_t to, bool reversible) {
+            double error;
+            double cost = Cost(from, to, error);
+            queue_.push_back({ (float)cost, (float)error, from, to, version_[from], version_[to], reversible });
+            std::push_heap(queue_.begin(), queue_.end(), std::greater<Collapse>());
+        }
+
+        // В очередь попадает более дешевое направление ребра, обратное пробуется, если первое недопустимо.
+        void PushEdge(uint32_t a, uint32_t b) {
+            size_t size = queue_.size();
+            AddEdge(a, b);
+            if (queue_.size() > size)
+                std::push_heap(queue_.begin(), queue_.end(), std::greater<Collapse>());
+        }
+
+        // Добавляет ребро в конец очереди без восстановления кучи.
+        void AddEdge(uint32_t a, uint32_t b) {
+            if (locked_[a] && locked_[b])
+                return;
+            if (locked_[a] || locked_[b]) {
+                uint32_t from = locked_[a] ? b : a, to = locked_[a] ? a : b;
+                double error;
+                double cost = Cost(from, to, error);
+                queue_.push_back({ (float)cost, (float)error, from, to, version_[from], version_[to], false });
+                return;
+            }
+            double errorA, errorB;
+            double costA = Cost(a, b, errorA);
+            double costB = Cost(b, a, errorB);
+            if (costA <= costB)
+                queue_.push_back({ (float)costA, (float)errorA, a, b, version_[a], version_[b], true });
+            else
+                queue_.push_back({ (float)costB, (float)errorB, b, a, version_[b], version_[a], true });
+        }
+
+        bool IsValid(uint32_t from, uint32_t to) {
+            // Общие треугольники и общие соседи: для многообразного результата соседей должно быть ровно столько же.
+            size_t shared = 0;
+            neighbours_.clear();
+            for (uint32_t t : incident_[from]) {
+                const uint32_t* tri = &triangles_[t * 3];
+                if (tri[0] == to || tri[1] == to || tri[2] == to)
+                    shared++;
+                for (int k = 0; k < 3; k++) {
+                    if (tri[k] != from && tri[k] != to)
+                        neighbours_.push_back(tri[k]);
+                }
+            }
+            if (shared == 0)
+                return false;
+            // Граничная вершина может скользить только вдоль границы.
+            if (border_[from] && !(border_[to] && shared == 1))
+                return false;
+
+            std::sort(neighbours_.begin(), neighbours_.end());
+            neighbours_.erase(std::unique(neighbours_.begin(), neighbours_.end()), neighbours_.end());
+            size_t uniqueFrom = neighbours_.size();
+            for (uint32_t t : incident_[to]) {
+                const uint32_t* tri = &triangles_[t * 3];
+                for (int k = 0; k < 3; k++) {
+                    if (tri[k] != to && tri[k] != from)
+                        neighbours_.push_back(tri[k]);
+                }
+            }
+            std::sort(neighbours_.begin() + uniqueFrom, neighbours_.end());
+            neighbours_.erase(std::unique(neighbours_.begin() + uniqueFrom, neighbours_.end()), neighbours_.end());
+            // Общие соседи допустимы только напротив общего ребра, иначе результат не будет многообразием.
+            size_t common = 0;
+            for (size_t i = uniqueFrom; i < neighbours_.size(); i++) {
+                if (std::binary_search(neighbours_.begin(), neighbours_.begin() + uniqueFrom, neighbours_[i]))
+                    common++;
+            }
+            if (common > shared)
+                return false;
+            // Ограничение валентности не дает на плоских участках с нулевой ошибкой собирать веера из длинных треугольников.
+            size_t valence = neighbours_.size() - common;
+            if (valence > maxValence && valence > neighbours_.size() - uniqueFrom + 1)
+                return false;
+
+            // Треугольники не должны выворачиваться.
+            for (uint32_t t : incident_[from]) {
+                const uint32_t* tri = &triangles_[t * 3];
+                if (tri[0] == to || tri[1] == to || tri[2] == to)
+                    continue;
+                uint32_t moved[3] = { tri[0], tri[1], tri[2] };
+                for (int k = 0; k < 3; k++) {
+                    if (moved[k] == from)
+                        moved[k] = to;
+                }
+                double before[3], after[3];
+                Normal(tri[0], tri[1], tri[2], before);
+                Normal(moved[0], moved[1], moved[2], after);
+                double lengths = std::sqrt(Dot(before, before, 3) * Dot(after, after, 3));
+                if (lengths <= 0.0 || Dot(before, after, 3) < 0.25 * lengths)
+                    return false;
+            }
+            return true;
+        }
+
+        void Apply(uint32_t from, uint32_t to) {
+            // Соседи from, которые не были соседями to, дают новые ребра. Ребра to уже в очереди и пересчитаются по
+            // версии, заново ставятся только те, что раньше отвергались как недопустимые.
+            CollectNeighbours(to);
+            size_t oldNeighbours = neighbours_.size();
+            for (uint32_t t : incident_[from]) {
+                const uint32_t* tri = &triangles_[t * 3];
+                for (int k = 0; k < 3; k++) {
+                    if (tri[k] != from && tri[k] != to && !std::binary_search(neighbours_.begin(), neighbours_.begin() + oldNeighbours, tri[k]))
+                        neighbours_.push_back(tri[k]);
+                }
+            }
+            std::sort(neighbours_.begin() + oldNeighbours, neighbours_.end());
+            neighbours_.erase(std::unique(neighbours_.begin() + oldNeighbours, neighbours_.end()), neighbours_.end());
+
+            for (uint32_t t : incident_[from]) {
+                uint32_t* tri = &triangles_[t * 3];
+                if (tri[0] == to || tri[1] == to || tri[2] == to) {
+                    alive_[t] = 0;
+                    aliveCount_--;
+                    for (int k = 0; k < 3; k++) {
+                        if (tri[k] != from) {
+                            auto& list = incident_[tri[k]];
+                            list.erase(std::find(list.begin(), list.end(), t));
+                        }
+                    }
+                }
+                else {
+                    for (int k = 0; k < 3; k++) {
+                        if (tri[k] == from)
+                            tri[k] = to;
+                    }
+                    incident_[to].push_back(t);
+                }
+            }
+            incident_[from].clear();
+            removed_[from] = 1;
+            quadrics_[to].Add(quadrics_[from]);
+            distances_[to].Add(distances_[from]);
+            version_[to]++;
+
+            for (size_t i = 0; i < neighbours_.size(); i++) {
+                uint32_t w = neighbours_[i];
+                if (i >= oldNeighbours || rejected_[w] || rejected_[to])
+                    PushEdge(w, to);
+            }
+        }
+
+        size_t vertexCount_;
+        mesh::SimplifyOptions options_;
+        std::vector<double> points_;
+        std::vector<uint32_t> triangles_;
+        std::vector<uint8_t> alive_;
+        size_t aliveCount_ = 0;
+        std::vector<std::vector<uint32_t>> incident_;
+        std::vector<uint8_t> removed_;
+        std::vector<uint8_t> rejected_;    // у вершины было ребро, отвергнутое в обе стороны
+        std::vector<uint8_t> locked_;
+        std::vector<uint8_t> border_;
+        std::vector<uint32_t> version_;
+        std::vector<Quadric> quadrics_;
+        std::vector<DistanceQuadric> distances_;
+        std::vector<uint32_t> neighbours_;
+        std::vector<Collapse> queue_;   // куча по возрастанию стоимости
+        double maxError_ = 0.0;
+    };
+}
+
+namespace mesh {
+    void Simplify(const void* vertices, size_t vertexCount, size_t stride, size_t positionOffset, size_t normalOffset,
+                  const uint32_t* indices, size_t indexCount, const std::vector<size_t>& targets,
+                  const SimplifyOptions& options, std::vector<Lod>& lods) {
+        Simplifier simplifier(static_cast<const uint8_t*>(vertices), vertexCount, stride, positionOffset, normalOffset,
+            indices, indexCount, options);
+        simplifier.Start();
+
+        for (size_t target : targets) {
+            while (simplifier.GetTriangleCount() > target && simplifier.Step()) {
+            }
+            if (simplifier.GetTriangleCount() > target)
+                break;
+            lods.emplace_back();
+            simplifier.Snapshot(lods.back());
+        }
+    }
+
+    void BuildLodChain(const void* vertices, size_t vertexCount, size_t stride, size_t positionOffset, size_t normalOffset,
+                       const uint32_t* indices, size_t indexCount, unsigned maxLevels, float ratio, size_t minTriangles,
+                       const SimplifyOptions& options, std::vector<Lod>& lods) {
+        lods.clear();
+        lods.emplace_back();
+        lods[0].indices.assign(indices, indices + indexCount);
+
+        std::vector<size_t> targets;
+        double triangles = (double)(indexCount / 3);
+        for (unsigned level = 1; level < maxLevels; level++) {
+            triangles *= ratio;
+            if (triangles < minTriangles)
+                break;
+            targets.push_back((size_t)triangles);
+        }
+        Simplify(vertices, vertexCount, stride, positionOffset, normalOffset, indices, indexCount, targets, options, lods);
+    }
+
+    unsigned SelectLod(const std::vector<float>& errors, float radius, float worldScale, float viewDepth, float nearPlane,
+                       float projectionScale, float pixelThreshold) {
+        float depth = viewDepth - radius * worldScale;
+        if (errors.empty() || depth <= nearPlane)
+            return 0;
+
+        float pixelsPerUnit = worldScale * projectionScale / depth;
+        unsigned lod = 0;
+        for (unsigned i = 1; i < errors.size(); i++) {
+            if (errors[i] * pixelsPerUnit > pixelThreshold)
+                break;
+            lod = i;
+        }
+        return lod;
+    }
+}
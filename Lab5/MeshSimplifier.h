@@ -0,0 +1,40 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+
+// Упрощение мешей по квадрикам ошибки (Garland, Heckbert 1998) с учетом нормалей. Ребра схлопываются в одну из
+// существующих вершин, поэтому все уровни детализации используют исходный вершинный буфер и отличаются только индексами.
+namespace mesh {
+    struct SimplifyOptions {
+        float normalWeight = 0.5f;  // вес нормали в квадрике относительно позиции
+        float borderWeight = 10.0f; // вес плоскостей, удерживающих открытые границы
+        float maxError = 1e30f;     // упрощение останавливается, когда ошибка превысит это значение
+    };
+
+    struct Lod {
+        std::vector<uint32_t> indices;
+        float error = 0.0f;         // оценка отклонения от исходной поверхности в единицах меша
+    };
+
+    // Упрощает меш, записывая в lods снимки индексов при достижении каждого числа треугольников из targets
+    // (по убыванию). Уровни, до которых упростить не удалось, не добавляются. normalOffset = SIZE_MAX - без нормалей.
+    void Simplify(const void* vertices, size_t vertexCount, size_t stride, size_t positionOffset, size_t normalOffset,
+                  const uint32_t* indices, size_t indexCount, const std::vector<size_t>& targets,
+                  const SimplifyOptions& options, std::vector<Lod>& lods);
+
+    // Цепочка уровней: lods[0] - исходный меш, каждый следующий примерно в 1 / ratio раз меньше по треугольникам.
+    void BuildLodChain(const void* vertices, size_t vertexCount, size_t stride, size_t positionOffset, size_t normalOffset,
+                       const uint32_t* indices, size_t indexCount, unsigned maxLevels, float ratio, size_t minTriangles,
+                       const SimplifyOptions& options, std::vector<Lod>& lods);
+
+    // Выбирает самый грубый уровень, ошибка которого на экране не превышает pixelThreshold пикселей.
+    // Ошибка оценивается на ближайшей к камере точке ограничивающей сферы: viewDepth - глубина центра объекта
+    // в пространстве камеры, radius - радиус сферы в пространстве модели. Если сфера доходит до ближней плоскости
+    // nearPlane, выбирается исходный меш. projectionScale - пикселей на единицу на глубине 1 (элемент _22 матрицы
+    // проекции, умноженный на половину высоты экрана).
+    unsigned SelectLod(const std::vector<float>& errors, float radius, float worldScale, float viewDepth, float nearPlane,
+                       float projectionScale, float pixelThreshold);
+}
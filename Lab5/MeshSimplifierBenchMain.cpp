@@ -0,0 +1,135 @@
+﻿// Замер и проверка MeshSimplifier, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 MeshSimplifierBenchMain.cpp MeshSimplifier.cpp MeshOptimizer.cpp MeshGenerator.cpp -o simplify
+// Примеры:
+//   ./simplify
+//   ./simplify --tessellation 1000
+// Для каждого меша строится цепочка уровней и печатается кривая "треугольники - ошибка". Проверки уровней: нет
+// вырожденных треугольников и ребер, пройденных в одну сторону дважды; у сфер грани смотрят наружу, а отклонение
+// центров граней от сферы превышает отклонение исходного меша не больше чем на 3 x error уровня (error - оценка
+// по квадрикам, а не строгая граница); ошибка растет вместе с номером уровня. SelectLod:
+// пустой список и сфера у ближней плоскости дают 0, уровень не уменьшается с удалением объекта. Замер -
+// скорость схлопывания на большой UVSphere.
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "MeshGenerator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace {
+    const size_t stride = 24;   // позиция + нормаль
+
+    double Milliseconds(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // baseDeviation - отклонение исходного меша, оно возвращается в deviation для уровня 0.
+    bool CheckLod(unsigned level, const std::vector<uint8_t>& vertices, const mesh::Lod& lod, bool sphere, double& baseDeviation) {
+        std::map<std::pair<uint32_t, uint32_t>, int> edges;
+        size_t degenerate = 0, nonManifold = 0, inverted = 0;
+        double deviation = 0.0;
+        for (size_t i = 0; i < lod.indices.size(); i += 3) {
+            const uint32_t* t = &lod.indices[i];
+            degenerate += t[0] == t[1] || t[1] == t[2] || t[0] == t[2];
+            float p[3][3];
+            for (int k = 0; k < 3; k++) {
+                nonManifold += ++edges[{ t[k], t[(k + 1) % 3] }] > 1;
+                memcpy(p[k], &vertices[t[k] * stride], 12);
+            }
+            if (sphere) {
+                double e1[3], e2[3], center[3];
+                for (int j = 0; j < 3; j++) {
+                    e1[j] = p[1][j] - p[0][j];
+                    e2[j] = p[2][j] - p[0][j];
+                    center[j] = (p[0][j] + p[1][j] + p[2][j]) / 3.0;
+                }
+                double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+                inverted += n[0] * center[0] + n[1] * center[1] + n[2] * center[2] < 0.0;
+                deviation = std::max(deviation, 1.0 - std::sqrt(center[0] * center[0] + center[1] * center[1] + center[2] * center[2]));
+            }
+        }
+        if (level == 0) {
+            baseDeviation = deviation;
+        }
+        bool ok = degenerate == 0 && nonManifold == 0 && inverted == 0 && deviation <= baseDeviation + 3.0 * lod.error + 1e-6;
+        printf("  lod %2u: %7zu triangles, error %.5f", level, lod.indices.size() / 3, lod.error);
+        if (sphere) {
+            printf(", deviation from the sphere %.5f", deviation);
+        }
+        printf(", %zu degenerate, %zu non-manifold, %zu inverted: %s\n", degenerate, nonManifold, inverted, ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    bool Run(const char* name, const mesh::MeshData& mesh, bool sphere, unsigned levels) {
+        std::vector<uint8_t> vertices(mesh.GetVertexCount() * stride);
+        mesh::WriteVertices(mesh, mesh::VertexLayout::Make(mesh::Position | mesh::Normal), vertices.data());
+        std::vector<uint32_t> indices = mesh.indices;
+        mesh::OptimizeMesh(vertices, stride, 0, indices);
+
+        std::vector<mesh::Lod> lods;
+        auto start = std::chrono::steady_clock::now();
+        mesh::BuildLodChain(vertices.data(), vertices.size() / stride, stride, 0, 12, indices.data(), indices.size(), levels, 0.5f,
+            64, mesh::SimplifyOptions(), lods);
+        double milliseconds = Milliseconds(start);
+        size_t removed = indices.size() / 3 - lods.back().indices.size() / 3;
+        printf("%s: %zu triangles, %zu levels in %.1f ms, %.2f M collapsed triangles/s\n", name, indices.size() / 3, lods.size(),
+            milliseconds, removed / milliseconds / 1e3);
+
+        bool ok = lods.size() > 1 && lods[0].indices.size() == indices.size();
+        double baseDeviation = 0.0;
+        for (size_t i = 0; i < lods.size(); i++) {
+            ok = CheckLod((unsigned)i, vertices, lods[i], sphere, baseDeviation) && ok;
+            ok = ok && (i == 0 || (lods[i].error >= lods[i - 1].error && lods[i].indices.size() < lods[i - 1].indices.size()));
+        }
+
+        // Единичная сфера, кадр 720 пикселей по высоте, вертикальный угол 60 градусов.
+        std::vector<float> errors;
+        for (const mesh::Lod& lod : lods) {
+            errors.push_back(lod.error);
+        }
+        const float projectionScale = 1.7320508f * 720.0f / 2.0f, nearPlane = 0.01f;
+        unsigned previous = 0;
+        bool monotonic = mesh::SelectLod(errors, 1.0f, 1.0f, 0.5f, nearPlane, projectionScale, 1.0f) == 0;
+        printf("  SelectLod at 1 px:");
+        for (float depth : { 1.5f, 2.0f, 5.0f, 10.0f, 30.0f, 100.0f, 1000.0f }) {
+            unsigned level = mesh::SelectLod(errors, 1.0f, 1.0f, depth, nearPlane, projectionScale, 1.0f);
+            monotonic = monotonic && level >= previous && level < lods.size();
+            previous = level;
+            printf(" depth %g -> %u,", depth, level);
+        }
+        printf(" %s\n", monotonic ? "ok" : "FAILED");
+        return ok && monotonic;
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned tessellation = 700;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--tessellation") && i + 1 < argc) {
+            tessellation = (unsigned)atoi(argv[++i]);
+        } else {
+            printf("simplify [--tessellation <n>]\n");
+            return 1;
+        }
+    }
+
+    bool ok = mesh::SelectLod(std::vector<float>(), 1.0f, 1.0f, 10.0f, 0.01f, 600.0f, 1.0f) == 0;
+    mesh::MeshData mesh;
+    mesh::UVSphere(40, 40, mesh);
+    ok = Run("uvsphere 40", mesh, true, 8) && ok;
+    mesh::Icosphere(5, mesh);
+    ok = Run("icosphere 5", mesh, true, 10) && ok;
+    mesh::Torus(1.0f, 0.3f, 128, 64, mesh);
+    ok = Run("torus", mesh, false, 8) && ok;
+    mesh::Plane(64, 64, 2.0f, mesh);
+    ok = Run("plane", mesh, false, 8) && ok;
+    mesh::UVSphere(tessellation, tessellation, mesh);
+    ok = Run("uvsphere", mesh, true, 12) && ok;
+    return ok ? 0 : 1;
+}
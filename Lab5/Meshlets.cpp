@@ -0,0 +1,337 @@
+﻿#include "Meshlets.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MESHLETS_SSE
+#endif
+
+namespace {
+    struct Float3 {
+        float x, y, z;
+    };
+
+    inline Float3 operator-(Float3 a, Float3 b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    inline Float3 operator+(Float3 a, Float3 b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+    inline Float3 operator*(Float3 a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+    inline float Dot(Float3 a, Float3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    inline Float3 Cross(Float3 a, Float3 b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+    inline Float3 Normalize(Float3 a) {
+        float length = std::sqrt(Dot(a, a));
+        return length > 0.0f ? a * (1.0f / length) : Float3{ 0.0f, 0.0f, 0.0f };
+    }
+
+    Float3 LoadPosition(const uint8_t* vertices, size_t stride, size_t positionOffset, uint32_t index) {
+        Float3 p;
+        memcpy(&p, vertices + index * stride + positionOffset, sizeof(p));
+        return p;
+    }
+
+    // Сфера Риттера: начальный диаметр - самая дальняя пара среди крайних точек по осям, затем расширение.
+    void BoundingSphere(const std::vector<Float3>& points, float* center, float& radius) {
+        size_t extremes[6] = {};
+        for (size_t i = 1; i < points.size(); i++) {
+            const float* p = &points[i].x;
+            for (int axis = 0; axis < 3; axis++) {
+                if (p[axis] < (&points[extremes[axis * 2]].x)[axis])
+                    extremes[axis * 2] = i;
+                if (p[axis] > (&points[extremes[axis * 2 + 1]].x)[axis])
+                    extremes[axis * 2 + 1] = i;
+            }
+        }
+        Float3 a = points[extremes[0]], b = points[extremes[1]];
+        for (int axis = 1; axis < 3; axis++) {
+            Float3 c = points[extremes[axis * 2]], d = points[extremes[axis * 2 + 1]];
+            if (Dot(d - c, d - c) > Dot(b - a, b - a)) {
+                a = c;
+                b = d;
+            }
+        }
+
+        Float3 c = (a + b) * 0.5f;
+        float r = std::sqrt(Dot(b - a, b - a)) * 0.5f;
+        for (const Float3& p : points) {
+            float distance = std::sqrt(Dot(p - c, p - c));
+            if (distance > r) {
+                float grown = (r + distance) * 0.5f;
+                c = c + (p - c) * ((grown - r) / distance);
+                r = grown;
+            }
+        }
+        center[0] = c.x;
+        center[1] = c.y;
+        center[2] = c.z;
+        radius = r;
+    }
+
+    void ComputeBounds(const uint32_t* indices, size_t triangleCount, const std::vector<Float3>& normals,
+                       const uint32_t* triangles, const uint8_t* vertices, size_t stride, size_t positionOffset,
+                       mesh::Meshlet& meshlet) {
+        std::vector<Float3> points;
+        points.reserve(triangleCount * 3);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            points.push_back(LoadPosition(vertices, stride, positionOffset, indices[i]));
+        }
+        BoundingSphere(points, meshlet.center, meshlet.radius);
+
+        Float3 axis = { 0.0f, 0.0f, 0.0f };
+        for (size_t t = 0; t < triangleCount; t++) {
+            axis = axis + normals[triangles[t]];
+        }
+        axis = Normalize(axis);
+        float minDot = 1.0f;
+        for (size_t t = 0; t < triangleCount; t++) {
+            Float3 normal = normals[triangles[t]];
+            if (Dot(normal, normal) > 0.0f)
+                minDot = std::min(minDot, Dot(normal, axis));
+        }
+        meshlet.coneAxis[0] = axis.x;
+        meshlet.coneAxis[1] = axis.y;
+        meshlet.coneAxis[2] = axis.z;
+        // При раствора больше ~84 градусов кластер почти всегда виден частично, отсекать его бессмысленно.
+        meshlet.coneCutoff = minDot <= 0.1f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+    }
+}
+
+namespace mesh {
+    void BuildMeshlets(uint32_t* indices, size_t indexCount, const void* vertexData, size_t vertexCount, size_t stride,
+                       size_t positionOffset, std::vector<Meshlet>& meshlets) {
+        const uint8_t* vertices = static_cast<const uint8_t*>(vertexData);
+        size_t triangleCount = indexCount / 3;
+        meshlets.clear();
+
+        std::vector<Float3> normals(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++) {
+            Float3 a = LoadPosition(vertices, stride, positionOffset, indices[t * 3]);
+            Float3 b = LoadPosition(vertices, stride, positionOffset, indices[t * 3 + 1]);
+            Float3 c = LoadPosition(vertices, stride, positionOffset, indices[t * 3 + 2]);
+            normals[t] = Normalize(Cross(b - a, c - a));
+        }
+
+        // Треугольники каждой вершины в одном массиве.
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            offsets[indices[i] + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; v++) {
+            offsets[v + 1] += offsets[v];
+        }
+        std::vector<uint32_t> adjacency(triangleCount * 3);
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+        }
+
+        std::vector<uint8_t> used(triangleCount, 0);
+        std::vector<uint32_t> vertexMark(vertexCount, 0);      // номер кластера + 1, в который входит вершина
+        std::vector<uint32_t> candidateMark(triangleCount, 0); // номер кластера + 1, в кандидатах которого треугольник
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> order;                            // треугольники в порядке кластеров
+        order.reserve(triangleCount);
+        size_t scan = 0;
+        uint32_t seed = UINT32_MAX;
+
+        while (order.size() < triangleCount) {
+            uint32_t mark = (uint32_t)meshlets.size() + 1;
+            Meshlet meshlet = {};
+            meshlet.startIndex = (uint32_t)(order.size() * 3);
+            size_t first = order.size();
+            Float3 axis = { 0.0f, 0.0f, 0.0f };
+            candidates.clear();
+
+            // Новый кластер начинается рядом с предыдущим, если там остались треугольники.
+            if (seed == UINT32_MAX || used[seed]) {
+                while (used[scan]) {
+                    scan++;
+                }
+                seed = (uint32_t)scan;
+            }
+
+            uint32_t next = seed;
+            seed = UINT32_MAX;
+            while (next != UINT32_MAX) {
+                used[next] = 1;
+                order.push_back(next);
+                axis = axis + normals[next];
+                for (int k = 0; k < 3; k++) {
+                    uint32_t v = indices[next * 3 + k];
+                    if (vertexMark[v] != mark) {
+                        vertexMark[v] = mark;
+                        meshlet.vertexCount++;
+                    }
+                    for (uint32_t i = offsets[v]; i < offsets[v + 1]; i++) {
+                        uint32_t t = adjacency[i];
+                        if (!used[t] && candidateMark[t] != mark) {
+                            candidateMark[t] = mark;
+                            candidates.push_back(t);
+                        }
+                    }
+                }
+                if (order.size() - first == maxMeshletTriangles)
+                    break;
+
+                // Лучший сосед добавляет меньше всего новых вершин и ближе всего по нормали к кластеру.
+                Float3 direction = Normalize(axis);
+                float bestScore = 1e30f;
+                next = UINT32_MAX;
+                for (size_t i = 0; i < candidates.size();) {
+                    uint32_t t = candidates[i];
+                    if (used[t]) {
+                        candidates[i] = candidates.back();
+                        candidates.pop_back();
+                        continue;
+                    }
+                    i++;
+                    unsigned added = 0;
+                    for (int k = 0; k < 3; k++) {
+                        added += vertexMark[indices[t * 3 + k]] != mark;
+                    }
+                    if (meshlet.vertexCount + added > maxMeshletVertices)
+                        continue;
+                    float score = added + (1.0f - Dot(normals[t], direction));
+                    if (score < bestScore) {
+                        bestScore = score;
+                        next = t;
+                    }
+                }
+            }
+            for (uint32_t t : candidates) {
+                if (!used[t]) {
+                    seed = t;
+                    break;
+                }
+            }
+
+            size_t count = order.size() - first;
+            meshlet.indexCount = (uint32_t)(count * 3);
+            meshlets.push_back(meshlet);
+        }
+
+        std::vector<uint32_t> reordered(triangleCount * 3);
+        for (size_t i = 0; i < triangleCount; i++) {
+            memcpy(&reordered[i * 3], &indices[order[i] * 3], sizeof(uint32_t) * 3);
+        }
+        for (Meshlet& meshlet : meshlets) {
+            ComputeBounds(&reordered[meshlet.startIndex], meshlet.indexCount / 3, normals, &order[meshlet.startIndex / 3],
+                vertices, stride, positionOffset, meshlet);
+        }
+        memcpy(indices, reordered.data(), reordered.size() * sizeof(uint32_t));
+    }
+
+    void ExtractFrustumPlanes(const float* m, float planes[6][4]) {
+        // Столбцы матрицы: clip = (x, y, z, 1) * M, видимая область -w <= x, y <= w, 0 <= z <= w.
+        for (int i = 0; i < 4; i++) {
+            float x = m[i * 4], y = m[i * 4 + 1], z = m[i * 4 + 2], w = m[i * 4 + 3];
+            planes[0][i] = w + x;
+            planes[1][i] = w - x;
+            planes[2][i] = w + y;
+            planes[3][i] = w - y;
+            planes[4][i] = z;
+            planes[5][i] = w - z;
+        }
+        for (int p = 0; p < 6; p++) {
+            float length = std::sqrt(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+            if (length > 0.0f) {
+                for (int i = 0; i < 4; i++) {
+                    planes[p][i] /= length;
+                }
+            }
+        }
+    }
+
+    void MeshletCuller::Build(const std::vector<Meshlet>& meshlets) {
+        count_ = meshlets.size();
+        // Размер кратен четырем, лишние элементы всегда невидимы.
+        size_t padded = (count_ + 3) & ~(size_t)3;
+        for (auto* stream : { &centerX_, &centerY_, &centerZ_, &axisX_, &axisY_, &axisZ_, &cutoff_ }) {
+            stream->assign(padded, 0.0f);
+        }
+        radius_.assign(padded, -1e30f);
+        startIndex_.assign(padded, 0);
+        indexCount_.assign(padded, 0);
+        for (size_t i = 0; i < count_; i++) {
+            const Meshlet& meshlet = meshlets[i];
+            centerX_[i] = meshlet.center[0];
+            centerY_[i] = meshlet.center[1];
+            centerZ_[i] = meshlet.center[2];
+            radius_[i] = meshlet.radius;
+            axisX_[i] = meshlet.coneAxis[0];
+            axisY_[i] = meshlet.coneAxis[1];
+            axisZ_[i] = meshlet.coneAxis[2];
+            cutoff_[i] = meshlet.coneCutoff;
+            startIndex_[i] = meshlet.startIndex;
+            indexCount_[i] = meshlet.indexCount;
+        }
+    }
+
+    size_t MeshletCuller::Cull(const float planes[6][4], const float* camera, std::vector<IndexRange>& ranges) const {
+        ranges.clear();
+        size_t visibleCount = 0;
+        auto emit = [&](size_t i) {
+            visibleCount++;
+            if (!ranges.empty() && ranges.back().startIndex + ranges.back().indexCount == startIndex_[i])
+                ranges.back().indexCount += indexCount_[i];
+            else
+                ranges.push_back({ startIndex_[i], indexCount_[i] });
+        };
+
+#ifdef MESHLETS_SSE
+        __m128 plane[6][4];
+        for (int p = 0; p < 6; p++) {
+            for (int k = 0; k < 4; k++) {
+                plane[p][k] = _mm_set1_ps(planes[p][k]);
+            }
+        }
+        __m128 cameraX = _mm_set1_ps(camera[0]), cameraY = _mm_set1_ps(camera[1]), cameraZ = _mm_set1_ps(camera[2]);
+        __m128 zero = _mm_setzero_ps();
+
+        for (size_t i = 0; i < count_; i += 4) {
+            __m128 x = _mm_loadu_ps(&centerX_[i]);
+            __m128 y = _mm_loadu_ps(&centerY_[i]);
+            __m128 z = _mm_loadu_ps(&centerZ_[i]);
+            __m128 r = _mm_loadu_ps(&radius_[i]);
+
+            // Сфера видима, если ни одна плоскость не отделяет ее целиком.
+            __m128 visible = _mm_cmpge_ps(r, zero);
+            for (int p = 0; p < 6; p++) {
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, plane[p][0]), _mm_mul_ps(y, plane[p][1])),
+                    _mm_add_ps(_mm_mul_ps(z, plane[p][2]), plane[p][3]));
+                visible = _mm_and_ps(visible, _mm_cmpgt_ps(_mm_add_ps(distance, r), zero));
+            }
+
+            // Кластер обращен от камеры, если от нее отвернут весь конус нормалей с учетом размера сферы.
+            __m128 dx = _mm_sub_ps(x, cameraX), dy = _mm_sub_ps(y, cameraY), dz = _mm_sub_ps(z, cameraZ);
+            __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&axisX_[i])), _mm_mul_ps(dy, _mm_loadu_ps(&axisY_[i]))),
+                _mm_mul_ps(dz, _mm_loadu_ps(&axisZ_[i])));
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+            __m128 backFacing = _mm_cmpgt_ps(dot, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&cutoff_[i]), length), r));
+            int mask = _mm_movemask_ps(_mm_andnot_ps(backFacing, visible));
+
+            while (mask) {
+                int bit = 0;
+                while (!(mask & (1 << bit))) {
+                    bit++;
+                }
+                emit(i + bit);
+                mask &= mask - 1;
+            }
+        }
+#else
+        for (size_t i = 0; i < count_; i++) {
+            float x = centerX_[i], y = centerY_[i], z = centerZ_[i], r = radius_[i];
+            bool visible = true;
+            for (int p = 0; p < 6 && visible; p++) {
+                visible = x * planes[p][0] + y * planes[p][1] + z * planes[p][2] + planes[p][3] + r > 0.0f;
+            }
+            float dx = x - camera[0], dy = y - camera[1], dz = z - camera[2];
+            float dot = dx * axisX_[i] + dy * axisY_[i] + dz * axisZ_[i];
+            if (visible && !(dot > cutoff_[i] * std::sqrt(dx * dx + dy * dy + dz * dz) + r))
+                emit(i);
+        }
+#endif
+        return visibleCount;
+    }
+}
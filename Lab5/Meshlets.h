@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+
+// Разбиение мешей на кластеры (meshlets) и их отсечение на CPU. Треугольники кластера идут в индексном буфере
+// подряд, поэтому видимые кластеры рисуются диапазонами DrawIndexed без изменения буферов.
+namespace mesh {
+    const size_t maxMeshletVertices = 64;
+    const size_t maxMeshletTriangles = 124;
+
+    struct Meshlet {
+        uint32_t startIndex;
+        uint32_t indexCount;
+        uint32_t vertexCount;
+        float center[3];        // ограничивающая сфера
+        float radius;
+        float coneAxis[3];      // средняя нормаль
+        float coneCutoff;       // синус раствора конуса нормалей, 1 - кластер не отсекается по обратной стороне
+    };
+
+    struct IndexRange {
+        uint32_t startIndex;
+        uint32_t indexCount;
+    };
+
+    // Переставляет треугольники в indices так, чтобы каждый кластер занимал непрерывный диапазон.
+    void BuildMeshlets(uint32_t* indices, size_t indexCount, const void* vertices, size_t vertexCount, size_t stride,
+                       size_t positionOffset, std::vector<Meshlet>& meshlets);
+
+    // Нормализованные плоскости (a, b, c, d), a * x + b * y + c * z + d >= 0 внутри. Матрица 4x4 по строкам,
+    // векторы умножаются слева, как в DirectXMath.
+    void ExtractFrustumPlanes(const float* viewProjection, float planes[6][4]);
+
+    // Границы кластеров в виде структуры массивов для проверки по четыре кластера за раз.
+    class MeshletCuller {
+    public:
+        void Build(const std::vector<Meshlet>& meshlets);
+
+        // Камера и плоскости - в пространстве модели. Соседние видимые кластеры сливаются в один диапазон.
+        // Возвращает число видимых кластеров.
+        size_t Cull(const float planes[6][4], const float* cameraPosition, std::vector<IndexRange>& ranges) const;
+
+        size_t GetMeshletCount() const {
+            return count_;
+        };
+
+    private:
+        size_t count_ = 0;
+        std::vector<float> centerX_, centerY_, centerZ_, radius_;
+        std::vector<float> axisX_, axisY_, axisZ_, cutoff_;
+        std::vector<uint32_t> startIndex_, indexCount_;
+    };
+}
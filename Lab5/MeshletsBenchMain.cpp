@@ -0,0 +1,223 @@
+﻿// Замер и проверка Meshlets, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 MeshletsBenchMain.cpp Meshlets.cpp MeshOptimizer.cpp MeshGenerator.cpp -o meshlets
+// Примеры:
+//   ./meshlets
+//   ./meshlets --tessellation 1000 --views 100
+// Сфера 40x40 и большая UVSphere (700x700 - около миллиона треугольников) разбиваются на кластеры. Проверки:
+// набор треугольников не меняется, кластеры идут подряд, не больше 64 вершин и 124 треугольников, сфера кластера
+// содержит его вершины. Затем из случайных точек вокруг меша отсекаются кластеры: каждый лицевой треугольник с
+// вершиной внутри пирамиды видимости должен попасть в выданные диапазоны. Замер - кластеров в миллисекунду.
+#include "Meshlets.h"
+#include "MeshOptimizer.h"
+#include "MeshGenerator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace {
+    const size_t stride = 24;   // позиция + нормаль
+
+    double Milliseconds(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Матрицы как в DirectXMath: по строкам, вектор умножается слева, левая система координат.
+    void Multiply(const float* a, const float* b, float* out) {
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                float sum = 0.0f;
+                for (int k = 0; k < 4; k++) {
+                    sum += a[i * 4 + k] * b[k * 4 + j];
+                }
+                out[i * 4 + j] = sum;
+            }
+        }
+    }
+
+    void Normalize(float* v) {
+        float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        for (int i = 0; i < 3; i++) {
+            v[i] /= length;
+        }
+    }
+
+    void Cross(const float* a, const float* b, float* out) {
+        out[0] = a[1] * b[2] - a[2] * b[1];
+        out[1] = a[2] * b[0] - a[0] * b[2];
+        out[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    void LookAt(const float* eye, const float* at, float* view) {
+        const float up[3] = { 0.0f, 1.0f, 0.0f };
+        float x[3], y[3], z[3] = { at[0] - eye[0], at[1] - eye[1], at[2] - eye[2] };
+        Normalize(z);
+        Cross(up, z, x);
+        Normalize(x);
+        Cross(z, x, y);
+        const float* axes[3] = { x, y, z };
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) {
+                view[r * 4 + c] = axes[c][r];
+            }
+            view[r * 4 + 3] = 0.0f;
+        }
+        for (int c = 0; c < 3; c++) {
+            view[12 + c] = -(axes[c][0] * eye[0] + axes[c][1] * eye[1] + axes[c][2] * eye[2]);
+        }
+        view[15] = 1.0f;
+    }
+
+    // Обратная глубина, как в Renderer.
+    void Perspective(float fov, float aspect, float nearPlane, float farPlane, float* projection) {
+        float h = 1.0f / std::tan(fov / 2.0f), w = h / aspect, r = nearPlane / (nearPlane - farPlane);
+        const float m[16] = { w, 0, 0, 0, 0, h, 0, 0, 0, 0, r, 1, 0, 0, -r * farPlane, 0 };
+        memcpy(projection, m, sizeof(m));
+    }
+
+    bool Run(unsigned tessellation, unsigned views) {
+        mesh::MeshData sphere;
+        mesh::UVSphere(tessellation, tessellation, sphere);
+        std::vector<uint8_t> vertices(sphere.GetVertexCount() * stride);
+        mesh::WriteVertices(sphere, mesh::VertexLayout::Make(mesh::Position | mesh::Normal), vertices.data());
+        std::vector<uint32_t> indices = sphere.indices;
+        mesh::OptimizeMesh(vertices, stride, 0, indices);
+        size_t vertexCount = vertices.size() / stride, triangleCount = indices.size() / 3;
+
+        std::vector<std::array<uint32_t, 3>> before(triangleCount), after(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++) {
+            before[t] = { { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] } };
+        }
+        std::vector<mesh::Meshlet> meshlets;
+        auto start = std::chrono::steady_clock::now();
+        mesh::BuildMeshlets(indices.data(), indices.size(), vertices.data(), vertexCount, stride, 0, meshlets);
+        double buildMs = Milliseconds(start);
+        for (size_t t = 0; t < triangleCount; t++) {
+            after[t] = { { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] } };
+        }
+        std::sort(before.begin(), before.end());
+        std::sort(after.begin(), after.end());
+        bool same = before == after;
+
+        size_t invalid = 0, maxVertices = 0, maxTriangles = 0, coneClusters = 0;
+        uint32_t expected = 0;
+        double coneDegrees = 0.0;
+        for (const mesh::Meshlet& meshlet : meshlets) {
+            std::vector<uint32_t> unique(indices.begin() + meshlet.startIndex, indices.begin() + meshlet.startIndex + meshlet.indexCount);
+            std::sort(unique.begin(), unique.end());
+            unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+            invalid += meshlet.startIndex != expected || unique.size() != meshlet.vertexCount ||
+                unique.size() > mesh::maxMeshletVertices || meshlet.indexCount / 3 > mesh::maxMeshletTriangles;
+            expected += meshlet.indexCount;
+            maxVertices = std::max(maxVertices, unique.size());
+            maxTriangles = std::max<size_t>(maxTriangles, meshlet.indexCount / 3);
+            for (uint32_t v : unique) {
+                float p[3];
+                memcpy(p, &vertices[v * stride], 12);
+                float d[3] = { p[0] - meshlet.center[0], p[1] - meshlet.center[1], p[2] - meshlet.center[2] };
+                invalid += std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) > meshlet.radius * 1.0001f + 1e-6f;
+            }
+            if (meshlet.coneCutoff < 1.0f) {
+                coneClusters++;
+                coneDegrees += std::asin(meshlet.coneCutoff) * 180.0 / 3.14159265358979;
+            }
+        }
+        invalid += expected != indices.size();
+        bool ok = same && invalid == 0;
+        printf("UVSphere %u: %zu triangles -> %zu meshlets (%.1f triangles on average, at most %zu vertices and %zu triangles), "
+            "triangles %s, %zu invalid; %zu with a normal cone, %.1f deg on average; built in %.1f ms: %s\n", tessellation,
+            triangleCount, meshlets.size(), (double)triangleCount / meshlets.size(), maxVertices, maxTriangles,
+            same ? "same" : "DIFFER", invalid, coneClusters, coneDegrees / std::max<size_t>(coneClusters, 1), buildMs, ok ? "ok" : "FAILED");
+
+        mesh::MeshletCuller culler;
+        culler.Build(meshlets);
+        std::mt19937 random(3);
+        std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+        std::vector<mesh::IndexRange> ranges;
+        std::vector<char> drawn(triangleCount);
+        size_t visible = 0, drawCount = 0, missed = 0;
+        double cullMs = 0.0;
+        int repeats = std::max(1, int(2000000 / meshlets.size()));
+        for (unsigned view = 0; view < views; view++) {
+            float eye[3] = { uniform(random) * 3.0f, uniform(random) * 3.0f, uniform(random) * 3.0f };
+            float length = std::sqrt(eye[0] * eye[0] + eye[1] * eye[1] + eye[2] * eye[2]);
+            if (length < 1.3f) {
+                for (int i = 0; i < 3; i++) {
+                    eye[i] *= 1.5f / length;
+                }
+            }
+            float at[3] = { uniform(random) * 0.5f, uniform(random) * 0.5f, uniform(random) * 0.5f };
+            float viewMatrix[16], projection[16], viewProjection[16], planes[6][4];
+            LookAt(eye, at, viewMatrix);
+            Perspective(3.14159265f / 3.0f, 16.0f / 9.0f, 0.01f, 100.0f, projection);
+            Multiply(viewMatrix, projection, viewProjection);
+            mesh::ExtractFrustumPlanes(viewProjection, planes);
+
+            start = std::chrono::steady_clock::now();
+            size_t count = 0;
+            for (int r = 0; r < repeats; r++) {
+                count = culler.Cull(planes, eye, ranges);
+            }
+            cullMs += Milliseconds(start) / repeats;
+            visible += count;
+            drawCount += ranges.size();
+
+            std::fill(drawn.begin(), drawn.end(), 0);
+            for (const mesh::IndexRange& range : ranges) {
+                std::fill(drawn.begin() + range.startIndex / 3, drawn.begin() + (range.startIndex + range.indexCount) / 3, 1);
+            }
+            // Грани смотрят наружу, треугольник лицевой, если камера с внешней стороны его плоскости.
+            for (size_t t = 0; t < triangleCount; t++) {
+                if (drawn[t])
+                    continue;
+                float p[3][3];
+                for (int k = 0; k < 3; k++) {
+                    memcpy(p[k], &vertices[indices[t * 3 + k] * stride], 12);
+                }
+                float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+                float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] }, n[3];
+                Cross(e1, e2, n);
+                if (n[0] * (p[0][0] - eye[0]) + n[1] * (p[0][1] - eye[1]) + n[2] * (p[0][2] - eye[2]) >= 0.0f)
+                    continue;
+                bool inside = false;
+                for (int k = 0; k < 3 && !inside; k++) {
+                    bool in = true;
+                    for (int q = 0; q < 6; q++) {
+                        in = in && planes[q][0] * p[k][0] + planes[q][1] * p[k][1] + planes[q][2] * p[k][2] + planes[q][3] >= 0.0f;
+                    }
+                    inside = in;
+                }
+                missed += inside;
+            }
+        }
+        bool cullOk = missed == 0;
+        printf("  Cull over %u views: %.1f%% of meshlets visible, %.1f draws per view, %.4f ms per pass, %.0f meshlets/ms, "
+            "%zu visible triangles missed: %s\n", views, 100.0 * visible / (meshlets.size() * views), (double)drawCount / views,
+            cullMs / views, meshlets.size() / (cullMs / views), missed, cullOk ? "ok" : "FAILED");
+        return ok && cullOk;
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned tessellation = 700, views = 50;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--tessellation") && i + 1 < argc) {
+            tessellation = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--views") && i + 1 < argc) {
+            views = (unsigned)atoi(argv[++i]);
+        } else {
+            printf("meshlets [--tessellation <n>] [--views <n>]\n");
+            return 1;
+        }
+    }
+    views = std::max(views, 1u);
+
+    bool ok = Run(40, views);
+    ok = Run(tessellation, views) && ok;
+    return ok ? 0 : 1;
+}
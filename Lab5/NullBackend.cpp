@@ -0,0 +1,720 @@
+﻿#include "NullBackend.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+
+namespace {
+    const char* stageNames[] = { "VS", "PS" };
+}
+
+namespace gfx {
+    uint64_t NullBackend::Stats::TotalCalls() const {
+        uint64_t total = 0;
+        for (uint64_t count : calls) {
+            total += count;
+        }
+        return total;
+    }
+
+    uint32_t NullBackend::Allocate(ResourceType type) {
+        std::vector<uint8_t>& alive = alive_[(size_t)type];
+        alive.push_back(1);
+        return (uint32_t)alive.size();
+    }
+
+    bool NullBackend::IsAlive(ResourceType type, uint32_t id) const {
+        const std::vector<uint8_t>& alive = alive_[(size_t)type];
+        return id != 0 && id <= alive.size() && alive[id - 1] != 0;
+    }
+
+    bool NullBackend::CheckHandle(ResourceType type, uint32_t id, const char* call, bool allowEmpty) {
+        if (id == 0 ? allowEmpty : IsAlive(type, id))
+            return true;
+        Error(id == 0 ? "%s: empty handle" : "%s: handle %u is not a live resource", call, id);
+        return false;
+    }
+
+    void NullBackend::Error(const char* format, ...) {
+        stats_.errors++;
+        if (messages_.size() >= maxMessages)
+            return;
+        char message[256];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(message, sizeof(message), format, args);
+        va_end(args);
+        messages_.emplace_back(message);
+    }
+
+    BufferHandle NullBackend::CreateBuffer(const BufferDesc& desc, const void* initialData) {
+        stats_.calls[(size_t)Command::CreateBuffer]++;
+        BufferHandle handle;
+        if (desc.size == 0 || desc.bindFlags == 0) {
+            Error("CreateBuffer: empty size or bind flags");
+            return handle;
+        }
+        if ((desc.bindFlags & BindConstantBuffer) && (desc.bindFlags != BindConstantBuffer || desc.size % 16 != 0)) {
+            Error("CreateBuffer: constant buffer of %zu bytes must be a multiple of 16 and bound alone", desc.size);
+            return handle;
+        }
+        if (desc.bindFlags & (BindRenderTarget | BindDepthStencil)) {
+            Error("CreateBuffer: buffers cannot be render targets or depth buffers");
+            return handle;
+        }
+        if (desc.usage == Usage::Immutable && initialData == nullptr) {
+            Error("CreateBuffer: immutable buffer without initial data");
+            return handle;
+        }
+        handle.id = Allocate(ResourceType::Buffer);
+        buffers_.resize(handle.id);
+        BufferRecord& record = buffers_[handle.id - 1];
+        record.desc = desc;
+        record.data.resize(desc.size);
+        if (initialData != nullptr) {
+            memcpy(record.data.data(), initialData, desc.size);
+        }
+        return handle;
+    }
+
+    TextureHandle NullBackend::CreateTexture(const TextureDesc& desc, const void* initialData) {
+        stats_.calls[(size_t)Command::CreateTexture]++;
+        (void)initialData;
+        TextureHandle handle;
+        unsigned maxLevels = 1;
+        for (unsigned size = desc.width > desc.height ? desc.width : desc.height; size > 1; size /= 2) {
+            maxLevels++;
+        }
+        if (desc.width == 0 || desc.height == 0 || FormatSize(desc.format) == 0 || desc.arraySize == 0) {
+            Error("CreateTexture: empty size or unknown format");
+            return handle;
+        }
+        if (desc.mipLevels == 0 || desc.mipLevels > maxLevels) {
+            Error("CreateTexture: %u mip levels for %ux%u", desc.mipLevels, desc.width, desc.height);
+            return handle;
+        }
+        if (desc.cube && (desc.arraySize % 6 != 0 || desc.width != desc.height)) {
+            Error("CreateTexture: cube texture needs square faces and a multiple of 6 slices");
+            return handle;
+        }
+        if ((desc.bindFlags & ~(uint32_t)(BindShaderResource | BindRenderTarget | BindDepthStencil)) != 0) {
+            Error("CreateTexture: textures can only be shader resources, render targets and depth buffers");
+            return handle;
+        }
+        if ((desc.bindFlags == BindDepthStencil) != (desc.format == Format::D32_FLOAT)) {
+            Error("CreateTexture: depth buffers are D32_FLOAT textures without other bind flags");
+            return handle;
+        }
+        handle.id = Allocate(ResourceType::Texture);
+        textures_.resize(handle.id);
+        textures_[handle.id - 1] = desc;
+        return handle;
+    }
+
+    ShaderResourceViewHandle NullBackend::CreateShaderResourceView(TextureHandle texture) {
+        stats_.calls[(size_t)Command::CreateShaderResourceView]++;
+        ShaderResourceViewHandle handle;
+        if (!CheckHandle(ResourceType::Texture, texture.id, "CreateShaderResourceView", false))
+            return handle;
+        if (!(textures_[texture.id - 1].bindFlags & BindShaderResource)) {
+            Error("CreateShaderResourceView: texture %u is not bindable as a shader resource", texture.id);
+            return handle;
+        }
+        handle.id = Allocate(ResourceType::ShaderResourceView);
+        shaderResourceViews_.resize(handle.id);
+        shaderResourceViews_[handle.id - 1].texture = texture.id;
+        return handle;
+    }
+
+    RenderTargetViewHandle NullBackend::CreateRenderTargetView(TextureHandle texture, unsigned mipLevel, unsigned arraySlice) {
+        stats_.calls[(size_t)Command::CreateRenderTargetView]++;
+        RenderTargetViewHandle handle;
+        if (!CheckHandle(ResourceType::Texture, texture.id, "CreateRenderTargetView", false))
+            return handle;
+        const TextureDesc& desc = textures_[texture.id - 1];
+        if (!(desc.bindFlags & BindRenderTarget)) {
+            Error("CreateRenderTargetView: texture %u is not bindable as a render target", texture.id);
+            return handle;
+        }
+        if (mipLevel >= desc.mipLevels || arraySlice >= desc.arraySize) {
+            Error("CreateRenderTargetView: level %u slice %u out of range", mipLevel, arraySlice);
+            return handle;
+        }
+        handle.id = Allocate(ResourceType::RenderTargetView);
+        renderTargetViews_.resize(handle.id);
+        ViewRecord& view = renderTargetViews_[handle.id - 1];
+        view.texture = texture.id;
+        view.mipLevel = mipLevel;
+        view.arraySlice = arraySlice;
+        return handle;
+    }
+
+    DepthStencilViewHandle NullBackend::CreateDepthStencilView(TextureHandle texture) {
+        stats_.calls[(size_t)Command::CreateDepthStencilView]++;
+        DepthStencilViewHandle handle;
+        if (!CheckHandle(ResourceType::Texture, texture.id, "CreateDepthStencilView", false))
+            return handle;
+        if (!(textures_[texture.id - 1].bindFlags & BindDepthStencil)) {
+            Error("CreateDepthStencilView: texture %u is not bindable as a depth buffer", texture.id);
+            return handle;
+        }
+        handle.id = Allocate(ResourceType::DepthStencilView);
+        depthStencilViews_.resize(handle.id);
+        depthStencilViews_[handle.id - 1].texture = texture.id;
+        return handle;
+    }
+
+    VertexShaderHandle NullBackend::CreateVertexShader(const void* bytecode, size_t size) {
+        stats_.calls[(size_t)Command::CreateVertexShader]++;
+        VertexShaderHandle handle;
+        if (bytecode == nullptr || size == 0) {
+            Error("CreateVertexShader: empty bytecode");
+            return handle;
+        }
+        handle.id = Allocate(ResourceType::VertexShader);
+        return handle;
+    }
+
+    PixelShaderHandle NullBackend::CreatePixelShader(const void* bytecode, size_t size) {
+        stats_.calls[(size_t)Command::CreatePixelShader]++;
+        PixelShaderHandle handle;
+        if (bytecode == nullptr || size == 0) {
+            Error("CreatePixelShader: empty bytecode");
+            return handle;
+        }
+        handle.id = Allocate(ResourceType::PixelShader);
+        return handle;
+    }
+
+    InputLayoutHandle NullBackend::CreateInputLayout(const InputElement* elements, unsigned count, const void* bytecode, size_t size) {
+        stats_.calls[(size_t)Command::CreateInputLayout]++;
+        InputLayoutHandle handle;
+        if (elements == nullptr || count == 0 || bytecode == nullptr || size == 0) {
+            Error("CreateInputLayout: no elements or empty bytecode");
+            return handle;
+        }
+        LayoutRecord record;
+        for (unsigned i = 0; i < count; i++) {
+            const InputElement& element = elements[i];
+            if (element.semanticName == nullptr || FormatSize(element.format) == 0 || element.slot >= maxVertexBuffers) {
+                Error("CreateInputLayout: element %u has no name, an unknown format or slot %u", i, element.slot);
+                return handle;
+            }
+            uint32_t bit = 1u << element.slot;
+            if ((element.perInstance ? record.vertexSlots : record.instanceSlots) & bit) {
+                Error("CreateInputLayout: slot %u mixes per-vertex and per-instance data", element.slot);
+                return handle;
+            }
+            (element.perInstance ? record.instanceSlots : record.vertexSlots) |= bit;
+            record.elements.push_back(element);
+            record.elements.back().semanticName = nullptr;
+            record.names.emplace_back(element.semanticName);
+        }
+        handle.id = Allocate(ResourceType::InputLayout);
+        layouts_.resize(handle.id);
+        layouts_[handle.id - 1] = std::move(record);
+        return handle;
+    }
+
+    SamplerHandle NullBackend::CreateSampler(const SamplerDesc& desc) {
+        stats_.calls[(size_t)Command::CreateSampler]++;
+        SamplerHandle handle;
+        handle.id = Allocate(ResourceType::Sampler);
+        samplers_.resize(handle.id);
+        samplers_[handle.id - 1] = desc;
+        return handle;
+    }
+
+    RasterizerStateHandle NullBackend::CreateRasterizerState(const RasterizerDesc& desc) {
+        stats_.calls[(size_t)Command::CreateRasterizerState]++;
+        RasterizerStateHandle handle;
+        handle.id = Allocate(ResourceType::RasterizerState);
+        rasterizerStates_.resize(handle.id);
+        rasterizerStates_[handle.id - 1] = desc;
+        return handle;
+    }
+
+    DepthStencilStateHandle NullBackend::CreateDepthStencilState(const DepthStencilDesc& desc) {
+        stats_.calls[(size_t)Command::CreateDepthStencilState]++;
+        DepthStencilStateHandle handle;
+        handle.id = Allocate(ResourceType::DepthStencilState);
+        depthStencilStates_.resize(handle.id);
+        depthStencilStates_[handle.id - 1] = desc;
+        return handle;
+    }
+
+    void NullBackend::ReleaseResource(ResourceType type, uint32_t id) {
+        stats_.calls[(size_t)Command::Release]++;
+        if (!CheckHandle(type, id, "Release", false))
+            return;
+        if (type == ResourceType::Buffer) {
+            BufferRecord& record = buffers_[id - 1];
+            if (record.mapped) {
+                Error("Release: buffer %u is still mapped", id);
+                record.mapped = false;
+                mappedCount_--;
+            }
+            std::vector<uint8_t>().swap(record.data);
+        }
+        alive_[(size_t)type][id - 1] = 0;
+    }
+
+    void NullBackend::ClearState() {
+        stats_.calls[(size_t)Command::ClearState]++;
+        viewportSet_ = false;
+        renderTarget_ = 0;
+        depthTarget_ = 0;
+        for (VertexBinding& binding : vertexBuffers_) {
+            binding = VertexBinding();
+        }
+        indexBuffer_ = 0;
+        indexOffset_ = 0;
+        inputLayout_ = 0;
+        topology_ = Topology::Undefined;
+        vertexShader_ = 0;
+        pixelShader_ = 0;
+        memset(constantBuffers_, 0, sizeof(constantBuffers_));
+        memset(shaderResources_, 0, sizeof(shaderResources_));
+        memset(boundSamplers_, 0, sizeof(boundSamplers_));
+        memset(constantBufferSlots_, 0, sizeof(constantBufferSlots_));
+        memset(shaderResourceSlots_, 0, sizeof(shaderResourceSlots_));
+        rasterizerState_ = 0;
+        depthStencilState_ = 0;
+    }
+
+    void NullBackend::SetViewport(const Viewport& viewport) {
+        stats_.calls[(size_t)Command::SetViewport]++;
+        if (viewport.width <= 0.0f || viewport.height <= 0.0f || viewport.minDepth > viewport.maxDepth) {
+            Error("SetViewport: empty viewport %gx%g", viewport.width, viewport.height);
+            return;
+        }
+        viewportSet_ = true;
+    }
+
+    void NullBackend::SetScissorRect(const Rect& rect) {
+        stats_.calls[(size_t)Command::SetScissorRect]++;
+        if (rect.right < rect.left || rect.bottom < rect.top) {
+            Error("SetScissorRect: inverted rectangle");
+        }
+    }
+
+    void NullBackend::SetRenderTarget(RenderTargetViewHandle target, DepthStencilViewHandle depth) {
+        stats_.calls[(size_t)Command::SetRenderTarget]++;
+        if (!CheckHandle(ResourceType::RenderTargetView, target.id, "SetRenderTarget", true) ||
+            !CheckHandle(ResourceType::DepthStencilView, depth.id, "SetRenderTarget", true))
+            return;
+        if (target.IsValid() && depth.IsValid()) {
+            const ViewRecord& view = renderTargetViews_[target.id - 1];
+            const TextureDesc& color = textures_[view.texture - 1];
+            const TextureDesc& buffer = textures_[depthStencilViews_[depth.id - 1].texture - 1];
+            unsigned width = color.width >> view.mipLevel, height = color.height >> view.mipLevel;
+            if (buffer.width != (width > 1 ? width : 1) || buffer.height != (height > 1 ? height : 1)) {
+                Error("SetRenderTarget: depth buffer %ux%u does not match the target %ux%u", buffer.width, buffer.height,
+                    width, height);
+                return;
+            }
+        }
+        renderTarget_ = target.id;
+        depthTarget_ = depth.id;
+    }
+
+    void NullBackend::ClearRenderTarget(RenderTargetViewHandle target, const float color[4]) {
+        stats_.calls[(size_t)Command::ClearRenderTarget]++;
+        (void)color;
+        CheckHandle(ResourceType::RenderTargetView, target.id, "ClearRenderTarget", false);
+    }
+
+    void NullBackend::ClearDepthStencil(DepthStencilViewHandle target, float depth) {
+        stats_.calls[(size_t)Command::ClearDepthStencil]++;
+        if (CheckHandle(ResourceType::DepthStencilView, target.id, "ClearDepthStencil", false) && !(depth >= 0.0f && depth <= 1.0f)) {
+            Error("ClearDepthStencil: depth %g is outside 0..1", depth);
+        }
+    }
+
+    void NullBackend::SetVertexBuffer(unsigned slot, BufferHandle buffer, unsigned stride, unsigned offset) {
+        stats_.calls[(size_t)Command::SetVertexBuffer]++;
+        if (slot >= maxVertexBuffers) {
+            Error("SetVertexBuffer: slot %u out of range", slot);
+            return;
+        }
+        if (!CheckHandle(ResourceType::Buffer, buffer.id, "SetVertexBuffer", true))
+            return;
+        if (buffer.IsValid() && !(buffers_[buffer.id - 1].desc.bindFlags & BindVertexBuffer)) {
+            Error("SetVertexBuffer: buffer %u is not a vertex buffer", buffer.id);
+            return;
+        }
+        if (buffer.IsValid() && stride == 0) {
+            Error("SetVertexBuffer: zero stride in slot %u", slot);
+            return;
+        }
+        vertexBuffers_[slot].buffer = buffer.id;
+        vertexBuffers_[slot].stride = stride;
+        vertexBuffers_[slot].offset = offset;
+    }
+
+    void NullBackend::SetIndexBuffer(BufferHandle buffer, unsigned offset) {
+        stats_.calls[(size_t)Command::SetIndexBuffer]++;
+        if (!CheckHandle(ResourceType::Buffer, buffer.id, "SetIndexBuffer", true))
+            return;
+        if (buffer.IsValid() && !(buffers_[buffer.id - 1].desc.bindFlags & BindIndexBuffer)) {
+            Error("SetIndexBuffer: buffer %u is not an index buffer", buffer.id);
+            return;
+        }
+        if (offset % 4 != 0) {
+            Error("SetIndexBuffer: offset %u is not aligned to the index size", offset);
+            return;
+        }
+        indexBuffer_ = buffer.id;
+        indexOffset_ = offset;
+    }
+
+    void NullBackend::SetInputLayout(InputLayoutHandle layout) {
+        stats_.calls[(size_t)Command::SetInputLayout]++;
+        if (CheckHandle(ResourceType::InputLayout, layout.id, "SetInputLayout", true)) {
+            inputLayout_ = layout.id;
+        }
+    }
+
+    void NullBackend::SetPrimitiveTopology(Topology topology) {
+        stats_.calls[(size_t)Command::SetPrimitiveTopology]++;
+        topology_ = topology;
+    }
+
+    void NullBackend::SetVertexShader(VertexShaderHandle shader) {
+        stats_.calls[(size_t)Command::SetVertexShader]++;
+        if (CheckHandle(ResourceType::VertexShader, shader.id, "SetVertexShader", true)) {
+            vertexShader_ = shader.id;
+        }
+    }
+
+    void NullBackend::SetPixelShader(PixelShaderHandle shader) {
+        stats_.calls[(size_t)Command::SetPixelShader]++;
+        if (CheckHandle(ResourceType::PixelShader, shader.id, "SetPixelShader", true)) {
+            pixelShader_ = shader.id;
+        }
+    }
+
+    void NullBackend::SetConstantBuffers(ShaderStage stage, unsigned slot, unsigned count, const BufferHandle* buffers) {
+        stats_.calls[(size_t)Command::SetConstantBuffers]++;
+        if (slot + count > maxConstantBuffers) {
+            Error("SetConstantBuffers: %s slots %u..%u out of range", stageNames[(size_t)stage], slot, slot + count);
+            return;
+        }
+        for (unsigned i = 0; i < count; i++) {
+            uint32_t id = buffers[i].id;
+            if (!CheckHandle(ResourceType::Buffer, id, "SetConstantBuffers", true))
+                continue;
+            if (id != 0 && !(buffers_[id - 1].desc.bindFlags & BindConstantBuffer)) {
+                Error("SetConstantBuffers: buffer %u is not a constant buffer", id);
+                continue;
+            }
+            constantBuffers_[(size_t)stage][slot + i] = id;
+        }
+        if (slot + count > constantBufferSlots_[(size_t)stage]) {
+            constantBufferSlots_[(size_t)stage] = slot + count;
+        }
+    }
+
+    void NullBackend::SetShaderResources(ShaderStage stage, unsigned slot, unsigned count, const ShaderResourceViewHandle* views) {
+        stats_.calls[(size_t)Command::SetShaderResources]++;
+        if (slot + count > maxShaderResources) {
+            Error("SetShaderResources: %s slots %u..%u out of range", stageNames[(size_t)stage], slot, slot + count);
+            return;
+        }
+        for (unsigned i = 0; i < count; i++) {
+            if (CheckHandle(ResourceType::ShaderResourceView, views[i].id, "SetShaderResources", true)) {
+                shaderResources_[(size_t)stage][slot + i] = views[i].id;
+            }
+        }
+        if (slot + count > shaderResourceSlots_[(size_t)stage]) {
+            shaderResourceSlots_[(size_t)stage] = slot + count;
+        }
+    }
+
+    void NullBackend::SetSamplers(ShaderStage stage, unsigned slot, unsigned count, const SamplerHandle* samplers) {
+        stats_.calls[(size_t)Command::SetSamplers]++;
+        if (slot + count > maxSamplers) {
+            Error("SetSamplers: %s slots %u..%u out of range", stageNames[(size_t)stage], slot, slot + count);
+            return;
+        }
+        for (unsigned i = 0; i < count; i++) {
+            if (CheckHandle(ResourceType::Sampler, samplers[i].id, "SetSamplers", true)) {
+                boundSamplers_[(size_t)stage][slot + i] = samplers[i].id;
+            }
+        }
+    }
+
+    void NullBackend::SetRasterizerState(RasterizerStateHandle state) {
+        stats_.calls[(size_t)Command::SetRasterizerState]++;
+        if (CheckHandle(ResourceType::RasterizerState, state.id, "SetRasterizerState", true)) {
+            rasterizerState_ = state.id;
+        }
+    }
+
+    void NullBackend::SetDepthStencilState(DepthStencilStateHandle state) {
+        stats_.calls[(size_t)Command::SetDepthStencilState]++;
+        if (CheckHandle(ResourceType::DepthStencilState, state.id, "SetDepthStencilState", true)) {
+            depthStencilState_ = state.id;
+        }
+    }
+
+    void NullBackend::UpdateBuffer(BufferHandle buffer, const void* data, size_t size) {
+        stats_.calls[(size_t)Command::UpdateBuffer]++;
+        if (!CheckHandle(ResourceType::Buffer, buffer.id, "UpdateBuffer", false))
+            return;
+        BufferRecord& record = buffers_[buffer.id - 1];
+        if (record.desc.usage != Usage::Default) {
+            Error("UpdateBuffer: buffer %u is not a default-usage buffer", buffer.id);
+            return;
+        }
+        if (data == nullptr || size == 0 || size > record.desc.size ||
+            ((record.desc.bindFlags & BindConstantBuffer) && size != record.desc.size)) {
+            Error("UpdateBuffer: %zu bytes for buffer %u of %zu bytes", size, buffer.id, record.desc.size);
+            return;
+        }
+        memcpy(record.data.data(), data, size);
+        stats_.uploadedBytes += size;
+    }
+
+    void NullBackend::UpdateBufferRange(BufferHandle buffer, size_t offset, const void* data, size_t size) {
+        stats_.calls[(size_t)Command::UpdateBufferRange]++;
+        if (!CheckHandle(ResourceType::Buffer, buffer.id, "UpdateBufferRange", false))
+            return;
+        BufferRecord& record = buffers_[buffer.id - 1];
+        if (record.desc.usage != Usage::Default || (record.desc.bindFlags & BindConstantBuffer)) {
+            Error("UpdateBufferRange: buffer %u is not a default-usage non-constant buffer", buffer.id);
+            return;
+        }
+        if (data == nullptr || size == 0 || offset > record.desc.size || size > record.desc.size - offset) {
+            Error("UpdateBufferRange: %zu bytes at %zu for buffer %u of %zu bytes", size, offset, buffer.id, record.desc.size);
+            return;
+        }
+        memcpy(record.data.data() + offset, data, size);
+        stats_.uploadedBytes += size;
+    }
+
+    void* NullBackend::Map(BufferHandle buffer) {
+        stats_.calls[(size_t)Command::Map]++;
+        if (!CheckHandle(ResourceType::Buffer, buffer.id, "Map", false))
+            return nullptr;
+        BufferRecord& record = buffers_[buffer.id - 1];
+        if (record.desc.usage != Usage::Dynamic) {
+            Error("Map: buffer %u is not dynamic", buffer.id);
+            return nullptr;
+        }
+        if (record.mapped) {
+            Error("Map: buffer %u is already mapped", buffer.id);
+            return nullptr;
+        }
+        record.mapped = true;
+        mappedCount_++;
+        stats_.uploadedBytes += record.desc.size;
+        return record.data.data();
+    }
+
+    void NullBackend::Unmap(BufferHandle buffer) {
+        stats_.calls[(size_t)Command::Unmap]++;
+        if (!CheckHandle(ResourceType::Buffer, buffer.id, "Unmap", false))
+            return;
+        BufferRecord& record = buffers_[buffer.id - 1];
+        if (!record.mapped) {
+            Error("Unmap: buffer %u is not mapped", buffer.id);
+            return;
+        }
+        record.mapped = false;
+        mappedCount_--;
+    }
+
+    bool NullBackend::ValidateDraw(const char* call) {
+        // Ресурсы могли быть освобождены после привязки, поэтому проверяются на каждой отрисовке.
+        bool valid = true;
+        if (!IsAlive(ResourceType::VertexShader, vertexShader_) || !IsAlive(ResourceType::PixelShader, pixelShader_)) {
+            Error("%s: vertex or pixel shader is not bound", call);
+            valid = false;
+        }
+        if (!IsAlive(ResourceType::InputLayout, inputLayout_)) {
+            Error("%s: input layout is not bound", call);
+            valid = false;
+        }
+        if (topology_ == Topology::Undefined) {
+            Error("%s: primitive topology is not set", call);
+            valid = false;
+        }
+        if (!viewportSet_ || !IsAlive(ResourceType::RenderTargetView, renderTarget_)) {
+            Error("%s: viewport or render target is not set", call);
+            valid = false;
+        }
+        if ((depthTarget_ != 0 && !IsAlive(ResourceType::DepthStencilView, depthTarget_)) ||
+            (depthStencilState_ != 0 && !IsAlive(ResourceType::DepthStencilState, depthStencilState_))) {
+            Error("%s: depth buffer or depth state was released", call);
+            valid = false;
+        }
+        if (mappedCount_ != 0) {
+            Error("%s: %zu buffers are still mapped", call, mappedCount_);
+            valid = false;
+        }
+        if (valid) {
+            const LayoutRecord& layout = layouts_[inputLayout_ - 1];
+            uint32_t slots = layout.vertexSlots | layout.instanceSlots;
+            for (unsigned slot = 0; slot < maxVertexBuffers; slot++) {
+                if ((slots & (1u << slot)) && !IsAlive(ResourceType::Buffer, vertexBuffers_[slot].buffer)) {
+                    Error("%s: input layout reads slot %u without a vertex buffer", call, slot);
+                    valid = false;
+                }
+            }
+        }
+        uint32_t targetTexture = valid ? renderTargetViews_[renderTarget_ - 1].texture : 0;
+        for (size_t stage = 0; stage < 2; stage++) {
+            for (unsigned slot = 0; slot < constantBufferSlots_[stage]; slot++) {
+                uint32_t id = constantBuffers_[stage][slot];
+                if (id != 0 && !IsAlive(ResourceType::Buffer, id)) {
+                    Error("%s: %s constant buffer %u was released", call, stageNames[stage], slot);
+                    valid = false;
+                }
+            }
+            for (unsigned slot = 0; slot < shaderResourceSlots_[stage]; slot++) {
+                uint32_t id = shaderResources_[stage][slot];
+                if (id == 0)
+                    continue;
+                if (!IsAlive(ResourceType::ShaderResourceView, id)) {
+                    Error("%s: %s shader resource %u was released", call, stageNames[stage], slot);
+                    valid = false;
+                }
+                else if (shaderResourceViews_[id - 1].texture == targetTexture) {
+                    Error("%s: texture %u is both the render target and %s resource %u", call, targetTexture, stageNames[stage], slot);
+                    valid = false;
+                }
+            }
+        }
+        return valid;
+    }
+
+    void NullBackend::CheckVertexRange(const char* call, uint32_t slots, uint64_t count, uint64_t start) {
+        for (unsigned slot = 0; slot < maxVertexBuffers; slot++) {
+            if (!(slots & (1u << slot)))
+                continue;
+            const VertexBinding& binding = vertexBuffers_[slot];
+            uint64_t end = binding.offset + (start + count) * binding.stride;
+            if (end > buffers_[binding.buffer - 1].desc.size) {
+                Error("%s: slot %u reads up to byte %llu of buffer %u of %zu bytes", call, slot, (unsigned long long)end,
+                    binding.buffer, buffers_[binding.buffer - 1].desc.size);
+            }
+        }
+    }
+
+    void NullBackend::Draw(unsigned vertexCount, unsigned startVertex) {
+        stats_.calls[(size_t)Command::Draw]++;
+        if (!ValidateDraw("Draw"))
+            return;
+        const LayoutRecord& layout = layouts_[inputLayout_ - 1];
+        CheckVertexRange("Draw", layout.vertexSlots, vertexCount, startVertex);
+        CheckVertexRange("Draw", layout.instanceSlots, 1, 0);
+        stats_.draws++;
+        stats_.instances++;
+        stats_.primitives += vertexCount / 3;
+    }
+
+    void NullBackend::DrawIndexed(unsigned indexCount, unsigned startIndex, int baseVertex) {
+        (void)baseVertex;
+        stats_.calls[(size_t)Command::DrawIndexed]++;
+        DrawIndices("DrawIndexed", indexCount, 1, startIndex, 0);
+    }
+
+    void NullBackend::DrawIndexedInstanced(unsigned indexCount, unsigned instanceCount, unsigned startIndex, int baseVertex,
+                                           unsigned startInstance) {
+        stats_.calls[(size_t)Command::DrawIndexedInstanced]++;
+        (void)baseVertex;
+        if (instanceCount == 0) {
+            Error("DrawIndexedInstanced: zero instances");
+            return;
+        }
+        DrawIndices("DrawIndexedInstanced", indexCount, instanceCount, startIndex, startInstance);
+    }
+
+    // Индексы вершин не читаются, поэтому baseVertex и диапазон вершинных буферов на вершину не проверяются.
+    void NullBackend::DrawIndices(const char* call, unsigned indexCount, unsigned instanceCount, unsigned startIndex,
+                                  unsigned startInstance) {
+        if (!ValidateDraw(call))
+            return;
+        if (!IsAlive(ResourceType::Buffer, indexBuffer_)) {
+            Error("%s: index buffer is not bound", call);
+            return;
+        }
+        uint64_t end = indexOffset_ + ((uint64_t)startIndex + indexCount) * 4;
+        if (end > buffers_[indexBuffer_ - 1].desc.size) {
+            Error("%s: indices %u..%u past the end of buffer %u", call, startIndex, startIndex + indexCount, indexBuffer_);
+            return;
+        }
+        CheckVertexRange(call, layouts_[inputLayout_ - 1].instanceSlots, instanceCount, startInstance);
+        stats_.draws++;
+        stats_.instances += instanceCount;
+        stats_.primitives += (uint64_t)indexCount / 3 * instanceCount;
+    }
+
+    bool NullBackend::Describe(ResourceType type, uint32_t id, ResourceInfo& info) const {
+        if (!IsAlive(type, id))
+            return false;
+        switch (type) {
+        case ResourceType::Buffer:
+            info.buffer = buffers_[id - 1].desc;
+            info.contents = buffers_[id - 1].data.data();
+            break;
+        case ResourceType::Texture:
+            info.texture = textures_[id - 1];
+            break;
+        case ResourceType::ShaderResourceView:
+        case ResourceType::RenderTargetView: {
+            const ViewRecord& view = (type == ResourceType::ShaderResourceView ? shaderResourceViews_ : renderTargetViews_)[id - 1];
+            info.viewTexture = view.texture;
+            info.mipLevel = view.mipLevel;
+            info.arraySlice = view.arraySlice;
+            info.texture = textures_[view.texture - 1];
+            break;
+        }
+        case ResourceType::DepthStencilView:
+            info.viewTexture = depthStencilViews_[id - 1].texture;
+            info.texture = textures_[info.viewTexture - 1];
+            break;
+        case ResourceType::InputLayout: {
+            const LayoutRecord& layout = layouts_[id - 1];
+            info.elements = layout.elements;
+            for (size_t i = 0; i < layout.elements.size(); i++) {
+                info.elements[i].semanticName = layout.names[i].c_str();
+            }
+            break;
+        }
+        case ResourceType::Sampler:
+            info.sampler = samplers_[id - 1];
+            break;
+        case ResourceType::RasterizerState:
+            info.rasterizer = rasterizerStates_[id - 1];
+            break;
+        case ResourceType::DepthStencilState:
+            info.depthStencil = depthStencilStates_[id - 1];
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    void NullBackend::ResetStats() {
+        stats_ = Stats();
+        messages_.clear();
+    }
+
+    const uint8_t* NullBackend::GetBufferData(BufferHandle buffer) const {
+        return IsAlive(ResourceType::Buffer, buffer.id) ? buffers_[buffer.id - 1].data.data() : nullptr;
+    }
+
+    size_t NullBackend::GetLiveResourceCount() const {
+        size_t count = 0;
+        for (const std::vector<uint8_t>& alive : alive_) {
+            for (uint8_t flag : alive) {
+                count += flag;
+            }
+        }
+        return count;
+    }
+}
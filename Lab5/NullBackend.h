@@ -0,0 +1,160 @@
+﻿#pragma once
+
+#include "RenderBackend.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+namespace gfx {
+    // Бэкенд без GPU: ведет таблицы ресурсов и привязанное состояние, проверяет вызовы по правилам D3D11
+    // (флаги привязки, Map только для Dynamic, диапазоны индексов и вершин, незаполненный конвейер перед
+    // отрисовкой, один и тот же ресурс как цель и как SRV) и считает их. Содержимое буферов хранится, чтобы
+    // его можно было проверить. Нужен для замеров CPU-стоимости кадра и для запуска рендера вне Windows.
+    class NullBackend : public RenderBackend {
+    public:
+        static const size_t maxMessages = 64;   // сохраняемых сообщений об ошибках, остальные только считаются
+
+        struct Stats {
+            uint64_t calls[(size_t)Command::Count] = {};
+            uint64_t draws = 0;                 // вызовы Draw*
+            uint64_t instances = 0;
+            uint64_t primitives = 0;            // вершин или индексов с учетом экземпляров / 3
+            uint64_t uploadedBytes = 0;         // UpdateBuffer, UpdateBufferRange и Map
+            uint64_t errors = 0;
+
+            uint64_t TotalCalls() const;
+        };
+
+        BufferHandle CreateBuffer(const BufferDesc& desc, const void* initialData = nullptr) override;
+        TextureHandle CreateTexture(const TextureDesc& desc, const void* initialData = nullptr) override;
+        ShaderResourceViewHandle CreateShaderResourceView(TextureHandle texture) override;
+        RenderTargetViewHandle CreateRenderTargetView(TextureHandle texture, unsigned mipLevel = 0, unsigned arraySlice = 0) override;
+        DepthStencilViewHandle CreateDepthStencilView(TextureHandle texture) override;
+        VertexShaderHandle CreateVertexShader(const void* bytecode, size_t size) override;
+        PixelShaderHandle CreatePixelShader(const void* bytecode, size_t size) override;
+        InputLayoutHandle CreateInputLayout(const InputElement* elements, unsigned count, const void* bytecode, size_t size) override;
+        SamplerHandle CreateSampler(const SamplerDesc& desc) override;
+        RasterizerStateHandle CreateRasterizerState(const RasterizerDesc& desc) override;
+        DepthStencilStateHandle CreateDepthStencilState(const DepthStencilDesc& desc) override;
+
+        void ClearState() override;
+        void SetViewport(const Viewport& viewport) override;
+        void SetScissorRect(const Rect& rect) override;
+        void SetRenderTarget(RenderTargetViewHandle target, DepthStencilViewHandle depth = DepthStencilViewHandle()) override;
+        void ClearRenderTarget(RenderTargetViewHandle target, const float color[4]) override;
+        void ClearDepthStencil(DepthStencilViewHandle target, float depth) override;
+
+        void SetVertexBuffer(unsigned slot, BufferHandle buffer, unsigned stride, unsigned offset = 0) override;
+        void SetIndexBuffer(BufferHandle buffer, unsigned offset = 0) override;
+        void SetInputLayout(InputLayoutHandle layout) override;
+        void SetPrimitiveTopology(Topology topology) override;
+        void SetVertexShader(VertexShaderHandle shader) override;
+        void SetPixelShader(PixelShaderHandle shader) override;
+        void SetConstantBuffers(ShaderStage stage, unsigned slot, unsigned count, const BufferHandle* buffers) override;
+        void SetShaderResources(ShaderStage stage, unsigned slot, unsigned count, const ShaderResourceViewHandle* views) override;
+        void SetSamplers(ShaderStage stage, unsigned slot, unsigned count, const SamplerHandle* samplers) override;
+        void SetRasterizerState(RasterizerStateHandle state) override;
+        void SetDepthStencilState(DepthStencilStateHandle state) override;
+
+        void UpdateBuffer(BufferHandle buffer, const void* data, size_t size) override;
+        void UpdateBufferRange(BufferHandle buffer, size_t offset, const void* data, size_t size) override;
+        void* Map(BufferHandle buffer) override;
+        void Unmap(BufferHandle buffer) override;
+
+        void Draw(unsigned vertexCount, unsigned startVertex) override;
+        void DrawIndexed(unsigned indexCount, unsigned startIndex, int baseVertex) override;
+        void DrawIndexedInstanced(unsigned indexCount, unsigned instanceCount, unsigned startIndex, int baseVertex,
+                                  unsigned startInstance) override;
+
+        bool Describe(ResourceType type, uint32_t id, ResourceInfo& info) const override;
+
+        const Stats& GetStats() const {
+            return stats_;
+        };
+
+        // Обнуляет счетчики и сообщения, ресурсы и состояние остаются.
+        void ResetStats();
+
+        const std::vector<std::string>& GetErrors() const {
+            return messages_;
+        };
+
+        // Текущее содержимое буфера, nullptr для неверного дескриптора.
+        const uint8_t* GetBufferData(BufferHandle buffer) const;
+
+        size_t GetLiveResourceCount() const;
+
+    protected:
+        void ReleaseResource(ResourceType type, uint32_t id) override;
+
+    private:
+        struct BufferRecord {
+            BufferDesc desc;
+            std::vector<uint8_t> data;
+            bool mapped = false;
+        };
+
+        struct LayoutRecord {
+            uint32_t vertexSlots = 0;       // маски слотов с данными на вершину и на экземпляр
+            uint32_t instanceSlots = 0;
+            std::vector<InputElement> elements;     // имена хранятся отдельно в names
+            std::vector<std::string> names;
+        };
+
+        struct ViewRecord {
+            uint32_t texture = 0;
+            unsigned mipLevel = 0;
+            unsigned arraySlice = 0;
+        };
+
+        struct VertexBinding {
+            uint32_t buffer = 0;
+            unsigned stride = 0;
+            unsigned offset = 0;
+        };
+
+        uint32_t Allocate(ResourceType type);
+        bool IsAlive(ResourceType type, uint32_t id) const;
+        // Пустой дескриптор допустим, если allowEmpty.
+        bool CheckHandle(ResourceType type, uint32_t id, const char* call, bool allowEmpty);
+        void Error(const char* format, ...);
+        bool ValidateDraw(const char* call);
+        void CheckVertexRange(const char* call, uint32_t slots, uint64_t count, uint64_t start);
+        void DrawIndices(const char* call, unsigned indexCount, unsigned instanceCount, unsigned startIndex, unsigned startInstance);
+
+        std::vector<uint8_t> alive_[(size_t)ResourceType::Count];
+        std::vector<BufferRecord> buffers_;
+        std::vector<TextureDesc> textures_;
+        std::vector<ViewRecord> shaderResourceViews_;
+        std::vector<ViewRecord> renderTargetViews_;
+        std::vector<ViewRecord> depthStencilViews_;
+        std::vector<LayoutRecord> layouts_;
+        std::vector<SamplerDesc> samplers_;
+        std::vector<RasterizerDesc> rasterizerStates_;
+        std::vector<DepthStencilDesc> depthStencilStates_;
+        size_t mappedCount_ = 0;
+
+        bool viewportSet_ = false;
+        uint32_t renderTarget_ = 0;
+        uint32_t depthTarget_ = 0;
+        VertexBinding vertexBuffers_[maxVertexBuffers];
+        uint32_t indexBuffer_ = 0;
+        unsigned indexOffset_ = 0;
+        uint32_t inputLayout_ = 0;
+        Topology topology_ = Topology::Undefined;
+        uint32_t vertexShader_ = 0;
+        uint32_t pixelShader_ = 0;
+        uint32_t constantBuffers_[2][maxConstantBuffers] = {};
+        uint32_t shaderResources_[2][maxShaderResources] = {};
+        uint32_t boundSamplers_[2][maxSamplers] = {};
+        unsigned constantBufferSlots_[2] = {};      // верхняя граница занятых слотов, чтобы не обходить все
+        unsigned shaderResourceSlots_[2] = {};
+        uint32_t rasterizerState_ = 0;
+        uint32_t depthStencilState_ = 0;
+
+        Stats stats_;
+        std::vector<std::string> messages_;
+    };
+}
@@ -0,0 +1,203 @@
+﻿#include "ObjectCulling.h"
+#include "ShaderMath.h"
+#include "ThreadPool.h"
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+namespace culling {
+    namespace {
+        using namespace hlsl;
+
+        // Объектов на задачу пула и на участок scratch: около десятка микросекунд работы.
+        const size_t cullChunk = 16384;
+        // Радиус и размеры пустого объекта: ни одна проверка не проходит.
+        const float emptyBounds = -1e30f;
+
+        void For(ThreadPool* pool, size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+            if (pool) {
+                pool->ParallelFor(count, grain, body);
+            } else {
+                body(0, count);
+            }
+        }
+    }
+
+    void TransformBox(const float boxMin[3], const float boxMax[3], const float* m, float outMin[3], float outMax[3]) {
+        // Вклад каждой оси - меньшее и большее из произведений на края (Arvo).
+        for (int k = 0; k < 3; k++) {
+            outMin[k] = outMax[k] = m[12 + k];
+            for (int i = 0; i < 3; i++) {
+                float a = m[i * 4 + k] * boxMin[i], b = m[i * 4 + k] * boxMax[i];
+                outMin[k] += std::min(a, b);
+                outMax[k] += std::max(a, b);
+            }
+        }
+    }
+
+    uint32_t ObjectBounds::Add(const float boxMin[3], const float boxMax[3]) {
+        float center[3];
+        float radius2 = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            center[k] = (boxMin[k] + boxMax[k]) * 0.5f;
+            radius2 += (boxMax[k] - center[k]) * (boxMax[k] - center[k]);
+        }
+        return Add(boxMin, boxMax, center, std::sqrt(radius2));
+    }
+
+    uint32_t ObjectBounds::Add(const float boxMin[3], const float boxMax[3], const float center[3], float radius) {
+        uint32_t index = (uint32_t)count_++;
+        size_t padded = (count_ + 7) & ~size_t(7);
+        size_t old = streams_[0].size();
+        for (std::vector<float>& stream : streams_) {
+            stream.resize(padded);
+        }
+        for (size_t i = old; i < padded; i++) {
+            WriteEmpty(i);
+        }
+        Write(index, boxMin, boxMax, center, radius);
+        return index;
+    }
+
+    void ObjectBounds::Set(uint32_t index, const float boxMin[3], const float boxMax[3]) {
+        float center[3];
+        float radius2 = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            center[k] = (boxMin[k] + boxMax[k]) * 0.5f;
+            radius2 += (boxMax[k] - center[k]) * (boxMax[k] - center[k]);
+        }
+        Set(index, boxMin, boxMax, center, std::sqrt(radius2));
+    }
+
+    void ObjectBounds::Set(uint32_t index, const float boxMin[3], const float boxMax[3], const float center[3], float radius) {
+        if (index < count_) {
+            Write(index, boxMin, boxMax, center, radius);
+        }
+    }
+
+    void ObjectBounds::Remove(uint32_t index) {
+        if (index >= count_)
+            return;
+        size_t last = count_ - 1;
+        for (std::vector<float>& stream : streams_) {
+            stream[index] = stream[last];
+        }
+        WriteEmpty(last);
+        count_--;
+    }
+
+    void ObjectBounds::Clear() {
+        count_ = 0;
+        for (std::vector<float>& stream : streams_) {
+            stream.clear();
+        }
+    }
+
+    void ObjectBounds::GetBox(uint32_t index, float boxMin[3], float boxMax[3]) const {
+        for (int k = 0; k < 3; k++) {
+            boxMin[k] = streams_[BoxX + k][index] - streams_[ExtentX + k][index];
+            boxMax[k] = streams_[BoxX + k][index] + streams_[ExtentX + k][index];
+        }
+    }
+
+    void ObjectBounds::Write(uint32_t index, const float boxMin[3], const float boxMax[3], const float center[3], float radius) {
+        streams_[SphereX][index] = center[0];
+        streams_[SphereY][index] = center[1];
+        streams_[SphereZ][index] = center[2];
+        streams_[Radius][index] = radius;
+        for (int k = 0; k < 3; k++) {
+            streams_[BoxX + k][index] = (boxMin[k] + boxMax[k]) * 0.5f;
+            streams_[ExtentX + k][index] = (boxMax[k] - boxMin[k]) * 0.5f;
+        }
+    }
+
+    void ObjectBounds::WriteEmpty(size_t index) {
+        for (int stream = 0; stream < StreamCount; stream++) {
+            streams_[stream][index] = stream == Radius || stream >= ExtentX ? emptyBounds : 0.0f;
+        }
+    }
+
+    size_t FrustumCuller::Cull(const ObjectBounds& bounds, const float planes[6][4], std::vector<uint32_t>& visible,
+                               ThreadPool* pool) {
+        size_t padded = bounds.streams_[0].size();
+        size_t chunks = (padded + cullChunk - 1) / cullChunk;
+        scratch_.resize(padded);
+        counts_.assign(chunks + 1, 0);
+        boxTested_.assign(chunks, 0);
+
+        // Сфера вне пирамиды, если ее целиком отделяет хоть одна плоскость, и внутри, если лежит по внутреннюю
+        // сторону всех плоскостей. Для сфер на границе решает параллелепипед: расстояние от центра плюс проекция
+        // половины размера на нормаль.
+        For(pool, chunks, 1, [&](size_t chunkBegin, size_t chunkEnd) {
+            floatx8 plane[6][4], normalAbs[6][3];
+            for (int p = 0; p < 6; p++) {
+                for (int k = 0; k < 4; k++) {
+                    plane[p][k] = floatx8(planes[p][k]);
+                }
+                for (int k = 0; k < 3; k++) {
+                    normalAbs[p][k] = floatx8(std::fabs(planes[p][k]));
+                }
+            }
+            const float* streams[ObjectBounds::StreamCount];
+            for (int stream = 0; stream < ObjectBounds::StreamCount; stream++) {
+                streams[stream] = bounds.streams_[stream].data();
+            }
+            auto load = [&streams](ObjectBounds::Stream stream, size_t i) {
+                return floatx8::Load(streams[stream] + i);
+            };
+            for (size_t chunk = chunkBegin; chunk < chunkEnd; chunk++) {
+                size_t begin = chunk * cullChunk, end = std::min(begin + cullChunk, padded);
+                uint32_t* out = scratch_.data() + begin;
+                size_t count = 0, boxTested = 0;
+                for (size_t i = begin; i < end; i += 8) {
+                    floatx8 x = load(ObjectBounds::SphereX, i), y = load(ObjectBounds::SphereY, i);
+                    floatx8 z = load(ObjectBounds::SphereZ, i), r = load(ObjectBounds::Radius, i);
+                    floatx8 touching = r >= floatx8(0.0f), inside = touching;
+                    for (int p = 0; p < 6; p++) {
+                        floatx8 distance = x * plane[p][0] + y * plane[p][1] + z * plane[p][2] + plane[p][3];
+                        touching = touching & (distance + r > floatx8(0.0f));
+                        inside = inside & (distance >= r);
+                    }
+                    unsigned mask = lanemask(touching);
+                    unsigned border = mask & ~lanemask(inside);
+                    if (border) {
+                        floatx8 bx = load(ObjectBounds::BoxX, i), by = load(ObjectBounds::BoxY, i), bz = load(ObjectBounds::BoxZ, i);
+                        floatx8 ex = load(ObjectBounds::ExtentX, i), ey = load(ObjectBounds::ExtentY, i);
+                        floatx8 ez = load(ObjectBounds::ExtentZ, i);
+                        floatx8 box = ex >= floatx8(0.0f);
+                        for (int p = 0; p < 6; p++) {
+                            floatx8 distance = bx * plane[p][0] + by * plane[p][1] + bz * plane[p][2] + plane[p][3];
+                            floatx8 extent = ex * normalAbs[p][0] + ey * normalAbs[p][1] + ez * normalAbs[p][2];
+                            box = box & (distance + extent > floatx8(0.0f));
+                        }
+                        mask &= ~border | lanemask(box);
+                        boxTested += 8;
+                    }
+                    // Запись всех восьми номеров без ветвлений, счетчик растет только на видимых.
+                    for (unsigned lane = 0; lane < 8; lane++) {
+                        out[count] = (uint32_t)(i + lane);
+                        count += (mask >> lane) & 1;
+                    }
+                }
+                counts_[chunk + 1] = count;
+                boxTested_[chunk] = boxTested;
+            }
+        });
+
+        stats_ = CullStats();
+        stats_.tested = bounds.count_;
+        for (size_t chunk = 0; chunk < chunks; chunk++) {
+            counts_[chunk + 1] += counts_[chunk];
+            stats_.boxTested += boxTested_[chunk];
+        }
+        visible.resize(counts_[chunks]);
+        For(pool, chunks, 1, [&](size_t chunkBegin, size_t chunkEnd) {
+            for (size_t chunk = chunkBegin; chunk < chunkEnd; chunk++) {
+                std::copy(scratch_.data() + chunk * cullChunk, scratch_.data() + chunk * cullChunk +
+                    (counts_[chunk + 1] - counts_[chunk]), visible.data() + counts_[chunk]);
+            }
+        });
+        stats_.visible = visible.size();
+        return visible.size();
+    }
+}
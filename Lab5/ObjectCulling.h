@@ -0,0 +1,75 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+
+// Отсечение объектов сцены пирамидой видимости на CPU. Границы объектов - сфера и параллелепипед по осям (AABB)
+// в мировом пространстве, хранятся структурой массивов. Сферы проверяются по восемь объектов за раз (ShaderMath.h);
+// параллелепипеды читаются только для блоков, где есть сферы на границе пирамиды. Не зависит от D3D и собирается
+// на Linux (см. ObjectCullingBenchMain.cpp).
+namespace culling {
+    // Параллелепипед по осям после преобразования matrix (4x4 по строкам, векторы умножаются слева).
+    void TransformBox(const float boxMin[3], const float boxMax[3], const float* matrix, float outMin[3], float outMax[3]);
+
+    class ObjectBounds {
+    public:
+        // Сфера - описанная около параллелепипеда.
+        uint32_t Add(const float boxMin[3], const float boxMax[3]);
+        uint32_t Add(const float boxMin[3], const float boxMax[3], const float center[3], float radius);
+        void Set(uint32_t index, const float boxMin[3], const float boxMax[3]);
+        void Set(uint32_t index, const float boxMin[3], const float boxMax[3], const float center[3], float radius);
+        // На место удаленного переносится последний объект.
+        void Remove(uint32_t index);
+        void Clear();
+
+        size_t GetCount() const {
+            return count_;
+        };
+
+        void GetBox(uint32_t index, float boxMin[3], float boxMax[3]) const;
+
+    private:
+        friend class FrustumCuller;
+
+        // Массивы одного поля, длина кратна восьми; хвост - пустые объекты, которые никогда не видимы.
+        enum Stream {
+            SphereX, SphereY, SphereZ, Radius,
+            BoxX, BoxY, BoxZ, ExtentX, ExtentY, ExtentZ,    // центр и половина размера параллелепипеда
+            StreamCount
+        };
+
+        void Write(uint32_t index, const float boxMin[3], const float boxMax[3], const float center[3], float radius);
+        void WriteEmpty(size_t index);
+
+        size_t count_ = 0;
+        std::vector<float> streams_[StreamCount];
+    };
+
+    struct CullStats {
+        size_t tested = 0;
+        size_t visible = 0;
+        size_t boxTested = 0;           // объектов в блоках, где понадобились параллелепипеды
+    };
+
+    class FrustumCuller {
+    public:
+        // Плоскости - mesh::ExtractFrustumPlanes. Номера видимых объектов - в visible по возрастанию.
+        // Возвращает их число.
+        size_t Cull(const ObjectBounds& bounds, const float planes[6][4], std::vector<uint32_t>& visible,
+                    ThreadPool* pool = nullptr);
+
+        const CullStats& GetStats() const {
+            return stats_;
+        };
+
+    private:
+        std::vector<uint32_t> scratch_;     // видимые каждого блока объектов с его начала
+        std::vector<size_t> counts_;        // видимых в блоке, затем начало блока в visible
+        std::vector<size_t> boxTested_;
+        CullStats stats_;
+    };
+}
@@ -0,0 +1,251 @@
+﻿// Замер и проверка ObjectCulling, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 -mavx2 -mfma -pthread ObjectCullingBenchMain.cpp ObjectCulling.cpp Meshlets.cpp ThreadPool.cpp -o objectculling
+// Примеры:
+//   ./objectculling --objects 1000000
+//   ./objectculling --objects 1000000 --threads 8
+// Объекты - параллелепипеды 0.5 .. 5 в слое 1000 x 100 x 1000, камера в центре поворачивается по кругу.
+// Для сравнения - проверка по одному объекту из массива структур той же сферой и параллелепипедом.
+#include "ObjectCulling.h"
+#include "Meshlets.h"
+#include "ThreadPool.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+    struct Object {
+        float boxMin[3];
+        float boxMax[3];
+        float center[3];
+        float radius;
+    };
+
+    void MakeObjects(size_t count, std::vector<Object>& objects) {
+        std::mt19937 random(7);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        objects.resize(count);
+        for (Object& object : objects) {
+            float position[3] = { unit(random) * 1000.0f - 500.0f, unit(random) * 100.0f - 50.0f, unit(random) * 1000.0f - 500.0f };
+            float radius2 = 0.0f;
+            for (int k = 0; k < 3; k++) {
+                float half = 0.25f + unit(random) * 2.25f;
+                object.boxMin[k] = position[k] - half;
+                object.boxMax[k] = position[k] + half;
+                object.center[k] = position[k];
+                radius2 += half * half;
+            }
+            object.radius = std::sqrt(radius2);
+        }
+    }
+
+    // Вид-проекция Renderer: камера в начале координат смотрит под углом yaw в плоскости xz, PerspectiveFovLH
+    // с переставленными ближней и дальней плоскостями (1000 и 0.1).
+    void ViewProjection(float yaw, float aspect, float m[16]) {
+        float s = std::sin(yaw), c = std::cos(yaw);
+        // Строки вида: оси right = (c, 0, -s), up = (0, 1, 0), forward = (s, 0, c) - столбцы матрицы.
+        float view[16] = { c, 0.0f, s, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, -s, 0.0f, c, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+        float nearZ = 1000.0f, farZ = 0.1f;
+        float h = 1.0f / std::tan(3.14159265f / 6.0f), w = h / aspect, range = farZ / (farZ - nearZ);
+        float projection[16] = { w, 0.0f, 0.0f, 0.0f, 0.0f, h, 0.0f, 0.0f, 0.0f, 0.0f, range, 1.0f, 0.0f, 0.0f, -range * nearZ, 0.0f };
+        for (int row = 0; row < 4; row++) {
+            for (int column = 0; column < 4; column++) {
+                float sum = 0.0f;
+                for (int k = 0; k < 4; k++) {
+                    sum += view[row * 4 + k] * projection[k * 4 + column];
+                }
+                m[row * 4 + column] = sum;
+            }
+        }
+    }
+
+    // То же решение, что FrustumCuller, по одному объекту. border - объект в пределах epsilon от решающей
+    // плоскости, его результат может отличаться из-за округления.
+    bool ScalarVisible(const Object& object, const float planes[6][4], float epsilon, bool* border = nullptr) {
+        bool touching = true, inside = true, box = true, close = false;
+        for (int p = 0; p < 6; p++) {
+            float distance = object.center[0] * planes[p][0] + object.center[1] * planes[p][1] +
+                object.center[2] * planes[p][2] + planes[p][3];
+            touching = touching && distance + object.radius > 0.0f;
+            inside = inside && distance >= object.radius;
+            close = close || std::fabs(distance + object.radius) < epsilon || std::fabs(distance - object.radius) < epsilon;
+            float boxDistance = planes[p][3], extent = 0.0f;
+            for (int k = 0; k < 3; k++) {
+                boxDistance += (object.boxMin[k] + object.boxMax[k]) * 0.5f * planes[p][k];
+                extent += (object.boxMax[k] - object.boxMin[k]) * 0.5f * std::fabs(planes[p][k]);
+            }
+            box = box && boxDistance + extent > 0.0f;
+            close = close || std::fabs(boxDistance + extent) < epsilon;
+        }
+        if (border) {
+            *border = close;
+        }
+        return touching && (inside || box);
+    }
+
+    // Прежний способ: по объекту, выход на первой отделяющей плоскости.
+    bool NaiveVisible(const Object& object, const float planes[6][4]) {
+        bool inside = true;
+        for (int p = 0; p < 6; p++) {
+            float distance = object.center[0] * planes[p][0] + object.center[1] * planes[p][1] +
+                object.center[2] * planes[p][2] + planes[p][3];
+            if (distance + object.radius <= 0.0f)
+                return false;
+            inside = inside && distance >= object.radius;
+        }
+        if (inside)
+            return true;
+        for (int p = 0; p < 6; p++) {
+            float distance = planes[p][3], extent = 0.0f;
+            for (int k = 0; k < 3; k++) {
+                distance += (object.boxMin[k] + object.boxMax[k]) * 0.5f * planes[p][k];
+                extent += (object.boxMax[k] - object.boxMin[k]) * 0.5f * std::fabs(planes[p][k]);
+            }
+            if (distance + extent <= 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    double MeasureScalar(const std::vector<Object>& objects, const float planes[6][4], unsigned runs, size_t& visibleCount) {
+        std::vector<uint32_t> visible;
+        visible.reserve(objects.size());
+        double best = 1e30;
+        for (unsigned run = 0; run < runs; run++) {
+            auto start = std::chrono::steady_clock::now();
+            visible.clear();
+            for (size_t i = 0; i < objects.size(); i++) {
+                if (NaiveVisible(objects[i], planes)) {
+                    visible.push_back((uint32_t)i);
+                }
+            }
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        visibleCount = visible.size();
+        return best;
+    }
+
+    // Список FrustumCuller против ScalarVisible: по возрастанию, без пропусков и лишних объектов кроме пограничных.
+    bool Validate(const std::vector<Object>& objects, const float planes[6][4], const std::vector<uint32_t>& visible,
+                  size_t& borderMismatches) {
+        borderMismatches = 0;
+        size_t next = 0;
+        for (size_t i = 0; i < objects.size(); i++) {
+            bool listed = next < visible.size() && visible[next] == i;
+            next += listed ? 1 : 0;
+            bool border = false;
+            if (listed != ScalarVisible(objects[i], planes, 1e-3f, &border)) {
+                if (!border)
+                    return false;
+                borderMismatches++;
+            }
+        }
+        return next == visible.size();
+    }
+
+    // Удаление с переносом последнего и изменение границ.
+    bool CheckEdits() {
+        culling::ObjectBounds bounds;
+        float a[3] = { -1.0f, -1.0f, 5.0f }, b[3] = { 1.0f, 1.0f, 7.0f }, far[3] = { 0.0f, 0.0f, -100.0f };
+        float farMax[3] = { 1.0f, 1.0f, -99.0f };
+        for (int i = 0; i < 11; i++) {
+            bounds.Add(i % 2 ? a : far, i % 2 ? b : farMax);
+        }
+        float m[16], planes[6][4];
+        ViewProjection(0.0f, 16.0f / 9.0f, m);
+        mesh::ExtractFrustumPlanes(m, planes);
+        culling::FrustumCuller culler;
+        std::vector<uint32_t> visible;
+        bool ok = culler.Cull(bounds, planes, visible) == 5 && visible[0] == 1 && visible[4] == 9;
+        bounds.Remove(1);       // на место 1 встает последний, невидимый
+        bounds.Set(0, a, b);
+        ok = ok && culler.Cull(bounds, planes, visible) == 5 && visible[0] == 0 && visible[1] == 3;
+        while (bounds.GetCount() > 0) {
+            bounds.Remove(0);
+        }
+        ok = ok && culler.Cull(bounds, planes, visible) == 0;
+        // Объект, задевающий пирамиду только описанной сферой, отсекается параллелепипедом.
+        float thinMin[3] = { -140.0f, -0.1f, 100.0f }, thinMax[3] = { -139.0f, 0.1f, 101.0f };
+        float sphereCenter[3] = { -139.5f, 0.0f, 100.5f };
+        bounds.Add(thinMin, thinMax, sphereCenter, 40.0f);
+        ok = ok && culler.Cull(bounds, planes, visible) == 0 && culler.GetStats().boxTested == 8;
+        float worldMin[3], worldMax[3];
+        float rotation[16] = { 0.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 10.0f, 0.0f, 0.0f, 1.0f };
+        culling::TransformBox(thinMin, thinMax, rotation, worldMin, worldMax);
+        ok = ok && worldMin[0] == 110.0f && worldMax[0] == 111.0f && worldMin[2] == 139.0f && worldMax[2] == 140.0f;
+        printf("Edits: %s\n", ok ? "ok" : "FAILED");
+        return ok;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t objectCount = 1000000;
+    unsigned runs = 20;
+    unsigned threads = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--objects") && i + 1 < argc) {
+            objectCount = (size_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--runs") && i + 1 < argc) {
+            runs = (unsigned)atoi(argv[++i]);
+        } else {
+            printf("objectculling [--objects <n>] [--threads <n>] [--runs <n>]\n");
+            return 1;
+        }
+    }
+    threads = std::max(threads, 1u);
+    runs = std::max(runs, 1u);
+
+    std::vector<Object> objects;
+    MakeObjects(objectCount, objects);
+    culling::ObjectBounds bounds;
+    for (const Object& object : objects) {
+        bounds.Add(object.boxMin, object.boxMax, object.center, object.radius);
+    }
+
+    bool ok = CheckEdits();
+    const float yaws[4] = { 0.3f, 1.9f, 3.5f, 5.1f };
+    float m[16], planes[4][6][4];
+    for (int view = 0; view < 4; view++) {
+        ViewProjection(yaws[view], 16.0f / 9.0f, m);
+        mesh::ExtractFrustumPlanes(m, planes[view]);
+    }
+
+    size_t scalarVisible = 0;
+    double scalar = MeasureScalar(objects, planes[0], std::min(runs, 5u), scalarVisible);
+    printf("%zu objects, %zu visible in view 0\n", objectCount, scalarVisible);
+    printf("AoS scalar:  %.3f ms best (%.2f ns/object)\n", scalar * 1e3, scalar * 1e9 / objectCount);
+
+    culling::FrustumCuller culler;
+    std::vector<uint32_t> visible;
+    for (unsigned n = 1; n <= threads; n = n < threads ? std::min(n * 2, threads) : n + 1) {
+        std::unique_ptr<ThreadPool> pool(n > 1 ? new ThreadPool(n - 1) : nullptr);
+        double best = 1e30;
+        for (unsigned run = 0; run < runs; run++) {
+            auto start = std::chrono::steady_clock::now();
+            culler.Cull(bounds, planes[run % 4], visible, pool.get());
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        printf("threads %2u: %.3f ms best (%.2f ns/object), %.1fx vs AoS\n", n, best * 1e3, best * 1e9 / objectCount,
+            scalar / best);
+    }
+
+    for (int view = 0; view < 4; view++) {
+        culler.Cull(bounds, planes[view], visible);
+        size_t border = 0;
+        bool valid = Validate(objects, planes[view], visible, border);
+        const culling::CullStats& stats = culler.GetStats();
+        printf("View %d: %zu visible, %zu in blocks with box tests, %zu border mismatches, %s\n", view, stats.visible,
+            stats.boxTested, border, valid ? "ok" : "FAILED");
+        ok = ok && valid;
+    }
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
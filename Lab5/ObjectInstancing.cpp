@@ -0,0 +1,161 @@
+﻿#include "ObjectInstancing.h"
+#include <algorithm>
+#include <cstring>
+
+
+namespace gfx {
+    namespace {
+        uint32_t Mix(uint32_t hash, uint32_t value) {
+            hash ^= value;
+            return hash * 0x01000193u;
+        }
+
+        uint32_t HashKey(const MeshBinding& mesh, const mesh::IndexRange* ranges, size_t rangeCount, uint32_t startIndex) {
+            uint32_t hash = 0x811c9dc5u;
+            hash = Mix(hash, mesh.vertexBuffer.id);
+            hash = Mix(hash, mesh.indexBuffer.id);
+            hash = Mix(hash, mesh.stride);
+            hash = Mix(hash, mesh.inputLayout.id);
+            hash = Mix(hash, mesh.vertexShader.id);
+            hash = Mix(hash, mesh.rasterizerState.id);
+            hash = Mix(hash, startIndex);
+            hash = Mix(hash, (uint32_t)rangeCount);
+            for (size_t r = 0; r < rangeCount; r++) {
+                hash = Mix(Mix(hash, ranges[r].startIndex), ranges[r].indexCount);
+            }
+            return hash ^ (hash >> 15);
+        }
+    }
+
+    void InstanceBatcher::Clear() {
+        groups_.clear();
+        std::fill(table_.begin(), table_.end(), 0u);
+        groupOf_.clear();
+        groupSize_.clear();
+        batchableGroups_ = 0;
+        last_ = UINT32_MAX;
+        visible_.clear();
+        visibleCount_.clear();
+        cursor_.clear();
+        slot_.clear();
+        batches_.clear();
+        instances_.clear();
+    }
+
+    bool InstanceBatcher::SameKey(const InstanceBatch& batch, const MeshBinding& mesh, const mesh::IndexRange* ranges,
+                                  size_t rangeCount, uint32_t startIndex) {
+        const MeshBinding& a = batch.mesh;
+        if (a.vertexBuffer != mesh.vertexBuffer || a.indexBuffer != mesh.indexBuffer || a.stride != mesh.stride
+            || a.inputLayout != mesh.inputLayout || a.vertexShader != mesh.vertexShader
+            || a.rasterizerState != mesh.rasterizerState || batch.startIndex != startIndex || batch.rangeCount != rangeCount)
+            return false;
+        for (size_t r = 0; r < rangeCount && batch.ranges != ranges; r++) {
+            if (batch.ranges[r].startIndex != ranges[r].startIndex || batch.ranges[r].indexCount != ranges[r].indexCount)
+                return false;
+        }
+        return true;
+    }
+
+    void InstanceBatcher::Rehash(size_t size) {
+        table_.assign(size, 0u);
+        size_t mask = size - 1;
+        for (size_t g = 0; g < groups_.size(); g++) {
+            const InstanceBatch& group = groups_[g];
+            size_t slot = HashKey(group.mesh, group.ranges, group.rangeCount, group.startIndex) & mask;
+            while (table_[slot] != 0) {
+                slot = (slot + 1) & mask;
+            }
+            table_[slot] = (uint32_t)g + 1;
+        }
+    }
+
+    uint32_t InstanceBatcher::FindGroup(const MeshBinding& mesh, const mesh::IndexRange* ranges, size_t rangeCount,
+                                        uint32_t startIndex) {
+        // Объекты одной модели обычно идут подряд.
+        if (last_ != UINT32_MAX && SameKey(groups_[last_], mesh, ranges, rangeCount, startIndex))
+            return last_;
+
+        // Заполнение таблицы не больше половины.
+        if ((groups_.size() + 1) * 2 > table_.size()) {
+            Rehash(table_.empty() ? 64 : table_.size() * 2);
+        }
+        size_t mask = table_.size() - 1;
+        size_t slot = HashKey(mesh, ranges, rangeCount, startIndex) & mask;
+        while (table_[slot] != 0) {
+            uint32_t group = table_[slot] - 1;
+            if (SameKey(groups_[group], mesh, ranges, rangeCount, startIndex))
+                return group;
+            slot = (slot + 1) & mask;
+        }
+        InstanceBatch group;
+        group.mesh = mesh;
+        group.ranges = ranges;
+        group.rangeCount = rangeCount;
+        group.startIndex = startIndex;
+        groups_.push_back(group);
+        table_[slot] = (uint32_t)groups_.size();
+        return (uint32_t)groups_.size() - 1;
+    }
+
+    uint32_t InstanceBatcher::AddObject(const MeshBinding& mesh, const mesh::IndexRange* ranges, size_t rangeCount,
+                                        uint32_t startIndex) {
+        last_ = FindGroup(mesh, ranges, rangeCount, startIndex);
+        groupOf_.push_back(last_);
+        slot_.push_back(UINT32_MAX);
+        groupSize_.resize(groups_.size(), 0u);
+        batchableGroups_ += ++groupSize_[last_] == minInstances;
+        visibleCount_.resize(groups_.size(), 0u);
+        cursor_.resize(groups_.size(), UINT32_MAX);
+        return (uint32_t)groupOf_.size() - 1;
+    }
+
+    void InstanceBatcher::Begin() {
+        // Сбрасывается только то, что тронул прошлый кадр.
+        for (uint32_t object : visible_) {
+            uint32_t group = groupOf_[object];
+            slot_[object] = UINT32_MAX;
+            visibleCount_[group] = 0;
+            cursor_[group] = UINT32_MAX;
+        }
+        visible_.clear();
+        batches_.clear();
+        instances_.clear();
+    }
+
+    void InstanceBatcher::MarkVisible(uint32_t object) {
+        visible_.push_back(object);
+        visibleCount_[groupOf_[object]]++;
+    }
+
+    void InstanceBatcher::Build() {
+        uint32_t instanceCount = 0;
+        for (uint32_t object : visible_) {
+            uint32_t group = groupOf_[object];
+            if (visibleCount_[group] < minInstances)
+                continue;
+            if (cursor_[group] == UINT32_MAX) {
+                batches_.push_back(groups_[group]);
+                batches_.back().firstInstance = instanceCount;
+                batches_.back().instanceCount = visibleCount_[group];
+                cursor_[group] = instanceCount;
+                instanceCount += visibleCount_[group];
+            }
+            slot_[object] = cursor_[group]++;
+        }
+        instances_.resize(instanceCount);
+    }
+
+    void InstanceBatcher::SetInstance(uint32_t object, const float* world, const float color[3], float roughness,
+                                      float metalness) {
+        InstanceData& instance = instances_[slot_[object]];
+        for (int j = 0; j < 3; j++) {
+            for (int i = 0; i < 4; i++) {
+                instance.world[j][i] = world[i * 4 + j];
+            }
+        }
+        memcpy(instance.color, color, sizeof(instance.color));
+        instance.roughness = roughness;
+        instance.metalness = metalness;
+        memset(instance.padding, 0, sizeof(instance.padding));
+    }
+}
@@ -0,0 +1,114 @@
+﻿#pragma once
+
+#include "ScenePass.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+
+// Группировка объектов сцены для отрисовки экземплярами. Объекты с одинаковыми привязками геометрии и шейдеров
+// и одинаковыми диапазонами индексов относятся к одной группе; группы строятся один раз при загрузке сцены
+// (AddObject), а в кадре только считаются видимые объекты групп. Данные экземпляров всех групп лежат подряд в одном
+// вершинном буфере (слот 1), и каждая группа рисуется одним DrawIndexedInstanced на диапазон (ScenePass).
+// Не зависит от D3D и собирается на Linux (см. InstancingBenchMain.cpp).
+namespace gfx {
+    // Вершина слота 1 для VS.hlsl с INSTANCED: первые три столбца мировой матрицы и материал, те же поля,
+    // что в WorldMatrixBuffer.
+    struct InstanceData {
+        float world[3][4];          // столбец j: m[0][j], m[1][j], m[2][j], m[3][j]
+        float color[3];
+        float roughness;
+        float metalness;
+        float padding[3];
+    };
+
+    static_assert(sizeof(InstanceData) == 80, "InstanceData layout");
+
+    struct InstanceBatch {
+        MeshBinding mesh;
+        const mesh::IndexRange* ranges = nullptr;
+        size_t rangeCount = 0;
+        uint32_t startIndex = 0;
+        uint32_t firstInstance = 0;         // номер в InstanceBatcher::GetInstances
+        uint32_t instanceCount = 0;
+    };
+
+    // Кадр: Begin, MarkVisible для видимых объектов, Build, затем SetInstance для объектов, у которых IsInstanced.
+    // Остальные видимые объекты рисуются по одному.
+    class InstanceBatcher {
+    public:
+        // Группа с меньшим числом видимых объектов рисуется по одному: один экземпляр не окупает запись в буфер
+        // экземпляров и отдельную раскладку (InstancingBenchMain, 1000 объектов на 1000 мешей).
+        static constexpr uint32_t minInstances = 2;
+
+        // Удаляет объекты и группы.
+        void Clear();
+        // Регистрирует объект с номером GetObjectCount() и возвращает этот номер. Диапазоны сравниваются по содержимому
+        // и должны жить до Clear.
+        uint32_t AddObject(const MeshBinding& mesh, const mesh::IndexRange* ranges, size_t rangeCount, uint32_t startIndex);
+
+        size_t GetObjectCount() const {
+            return groupOf_.size();
+        };
+
+        size_t GetGroupCount() const {
+            return groups_.size();
+        };
+
+        // Есть группа хотя бы из minInstances объектов. Иначе кадру нечего группировать, и MarkVisible не нужен.
+        bool CanBatch() const {
+            return batchableGroups_ != 0;
+        };
+
+        void Begin();
+        // Каждый объект - не больше одного раза за кадр.
+        void MarkVisible(uint32_t object);
+        // Группы в порядке первого видимого объекта, внутри группы - в порядке MarkVisible.
+        void Build();
+
+        bool IsInstanced(uint32_t object) const {
+            return slot_[object] != UINT32_MAX;
+        };
+
+        // world - 4x4 по строкам (XMMATRIX), последний столбец должен быть (0, 0, 0, 1).
+        void SetInstance(uint32_t object, const float* world, const float color[3], float roughness, float metalness);
+
+        const InstanceBatch* GetBatches() const {
+            return batches_.data();
+        };
+
+        size_t GetBatchCount() const {
+            return batches_.size();
+        };
+
+        const InstanceData* GetInstances() const {
+            return instances_.data();
+        };
+
+        size_t GetInstanceCount() const {
+            return instances_.size();
+        };
+
+    private:
+        uint32_t FindGroup(const MeshBinding& mesh, const mesh::IndexRange* ranges, size_t rangeCount, uint32_t startIndex);
+        static bool SameKey(const InstanceBatch& batch, const MeshBinding& mesh, const mesh::IndexRange* ranges,
+                            size_t rangeCount, uint32_t startIndex);
+        void Rehash(size_t size);
+
+        // Загрузка.
+        std::vector<InstanceBatch> groups_;     // ключ группы, firstInstance и instanceCount не заданы
+        std::vector<uint32_t> table_;           // открытая адресация: номер группы + 1, 0 - пусто
+        std::vector<uint32_t> groupOf_;         // группа каждого объекта
+        std::vector<uint32_t> groupSize_;
+        size_t batchableGroups_ = 0;            // групп не меньше чем из minInstances объектов
+        uint32_t last_ = UINT32_MAX;            // группа предыдущего AddObject
+
+        // Кадр.
+        std::vector<uint32_t> visible_;
+        std::vector<uint32_t> visibleCount_;    // видимых объектов в группе
+        std::vector<uint32_t> cursor_;          // следующее место группы в instances_, UINT32_MAX - группы нет в кадре
+        std::vector<uint32_t> slot_;            // место объекта в instances_, UINT32_MAX - рисуется по одному
+        std::vector<InstanceBatch> batches_;
+        std::vector<InstanceData> instances_;
+    };
+}
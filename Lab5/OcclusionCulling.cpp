@@ -0,0 +1,461 @@
+﻿#include "OcclusionCulling.h"
+#include "ObjectCulling.h"
+#include "ShaderMath.h"
+#include "ThreadPool.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+namespace culling {
+    namespace {
+        using namespace hlsl;
+
+        // Проверяемых объектов на задачу пула.
+        const size_t testGrain = 256;
+        const float farLayer = 1e30f;           // глубина пустого рабочего слоя
+
+        void For(ThreadPool* pool, size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+            if (pool) {
+                pool->ParallelFor(count, grain, body);
+            } else {
+                body(0, count);
+            }
+        }
+
+        // Биты first .. last - 1 строки плитки.
+        uint32_t RowBits(int first, int last) {
+            first = std::max(first, 0);
+            last = std::min(last, (int)OcclusionBuffer::tileWidth);
+            return first < last ? (uint32_t)((1ull << last) - (1ull << first)) : 0u;
+        }
+    }
+
+    void OcclusionBuffer::Begin(unsigned width, unsigned height, float nearW) {
+        tilesX_ = std::max((width + tileWidth - 1) / tileWidth, 1u);
+        tilesY_ = std::max((height + tileHeight - 1) / tileHeight, 1u);
+        width_ = tilesX_ * tileWidth;
+        height_ = tilesY_ * tileHeight;
+        binsX_ = (tilesX_ + binTiles - 1) / binTiles;
+        nearW_ = nearW;
+        size_t tiles = (size_t)tilesX_ * tilesY_;
+        layer0_.assign(tiles, 0.0f);
+        layer1_.assign(tiles, farLayer);
+        masks_.assign(tiles * tileHeight, 0u);
+        triangles_.clear();
+        bins_.resize((size_t)binsX_ * ((tilesY_ + binTiles - 1) / binTiles));
+        for (std::vector<uint32_t>& bin : bins_) {
+            bin.clear();
+        }
+        stats_ = OcclusionStats();
+    }
+
+    void OcclusionBuffer::SetupTriangles(const OccluderMesh& mesh, const float* clip, size_t begin, size_t end,
+                                         SetupChunk& chunk) const {
+        for (size_t tri = begin; tri < end; tri++) {
+            const uint32_t* index = mesh.indices + tri * 3;
+            const float* v[3];
+            unsigned behind = 0, outside = 15;
+            for (int i = 0; i < 3; i++) {
+                v[i] = clip + (size_t)index[i] * 4;
+                behind |= v[i][3] >= nearW_ ? 0u : 1u << i;
+                const float* p = v[i];
+                outside &= (p[0] < -p[3] ? 1u : 0u) | (p[0] > p[3] ? 2u : 0u) | (p[1] < -p[3] ? 4u : 0u) | (p[1] > p[3] ? 8u : 0u);
+            }
+            // Все вершины за ближней плоскостью или за одной боковой гранью пирамиды.
+            if (behind == 7 || outside)
+                continue;
+            if (!behind) {
+                float x[3], y[3], z[3];
+                for (int i = 0; i < 3; i++) {
+                    z[i] = 1.0f / v[i][3];
+                    x[i] = (v[i][0] * z[i] * 0.5f + 0.5f) * width_;
+                    y[i] = (0.5f - v[i][1] * z[i] * 0.5f) * height_;
+                }
+                AddTriangle(x, y, z, mesh.frontCounterClockwise, chunk);
+                continue;
+            }
+
+            // Многоугольник после отсечения полупространством w >= nearW_: до четырех вершин, веером на треугольники.
+            float polygon[4][3];
+            int count = 0;
+            for (int i = 0; i < 3; i++) {
+                const float* a = v[i];
+                const float* b = v[(i + 1) % 3];
+                bool aInside = !(behind >> i & 1), bInside = !(behind >> (i + 1) % 3 & 1);
+                if (aInside) {
+                    polygon[count][0] = a[0];
+                    polygon[count][1] = a[1];
+                    polygon[count][2] = a[3];
+                    count++;
+                }
+                if (aInside != bInside) {
+                    float t = (nearW_ - a[3]) / (b[3] - a[3]);
+                    polygon[count][0] = a[0] + (b[0] - a[0]) * t;
+                    polygon[count][1] = a[1] + (b[1] - a[1]) * t;
+                    polygon[count][2] = nearW_;
+                    count++;
+                }
+            }
+            float x[4], y[4], z[4];
+            for (int i = 0; i < count; i++) {
+                z[i] = 1.0f / polygon[i][2];
+                x[i] = (polygon[i][0] * z[i] * 0.5f + 0.5f) * width_;
+                y[i] = (0.5f - polygon[i][1] * z[i] * 0.5f) * height_;
+            }
+            for (int i = 2; i < count; i++) {
+                float tx[3] = { x[0], x[i - 1], x[i] }, ty[3] = { y[0], y[i - 1], y[i] }, tz[3] = { z[0], z[i - 1], z[i] };
+                AddTriangle(tx, ty, tz, mesh.frontCounterClockwise, chunk);
+            }
+        }
+    }
+
+    void OcclusionBuffer::AddTriangle(float x[3], float y[3], float z[3], bool frontCounterClockwise, SetupChunk& chunk) const {
+        // Ось y экрана направлена вниз, поэтому обход по часовой стрелке дает положительную площадь.
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (area == 0.0f || (frontCounterClockwise ? area > 0.0f : area < 0.0f))
+            return;
+        if (area < 0.0f) {
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            std::swap(z[1], z[2]);
+            area = -area;
+        }
+
+        Triangle t;
+        float minX = std::min(x[0], std::min(x[1], x[2])), maxX = std::max(x[0], std::max(x[1], x[2]));
+        float minY = std::min(y[0], std::min(y[1], y[2])), maxY = std::max(y[0], std::max(y[1], y[2]));
+        // Пиксели, центры которых могут попасть в треугольник.
+        t.minX = (int)std::max(std::ceil(minX - 0.5f), 0.0f);
+        t.maxX = (int)std::min(std::floor(maxX - 0.5f), (float)width_ - 1.0f);
+        t.minY = (int)std::max(std::ceil(minY - 0.5f), 0.0f);
+        t.maxY = (int)std::min(std::floor(maxY - 0.5f), (float)height_ - 1.0f);
+        if (t.minX > t.maxX || t.minY > t.maxY)
+            return;
+
+        for (int i = 0; i < 3; i++) {
+            int a = i, b = (i + 1) % 3;
+            // Опорная вершина ребра не зависит от его направления: у соседних треугольников общее ребро дает одну и
+            // ту же границу строки, и между ними не остается щелей.
+            int origin = x[a] < x[b] || (x[a] == x[b] && y[a] < y[b]) ? a : b;
+            t.edgeA[i] = y[a] - y[b];
+            t.edgeB[i] = x[b] - x[a];
+            t.edgeC[i] = -(t.edgeA[i] * x[origin] + t.edgeB[i] * y[origin]);
+            t.invEdgeA[i] = t.edgeA[i] != 0.0f ? 1.0f / t.edgeA[i] : 0.0f;
+        }
+        float invArea = 1.0f / area;
+        t.depthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) * invArea;
+        t.depthB = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) * invArea;
+        t.depthC = z[0] - t.depthA * x[0] - t.depthB * y[0];
+        t.depthMin = std::min(z[0], std::min(z[1], z[2]));
+
+        uint32_t local = (uint32_t)chunk.triangles.size();
+        chunk.triangles.push_back(t);
+        unsigned binWidth = tileWidth * binTiles, binHeight = tileHeight * binTiles;
+        for (unsigned by = (unsigned)t.minY / binHeight; by <= (unsigned)t.maxY / binHeight; by++) {
+            for (unsigned bx = (unsigned)t.minX / binWidth; bx <= (unsigned)t.maxX / binWidth; bx++) {
+                chunk.bins.push_back(by * binsX_ + bx);
+                chunk.bins.push_back(local);
+            }
+        }
+    }
+
+    void OcclusionBuffer::Split(const OccluderMesh* meshes, size_t count, bool triangles, size_t grain,
+                                std::vector<MeshRange>& ranges, std::vector<size_t>& jobs) {
+        ranges.clear();
+        jobs.assign(1, 0);
+        size_t work = 0;
+        for (size_t m = 0; m < count; m++) {
+            const OccluderMesh& mesh = meshes[m];
+            if (!mesh.positions || !mesh.indices || !mesh.worldViewProjection)
+                continue;
+            size_t size = triangles ? mesh.indexCount / 3 : mesh.vertexCount;
+            for (size_t begin = 0; begin < size; begin += grain) {
+                size_t end = std::min(begin + grain, size);
+                ranges.push_back({ m, begin, end });
+                work += end - begin;
+                if (work >= grain) {
+                    jobs.push_back(ranges.size());
+                    work = 0;
+                }
+            }
+        }
+        if (jobs.back() != ranges.size()) {
+            jobs.push_back(ranges.size());
+        }
+    }
+
+    void OcclusionBuffer::Render(const OccluderMesh* meshes, size_t count, ThreadPool* pool) {
+        auto start = std::chrono::steady_clock::now();
+        vertexOffsets_.resize(count + 1);
+        vertexOffsets_[0] = 0;
+        for (size_t m = 0; m < count; m++) {
+            vertexOffsets_[m + 1] = vertexOffsets_[m] + meshes[m].vertexCount;
+        }
+        clip_.resize(vertexOffsets_[count] * 4);
+
+        // Мелкие сетки собираются в общие задачи, крупные делятся на части по vertexGrain и setupGrain.
+        Split(meshes, count, false, vertexGrain, vertexRanges_, vertexJobs_);
+        For(pool, vertexJobs_.size() - 1, 1, [&](size_t jobBegin, size_t jobEnd) {
+            for (size_t r = vertexJobs_[jobBegin]; r < vertexJobs_[jobEnd]; r++) {
+                const MeshRange& range = vertexRanges_[r];
+                const OccluderMesh& mesh = meshes[range.mesh];
+                const float* matrix = mesh.worldViewProjection;
+                const uint8_t* base = (const uint8_t*)mesh.positions;
+                float* out = &clip_[(vertexOffsets_[range.mesh] + range.begin) * 4];
+                for (size_t v = range.begin; v < range.end; v++, out += 4) {
+                    float p[3];
+                    memcpy(p, base + v * mesh.stride, sizeof(p));
+                    for (int k = 0; k < 4; k++) {
+                        out[k] = p[0] * matrix[k] + p[1] * matrix[4 + k] + p[2] * matrix[8 + k] + matrix[12 + k];
+                    }
+                }
+            }
+        });
+
+        Split(meshes, count, true, setupGrain, triangleRanges_, triangleJobs_);
+        size_t jobCount = triangleJobs_.size() - 1;
+        chunks_.resize(std::max(chunks_.size(), jobCount));
+        For(pool, jobCount, 1, [&](size_t jobBegin, size_t jobEnd) {
+            for (size_t job = jobBegin; job < jobEnd; job++) {
+                SetupChunk& chunk = chunks_[job];
+                chunk.triangles.clear();
+                chunk.bins.clear();
+                for (size_t r = triangleJobs_[job]; r < triangleJobs_[job + 1]; r++) {
+                    const MeshRange& range = triangleRanges_[r];
+                    SetupTriangles(meshes[range.mesh], &clip_[vertexOffsets_[range.mesh] * 4], range.begin, range.end,
+                                   chunk);
+                }
+            }
+        });
+
+        // Группы сливаются по порядку, поэтому в корзинах треугольники идут в порядке отправки.
+        for (size_t job = 0; job < jobCount; job++) {
+            const SetupChunk& chunk = chunks_[job];
+            uint32_t base = (uint32_t)triangles_.size();
+            triangles_.insert(triangles_.end(), chunk.triangles.begin(), chunk.triangles.end());
+            for (size_t i = 0; i + 1 < chunk.bins.size(); i += 2) {
+                bins_[chunk.bins[i]].push_back(base + chunk.bins[i + 1]);
+            }
+            stats_.trianglesBinned += chunk.triangles.size();
+            stats_.binEntries += chunk.bins.size() / 2;
+        }
+        for (const MeshRange& range : triangleRanges_) {
+            stats_.trianglesSubmitted += range.end - range.begin;
+        }
+        auto setupEnd = std::chrono::steady_clock::now();
+        stats_.setupSeconds += std::chrono::duration<double>(setupEnd - start).count();
+
+        For(pool, bins_.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t bin = begin; bin < end; bin++) {
+                RenderBin((unsigned)bin);
+            }
+        });
+        for (std::vector<uint32_t>& bin : bins_) {
+            bin.clear();
+        }
+        triangles_.clear();
+        stats_.rasterSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - setupEnd).count();
+    }
+
+    void OcclusionBuffer::RenderBin(unsigned bin) {
+        unsigned tx0 = bin % binsX_ * binTiles, ty0 = bin / binsX_ * binTiles;
+        unsigned tx1 = std::min(tx0 + binTiles, tilesX_), ty1 = std::min(ty0 + binTiles, tilesY_);
+        for (uint32_t index : bins_[bin]) {
+            const Triangle& t = triangles_[index];
+            unsigned fromX = std::max(tx0, (unsigned)t.minX / tileWidth), toX = std::min(tx1 - 1, (unsigned)t.maxX / tileWidth);
+            unsigned fromY = std::max(ty0, (unsigned)t.minY / tileHeight), toY = std::min(ty1 - 1, (unsigned)t.maxY / tileHeight);
+            for (unsigned ty = fromY; ty <= toY; ty++) {
+                for (unsigned tx = fromX; tx <= toX; tx++) {
+                    RenderTriangle(t, ty * tilesX_ + tx);
+                }
+            }
+        }
+    }
+
+    void OcclusionBuffer::RenderTriangle(const Triangle& t, unsigned tile) {
+        static const float rowOffsets[8] = { 0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f };
+        static_assert(tileHeight == 8, "строки плитки - дорожки floatx8");
+        const int x0 = (int)(tile % tilesX_ * tileWidth), y0 = (int)(tile / tilesX_ * tileHeight);
+
+        // Граница пикселей строки по каждому ребру: a * (x + 0.5) + b * y + c >= 0 дает x не меньше или не больше
+        // (-(b * y + c)) / a - 0.5 в зависимости от знака a.
+        floatx8 y = floatx8((float)y0) + floatx8::Load(rowOffsets);
+        floatx8 lo(-1e30f), hi(1e30f);
+        for (int e = 0; e < 3; e++) {
+            floatx8 bound = -(y * floatx8(t.edgeB[e]) + floatx8(t.edgeC[e]));
+            if (t.edgeA[e] > 0.0f) {
+                lo = max(lo, bound * floatx8(t.invEdgeA[e]));
+            } else if (t.edgeA[e] < 0.0f) {
+                hi = min(hi, bound * floatx8(t.invEdgeA[e]));
+            } else {
+                lo = select(bound <= floatx8(0.0f), lo, floatx8(1e30f));
+            }
+        }
+        // Первый и последний пиксели строки относительно плитки, ограниченные [-1, tileWidth].
+        floatx8 first = -floor(-(lo - floatx8(0.5f + x0)));
+        floatx8 last = floor(hi - floatx8(0.5f + x0));
+        first = min(max(first, floatx8(-1.0f)), floatx8((float)tileWidth));
+        last = min(max(last, floatx8(-1.0f)), floatx8((float)tileWidth));
+        float firstLanes[8], lastLanes[8];
+        first.Store(firstLanes);
+        last.Store(lastLanes);
+        uint32_t coverage[tileHeight];
+        uint32_t any = 0;
+        for (unsigned row = 0; row < tileHeight; row++) {
+            coverage[row] = RowBits((int)firstLanes[row], (int)lastLanes[row] + 1);
+            any |= coverage[row];
+        }
+        if (!any)
+            return;
+
+        // Наименьшая глубина плоскости на пересечении плитки и рамки треугольника.
+        float cx0 = (float)std::max(x0, t.minX) + 0.5f, cx1 = (float)std::min(x0 + (int)tileWidth - 1, t.maxX) + 0.5f;
+        float cy0 = (float)std::max(y0, t.minY) + 0.5f, cy1 = (float)std::min(y0 + (int)tileHeight - 1, t.maxY) + 0.5f;
+        float depth = t.depthC + std::min(t.depthA * cx0, t.depthA * cx1) + std::min(t.depthB * cy0, t.depthB * cy1);
+        depth = std::max(depth, t.depthMin);
+
+        float& layer0 = layer0_[tile];
+        float& layer1 = layer1_[tile];
+        uint32_t* mask = &masks_[(size_t)tile * tileHeight];
+        if (depth <= layer0)
+            return;
+        // Треугольник ближе к опорному слою, чем к рабочему: рабочий слой сбрасывается, иначе его глубина
+        // ушла бы далеко назад.
+        if (layer1 - depth > depth - layer0) {
+            layer1 = farLayer;
+            std::fill(mask, mask + tileHeight, 0u);
+        }
+        layer1 = std::min(layer1, depth);
+        uint32_t full = ~0u;
+        for (unsigned row = 0; row < tileHeight; row++) {
+            mask[row] |= coverage[row];
+            full &= mask[row];
+        }
+        if (full == ~0u) {
+            layer0 = layer1;
+            layer1 = farLayer;
+            std::fill(mask, mask + tileHeight, 0u);
+        }
+    }
+
+    bool OcclusionBuffer::TestRect(int minX, int minY, int maxX, int maxY, float depth) const {
+        for (int ty = minY / (int)tileHeight; ty <= maxY / (int)tileHeight; ty++) {
+            for (int tx = minX / (int)tileWidth; tx <= maxX / (int)tileWidth; tx++) {
+                size_t tile = (size_t)ty * tilesX_ + tx;
+                if (depth < layer0_[tile])
+                    continue;
+                if (!(depth < layer1_[tile]))
+                    return false;
+                int x0 = tx * (int)tileWidth, y0 = ty * (int)tileHeight;
+                uint32_t bits = RowBits(minX - x0, maxX - x0 + 1);
+                int rowFrom = std::max(minY - y0, 0), rowTo = std::min(maxY - y0, (int)tileHeight - 1);
+                const uint32_t* mask = &masks_[tile * tileHeight];
+                for (int row = rowFrom; row <= rowTo; row++) {
+                    if ((mask[row] & bits) != bits)
+                        return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    unsigned OcclusionBuffer::ProjectBoxes(const float boxes[6][8], const float* m, float rects[4][8], float depth[8]) const {
+        // Восемь объектов - восемь дорожек. Вклад края по каждой оси в x, y и w считается один раз, угол - сумма
+        // трех вкладов: бит 0 номера угла выбирает край по x, бит 1 - по y, бит 2 - по z.
+        static const int components[3] = { 0, 1, 3 };
+        floatx8 low[3][3], high[3][3];
+        for (int c = 0; c < 3; c++) {
+            for (int k = 0; k < 3; k++) {
+                floatx8 scale(m[k * 4 + components[c]]);
+                low[c][k] = floatx8::Load(boxes[k]) * scale;
+                high[c][k] = floatx8::Load(boxes[3 + k]) * scale;
+            }
+        }
+        floatx8 halfWidth(width_ * 0.5f), halfHeight(height_ * 0.5f), nearW(nearW_);
+        floatx8 minX(1e30f), maxX(-1e30f), minY(1e30f), maxY(-1e30f), nearest(0.0f);
+        floatx8 front = floatx8(0.0f) == floatx8(0.0f);
+        for (int corner = 0; corner < 8; corner++) {
+            floatx8 p[3];
+            for (int c = 0; c < 3; c++) {
+                p[c] = (corner & 1 ? high[c][0] : low[c][0]) + (corner & 2 ? high[c][1] : low[c][1]) +
+                    (corner & 4 ? high[c][2] : low[c][2]) + floatx8(m[12 + components[c]]);
+            }
+            front = front & (p[2] >= nearW);
+            floatx8 invW = floatx8(1.0f) / p[2];
+            floatx8 x = p[0] * invW * halfWidth + halfWidth, y = halfHeight - p[1] * invW * halfHeight;
+            minX = min(minX, x);
+            maxX = max(maxX, x);
+            minY = min(minY, y);
+            maxY = max(maxY, y);
+            nearest = max(nearest, invW);
+        }
+        // Все пиксели, которых касается прямоугольник; объект за краем экрана или у ближней плоскости не проверяется.
+        floatx8 x0 = max(floor(minX), floatx8(0.0f)), x1 = min(-floor(-maxX) - floatx8(1.0f), floatx8(width_ - 1.0f));
+        floatx8 y0 = max(floor(minY), floatx8(0.0f)), y1 = min(-floor(-maxY) - floatx8(1.0f), floatx8(height_ - 1.0f));
+        x0.Store(rects[0]);
+        y0.Store(rects[1]);
+        x1.Store(rects[2]);
+        y1.Store(rects[3]);
+        nearest.Store(depth);
+        return lanemask(front & (x0 <= x1) & (y0 <= y1));
+    }
+
+    bool OcclusionBuffer::IsOccluded(const float boxMin[3], const float boxMax[3], const float* m) const {
+        float boxes[6][8], rects[4][8], depth[8];
+        for (int k = 0; k < 3; k++) {
+            std::fill(boxes[k], boxes[k] + 8, boxMin[k]);
+            std::fill(boxes[3 + k], boxes[3 + k] + 8, boxMax[k]);
+        }
+        return (ProjectBoxes(boxes, m, rects, depth) & 1) &&
+            TestRect((int)rects[0][0], (int)rects[1][0], (int)rects[2][0], (int)rects[3][0], depth[0]);
+    }
+
+    size_t OcclusionBuffer::Cull(const ObjectBounds& bounds, const float* viewProjection, std::vector<uint32_t>& visible,
+                                 ThreadPool* pool) {
+        auto start = std::chrono::steady_clock::now();
+        occluded_.resize(visible.size());
+        For(pool, (visible.size() + 7) / 8, testGrain / 8, [&](size_t begin, size_t end) {
+            for (size_t group = begin; group < end; group++) {
+                // Неполная последняя восьмерка дополняется последним объектом.
+                size_t first = group * 8, count = std::min(visible.size() - first, size_t(8));
+                float boxes[6][8], rects[4][8], depth[8];
+                for (size_t lane = 0; lane < 8; lane++) {
+                    float boxMin[3], boxMax[3];
+                    bounds.GetBox(visible[first + std::min(lane, count - 1)], boxMin, boxMax);
+                    for (int k = 0; k < 3; k++) {
+                        boxes[k][lane] = boxMin[k];
+                        boxes[3 + k][lane] = boxMax[k];
+                    }
+                }
+                unsigned mask = ProjectBoxes(boxes, viewProjection, rects, depth);
+                for (size_t lane = 0; lane < count; lane++) {
+                    occluded_[first + lane] = (mask >> lane & 1) && TestRect((int)rects[0][lane], (int)rects[1][lane],
+                        (int)rects[2][lane], (int)rects[3][lane], depth[lane]) ? 1 : 0;
+                }
+            }
+        });
+        size_t kept = 0;
+        for (size_t i = 0; i < visible.size(); i++) {
+            visible[kept] = visible[i];
+            kept += occluded_[i] ? 0 : 1;
+        }
+        stats_.tested += visible.size();
+        stats_.occluded += visible.size() - kept;
+        visible.resize(kept);
+        stats_.testSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return kept;
+    }
+
+    void OcclusionBuffer::Resolve(std::vector<float>& depth) const {
+        depth.resize((size_t)width_ * height_);
+        for (unsigned y = 0; y < height_; y++) {
+            for (unsigned x = 0; x < width_; x++) {
+                size_t tile = (size_t)(y / tileHeight) * tilesX_ + x / tileWidth;
+                bool masked = (masks_[tile * tileHeight + y % tileHeight] >> (x % tileWidth)) & 1;
+                depth[(size_t)y * width_ + x] = std::max(layer0_[tile], masked ? layer1_[tile] : 0.0f);
+            }
+        }
+    }
+}
@@ -0,0 +1,136 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+
+// Программное отсечение перекрытых объектов по маскированному буферу глубины низкого разрешения. Экран делится
+// на плитки 32 x 8 пикселей; у плитки 1 бит покрытия на пиксель и две глубины: опорный слой (вся плитка закрыта
+// не дальше layer0) и рабочий (пиксели маски закрыты не дальше layer1). Треугольник сливается с рабочим слоем,
+// полностью покрытый рабочий слой становится опорным; если треугольник ближе к опорному, рабочий слой
+// сбрасывается. Глубина - 1 / w, ближе - больше, как в SoftwareRasterizer; глубина треугольника в плитке -
+// наименьшая по плитке, так что буфер всегда дальше настоящей глубины.
+//
+// Render готовит треугольники параллельно по группам и раскладывает по корзинам плиток, затем каждая корзина
+// растеризуется отдельной задачей: восемь строк плитки - восемь дорожек floatx8 (ShaderMath.h). Объект закрыт,
+// если каждый пиксель прямоугольника его параллелепипеда на экране закрыт ближе, чем ближайшая точка
+// параллелепипеда. Не зависит от D3D и собирается на Linux (см. OcclusionCullingBenchMain.cpp).
+namespace culling {
+    class ObjectBounds;
+
+    // Треугольники обрезаются ближней плоскостью, обратные грани не рисуются.
+    struct OccluderMesh {
+        const float* positions = nullptr;           // float3 в начале вершины размера stride
+        size_t stride = 3 * sizeof(float);
+        size_t vertexCount = 0;
+        const uint32_t* indices = nullptr;
+        size_t indexCount = 0;
+        const float* worldViewProjection = nullptr; // 4x4 по строкам, векторы умножаются слева
+        bool frontCounterClockwise = false;
+    };
+
+    struct OcclusionStats {
+        size_t trianglesSubmitted = 0;
+        size_t trianglesBinned = 0;
+        size_t binEntries = 0;
+        size_t tested = 0;
+        size_t occluded = 0;
+        double setupSeconds = 0.0;
+        double rasterSeconds = 0.0;
+        double testSeconds = 0.0;
+    };
+
+    class OcclusionBuffer {
+    public:
+        static const unsigned tileWidth = 32;
+        static const unsigned tileHeight = 8;
+        static const unsigned binTiles = 4;         // корзина - binTiles x binTiles плиток
+        static const size_t vertexGrain = 4096;     // вершин на задачу преобразования
+        static const size_t setupGrain = 1024;      // треугольников на задачу подготовки
+
+        // Размеры округляются вверх до целых плиток, экран растягивается на весь буфер. nearW - ближняя
+        // плоскость: по ней обрезаются треугольники, а объекты, которые ее пересекают, всегда видимы.
+        void Begin(unsigned width, unsigned height, float nearW);
+        void Render(const OccluderMesh* meshes, size_t count, ThreadPool* pool = nullptr);
+
+        // Параллелепипед в мировом пространстве целиком закрыт.
+        bool IsOccluded(const float boxMin[3], const float boxMax[3], const float* viewProjection) const;
+        // Убирает из visible (номера в bounds) закрытые объекты, порядок остальных сохраняется. Возвращает число
+        // оставшихся.
+        size_t Cull(const ObjectBounds& bounds, const float* viewProjection, std::vector<uint32_t>& visible,
+                    ThreadPool* pool = nullptr);
+
+        // Глубина, ближе которой начинается закрытая область пикселя (0 - не закрыт), width x height по строкам.
+        void Resolve(std::vector<float>& depth) const;
+
+        unsigned GetWidth() const {
+            return width_;
+        };
+
+        unsigned GetHeight() const {
+            return height_;
+        };
+
+        const OcclusionStats& GetStats() const {
+            return stats_;
+        };
+
+    private:
+        // Ребро i: edgeA * x + edgeB * y + edgeC >= 0 внутри, координаты в пикселях. Глубина внутри -
+        // depthA * x + depthB * y + depthC, не меньше depthMin.
+        struct Triangle {
+            float edgeA[3], edgeB[3], edgeC[3];
+            float invEdgeA[3];
+            float depthA, depthB, depthC;
+            float depthMin;
+            int minX, minY, maxX, maxY;
+        };
+
+        // Часть вершин или треугольников одной сетки.
+        struct MeshRange {
+            size_t mesh;
+            size_t begin, end;
+        };
+
+        struct SetupChunk {
+            std::vector<Triangle> triangles;
+            std::vector<uint32_t> bins;             // пары (корзина, номер треугольника в группе)
+        };
+
+        // Части сеток по grain вершин или треугольников; jobs - начала задач в ranges, последнее - конец.
+        static void Split(const OccluderMesh* meshes, size_t count, bool triangles, size_t grain,
+                          std::vector<MeshRange>& ranges, std::vector<size_t>& jobs);
+        void SetupTriangles(const OccluderMesh& mesh, const float* clip, size_t begin, size_t end, SetupChunk& chunk) const;
+        void AddTriangle(float x[3], float y[3], float z[3], bool frontCounterClockwise, SetupChunk& chunk) const;
+        void RenderBin(unsigned bin);
+        void RenderTriangle(const Triangle& t, unsigned tile);
+        // Прямоугольники на экране (x0, y0, x1, y1 включительно) и ближайшие глубины восьми параллелепипедов
+        // (boxes - min x y z, max x y z по восемь). Возвращает маску тех, которые можно проверять.
+        unsigned ProjectBoxes(const float boxes[6][8], const float* m, float rects[4][8], float depth[8]) const;
+        bool TestRect(int minX, int minY, int maxX, int maxY, float depth) const;
+
+        unsigned width_ = 0;
+        unsigned height_ = 0;
+        unsigned tilesX_ = 0;
+        unsigned tilesY_ = 0;
+        unsigned binsX_ = 0;
+        float nearW_ = 0.0f;
+        std::vector<float> layer0_;
+        std::vector<float> layer1_;
+        std::vector<uint32_t> masks_;               // tileHeight строк на плитку, бит i - пиксель i строки
+        std::vector<float> clip_;                   // вершины в пространстве отсечения, x y z w
+        std::vector<size_t> vertexOffsets_;         // начало вершин сетки в clip_
+        std::vector<MeshRange> vertexRanges_;
+        std::vector<MeshRange> triangleRanges_;
+        std::vector<size_t> vertexJobs_;
+        std::vector<size_t> triangleJobs_;
+        std::vector<SetupChunk> chunks_;
+        std::vector<Triangle> triangles_;
+        std::vector<std::vector<uint32_t>> bins_;
+        std::vector<uint8_t> occluded_;
+        OcclusionStats stats_;
+    };
+}
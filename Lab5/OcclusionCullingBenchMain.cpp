@@ -0,0 +1,416 @@
+﻿// Замер и проверка OcclusionCulling, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 -mavx2 -mfma -pthread OcclusionCullingBenchMain.cpp OcclusionCulling.cpp ObjectCulling.cpp Meshlets.cpp ThreadPool.cpp -o occlusionculling
+// Примеры:
+//   ./occlusionculling --grid 40 --objects 200000
+//   ./occlusionculling --split 8 --threads 8
+// Город: сетка grid x grid домов с шагом 20 и высотой 4 .. 60, каждая грань дома разбита на split x split квадратов.
+// Между домами и на крышах - мелкие параллелепипеды. Камера стоит на перекрестке на высоте человека. Объекты,
+// прошедшие пирамиду видимости, проверяются по буферу; для сравнения - точный буфер глубины того же размера
+// (каждый пиксель отдельно, без слоев). Закрытый в OcclusionBuffer объект обязан быть закрыт и в точном буфере.
+#include "OcclusionCulling.h"
+#include "ObjectCulling.h"
+#include "Meshlets.h"
+#include "ThreadPool.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+    const float nearW = 0.01f;
+
+    struct Building {
+        float world[16];
+        float worldViewProjection[16];
+    };
+
+    struct Scene {
+        std::vector<float> positions;       // дом [-1, 1] x [0, 1] x [-1, 1]
+        std::vector<uint32_t> indices;
+        std::vector<Building> buildings;
+        std::vector<float> boxes;           // min и max объекта
+    };
+
+    void Multiply(const float* a, const float* b, float* out) {
+        for (int row = 0; row < 4; row++) {
+            for (int column = 0; column < 4; column++) {
+                float sum = 0.0f;
+                for (int k = 0; k < 4; k++) {
+                    sum += a[row * 4 + k] * b[k * 4 + column];
+                }
+                out[row * 4 + column] = sum;
+            }
+        }
+    }
+
+    // Грань из split x split квадратов; u x v - внешняя нормаль, тогда треугольники (o, o + u, o + u + v) обходятся
+    // по часовой стрелке при взгляде снаружи, как лицевые грани в D3D по умолчанию.
+    void AddFace(Scene& scene, const float o[3], const float u[3], const float v[3], unsigned split) {
+        uint32_t base = (uint32_t)(scene.positions.size() / 3);
+        for (unsigned j = 0; j <= split; j++) {
+            for (unsigned i = 0; i <= split; i++) {
+                for (int k = 0; k < 3; k++) {
+                    scene.positions.push_back(o[k] + u[k] * i / split + v[k] * j / split);
+                }
+            }
+        }
+        for (unsigned j = 0; j < split; j++) {
+            for (unsigned i = 0; i < split; i++) {
+                uint32_t a = base + j * (split + 1) + i, b = a + 1, c = a + split + 2, d = a + split + 1;
+                uint32_t quad[6] = { a, b, c, a, c, d };
+                scene.indices.insert(scene.indices.end(), quad, quad + 6);
+            }
+        }
+    }
+
+    void MakeScene(unsigned grid, unsigned split, size_t objectCount, Scene& scene) {
+        const float faces[6][3][3] = {
+            { { -1, 0, -1 }, { 0, 1, 0 }, { 2, 0, 0 } },
+            { { 1, 0, 1 }, { 0, 1, 0 }, { -2, 0, 0 } },
+            { { -1, 0, 1 }, { 0, 1, 0 }, { 0, 0, -2 } },
+            { { 1, 0, -1 }, { 0, 1, 0 }, { 0, 0, 2 } },
+            { { -1, 1, -1 }, { 0, 0, 2 }, { 2, 0, 0 } },
+            { { -1, 0, -1 }, { 2, 0, 0 }, { 0, 0, 2 } },
+        };
+        for (const auto& face : faces) {
+            AddFace(scene, face[0], face[1], face[2], split);
+        }
+
+        std::mt19937 random(11);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        float half = grid * 10.0f;
+        scene.buildings.resize((size_t)grid * grid);
+        for (unsigned z = 0; z < grid; z++) {
+            for (unsigned x = 0; x < grid; x++) {
+                Building& building = scene.buildings[z * grid + x];
+                float sizeX = 5.0f + unit(random) * 3.0f, sizeZ = 5.0f + unit(random) * 3.0f, height = 4.0f + unit(random) * 56.0f;
+                float world[16] = { sizeX, 0, 0, 0, 0, height, 0, 0, 0, 0, sizeZ, 0,
+                    x * 20.0f - half + 10.0f, 0, z * 20.0f - half + 10.0f, 1 };
+                memcpy(building.world, world, sizeof(world));
+            }
+        }
+        scene.boxes.resize(objectCount * 6);
+        for (size_t i = 0; i < objectCount; i++) {
+            float* box = &scene.boxes[i * 6];
+            float center[3] = { unit(random) * 2.0f * half - half, unit(random) * 20.0f, unit(random) * 2.0f * half - half };
+            for (int k = 0; k < 3; k++) {
+                float extent = 0.2f + unit(random) * 1.3f;
+                box[k] = center[k] - extent;
+                box[3 + k] = center[k] + extent;
+            }
+        }
+    }
+
+    // Вид-проекция Renderer с камерой в eye, повернутой на yaw в плоскости xz: PerspectiveFovLH с переставленными
+    // плоскостями (1000 и nearW).
+    void ViewProjection(const float eye[3], float yaw, float aspect, float m[16]) {
+        float s = std::sin(yaw), c = std::cos(yaw);
+        float tx = -(eye[0] * c - eye[2] * s), ty = -eye[1], tz = -(eye[0] * s + eye[2] * c);
+        float view[16] = { c, 0, s, 0, 0, 1, 0, 0, -s, 0, c, 0, tx, ty, tz, 1 };
+        float nearZ = 1000.0f, farZ = nearW;
+        float h = 1.0f / std::tan(3.14159265f / 6.0f), w = h / aspect, range = farZ / (farZ - nearZ);
+        float projection[16] = { w, 0, 0, 0, 0, h, 0, 0, 0, 0, range, 1, 0, 0, -range * nearZ, 0 };
+        Multiply(view, projection, m);
+    }
+
+    // Точный буфер: у каждого пикселя наибольшая 1 / w треугольников, покрывающих его центр, с обеих сторон.
+    // Треугольник чуть расширен, чтобы пиксели на ребре не расходились с OcclusionBuffer из-за округления.
+    void ExactDepth(const Scene& scene, const float viewProjection[16], unsigned width, unsigned height,
+                    std::vector<float>& depth) {
+        depth.assign((size_t)width * height, 0.0f);
+        std::vector<double> clip(scene.positions.size() / 3 * 4);
+        for (const Building& building : scene.buildings) {
+            float m[16];
+            Multiply(building.world, viewProjection, m);
+            for (size_t v = 0; v < clip.size() / 4; v++) {
+                const float* p = &scene.positions[v * 3];
+                for (int k = 0; k < 4; k++) {
+                    clip[v * 4 + k] = (double)p[0] * m[k] + (double)p[1] * m[4 + k] + (double)p[2] * m[8 + k] + m[12 + k];
+                }
+            }
+            for (size_t tri = 0; tri < scene.indices.size(); tri += 3) {
+                double polygon[4][3];
+                int count = 0;
+                for (int i = 0; i < 3; i++) {
+                    const double* a = &clip[scene.indices[tri + i] * 4];
+                    const double* b = &clip[scene.indices[tri + (i + 1) % 3] * 4];
+                    if (a[3] >= nearW) {
+                        polygon[count][0] = a[0];
+                        polygon[count][1] = a[1];
+                        polygon[count++][2] = a[3];
+                    }
+                    if ((a[3] >= nearW) != (b[3] >= nearW)) {
+                        double t = (nearW - a[3]) / (b[3] - a[3]);
+                        polygon[count][0] = a[0] + (b[0] - a[0]) * t;
+                        polygon[count][1] = a[1] + (b[1] - a[1]) * t;
+                        polygon[count++][2] = nearW;
+                    }
+                }
+                double x[4], y[4], z[4];
+                for (int i = 0; i < count; i++) {
+                    z[i] = 1.0 / polygon[i][2];
+                    x[i] = (polygon[i][0] * z[i] * 0.5 + 0.5) * width;
+                    y[i] = (0.5 - polygon[i][1] * z[i] * 0.5) * height;
+                }
+                for (int i = 2; i < count; i++) {
+                    int corner[3] = { 0, i - 1, i };
+                    double area = (x[corner[1]] - x[0]) * (y[corner[2]] - y[0]) - (x[corner[2]] - x[0]) * (y[corner[1]] - y[0]);
+                    if (area == 0.0)
+                        continue;
+                    double minX = std::min(x[0], std::min(x[i - 1], x[i])), maxX = std::max(x[0], std::max(x[i - 1], x[i]));
+                    double minY = std::min(y[0], std::min(y[i - 1], y[i])), maxY = std::max(y[0], std::max(y[i - 1], y[i]));
+                    int x0 = std::max((int)std::floor(minX), 0), x1 = std::min((int)std::ceil(maxX), (int)width - 1);
+                    int y0 = std::max((int)std::floor(minY), 0), y1 = std::min((int)std::ceil(maxY), (int)height - 1);
+                    for (int py = y0; py <= y1; py++) {
+                        for (int px = x0; px <= x1; px++) {
+                            double cx = px + 0.5, cy = py + 0.5, w[3];
+                            bool inside = true;
+                            for (int e = 0; e < 3; e++) {
+                                int a = corner[(e + 1) % 3], b = corner[(e + 2) % 3];
+                                double edge = (x[b] - x[a]) * (cy - y[a]) - (y[b] - y[a]) * (cx - x[a]);
+                                double length = std::hypot(x[b] - x[a], y[b] - y[a]);
+                                w[e] = edge / area;
+                                inside = inside && edge * (area > 0 ? 1.0 : -1.0) >= -1e-3 * length;
+                            }
+                            if (!inside)
+                                continue;
+                            double d = w[0] * z[0] + w[1] * z[i - 1] + w[2] * z[i];
+                            float& out = depth[(size_t)py * width + px];
+                            out = std::max(out, (float)d);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Тот же прямоугольник и ближайшая 1 / w, что в OcclusionBuffer::IsOccluded, но по точному буферу.
+    bool ExactOccluded(const float* box, const float viewProjection[16], unsigned width, unsigned height,
+                       const std::vector<float>& depth) {
+        double minX = 1e30, maxX = -1e30, minY = 1e30, maxY = -1e30, nearest = 0.0;
+        for (int i = 0; i < 8; i++) {
+            double p[3] = { box[i & 1 ? 3 : 0], box[i & 2 ? 4 : 1], box[i & 4 ? 5 : 2] }, clip[4];
+            for (int k = 0; k < 4; k++) {
+                clip[k] = p[0] * viewProjection[k] + p[1] * viewProjection[4 + k] + p[2] * viewProjection[8 + k] +
+                    viewProjection[12 + k];
+            }
+            if (!(clip[3] >= nearW))
+                return false;
+            double invW = 1.0 / clip[3];
+            double x = (clip[0] * invW * 0.5 + 0.5) * width, y = (0.5 - clip[1] * invW * 0.5) * height;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            nearest = std::max(nearest, invW);
+        }
+        int x0 = std::max((int)std::floor(minX), 0), x1 = std::min((int)std::ceil(maxX) - 1, (int)width - 1);
+        int y0 = std::max((int)std::floor(minY), 0), y1 = std::min((int)std::ceil(maxY) - 1, (int)height - 1);
+        if (x0 > x1 || y0 > y1)
+            return false;
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                if (!(nearest < depth[(size_t)y * width + x]))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Заслоняющие сетки домов, прошедших пирамиду видимости, как в Renderer.
+    void MakeMeshes(Scene& scene, const float viewProjection[16], const std::vector<uint32_t>& visible,
+                    std::vector<culling::OccluderMesh>& meshes) {
+        meshes.resize(visible.size());
+        for (size_t i = 0; i < visible.size(); i++) {
+            Building& building = scene.buildings[visible[i]];
+            Multiply(building.world, viewProjection, building.worldViewProjection);
+            culling::OccluderMesh& mesh = meshes[i];
+            mesh.positions = scene.positions.data();
+            mesh.vertexCount = scene.positions.size() / 3;
+            mesh.indices = scene.indices.data();
+            mesh.indexCount = scene.indices.size();
+            mesh.worldViewProjection = building.worldViewProjection;
+        }
+    }
+
+    // Один треугольник на весь экран закрывает все за собой и ничего перед собой; пустой буфер не закрывает ничего.
+    bool CheckBasics() {
+        culling::OcclusionBuffer buffer;
+        buffer.Begin(100, 50, nearW);
+        bool ok = buffer.GetWidth() == 128 && buffer.GetHeight() == 56;
+        float box[6] = { -1.0f, -1.0f, 9.0f, 1.0f, 1.0f, 11.0f };
+        float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+        float eye[3] = { 0.0f, 0.0f, 0.0f }, m[16];
+        ViewProjection(eye, 0.0f, 128.0f / 56.0f, m);
+        ok = ok && !buffer.IsOccluded(box, box + 3, m);
+
+        // Стена на z = 5 по часовой стрелке на экране.
+        float wall[12] = { -100, -100, 5, -100, 100, 5, 100, 100, 5, 100, -100, 5 };
+        uint32_t indices[6] = { 0, 1, 2, 0, 2, 3 };
+        float wallMatrix[16];
+        Multiply(identity, m, wallMatrix);
+        culling::OccluderMesh mesh;
+        mesh.positions = wall;
+        mesh.vertexCount = 4;
+        mesh.indices = indices;
+        mesh.indexCount = 6;
+        mesh.worldViewProjection = wallMatrix;
+        buffer.Render(&mesh, 1);
+        float nearBox[6] = { -1.0f, -1.0f, 2.0f, 1.0f, 1.0f, 4.0f }, crossing[6] = { -1.0f, -1.0f, 4.0f, 1.0f, 1.0f, 6.0f };
+        float behind[6] = { -1.0f, -1.0f, -2.0f, 1.0f, 1.0f, 2.0f };
+        ok = ok && buffer.IsOccluded(box, box + 3, m) && !buffer.IsOccluded(nearBox, nearBox + 3, m) &&
+            !buffer.IsOccluded(crossing, crossing + 3, m) && !buffer.IsOccluded(behind, behind + 3, m);
+        std::vector<float> depth;
+        buffer.Resolve(depth);
+        ok = ok && depth.size() == 128 * 56 && std::fabs(depth[0] - 0.2f) < 1e-5f;
+
+        // Обратная сторона той же стены не рисуется.
+        std::swap(indices[1], indices[2]);
+        std::swap(indices[4], indices[5]);
+        buffer.Begin(100, 50, nearW);
+        buffer.Render(&mesh, 1);
+        ok = ok && !buffer.IsOccluded(box, box + 3, m) && buffer.GetStats().trianglesBinned == 0;
+
+        // Пол, уходящий за камеру, обрезается ближней плоскостью и закрывает то, что под ним.
+        float floor[12] = { -100, -1, -100, -100, -1, 100, 100, -1, 100, 100, -1, -100 };
+        uint32_t floorIndices[6] = { 0, 1, 2, 0, 2, 3 };
+        mesh.positions = floor;
+        mesh.indices = floorIndices;
+        buffer.Begin(100, 50, nearW);
+        buffer.Render(&mesh, 1);
+        float under[6] = { -0.5f, -3.0f, 20.0f, 0.5f, -2.0f, 21.0f }, above[6] = { -0.5f, 0.0f, 9.0f, 0.5f, 1.0f, 10.0f };
+        ok = ok && buffer.IsOccluded(under, under + 3, m) &&
+            !buffer.IsOccluded(above, above + 3, m);
+        printf("Basics: %s\n", ok ? "ok" : "FAILED");
+        return ok;
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned grid = 40, split = 1, width = 320, height = 192, runs = 20;
+    size_t objectCount = 200000;
+    unsigned threads = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--grid") && i + 1 < argc) {
+            grid = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--split") && i + 1 < argc) {
+            split = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--objects") && i + 1 < argc) {
+            objectCount = (size_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--size") && i + 2 < argc) {
+            width = (unsigned)atoi(argv[++i]);
+            height = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--runs") && i + 1 < argc) {
+            runs = (unsigned)atoi(argv[++i]);
+        } else {
+            printf("occlusionculling [--grid <n>] [--split <n>] [--objects <n>] [--size <w> <h>] [--threads <n>] [--runs <n>]\n");
+            return 1;
+        }
+    }
+    grid = std::max(grid, 2u);
+    split = std::max(split, 1u);
+    threads = std::max(threads, 1u);
+    runs = std::max(runs, 1u);
+
+    bool ok = CheckBasics();
+    Scene scene;
+    MakeScene(grid, split, objectCount, scene);
+    culling::ObjectBounds bounds;
+    for (size_t i = 0; i < objectCount; i++) {
+        bounds.Add(&scene.boxes[i * 6], &scene.boxes[i * 6 + 3]);
+    }
+    culling::ObjectBounds buildingBounds;
+    for (const Building& building : scene.buildings) {
+        float unitMin[3] = { -1.0f, 0.0f, -1.0f }, unitMax[3] = { 1.0f, 1.0f, 1.0f }, boxMin[3], boxMax[3];
+        culling::TransformBox(unitMin, unitMax, building.world, boxMin, boxMax);
+        buildingBounds.Add(boxMin, boxMax);
+    }
+    printf("%u x %u buildings, %zu triangles, %zu objects, buffer %u x %u\n", grid, grid,
+        scene.buildings.size() * scene.indices.size() / 3, objectCount, width, height);
+
+    // Камера на перекрестке возле центра города, четыре направления.
+    const float eye[3] = { 0.0f, 1.7f, 0.0f };
+    const float yaws[4] = { 0.1f, 1.7f, 3.3f, 4.9f };
+    culling::OcclusionBuffer buffer;
+    culling::FrustumCuller culler;
+    std::vector<culling::OccluderMesh> meshes;
+    std::vector<uint32_t> inFrustum, visible, buildings;
+    std::vector<float> exact;
+    for (int view = 0; view < 4; view++) {
+        float m[16], planes[6][4];
+        ViewProjection(eye, yaws[view], (float)width / height, m);
+        mesh::ExtractFrustumPlanes(m, planes);
+        culler.Cull(buildingBounds, planes, buildings);
+        MakeMeshes(scene, m, buildings, meshes);
+        culler.Cull(bounds, planes, inFrustum);
+        buffer.Begin(width, height, nearW);
+        buffer.Render(meshes.data(), meshes.size());
+        visible = inFrustum;
+        buffer.Cull(bounds, m, visible);
+
+        // Буфер нигде не ближе точного, закрытые объекты закрыты и в точном буфере.
+        ExactDepth(scene, m, buffer.GetWidth(), buffer.GetHeight(), exact);
+        std::vector<float> depth;
+        buffer.Resolve(depth);
+        size_t nearer = 0, covered = 0, exactCovered = 0;
+        for (size_t p = 0; p < depth.size(); p++) {
+            nearer += depth[p] > exact[p] * (1.0f + 1e-4f) ? 1 : 0;
+            covered += depth[p] > 0.0f ? 1 : 0;
+            exactCovered += exact[p] > 0.0f ? 1 : 0;
+        }
+        size_t wrong = 0, exactOccluded = 0, next = 0;
+        for (uint32_t object : inFrustum) {
+            bool occluded = next >= visible.size() || visible[next] != object;
+            next += occluded ? 0 : 1;
+            bool exactHidden = ExactOccluded(&scene.boxes[object * 6], m, buffer.GetWidth(), buffer.GetHeight(), exact);
+            exactOccluded += exactHidden ? 1 : 0;
+            wrong += occluded && !exactHidden ? 1 : 0;
+        }
+        const culling::OcclusionStats& stats = buffer.GetStats();
+        bool valid = nearer == 0 && wrong == 0;
+        printf("View %d: %zu buildings and %zu objects in frustum, %zu occluded (%.1f%%), exact buffer %zu (%.1f%%); covered pixels %zu of %zu exact, "
+            "%zu triangles binned, %s\n", view, buildings.size(), inFrustum.size(), stats.occluded, 100.0 * stats.occluded / std::max(inFrustum.size(), size_t(1)),
+            exactOccluded, 100.0 * exactOccluded / std::max(inFrustum.size(), size_t(1)), covered, exactCovered,
+            stats.trianglesBinned, valid ? "ok" : "FAILED");
+        if (!valid) {
+            printf("  %zu pixels nearer than exact, %zu objects wrongly occluded\n", nearer, wrong);
+        }
+        ok = ok && valid;
+    }
+
+    for (unsigned n = 1; n <= threads; n = n < threads ? std::min(n * 2, threads) : n + 1) {
+        std::unique_ptr<ThreadPool> pool(n > 1 ? new ThreadPool(n - 1) : nullptr);
+        double bestRender = 1e30, bestTest = 1e30, bestSetup = 1e30;
+        size_t tested = 0;
+        for (unsigned run = 0; run < runs; run++) {
+            float m[16], planes[6][4];
+            ViewProjection(eye, yaws[run % 4], (float)width / height, m);
+            mesh::ExtractFrustumPlanes(m, planes);
+            culler.Cull(buildingBounds, planes, buildings);
+            MakeMeshes(scene, m, buildings, meshes);
+            culler.Cull(bounds, planes, inFrustum);
+            buffer.Begin(width, height, nearW);
+            auto start = std::chrono::steady_clock::now();
+            buffer.Render(meshes.data(), meshes.size(), pool.get());
+            auto rendered = std::chrono::steady_clock::now();
+            buffer.Cull(bounds, m, inFrustum, pool.get());
+            auto end = std::chrono::steady_clock::now();
+            bestRender = std::min(bestRender, std::chrono::duration<double>(rendered - start).count());
+            bestSetup = std::min(bestSetup, buffer.GetStats().setupSeconds);
+            bestTest = std::min(bestTest, std::chrono::duration<double>(end - rendered).count());
+            tested = std::max(tested, buffer.GetStats().tested);
+        }
+        printf("threads %2u: render %.3f ms best (setup %.3f ms), test %.3f ms best (%.1f ns/object)\n", n,
+            bestRender * 1e3, bestSetup * 1e3, bestTest * 1e3, bestTest * 1e9 / std::max(tested, size_t(1)));
+    }
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
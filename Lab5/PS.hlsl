@@ -1,19 +1,15 @@
 #include "LightCalc.h"
 
-cbuffer WorldMatrixBuffer : register (b0) {
-    float4x4 worldMatrix;
-    float3 color;
-    float roughness;
-    float metalness;
-};
-
+// Материал приходит из VS.hlsl, поэтому инстансы и одиночные объекты используют один пиксельный шейдер.
 struct PS_INPUT {
     float4 position : SV_POSITION;
     float4 worldPos : POSITION;
     float3 normal : NORMAL;
+    nointerpolation float3 color : COLOR;
+    nointerpolation float2 material : MATERIAL;     // шероховатость, металличность
 };
 
 float4 main(PS_INPUT input) : SV_TARGET {
-    return float4(CalculateColor(color, normalize(input.normal), input.worldPos.xyz,
-        clamp(roughness, 0.0001f, 1.0f), clamp(metalness, 0.0f, 1.0f)), 1.0f);
+    return float4(CalculateColor(input.color, normalize(input.normal), input.worldPos.xyz,
+        clamp(input.material.x, 0.0001f, 1.0f), clamp(input.material.y, 0.0f, 1.0f)), 1.0f);
 }
\ No newline at end of file
@@ -0,0 +1,191 @@
+﻿// Консольный запуск эталонного рендера без окна и D3D, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 -pthread PathTraceMain.cpp PathTracer.cpp ThreadPool.cpp ImageEncoder.cpp -o pathtrace
+// Примеры:
+//   ./pathtrace --spp 256 --light 3 3 -3 1 1 1 20 --out reference.hdr
+//   ./pathtrace --bench --width 320 --height 180 --spp 4
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "PathTracer.h"
+#include "ThreadPool.h"
+#include "ImageEncoder.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <memory>
+
+namespace {
+    void Usage() {
+        printf("pathtrace [options]\n"
+            "  --env <file.hdr>           equirect environment (textures/hdr_text.hdr), --env none for black\n"
+            "  --out <file.hdr>           output (reference.hdr)\n"
+            "  --width <w> --height <h>   image size (1280 x 720)\n"
+            "  --spp <n>                  samples per pixel (64)\n"
+            "  --pass <n>                 samples per progressive pass (8)\n"
+            "  --threads <n>              worker count including the main thread (all cores)\n"
+            "  --seed <n>                 seed of the deterministic mode (0)\n"
+            "  --random                   seed from the clock, results differ between runs\n"
+            "  --color <r> <g> <b> --roughness <r> --metalness <m>\n"
+            "  --light <x> <y> <z> <r> <g> <b> <brightness>   may be repeated\n"
+            "  --camera <px> <py> <pz> <fx> <fy> <fz>         position and focus point\n"
+            "  --bench                    samples per second for 1..threads workers, no output file\n");
+    }
+
+    void Normalize(float v[3]) {
+        float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+
+    void Cross(const float a[3], const float b[3], float out[3]) {
+        out[0] = a[1] * b[2] - a[2] * b[1];
+        out[1] = a[2] * b[0] - a[0] * b[2];
+        out[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    // Базис как у XMMatrixLookAtLH, вектор up как в Camera::UpdateViewMatrix - перпендикулярен взгляду в вертикальной плоскости.
+    void LookAt(const float position[3], const float focus[3], reference::View& view) {
+        for (int k = 0; k < 3; k++) {
+            view.position[k] = position[k];
+            view.forward[k] = focus[k] - position[k];
+        }
+        Normalize(view.forward);
+        const float worldUp[3] = { 0.0f, 1.0f, 0.0f };
+        Cross(worldUp, view.forward, view.right);
+        Normalize(view.right);
+        Cross(view.forward, view.right, view.up);
+    }
+
+    bool ReadFloats(int argc, char** argv, int& i, float* out, int count) {
+        if (i + count >= argc)
+            return false;
+        for (int k = 0; k < count; k++) {
+            out[k] = (float)atof(argv[++i]);
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string envPath = "textures/hdr_text.hdr";
+    std::string outPath = "reference.hdr";
+    unsigned width = 1280, height = 720, spp = 64, pass = 8;
+    unsigned threads = std::thread::hardware_concurrency();
+    bool bench = false;
+    reference::TracerOptions options;
+    reference::Scene scene;
+    scene.spheres.push_back(reference::Sphere());
+    // Начальное положение Camera: r = 5, theta = -pi / 4, взгляд в начало координат.
+    float position[3] = { 0.0f, 3.5355339f, -3.5355339f }, focus[3] = { 0.0f, 0.0f, 0.0f };
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool ok = true;
+        if (!strcmp(arg, "--env") && i + 1 < argc) {
+            envPath = argv[++i];
+        } else if (!strcmp(arg, "--out") && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (!strcmp(arg, "--width") && i + 1 < argc) {
+            width = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(arg, "--height") && i + 1 < argc) {
+            height = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(arg, "--spp") && i + 1 < argc) {
+            spp = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(arg, "--pass") && i + 1 < argc) {
+            pass = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(arg, "--threads") && i + 1 < argc) {
+            threads = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(arg, "--seed") && i + 1 < argc) {
+            options.seed = strtoull(argv[++i], nullptr, 10);
+        } else if (!strcmp(arg, "--random")) {
+            options.deterministic = false;
+        } else if (!strcmp(arg, "--color")) {
+            ok = ReadFloats(argc, argv, i, scene.spheres[0].material.color, 3);
+        } else if (!strcmp(arg, "--roughness")) {
+            ok = ReadFloats(argc, argv, i, &scene.spheres[0].material.roughness, 1);
+        } else if (!strcmp(arg, "--metalness")) {
+            ok = ReadFloats(argc, argv, i, &scene.spheres[0].material.metalness, 1);
+        } else if (!strcmp(arg, "--light")) {
+            float values[7];
+            ok = ReadFloats(argc, argv, i, values, 7);
+            if (ok) {
+                scene.lights.push_back({ { values[0], values[1], values[2] }, { values[3], values[4], values[5] }, values[6] });
+            }
+        } else if (!strcmp(arg, "--camera")) {
+            float values[6];
+            ok = ReadFloats(argc, argv, i, values, 6);
+            if (ok) {
+                memcpy(position, values, sizeof(position));
+                memcpy(focus, values + 3, sizeof(focus));
+            }
+        } else if (!strcmp(arg, "--bench")) {
+            bench = true;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            Usage();
+            return 1;
+        }
+    }
+    if (width == 0 || height == 0 || spp == 0) {
+        Usage();
+        return 1;
+    }
+    threads = threads == 0 ? 1 : threads;
+    pass = pass == 0 ? 1 : pass;
+    LookAt(position, focus, scene.view);
+
+    reference::Environment environment;
+    if (envPath != "none") {
+        int envWidth = 0, envHeight = 0, components = 0;
+        float* data = stbi_loadf(envPath.c_str(), &envWidth, &envHeight, &components, 4);
+        if (!data) {
+            fprintf(stderr, "Failed to load %s\n", envPath.c_str());
+            return 1;
+        }
+        environment.Init(data, (unsigned)envWidth, (unsigned)envHeight);
+        stbi_image_free(data);
+        scene.environment = &environment;
+    }
+
+    reference::PathTracer tracer;
+    if (bench) {
+        // Пул из n - 1 рабочих потоков плюс вызывающий поток.
+        for (unsigned n = 1; n <= threads; n++) {
+            std::unique_ptr<ThreadPool> pool(n > 1 ? new ThreadPool(n - 1) : nullptr);
+            tracer.Reset(width, height, options);
+            tracer.Render(scene, spp, pool.get());
+            const reference::TracerStats& stats = tracer.GetLastStats();
+            printf("threads %2u: %8.3f s, %7.3f Msamples/s, %7.3f Mrays/s\n", n, stats.seconds,
+                stats.samples / stats.seconds * 1e-6, stats.rays / stats.seconds * 1e-6);
+        }
+        return 0;
+    }
+
+    std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads - 1) : nullptr);
+    tracer.Reset(width, height, options);
+    double seconds = 0.0;
+    uint64_t samples = 0;
+    while (tracer.GetSampleCount() < spp) {
+        unsigned count = spp - tracer.GetSampleCount() < pass ? spp - tracer.GetSampleCount() : pass;
+        tracer.Render(scene, count, pool.get());
+        seconds += tracer.GetLastStats().seconds;
+        samples += tracer.GetLastStats().samples;
+        printf("%u / %u spp, %.2f s, %.3f Msamples/s\n", tracer.GetSampleCount(), spp, seconds, samples / seconds * 1e-6);
+    }
+
+    std::vector<float> image;
+    tracer.Resolve(image);
+    std::vector<uint8_t> encoded;
+    if (!encoder::EncodeHDR(image.data(), width, height, width * 4 * sizeof(float), PixelFormat::RGBA32F, encoded) ||
+        !encoder::WriteFile(outPath, encoded)) {
+        fprintf(stderr, "Failed to write %s\n", outPath.c_str());
+        return 1;
+    }
+    printf("Written %s\n", outPath.c_str());
+    return 0;
+}
@@ -0,0 +1,509 @@
+﻿#include "PathTracer.h"
+#include "ThreadPool.h"
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+
+namespace {
+    const float pi = 3.14159265358979323846f;
+
+    struct Vec3 {
+        float x, y, z;
+    };
+
+    inline Vec3 Make(const float v[3]) {
+        return { v[0], v[1], v[2] };
+    }
+
+    inline Vec3 operator+(const Vec3& a, const Vec3& b) {
+        return { a.x + b.x, a.y + b.y, a.z + b.z };
+    }
+
+    inline Vec3 operator-(const Vec3& a, const Vec3& b) {
+        return { a.x - b.x, a.y - b.y, a.z - b.z };
+    }
+
+    inline Vec3 operator*(const Vec3& a, float s) {
+        return { a.x * s, a.y * s, a.z * s };
+    }
+
+    inline Vec3 operator*(const Vec3& a, const Vec3& b) {
+        return { a.x * b.x, a.y * b.y, a.z * b.z };
+    }
+
+    inline float Dot(const Vec3& a, const Vec3& b) {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    inline Vec3 Cross(const Vec3& a, const Vec3& b) {
+        return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+    }
+
+    inline Vec3 Normalize(const Vec3& a) {
+        return a * (1.0f / std::sqrt(Dot(a, a)));
+    }
+
+    inline float Luminance(const Vec3& c) {
+        return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+    }
+
+    inline uint64_t SplitMix64(uint64_t x) {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    // PCG32: состояние каждого отсчета выводится из (seed, пиксель, номер отсчета).
+    class Random {
+    public:
+        Random(uint64_t seed, uint64_t pixel, uint64_t sample) {
+            state_ = SplitMix64(seed ^ SplitMix64(pixel ^ SplitMix64(sample)));
+            increment_ = (SplitMix64(state_) << 1) | 1;
+        }
+
+        uint32_t Next() {
+            uint64_t old = state_;
+            state_ = old * 6364136223846793005ull + increment_;
+            uint32_t xorShifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+            uint32_t rotation = (uint32_t)(old >> 59);
+            return (xorShifted >> rotation) | (xorShifted << ((32 - rotation) & 31));
+        }
+
+        // [0, 1)
+        float Uniform() {
+            return (Next() >> 8) * (1.0f / 16777216.0f);
+        }
+
+    private:
+        uint64_t state_;
+        uint64_t increment_;
+    };
+
+    // Ортонормированный базис вокруг n (Duff et al. 2017).
+    void Basis(const Vec3& n, Vec3& t, Vec3& b) {
+        float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+        float a = -1.0f / (sign + n.z);
+        float c = n.x * n.y * a;
+        t = { 1.0f + sign * n.x * n.x * a, sign * c, -sign * n.x };
+        b = { c, sign + n.y * n.y * a, -n.y };
+    }
+
+    // BRDF из LightCalc.h и выборка по ней: смесь GGX (D * cos по полувектору) и косинусной диффузной доли.
+    struct Brdf {
+        Vec3 n, v;
+        Vec3 color;
+        float roughness, metalness;
+        float nv;
+        float specularProbability;
+
+        Brdf(const Vec3& normal, const Vec3& view, const reference::Material& material) : n(normal), v(view) {
+            color = Make(material.color);
+            roughness = std::min(std::max(material.roughness, 0.0001f), 1.0f);
+            metalness = std::min(std::max(material.metalness, 0.0f), 1.0f);
+            nv = std::max(Dot(n, v), 0.0f);
+
+            // Доли лобов по отражательной способности при h = n.
+            Vec3 f = Fresnel(nv);
+            Vec3 diffuse = (Vec3{ 1.0f, 1.0f, 1.0f } - f) * color * (1.0f - metalness);
+            float specular = Luminance(f);
+            float total = specular + Luminance(diffuse);
+            specularProbability = total > 0.0f ? specular / total : 1.0f;
+        }
+
+        Vec3 F0() const {
+            return Vec3{ 0.04f, 0.04f, 0.04f } * (1.0f - metalness) + color * metalness;
+        }
+
+        Vec3 Fresnel(float hv) const {
+            Vec3 f0 = F0();
+            float m = 1.0f - hv;
+            float m5 = m * m * m * m * m;
+            return f0 + (Vec3{ 1.0f, 1.0f, 1.0f } - f0) * m5;
+        }
+
+        // GGX с alpha = roughness, как distributionGGX. (n.h)^2 (a^2 - 1) + 1 = sin^2 + a^2 cos^2; синус через
+        // векторное произведение не теряет точность у самого пика при малой шероховатости.
+        float Distribution(const Vec3& h) const {
+            Vec3 s = Cross(n, h);
+            float sin2 = Dot(s, s);
+            float cos = Dot(n, h);
+            float a2 = roughness * roughness;
+            float denom = sin2 + a2 * cos * cos;
+            return a2 / (pi * denom * denom);
+        }
+
+        float GeometrySchlick(float x) const {
+            float k = (roughness + 1.0f) * (roughness + 1.0f) / 8.0f;
+            return x / (x * (1.0f - k) + k);
+        }
+
+        Vec3 Evaluate(const Vec3& l) const {
+            float nl = Dot(n, l);
+            if (nl <= 0.0f || nv <= 0.0f)
+                return { 0.0f, 0.0f, 0.0f };
+            Vec3 h = Normalize(v + l);
+            Vec3 f = Fresnel(std::max(Dot(h, v), 0.0f));
+            float d = Distribution(h);
+            float g = GeometrySchlick(nv) * GeometrySchlick(nl);
+            Vec3 kd = (Vec3{ 1.0f, 1.0f, 1.0f } - f) * (1.0f - metalness);
+            return kd * color * (1.0f / pi) + f * (d * g / std::max(4.0f * nv * nl, 0.0001f));
+        }
+
+        float Pdf(const Vec3& l) const {
+            float nl = Dot(n, l);
+            if (nl <= 0.0f || nv <= 0.0f)
+                return 0.0f;
+            Vec3 h = Normalize(v + l);
+            float hv = Dot(h, v);
+            float specular = hv > 0.0f ? Distribution(h) * Dot(n, h) / (4.0f * hv) : 0.0f;
+            return specularProbability * specular + (1.0f - specularProbability) * nl / pi;
+        }
+
+        bool Sample(Random& random, Vec3& l) const {
+            if (nv <= 0.0f)
+                return false;
+            Vec3 t, b;
+            Basis(n, t, b);
+            float u1 = random.Uniform(), u2 = random.Uniform();
+            float phi = 2.0f * pi * u2;
+            if (random.Uniform() < specularProbability) {
+                float a2 = roughness * roughness;
+                float cos2 = (1.0f - u1) / (1.0f + (a2 - 1.0f) * u1);
+                float cos = std::sqrt(cos2), sin = std::sqrt(std::max(1.0f - cos2, 0.0f));
+                Vec3 h = t * (sin * std::cos(phi)) + b * (sin * std::sin(phi)) + n * cos;
+                l = h * (2.0f * Dot(v, h)) - v;
+            } else {
+                float r = std::sqrt(u1);
+                l = t * (r * std::cos(phi)) + b * (r * std::sin(phi)) + n * std::sqrt(std::max(1.0f - u1, 0.0f));
+            }
+            return Dot(n, l) > 0.0f;
+        }
+    };
+
+    // Эвристика степени 2 для двух стратегий по одному отсчету.
+    inline float PowerHeuristic(float pdf, float other) {
+        float a = pdf * pdf, b = other * other;
+        return a + b > 0.0f ? a / (a + b) : 0.0f;
+    }
+
+    struct Hit {
+        float t;
+        const reference::Sphere* sphere;
+    };
+
+    bool IntersectSphere(const reference::Sphere& sphere, const Vec3& origin, const Vec3& direction, float tMax, float& t) {
+        Vec3 oc = origin - Make(sphere.center);
+        float b = Dot(oc, direction);
+        // Дискриминант через расстояние до хорды: устойчивее b * b - c для далеких лучей.
+        Vec3 perpendicular = oc - direction * b;
+        float h = sphere.radius * sphere.radius - Dot(perpendicular, perpendicular);
+        if (h < 0.0f)
+            return false;
+        h = std::sqrt(h);
+        float t0 = -b - h, t1 = -b + h;
+        t = t0 > 0.0f ? t0 : t1;
+        return t > 0.0f && t < tMax;
+    }
+
+    bool Intersect(const reference::Scene& scene, const Vec3& origin, const Vec3& direction, float tMax, Hit& hit) {
+        hit.t = tMax;
+        hit.sphere = nullptr;
+        for (const reference::Sphere& sphere : scene.spheres) {
+            float t;
+            if (IntersectSphere(sphere, origin, direction, hit.t, t)) {
+                hit.t = t;
+                hit.sphere = &sphere;
+            }
+        }
+        return hit.sphere != nullptr;
+    }
+
+    bool Occluded(const reference::Scene& scene, const Vec3& origin, const Vec3& direction, float tMax) {
+        for (const reference::Sphere& sphere : scene.spheres) {
+            float t;
+            if (IntersectSphere(sphere, origin, direction, tMax, t))
+                return true;
+        }
+        return false;
+    }
+
+    struct PathCounters {
+        uint64_t rays = 0;
+    };
+
+    Vec3 Trace(const reference::Scene& scene, const reference::TracerOptions& options, Vec3 origin, Vec3 direction,
+               Random& random, PathCounters& counters) {
+        const reference::Environment* environment = scene.environment && !scene.environment->IsEmpty() ? scene.environment : nullptr;
+        Vec3 radiance = { 0.0f, 0.0f, 0.0f };
+        Vec3 throughput = { 1.0f, 1.0f, 1.0f };
+        float bsdfPdf = 0.0f;           // 0 - предыдущее направление не выбиралось по BRDF (луч камеры)
+
+        for (unsigned depth = 0; depth < options.maxDepth; depth++) {
+            Hit hit;
+            counters.rays++;
+            if (!Intersect(scene, origin, direction, 1e30f, hit)) {
+                if (environment) {
+                    float d[3] = { direction.x, direction.y, direction.z };
+                    float le[3];
+                    environment->Lookup(d, le);
+                    float weight = bsdfPdf > 0.0f ? PowerHeuristic(bsdfPdf, environment->Pdf(d)) : 1.0f;
+                    radiance = radiance + throughput * Make(le) * weight;
+                }
+                break;
+            }
+
+            Vec3 position = origin + direction * hit.t;
+            Vec3 normal = Normalize(position - Make(hit.sphere->center));
+            Vec3 view = direction * -1.0f;
+            if (Dot(normal, view) < 0.0f) {
+                normal = normal * -1.0f;
+            }
+            Brdf brdf(normal, view, hit.sphere->material);
+            float epsilon = 1e-4f * std::max(hit.sphere->radius, 1.0f);
+            Vec3 surface = position + normal * epsilon;
+
+            for (const reference::PointLight& light : scene.lights) {
+                Vec3 toLight = Make(light.position) - surface;
+                float distance2 = Dot(toLight, toLight);
+                float distance = std::sqrt(distance2);
+                Vec3 l = toLight * (1.0f / distance);
+                float nl = Dot(normal, l);
+                if (nl <= 0.0f)
+                    continue;
+                counters.rays++;
+                if (Occluded(scene, surface, l, distance))
+                    continue;
+                float attenuation = std::min(1.0f / distance2, 1.0f);
+                Vec3 le = Make(light.color) * (light.brightness * attenuation);
+                radiance = radiance + throughput * brdf.Evaluate(l) * le * nl;
+            }
+
+            if (environment) {
+                float d[3], le[3];
+                float lightPdf = environment->Sample(random.Uniform(), random.Uniform(), d, le);
+                Vec3 l = Make(d);
+                float nl = Dot(normal, l);
+                if (lightPdf > 0.0f && nl > 0.0f) {
+                    counters.rays++;
+                    if (!Occluded(scene, surface, l, 1e30f)) {
+                        float weight = PowerHeuristic(lightPdf, brdf.Pdf(l));
+                        radiance = radiance + throughput * brdf.Evaluate(l) * Make(le) * (nl * weight / lightPdf);
+                    }
+                }
+            }
+
+            Vec3 l;
+            if (!brdf.Sample(random, l))
+                break;
+            bsdfPdf = brdf.Pdf(l);
+            if (bsdfPdf <= 0.0f)
+                break;
+            throughput = throughput * brdf.Evaluate(l) * (Dot(normal, l) / bsdfPdf);
+
+            if (depth + 1 >= options.rouletteDepth) {
+                float survive = std::min(std::max(throughput.x, std::max(throughput.y, throughput.z)), 0.95f);
+                if (random.Uniform() >= survive)
+                    break;
+                throughput = throughput * (1.0f / survive);
+            }
+            origin = surface;
+            direction = l;
+        }
+        return radiance;
+    }
+}
+
+namespace reference {
+    void Environment::Init(const float* rgba, unsigned width, unsigned height) {
+        width_ = width;
+        height_ = height;
+        size_t count = (size_t)width * height;
+        radiance_.resize(count * 3);
+        rowCdf_.assign(height + 1, 0.0f);
+        columnCdf_.assign((size_t)height * (width + 1), 0.0f);
+        pixelPdf_.assign(count, 0.0f);
+
+        // Вес пикселя - яркость, умноженная на косинус высоты: строки у полюсов покрывают меньший телесный угол.
+        double total = 0.0;
+        for (unsigned y = 0; y < height; y++) {
+            float elevation = pi * (0.5f - (y + 0.5f) / height);
+            float area = std::cos(elevation);
+            float* cdf = &columnCdf_[(size_t)y * (width + 1)];
+            double sum = 0.0;
+            for (unsigned x = 0; x < width; x++) {
+                size_t i = (size_t)y * width + x;
+                Vec3 c = { rgba[i * 4], rgba[i * 4 + 1], rgba[i * 4 + 2] };
+                radiance_[i * 3] = c.x;
+                radiance_[i * 3 + 1] = c.y;
+                radiance_[i * 3 + 2] = c.z;
+                double weight = std::max(Luminance(c), 0.0f) * area;
+                pixelPdf_[i] = (float)weight;
+                sum += weight;
+                cdf[x + 1] = (float)sum;
+            }
+            for (unsigned x = 1; x <= width; x++) {
+                cdf[x] = sum > 0.0 ? (float)(cdf[x] / sum) : (float)x / width;
+            }
+            total += sum;
+            rowCdf_[y + 1] = (float)total;
+        }
+        for (unsigned y = 1; y <= height; y++) {
+            rowCdf_[y] = total > 0.0 ? (float)(rowCdf_[y] / total) : (float)y / height;
+        }
+        // Плотность по (u, v) на единицу площади развертки.
+        for (size_t i = 0; i < count; i++) {
+            pixelPdf_[i] = total > 0.0 ? (float)(pixelPdf_[i] * count / total) : 1.0f;
+        }
+    }
+
+    size_t Environment::PixelIndex(const float direction[3], float& cosElevation) const {
+        float horizontal = std::sqrt(direction[0] * direction[0] + direction[2] * direction[2]);
+        float u = 1.0f - std::atan2(direction[2], direction[0]) / (2.0f * pi);
+        float v = 0.5f - std::atan2(direction[1], horizontal) / pi;
+        u -= std::floor(u);
+        unsigned x = std::min((unsigned)(u * width_), width_ - 1);
+        unsigned y = std::min((unsigned)std::max(v * height_, 0.0f), height_ - 1);
+        float length = std::sqrt(horizontal * horizontal + direction[1] * direction[1]);
+        cosElevation = length > 0.0f ? horizontal / length : 0.0f;
+        return (size_t)y * width_ + x;
+    }
+
+    void Environment::Lookup(const float direction[3], float radiance[3]) const {
+        float cosElevation;
+        size_t i = PixelIndex(direction, cosElevation);
+        radiance[0] = radiance_[i * 3];
+        radiance[1] = radiance_[i * 3 + 1];
+        radiance[2] = radiance_[i * 3 + 2];
+    }
+
+    // d omega = cos(elevation) * 2 pi du * pi dv.
+    float Environment::Pdf(const float direction[3]) const {
+        float cosElevation;
+        size_t i = PixelIndex(direction, cosElevation);
+        if (cosElevation <= 0.0f)
+            return 0.0f;
+        return pixelPdf_[i] / (2.0f * pi * pi * cosElevation);
+    }
+
+    float Environment::Sample(float u1, float u2, float direction[3], float radiance[3]) const {
+        const float* rowEnd = rowCdf_.data() + height_ + 1;
+        unsigned y = (unsigned)(std::upper_bound(rowCdf_.data() + 1, rowEnd, u2) - (rowCdf_.data() + 1));
+        y = std::min(y, height_ - 1);
+        const float* cdf = &columnCdf_[(size_t)y * (width_ + 1)];
+        unsigned x = (unsigned)(std::upper_bound(cdf + 1, cdf + width_ + 1, u1) - (cdf + 1));
+        x = std::min(x, width_ - 1);
+
+        // Положение внутри пикселя по остатку случайных чисел.
+        float rowWidth = rowCdf_[y + 1] - rowCdf_[y];
+        float columnWidth = cdf[x + 1] - cdf[x];
+        float fy = rowWidth > 0.0f ? std::min(std::max((u2 - rowCdf_[y]) / rowWidth, 0.0f), 0.9999f) : 0.5f;
+        float fx = columnWidth > 0.0f ? std::min(std::max((u1 - cdf[x]) / columnWidth, 0.0f), 0.9999f) : 0.5f;
+        float u = (x + fx) / width_;
+        float v = (y + fy) / height_;
+
+        float phi = 2.0f * pi * (1.0f - u);
+        float elevation = pi * (0.5f - v);
+        float cosElevation = std::cos(elevation);
+        direction[0] = cosElevation * std::cos(phi);
+        direction[1] = std::sin(elevation);
+        direction[2] = cosElevation * std::sin(phi);
+
+        size_t i = (size_t)y * width_ + x;
+        radiance[0] = radiance_[i * 3];
+        radiance[1] = radiance_[i * 3 + 1];
+        radiance[2] = radiance_[i * 3 + 2];
+        if (cosElevation <= 0.0f)
+            return 0.0f;
+        return pixelPdf_[i] / (2.0f * pi * pi * cosElevation);
+    }
+
+    void PathTracer::Reset(unsigned width, unsigned height, const TracerOptions& options) {
+        width_ = width;
+        height_ = height;
+        options_ = options;
+        if (options_.tileSize == 0) {
+            options_.tileSize = 16;
+        }
+        sampleCount_ = 0;
+        seed_ = options.seed;
+        if (!options.deterministic) {
+            std::random_device device;
+            seed_ ^= ((uint64_t)device() << 32) ^ device() ^
+                (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+        }
+        accumulation_.assign((size_t)width * height * 3, 0.0);
+        lastStats_ = TracerStats();
+    }
+
+    void PathTracer::Render(const Scene& scene, unsigned samplesPerPixel, ThreadPool* pool) {
+        lastStats_ = TracerStats();
+        if (width_ == 0 || height_ == 0 || samplesPerPixel == 0)
+            return;
+        auto start = std::chrono::steady_clock::now();
+
+        const unsigned tile = options_.tileSize;
+        const unsigned tilesX = (width_ + tile - 1) / tile;
+        const unsigned tilesY = (height_ + tile - 1) / tile;
+        const View& view = scene.view;
+        const Vec3 position = Make(view.position), right = Make(view.right), up = Make(view.up), forward = Make(view.forward);
+        const float tanHalf = std::tan(view.fovY * 0.5f);
+        const float aspect = (float)width_ / height_;
+        const unsigned firstSample = sampleCount_;
+        std::atomic<uint64_t> rays(0);
+
+        auto renderTiles = [&](size_t begin, size_t end) {
+            PathCounters counters;
+            for (size_t t = begin; t < end; t++) {
+                unsigned x0 = (unsigned)(t % tilesX) * tile, y0 = (unsigned)(t / tilesX) * tile;
+                unsigned x1 = std::min(x0 + tile, width_), y1 = std::min(y0 + tile, height_);
+                for (unsigned y = y0; y < y1; y++) {
+                    for (unsigned x = x0; x < x1; x++) {
+                        size_t pixel = (size_t)y * width_ + x;
+                        double* sum = &accumulation_[pixel * 3];
+                        for (unsigned s = 0; s < samplesPerPixel; s++) {
+                            Random random(seed_, pixel, firstSample + s);
+                            float sx = (2.0f * (x + random.Uniform()) / width_ - 1.0f) * tanHalf * aspect;
+                            float sy = (1.0f - 2.0f * (y + random.Uniform()) / height_) * tanHalf;
+                            Vec3 direction = Normalize(forward + right * sx + up * sy);
+                            Vec3 c = Trace(scene, options_, position, direction, random, counters);
+                            // Отсчет с NaN или бесконечностью портит пиксель навсегда, такие отбрасываются.
+                            if (std::isfinite(c.x) && std::isfinite(c.y) && std::isfinite(c.z)) {
+                                sum[0] += c.x;
+                                sum[1] += c.y;
+                                sum[2] += c.z;
+                            }
+                        }
+                    }
+                }
+            }
+            rays += counters.rays;
+        };
+
+        size_t tileCount = (size_t)tilesX * tilesY;
+        if (pool) {
+            pool->ParallelFor(tileCount, 1, renderTiles);
+        } else {
+            renderTiles(0, tileCount);
+        }
+
+        sampleCount_ += samplesPerPixel;
+        lastStats_.samples = (uint64_t)width_ * height_ * samplesPerPixel;
+        lastStats_.rays = rays.load();
+        lastStats_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void PathTracer::Resolve(std::vector<float>& rgba) const {
+        size_t count = (size_t)width_ * height_;
+        rgba.resize(count * 4);
+        double scale = sampleCount_ > 0 ? 1.0 / sampleCount_ : 0.0;
+        for (size_t i = 0; i < count; i++) {
+            rgba[i * 4] = (float)(accumulation_[i * 3] * scale);
+            rgba[i * 4 + 1] = (float)(accumulation_[i * 3 + 1] * scale);
+            rgba[i * 4 + 2] = (float)(accumulation_[i * 3 + 2] * scale);
+            rgba[i * 4 + 3] = 1.0f;
+        }
+    }
+}
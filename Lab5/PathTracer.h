@@ -0,0 +1,133 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+
+// Эталонный рендер сцены Lab5 трассировкой путей на CPU: шары с материалом из PS.hlsl, точечные источники
+// с тем же затуханием, что в LightCalc.h, и equirect HDR окружение в той же развертке, что cubemapGeneratorPS.hlsl.
+// BRDF совпадает с CalculateColor (GGX с alpha = roughness, Smith-Schlick с k = (roughness + 1)^2 / 8, Шлик для
+// Френеля), поэтому разница с растеризацией показывает ошибку только приближений: split-sum IBL и свертки кубмап.
+// Не зависит от D3D и собирается на Linux (см. PathTraceMain.cpp).
+namespace reference {
+    struct Material {
+        float color[3] = { 1.0f, 0.71f, 0.29f };
+        float roughness = 0.01f;
+        float metalness = 1.0f;
+    };
+
+    struct Sphere {
+        float center[3] = { 0.0f, 0.0f, 0.0f };
+        float radius = 1.0f;
+        Material material;
+    };
+
+    // Как источники LightCalc.h: излучение color * brightness * min(1 / d^2, 1).
+    struct PointLight {
+        float position[3];
+        float color[3];
+        float brightness;
+    };
+
+    // Окружение, развернутое на прямоугольник: u по азимуту atan2(z, x), v по высоте над плоскостью XZ.
+    // Для выборки по яркости строится двумерная функция распределения с учетом площади строк.
+    class Environment {
+    public:
+        // rgba - width * height пикселей по 4 float, как возвращает stbi_loadf(..., 4).
+        void Init(const float* rgba, unsigned width, unsigned height);
+
+        bool IsEmpty() const {
+            return width_ == 0;
+        };
+
+        void Lookup(const float direction[3], float radiance[3]) const;
+        // Плотность выборки по телесному углу для направления.
+        float Pdf(const float direction[3]) const;
+        // Направление пропорционально яркости окружения; возвращает плотность или 0.
+        float Sample(float u1, float u2, float direction[3], float radiance[3]) const;
+
+    private:
+        size_t PixelIndex(const float direction[3], float& cosElevation) const;
+
+        unsigned width_ = 0;
+        unsigned height_ = 0;
+        std::vector<float> radiance_;       // rgb
+        std::vector<float> rowCdf_;         // height_ + 1
+        std::vector<float> columnCdf_;      // height_ * (width_ + 1)
+        std::vector<float> pixelPdf_;       // плотность по (u, v) для каждого пикселя
+    };
+
+    // Камера как в Renderer: вертикальный угол обзора и левосторонний базис из обращенной матрицы вида.
+    struct View {
+        float position[3] = { 0.0f, 0.0f, -5.0f };
+        float right[3] = { 1.0f, 0.0f, 0.0f };
+        float up[3] = { 0.0f, 1.0f, 0.0f };
+        float forward[3] = { 0.0f, 0.0f, 1.0f };
+        float fovY = 3.14159265f / 3.0f;
+    };
+
+    struct Scene {
+        std::vector<Sphere> spheres;
+        std::vector<PointLight> lights;
+        const Environment* environment = nullptr;   // без окружения фон черный
+        View view;
+    };
+
+    struct TracerOptions {
+        unsigned tileSize = 16;
+        unsigned maxDepth = 8;
+        unsigned rouletteDepth = 3;         // с этой глубины пути обрываются русской рулеткой
+        // Детерминированный режим: зерно каждого отсчета зависит только от seed, пикселя и номера отсчета,
+        // поэтому картинка побитово повторяется при любом числе потоков и порядке плиток.
+        bool deterministic = true;
+        uint64_t seed = 0;
+    };
+
+    struct TracerStats {
+        uint64_t samples = 0;               // пути от камеры
+        uint64_t rays = 0;                  // все лучи, включая теневые
+        double seconds = 0.0;
+    };
+
+    // Прогрессивное накопление: каждый Render добавляет samplesPerPixel отсчетов к уже накопленным.
+    // Сцену нельзя менять между вызовами без Reset.
+    class PathTracer {
+    public:
+        void Reset(unsigned width, unsigned height, const TracerOptions& options = TracerOptions());
+
+        // Плитки tileSize x tileSize раздаются потокам пула, без пула рендерится в вызывающем потоке.
+        void Render(const Scene& scene, unsigned samplesPerPixel, ThreadPool* pool = nullptr);
+
+        // Среднее по накопленным отсчетам, RGBA32F с альфой 1.
+        void Resolve(std::vector<float>& rgba) const;
+
+        unsigned GetWidth() const {
+            return width_;
+        };
+
+        unsigned GetHeight() const {
+            return height_;
+        };
+
+        unsigned GetSampleCount() const {
+            return sampleCount_;
+        };
+
+        // Статистика последнего Render.
+        const TracerStats& GetLastStats() const {
+            return lastStats_;
+        };
+
+    private:
+        unsigned width_ = 0;
+        unsigned height_ = 0;
+        unsigned sampleCount_ = 0;
+        uint64_t seed_ = 0;
+        TracerOptions options_;
+        std::vector<double> accumulation_;  // rgb, сумма отсчетов
+        TracerStats lastStats_;
+    };
+}
@@ -0,0 +1,28 @@
+cbuffer QuantizationBuffer : register (b2) {
+    float4 positionScale;
+    float4 positionOffset;
+};
+
+// Позиция в xyz (R16G16B16A16_UNORM) относительно границ меша.
+float3 DecodePosition(float4 packed) {
+    return packed.xyz * positionScale.xyz + positionOffset.xyz;
+}
+
+float3 DecodeOctahedral(float2 e) {
+    float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy += n.xy >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
+// Нормаль в w: два 8-битных октаэдрических кода со смещением 127.
+float3 DecodeNormal8(float packed) {
+    uint bits = (uint)round(packed * 65535.0f);
+    float2 e = (float2(bits & 0xFF, bits >> 8) - 127.0f) / 127.0f;
+    return DecodeOctahedral(max(e, -1.0f));
+}
+
+// Нормаль в отдельном атрибуте R16G16_SNORM.
+float3 DecodeNormal16(float2 packed) {
+    return DecodeOctahedral(packed);
+}
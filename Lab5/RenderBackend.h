@@ -0,0 +1,349 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+
+// Тонкий слой между рендером и графическим API: буферы, текстуры, views, шейдеры, состояния и вызовы отрисовки.
+// Ресурсы адресуются типизированными дескрипторами, 0 - пустой дескриптор. Реализации: gfx::D3D11Backend
+// (только Windows) и gfx::NullBackend, которая лишь проверяет и подсчитывает вызовы. Интерфейс не зависит
+// от D3D и собирается на Linux.
+namespace gfx {
+    enum class ResourceType : uint8_t {
+        Buffer,
+        Texture,
+        ShaderResourceView,
+        RenderTargetView,
+        DepthStencilView,
+        VertexShader,
+        PixelShader,
+        InputLayout,
+        Sampler,
+        RasterizerState,
+        DepthStencilState,
+        Count
+    };
+
+    template<ResourceType Type>
+    struct Handle {
+        static const ResourceType type = Type;
+        uint32_t id = 0;
+
+        bool IsValid() const {
+            return id != 0;
+        };
+
+        bool operator==(Handle other) const {
+            return id == other.id;
+        };
+
+        bool operator!=(Handle other) const {
+            return id != other.id;
+        };
+    };
+
+    using BufferHandle = Handle<ResourceType::Buffer>;
+    using TextureHandle = Handle<ResourceType::Texture>;
+    using ShaderResourceViewHandle = Handle<ResourceType::ShaderResourceView>;
+    using RenderTargetViewHandle = Handle<ResourceType::RenderTargetView>;
+    using DepthStencilViewHandle = Handle<ResourceType::DepthStencilView>;
+    using VertexShaderHandle = Handle<ResourceType::VertexShader>;
+    using PixelShaderHandle = Handle<ResourceType::PixelShader>;
+    using InputLayoutHandle = Handle<ResourceType::InputLayout>;
+    using SamplerHandle = Handle<ResourceType::Sampler>;
+    using RasterizerStateHandle = Handle<ResourceType::RasterizerState>;
+    using DepthStencilStateHandle = Handle<ResourceType::DepthStencilState>;
+
+    enum class Format : uint8_t {
+        Unknown,
+        R8G8B8A8_UNORM,
+        R8G8B8A8_UNORM_SRGB,
+        R16G16B16A16_UNORM,
+        R16G16B16A16_FLOAT,
+        R32G32B32A32_FLOAT,
+        R32G32B32_FLOAT,
+        R32G32_FLOAT,
+        R32_FLOAT,
+        R32_UINT,
+        R16_UINT,
+        D32_FLOAT
+    };
+
+    // Размер элемента формата в байтах.
+    inline unsigned FormatSize(Format format) {
+        switch (format) {
+        case Format::R8G8B8A8_UNORM:
+        case Format::R8G8B8A8_UNORM_SRGB:
+        case Format::R32_FLOAT:
+        case Format::R32_UINT:
+        case Format::D32_FLOAT:
+            return 4;
+        case Format::R16G16B16A16_UNORM:
+        case Format::R16G16B16A16_FLOAT:
+        case Format::R32G32_FLOAT:
+            return 8;
+        case Format::R32G32B32_FLOAT:
+            return 12;
+        case Format::R32G32B32A32_FLOAT:
+            return 16;
+        case Format::R16_UINT:
+            return 2;
+        default:
+            return 0;
+        }
+    }
+
+    enum BindFlags : uint32_t {
+        BindVertexBuffer = 1,
+        BindIndexBuffer = 2,
+        BindConstantBuffer = 4,
+        BindShaderResource = 8,
+        BindRenderTarget = 16,
+        BindDepthStencil = 32       // только D32_FLOAT и без других флагов
+    };
+
+    enum class Usage : uint8_t {
+        Default,        // обновляется через UpdateBuffer
+        Immutable,      // только начальные данные
+        Dynamic         // Map с отбрасыванием старого содержимого
+    };
+
+    enum class ShaderStage : uint8_t {
+        Vertex,
+        Pixel
+    };
+
+    enum class Topology : uint8_t {
+        Undefined,
+        TriangleList,
+        TriangleStrip,
+        LineList
+    };
+
+    enum class Filter : uint8_t {
+        Point,
+        Linear,
+        Anisotropic,
+        MinimumAnisotropic,
+        MaximumAnisotropic
+    };
+
+    enum class AddressMode : uint8_t {
+        Wrap,
+        Clamp
+    };
+
+    enum class CullMode : uint8_t {
+        None,
+        Front,
+        Back
+    };
+
+    enum class Comparison : uint8_t {
+        Never,
+        Less,
+        Equal,
+        LessEqual,
+        Greater,
+        NotEqual,
+        GreaterEqual,
+        Always
+    };
+
+    struct BufferDesc {
+        size_t size = 0;
+        uint32_t bindFlags = 0;
+        Usage usage = Usage::Default;
+    };
+
+    struct TextureDesc {
+        unsigned width = 0;
+        unsigned height = 0;
+        unsigned mipLevels = 1;
+        unsigned arraySize = 1;
+        Format format = Format::R8G8B8A8_UNORM;
+        uint32_t bindFlags = BindShaderResource;
+        bool cube = false;
+    };
+
+    struct InputElement {
+        const char* semanticName = nullptr;
+        unsigned semanticIndex = 0;
+        Format format = Format::Unknown;
+        unsigned slot = 0;
+        unsigned offset = 0;
+        bool perInstance = false;
+    };
+
+    struct SamplerDesc {
+        Filter filter = Filter::Linear;
+        AddressMode address = AddressMode::Wrap;
+    };
+
+    struct RasterizerDesc {
+        CullMode cullMode = CullMode::Back;
+        bool frontCounterClockwise = false;
+    };
+
+    // Без трафарета. По умолчанию - как состояние D3D11 по умолчанию.
+    struct DepthStencilDesc {
+        bool depthEnable = true;
+        bool depthWrite = true;
+        Comparison depthFunc = Comparison::Less;
+    };
+
+    struct Viewport {
+        float x = 0.0f;
+        float y = 0.0f;
+        float width = 0.0f;
+        float height = 0.0f;
+        float minDepth = 0.0f;
+        float maxDepth = 1.0f;
+    };
+
+    struct Rect {
+        int left = 0;
+        int top = 0;
+        int right = 0;
+        int bottom = 0;
+    };
+
+    // Описание существующего ресурса. Поля заполняются по его типу; у views - описание текстуры и ее дескриптор,
+    // если текстура известна бэкенду (иначе 0).
+    struct ResourceInfo {
+        BufferDesc buffer;
+        const void* contents = nullptr;             // содержимое буфера, если бэкенд его хранит
+        TextureDesc texture;
+        uint32_t viewTexture = 0;
+        unsigned mipLevel = 0;
+        unsigned arraySlice = 0;
+        std::vector<InputElement> elements;         // имена действительны, пока ресурс жив
+        SamplerDesc sampler;
+        RasterizerDesc rasterizer;
+        DepthStencilDesc depthStencil;
+    };
+
+    // Вызовы интерфейса, для статистики и записи потока команд.
+    enum class Command : uint8_t {
+        CreateBuffer,
+        CreateTexture,
+        CreateShaderResourceView,
+        CreateRenderTargetView,
+        CreateDepthStencilView,
+        CreateVertexShader,
+        CreatePixelShader,
+        CreateInputLayout,
+        CreateSampler,
+        CreateRasterizerState,
+        CreateDepthStencilState,
+        Release,
+        ClearState,
+        SetViewport,
+        SetScissorRect,
+        SetRenderTarget,
+        ClearRenderTarget,
+        ClearDepthStencil,
+        SetVertexBuffer,
+        SetIndexBuffer,
+        SetInputLayout,
+        SetPrimitiveTopology,
+        SetVertexShader,
+        SetPixelShader,
+        SetConstantBuffers,
+        SetShaderResources,
+        SetSamplers,
+        SetRasterizerState,
+        SetDepthStencilState,
+        UpdateBuffer,
+        UpdateBufferRange,
+        Map,
+        Unmap,
+        Draw,
+        DrawIndexed,
+        DrawIndexedInstanced,
+        Count
+    };
+
+    // Ограничения числа слотов, общие для всех реализаций (в D3D11 слотов больше).
+    static const unsigned maxVertexBuffers = 8;
+    static const unsigned maxConstantBuffers = 14;
+    static const unsigned maxShaderResources = 16;
+    static const unsigned maxSamplers = 16;
+
+    class RenderBackend {
+    public:
+        virtual ~RenderBackend() = default;
+
+        // Создание ресурсов. При ошибке возвращается пустой дескриптор. initialData текстуры - уровень 0
+        // без выравнивания строк.
+        virtual BufferHandle CreateBuffer(const BufferDesc& desc, const void* initialData = nullptr) = 0;
+        virtual TextureHandle CreateTexture(const TextureDesc& desc, const void* initialData = nullptr) = 0;
+        virtual ShaderResourceViewHandle CreateShaderResourceView(TextureHandle texture) = 0;
+        virtual RenderTargetViewHandle CreateRenderTargetView(TextureHandle texture, unsigned mipLevel = 0, unsigned arraySlice = 0) = 0;
+        virtual DepthStencilViewHandle CreateDepthStencilView(TextureHandle texture) = 0;
+        virtual VertexShaderHandle CreateVertexShader(const void* bytecode, size_t size) = 0;
+        virtual PixelShaderHandle CreatePixelShader(const void* bytecode, size_t size) = 0;
+        virtual InputLayoutHandle CreateInputLayout(const InputElement* elements, unsigned count, const void* bytecode, size_t size) = 0;
+        virtual SamplerHandle CreateSampler(const SamplerDesc& desc) = 0;
+        virtual RasterizerStateHandle CreateRasterizerState(const RasterizerDesc& desc) = 0;
+        virtual DepthStencilStateHandle CreateDepthStencilState(const DepthStencilDesc& desc) = 0;
+
+        template<ResourceType Type>
+        void Release(Handle<Type>& handle) {
+            if (handle.IsValid()) {
+                ReleaseResource(Type, handle.id);
+                handle.id = 0;
+            }
+        };
+
+        virtual void ClearState() = 0;
+        virtual void SetViewport(const Viewport& viewport) = 0;
+        virtual void SetScissorRect(const Rect& rect) = 0;
+        // Пустой дескриптор отвязывает цель. Буфер глубины - того же размера, что и цель; пустой - без глубины.
+        virtual void SetRenderTarget(RenderTargetViewHandle target, DepthStencilViewHandle depth = DepthStencilViewHandle()) = 0;
+        virtual void ClearRenderTarget(RenderTargetViewHandle target, const float color[4]) = 0;
+        virtual void ClearDepthStencil(DepthStencilViewHandle target, float depth) = 0;
+
+        virtual void SetVertexBuffer(unsigned slot, BufferHandle buffer, unsigned stride, unsigned offset = 0) = 0;
+        // Индексы всегда 32-битные, как во всех буферах Lab5.
+        virtual void SetIndexBuffer(BufferHandle buffer, unsigned offset = 0) = 0;
+        virtual void SetInputLayout(InputLayoutHandle layout) = 0;
+        virtual void SetPrimitiveTopology(Topology topology) = 0;
+        virtual void SetVertexShader(VertexShaderHandle shader) = 0;
+        virtual void SetPixelShader(PixelShaderHandle shader) = 0;
+        virtual void SetConstantBuffers(ShaderStage stage, unsigned slot, unsigned count, const BufferHandle* buffers) = 0;
+        virtual void SetShaderResources(ShaderStage stage, unsigned slot, unsigned count, const ShaderResourceViewHandle* views) = 0;
+        virtual void SetSamplers(ShaderStage stage, unsigned slot, unsigned count, const SamplerHandle* samplers) = 0;
+        // Пустой дескриптор - состояние по умолчанию.
+        virtual void SetRasterizerState(RasterizerStateHandle state) = 0;
+        // Пустой дескриптор - состояние по умолчанию: проверка LESS с записью.
+        virtual void SetDepthStencilState(DepthStencilStateHandle state) = 0;
+
+        // Полная перезапись буфера с Usage::Default (UpdateSubresource).
+        virtual void UpdateBuffer(BufferHandle buffer, const void* data, size_t size) = 0;
+        // Перезапись size байт с offset в буфере с Usage::Default, кроме константных: остальное содержимое
+        // сохраняется.
+        virtual void UpdateBufferRange(BufferHandle buffer, size_t offset, const void* data, size_t size) = 0;
+        // Буфер с Usage::Dynamic, старое содержимое отбрасывается. nullptr при ошибке.
+        virtual void* Map(BufferHandle buffer) = 0;
+        virtual void Unmap(BufferHandle buffer) = 0;
+
+        virtual void Draw(unsigned vertexCount, unsigned startVertex) = 0;
+        virtual void DrawIndexed(unsigned indexCount, unsigned startIndex, int baseVertex) = 0;
+        virtual void DrawIndexedInstanced(unsigned indexCount, unsigned instanceCount, unsigned startIndex, int baseVertex,
+                                          unsigned startInstance) = 0;
+
+        // Нужно для записи потока команд, начатой после создания ресурса. Байт-код шейдеров не сохраняется
+        // ни одной реализацией. false, если описания нет.
+        virtual bool Describe(ResourceType type, uint32_t id, ResourceInfo& info) const {
+            (void)type;
+            (void)id;
+            (void)info;
+            return false;
+        };
+
+    protected:
+        virtual void ReleaseResource(ResourceType type, uint32_t id) = 0;
+    };
+}
@@ -0,0 +1,123 @@
+﻿#pragma once
+
+#include <map>
+#include <cstddef>
+#include <cstdint>
+
+
+struct RenderTargetDesc {
+    unsigned width;
+    unsigned height;
+    unsigned format;
+
+    bool operator<(const RenderTargetDesc& other) const {
+        if (format != other.format)
+            return format < other.format;
+        if (width != other.width)
+            return width < other.width;
+        return height < other.height;
+    };
+
+    bool operator==(const RenderTargetDesc& other) const {
+        return width == other.width && height == other.height && format == other.format;
+    };
+};
+
+
+// Пул render target'ов, разбитый по размерам. Allocator должен предоставлять тип Handle и методы
+// bool Create(const RenderTargetDesc&, Handle&) и void Destroy(Handle&).
+template<typename Allocator>
+class RenderTargetPool {
+public:
+    using Handle = typename Allocator::Handle;
+
+    struct Stats {
+        size_t created = 0;
+        size_t reused = 0;
+        size_t destroyed = 0;
+    };
+
+    RenderTargetPool(Allocator& allocator, size_t maxFree = 16) : allocator_(allocator), maxFree_(maxFree) {};
+
+    RenderTargetPool(const RenderTargetPool&) = delete;
+    RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+
+    // Округление размера вверх до шага корзины (step = 0 - без округления).
+    static unsigned Bucket(unsigned size, unsigned step) {
+        if (step == 0)
+            return size;
+        return (size + step - 1) / step * step;
+    };
+
+    bool Acquire(const RenderTargetDesc& desc, Handle& handle) {
+        auto it = free_.find(desc);
+        if (it != free_.end()) {
+            handle = it->second.handle;
+            free_.erase(it);
+            stats_.reused++;
+            return true;
+        }
+        if (!allocator_.Create(desc, handle))
+            return false;
+        stats_.created++;
+        return true;
+    };
+
+    // Возвращает текстуру в пул. Лишние свободные текстуры удаляются только в Trim, чтобы при
+    // пересоздании цепочки целиком (освободить все -> взять заново) ничего не терялось.
+    void Release(const RenderTargetDesc& desc, Handle& handle) {
+        free_.emplace(desc, Entry{ handle, ++releaseCounter_ });
+        handle = Handle();
+    };
+
+    void Trim() {
+        Trim(maxFree_);
+    };
+
+    // Удаляет самые давно освобожденные текстуры, пока свободных не останется не больше maxFree.
+    void Trim(size_t maxFree) {
+        while (free_.size() > maxFree) {
+            auto oldest = free_.begin();
+            for (auto it = free_.begin(); it != free_.end(); ++it) {
+                if (it->second.released < oldest->second.released)
+                    oldest = it;
+            }
+            allocator_.Destroy(oldest->second.handle);
+            free_.erase(oldest);
+            stats_.destroyed++;
+        }
+    };
+
+    void Clear() {
+        Trim(0);
+    };
+
+    void SetMaxFree(size_t maxFree) {
+        maxFree_ = maxFree;
+        Trim(maxFree_);
+    };
+
+    size_t GetFreeCount() const {
+        return free_.size();
+    };
+
+    const Stats& GetStats() const {
+        return stats_;
+    };
+
+    ~RenderTargetPool() {
+        Clear();
+    };
+
+private:
+    struct Entry {
+        Handle handle;
+        uint64_t released;
+    };
+
+    Allocator& allocator_;
+    size_t maxFree_;
+    uint64_t releaseCounter_ = 0;
+    std::multimap<RenderTargetDesc, Entry> free_;
+    Stats stats_;
+};
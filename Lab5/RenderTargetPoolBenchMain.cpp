@@ -0,0 +1,221 @@
+﻿// Проверка RenderTargetPool и ResizeCoalescer на поддельном аллокаторе, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 RenderTargetPoolBenchMain.cpp ResizeCoalescer.cpp -o rtpool
+// Примеры:
+//   ./rtpool
+//   ./rtpool --events 240 --pause 300 --interval 150
+// Сначала - проверки пула (повторное использование, вытеснение старых, округление) и откладывания размеров. Затем
+// перетаскивание края окна: события WM_SIZE каждые 16 мс, размер меняется от 1280x720 до 1920x1080 с остановкой
+// на полпути.
+// Цепочка текстур та же, что в ToneMapping::CreateTextures: HDR кадр с округлением до 128 и по три уровня яркости
+// 1 .. 2^n. Считается, сколько текстур создано без откладывания и пула, только с откладыванием и с обоими.
+#include "RenderTargetPool.h"
+#include "ResizeCoalescer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+namespace {
+    // Значения DXGI_FORMAT_R16G16B16A16_FLOAT и DXGI_FORMAT_R32_FLOAT.
+    const unsigned hdrFormat = 10;
+    const unsigned luminanceFormat = 41;
+    const unsigned frameBucketStep = 128;
+    const size_t maxFreeTargets = 12;
+
+    struct FakeAllocator {
+        using Handle = int;
+
+        int live = 0;
+        int next = 1;
+        size_t created = 0;
+
+        bool Create(const RenderTargetDesc&, Handle& handle) {
+            handle = next++;
+            live++;
+            created++;
+            return true;
+        };
+
+        void Destroy(Handle& handle) {
+            live--;
+            handle = 0;
+        };
+    };
+
+    bool Check(bool condition, const char* what) {
+        if (!condition) {
+            printf("FAILED: %s\n", what);
+        }
+        return condition;
+    }
+
+    bool CheckPool() {
+        FakeAllocator allocator;
+        bool ok = true;
+        {
+            RenderTargetPool<FakeAllocator> pool(allocator, 4);
+            int a, b;
+            pool.Acquire({ 100, 100, 1 }, a);
+            pool.Release({ 100, 100, 1 }, a);
+            ok = Check(a == 0, "Release clears the handle") && ok;
+            pool.Acquire({ 100, 100, 1 }, b);
+            ok = Check(b == 1 && pool.GetStats().reused == 1, "a released target of the same size is reused") && ok;
+            for (unsigned i = 0; i < 10; i++) {
+                int handle;
+                pool.Acquire({ i, 1, 1 }, handle);
+                pool.Release({ i, 1, 1 }, handle);
+            }
+            ok = Check(pool.GetFreeCount() == 10, "Release keeps every target until Trim") && ok;
+            pool.Trim();
+            ok = Check(pool.GetFreeCount() == 4 && pool.GetStats().destroyed == 6, "Trim evicts down to maxFree") && ok;
+            // Вытесняются самые давно освобожденные: остались размеры 6 .. 9.
+            int handle;
+            ok = Check(pool.Acquire({ 9, 1, 1 }, handle) && pool.GetStats().reused == 2, "the newest free targets survive Trim") && ok;
+            ok = Check(RenderTargetPool<FakeAllocator>::Bucket(129, 128) == 256 &&
+                RenderTargetPool<FakeAllocator>::Bucket(128, 128) == 128 &&
+                RenderTargetPool<FakeAllocator>::Bucket(5, 0) == 5, "Bucket rounds up to the step") && ok;
+        }
+        // b и последний handle не возвращены, пул их не удаляет.
+        ok = Check(allocator.live == 2, "the destructor destroys only free targets") && ok;
+        return ok;
+    }
+
+    bool CheckCoalescer() {
+        using Clock = ResizeCoalescer::Clock;
+        using std::chrono::milliseconds;
+        const Clock::time_point t0{};
+        ResizeCoalescer coalescer(milliseconds(100));
+        coalescer.SetApplied(10, 10);
+        unsigned width = 0, height = 0;
+        bool ok = true;
+        coalescer.Request(20, 20, t0);
+        ok = Check(!coalescer.Poll(t0 + milliseconds(50), width, height), "a size is not applied before the interval") && ok;
+        coalescer.Request(30, 30, t0 + milliseconds(60));
+        ok = Check(!coalescer.Poll(t0 + milliseconds(120), width, height), "a new size restarts the interval") && ok;
+        coalescer.Request(30, 30, t0 + milliseconds(150));
+        ok = Check(coalescer.Poll(t0 + milliseconds(161), width, height) && width == 30 && height == 30,
+            "repeating the same size does not restart the interval") && ok;
+        ok = Check(!coalescer.Poll(t0 + milliseconds(500), width, height), "a size is applied once") && ok;
+        coalescer.Request(40, 40, t0);
+        coalescer.Request(30, 30, t0);
+        ok = Check(!coalescer.IsPending(), "returning to the applied size cancels the request") && ok;
+        coalescer.Request(50, 40, t0);
+        ok = Check(coalescer.Flush(width, height) && width == 50 && !coalescer.IsPending(), "Flush applies at once") && ok;
+        return ok;
+    }
+
+    // Текстуры ToneMapping для окна width x height.
+    struct Chain {
+        std::vector<RenderTargetDesc> descs;
+        std::vector<int> handles;
+    };
+
+    void Describe(unsigned width, unsigned height, bool bucket, Chain& chain) {
+        chain.descs.clear();
+        unsigned step = bucket ? frameBucketStep : 0;
+        chain.descs.push_back({ RenderTargetPool<FakeAllocator>::Bucket(width, step), RenderTargetPool<FakeAllocator>::Bucket(height, step),
+            hdrFormat });
+        unsigned levels = 0;
+        for (unsigned side = std::min(width, height); side >>= 1;) {
+            levels++;
+        }
+        for (unsigned i = 0; i <= levels; i++) {
+            for (int k = 0; k < 3; k++) {
+                chain.descs.push_back({ 1u << i, 1u << i, luminanceFormat });
+            }
+        }
+    }
+
+    // Без пула текстуры удаляются и создаются заново; с пулом - возвращаются и берутся, как в ToneMapping::Resize.
+    void Recreate(FakeAllocator& allocator, RenderTargetPool<FakeAllocator>* pool, unsigned width, unsigned height, Chain& chain) {
+        for (size_t i = 0; i < chain.handles.size(); i++) {
+            if (pool != nullptr) {
+                pool->Release(chain.descs[i], chain.handles[i]);
+            } else {
+                allocator.Destroy(chain.handles[i]);
+            }
+        }
+        Describe(width, height, pool != nullptr, chain);
+        chain.handles.assign(chain.descs.size(), 0);
+        for (size_t i = 0; i < chain.descs.size(); i++) {
+            if (pool != nullptr) {
+                pool->Acquire(chain.descs[i], chain.handles[i]);
+            } else {
+                allocator.Create(chain.descs[i], chain.handles[i]);
+            }
+        }
+        if (pool != nullptr) {
+            pool->Trim();
+        }
+    }
+
+    void SimulateDrag(unsigned events, unsigned pauseMs, unsigned intervalMs) {
+        using Clock = ResizeCoalescer::Clock;
+        using std::chrono::milliseconds;
+        const unsigned startWidth = 1280, startHeight = 720, endWidth = 1920, endHeight = 1080;
+        printf("Drag: %u WM_SIZE events 16 ms apart, %ux%u -> %ux%u, %u ms pause halfway, coalescing interval %u ms\n", events,
+            startWidth, startHeight, endWidth, endHeight, pauseMs, intervalMs);
+
+        for (int mode = 0; mode < 3; mode++) {
+            bool coalesce = mode >= 1, pooled = mode == 2;
+            FakeAllocator allocator;
+            RenderTargetPool<FakeAllocator> pool(allocator, maxFreeTargets);
+            RenderTargetPool<FakeAllocator>* usedPool = pooled ? &pool : nullptr;
+            ResizeCoalescer coalescer{ milliseconds(intervalMs) };
+            Chain chain;
+            Recreate(allocator, usedPool, startWidth, startHeight, chain);
+            coalescer.SetApplied(startWidth, startHeight);
+            size_t initial = allocator.created;
+            unsigned resizes = 0;
+
+            // Кадр рисуется каждые 16 мс, после события - сразу; моделируется еще секунда после последнего события.
+            const Clock::time_point t0{};
+            unsigned pauseFrames = pauseMs / 16, frames = events + pauseFrames + 1000 / 16;
+            for (unsigned f = 0, e = 0; f < frames; f++) {
+                Clock::time_point now = t0 + milliseconds(16 * f);
+                unsigned width, height;
+                if (e < events && (e < events / 2 || f >= events / 2 + pauseFrames)) {
+                    float t = (float)e++ / std::max(events - 1, 1u);
+                    width = startWidth + (unsigned)((endWidth - startWidth) * t);
+                    height = startHeight + (unsigned)((endHeight - startHeight) * t);
+                    if (!coalesce) {
+                        Recreate(allocator, usedPool, width, height, chain);
+                        resizes++;
+                        continue;
+                    }
+                    coalescer.Request(width, height, now);
+                }
+                if (coalesce && coalescer.Poll(now, width, height)) {
+                    Recreate(allocator, usedPool, width, height, chain);
+                    resizes++;
+                }
+            }
+            static const char* names[] = { "every event   ", "coalesced     ", "coalesced+pool" };
+            printf("  %s: %4u chain rebuilds, %6zu textures created after start (%zu at start), %zu live\n", names[mode], resizes,
+                allocator.created - initial, initial, (size_t)allocator.live);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned events = 120, pause = 300, interval = 150;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--events") && i + 1 < argc) {
+            events = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--pause") && i + 1 < argc) {
+            pause = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--interval") && i + 1 < argc) {
+            interval = (unsigned)atoi(argv[++i]);
+        } else {
+            printf("rtpool [--events <n>] [--pause <ms>] [--interval <ms>]\n");
+            return 1;
+        }
+    }
+
+    bool ok = CheckPool();
+    ok = CheckCoalescer() && ok;
+    printf("Pool and coalescer checks: %s\n", ok ? "ok" : "FAILED");
+    SimulateDrag(events, pause, interval);
+    return ok ? 0 : 1;
+}
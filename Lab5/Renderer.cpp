@@ -1,13 +1,45 @@
 ﻿#include "Renderer.h"
+#include "ConstexprMesh.h"
+#include "ImageEncoder.h"
+#include "stb_image.h"
+#include <algorithm>
 #include <string>
+#include <random>
 
 const D3D11_INPUT_ELEMENT_DESC Renderer::SimpleVertexDesc[] = {
     {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
 };
+// mesh::QuantizedVertex8: нормаль декодируется из четвертой компоненты позиции.
+const D3D11_INPUT_ELEMENT_DESC Renderer::QuantizedVertexDesc[] = {
+    {"POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+};
+// Vertex: вершины загруженных моделей.
 const D3D11_INPUT_ELEMENT_DESC Renderer::VertexDesc[] = {
     {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
     {"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
 };
+// Vertex и gfx::InstanceData в слоте 1.
+const D3D11_INPUT_ELEMENT_DESC Renderer::InstancedVertexDesc[] = {
+    {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+    {"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
+    {"WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+    {"WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+    {"WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+    {"COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+    {"MATERIAL", 0, DXGI_FORMAT_R32_FLOAT, 1, 64, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+};
+
+// Сфера вычисляется при компиляции по тем же формулам, что и mesh::UVSphere.
+static constexpr unsigned sphereLatLines = 40;
+static constexpr unsigned sphereLongLines = 40;
+static constexpr float sphereRadius = 1.0f;
+static constexpr auto builtinSphere = mesh::MakeUVSphere<sphereLatLines, sphereLongLines>();
+static_assert(mesh::IsClosedAroundOrigin(builtinSphere, sphereRadius, 1e-6f, mesh::Winding::Outward),
+    "built-in sphere must be a closed outward-facing unit sphere");
+
+// Глубина перевернута: ближняя плоскость отображается в 1, дальняя - в 0.
+static constexpr float nearPlane = 0.01f;
+static constexpr float farPlane = 100.0f;
 
 Renderer& Renderer::GetInstance() {
     static Renderer instance;
@@ -25,6 +57,7 @@ Renderer::Renderer() :
     height_(defaultHeight) {}
 
 bool Renderer::Init(HINSTANCE hInstance, HWND hWnd) {
+    threadPool_.Submit([this]() { PrepareSphere(); });
     HRESULT result = CreateDevice();
 
     if (SUCCEEDED(result)) {
@@ -50,6 +83,11 @@ bool Renderer::Init(HINSTANCE hInstance, HWND hWnd) {
         desc.SlopeScaledDepthBias = 0.0f;
 
         result = pDevice_->CreateRasterizerState(&desc, &pRasterizerState_);
+        if (SUCCEEDED(result)) {
+            // glTF задает лицевые грани против часовой стрелки.
+            desc.FrontCounterClockwise = true;
+            result = pDevice_->CreateRasterizerState(&desc, &pModelRasterizerState_);
+        }
     }
     if (SUCCEEDED(result)) {
         result = CreateWMBuffer();
@@ -75,8 +113,21 @@ bool Renderer::Init(HINSTANCE hInstance, HWND hWnd) {
     if (SUCCEEDED(result)) {
         result = InitObjects();
     }
+    if (SUCCEEDED(result)) {
+        result = LoadModels();
+    }
+    if (SUCCEEDED(result)) {
+        result = InitObjectBounds();
+    }
+    if (SUCCEEDED(result)) {
+        result = InitBackend();
+    }
     if (SUCCEEDED(result)) {
         result = toneMapping_.Init(pDevice_, pDeviceContext_, pVSManager_, pPSManager_, pSamplerManager_, width_, height_);
+        resizeCoalescer_.SetApplied(width_, height_);
+    }
+    if (SUCCEEDED(result)) {
+        result = screenCapture_.Init(pDevice_, pDeviceContext_);
     }
     if (SUCCEEDED(result)) {
         pCamera_ = new Camera;
@@ -103,6 +154,9 @@ bool Renderer::Init(HINSTANCE hInstance, HWND hWnd) {
     }
 #endif // _DEBUG
 
+    // Время первого кадра отсчитывается от конца инициализации, а не от нулевой точки часов.
+    lastFrameTime_ = std::chrono::steady_clock::now();
+
     if (FAILED(result)) {
         Cleanup();
     }
@@ -268,13 +322,297 @@ HRESULT Renderer::CreateVMBuffer() {
     return pDevice_->CreateBuffer(&desc, nullptr, &pViewMatrixBuffer_);
 }
 
+// Буферы источников t3-t5 из LightCalc.h: данные источников, индексы и списки кластеров.
+static const DXGI_FORMAT lightBufferFormats[3] = { DXGI_FORMAT_R32G32B32A32_FLOAT, DXGI_FORMAT_R32_UINT, DXGI_FORMAT_R32G32_UINT };
+static const UINT lightBufferStrides[3] = { 16, 4, 8 };
+
+// Буфер пересоздается с запасом вдвое, старые дескрипторы освобождаются; тогда результат S_FALSE.
+HRESULT Renderer::ReserveLightBuffer(UINT index, UINT elements) {
+    if (elements <= lightBufferCapacity_[index] && pLightBuffers_[index] != nullptr)
+        return S_OK;
+    UINT capacity = max(max(elements, lightBufferCapacity_[index] * 2), 64u);
+
+    D3D11_BUFFER_DESC desc = {};
+    desc.ByteWidth = capacity * lightBufferStrides[index];
+    desc.Usage = index == 0 ? D3D11_USAGE_DEFAULT : D3D11_USAGE_DYNAMIC;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = index == 0 ? 0 : D3D11_CPU_ACCESS_WRITE;
+    ID3D11Buffer* buffer = nullptr;
+    HRESULT result = pDevice_->CreateBuffer(&desc, nullptr, &buffer);
+    if (FAILED(result))
+        return result;
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+    viewDesc.Format = lightBufferFormats[index];
+    viewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+    viewDesc.Buffer.FirstElement = 0;
+    viewDesc.Buffer.NumElements = capacity;
+    ID3D11ShaderResourceView* view = nullptr;
+    result = pDevice_->CreateShaderResourceView(buffer, &viewDesc, &view);
+    if (FAILED(result)) {
+        SAFE_RELEASE(buffer);
+        return result;
+    }
+
+    capture_.Release(frame_.lightBuffers[index]);
+    capture_.Release(frame_.lightViews[index]);
+    SAFE_RELEASE(pLightBuffers_[index]);
+    SAFE_RELEASE(pLightViews_[index]);
+    pLightBuffers_[index] = buffer;
+    pLightViews_[index] = view;
+    lightBufferCapacity_[index] = capacity;
+    frame_.lightBuffers[index] = backend_.Import(buffer);
+    frame_.lightViews[index] = backend_.Import(view);
+    return frame_.lightBuffers[index].IsValid() && frame_.lightViews[index].IsValid() ? S_FALSE : E_FAIL;
+}
+
+// Буфер пересоздается с запасом вдвое, старый дескриптор освобождается.
+HRESULT Renderer::ReserveInstanceBuffer(UINT instances) {
+    if (instances <= instanceCapacity_ && pInstanceBuffer_ != nullptr)
+        return S_OK;
+    UINT capacity = max(max(instances, instanceCapacity_ * 2), 64u);
+
+    D3D11_BUFFER_DESC desc = {};
+    desc.ByteWidth = capacity * sizeof(gfx::InstanceData);
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    ID3D11Buffer* buffer = nullptr;
+    HRESULT result = pDevice_->CreateBuffer(&desc, nullptr, &buffer);
+    if (FAILED(result))
+        return result;
+
+    capture_.Release(frame_.instanceBuffer);
+    SAFE_RELEASE(pInstanceBuffer_);
+    pInstanceBuffer_ = buffer;
+    instanceCapacity_ = capacity;
+    frame_.instanceBuffer = backend_.Import(buffer);
+    return frame_.instanceBuffer.IsValid() ? S_OK : E_FAIL;
+}
+
+// Группы моделей построены в InitBackend, здесь только считаются видимые модели групп; данные экземпляров
+// загружает ScenePass::Upload. Сфера и модели из групп с одним видимым объектом рисуются по одной.
+HRESULT Renderer::UpdateInstances() {
+    instanceBatcher_.Begin();
+    if (instancing_ && instanceBatcher_.CanBatch()) {
+        for (uint32_t object : visibleObjects_) {
+            if (object != 0) {
+                instanceBatcher_.MarkVisible(object - 1);
+            }
+        }
+    }
+    instanceBatcher_.Build();
+    for (uint32_t object : visibleObjects_) {
+        if (object == 0 || !instanceBatcher_.IsInstanced(object - 1))
+            continue;
+        const SimpleObject<Vertex>& model = models_[object - 1];
+        XMFLOAT4X4 world;
+        XMStoreFloat4x4(&world, model.worldMatrix);
+        instanceBatcher_.SetInstance(object - 1, &world.m[0][0], &model.color.x, model.roughness, model.metalness);
+    }
+
+    HRESULT result = ReserveInstanceBuffer((UINT)instanceBatcher_.GetInstanceCount());
+    if (FAILED(result))
+        return result;
+    frame_.instances = instanceBatcher_.GetInstances();
+    frame_.instanceCount = instanceBatcher_.GetInstanceCount();
+    frame_.batches = instanceBatcher_.GetBatches();
+    frame_.batchCount = instanceBatcher_.GetBatchCount();
+    return S_OK;
+}
+
+// Анимация источников и списки по кластерам текущего вида. Радиус влияния - расстояние, на котором яркость самой
+// сильной компоненты цвета падает до lightCutoff; дальше шейдер источник не учитывает.
+HRESULT Renderer::UpdateLights(const XMMATRIX& view) {
+    lights_.Animate(lightTime_, &threadPool_);
+
+    // Проекция та же, что в UpdateScene, без перестановки ближней и дальней плоскостей.
+    lighting::ClusterCamera camera;
+    XMFLOAT4X4 viewMatrix;
+    XMStoreFloat4x4(&viewMatrix, view);
+    memcpy(camera.view, &viewMatrix.m[0][0], sizeof(camera.view));
+    camera.fovY = XM_PI / 3;
+    camera.aspect = width_ / (FLOAT)height_;
+    camera.nearZ = nearPlane;
+    camera.farZ = farPlane;
+    lightClusterer_.Build(lightGrid_, camera, lights_.GetSpheres(), &threadPool_);
+
+    const std::vector<uint32_t>& indices = lightClusterer_.GetIndices();
+    const std::vector<uint32_t>& clusters = lightClusterer_.GetClusters();
+    HRESULT result = ReserveLightBuffer(0, max((UINT)lights_.GetCount() * 2, 1u));
+    // Новый буфер пуст - упаковываются и загружаются все источники.
+    if (result == S_FALSE) {
+        lights_.MarkAllDirty();
+    }
+    if (SUCCEEDED(result)) {
+        result = ReserveLightBuffer(1, max((UINT)indices.size(), 1u));
+    }
+    if (SUCCEEDED(result)) {
+        result = ReserveLightBuffer(2, (UINT)clusters.size() / 2);
+    }
+    if (FAILED(result))
+        return result;
+
+    lights_.Pack(lightRanges_, &threadPool_);
+    const size_t lightBytes = lighting::LightStorage::packedFloats * sizeof(float);
+    lightUploads_.clear();
+    for (const lighting::LightRange& range : lightRanges_) {
+        lightUploads_.push_back({ range.first * lightBytes, range.count * lightBytes });
+    }
+    frame_.lightData[0] = lights_.GetPacked().data();
+    frame_.lightDataSize[0] = lights_.GetPacked().size() * sizeof(float);
+    frame_.lightDataRanges = lightUploads_.data();
+    frame_.lightDataRangeCount = lightUploads_.size();
+    frame_.lightData[1] = indices.data();
+    frame_.lightDataSize[1] = indices.size() * sizeof(uint32_t);
+    frame_.lightData[2] = clusters.data();
+    frame_.lightDataSize[2] = clusters.size() * sizeof(uint32_t);
+    return S_OK;
+}
+
+// Привязки геометрии и вершинного шейдера объекта для gfx::ScenePass.
+template<typename Object, UINT numElements>
+static gfx::MeshBinding MakeMeshBinding(gfx::D3D11Backend& backend, const Object& object,
+    const D3D11_INPUT_ELEMENT_DESC (&desc)[numElements]) {
+    gfx::MeshBinding mesh;
+    mesh.vertexBuffer = backend.Import(object.geometry->getVertexBuffer());
+    mesh.indexBuffer = backend.Import(object.geometry->getIndexBuffer());
+    mesh.stride = object.vertexSize;
+    mesh.inputLayout = backend.Import(object.IL.get(), desc, numElements);
+    mesh.vertexShader = backend.Import(object.VS.get());
+    return mesh;
+}
+
+// Кадр рисуется через gfx::RenderBackend. Ресурсы создаются менеджерами и подключаются к бэкенду один раз.
+HRESULT Renderer::InitBackend() {
+    backend_.Init(pDevice_, pDeviceContext_);
+
+    std::shared_ptr<ID3D11SamplerState> avgSample;
+    std::shared_ptr<SimpleTexture> prefilteredText;
+    std::shared_ptr<SimpleTexture> brdfText;
+    HRESULT result = pSamplerManager_.get("avg", avgSample);
+    if (SUCCEEDED(result)) {
+        result = pTextureManager_.get("prefiltered", prefilteredText);
+    }
+    if (SUCCEEDED(result)) {
+        result = pTextureManager_.get("brdf", brdfText);
+    }
+    if (FAILED(result))
+        return result;
+
+    frame_.objectBuffer = backend_.Import(pWorldMatrixBuffer_);
+    frame_.skyboxBuffer = backend_.Import(pSkyboxWorldMatrixBuffer_);
+    frame_.viewBuffer = backend_.Import(pViewMatrixBuffer_);
+    frame_.quantizationBuffer = backend_.Import(pQuantizationBuffer_);
+    frame_.viewConstantsSize = sizeof(ViewMatrixBuffer);
+    frame_.skyboxConstantsSize = sizeof(SkyboxWorldMatrixBuffer);
+    frame_.objectConstantsSize = sizeof(WorldMatrixBuffer);
+    frame_.sampler = backend_.Import(pSampler_.get());
+    frame_.environmentSampler = backend_.Import(avgSample.get());
+
+    frame_.skybox.mesh = MakeMeshBinding(backend_, skybox, QuantizedVertexDesc);
+    skyboxRange_ = { 0, skybox.geometry->getNumIndices() };
+    frame_.skybox.ranges = &skyboxRange_;
+    frame_.skybox.rangeCount = 1;
+    frame_.skybox.startIndex = skybox.geometry->getStartIndex();
+    frame_.skyboxShader = backend_.Import(skybox.PS.get());
+    frame_.skyboxTexture = backend_.Import(skybox.texture->getSRV());
+
+    // Модели рисуются пиксельным шейдером сферы.
+    sphereMesh_ = MakeMeshBinding(backend_, sphere, QuantizedVertexDesc);
+    frame_.objectShader = backend_.Import(sphere.PS.get());
+    frame_.objectTextures[0] = backend_.Import(sphere.irradianceMap->getSRV());
+    frame_.objectTextures[1] = backend_.Import(prefilteredText->getSRV());
+    frame_.objectTextures[2] = backend_.Import(brdfText->getSRV());
+
+    gfx::RasterizerStateHandle modelState = backend_.Import(pModelRasterizerState_);
+    std::shared_ptr<ID3D11VertexShader> instancedVS;
+    std::shared_ptr<ID3D11InputLayout> instancedIL;
+    result = pVSManager_.get("modelInstanced", instancedVS);
+    if (SUCCEEDED(result)) {
+        result = pILManager_.get("modelInstanced", instancedIL);
+    }
+    if (FAILED(result))
+        return result;
+    gfx::VertexShaderHandle instancedShader = backend_.Import(instancedVS.get());
+    gfx::InputLayoutHandle instancedLayout = backend_.Import(instancedIL.get(), InstancedVertexDesc,
+        sizeof(InstancedVertexDesc) / sizeof(InstancedVertexDesc[0]));
+    modelMeshes_.clear();
+    modelRanges_.clear();
+    instancedMeshes_.clear();
+    for (const SimpleObject<Vertex>& model : models_) {
+        modelMeshes_.push_back(MakeMeshBinding(backend_, model, VertexDesc));
+        modelMeshes_.back().rasterizerState = modelState;
+        modelRanges_.push_back({ model.geometry->getStartIndex(), model.geometry->getNumIndices() });
+        instancedMeshes_.push_back(modelMeshes_.back());
+        instancedMeshes_.back().vertexShader = instancedShader;
+        instancedMeshes_.back().inputLayout = instancedLayout;
+    }
+    // Диапазоны должны жить до следующего Clear, поэтому объекты регистрируются после заполнения modelRanges_.
+    instanceBatcher_.Clear();
+    for (size_t i = 0; i < models_.size(); i++) {
+        instanceBatcher_.AddObject(instancedMeshes_[i], &modelRanges_[i], 1, 0);
+    }
+
+    backBufferView_ = backend_.Import(pRenderTargetView_);
+
+    // Скайбокс рисуется первым и глубину не трогает, объекты - с обратным Z.
+    gfx::DepthStencilDesc depthDesc;
+    depthDesc.depthEnable = false;
+    depthDesc.depthWrite = false;
+    frame_.skyboxDepthState = capture_.CreateDepthStencilState(depthDesc);
+    depthDesc.depthEnable = true;
+    depthDesc.depthWrite = true;
+    depthDesc.depthFunc = gfx::Comparison::Greater;
+    frame_.objectDepthState = capture_.CreateDepthStencilState(depthDesc);
+
+    bool valid = frame_.objectBuffer.IsValid() && frame_.skyboxBuffer.IsValid() && frame_.viewBuffer.IsValid() &&
+        frame_.quantizationBuffer.IsValid() && frame_.sampler.IsValid() && frame_.environmentSampler.IsValid() &&
+        frame_.skybox.mesh.vertexShader.IsValid() && frame_.skyboxShader.IsValid() && frame_.skyboxTexture.IsValid() &&
+        sphereMesh_.vertexShader.IsValid() && frame_.objectShader.IsValid() && frame_.objectTextures[0].IsValid() &&
+        frame_.objectTextures[1].IsValid() && frame_.objectTextures[2].IsValid() && backBufferView_.IsValid() &&
+        frame_.skyboxDepthState.IsValid() && frame_.objectDepthState.IsValid();
+    return valid ? S_OK : E_FAIL;
+}
+
+HRESULT Renderer::UpdateDepthTarget() {
+    gfx::ResourceInfo target;
+    if (!capture_.Describe(gfx::ResourceType::RenderTargetView, frame_.target.id, target))
+        return E_FAIL;
+    gfx::ResourceInfo depth;
+    if (frame_.depthTarget.IsValid() && capture_.Describe(gfx::ResourceType::Texture, depthTexture_.id, depth) &&
+        depth.texture.width == target.texture.width && depth.texture.height == target.texture.height)
+        return S_FALSE;
+
+    capture_.Release(frame_.depthTarget);
+    capture_.Release(depthTexture_);
+    gfx::TextureDesc desc;
+    desc.width = target.texture.width;
+    desc.height = target.texture.height;
+    desc.format = gfx::Format::D32_FLOAT;
+    desc.bindFlags = gfx::BindDepthStencil;
+    depthTexture_ = capture_.CreateTexture(desc);
+    frame_.depthTarget = capture_.CreateDepthStencilView(depthTexture_);
+    return frame_.depthTarget.IsValid() ? S_OK : backend_.GetLastResult();
+}
+
 HRESULT Renderer::LoadShaders() {
     pVSManager_.setDevice(pDevice_);
     pILManager_.setDevice(pDevice_);
     pPSManager_.setDevice(pDevice_);
 
     HRESULT result = pVSManager_.loadVS(L"VS.hlsl", nullptr, "sphere",
-        &pILManager_, VertexDesc, sizeof(VertexDesc) / sizeof(VertexDesc[0]));
+        &pILManager_, QuantizedVertexDesc, sizeof(QuantizedVertexDesc) / sizeof(QuantizedVertexDesc[0]));
+    if (SUCCEEDED(result)) {
+        D3D_SHADER_MACRO shaderMacros[] = { {"FULL_PRECISION"}, {NULL, NULL} };
+        result = pVSManager_.loadVS(L"VS.hlsl", shaderMacros, "model",
+            &pILManager_, VertexDesc, sizeof(VertexDesc) / sizeof(VertexDesc[0]));
+    }
+    if (SUCCEEDED(result)) {
+        D3D_SHADER_MACRO shaderMacros[] = { {"FULL_PRECISION"}, {"INSTANCED"}, {NULL, NULL} };
+        result = pVSManager_.loadVS(L"VS.hlsl", shaderMacros, "modelInstanced",
+            &pILManager_, InstancedVertexDesc, sizeof(InstancedVertexDesc) / sizeof(InstancedVertexDesc[0]));
+    }
     if (SUCCEEDED(result)) {
         D3D_SHADER_MACRO shaderMacros[] = { {"DEFAULT"}, {NULL, NULL} };
         result = pPSManager_.loadPS(L"PS.hlsl", shaderMacros, "default");
@@ -293,7 +631,7 @@ HRESULT Renderer::LoadShaders() {
     }
     if (SUCCEEDED(result)) {
         result = pVSManager_.loadVS(L"CubeMapVS.hlsl", nullptr, "skybox",
-            &pILManager_, SimpleVertexDesc, sizeof(SimpleVertexDesc) / sizeof(SimpleVertexDesc[0]));
+            &pILManager_, QuantizedVertexDesc, sizeof(QuantizedVertexDesc) / sizeof(QuantizedVertexDesc[0]));
     }
     if (SUCCEEDED(result)) {
         result = pPSManager_.loadPS(L"CubeMapPS.hlsl", nullptr, "skybox");
@@ -335,151 +673,125 @@ HRESULT Renderer::LoadShaders() {
     return result;
 }
 
-HRESULT Renderer::LoadGeometry() {
-    pGeometryManager_.setDevice(pDevice_);
-
-    UINT LatLines = 40, LongLines = 40;
-    UINT numVertices = ((LatLines - 2) * LongLines) + 2;
-    UINT numIndices = (((LatLines - 3) * (LongLines) * 2) + (LongLines * 2)) * 3;
-
-    float phi = 0.0f;
-    float theta = 0.0f;
-
-    std::vector<SimpleVertex> skyboxVertices(numVertices);
-    std::vector<Vertex> sphereVertices(numVertices);
-
-    XMVECTOR currVertPos = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
-
-    skyboxVertices[0].pos.x = 0.0f;
-    skyboxVertices[0].pos.y = 0.0f;
-    skyboxVertices[0].pos.z = 1.0f;
-
-    sphereVertices[0].pos.x = 0.0f;
-    sphereVertices[0].pos.y = 0.0f;
-    sphereVertices[0].pos.z = 1.0f;
-    sphereVertices[0].norm.x = 0.0f;
-    sphereVertices[0].norm.y = 0.0f;
-    sphereVertices[0].norm.z = 1.0f;
+// Только работа на CPU: выполняется в пуле потоков параллельно с созданием устройства и загрузкой шейдеров.
+void Renderer::PrepareSphere() {
+    SphereData& data = sphereData_;
+    mesh::MeshData sphereMesh;
+    sphereMesh.indices.assign(builtinSphere.indices, builtinSphere.indices + builtinSphere.indexCount);
 
-    for (UINT i = 0; i < LatLines - 2; i++) {
-        theta = (i + 1) * (XM_PI / (LatLines - 1));
-        XMMATRIX Rotationx = XMMatrixRotationX(theta);
-        for (UINT j = 0; j < LongLines; j++) {
-            phi = j * (XM_2PI / LongLines);
-            XMMATRIX Rotationy = XMMatrixRotationZ(phi);
-            currVertPos = XMVector3TransformNormal(XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), (Rotationx * Rotationy));
-            currVertPos = XMVector3Normalize(currVertPos);
-            skyboxVertices[i * (__int64)LongLines + j + 1].pos.x = XMVectorGetX(currVertPos);
-            skyboxVertices[i * (__int64)LongLines + j + 1].pos.y = XMVectorGetY(currVertPos);
-            skyboxVertices[i * (__int64)LongLines + j + 1].pos.z = XMVectorGetZ(currVertPos);
-
-            sphereVertices[i * (__int64)LongLines + j + 1].pos.x = XMVectorGetX(currVertPos);
-            sphereVertices[i * (__int64)LongLines + j + 1].pos.y = XMVectorGetY(currVertPos);
-            sphereVertices[i * (__int64)LongLines + j + 1].pos.z = XMVectorGetZ(currVertPos);
-            sphereVertices[i * (__int64)LongLines + j + 1].norm.x = XMVectorGetX(currVertPos);
-            sphereVertices[i * (__int64)LongLines + j + 1].norm.y = XMVectorGetY(currVertPos);
-            sphereVertices[i * (__int64)LongLines + j + 1].norm.z = XMVectorGetZ(currVertPos);
-        }
+    data.vertices.resize(builtinSphere.vertexCount * sizeof(Vertex));
+    Vertex* sphereVertices = reinterpret_cast<Vertex*>(data.vertices.data());
+    for (size_t i = 0; i < builtinSphere.vertexCount; i++) {
+        sphereVertices[i].pos = XMFLOAT3(builtinSphere.position[i]);
+        sphereVertices[i].norm = XMFLOAT3(builtinSphere.normal[i]);
     }
 
-    skyboxVertices[(__int64)numVertices - 1].pos.x = 0.0f;
-    skyboxVertices[(__int64)numVertices - 1].pos.y = 0.0f;
-    skyboxVertices[(__int64)numVertices - 1].pos.z = -1.0f;
+    // Оптимизируется внешний обход, обратный для скайбокса строится из него и сохраняет тот же порядок.
+    mesh::OptimizeReport report = mesh::OptimizeMesh(data.vertices, sizeof(Vertex), 0, sphereMesh.indices);
+    UINT numVertices = (UINT)(data.vertices.size() / sizeof(Vertex));
 
-    sphereVertices[(__int64)numVertices - 1].pos.x = 0.0f;
-    sphereVertices[(__int64)numVertices - 1].pos.y = 0.0f;
-    sphereVertices[(__int64)numVertices - 1].pos.z = -1.0f;
-    sphereVertices[(__int64)numVertices - 1].norm.x = 0.0f;
-    sphereVertices[(__int64)numVertices - 1].norm.y = 0.0f;
-    sphereVertices[(__int64)numVertices - 1].norm.z = -1.0f;
+    // Упрощенные уровни используют те же вершины, поэтому строятся до сжатия.
+    std::vector<mesh::Lod> lods;
+    mesh::BuildLodChain(data.vertices.data(), numVertices, sizeof(Vertex), offsetof(Vertex, pos), offsetof(Vertex, norm),
+        sphereMesh.indices.data(), sphereMesh.indices.size(), maxLodCount, 0.5f, 64, mesh::SimplifyOptions(), lods);
 
-    std::vector<UINT> skyboxIndices(numIndices);
-    std::vector<UINT> sphereIndices(numIndices);
+    // Полный уровень разбивается на кластеры, которые отсекаются на CPU перед отрисовкой.
+    mesh::BuildMeshlets(sphereMesh.indices.data(), sphereMesh.indices.size(), data.vertices.data(), numVertices, sizeof(Vertex),
+        offsetof(Vertex, pos), data.meshlets);
 
-    UINT k = 0;
-    for (UINT i = 0; i < LongLines - 1; i++) {
-        skyboxIndices[k] = 0;
-        skyboxIndices[(__int64)k + 2] = i + 1;
-        skyboxIndices[(__int64)k + 1] = i + 2;
+    // Вершины сжимаются до 8 байт, габариты для декодирования передаются в вершинные шейдеры.
+    data.bounds = mesh::ComputeBounds(data.vertices.data(), numVertices, sizeof(Vertex), offsetof(Vertex, pos));
+    data.quantized.resize(numVertices);
+    mesh::QuantizeVertices(data.vertices.data(), numVertices, sizeof(Vertex), offsetof(Vertex, pos), offsetof(Vertex, norm),
+        data.bounds, data.quantized.data());
 
-        sphereIndices[k] = i + 1;
-        sphereIndices[(__int64)k + 2] = 0;
-        sphereIndices[(__int64)k + 1] = i + 2;
-        k += 3;
+#ifdef _DEBUG
+    std::vector<float> positions(numVertices * 3), normals(numVertices * 3);
+    mesh::DequantizeVertices(data.quantized.data(), numVertices, data.bounds, positions.data(), normals.data());
+    mesh::QuantizationError error = mesh::MeasureError(data.vertices.data(), numVertices, sizeof(Vertex),
+        offsetof(Vertex, pos), offsetof(Vertex, norm), positions.data(), normals.data());
+
+    char message[192];
+    snprintf(message, sizeof(message), "sphere: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, position error %.2e, normal error %.3f deg\n",
+        report.before.acmr, report.after.acmr, report.before.atvr, report.after.atvr, error.maxPosition, error.maxNormalDegrees);
+    OutputDebugStringA(message);
+    for (size_t i = 1; i < lods.size(); i++) {
+        snprintf(message, sizeof(message), "sphere LOD %zu: %zu triangles, error %.2e\n", i, lods[i].indices.size() / 3,
+            lods[i].error);
+        OutputDebugStringA(message);
     }
-    skyboxIndices[k] = 0;
-    skyboxIndices[(__int64)k + 2] = LongLines;
-    skyboxIndices[(__int64)k + 1] = 1;
-
-    sphereIndices[k] = LongLines;
-    sphereIndices[(__int64)k + 2] = 0;
-    sphereIndices[(__int64)k + 1] = 1;
-    k += 3;
-
-    for (UINT i = 0; i < LatLines - 3; i++) {
-        for (UINT j = 0; j < LongLines - 1; j++) {
-            skyboxIndices[k] = i * LongLines + j + 1;
-            skyboxIndices[(__int64)k + 1] = i * LongLines + j + 2;
-            skyboxIndices[(__int64)k + 2] = (i + 1) * LongLines + j + 1;
-
-            skyboxIndices[(__int64)k + 3] = (i + 1) * LongLines + j + 1;
-            skyboxIndices[(__int64)k + 4] = i * LongLines + j + 2;
-            skyboxIndices[(__int64)k + 5] = (i + 1) * LongLines + j + 2;
-
-            sphereIndices[(__int64)k + 2] = i * LongLines + j + 1;
-            sphereIndices[(__int64)k + 1] = i * LongLines + j + 2;
-            sphereIndices[k] = (i + 1) * LongLines + j + 1;
-
-            sphereIndices[(__int64)k + 5] = (i + 1) * LongLines + j + 1;
-            sphereIndices[(__int64)k + 4] = i * LongLines + j + 2;
-            sphereIndices[(__int64)k + 3] = (i + 1) * LongLines + j + 2;
-
-            k += 6;
-        }
-
-        skyboxIndices[k] = (i * LongLines) + LongLines;
-        skyboxIndices[(__int64)k + 1] = (i * LongLines) + 1;
-        skyboxIndices[(__int64)k + 2] = ((i + 1) * LongLines) + LongLines;
-
-        skyboxIndices[(__int64)k + 3] = ((i + 1) * LongLines) + LongLines;
-        skyboxIndices[(__int64)k + 4] = (i * LongLines) + 1;
-        skyboxIndices[(__int64)k + 5] = ((i + 1) * LongLines) + 1;
-
-        sphereIndices[(__int64)k + 2] = (i * LongLines) + LongLines;
-        sphereIndices[(__int64)k + 1] = (i * LongLines) + 1;
-        sphereIndices[k] = ((i + 1) * LongLines) + LongLines;
-
-        sphereIndices[(__int64)k + 5] = ((i + 1) * LongLines) + LongLines;
-        sphereIndices[(__int64)k + 4] = (i * LongLines) + 1;
-        sphereIndices[(__int64)k + 3] = ((i + 1) * LongLines) + 1;
+#endif // _DEBUG
 
-        k += 6;
+    // Сфера и скайбокс используют общие вершины, индексы скайбокса идут следом с обратным обходом,
+    // за ними - упрощенные уровни сферы.
+    size_t numIndices = sphereMesh.indices.size();
+    data.indices.resize(numIndices * 2);
+    mesh::WriteIndices(sphereMesh, mesh::Winding::Outward, data.indices.data());
+    mesh::WriteIndices(sphereMesh, mesh::Winding::Inward, data.indices.data() + numIndices);
+    data.lodStarts.assign(1, 0);
+    data.lodCounts.assign(1, (UINT)numIndices);
+    data.lodErrors.assign(1, 0.0f);
+    for (size_t i = 1; i < lods.size(); i++) {
+        mesh::OptimizeVertexCache(lods[i].indices.data(), lods[i].indices.size(), numVertices);
+        data.lodStarts.push_back((UINT)data.indices.size());
+        data.lodCounts.push_back((UINT)lods[i].indices.size());
+        data.lodErrors.push_back(lods[i].error);
+        data.indices.insert(data.indices.end(), lods[i].indices.begin(), lods[i].indices.end());
     }
+}
 
-    for (UINT i = 0; i < LongLines - 1; i++) {
-        skyboxIndices[k] = numVertices - 1;
-        skyboxIndices[(__int64)k + 2] = (numVertices - 1) - (i + 1);
-        skyboxIndices[(__int64)k + 1] = (numVertices - 1) - (i + 2);
+HRESULT Renderer::LoadGeometry() {
+    pGeometryManager_.setDevice(pDevice_);
 
-        sphereIndices[(__int64)k + 2] = numVertices - 1;
-        sphereIndices[k] = (numVertices - 1) - (i + 1);
-        sphereIndices[(__int64)k + 1] = (numVertices - 1) - (i + 2);
-        k += 3;
+    // Задачу PrepareSphere поставил Init, других задач в пуле до этой точки нет.
+    threadPool_.Wait();
+    SphereData prepared;
+    std::swap(prepared, sphereData_);
+
+    sphereMeshlets_.Build(prepared.meshlets);
+    sphere.lodErrors = prepared.lodErrors;
+    const std::vector<mesh::QuantizedVertex8>& quantized = prepared.quantized;
+    const std::vector<UINT>& indices = prepared.indices;
+    const mesh::Bounds& bounds = prepared.bounds;
+    UINT numVertices = (UINT)quantized.size();
+    UINT numIndices = prepared.lodCounts[0];
+
+    HRESULT result = pGeometryManager_.loadGeometry(quantized.data(), (UINT)(sizeof(mesh::QuantizedVertex8) * quantized.size()),
+        indices.data(), (UINT)(sizeof(UINT) * indices.size()), "uvsphere");
+    // Для запросов на CPU сохраняются несжатые позиции, вьюхи ниже получают ту же копию.
+    if (SUCCEEDED(result)) {
+        result = pGeometryManager_.setCpuCopy("uvsphere", prepared.vertices.data(), numVertices, sizeof(Vertex), offsetof(Vertex, pos),
+            indices.data(), (UINT)indices.size());
+    }
+    if (SUCCEEDED(result)) {
+        result = pGeometryManager_.createView("uvsphere", 0, numIndices, "sphere");
+    }
+    if (SUCCEEDED(result)) {
+        result = pGeometryManager_.createView("uvsphere", numIndices, numIndices, "skybox");
     }
+    for (size_t i = 1; i < prepared.lodStarts.size() && SUCCEEDED(result); i++) {
+        result = pGeometryManager_.createView("uvsphere", prepared.lodStarts[i], prepared.lodCounts[i],
+            "sphere_lod" + std::to_string(i));
+    }
+    if (SUCCEEDED(result)) {
+        QuantizationBuffer quantizationBuffer;
+        quantizationBuffer.positionScale = XMFLOAT4(bounds.extent[0], bounds.extent[1], bounds.extent[2], 0.0f);
+        quantizationBuffer.positionOffset = XMFLOAT4(bounds.min[0], bounds.min[1], bounds.min[2], 0.0f);
 
-    skyboxIndices[k] = numVertices - 1;
-    skyboxIndices[(__int64)k + 2] = (numVertices - 1) - LongLines;
-    skyboxIndices[(__int64)k + 1] = numVertices - 2;
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(QuantizationBuffer);
+        desc.Usage = D3D11_USAGE_IMMUTABLE;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
 
-    sphereIndices[(__int64)k + 2] = numVertices - 1;
-    sphereIndices[k] = (numVertices - 1) - LongLines;
-    sphereIndices[(__int64)k + 1] = numVertices - 2;
+        D3D11_SUBRESOURCE_DATA data;
+        data.pSysMem = &quantizationBuffer;
+        data.SysMemPitch = sizeof(quantizationBuffer);
+        data.SysMemSlicePitch = 0;
 
-    HRESULT result = pGeometryManager_.loadGeometry(&skyboxVertices[0], sizeof(SimpleVertex) * numVertices,
-        &skyboxIndices[0], sizeof(UINT) * numIndices, "skybox");
-    if (SUCCEEDED(result)) {
-        result = pGeometryManager_.loadGeometry(&sphereVertices[0], sizeof(Vertex) * numVertices,
-            &sphereIndices[0], sizeof(UINT) * numIndices, "sphere");
+        result = pDevice_->CreateBuffer(&desc, &data, &pQuantizationBuffer_);
     }
 
     return result;
@@ -540,7 +852,14 @@ HRESULT Renderer::InitObjects() {
     sphere.color = XMFLOAT3(1.0f, 0.71f, 0.29f);
     sphere.metalness = 1.0f;
     sphere.roughness = 0.01f;
+    lights_.SetCutoff(lightCutoff);
     HRESULT result = pGeometryManager_.get("sphere", sphere.geometry);
+    sphere.lods.assign(1, sphere.geometry);
+    for (size_t i = 1; i < sphere.lodErrors.size() && SUCCEEDED(result); i++) {
+        std::shared_ptr<Geometry> lod;
+        result = pGeometryManager_.get("sphere_lod" + std::to_string(i), lod);
+        sphere.lods.push_back(lod);
+    }
     if (SUCCEEDED(result)) {
         result = pVSManager_.get("sphere", sphere.VS);
     }
@@ -553,6 +872,194 @@ HRESULT Renderer::InitObjects() {
     if (SUCCEEDED(result)) {
         result = pTextureManager_.get("irradiance", sphere.irradianceMap);
     }
+    if (SUCCEEDED(result)) {
+        result = BuildBvh(sphere.geometry, sphereBvh_);
+    }
+    return result;
+}
+
+HRESULT Renderer::BuildBvh(const std::shared_ptr<Geometry>& geometry, mesh::Bvh& bvh) {
+    // Дерево строится в пространстве модели по CPU-копии, вьюха задает свой диапазон индексов.
+    const std::shared_ptr<const CpuGeometry>& copy = geometry->getCpuCopy();
+    if (copy == nullptr)
+        return E_FAIL;
+    bvh.Build(copy->positions.data(), copy->positions.size() / 3, 3 * sizeof(float), 0,
+        copy->indices.data() + geometry->getStartIndex(), geometry->getNumIndices(), &threadPool_);
+    return S_OK;
+}
+
+// Параллелепипеды деревьев в пространстве модели переводятся в мировое; объекты сцены неподвижны, поэтому
+// границы считаются один раз.
+HRESULT Renderer::InitObjectBounds() {
+    objectBounds_.Clear();
+    auto add = [this](const mesh::Bvh& bvh, const XMMATRIX& worldMatrix) {
+        float localMin[3], localMax[3], worldMin[3], worldMax[3];
+        bvh.GetBounds(localMin, localMax);
+        XMFLOAT4X4 world;
+        XMStoreFloat4x4(&world, worldMatrix);
+        culling::TransformBox(localMin, localMax, &world.m[0][0], worldMin, worldMax);
+        objectBounds_.Add(worldMin, worldMax);
+    };
+    if (sphereBvh_.IsEmpty())
+        return E_FAIL;
+    add(sphereBvh_, sphere.worldMatrix);
+    for (size_t i = 0; i < models_.size(); i++) {
+        if (modelBvhs_[i]->IsEmpty())
+            return E_FAIL;
+        add(*modelBvhs_[i], models_[i].worldMatrix);
+    }
+    return S_OK;
+}
+
+static const unsigned occlusionWidth = 320;
+static const unsigned occlusionHeight = 192;
+static const float occluderMinPixels = 64.0f;       // площадь прямоугольника на экране в пикселях буфера
+static const size_t occluderTriangleBudget = 65536;
+
+// Заслонители выбираются из объектов, прошедших пирамиду, по убыванию площади прямоугольника параллелепипеда
+// на экране буфера, пока хватает бюджета треугольников; мелкие не рисуются. Рисуются CPU-копии геометрии,
+// у сферы - самый грубый уровень, ошибка которого меньше пикселя буфера.
+// Сам себя объект не закрывает: буфер не ближе его поверхности, а проверяется ближайшая точка параллелепипеда.
+void Renderer::CullOccludedObjects(const XMMATRIX& view, const XMMATRIX& projection) {
+    XMMATRIX viewProjection = XMMatrixMultiply(view, projection);
+    occluderOrder_.clear();
+    for (size_t v = 0; v < visibleObjects_.size(); v++) {
+        float boxMin[3], boxMax[3];
+        objectBounds_.GetBox(visibleObjects_[v], boxMin, boxMax);
+        // Параллелепипед, пересекающий ближнюю плоскость, считается закрывающим весь экран.
+        float rect[4] = { 1.0f, 1.0f, -1.0f, -1.0f };
+        bool crossesNear = false;
+        for (int corner = 0; corner < 8 && !crossesNear; corner++) {
+            XMVECTOR point = XMVector4Transform(XMVectorSet(corner & 1 ? boxMax[0] : boxMin[0],
+                corner & 2 ? boxMax[1] : boxMin[1], corner & 4 ? boxMax[2] : boxMin[2], 1.0f), viewProjection);
+            float w = XMVectorGetW(point);
+            crossesNear = w <= nearPlane;
+            rect[0] = min(rect[0], XMVectorGetX(point) / w);
+            rect[1] = min(rect[1], XMVectorGetY(point) / w);
+            rect[2] = max(rect[2], XMVectorGetX(point) / w);
+            rect[3] = max(rect[3], XMVectorGetY(point) / w);
+        }
+        float area = (float)(occlusionWidth * occlusionHeight);
+        if (!crossesNear) {
+            float width = max(min(rect[2], 1.0f) - max(rect[0], -1.0f), 0.0f);
+            float height = max(min(rect[3], 1.0f) - max(rect[1], -1.0f), 0.0f);
+            area *= width * height * 0.25f;
+        }
+        if (area >= occluderMinPixels)
+            occluderOrder_.push_back({ area, (uint32_t)v });
+    }
+    std::sort(occluderOrder_.begin(), occluderOrder_.end(),
+        [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) { return a.first > b.first; });
+
+    float projectionScale = XMVectorGetY(projection.r[1]) * occlusionHeight * 0.5f;
+    size_t triangles = 0;
+    occluders_.clear();
+    occluderMatrices_.resize(visibleObjects_.size());
+    for (const std::pair<float, uint32_t>& candidate : occluderOrder_) {
+        size_t v = candidate.second;
+        bool isSphere = visibleObjects_[v] == 0;
+        std::shared_ptr<Geometry> geometry = isSphere ? sphere.geometry : models_[visibleObjects_[v] - 1].geometry;
+        const XMMATRIX& worldMatrix = isSphere ? sphere.worldMatrix : models_[visibleObjects_[v] - 1].worldMatrix;
+        if (isSphere) {
+            XMVECTOR center = XMVector3TransformCoord(worldMatrix.r[3], view);
+            float worldScale = XMVectorGetX(XMVector3Length(worldMatrix.r[0]));
+            geometry = sphere.lods[mesh::SelectLod(sphere.lodErrors, sphereRadius, worldScale, XMVectorGetZ(center),
+                nearPlane, projectionScale, 1.0f)];
+        }
+        const std::shared_ptr<const CpuGeometry>& copy = geometry->getCpuCopy();
+        if (copy == nullptr || triangles + geometry->getNumIndices() / 3 > occluderTriangleBudget)
+            continue;
+        triangles += geometry->getNumIndices() / 3;
+        XMStoreFloat4x4(&occluderMatrices_[v], XMMatrixMultiply(worldMatrix, viewProjection));
+        culling::OccluderMesh occluder;
+        occluder.positions = copy->positions.data();
+        occluder.vertexCount = copy->positions.size() / 3;
+        occluder.indices = copy->indices.data() + geometry->getStartIndex();
+        occluder.indexCount = geometry->getNumIndices();
+        occluder.worldViewProjection = &occluderMatrices_[v].m[0][0];
+        occluder.frontCounterClockwise = !isSphere;
+        occluders_.push_back(occluder);
+    }
+
+    XMFLOAT4X4 matrix;
+    XMStoreFloat4x4(&matrix, viewProjection);
+    size_t visible = visibleObjects_.size();
+    occlusionBuffer_.Begin(occlusionWidth, occlusionHeight, nearPlane);
+    occlusionBuffer_.Render(occluders_.data(), occluders_.size(), &threadPool_);
+    occlusionBuffer_.Cull(objectBounds_, &matrix.m[0][0], visibleObjects_, &threadPool_);
+    occludedObjects_ = (UINT)(visible - visibleObjects_.size());
+}
+
+HRESULT Renderer::LoadModels() {
+    // Модель необязательна: без файла сцена состоит из одной сферы.
+    mesh::GlbModel model;
+    if (!model.Load(modelPath)) {
+#ifdef _DEBUG
+        OutputDebugStringA(("model: " + model.GetError() + "\n").c_str());
+#endif // _DEBUG
+        return S_OK;
+    }
+
+    // Каждый примитив загружается один раз, вершины и индексы по возможности берутся прямо из отображенного файла.
+    HRESULT result = S_OK;
+    const std::vector<mesh::GltfPrimitive>& primitives = model.GetPrimitives();
+    std::vector<bool> loaded(primitives.size(), false);
+    std::vector<std::shared_ptr<mesh::Bvh>> bvhs(primitives.size());
+    for (size_t i = 0; i < primitives.size() && SUCCEEDED(result); i++) {
+        const uint8_t* vertices;
+        const uint32_t* indices;
+        size_t numVertices, numIndices;
+        std::vector<uint8_t> vertexStorage;
+        std::vector<uint32_t> indexStorage;
+        if (!model.GetVertices(primitives[i], vertices, numVertices, vertexStorage) ||
+            !model.GetIndices(primitives[i], indices, numIndices, indexStorage) || numIndices == 0)
+            continue;
+        result = pGeometryManager_.loadGeometry(vertices, (UINT)(numVertices * sizeof(Vertex)), indices,
+            (UINT)(numIndices * sizeof(UINT)), "model" + std::to_string(i));
+        if (SUCCEEDED(result)) {
+            result = pGeometryManager_.setCpuCopy("model" + std::to_string(i), vertices, (UINT)numVertices, sizeof(Vertex),
+                offsetof(Vertex, pos), indices, (UINT)numIndices);
+        }
+        loaded[i] = SUCCEEDED(result);
+    }
+
+    for (const mesh::GltfInstance& instance : model.GetInstances()) {
+        if (FAILED(result))
+            break;
+        if (!loaded[instance.primitive])
+            continue;
+
+        // Матрица glTF по столбцам совпадает в памяти с матрицей DirectXMath по строкам.
+        // Отражение по Z переводит правую систему координат glTF в левую.
+        SimpleObject<Vertex> object;
+        object.worldMatrix = XMMatrixMultiply(XMMATRIX(instance.transform), XMMatrixScaling(1.0f, 1.0f, -1.0f));
+        mesh::GltfMaterial material;
+        int materialIndex = primitives[instance.primitive].material;
+        if (materialIndex >= 0)
+            material = model.GetMaterials()[materialIndex];
+        object.color = XMFLOAT3(material.baseColor[0], material.baseColor[1], material.baseColor[2]);
+        object.roughness = material.roughness;
+        object.metalness = material.metallic;
+
+        result = pGeometryManager_.get("model" + std::to_string(instance.primitive), object.geometry);
+        if (SUCCEEDED(result)) {
+            result = pVSManager_.get("model", object.VS);
+        }
+        if (SUCCEEDED(result)) {
+            result = pILManager_.get("model", object.IL);
+        }
+        if (SUCCEEDED(result)) {
+            result = pTextureManager_.get("irradiance", object.irradianceMap);
+        }
+        if (SUCCEEDED(result) && bvhs[instance.primitive] == nullptr) {
+            bvhs[instance.primitive] = std::make_shared<mesh::Bvh>();
+            result = BuildBvh(object.geometry, *bvhs[instance.primitive]);
+        }
+        if (SUCCEEDED(result)) {
+            models_.push_back(object);
+            modelBvhs_.push_back(bvhs[instance.primitive]);
+        }
+    }
     return result;
 }
 
@@ -578,6 +1085,42 @@ void Renderer::InputHandler() {
         dy = pCamera_->GetDistance() * keyboard.y / 30.0f,
         dz = pCamera_->GetDistance() * keyboard.z / 30.0f;
     pCamera_->Move(dx, dy, dz);
+
+    // Состояния кнопок берутся из ReadMouse и ReadKeyboard выше, запрос - нажатие левой кнопки или P.
+    pickRequested_ = pInput_->ReadPick();
+}
+
+// Луч из центра экрана по оси камеры; объекты проверяются в своем пространстве, параметр t при этом сохраняется.
+void Renderer::PickCenter(const XMMATRIX& view, const XMFLOAT3& cameraPos) {
+    auto start = std::chrono::steady_clock::now();
+    XMVECTOR origin = XMLoadFloat3(&cameraPos);
+    XMVECTOR direction = XMMatrixInverse(nullptr, view).r[2];
+    float closest = 1e30f;
+    pickedName_.clear();
+
+    auto test = [&](const mesh::Bvh& bvh, const XMMATRIX& worldMatrix, const char* name) {
+        XMMATRIX inverseWorld = XMMatrixInverse(nullptr, worldMatrix);
+        XMFLOAT3 objectOrigin, objectDirection;
+        XMStoreFloat3(&objectOrigin, XMVector3TransformCoord(origin, inverseWorld));
+        XMStoreFloat3(&objectDirection, XMVector3TransformNormal(direction, inverseWorld));
+        mesh::Ray ray;
+        memcpy(ray.origin, &objectOrigin, sizeof(ray.origin));
+        memcpy(ray.direction, &objectDirection, sizeof(ray.direction));
+        ray.tMax = closest;
+        mesh::RayHit hit;
+        if (bvh.Intersect(ray, hit)) {
+            closest = hit.t;
+            pickedName_ = name;
+            pickedTriangle_ = hit.triangle;
+        }
+    };
+    test(sphereBvh_, sphere.worldMatrix, "sphere");
+    for (size_t i = 0; i < models_.size(); i++) {
+        test(*modelBvhs_[i], models_[i].worldMatrix, "model");
+    }
+
+    pickedDistance_ = closest;
+    pickMicroseconds_ = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
 }
 
 bool Renderer::UpdateScene() {
@@ -585,40 +1128,100 @@ bool Renderer::UpdateScene() {
 
     InputHandler();
 
-    WorldMatrixBuffer worldMatrixBuffer;
-    worldMatrixBuffer.worldMatrix = sphere.worldMatrix;
-    worldMatrixBuffer.color = sphere.color;
-    worldMatrixBuffer.roughness = sphere.roughness;
-    worldMatrixBuffer.metalness = sphere.metalness;
-    pDeviceContext_->UpdateSubresource(pWorldMatrixBuffer_, 0, nullptr, &worldMatrixBuffer, 0, 0);
-
     XMMATRIX mView = pCamera_->GetViewMatrix();
-    XMMATRIX mProjection = XMMatrixPerspectiveFovLH(XM_PI / 3, width_ / (FLOAT)height_, 100.0f, 0.01f);
+    XMMATRIX mProjection = XMMatrixPerspectiveFovLH(XM_PI / 3, width_ / (FLOAT)height_, farPlane, nearPlane);
     XMFLOAT3 cameraPos = pCamera_->GetPosition();
-    D3D11_MAPPED_SUBRESOURCE subresource;
-    HRESULT result = pDeviceContext_->Map(pViewMatrixBuffer_, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
-    if (SUCCEEDED(result)) {
-        ViewMatrixBuffer& sceneBuffer = *reinterpret_cast<ViewMatrixBuffer*>(subresource.pData);
-        sceneBuffer.viewProjectionMatrix = XMMatrixMultiply(mView, mProjection);
-        sceneBuffer.cameraPos = XMFLOAT4(cameraPos.x, cameraPos.y, cameraPos.z, 1.0f);
-        sceneBuffer.lightParams = XMINT4(int(lights_.size()), 0, 0, 0);
-        for (int i = 0; i < lights_.size(); i++) {
-            sceneBuffer.lights[i].pos = lights_[i].pos;
-            sceneBuffer.lights[i].color = lights_[i].color;
+
+    // Уровень детализации - самый грубый, ошибка которого на ближней к камере точке сферы не больше lodPixelError_ пикселей.
+    XMVECTOR center = XMVector3TransformCoord(XMVector3TransformCoord(XMVectorZero(), sphere.worldMatrix), mView);
+    float worldScale = XMVectorGetX(XMVector3Length(sphere.worldMatrix.r[0]));
+    float projectionScale = XMVectorGetY(mProjection.r[1]) * height_ * 0.5f;
+    sphere.lod = mesh::SelectLod(sphere.lodErrors, sphereRadius, worldScale, XMVectorGetZ(center), nearPlane,
+        projectionScale, lodPixelError_);
+
+    // Кластеры проверяются в пространстве модели: плоскости берутся из полной матрицы, камера переносится обратной.
+    if (clusterCulling_ && sphere.lod == 0) {
+        XMFLOAT4X4 worldViewProjection;
+        XMStoreFloat4x4(&worldViewProjection, XMMatrixMultiply(XMMatrixMultiply(sphere.worldMatrix, mView), mProjection));
+        float planes[6][4];
+        mesh::ExtractFrustumPlanes(&worldViewProjection.m[0][0], planes);
+        XMFLOAT3 objectCamera;
+        XMStoreFloat3(&objectCamera, XMVector3TransformCoord(XMLoadFloat3(&cameraPos), XMMatrixInverse(nullptr, sphere.worldMatrix)));
+        visibleClusters_ = (UINT)sphereMeshlets_.Cull(planes, &objectCamera.x, sphereRanges_);
+    }
+    else {
+        sphereRanges_.assign(1, { 0, sphere.lods[sphere.lod]->getNumIndices() });
+        visibleClusters_ = (UINT)sphereMeshlets_.GetMeshletCount();
+    }
+
+    // Объекты после загрузки не двигаются, поэтому луч пускается только по запросу и при сдвиге камеры.
+    XMFLOAT4X4 view;
+    XMStoreFloat4x4(&view, mView);
+    if (pickRequested_ || memcmp(&view, &pickView_, sizeof(view)) != 0) {
+        pickView_ = view;
+        PickCenter(mView, cameraPos);
+    }
+
+    // Объекты вне пирамиды видимости в RenderObjects не попадают.
+    XMMATRIX viewProjection = XMMatrixMultiply(mView, mProjection);
+    auto cullStart = std::chrono::steady_clock::now();
+    if (objectCulling_) {
+        XMFLOAT4X4 matrix;
+        XMStoreFloat4x4(&matrix, viewProjection);
+        float planes[6][4];
+        mesh::ExtractFrustumPlanes(&matrix.m[0][0], planes);
+        objectCuller_.Cull(objectBounds_, planes, visibleObjects_, &threadPool_);
+    }
+    else {
+        visibleObjects_.resize(objectBounds_.GetCount());
+        for (size_t i = 0; i < visibleObjects_.size(); i++) {
+            visibleObjects_[i] = (uint32_t)i;
         }
-        pDeviceContext_->Unmap(pViewMatrixBuffer_, 0);
     }
-    if (SUCCEEDED(result)) {
-        SkyboxWorldMatrixBuffer skyboxWorldMatrixBuffer;
-        skyboxWorldMatrixBuffer.worldMatrix = skybox.worldMatrix;
-        skyboxWorldMatrixBuffer.size = XMFLOAT4(skybox.size, 0.0f, 0.0f, 0.0f);
-        pDeviceContext_->UpdateSubresource(pSkyboxWorldMatrixBuffer_, 0, nullptr, &skyboxWorldMatrixBuffer, 0, 0);
+    cullMicroseconds_ = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - cullStart).count();
+
+    // Затем - закрытые другими объектами по программному буферу глубины.
+    auto occlusionStart = std::chrono::steady_clock::now();
+    occludedObjects_ = 0;
+    if (objectCulling_ && occlusionCulling_) {
+        CullOccludedObjects(mView, mProjection);
     }
-    if (SUCCEEDED(result)) {
+    occlusionMicroseconds_ = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - occlusionStart).count();
+
+    if (FAILED(UpdateInstances()))
+        return false;
+
+    if (FAILED(UpdateLights(mView)))
+        return false;
+
+    ViewMatrixBuffer sceneBuffer;
+    sceneBuffer.viewProjectionMatrix = viewProjection;
+    sceneBuffer.cameraPos = XMFLOAT4(cameraPos.x, cameraPos.y, cameraPos.z, 1.0f);
+    sceneBuffer.lightParams = XMINT4(int(lights_.GetCount()), (int)lightGrid_.tilesX, (int)lightGrid_.tilesY,
+        (int)lightGrid_.slices);
+    sceneBuffer.clusterParams = XMFLOAT4(lightClusterer_.GetSliceScale(), lightClusterer_.GetSliceBias(), 0.0f, 0.0f);
+
+    SkyboxWorldMatrixBuffer skyboxWorldMatrixBuffer;
+    skyboxWorldMatrixBuffer.worldMatrix = skybox.worldMatrix;
+    skyboxWorldMatrixBuffer.size = XMFLOAT4(skybox.size, 0.0f, 0.0f, 0.0f);
+
+    frame_.viewConstants = &sceneBuffer;
+    frame_.skyboxConstants = &skyboxWorldMatrixBuffer;
+    bool uploaded = gfx::ScenePass::Upload(FrameBackend(), frame_);
+    frame_.viewConstants = nullptr;
+    frame_.skyboxConstants = nullptr;
+    for (int i = 0; i < 3; i++) {
+        frame_.lightData[i] = nullptr;
+        frame_.lightDataSize[i] = 0;
+    }
+    frame_.lightDataRanges = nullptr;
+    frame_.lightDataRangeCount = 0;
+
+    if (uploaded) {
         ImGui::Render();
     }
 
-    return SUCCEEDED(result);
+    return uploaded;
 }
 
 void Renderer::UpdateImgui() {
@@ -694,42 +1297,152 @@ void Renderer::UpdateImgui() {
         ImGui::Text(str.c_str());
         ImGui::SameLine();
         if (ImGui::Button("+")) {
-            if (lights_.size() < MAX_LIGHT)
-                lights_.push_back({ XMFLOAT4(5.0f, 5.0f, 5.0f, 0.f), XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f) });
+            lighting::LightDesc light;
+            light.position[0] = light.position[1] = light.position[2] = 5.0f;
+            lights_.Add(light);
         }
         ImGui::SameLine();
         if (ImGui::Button("-")) {
-            if (lights_.size() > 0)
-                lights_.pop_back();
+            if (lights_.GetCount() > 0)
+                lights_.Remove((uint32_t)lights_.GetCount() - 1);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Clear")) {
+            lights_.Clear();
         }
 
-        static float col[MAX_LIGHT][3];
-        static float pos[MAX_LIGHT][4];
-        static float brightness[MAX_LIGHT];
-        for (int i = 0; i < lights_.size(); i++) {
-            std::string str = "Light " + std::to_string(i);
-            ImGui::Text(str.c_str());
+        // Случайные источники в той же области, что и ползунки положения.
+        ImGui::DragInt("Scatter count", &lightScatterCount_, 16.0f, 1, 65536);
+        ImGui::SameLine();
+        if (ImGui::Button("Scatter")) {
+            static std::mt19937 random(1);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+            for (int i = 0; i < lightScatterCount_; i++) {
+                lighting::LightDesc light;
+                for (int k = 0; k < 3; k++) {
+                    light.position[k] = unit(random) * 30.0f - 15.0f;
+                    light.color[k] = unit(random);
+                }
+                light.intensity = 1.0f + unit(random) * 9.0f;
+                if (lightScatterAnimated_) {
+                    light.orbitRadius = unit(random) * 2.0f;
+                    light.orbitSpeed = unit(random) * 4.0f - 2.0f;
+                    light.flicker = unit(random) * 0.5f;
+                    light.flickerSpeed = unit(random) * 20.0f;
+                    light.phase = unit(random) * XM_2PI;
+                }
+                lights_.Add(light);
+            }
+        }
+        ImGui::SameLine();
+        ImGui::Checkbox("Animated", &lightScatterAnimated_);
 
-            pos[i][0] = lights_[i].pos.x;
-            pos[i][1] = lights_[i].pos.y;
-            pos[i][2] = lights_[i].pos.z;
-            str = "Pos " + std::to_string(i);
-            ImGui::DragFloat3(str.c_str(), pos[i], 0.1f, -15.0f, 15.0f);
-            lights_[i].pos = XMFLOAT4(pos[i][0], pos[i][1], pos[i][2], 1.0f);
+        const lighting::ClusterStats& clusterStats = lightClusterer_.GetStats();
+        size_t uploadedBytes = 0;
+        for (const gfx::BufferRange& range : lightUploads_) {
+            uploadedBytes += range.size;
+        }
+        ImGui::Text("%u lights, %u visible, %u of %u clusters lit, max %u per cluster, %u indices (%.2f ms)",
+            (UINT)lights_.GetCount(), (UINT)clusterStats.visibleLights, (UINT)clusterStats.nonEmptyClusters, lightGrid_.GetClusterCount(),
+            (UINT)clusterStats.maxClusterLights, (UINT)clusterStats.indexCount, clusterStats.seconds * 1e3);
+        ImGui::Text("Light upload %u ranges, %u KB", (UINT)lightUploads_.size(), (UINT)(uploadedBytes >> 10));
+
+        // Источник записывается обратно, только если его поле изменили: иначе его блок загружался бы каждый кадр.
+        if (ImGui::CollapsingHeader("Light list")) {
+            for (uint32_t i = 0; i < lights_.GetCount(); i++) {
+                std::string str = "Light " + std::to_string(i);
+                ImGui::Text(str.c_str());
+
+                lighting::LightDesc light;
+                lights_.Get(i, light);
+                str = "Pos " + std::to_string(i);
+                bool changed = ImGui::DragFloat3(str.c_str(), light.position, 0.1f, -15.0f, 15.0f);
+                str = "Color " + std::to_string(i);
+                changed |= ImGui::ColorEdit3(str.c_str(), light.color);
+                str = "Brightness " + std::to_string(i);
+                changed |= ImGui::DragFloat(str.c_str(), &light.intensity, 1.0f, 1.0f, 1000.0f);
+                if (changed) {
+                    lights_.Set(i, light);
+                }
+            }
+        }
 
-            col[i][0] = lights_[i].color.x;
-            col[i][1] = lights_[i].color.y;
-            col[i][2] = lights_[i].color.z;
-            str = "Color " + std::to_string(i);
-            ImGui::ColorEdit3(str.c_str(), col[i]);
-            lights_[i].color = XMFLOAT4(col[i][0], col[i][1], col[i][2], lights_[i].color.w);
+        str = "Capture";
+        ImGui::Text(str.c_str());
+        ImGui::SameLine();
+        if (ImGui::Button("Screenshot")) {
+            captureRequested_ = true;
+        }
+        ImGui::SameLine();
+        ImGui::Checkbox("Record", &recording_);
+
+        CaptureQueue::Stats stats = screenCapture_.GetStats();
+        ImGui::Text("Written %u, dropped %u, in flight %u KB", (UINT)stats.written, (UINT)stats.dropped,
+            (UINT)(stats.bytesInFlight >> 10));
+
+        str = "Command trace";
+        ImGui::Text(str.c_str());
+        ImGui::SameLine();
+        if (ImGui::Button("Record trace") && traceFramesLeft_ == 0) {
+            traceFramesLeft_ = traceFrames_;
+        }
+        ImGui::DragInt("Trace frames", &traceFrames_, 1.0f, 1, 1000);
+        if (traceIndex_ > 0)
+            ImGui::Text("trace_%06u.gfxt: %u frames, %u commands, payloads %u KB (%u KB stored)", traceIndex_ - 1,
+                traceStats_.frames, (UINT)traceStats_.commands, (UINT)(traceStats_.payloadBytes >> 10),
+                (UINT)(traceStats_.storedPayloadBytes >> 10));
 
-            brightness[i] = lights_[i].color.w;
-            str = "Brightness " + std::to_string(i);
-            ImGui::DragFloat(str.c_str(), &brightness[i], 1.0f, 1.0f, 1000.0f);
-            lights_[i].color.w = brightness[i];
+        str = "Resolution";
+        ImGui::Text(str.c_str());
+        ImGui::SameLine();
+        if (ImGui::Checkbox("Dynamic", &dynamicResolutionEnabled_)) {
+            dynamicResolution_.Reset();
         }
 
+        DynamicResolutionSettings settings = dynamicResolution_.GetSettings();
+        str = "Target frame ms";
+        if (ImGui::DragFloat(str.c_str(), &settings.targetFrameMs, 0.1f, 1.0f, 100.0f)) {
+            dynamicResolution_.SetSettings(settings);
+        }
+        ImGui::Text("Scale %.2f (%dx%d), frame %.2f ms", toneMapping_.GetRenderScale(), toneMapping_.GetWidth(),
+            toneMapping_.GetHeight(), dynamicResolution_.GetSmoothedFrameMs());
+
+        str = "LOD pixel error";
+        ImGui::DragFloat(str.c_str(), &lodPixelError_, 0.05f, 0.0f, 20.0f);
+        ImGui::Text("LOD %u of %u, %u triangles", sphere.lod, (UINT)sphere.lods.size() - 1,
+            sphere.lods[sphere.lod]->getNumIndices() / 3);
+
+        ImGui::Checkbox("Cluster culling", &clusterCulling_);
+        ImGui::Text("Clusters %u of %u, draws %u", visibleClusters_, (UINT)sphereMeshlets_.GetMeshletCount(),
+            (UINT)sphereRanges_.size());
+
+        ImGui::Checkbox("Object culling", &objectCulling_);
+        ImGui::Text("Objects %u of %u (%.1f us)", (UINT)visibleObjects_.size(), (UINT)objectBounds_.GetCount(),
+            cullMicroseconds_);
+        ImGui::Checkbox("Occlusion culling", &occlusionCulling_);
+        ImGui::Text("Occluded %u by %u occluders, %u triangles (%.1f us)", occludedObjects_, (UINT)occluders_.size(),
+            (UINT)occlusionBuffer_.GetStats().trianglesBinned, occlusionMicroseconds_);
+        ImGui::Checkbox("Instancing", &instancing_);
+        ImGui::Text("Instances %u in %u batches, draws %u", (UINT)instanceBatcher_.GetInstanceCount(),
+            (UINT)instanceBatcher_.GetBatchCount(), (UINT)scenePass_.GetStats().drawCalls);
+
+        if (pickedName_.empty())
+            ImGui::Text("Center ray (click or P): no hit (%.1f us)", pickMicroseconds_);
+        else
+            ImGui::Text("Center ray (click or P): %s, distance %.3f, triangle %u (%.1f us)", pickedName_.c_str(), pickedDistance_,
+                pickedTriangle_, pickMicroseconds_);
+
+        str = "Reference";
+        ImGui::Text(str.c_str());
+        ImGui::SameLine();
+        if (ImGui::Button("Path trace")) {
+            RenderReference();
+        }
+        ImGui::DragInt("Samples per pixel", &referenceSamples_, 1.0f, 1, 4096);
+        if (referenceIndex_ > 0)
+            ImGui::Text("reference_%06u.hdr: %.2f s, %.2f Msamples/s", referenceIndex_ - 1, referenceSeconds_,
+                referenceSamplesPerSecond_);
+
         ImGui::End();
     }
 }
@@ -740,7 +1453,10 @@ bool Renderer::Render() {
     pAnnotation_->BeginEvent(L"Preliminary_preparations");
 #endif
 
-    if (!UpdateScene()) {
+    // Текстуры тонмаппинга пересоздаются только после того, как размер окна установился.
+    UINT frameWidth, frameHeight;
+    if (resizeCoalescer_.Poll(ResizeCoalescer::Clock::now(), frameWidth, frameHeight) &&
+        !SUCCEEDED(toneMapping_.Resize(frameWidth, frameHeight))) {
 #ifdef _DEBUG
         pAnnotation_->EndEvent();
         pAnnotation_->EndEvent();
@@ -748,43 +1464,54 @@ bool Renderer::Render() {
         return false;
     }
 
-    pDeviceContext_->ClearState();
-
-    D3D11_VIEWPORT viewport;
-    viewport.TopLeftX = 0;
-    viewport.TopLeftY = 0;
-    viewport.Width = (FLOAT)width_;
-    viewport.Height = (FLOAT)height_;
-    viewport.MinDepth = 0.0f;
-    viewport.MaxDepth = 1.0f;
-    pDeviceContext_->RSSetViewports(1, &viewport);
+    // Масштаб рендеринга на этот кадр выбирается по времени предыдущего кадра.
+    auto frameTime = std::chrono::steady_clock::now();
+    float frameMs = std::chrono::duration<float, std::milli>(frameTime - lastFrameTime_).count();
+    lastFrameTime_ = frameTime;
+    lightTime_ += min(frameMs, 100.0f) * 1e-3f;
+    toneMapping_.SetRenderScale(dynamicResolutionEnabled_ ? dynamicResolution_.Update(frameMs) : 1.0f);
 
-    D3D11_RECT rect;
-    rect.left = 0;
-    rect.top = 0;
-    rect.right = width_;
-    rect.bottom = height_;
-    pDeviceContext_->RSSetScissorRects(1, &rect);
+    if (traceFramesLeft_ > 0 && !capture_.IsRecording()) {
+        capture_.Start();
+    }
 
-    ID3D11SamplerState* samplers[] = { pSampler_.get() };
-    static const FLOAT backColor[4] = { 0.25f, 0.25f, 0.25f, 1.0f };
+    if (!UpdateScene()) {
+#ifdef _DEBUG
+        pAnnotation_->EndEvent();
+        pAnnotation_->EndEvent();
+#endif
+        return false;
+    }
 
+    // Без тонмаппинга сцена рисуется сразу в back buffer. Цель тонмаппинга пересоздается при смене размера,
+    // дескриптор меняется вместе с ней.
     if (default_) {
+        if (toneMapping_.GetFrameTarget() != pFrameTarget_) {
+            capture_.Release(frameTargetView_);
+            pFrameTarget_ = toneMapping_.GetFrameTarget();
+            frameTargetView_ = backend_.Import(pFrameTarget_);
+        }
         toneMapping_.ClearRenderTarget();
-        toneMapping_.SetRenderTarget();
+        frame_.width = (unsigned)toneMapping_.GetWidth();
+        frame_.height = (unsigned)toneMapping_.GetHeight();
+        frame_.target = frameTargetView_;
+    } else {
+        frame_.width = width_;
+        frame_.height = height_;
+        frame_.target = backBufferView_;
     }
-    else {
-        pDeviceContext_->OMSetRenderTargets(1, &pRenderTargetView_, nullptr);
-        pDeviceContext_->ClearRenderTargetView(pRenderTargetView_, backColor);
-        pDeviceContext_->RSSetViewports(1, &viewport);
+    // Без буфера глубины кадр все равно рисуется, как до его появления.
+    if (FAILED(UpdateDepthTarget())) {
+        capture_.Release(frame_.depthTarget);
+        capture_.Release(depthTexture_);
     }
+    scenePass_.Begin(FrameBackend(), frame_);
 
 #ifdef _DEBUG
     pAnnotation_->EndEvent();
     pAnnotation_->BeginEvent(L"Draw_skybox");
 #endif
 
-    pDeviceContext_->PSSetSamplers(0, 1, samplers);
     RenderSkybox();
 
 #ifdef _DEBUG
@@ -792,7 +1519,6 @@ bool Renderer::Render() {
     pAnnotation_->BeginEvent(L"Draw_sphere");
 #endif
 
-    pDeviceContext_->PSSetSamplers(0, 1, samplers);
     RenderObjects();
 
     if (default_) {
@@ -803,16 +1529,39 @@ bool Renderer::Render() {
 
         toneMapping_.RenderBrightness();
 
-        pDeviceContext_->OMSetRenderTargets(1, &pRenderTargetView_, nullptr);
-        pDeviceContext_->PSSetSamplers(0, 1, samplers);
+        gfx::RenderBackend& backend = FrameBackend();
+        backend.SetRenderTarget(backBufferView_);
+        backend.SetSamplers(gfx::ShaderStage::Pixel, 0, 1, &frame_.sampler);
 
-        pDeviceContext_->ClearRenderTargetView(pRenderTargetView_, backColor);
+        backend.ClearRenderTarget(backBufferView_, frame_.clearColor);
 
-        pDeviceContext_->RSSetViewports(1, &viewport);
+        gfx::Viewport viewport;
+        viewport.width = (float)width_;
+        viewport.height = (float)height_;
+        backend.SetViewport(viewport);
 
         toneMapping_.RenderTonemap();
     }
 
+    if (captureRequested_ || recording_) {
+        CaptureFrame();
+        captureRequested_ = false;
+    }
+    screenCapture_.Update();
+
+    // Тонмаппинг, генерация кубических карт и ImGui работают с контекстом напрямую и в трассу не попадают.
+    if (capture_.IsRecording()) {
+        capture_.EndFrame();
+        if (--traceFramesLeft_ <= 0) {
+            traceFramesLeft_ = 0;
+            capture_.Stop();
+            char name[32];
+            snprintf(name, sizeof(name), "trace_%06u.gfxt", traceIndex_++);
+            capture_.Save(name);
+            traceStats_ = capture_.GetStats();
+        }
+    }
+
 #ifdef _DEBUG
     pAnnotation_->EndEvent();
 #endif
@@ -829,54 +1578,132 @@ bool Renderer::Render() {
 }
 
 void Renderer::RenderSkybox() {
-    ID3D11ShaderResourceView* resources[] = { skybox.texture->getSRV() };
-    pDeviceContext_->PSSetShaderResources(0, 1, resources);
-
-    pDeviceContext_->IASetIndexBuffer(skybox.geometry->getIndexBuffer(), DXGI_FORMAT_R32_UINT, 0);
-    ID3D11Buffer* vertexBuffers[] = { skybox.geometry->getVertexBuffer() };
-    UINT strides[] = { skybox.vertexSize };
-    UINT offsets[] = { 0 };
-    pDeviceContext_->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
-    pDeviceContext_->IASetInputLayout(skybox.IL.get());
-    pDeviceContext_->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    pDeviceContext_->VSSetShader(skybox.VS.get(), nullptr, 0);
-    pDeviceContext_->VSSetConstantBuffers(0, 1, &pSkyboxWorldMatrixBuffer_);
-    pDeviceContext_->VSSetConstantBuffers(1, 1, &pViewMatrixBuffer_);
-    pDeviceContext_->PSSetShader(skybox.PS.get(), nullptr, 0);
-
-    pDeviceContext_->DrawIndexed(skybox.geometry->getNumIndices(), 0, 0);
+    scenePass_.DrawSkybox(FrameBackend(), frame_);
 }
 
+// Рисуются только объекты из visibleObjects_: сфера - видимыми диапазонами выбранного уровня детализации,
+// модели - целиком, экземплярами из UpdateInstances или по одной с обновлением буфера объекта перед каждой.
 void Renderer::RenderObjects() {
-    std::shared_ptr<SimpleTexture> prefilteredText;
-    std::shared_ptr<SimpleTexture> brdfText;
-    pTextureManager_.get("prefiltered", prefilteredText);
-    pTextureManager_.get("brdf", brdfText);
+    objectConstants_.resize(visibleObjects_.size());
+    passObjects_.clear();
+
+    for (size_t v = 0; v < visibleObjects_.size(); v++) {
+        // Переключатель мог измениться после UpdateInstances, решает раскладка кадра.
+        if (visibleObjects_[v] != 0 && instanceBatcher_.IsInstanced(visibleObjects_[v] - 1))
+            continue;
+        WorldMatrixBuffer& constants = objectConstants_[passObjects_.size()];
+        passObjects_.emplace_back();
+        gfx::PassObject& pass = passObjects_.back();
+        pass.constants = &constants;
+        if (visibleObjects_[v] == 0) {
+            constants.worldMatrix = sphere.worldMatrix;
+            constants.color = sphere.color;
+            constants.roughness = sphere.roughness;
+            constants.metalness = sphere.metalness;
+
+            pass.mesh = sphereMesh_;
+            pass.ranges = sphereRanges_.data();
+            pass.rangeCount = sphereRanges_.size();
+            pass.startIndex = sphere.lods[sphere.lod]->getStartIndex();
+            continue;
+        }
 
-    std::shared_ptr<ID3D11SamplerState> avgSample;
-    pSamplerManager_.get("avg", avgSample);
+        size_t i = visibleObjects_[v] - 1;
+        const SimpleObject<Vertex>& model = models_[i];
+        constants.worldMatrix = model.worldMatrix;
+        constants.color = model.color;
+        constants.roughness = model.roughness;
+        constants.metalness = model.metalness;
+
+        pass.mesh = modelMeshes_[i];
+        pass.ranges = &modelRanges_[i];
+        pass.rangeCount = 1;
+        pass.startIndex = 0;
+    }
 
-    ID3D11SamplerState* samplers[] = { avgSample.get() };
-    pDeviceContext_->PSSetSamplers(1, 1, samplers);
+    // Шейдер сферы переключается в UpdateImgui, повторный Import возвращает уже выданный дескриптор.
+    frame_.objectShader = backend_.Import(sphere.PS.get());
+    frame_.objects = passObjects_.data();
+    frame_.objectCount = passObjects_.size();
+    scenePass_.DrawObjects(FrameBackend(), frame_);
+}
 
-    ID3D11ShaderResourceView* resources[] = { sphere.irradianceMap->getSRV(), prefilteredText->getSRV(), brdfText->getSRV() };
-    pDeviceContext_->PSSetShaderResources(0, 3, resources);
+void Renderer::CaptureFrame() {
+    char name[32];
+    snprintf(name, sizeof(name), "frame_%06u", captureIndex_++);
 
-    pDeviceContext_->IASetIndexBuffer(sphere.geometry->getIndexBuffer(), DXGI_FORMAT_R32_UINT, 0);
-    ID3D11Buffer* vertexBuffers[] = { sphere.geometry->getVertexBuffer() };
-    UINT strides[] = { sphere.vertexSize };
-    UINT offsets[] = { 0 };
-    pDeviceContext_->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
-    pDeviceContext_->IASetInputLayout(sphere.IL.get());
-    pDeviceContext_->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    pDeviceContext_->VSSetConstantBuffers(0, 1, &pWorldMatrixBuffer_);
-    pDeviceContext_->VSSetConstantBuffers(1, 1, &pViewMatrixBuffer_);
-    pDeviceContext_->PSSetConstantBuffers(0, 1, &pWorldMatrixBuffer_);
-    pDeviceContext_->PSSetConstantBuffers(1, 1, &pViewMatrixBuffer_);
-    pDeviceContext_->VSSetShader(sphere.VS.get(), nullptr, 0);
-    pDeviceContext_->PSSetShader(sphere.PS.get(), nullptr, 0);
+    ID3D11Texture2D* pBackBuffer = nullptr;
+    if (SUCCEEDED(pSwapChain_->GetBuffer(0, __uuidof(ID3D11Texture2D), (LPVOID*)&pBackBuffer))) {
+        screenCapture_.Capture(pBackBuffer, width_, height_, name);
+    }
+    SAFE_RELEASE(pBackBuffer);
 
-    pDeviceContext_->DrawIndexed(sphere.geometry->getNumIndices(), 0, 0);
+    if (default_) {
+        screenCapture_.Capture(toneMapping_.GetFrameTexture(), toneMapping_.GetWidth(), toneMapping_.GetHeight(),
+            std::string(name) + "_hdr");
+    }
+}
+
+// Эталон текущего вида: та же сфера, источники и окружение, посчитанные трассировкой путей на пуле потоков.
+// Кадр блокируется на время рендера, результат пишется в reference_XXXXXX.hdr без тонмаппинга.
+HRESULT Renderer::RenderReference() {
+    if (referenceEnvironment_.IsEmpty()) {
+        int envWidth = 0, envHeight = 0, components = 0;
+        float* data = stbi_loadf("textures/hdr_text.hdr", &envWidth, &envHeight, &components, 4);
+        if (!data)
+            return E_FAIL;
+        referenceEnvironment_.Init(data, (unsigned)envWidth, (unsigned)envHeight);
+        stbi_image_free(data);
+    }
+
+    reference::Scene scene;
+    reference::Sphere referenceSphere;
+    referenceSphere.material.color[0] = sphere.color.x;
+    referenceSphere.material.color[1] = sphere.color.y;
+    referenceSphere.material.color[2] = sphere.color.z;
+    referenceSphere.material.roughness = sphere.roughness;
+    referenceSphere.material.metalness = sphere.metalness;
+    scene.spheres.push_back(referenceSphere);
+    // Источники - в положении и с яркостью текущего кадра.
+    for (uint32_t i = 0; i < lights_.GetCount(); i++) {
+        lighting::LightDesc light;
+        lights_.Get(i, light);
+        scene.lights.push_back({ { lights_.GetX()[i], lights_.GetY()[i], lights_.GetZ()[i] },
+            { light.color[0], light.color[1], light.color[2] }, lights_.GetIntensity()[i] });
+    }
+    scene.environment = &referenceEnvironment_;
+
+    // Строки обращенной матрицы вида - оси и положение камеры в мире.
+    XMFLOAT4X4 camera;
+    XMStoreFloat4x4(&camera, XMMatrixInverse(nullptr, pCamera_->GetViewMatrix()));
+    for (int k = 0; k < 3; k++) {
+        scene.view.right[k] = camera.m[0][k];
+        scene.view.up[k] = camera.m[1][k];
+        scene.view.forward[k] = camera.m[2][k];
+        scene.view.position[k] = camera.m[3][k];
+    }
+    scene.view.fovY = XM_PI / 3;
+
+    reference::PathTracer tracer;
+    tracer.Reset(width_, height_);
+    // Накопление прогрессивное: разбиение на проходы по 8 отсчетов не меняет результат.
+    double seconds = 0.0;
+    while (tracer.GetSampleCount() < (UINT)referenceSamples_) {
+        tracer.Render(scene, min((UINT)referenceSamples_ - tracer.GetSampleCount(), 8u), &threadPool_);
+        seconds += tracer.GetLastStats().seconds;
+    }
+    referenceSeconds_ = (float)seconds;
+    referenceSamplesPerSecond_ = (float)((double)width_ * height_ * referenceSamples_ / seconds * 1e-6);
+
+    std::vector<float> image;
+    tracer.Resolve(image);
+    std::vector<uint8_t> encoded;
+    char name[32];
+    snprintf(name, sizeof(name), "reference_%06u.hdr", referenceIndex_++);
+    if (!encoder::EncodeHDR(image.data(), width_, height_, width_ * 4 * sizeof(float), PixelFormat::RGBA32F, encoded) ||
+        !encoder::WriteFile(name, encoded))
+        return E_FAIL;
+    return S_OK;
 }
 
 bool Renderer::Resize(UINT width, UINT height) {
@@ -888,8 +1715,7 @@ bool Renderer::Resize(UINT width, UINT height) {
 
     ResizeSkybox();
 
-    if (!SUCCEEDED(toneMapping_.Resize(width_, height_)))
-        return false;
+    resizeCoalescer_.Request(width_, height_, ResizeCoalescer::Clock::now());
 
     return true;
 }
@@ -898,6 +1724,7 @@ bool Renderer::ResizeSwapChain() {
     if (pSwapChain_ == nullptr)
         return false;
 
+    capture_.Release(backBufferView_);
     SAFE_RELEASE(pRenderTargetView_);
 
     auto result = pSwapChain_->ResizeBuffers(2, width_, height_, DXGI_FORMAT_R8G8B8A8_UNORM, 0);
@@ -919,11 +1746,12 @@ bool Renderer::ResizeSwapChain() {
     if (!SUCCEEDED(result))
         return false;
 
+    backBufferView_ = backend_.Import(pRenderTargetView_);
     return true;
 }
 
 void Renderer::ResizeSkybox() {
-    float n = 0.01f;
+    float n = nearPlane;
     float fov = XM_PI / 3;
     float halfW = tanf(fov / 2) * n;
     float halfH = height_ / float(width_) * halfW;
@@ -938,11 +1766,32 @@ void Renderer::Cleanup() {
     if (pDeviceContext_ != nullptr)
         pDeviceContext_->ClearState();
 
+    capture_.Stop();
+    backend_.Cleanup();
+    frame_ = gfx::SceneFrame();
+    backBufferView_ = gfx::RenderTargetViewHandle();
+    pFrameTarget_ = nullptr;
+    frameTargetView_ = gfx::RenderTargetViewHandle();
+    modelMeshes_.clear();
+    modelRanges_.clear();
+    passObjects_.clear();
+    instancedMeshes_.clear();
+    instanceBatcher_.Clear();
+
     pSampler_.reset();
     pDeviceContext_.reset();
     skybox.Cleanup();
     sphere.Cleanup();
+    for (SimpleObject<Vertex>& model : models_) {
+        model.Cleanup();
+    }
+    models_.clear();
+    modelBvhs_.clear();
+    objectBounds_.Clear();
+    visibleObjects_.clear();
+    occluders_.clear();
     toneMapping_.Cleanup();
+    screenCapture_.Cleanup();
     pGeometryManager_.Cleanup();
     pVSManager_.Cleanup();
     pILManager_.Cleanup();
@@ -957,9 +1806,18 @@ void Renderer::Cleanup() {
     SAFE_RELEASE(pSelectedAdapter_);
 
     SAFE_RELEASE(pRasterizerState_);
+    SAFE_RELEASE(pModelRasterizerState_);
     SAFE_RELEASE(pViewMatrixBuffer_);
+    SAFE_RELEASE(pQuantizationBuffer_);
     SAFE_RELEASE(pWorldMatrixBuffer_);
     SAFE_RELEASE(pSkyboxWorldMatrixBuffer_);
+    for (int i = 0; i < 3; i++) {
+        SAFE_RELEASE(pLightBuffers_[i]);
+        SAFE_RELEASE(pLightViews_[i]);
+        lightBufferCapacity_[i] = 0;
+    }
+    SAFE_RELEASE(pInstanceBuffer_);
+    instanceCapacity_ = 0;
     
     if (pCamera_) {
         delete pCamera_;
@@ -1,4 +1,4 @@
-#pragma once
+﻿#pragma once
 
 #include "framework.h"
 #include "Camera.h"
@@ -7,10 +7,28 @@
 #include "SimpleObject.h"
 #include "ToneMapping.h"
 #include "CubemapGenerator.h"
+#include "ResizeCoalescer.h"
+#include "ScreenCapture.h"
+#include "DynamicResolution.h"
+#include "MeshGenerator.h"
+#include "MeshOptimizer.h"
+#include "VertexQuantization.h"
+#include "MeshSimplifier.h"
+#include "Meshlets.h"
+#include "GltfLoader.h"
+#include "Bvh.h"
+#include "ThreadPool.h"
+#include "PathTracer.h"
+#include "D3D11Backend.h"
+#include "ScenePass.h"
+#include "CommandTrace.h"
+#include "LightStorage.h"
+#include "ObjectCulling.h"
+#include "OcclusionCulling.h"
+#include "ObjectInstancing.h"
 #include <vector>
 #include <string>
-
-#define MAX_LIGHT 10
+#include <chrono>
 
 struct WorldMatrixBuffer {
     XMMATRIX worldMatrix;
@@ -24,22 +42,27 @@ struct SkyboxWorldMatrixBuffer {
     XMFLOAT4 size;
 };
 
-struct Light {
-    XMFLOAT4 pos;
-    XMFLOAT4 color;
+struct QuantizationBuffer {
+    XMFLOAT4 positionScale;
+    XMFLOAT4 positionOffset;
 };
 
+// Источники не лежат в константном буфере: их данные и кластерные списки - буферы t3-t5 (LightCalc.h).
 struct ViewMatrixBuffer {
     XMMATRIX viewProjectionMatrix;
     XMFLOAT4 cameraPos;
-    XMINT4 lightParams;
-    Light lights[MAX_LIGHT];
+    XMINT4 lightParams;         // число источников, размер сетки кластеров
+    XMFLOAT4 clusterParams;     // срез по глубине: scale, bias
 };
 
 class Renderer {
 public:
     static constexpr UINT defaultWidth = 1280;
     static constexpr UINT defaultHeight = 720;
+    static constexpr UINT maxLodCount = 6;
+    static constexpr const char* modelPath = "models/scene.glb";
+    // Освещенность, ниже которой источник не учитывается; задает радиусы влияния для кластеров.
+    static constexpr float lightCutoff = 0.01f;
 
     static Renderer& GetInstance();
     Renderer(const Renderer&) = delete;
@@ -55,25 +78,43 @@ public:
 private:
     Renderer();
 
+    void PrepareSphere();
     HRESULT LoadGeometry();
     HRESULT LoadShaders();
     HRESULT LoadTextures();
     HRESULT CreateSamplers();
     HRESULT InitSkybox();
     HRESULT InitObjects();
+    HRESULT LoadModels();
+    HRESULT BuildBvh(const std::shared_ptr<Geometry>& geometry, mesh::Bvh& bvh);
+    HRESULT InitObjectBounds();
+    void CullOccludedObjects(const XMMATRIX& view, const XMMATRIX& projection);
     HRESULT CreateDevice();
     HRESULT CreateSwapChain(HWND hWnd);
     HRESULT InitImgui(HWND hWnd);
     HRESULT CreateVMBuffer();
     HRESULT CreateWMBuffer();
     HRESULT CreateSWMBuffer();
+    HRESULT InitBackend();
+    HRESULT ReserveLightBuffer(UINT index, UINT elements);
+    HRESULT UpdateLights(const XMMATRIX& view);
+    HRESULT ReserveInstanceBuffer(UINT instances);
+    HRESULT UpdateInstances();
+    HRESULT UpdateDepthTarget();
     void InputHandler();
     bool UpdateScene();
+    void PickCenter(const XMMATRIX& view, const XMFLOAT3& cameraPos);
     void UpdateImgui();
     void RenderSkybox();
     void RenderObjects();
+    // Вызовы кадра: через capture_ во время записи трассы, иначе прямо в backend_.
+    gfx::RenderBackend& FrameBackend() {
+        return capture_.IsRecording() ? static_cast<gfx::RenderBackend&>(capture_) : backend_;
+    };
     bool ResizeSwapChain();
     void ResizeSkybox();
+    void CaptureFrame();
+    HRESULT RenderReference();
 
     std::shared_ptr<ID3D11Device> pDevice_;
     std::shared_ptr<ID3D11DeviceContext> pDeviceContext_;
@@ -84,6 +125,7 @@ private:
     IDXGISwapChain* pSwapChain_ = nullptr;
     ID3D11RenderTargetView* pRenderTargetView_ = nullptr;
     ID3D11RasterizerState* pRasterizerState_ = nullptr;
+    ID3D11RasterizerState* pModelRasterizerState_ = nullptr;
 
     SimpleGeometryManager pGeometryManager_;
     SimpleILManager pILManager_;
@@ -93,14 +135,18 @@ private:
     SimpleTextureManager pTextureManager_;
 
     static const D3D11_INPUT_ELEMENT_DESC SimpleVertexDesc[];
+    static const D3D11_INPUT_ELEMENT_DESC QuantizedVertexDesc[];
     static const D3D11_INPUT_ELEMENT_DESC VertexDesc[];
+    static const D3D11_INPUT_ELEMENT_DESC InstancedVertexDesc[];
 
-    SimpleObject<Vertex> sphere;
+    SimpleObject<mesh::QuantizedVertex8> sphere;
     Skybox skybox;
+    std::vector<SimpleObject<Vertex>> models_;
 
     ID3D11Buffer* pWorldMatrixBuffer_ = nullptr;
     ID3D11Buffer* pSkyboxWorldMatrixBuffer_ = nullptr;
     ID3D11Buffer* pViewMatrixBuffer_ = nullptr;
+    ID3D11Buffer* pQuantizationBuffer_ = nullptr;
 #ifdef _DEBUG
     ID3DUserDefinedAnnotation* pAnnotation_ = nullptr;
 #endif // _DEBUG
@@ -108,11 +154,114 @@ private:
     Camera* pCamera_ = nullptr;
     Input* pInput_ = nullptr;
 
-    std::vector<Light> lights_;
+    lighting::LightStorage lights_;
+    float lightTime_ = 0.0f;                        // время анимации источников, секунды
+    std::vector<lighting::LightRange> lightRanges_;
+    std::vector<gfx::BufferRange> lightUploads_;
+    lighting::LightClusterer lightClusterer_;
+    lighting::ClusterGrid lightGrid_;
+    // t3 - Usage::Default, обновляются только изменившиеся источники; t4, t5 - Usage::Dynamic. Растут по необходимости.
+    ID3D11Buffer* pLightBuffers_[3] = {};
+    ID3D11ShaderResourceView* pLightViews_[3] = {};
+    UINT lightBufferCapacity_[3] = {};
+    int lightScatterCount_ = 256;
+    bool lightScatterAnimated_ = true;
 
     UINT width_;
     UINT height_;
 
     ToneMapping toneMapping_;
+    ResizeCoalescer resizeCoalescer_;
+    ScreenCapture screenCapture_;
     bool default_ = true;
+    bool captureRequested_ = false;
+    bool recording_ = false;
+    UINT captureIndex_ = 0;
+
+    DynamicResolution dynamicResolution_;
+    bool dynamicResolutionEnabled_ = false;
+    std::chrono::steady_clock::time_point lastFrameTime_;
+
+    float lodPixelError_ = 1.0f;
+
+    mesh::MeshletCuller sphereMeshlets_;
+    std::vector<mesh::IndexRange> sphereRanges_;
+    bool clusterCulling_ = true;
+    UINT visibleClusters_ = 0;
+
+    // Сфера после оптимизации, упрощения и сжатия: готовится в пуле, пока создается устройство и компилируются
+    // шейдеры, LoadGeometry загружает ее в буферы и освобождает. Объявлена до пула, чтобы пережить его потоки.
+    struct SphereData {
+        std::vector<uint8_t> vertices;              // Vertex, несжатые копии для запросов на CPU
+        std::vector<mesh::QuantizedVertex8> quantized;
+        mesh::Bounds bounds;
+        std::vector<UINT> indices;                  // сфера, скайбокс, упрощенные уровни
+        std::vector<UINT> lodStarts;
+        std::vector<UINT> lodCounts;
+        std::vector<float> lodErrors;
+        std::vector<mesh::Meshlet> meshlets;
+    };
+    SphereData sphereData_;
+
+    ThreadPool threadPool_;
+    mesh::Bvh sphereBvh_;
+    std::vector<std::shared_ptr<mesh::Bvh>> modelBvhs_;
+    std::string pickedName_;
+    UINT pickedTriangle_ = 0;
+    float pickedDistance_ = 0.0f;
+    float pickMicroseconds_ = 0.0f;
+    bool pickRequested_ = false;
+    XMFLOAT4X4 pickView_ = {};                  // вид, из которого пущен последний луч
+
+    // Границы в мировом пространстве: 0 - сфера, i + 1 - models_[i].
+    culling::ObjectBounds objectBounds_;
+    culling::FrustumCuller objectCuller_;
+    std::vector<uint32_t> visibleObjects_;
+    bool objectCulling_ = true;
+    float cullMicroseconds_ = 0.0f;
+
+    // Заслонители - крупнейшие на экране объекты, прошедшие пирамиду; матрицы и сетки живут до следующего кадра.
+    culling::OcclusionBuffer occlusionBuffer_;
+    std::vector<std::pair<float, uint32_t>> occluderOrder_;    // площадь на экране, номер в visibleObjects_
+    std::vector<culling::OccluderMesh> occluders_;
+    std::vector<XMFLOAT4X4> occluderMatrices_;
+    bool occlusionCulling_ = true;
+    UINT occludedObjects_ = 0;
+    float occlusionMicroseconds_ = 0.0f;
+
+    reference::Environment referenceEnvironment_;
+    int referenceSamples_ = 64;
+    UINT referenceIndex_ = 0;
+    float referenceSeconds_ = 0.0f;
+    float referenceSamplesPerSecond_ = 0.0f;
+
+    gfx::D3D11Backend backend_;
+    // Создание и освобождение ресурсов идут через capture_, вызовы кадра - только во время записи трассы (FrameBackend):
+    // даже без записи обертка добавляет к кадру 5-9% (BackendBenchMain --capture).
+    gfx::CaptureBackend capture_{ backend_ };
+    gfx::ScenePass scenePass_;
+    gfx::SceneFrame frame_;
+    gfx::RenderTargetViewHandle backBufferView_;
+    ID3D11RenderTargetView* pFrameTarget_ = nullptr;
+    gfx::RenderTargetViewHandle frameTargetView_;
+    // Буфер глубины сцены по размеру текстуры frame_.target, пересоздается при смене ее размера.
+    gfx::TextureHandle depthTexture_;
+    int traceFrames_ = 10;
+    int traceFramesLeft_ = 0;
+    UINT traceIndex_ = 0;
+    gfx::CaptureBackend::Stats traceStats_;
+    gfx::MeshBinding sphereMesh_;
+    std::vector<gfx::MeshBinding> modelMeshes_;
+    mesh::IndexRange skyboxRange_ = {};
+    std::vector<mesh::IndexRange> modelRanges_;
+    std::vector<WorldMatrixBuffer> objectConstants_;
+    std::vector<gfx::PassObject> passObjects_;
+
+    // Видимые модели с общей геометрией рисуются экземплярами. Буфер экземпляров - Usage::Dynamic, растет
+    // по необходимости.
+    gfx::InstanceBatcher instanceBatcher_;
+    std::vector<gfx::MeshBinding> instancedMeshes_;
+    ID3D11Buffer* pInstanceBuffer_ = nullptr;
+    UINT instanceCapacity_ = 0;
+    bool instancing_ = true;
 };
\ No newline at end of file
@@ -0,0 +1,37 @@
+#include "ResizeCoalescer.h"
+
+void ResizeCoalescer::Request(unsigned width, unsigned height, Clock::time_point now) {
+    requests_++;
+    if (width == appliedWidth_ && height == appliedHeight_) {
+        pending_ = false;
+        return;
+    }
+    if (!pending_ || width != width_ || height != height_) {
+        width_ = width;
+        height_ = height;
+        lastRequest_ = now;
+    }
+    pending_ = true;
+}
+
+bool ResizeCoalescer::Poll(Clock::time_point now, unsigned& width, unsigned& height) {
+    if (!pending_ || now - lastRequest_ < interval_)
+        return false;
+    return Flush(width, height);
+}
+
+bool ResizeCoalescer::Flush(unsigned& width, unsigned& height) {
+    if (!pending_)
+        return false;
+    pending_ = false;
+    SetApplied(width_, height_);
+    applies_++;
+    width = width_;
+    height = height_;
+    return true;
+}
+
+void ResizeCoalescer::SetApplied(unsigned width, unsigned height) {
+    appliedWidth_ = width;
+    appliedHeight_ = height;
+}
@@ -0,0 +1,54 @@
+﻿#pragma once
+
+#include <chrono>
+
+
+// Откладывает пересоздание ресурсов до тех пор, пока размер окна не перестанет меняться в течение интервала.
+class ResizeCoalescer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ResizeCoalescer(Clock::duration interval = std::chrono::milliseconds(150)) : interval_(interval) {};
+
+    void SetInterval(Clock::duration interval) {
+        interval_ = interval;
+    };
+
+    Clock::duration GetInterval() const {
+        return interval_;
+    };
+
+    void Request(unsigned width, unsigned height, Clock::time_point now);
+
+    // Возвращает true ровно один раз для каждого установившегося размера, отличного от примененного.
+    bool Poll(Clock::time_point now, unsigned& width, unsigned& height);
+
+    // Применить отложенный размер немедленно, не дожидаясь интервала.
+    bool Flush(unsigned& width, unsigned& height);
+
+    // Сообщить о размере, под который ресурсы уже созданы.
+    void SetApplied(unsigned width, unsigned height);
+
+    bool IsPending() const {
+        return pending_;
+    };
+
+    unsigned GetRequestCount() const {
+        return requests_;
+    };
+
+    unsigned GetApplyCount() const {
+        return applies_;
+    };
+
+private:
+    Clock::duration interval_;
+    Clock::time_point lastRequest_;
+    unsigned width_ = 0;
+    unsigned height_ = 0;
+    unsigned appliedWidth_ = 0;
+    unsigned appliedHeight_ = 0;
+    bool pending_ = false;
+    unsigned requests_ = 0;
+    unsigned applies_ = 0;
+};
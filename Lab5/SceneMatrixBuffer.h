@@ -1,11 +1,6 @@
-struct LIGHT {
-    float4 lightPos;
-    float4 lightColor;
-};
-
 cbuffer SceneMatrixBuffer : register (b1) {
     float4x4 viewProjectionMatrix;
     float4 cameraPos;
-    int4 lightParams;
-    LIGHT lights[10];
+    int4 lightParams;       // число источников, кластеров по x, y и глубине
+    float4 clusterParams;   // слой кластеров для глубины w в пространстве камеры: floor(log(w) * x + y)
 };
\ No newline at end of file
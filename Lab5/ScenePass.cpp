@@ -0,0 +1,157 @@
+﻿#include "ScenePass.h"
+#include "ObjectInstancing.h"
+#include <cstring>
+
+
+namespace gfx {
+    bool ScenePass::Upload(RenderBackend& backend, const SceneFrame& frame) {
+        void* data = backend.Map(frame.viewBuffer);
+        if (data == nullptr)
+            return false;
+        memcpy(data, frame.viewConstants, frame.viewConstantsSize);
+        backend.Unmap(frame.viewBuffer);
+
+        for (size_t r = 0; r < frame.lightDataRangeCount; r++) {
+            const BufferRange& range = frame.lightDataRanges[r];
+            backend.UpdateBufferRange(frame.lightBuffers[0], range.offset, (const uint8_t*)frame.lightData[0] + range.offset,
+                range.size);
+        }
+        for (int i = 1; i < 3; i++) {
+            if (frame.lightDataSize[i] == 0)
+                continue;
+            data = backend.Map(frame.lightBuffers[i]);
+            if (data == nullptr)
+                return false;
+            memcpy(data, frame.lightData[i], frame.lightDataSize[i]);
+            backend.Unmap(frame.lightBuffers[i]);
+        }
+
+        if (frame.instanceCount != 0) {
+            data = backend.Map(frame.instanceBuffer);
+            if (data == nullptr)
+                return false;
+            memcpy(data, frame.instances, frame.instanceCount * sizeof(InstanceData));
+            backend.Unmap(frame.instanceBuffer);
+        }
+
+        backend.UpdateBuffer(frame.skyboxBuffer, frame.skyboxConstants, frame.skyboxConstantsSize);
+        return true;
+    }
+
+    void ScenePass::Begin(RenderBackend& backend, const SceneFrame& frame) {
+        backend.ClearState();
+        bound_ = MeshBinding();
+        stats_ = PassStats();
+
+        Viewport viewport;
+        viewport.width = (float)frame.width;
+        viewport.height = (float)frame.height;
+        backend.SetViewport(viewport);
+
+        Rect rect;
+        rect.right = (int)frame.width;
+        rect.bottom = (int)frame.height;
+        backend.SetScissorRect(rect);
+
+        if (frame.target.IsValid()) {
+            backend.SetRenderTarget(frame.target, frame.depthTarget);
+            backend.ClearRenderTarget(frame.target, frame.clearColor);
+            if (frame.depthTarget.IsValid()) {
+                backend.ClearDepthStencil(frame.depthTarget, frame.clearDepth);
+            }
+        }
+    }
+
+    void ScenePass::BindMesh(RenderBackend& backend, const MeshBinding& mesh, bool force) {
+        bool changed = false;
+        if (force || mesh.indexBuffer != bound_.indexBuffer) {
+            backend.SetIndexBuffer(mesh.indexBuffer);
+            changed = true;
+        }
+        if (force || mesh.vertexBuffer != bound_.vertexBuffer || mesh.stride != bound_.stride) {
+            backend.SetVertexBuffer(0, mesh.vertexBuffer, mesh.stride);
+            changed = true;
+        }
+        if (force || mesh.inputLayout != bound_.inputLayout) {
+            backend.SetInputLayout(mesh.inputLayout);
+            changed = true;
+        }
+        if (force || mesh.vertexShader != bound_.vertexShader) {
+            backend.SetVertexShader(mesh.vertexShader);
+            changed = true;
+        }
+        if (mesh.rasterizerState != bound_.rasterizerState) {
+            backend.SetRasterizerState(mesh.rasterizerState);
+            changed = true;
+        }
+        bound_ = mesh;
+        stats_.meshBinds += changed ? 1 : 0;
+    }
+
+    void ScenePass::DrawSkybox(RenderBackend& backend, const SceneFrame& frame) {
+        BufferHandle constantBuffers[] = { frame.skyboxBuffer, frame.viewBuffer, frame.quantizationBuffer };
+        backend.SetSamplers(ShaderStage::Pixel, 0, 1, &frame.sampler);
+        backend.SetShaderResources(ShaderStage::Pixel, 0, 1, &frame.skyboxTexture);
+        BindMesh(backend, frame.skybox.mesh, true);
+        backend.SetDepthStencilState(frame.skyboxDepthState);
+        backend.SetPrimitiveTopology(Topology::TriangleList);
+        backend.SetConstantBuffers(ShaderStage::Vertex, 0, 3, constantBuffers);
+        backend.SetPixelShader(frame.skyboxShader);
+        for (size_t i = 0; i < frame.skybox.rangeCount; i++) {
+            backend.DrawIndexed(frame.skybox.ranges[i].indexCount, frame.skybox.startIndex + frame.skybox.ranges[i].startIndex, 0);
+            stats_.drawCalls++;
+        }
+    }
+
+    void ScenePass::DrawObjects(RenderBackend& backend, const SceneFrame& frame) {
+        if (frame.objectCount == 0 && frame.batchCount == 0)
+            return;
+        BufferHandle constantBuffers[] = { frame.objectBuffer, frame.viewBuffer, frame.quantizationBuffer };
+        backend.SetSamplers(ShaderStage::Pixel, 0, 1, &frame.sampler);
+        backend.SetSamplers(ShaderStage::Pixel, 1, 1, &frame.environmentSampler);
+        backend.SetShaderResources(ShaderStage::Pixel, 0, 3, frame.objectTextures);
+        backend.SetShaderResources(ShaderStage::Pixel, 3, 3, frame.lightViews);
+        backend.SetDepthStencilState(frame.objectDepthState);
+        backend.SetPrimitiveTopology(Topology::TriangleList);
+        backend.SetConstantBuffers(ShaderStage::Vertex, 0, 3, constantBuffers);
+        backend.SetConstantBuffers(ShaderStage::Pixel, 0, 2, constantBuffers);
+        backend.SetPixelShader(frame.objectShader);
+
+        for (size_t i = 0; i < frame.objectCount; i++) {
+            const PassObject& object = frame.objects[i];
+            if (object.constants != nullptr) {
+                backend.UpdateBuffer(frame.objectBuffer, object.constants, frame.objectConstantsSize);
+                stats_.constantUpdates++;
+            }
+            BindMesh(backend, object.mesh, false);
+            for (size_t r = 0; r < object.rangeCount; r++) {
+                backend.DrawIndexed(object.ranges[r].indexCount, object.startIndex + object.ranges[r].startIndex, 0);
+                stats_.drawCalls++;
+            }
+        }
+
+        // Материал и мировая матрица экземпляров - в слоте 1, константы объекта не нужны.
+        if (frame.batchCount != 0) {
+            backend.SetVertexBuffer(1, frame.instanceBuffer, sizeof(InstanceData));
+        }
+        for (size_t i = 0; i < frame.batchCount; i++) {
+            const InstanceBatch& batch = frame.batches[i];
+            BindMesh(backend, batch.mesh, false);
+            for (size_t r = 0; r < batch.rangeCount; r++) {
+                backend.DrawIndexedInstanced(batch.ranges[r].indexCount, batch.instanceCount,
+                    batch.startIndex + batch.ranges[r].startIndex, 0, batch.firstInstance);
+                stats_.drawCalls++;
+                stats_.instances += batch.instanceCount;
+            }
+        }
+
+        // Следующие проходы (тонмаппинг, ImGui) рассчитывают на состояния растеризатора и глубины по умолчанию.
+        if (bound_.rasterizerState.IsValid()) {
+            backend.SetRasterizerState(RasterizerStateHandle());
+            bound_.rasterizerState = RasterizerStateHandle();
+        }
+        if (frame.objectDepthState.IsValid()) {
+            backend.SetDepthStencilState(DepthStencilStateHandle());
+        }
+    }
+}
@@ -0,0 +1,121 @@
+﻿#pragma once
+
+#include "RenderBackend.h"
+#include "Meshlets.h"
+#include <cstddef>
+
+
+namespace gfx {
+    struct InstanceData;
+    struct InstanceBatch;
+
+    // Буферы и шейдеры, общие для всех диапазонов объекта.
+    struct MeshBinding {
+        BufferHandle vertexBuffer;
+        BufferHandle indexBuffer;
+        unsigned stride = 0;
+        InputLayoutHandle inputLayout;
+        VertexShaderHandle vertexShader;
+        RasterizerStateHandle rasterizerState;      // пустой - состояние по умолчанию
+    };
+
+    struct PassObject {
+        MeshBinding mesh;
+        const mesh::IndexRange* ranges = nullptr;
+        size_t rangeCount = 0;
+        uint32_t startIndex = 0;                    // прибавляется к началу каждого диапазона
+        const void* constants = nullptr;            // SceneFrame::objectConstantsSize байт, nullptr - буфер не обновляется
+    };
+
+    // Байты offset .. offset + size - 1 буфера.
+    struct BufferRange {
+        size_t offset;
+        size_t size;
+    };
+
+    // Кадр Renderer: константные буферы b0 - объект, b1 - вид и источники, b2 - квантование, самплер s0 общий.
+    // Сначала рисуется скайбокс, затем объекты одним пиксельным шейдером с картами освещения t0-t2, буферами
+    // источников t3-t5 и самплером s1. Проекция с обратным Z: буфер глубины очищается нулем (дальняя плоскость),
+    // объекты проверяются по GREATER.
+    struct SceneFrame {
+        unsigned width = 0;
+        unsigned height = 0;
+        RenderTargetViewHandle target;              // пустой - цель задает вызывающий после Begin
+        float clearColor[4] = { 0.25f, 0.25f, 0.25f, 1.0f };
+        DepthStencilViewHandle depthTarget;         // размер текстуры target, пустой - без глубины
+        float clearDepth = 0.0f;
+        DepthStencilStateHandle skyboxDepthState;   // без проверки и записи
+        DepthStencilStateHandle objectDepthState;   // GREATER с записью
+
+        BufferHandle objectBuffer;
+        BufferHandle skyboxBuffer;
+        BufferHandle viewBuffer;                    // Usage::Dynamic
+        BufferHandle quantizationBuffer;
+        const void* viewConstants = nullptr;
+        size_t viewConstantsSize = 0;
+        const void* skyboxConstants = nullptr;
+        size_t skyboxConstantsSize = 0;
+        size_t objectConstantsSize = 0;
+        // Данные источников, индексы и списки кластеров (LightCalc.h). Данные источников - Usage::Default,
+        // обновляются участки lightDataRanges из lightData[0]; остальные - Usage::Dynamic, буфер с размером 0
+        // не обновляется.
+        BufferHandle lightBuffers[3];
+        ShaderResourceViewHandle lightViews[3];
+        const void* lightData[3] = {};
+        size_t lightDataSize[3] = {};
+        const BufferRange* lightDataRanges = nullptr;
+        size_t lightDataRangeCount = 0;
+
+        SamplerHandle sampler;
+        SamplerHandle environmentSampler;
+
+        PassObject skybox;
+        PixelShaderHandle skyboxShader;
+        ShaderResourceViewHandle skyboxTexture;
+
+        PixelShaderHandle objectShader;
+        ShaderResourceViewHandle objectTextures[3];     // irradiance, prefiltered, brdf
+        const PassObject* objects = nullptr;
+        size_t objectCount = 0;
+        // Группы экземпляров (ObjectInstancing.h) рисуются после objects. Данные экземпляров копируются в
+        // instanceBuffer (Usage::Dynamic, не меньше instanceCount экземпляров) и привязываются к слоту 1.
+        BufferHandle instanceBuffer;
+        const InstanceData* instances = nullptr;
+        size_t instanceCount = 0;
+        const InstanceBatch* batches = nullptr;
+        size_t batchCount = 0;
+    };
+
+    struct PassStats {
+        size_t drawCalls = 0;
+        size_t meshBinds = 0;           // объекты, для которых менялась хотя бы одна привязка геометрии
+        size_t constantUpdates = 0;
+        size_t instances = 0;           // экземпляров в вызовах DrawIndexedInstanced
+    };
+
+    // Запись кадра Renderer через RenderBackend. Привязки геометрии подряд идущих объектов с одинаковыми
+    // буферами и шейдерами не повторяются.
+    class ScenePass {
+    public:
+        // Константы вида, буферы источников и экземпляры через Map, скайбокс через UpdateBuffer. false, если Map
+        // не удался.
+        static bool Upload(RenderBackend& backend, const SceneFrame& frame);
+
+        // Сброс состояния, область вывода и ножницы на весь кадр; если задана цель - привязка и очистка цели
+        // и буфера глубины.
+        void Begin(RenderBackend& backend, const SceneFrame& frame);
+        void DrawSkybox(RenderBackend& backend, const SceneFrame& frame);
+        // Оставляет состояния растеризатора и глубины по умолчанию.
+        void DrawObjects(RenderBackend& backend, const SceneFrame& frame);
+
+        const PassStats& GetStats() const {
+            return stats_;
+        };
+
+    private:
+        void BindMesh(RenderBackend& backend, const MeshBinding& mesh, bool force);
+
+        MeshBinding bound_;
+        PassStats stats_;
+    };
+}
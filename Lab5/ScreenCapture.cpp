@@ -0,0 +1,142 @@
+﻿#include "ScreenCapture.h"
+
+HRESULT ScreenCapture::Init(std::shared_ptr<ID3D11Device> device, std::shared_ptr<ID3D11DeviceContext> deviceContext,
+                            const std::wstring& directory) {
+    device_ = device;
+    deviceContext_ = deviceContext;
+    queue_.reset(new CaptureQueue());
+    directory_ = directory;
+    directoryPath_.clear();
+    return S_OK;
+}
+
+bool ScreenCapture::GetPixelFormat(DXGI_FORMAT format, PixelFormat& pixelFormat) {
+    switch (format) {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+        pixelFormat = PixelFormat::RGBA8;
+        return true;
+    case DXGI_FORMAT_R16G16B16A16_FLOAT:
+        pixelFormat = PixelFormat::RGBA16F;
+        return true;
+    case DXGI_FORMAT_R32G32B32A32_FLOAT:
+        pixelFormat = PixelFormat::RGBA32F;
+        return true;
+    default:
+        return false;
+    }
+}
+
+HRESULT ScreenCapture::PrepareSlot(Slot& slot, UINT width, UINT height, DXGI_FORMAT format) {
+    if (slot.staging != nullptr && slot.width == width && slot.height == height && slot.format == format)
+        return S_OK;
+
+    SAFE_RELEASE(slot.staging);
+
+    D3D11_TEXTURE2D_DESC textureDesc = {};
+    textureDesc.Width = width;
+    textureDesc.Height = height;
+    textureDesc.MipLevels = 1;
+    textureDesc.ArraySize = 1;
+    textureDesc.Format = format;
+    textureDesc.SampleDesc.Count = 1;
+    textureDesc.Usage = D3D11_USAGE_STAGING;
+    textureDesc.BindFlags = 0;
+    textureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    textureDesc.MiscFlags = 0;
+
+    HRESULT result = device_->CreateTexture2D(&textureDesc, nullptr, &slot.staging);
+    if (SUCCEEDED(result)) {
+        slot.width = width;
+        slot.height = height;
+        slot.format = format;
+    }
+    return result;
+}
+
+HRESULT ScreenCapture::Capture(ID3D11Texture2D* source, UINT width, UINT height, const std::string& name) {
+    if (source == nullptr || !queue_)
+        return E_FAIL;
+
+    D3D11_TEXTURE2D_DESC sourceDesc;
+    source->GetDesc(&sourceDesc);
+    PixelFormat pixelFormat;
+    if (!GetPixelFormat(sourceDesc.Format, pixelFormat))
+        return E_FAIL;
+
+    width = min(width, sourceDesc.Width);
+    height = min(height, sourceDesc.Height);
+
+    if (directoryPath_.empty()) {
+        if (!CreateDirectoryW(directory_.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS) {
+            OutputDebugStringA("ScreenCapture: cannot create the capture directory, frame is not saved\n");
+            return E_FAIL;
+        }
+        directoryPath_.assign(directory_.begin(), directory_.end());
+    }
+
+    Slot& slot = slots_[next_];
+    if (slot.busy) {
+        dropped_++;
+        return S_FALSE;
+    }
+
+    HRESULT result = PrepareSlot(slot, width, height, sourceDesc.Format);
+    if (SUCCEEDED(result)) {
+        D3D11_BOX box = { 0, 0, 0, width, height, 1 };
+        deviceContext_->CopySubresourceRegion(slot.staging, 0, 0, 0, 0, source, 0, &box);
+        slot.busy = true;
+        slot.path = directoryPath_ + "/" + name;
+        next_ = (next_ + 1) % ringSize;
+    }
+    return result;
+}
+
+void ScreenCapture::Update() {
+    if (!queue_)
+        return;
+
+    // Слоты проверяются в порядке постановки, чтобы кадры уходили на кодирование по очереди.
+    for (UINT i = 0; i < ringSize; i++) {
+        Slot& slot = slots_[(next_ + i) % ringSize];
+        if (!slot.busy)
+            continue;
+
+        D3D11_MAPPED_SUBRESOURCE mapped = {};
+        HRESULT result = deviceContext_->Map(slot.staging, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped);
+        if (result == DXGI_ERROR_WAS_STILL_DRAWING)
+            break;
+
+        slot.busy = false;
+        if (!SUCCEEDED(result))
+            continue;
+
+        PixelFormat pixelFormat;
+        GetPixelFormat(slot.format, pixelFormat);
+        CaptureImage image;
+        if (queue_->Allocate(slot.width, slot.height, pixelFormat, image)) {
+            const uint8_t* src = static_cast<const uint8_t*>(mapped.pData);
+            for (UINT y = 0; y < slot.height; y++) {
+                memcpy(image.pixels.get() + y * image.rowPitch, src + y * (size_t)mapped.RowPitch, image.rowPitch);
+            }
+            deviceContext_->Unmap(slot.staging, 0);
+            queue_->Submit(std::move(image), slot.path);
+        }
+        else {
+            deviceContext_->Unmap(slot.staging, 0);
+        }
+    }
+}
+
+void ScreenCapture::Cleanup() {
+    if (queue_) {
+        queue_->Flush();
+        queue_.reset();
+    }
+    for (auto& slot : slots_) {
+        SAFE_RELEASE(slot.staging);
+        slot.busy = false;
+    }
+    device_.reset();
+    deviceContext_.reset();
+}
@@ -0,0 +1,60 @@
+﻿#pragma once
+
+#include "framework.h"
+#include "CaptureQueue.h"
+#include <memory>
+#include <string>
+
+// Асинхронное чтение текстур с GPU через кольцо staging текстур. Кодирование выполняет CaptureQueue.
+class ScreenCapture {
+    static const UINT ringSize = 6;
+
+    struct Slot {
+        ID3D11Texture2D* staging = nullptr;
+        UINT width = 0;
+        UINT height = 0;
+        DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+        bool busy = false;
+        std::string path;
+    };
+
+public:
+    ScreenCapture() = default;
+
+    // Каталог создается при первом снимке, поэтому недоступный каталог не мешает запуску.
+    HRESULT Init(std::shared_ptr<ID3D11Device> device, std::shared_ptr<ID3D11DeviceContext> deviceContext,
+                 const std::wstring& directory = L"captures");
+
+    // Копирует левый верхний прямоугольник width x height текстуры source в свободную staging текстуру.
+    // Если все staging текстуры заняты, кадр пропускается (S_FALSE). E_FAIL, если каталог не удалось создать.
+    HRESULT Capture(ID3D11Texture2D* source, UINT width, UINT height, const std::string& name);
+
+    // Забирает готовые кадры без ожидания GPU и отдает их на кодирование. Вызывается раз в кадр.
+    void Update();
+
+    void Cleanup();
+
+    CaptureQueue::Stats GetStats() {
+        CaptureQueue::Stats stats = queue_ ? queue_->GetStats() : CaptureQueue::Stats();
+        stats.dropped += dropped_;
+        return stats;
+    };
+
+    ~ScreenCapture() {
+        Cleanup();
+    };
+
+private:
+    HRESULT PrepareSlot(Slot& slot, UINT width, UINT height, DXGI_FORMAT format);
+    static bool GetPixelFormat(DXGI_FORMAT format, PixelFormat& pixelFormat);
+
+    std::shared_ptr<ID3D11Device> device_;
+    std::shared_ptr<ID3D11DeviceContext> deviceContext_;
+    std::unique_ptr<CaptureQueue> queue_;
+    std::wstring directory_;
+    std::string directoryPath_;         // пустой, пока каталог не создан
+
+    Slot slots_[ringSize];
+    UINT next_ = 0;
+    size_t dropped_ = 0;
+};
@@ -0,0 +1,1176 @@
+﻿#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SHADER_MATH_SSE
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define SHADER_MATH_NEON
+#endif
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SHADER_MATH_AVX
+#endif
+
+// windows.h определяет min и max макросами.
+#pragma push_macro("min")
+#pragma push_macro("max")
+#undef min
+#undef max
+
+
+// Типы и функции HLSL для переноса шейдеров на CPU без изменения формул: float2/3/4, int4, float4x4,
+// перестановки компонент (v.xzy() вместо v.xzy), saturate, lerp, reflect, mul в обоих порядках.
+//
+// Компоненты векторов - "дорожки": float (один вызов шейдера), floatx4 (SSE или NEON) или floatx8 (AVX, иначе
+// два floatx4). Вектор из дорожек - структура массивов, каждая дорожка - отдельный вызов шейдера, поэтому
+// шаблонная функция шейдера работает и на скалярах, и на 4 или 8 пикселях сразу. float3x4 и float3x8 - это
+// float3 на 4 и 8 дорожек, а не матрицы, как в HLSL. Сравнения дорожек возвращают маску (для float - bool),
+// ветвления заменяются select(маска, a, b), а lanemask переводит маску в биты для обхода дорожек.
+namespace hlsl {
+    // ---- Скаляры ----
+
+    inline float min(float a, float b) {
+        return a < b ? a : b;
+    }
+
+    inline float max(float a, float b) {
+        return a > b ? a : b;
+    }
+
+    inline int32_t min(int32_t a, int32_t b) {
+        return a < b ? a : b;
+    }
+
+    inline int32_t max(int32_t a, int32_t b) {
+        return a > b ? a : b;
+    }
+
+    inline float abs(float x) {
+        return std::fabs(x);
+    }
+
+    inline int32_t abs(int32_t x) {
+        return x < 0 ? -x : x;
+    }
+
+    inline float sqrt(float x) {
+        return std::sqrt(x);
+    }
+
+    inline float rsqrt(float x) {
+        return 1.0f / std::sqrt(x);
+    }
+
+    inline float rcp(float x) {
+        return 1.0f / x;
+    }
+
+    inline float floor(float x) {
+        return std::floor(x);
+    }
+
+    inline float select(bool mask, float a, float b) {
+        return mask ? a : b;
+    }
+
+    inline bool any(bool mask) {
+        return mask;
+    }
+
+    inline bool all(bool mask) {
+        return mask;
+    }
+
+    // Не из HLSL: бит i - дорожка i маски сравнения.
+    inline unsigned lanemask(bool mask) {
+        return mask ? 1u : 0u;
+    }
+
+    namespace detail {
+        inline uint32_t Bits(float value) {
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+
+        inline float FromBits(uint32_t bits) {
+            float value;
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+    }
+
+    // ---- floatx4 ----
+
+    struct floatx4 {
+#if defined(SHADER_MATH_SSE)
+        __m128 v;
+
+        floatx4() = default;
+        floatx4(float s) : v(_mm_set1_ps(s)) {};
+        explicit floatx4(__m128 value) : v(value) {};
+
+        static floatx4 Load(const float* p) {
+            return floatx4(_mm_loadu_ps(p));
+        };
+
+        void Store(float* p) const {
+            _mm_storeu_ps(p, v);
+        };
+#elif defined(SHADER_MATH_NEON)
+        float32x4_t v;
+
+        floatx4() = default;
+        floatx4(float s) : v(vdupq_n_f32(s)) {};
+        explicit floatx4(float32x4_t value) : v(value) {};
+
+        static floatx4 Load(const float* p) {
+            return floatx4(vld1q_f32(p));
+        };
+
+        void Store(float* p) const {
+            vst1q_f32(p, v);
+        };
+#else
+        float v[4];
+
+        floatx4() = default;
+        floatx4(float s) : v{ s, s, s, s } {};
+
+        static floatx4 Load(const float* p) {
+            floatx4 r;
+            memcpy(r.v, p, sizeof(r.v));
+            return r;
+        };
+
+        void Store(float* p) const {
+            memcpy(p, v, sizeof(v));
+        };
+#endif
+
+        float Lane(int i) const {
+            float lanes[4];
+            Store(lanes);
+            return lanes[i];
+        };
+    };
+
+#if defined(SHADER_MATH_SSE)
+    inline floatx4 operator+(floatx4 a, floatx4 b) { return floatx4(_mm_add_ps(a.v, b.v)); }
+    inline floatx4 operator-(floatx4 a, floatx4 b) { return floatx4(_mm_sub_ps(a.v, b.v)); }
+    inline floatx4 operator*(floatx4 a, floatx4 b) { return floatx4(_mm_mul_ps(a.v, b.v)); }
+    inline floatx4 operator/(floatx4 a, floatx4 b) { return floatx4(_mm_div_ps(a.v, b.v)); }
+    inline floatx4 operator-(floatx4 a) { return floatx4(_mm_xor_ps(a.v, _mm_set1_ps(-0.0f))); }
+    inline floatx4 operator&(floatx4 a, floatx4 b) { return floatx4(_mm_and_ps(a.v, b.v)); }
+    inline floatx4 operator|(floatx4 a, floatx4 b) { return floatx4(_mm_or_ps(a.v, b.v)); }
+    inline floatx4 operator^(floatx4 a, floatx4 b) { return floatx4(_mm_xor_ps(a.v, b.v)); }
+    inline floatx4 operator<(floatx4 a, floatx4 b) { return floatx4(_mm_cmplt_ps(a.v, b.v)); }
+    inline floatx4 operator<=(floatx4 a, floatx4 b) { return floatx4(_mm_cmple_ps(a.v, b.v)); }
+    inline floatx4 operator>(floatx4 a, floatx4 b) { return floatx4(_mm_cmpgt_ps(a.v, b.v)); }
+    inline floatx4 operator>=(floatx4 a, floatx4 b) { return floatx4(_mm_cmpge_ps(a.v, b.v)); }
+    inline floatx4 operator==(floatx4 a, floatx4 b) { return floatx4(_mm_cmpeq_ps(a.v, b.v)); }
+    inline floatx4 operator!=(floatx4 a, floatx4 b) { return floatx4(_mm_cmpneq_ps(a.v, b.v)); }
+    inline floatx4 min(floatx4 a, floatx4 b) { return floatx4(_mm_min_ps(a.v, b.v)); }
+    inline floatx4 max(floatx4 a, floatx4 b) { return floatx4(_mm_max_ps(a.v, b.v)); }
+    inline floatx4 abs(floatx4 a) { return floatx4(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)); }
+    inline floatx4 sqrt(floatx4 a) { return floatx4(_mm_sqrt_ps(a.v)); }
+
+    inline floatx4 select(floatx4 mask, floatx4 a, floatx4 b) {
+        return floatx4(_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)));
+    }
+
+    inline bool any(floatx4 mask) { return _mm_movemask_ps(mask.v) != 0; }
+    inline bool all(floatx4 mask) { return _mm_movemask_ps(mask.v) == 0xF; }
+    inline unsigned lanemask(floatx4 mask) { return (unsigned)_mm_movemask_ps(mask.v); }
+
+    // Оценка 12 бит и шаг Ньютона, ошибка до 2^-22; 0 и бесконечность - как у 1 / sqrt.
+    inline floatx4 rsqrt(floatx4 a) {
+        __m128 y = _mm_rsqrt_ps(a.v);
+        __m128 refined = _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), a.v), _mm_mul_ps(y, y))));
+        __m128 finite = _mm_and_ps(_mm_cmpgt_ps(a.v, _mm_setzero_ps()), _mm_cmplt_ps(a.v, _mm_set1_ps(std::numeric_limits<float>::infinity())));
+        return floatx4(_mm_or_ps(_mm_and_ps(finite, refined), _mm_andnot_ps(finite, y)));
+    }
+
+    // SSE2 без округления вниз: усечение и поправка для отрицательных; от 2^23 числа целые.
+    inline floatx4 floor(floatx4 a) {
+        __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+        __m128 floored = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, a.v), _mm_set1_ps(1.0f)));
+        __m128 small = _mm_cmplt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v), _mm_set1_ps(8388608.0f));
+        return floatx4(_mm_or_ps(_mm_and_ps(small, floored), _mm_andnot_ps(small, a.v)));
+    }
+#elif defined(SHADER_MATH_NEON)
+    inline floatx4 operator+(floatx4 a, floatx4 b) { return floatx4(vaddq_f32(a.v, b.v)); }
+    inline floatx4 operator-(floatx4 a, floatx4 b) { return floatx4(vsubq_f32(a.v, b.v)); }
+    inline floatx4 operator*(floatx4 a, floatx4 b) { return floatx4(vmulq_f32(a.v, b.v)); }
+    inline floatx4 operator/(floatx4 a, floatx4 b) { return floatx4(vdivq_f32(a.v, b.v)); }
+    inline floatx4 operator-(floatx4 a) { return floatx4(vnegq_f32(a.v)); }
+
+    inline floatx4 operator&(floatx4 a, floatx4 b) {
+        return floatx4(vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))));
+    }
+
+    inline floatx4 operator|(floatx4 a, floatx4 b) {
+        return floatx4(vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))));
+    }
+
+    inline floatx4 operator^(floatx4 a, floatx4 b) {
+        return floatx4(vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))));
+    }
+
+    inline floatx4 operator<(floatx4 a, floatx4 b) { return floatx4(vreinterpretq_f32_u32(vcltq_f32(a.v, b.v))); }
+    inline floatx4 operator<=(floatx4 a, floatx4 b) { return floatx4(vreinterpretq_f32_u32(vcleq_f32(a.v, b.v))); }
+    inline floatx4 operator>(floatx4 a, floatx4 b) { return floatx4(vreinterpretq_f32_u32(vcgtq_f32(a.v, b.v))); }
+    inline floatx4 operator>=(floatx4 a, floatx4 b) { return floatx4(vreinterpretq_f32_u32(vcgeq_f32(a.v, b.v))); }
+    inline floatx4 operator==(floatx4 a, floatx4 b) { return floatx4(vreinterpretq_f32_u32(vceqq_f32(a.v, b.v))); }
+    inline floatx4 operator!=(floatx4 a, floatx4 b) { return floatx4(vreinterpretq_f32_u32(vmvnq_u32(vceqq_f32(a.v, b.v)))); }
+    inline floatx4 min(floatx4 a, floatx4 b) { return floatx4(vminq_f32(a.v, b.v)); }
+    inline floatx4 max(floatx4 a, floatx4 b) { return floatx4(vmaxq_f32(a.v, b.v)); }
+    inline floatx4 abs(floatx4 a) { return floatx4(vabsq_f32(a.v)); }
+    inline floatx4 sqrt(floatx4 a) { return floatx4(vsqrtq_f32(a.v)); }
+    inline floatx4 floor(floatx4 a) { return floatx4(vrndmq_f32(a.v)); }
+
+    inline floatx4 select(floatx4 mask, floatx4 a, floatx4 b) {
+        return floatx4(vbslq_f32(vreinterpretq_u32_f32(mask.v), a.v, b.v));
+    }
+
+    inline bool any(floatx4 mask) { return vmaxvq_u32(vreinterpretq_u32_f32(mask.v)) != 0; }
+    inline bool all(floatx4 mask) { return vminvq_u32(vreinterpretq_u32_f32(mask.v)) != 0; }
+
+    inline unsigned lanemask(floatx4 mask) {
+        const uint32x4_t weights = { 1, 2, 4, 8 };
+        return vaddvq_u32(vandq_u32(vreinterpretq_u32_f32(mask.v), weights));
+    }
+
+    // Оценка 8 бит и два шага Ньютона; 0 и бесконечность - как у 1 / sqrt.
+    inline floatx4 rsqrt(floatx4 a) {
+        float32x4_t y = vrsqrteq_f32(a.v);
+        float32x4_t refined = vmulq_f32(y, vrsqrtsq_f32(vmulq_f32(a.v, y), y));
+        refined = vmulq_f32(refined, vrsqrtsq_f32(vmulq_f32(a.v, refined), refined));
+        uint32x4_t finite = vandq_u32(vcgtq_f32(a.v, vdupq_n_f32(0.0f)), vcltq_f32(a.v, vdupq_n_f32(std::numeric_limits<float>::infinity())));
+        return floatx4(vbslq_f32(finite, refined, y));
+    }
+#else
+    // Без SIMD: по одной дорожке. Маски - все биты дорожки.
+    namespace detail {
+        inline float Mask(bool value) {
+            uint32_t bits = value ? 0xFFFFFFFFu : 0u;
+            float mask;
+            memcpy(&mask, &bits, sizeof(mask));
+            return mask;
+        }
+
+    }
+
+#define SHADER_MATH_LANES(expression) \
+    floatx4 r; \
+    for (int i = 0; i < 4; i++) { \
+        r.v[i] = expression; \
+    } \
+    return r;
+
+    inline floatx4 operator+(floatx4 a, floatx4 b) { SHADER_MATH_LANES(a.v[i] + b.v[i]) }
+    inline floatx4 operator-(floatx4 a, floatx4 b) { SHADER_MATH_LANES(a.v[i] - b.v[i]) }
+    inline floatx4 operator*(floatx4 a, floatx4 b) { SHADER_MATH_LANES(a.v[i] * b.v[i]) }
+    inline floatx4 operator/(floatx4 a, floatx4 b) { SHADER_MATH_LANES(a.v[i] / b.v[i]) }
+    inline floatx4 operator-(floatx4 a) { SHADER_MATH_LANES(-a.v[i]) }
+    inline floatx4 operator&(floatx4 a, floatx4 b) { SHADER_MATH_LANES(detail::FromBits(detail::Bits(a.v[i]) & detail::Bits(b.v[i]))) }
+    inline floatx4 operator|(floatx4 a, floatx4 b) { SHADER_MATH_LANES(detail::FromBits(detail::Bits(a.v[i]) | detail::Bits(b.v[i]))) }
+    inline floatx4 operator^(floatx4 a, floatx4 b) { SHADER_MATH_LANES(detail::FromBits(detail::Bits(a.v[i]) ^ detail::Bits(b.v[i]))) }
+    inline floatx4 operator<(floatx4 a, floatx4 b) { SHADER_MATH_LANES(detail::Mask(a.v[i] < b.v[i])) }
+    inline floatx4 operator<=(floatx4 a, floatx4 b) { SHADER_MATH_LANES(detail::Mask(a.v[i] <= b.v[i])) }
+    inline floatx4 operator>(floatx4 a, floatx4 b) { SHADER_MATH_LANES(detail::Mask(a.v[i] > b.v[i])) }
+    inline floatx4 operator>=(floatx4 a, floatx4 b) { SHADER_MATH_LANES(detail::Mask(a.v[i] >= b.v[i])) }
+    inline floatx4 operator==(floatx4 a, floatx4 b) { SHADER_MATH_LANES(detail::Mask(a.v[i] == b.v[i])) }
+    inline floatx4 operator!=(floatx4 a, floatx4 b) { SHADER_MATH_LANES(detail::Mask(a.v[i] != b.v[i])) }
+    inline floatx4 min(floatx4 a, floatx4 b) { SHADER_MATH_LANES(min(a.v[i], b.v[i])) }
+    inline floatx4 max(floatx4 a, floatx4 b) { SHADER_MATH_LANES(max(a.v[i], b.v[i])) }
+    inline floatx4 abs(floatx4 a) { SHADER_MATH_LANES(std::fabs(a.v[i])) }
+    inline floatx4 sqrt(floatx4 a) { SHADER_MATH_LANES(std::sqrt(a.v[i])) }
+    inline floatx4 rsqrt(floatx4 a) { SHADER_MATH_LANES(1.0f / std::sqrt(a.v[i])) }
+    inline floatx4 floor(floatx4 a) { SHADER_MATH_LANES(std::floor(a.v[i])) }
+    inline floatx4 select(floatx4 mask, floatx4 a, floatx4 b) { SHADER_MATH_LANES(detail::Bits(mask.v[i]) != 0 ? a.v[i] : b.v[i]) }
+
+#undef SHADER_MATH_LANES
+
+    inline bool any(floatx4 mask) {
+        return detail::Bits(mask.v[0]) | detail::Bits(mask.v[1]) | detail::Bits(mask.v[2]) | detail::Bits(mask.v[3]);
+    }
+
+    inline bool all(floatx4 mask) {
+        return detail::Bits(mask.v[0]) && detail::Bits(mask.v[1]) && detail::Bits(mask.v[2]) && detail::Bits(mask.v[3]);
+    }
+
+    inline unsigned lanemask(floatx4 mask) {
+        return (detail::Bits(mask.v[0]) ? 1u : 0u) | (detail::Bits(mask.v[1]) ? 2u : 0u) | (detail::Bits(mask.v[2]) ? 4u : 0u) |
+            (detail::Bits(mask.v[3]) ? 8u : 0u);
+    }
+#endif
+
+    inline floatx4 rcp(floatx4 a) {
+        return floatx4(1.0f) / a;
+    }
+
+    // ---- floatx8 ----
+
+#if defined(SHADER_MATH_AVX)
+    struct floatx8 {
+        __m256 v;
+
+        floatx8() = default;
+        floatx8(float s) : v(_mm256_set1_ps(s)) {};
+        explicit floatx8(__m256 value) : v(value) {};
+
+        static floatx8 Load(const float* p) {
+            return floatx8(_mm256_loadu_ps(p));
+        };
+
+        void Store(float* p) const {
+            _mm256_storeu_ps(p, v);
+        };
+
+        float Lane(int i) const {
+            float lanes[8];
+            Store(lanes);
+            return lanes[i];
+        };
+    };
+
+    inline floatx8 operator+(floatx8 a, floatx8 b) { return floatx8(_mm256_add_ps(a.v, b.v)); }
+    inline floatx8 operator-(floatx8 a, floatx8 b) { return floatx8(_mm256_sub_ps(a.v, b.v)); }
+    inline floatx8 operator*(floatx8 a, floatx8 b) { return floatx8(_mm256_mul_ps(a.v, b.v)); }
+    inline floatx8 operator/(floatx8 a, floatx8 b) { return floatx8(_mm256_div_ps(a.v, b.v)); }
+    inline floatx8 operator-(floatx8 a) { return floatx8(_mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f))); }
+    inline floatx8 operator&(floatx8 a, floatx8 b) { return floatx8(_mm256_and_ps(a.v, b.v)); }
+    inline floatx8 operator|(floatx8 a, floatx8 b) { return floatx8(_mm256_or_ps(a.v, b.v)); }
+    inline floatx8 operator^(floatx8 a, floatx8 b) { return floatx8(_mm256_xor_ps(a.v, b.v)); }
+    inline floatx8 operator<(floatx8 a, floatx8 b) { return floatx8(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)); }
+    inline floatx8 operator<=(floatx8 a, floatx8 b) { return floatx8(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)); }
+    inline floatx8 operator>(floatx8 a, floatx8 b) { return floatx8(_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)); }
+    inline floatx8 operator>=(floatx8 a, floatx8 b) { return floatx8(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)); }
+    inline floatx8 operator==(floatx8 a, floatx8 b) { return floatx8(_mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ)); }
+    inline floatx8 operator!=(floatx8 a, floatx8 b) { return floatx8(_mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ)); }
+    inline floatx8 min(floatx8 a, floatx8 b) { return floatx8(_mm256_min_ps(a.v, b.v)); }
+    inline floatx8 max(floatx8 a, floatx8 b) { return floatx8(_mm256_max_ps(a.v, b.v)); }
+    inline floatx8 abs(floatx8 a) { return floatx8(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v)); }
+    inline floatx8 sqrt(floatx8 a) { return floatx8(_mm256_sqrt_ps(a.v)); }
+    inline floatx8 floor(floatx8 a) { return floatx8(_mm256_floor_ps(a.v)); }
+    inline floatx8 select(floatx8 mask, floatx8 a, floatx8 b) { return floatx8(_mm256_blendv_ps(b.v, a.v, mask.v)); }
+    inline bool any(floatx8 mask) { return _mm256_movemask_ps(mask.v) != 0; }
+    inline bool all(floatx8 mask) { return _mm256_movemask_ps(mask.v) == 0xFF; }
+    inline unsigned lanemask(floatx8 mask) { return (unsigned)_mm256_movemask_ps(mask.v); }
+
+    inline floatx8 rsqrt(floatx8 a) {
+        __m256 y = _mm256_rsqrt_ps(a.v);
+        __m256 refined = _mm256_mul_ps(y, _mm256_sub_ps(_mm256_set1_ps(1.5f),
+            _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), a.v), _mm256_mul_ps(y, y))));
+        __m256 finite = _mm256_and_ps(_mm256_cmp_ps(a.v, _mm256_setzero_ps(), _CMP_GT_OQ),
+            _mm256_cmp_ps(a.v, _mm256_set1_ps(std::numeric_limits<float>::infinity()), _CMP_LT_OQ));
+        return floatx8(_mm256_blendv_ps(y, refined, finite));
+    }
+#else
+    // Без AVX - пара floatx4.
+    struct floatx8 {
+        floatx4 lo, hi;
+
+        floatx8() = default;
+        floatx8(float s) : lo(s), hi(s) {};
+        floatx8(floatx4 low, floatx4 high) : lo(low), hi(high) {};
+
+        static floatx8 Load(const float* p) {
+            return floatx8(floatx4::Load(p), floatx4::Load(p + 4));
+        };
+
+        void Store(float* p) const {
+            lo.Store(p);
+            hi.Store(p + 4);
+        };
+
+        float Lane(int i) const {
+            return i < 4 ? lo.Lane(i) : hi.Lane(i - 4);
+        };
+    };
+
+#define SHADER_MATH_HALVES2(name) \
+    inline floatx8 name(floatx8 a, floatx8 b) { return floatx8(name(a.lo, b.lo), name(a.hi, b.hi)); }
+#define SHADER_MATH_HALVES1(name) \
+    inline floatx8 name(floatx8 a) { return floatx8(name(a.lo), name(a.hi)); }
+
+    SHADER_MATH_HALVES2(operator+)
+    SHADER_MATH_HALVES2(operator-)
+    SHADER_MATH_HALVES2(operator*)
+    SHADER_MATH_HALVES2(operator/)
+    SHADER_MATH_HALVES2(operator&)
+    SHADER_MATH_HALVES2(operator|)
+    SHADER_MATH_HALVES2(operator^)
+    SHADER_MATH_HALVES2(operator<)
+    SHADER_MATH_HALVES2(operator<=)
+    SHADER_MATH_HALVES2(operator>)
+    SHADER_MATH_HALVES2(operator>=)
+    SHADER_MATH_HALVES2(operator==)
+    SHADER_MATH_HALVES2(operator!=)
+    SHADER_MATH_HALVES2(min)
+    SHADER_MATH_HALVES2(max)
+    SHADER_MATH_HALVES1(operator-)
+    SHADER_MATH_HALVES1(abs)
+    SHADER_MATH_HALVES1(sqrt)
+    SHADER_MATH_HALVES1(rsqrt)
+    SHADER_MATH_HALVES1(floor)
+
+#undef SHADER_MATH_HALVES1
+#undef SHADER_MATH_HALVES2
+
+    inline floatx8 select(floatx8 mask, floatx8 a, floatx8 b) {
+        return floatx8(select(mask.lo, a.lo, b.lo), select(mask.hi, a.hi, b.hi));
+    }
+
+    inline bool any(floatx8 mask) { return any(mask.lo) || any(mask.hi); }
+    inline bool all(floatx8 mask) { return all(mask.lo) && all(mask.hi); }
+    inline unsigned lanemask(floatx8 mask) { return lanemask(mask.lo) | lanemask(mask.hi) << 4; }
+#endif
+
+    inline floatx8 rcp(floatx8 a) {
+        return floatx8(1.0f) / a;
+    }
+
+    // ---- Общее для дорожек ----
+
+    // Число дорожек, загрузка и выгрузка подряд идущих значений.
+    template<typename Lane>
+    struct LaneTraits {
+        static const int count = sizeof(Lane) / sizeof(float);
+
+        static Lane Load(const float* p) {
+            return Lane::Load(p);
+        };
+
+        static void Store(const Lane& value, float* p) {
+            value.Store(p);
+        };
+    };
+
+    template<>
+    struct LaneTraits<float> {
+        static const int count = 1;
+
+        static float Load(const float* p) {
+            return *p;
+        };
+
+        static void Store(float value, float* p) {
+            *p = value;
+        };
+    };
+
+    // ---- Трансцендентные функции ----
+    //
+    // Один алгоритм для float и всех дорожек (сокращение аргумента и полиномы Cephes), поэтому результат не зависит
+    // от ширины, а скалярный перенос шейдера совпадает с векторным. Для одиночных скаляров libm обычно быстрее.
+    // Максимальная ошибка в ULP относительно точного значения (ShaderMathBenchMain --accuracy, 2^24 аргументов):
+    //   exp      1.0 ULP  x из [-87.3, 88.7]; ниже - денормалы с абсолютной ошибкой до 2^-149, от -104 - ноль
+    //   exp2     1.3 ULP  x из [-126, 128)
+    //   log      0.9 ULP  x > 0 включая денормалы; 0 -> -inf, x < 0 -> NaN
+    //   log2     1.4 ULP  то же
+    //   pow      как в HLSL, exp2(y * log2(x)), x < 0 -> NaN; ошибка растет с t = |y * log2(x)|:
+    //            1.5 ULP при t <= 1, 8.5 при t <= 8, 32 при t <= 32, 122 при t <= 126
+    //   sin, cos 1.3 ULP  |x| <= 8192; около нулей функции - абсолютная ошибка до 1.3 * 2^-24
+    //   atan2    3.0 ULP  все квадранты, нули со знаком и бесконечности как в libm; atan - 2.8 ULP
+    //   rsqrt    float - 1 / sqrt; дорожки SSE и AVX - оценка и шаг Ньютона, 4.2 ULP
+    // Аргументы NaN дают NaN. С -mfma ошибки отличаются не больше чем на 0.1 ULP.
+
+    // Маски для float - bool, для дорожек - биты; || над масками дорожек - побитовое или.
+    inline floatx4 operator||(floatx4 a, floatx4 b) { return a | b; }
+    inline floatx8 operator||(floatx8 a, floatx8 b) { return a | b; }
+
+    inline float copysign(float x, float s) { return std::copysign(x, s); }
+    inline floatx4 copysign(floatx4 x, floatx4 s) { return abs(x) | (s & floatx4(-0.0f)); }
+    inline floatx8 copysign(floatx8 x, floatx8 s) { return abs(x) | (s & floatx8(-0.0f)); }
+
+    // Round - округление к ближайшему целому для |x| < 2^31; Scale - x * 2^n для целого n из [-252, 254]
+    // за два умножения, чтобы не выйти за показатели float; Exponent - показатель и мантисса из [0.5, 1) для
+    // положительного нормального x.
+    namespace detail {
+        inline float Round(float x) {
+            return (float)(int32_t)(x + (x < 0.0f ? -0.5f : 0.5f));
+        }
+
+        inline float Scale(float x, float n) {
+            int32_t i = (int32_t)n, half = i >> 1;
+            return x * FromBits((uint32_t)(half + 127) << 23) * FromBits((uint32_t)(i - half + 127) << 23);
+        }
+
+        inline float Exponent(float x, float& mantissa) {
+            uint32_t bits = Bits(x);
+            mantissa = FromBits((bits & 0x007FFFFFu) | 0x3F000000u);
+            return (float)(int32_t)((bits >> 23) & 0xFF) - 126.0f;
+        }
+
+#if defined(SHADER_MATH_SSE)
+        inline floatx4 Round(floatx4 x) {
+            return floatx4(_mm_cvtepi32_ps(_mm_cvtps_epi32(x.v)));
+        }
+
+        inline floatx4 Scale(floatx4 x, floatx4 n) {
+            __m128i i = _mm_cvttps_epi32(n.v), half = _mm_srai_epi32(i, 1), bias = _mm_set1_epi32(127);
+            __m128 low = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(half, bias), 23));
+            __m128 high = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_sub_epi32(i, half), bias), 23));
+            return floatx4(_mm_mul_ps(_mm_mul_ps(x.v, low), high));
+        }
+
+        inline floatx4 Exponent(floatx4 x, floatx4& mantissa) {
+            __m128i bits = _mm_castps_si128(x.v);
+            mantissa = floatx4(_mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F000000))));
+            __m128i exponent = _mm_and_si128(_mm_srli_epi32(bits, 23), _mm_set1_epi32(0xFF));
+            return floatx4(_mm_cvtepi32_ps(_mm_sub_epi32(exponent, _mm_set1_epi32(126))));
+        }
+#elif defined(SHADER_MATH_NEON)
+        inline floatx4 Round(floatx4 x) {
+            return floatx4(vrndnq_f32(x.v));
+        }
+
+        inline floatx4 Scale(floatx4 x, floatx4 n) {
+            int32x4_t i = vcvtq_s32_f32(n.v), half = vshrq_n_s32(i, 1), bias = vdupq_n_s32(127);
+            float32x4_t low = vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(half, bias), 23));
+            float32x4_t high = vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(vsubq_s32(i, half), bias), 23));
+            return floatx4(vmulq_f32(vmulq_f32(x.v, low), high));
+        }
+
+        inline floatx4 Exponent(floatx4 x, floatx4& mantissa) {
+            uint32x4_t bits = vreinterpretq_u32_f32(x.v);
+            mantissa = floatx4(vreinterpretq_f32_u32(vorrq_u32(vandq_u32(bits, vdupq_n_u32(0x007FFFFF)), vdupq_n_u32(0x3F000000))));
+            int32x4_t exponent = vreinterpretq_s32_u32(vandq_u32(vshrq_n_u32(bits, 23), vdupq_n_u32(0xFF)));
+            return floatx4(vcvtq_f32_s32(vsubq_s32(exponent, vdupq_n_s32(126))));
+        }
+#else
+        inline floatx4 Round(floatx4 x) {
+            floatx4 r;
+            for (int i = 0; i < 4; i++) {
+                r.v[i] = Round(x.v[i]);
+            }
+            return r;
+        }
+
+        inline floatx4 Scale(floatx4 x, floatx4 n) {
+            floatx4 r;
+            for (int i = 0; i < 4; i++) {
+                r.v[i] = Scale(x.v[i], n.v[i]);
+            }
+            return r;
+        }
+
+        inline floatx4 Exponent(floatx4 x, floatx4& mantissa) {
+            floatx4 r;
+            for (int i = 0; i < 4; i++) {
+                r.v[i] = Exponent(x.v[i], mantissa.v[i]);
+            }
+            return r;
+        }
+#endif
+
+#if defined(SHADER_MATH_AVX)
+        inline floatx8 Round(floatx8 x) {
+            return floatx8(_mm256_round_ps(x.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        }
+#else
+        inline floatx8 Round(floatx8 x) {
+            return floatx8(Round(x.lo), Round(x.hi));
+        }
+#endif
+
+#if defined(SHADER_MATH_AVX) && defined(__AVX2__)
+        inline floatx8 Scale(floatx8 x, floatx8 n) {
+            __m256i i = _mm256_cvttps_epi32(n.v), half = _mm256_srai_epi32(i, 1), bias = _mm256_set1_epi32(127);
+            __m256 low = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(half, bias), 23));
+            __m256 high = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_sub_epi32(i, half), bias), 23));
+            return floatx8(_mm256_mul_ps(_mm256_mul_ps(x.v, low), high));
+        }
+
+        inline floatx8 Exponent(floatx8 x, floatx8& mantissa) {
+            __m256i bits = _mm256_castps_si256(x.v);
+            mantissa = floatx8(_mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)),
+                _mm256_set1_epi32(0x3F000000))));
+            __m256i exponent = _mm256_and_si256(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(0xFF));
+            return floatx8(_mm256_cvtepi32_ps(_mm256_sub_epi32(exponent, _mm256_set1_epi32(126))));
+        }
+#elif defined(SHADER_MATH_AVX)
+        // В AVX без AVX2 нет целочисленных операций над 256 битами - по половинам.
+        inline floatx4 Low(floatx8 x) {
+            return floatx4(_mm256_castps256_ps128(x.v));
+        }
+
+        inline floatx4 High(floatx8 x) {
+            return floatx4(_mm256_extractf128_ps(x.v, 1));
+        }
+
+        inline floatx8 Join(floatx4 lo, floatx4 hi) {
+            return floatx8(_mm256_insertf128_ps(_mm256_castps128_ps256(lo.v), hi.v, 1));
+        }
+
+        inline floatx8 Scale(floatx8 x, floatx8 n) {
+            return Join(Scale(Low(x), Low(n)), Scale(High(x), High(n)));
+        }
+
+        inline floatx8 Exponent(floatx8 x, floatx8& mantissa) {
+            floatx4 lo, hi;
+            floatx8 exponent = Join(Exponent(Low(x), lo), Exponent(High(x), hi));
+            mantissa = Join(lo, hi);
+            return exponent;
+        }
+#else
+        inline floatx8 Scale(floatx8 x, floatx8 n) {
+            return floatx8(Scale(x.lo, n.lo), Scale(x.hi, n.hi));
+        }
+
+        inline floatx8 Exponent(floatx8 x, floatx8& mantissa) {
+            return floatx8(Exponent(x.lo, mantissa.lo), Exponent(x.hi, mantissa.hi));
+        }
+#endif
+
+        // log(1 + m) - m для m из [sqrt(0.5) - 1, sqrt(2) - 1] без члена m; показатель x - в exponent.
+        template<typename T>
+        T LogReduce(const T& x, T& m, T& exponent) {
+            auto denormal = x < T(1.17549435e-38f);
+            T mantissa;
+            exponent = Exponent(select(denormal, x * T(8388608.0f), x), mantissa);
+            exponent = select(denormal, exponent - T(23.0f), exponent);
+            auto small = mantissa < T(0.707106781186547524f);
+            exponent = select(small, exponent - T(1.0f), exponent);
+            m = select(small, mantissa + mantissa - T(1.0f), mantissa - T(1.0f));
+            T z = m * m;
+            T y = ((((((((T(7.0376836292E-2f) * m - T(1.1514610310E-1f)) * m + T(1.1676998740E-1f)) * m - T(1.2420140846E-1f)) * m +
+                T(1.4249322787E-1f)) * m - T(1.6668057665E-1f)) * m + T(2.0000714765E-1f)) * m - T(2.4999993993E-1f)) * m +
+                T(3.3333331174E-1f)) * m * z;
+            return y - T(0.5f) * z;
+        }
+
+        template<typename T>
+        T LogSpecials(const T& x, const T& r) {
+            const float infinity = std::numeric_limits<float>::infinity();
+            T result = select(x == T(infinity), T(infinity), r);
+            result = select(x == T(0.0f), T(-infinity), result);
+            return select(x >= T(0.0f), result, T(std::numeric_limits<float>::quiet_NaN()));
+        }
+
+        template<typename T>
+        T Log(const T& x) {
+            T m, exponent;
+            T y = LogReduce(x, m, exponent);
+            // ln 2 = 0.693359375 - 2.12194440e-4, первое слагаемое точно умножается на показатель.
+            return LogSpecials(x, m + (y + exponent * T(-2.12194440e-4f)) + exponent * T(0.693359375f));
+        }
+
+        template<typename T>
+        T Log2(const T& x) {
+            T m, exponent;
+            T y = LogReduce(x, m, exponent);
+            // log2(e) = 1 + 0.44269504088896340736.
+            const T log2ea(0.44269504088896340736f);
+            return LogSpecials(x, y * log2ea + m * log2ea + y + m + exponent);
+        }
+
+        template<typename T>
+        T Exp(const T& x) {
+            T clamped = min(max(x, T(-104.0f)), T(88.8f));
+            T n = Round(clamped * T(1.44269504088896341f));
+            T r = clamped - n * T(0.693359375f) + n * T(2.12194440e-4f);
+            T z = r * r;
+            T p = (((((T(1.9875691500E-4f) * r + T(1.3981999507E-3f)) * r + T(8.3334519073E-3f)) * r + T(4.1665795894E-2f)) * r +
+                T(1.6666665459E-1f)) * r + T(5.0000001201E-1f)) * z + r + T(1.0f);
+            T result = select(x > T(88.72283905f), T(std::numeric_limits<float>::infinity()), Scale(p, n));
+            return select(x < T(-104.0f), T(0.0f), select(x != x, x, result));
+        }
+
+        template<typename T>
+        T Exp2(const T& x) {
+            T clamped = min(max(x, T(-151.0f)), T(128.0f));
+            T n = Round(clamped);
+            T f = clamped - n;
+            T p = f * (((((T(1.535336188319500E-4f) * f + T(1.339887440266574E-3f)) * f + T(9.618437357674640E-3f)) * f +
+                T(5.550332471162809E-2f)) * f + T(2.402264791363012E-1f)) * f + T(6.931472028550421E-1f)) + T(1.0f);
+            T result = select(x >= T(128.0f), T(std::numeric_limits<float>::infinity()), Scale(p, n));
+            return select(x < T(-151.0f), T(0.0f), select(x != x, x, result));
+        }
+
+        // sin и cos |x|: сокращение на ближайшее кратное pi / 2 в три шага (Коди-Уэйт), четверть периода - по его номеру.
+        template<typename T>
+        void SinCos(const T& x, T& s, T& c) {
+            T ax = abs(x);
+            T q = Round(min(ax * T(0.636619772367581343f), T(8388608.0f)));
+            T r = ((ax - q * T(1.5703125f)) - q * T(4.837512969970703125e-4f)) - q * T(7.54978995489188216e-8f);
+            T z = r * r;
+            T sinPoly = ((T(-1.9515295891E-4f) * z + T(8.3321608736E-3f)) * z - T(1.6666654611E-1f)) * z * r + r;
+            T cosPoly = ((T(2.443315711809948E-5f) * z - T(1.388731625493765E-3f)) * z + T(4.166664568298827E-2f)) * z * z -
+                T(0.5f) * z + T(1.0f);
+            // q mod 4: дробная часть q / 4 - 0, 0.25, 0.5 или 0.75, после сдвига на -0.375 округление дает floor.
+            T quarter = q - T(4.0f) * Round(q * T(0.25f) - T(0.375f));
+            auto swap = quarter == T(1.0f) || quarter == T(3.0f);
+            T sine = select(swap, cosPoly, sinPoly);
+            T cosine = select(swap, sinPoly, cosPoly);
+            sine = select(quarter >= T(2.0f), -sine, sine);
+            cosine = select(quarter == T(1.0f) || quarter == T(2.0f), -cosine, cosine);
+            s = select(copysign(T(1.0f), x) < T(0.0f), -sine, sine);
+            c = cosine;
+        }
+
+        // atan t для t из [0, 1].
+        template<typename T>
+        T AtanUnit(const T& t) {
+            auto large = t > T(0.4142135623730950f);
+            T reduced = select(large, (t - T(1.0f)) / (t + T(1.0f)), t);
+            T z = reduced * reduced;
+            T p = (((T(8.05374449538e-2f) * z - T(1.38776856032E-1f)) * z + T(1.99777106478E-1f)) * z - T(3.33329491539E-1f)) * z * reduced + reduced;
+            return select(large, p + T(0.785398163397448309616f), p);
+        }
+
+        template<typename T>
+        T Atan2(const T& y, const T& x) {
+            T ax = abs(x), ay = abs(y);
+            T high = max(ax, ay), low = min(ax, ay);
+            // 0 / 0 и inf / inf.
+            T t = select(high == T(0.0f), T(0.0f), select(low == high, T(1.0f), low / high));
+            T a = AtanUnit(t);
+            a = select(ay > ax, T(1.57079632679489661923f) - a, a);
+            a = select(copysign(T(1.0f), x) < T(0.0f), T(3.14159265358979323846f) - a, a);
+            a = copysign(a, y);
+            return select(x != x, x, select(y != y, y, a));
+        }
+    }
+
+#define SHADER_MATH_TRANSCENDENTAL(Lane) \
+    inline Lane exp(Lane x) { return detail::Exp(x); } \
+    inline Lane exp2(Lane x) { return detail::Exp2(x); } \
+    inline Lane log(Lane x) { return detail::Log(x); } \
+    inline Lane log2(Lane x) { return detail::Log2(x); } \
+    inline Lane pow(Lane x, Lane y) { return detail::Exp2(y * detail::Log2(x)); } \
+    inline void sincos(Lane x, Lane& s, Lane& c) { detail::SinCos(x, s, c); } \
+    inline Lane sin(Lane x) { Lane s, c; detail::SinCos(x, s, c); return s; } \
+    inline Lane cos(Lane x) { Lane s, c; detail::SinCos(x, s, c); return c; } \
+    inline Lane atan2(Lane y, Lane x) { return detail::Atan2(y, x); } \
+    inline Lane atan(Lane x) { return detail::Atan2(x, Lane(1.0f)); }
+
+    SHADER_MATH_TRANSCENDENTAL(float)
+    SHADER_MATH_TRANSCENDENTAL(floatx4)
+    SHADER_MATH_TRANSCENDENTAL(floatx8)
+
+#undef SHADER_MATH_TRANSCENDENTAL
+
+    // Функции HLSL над одной дорожкой; для векторов ниже они применяются покомпонентно.
+    template<typename T> T saturate(const T& x) { return min(max(x, T(0.0f)), T(1.0f)); }
+    template<typename T> T clamp(const T& x, const T& low, const T& high) { return min(max(x, low), high); }
+    template<typename T> T lerp(const T& a, const T& b, const T& t) { return a + (b - a) * t; }
+    template<typename T> T frac(const T& x) { return x - floor(x); }
+    template<typename T> T step(const T& edge, const T& x) { return select(x >= edge, T(1.0f), T(0.0f)); }
+    template<typename T> T sign(const T& x) { return select(x > T(0.0f), T(1.0f), select(x < T(0.0f), T(-1.0f), T(0.0f))); }
+
+    template<typename T>
+    T smoothstep(const T& low, const T& high, const T& x) {
+        T t = saturate((x - low) / (high - low));
+        return t * t * (T(3.0f) - T(2.0f) * t);
+    }
+
+    // ---- Векторы ----
+
+    template<typename T> struct Vector2;
+    template<typename T> struct Vector3;
+    template<typename T> struct Vector4;
+
+    // Скаляр в смешанных операциях не участвует в выводе типа: float3x8 * 2.0f.
+    template<typename T> struct NonDeduced {
+        typedef T type;
+    };
+
+    // Перестановки компонент только для чтения: v.zyx(), v.xxyy(). Запись - через компоненты.
+#define SHADER_MATH_SWIZZLE2(a, b) \
+    Vector2<T> a##b() const { return Vector2<T>(a, b); }
+#define SHADER_MATH_SWIZZLE3(a, b, c) \
+    Vector3<T> a##b##c() const { return Vector3<T>(a, b, c); }
+#define SHADER_MATH_SWIZZLE4(a, b, c, d) \
+    Vector4<T> a##b##c##d() const { return Vector4<T>(a, b, c, d); }
+
+#define SHADER_MATH_XY(M, ...) M(__VA_ARGS__, x) M(__VA_ARGS__, y)
+#define SHADER_MATH_XYZ(M, ...) M(__VA_ARGS__, x) M(__VA_ARGS__, y) M(__VA_ARGS__, z)
+#define SHADER_MATH_XYZW(M, ...) M(__VA_ARGS__, x) M(__VA_ARGS__, y) M(__VA_ARGS__, z) M(__VA_ARGS__, w)
+
+    // Все перестановки из двух, трех и четырех компонент для вектора с компонентами из набора EACH.
+#define SHADER_MATH_S2(EACH, a) EACH(SHADER_MATH_SWIZZLE2, a)
+#define SHADER_MATH_S3B(EACH, a, b) EACH(SHADER_MATH_SWIZZLE3, a, b)
+#define SHADER_MATH_S3(EACH, a) SHADER_MATH_S3B(EACH, a, x) SHADER_MATH_S3B(EACH, a, y) SHADER_MATH_S3B_REST_##EACH(a)
+#define SHADER_MATH_S4C(EACH, a, b, c) EACH(SHADER_MATH_SWIZZLE4, a, b, c)
+#define SHADER_MATH_S4B(EACH, a, b) SHADER_MATH_S4C(EACH, a, b, x) SHADER_MATH_S4C(EACH, a, b, y) SHADER_MATH_S4C_REST_##EACH(a, b)
+#define SHADER_MATH_S4(EACH, a) SHADER_MATH_S4B(EACH, a, x) SHADER_MATH_S4B(EACH, a, y) SHADER_MATH_S4B_REST_##EACH(a)
+
+#define SHADER_MATH_S3B_REST_SHADER_MATH_XY(a)
+#define SHADER_MATH_S3B_REST_SHADER_MATH_XYZ(a) SHADER_MATH_S3B(SHADER_MATH_XYZ, a, z)
+#define SHADER_MATH_S3B_REST_SHADER_MATH_XYZW(a) SHADER_MATH_S3B(SHADER_MATH_XYZW, a, z) SHADER_MATH_S3B(SHADER_MATH_XYZW, a, w)
+#define SHADER_MATH_S4C_REST_SHADER_MATH_XY(a, b)
+#define SHADER_MATH_S4C_REST_SHADER_MATH_XYZ(a, b) SHADER_MATH_S4C(SHADER_MATH_XYZ, a, b, z)
+#define SHADER_MATH_S4C_REST_SHADER_MATH_XYZW(a, b) SHADER_MATH_S4C(SHADER_MATH_XYZW, a, b, z) SHADER_MATH_S4C(SHADER_MATH_XYZW, a, b, w)
+#define SHADER_MATH_S4B_REST_SHADER_MATH_XY(a)
+#define SHADER_MATH_S4B_REST_SHADER_MATH_XYZ(a) SHADER_MATH_S4B(SHADER_MATH_XYZ, a, z)
+#define SHADER_MATH_S4B_REST_SHADER_MATH_XYZW(a) SHADER_MATH_S4B(SHADER_MATH_XYZW, a, z) SHADER_MATH_S4B(SHADER_MATH_XYZW, a, w)
+
+#define SHADER_MATH_SWIZZLES(EACH) \
+    SHADER_MATH_S2(EACH, x) SHADER_MATH_S2(EACH, y) SHADER_MATH_SWIZZLES_REST2_##EACH \
+    SHADER_MATH_S3(EACH, x) SHADER_MATH_S3(EACH, y) SHADER_MATH_SWIZZLES_REST3_##EACH \
+    SHADER_MATH_S4(EACH, x) SHADER_MATH_S4(EACH, y) SHADER_MATH_SWIZZLES_REST4_##EACH
+
+#define SHADER_MATH_SWIZZLES_REST2_SHADER_MATH_XY
+#define SHADER_MATH_SWIZZLES_REST2_SHADER_MATH_XYZ SHADER_MATH_S2(SHADER_MATH_XYZ, z)
+#define SHADER_MATH_SWIZZLES_REST2_SHADER_MATH_XYZW SHADER_MATH_S2(SHADER_MATH_XYZW, z) SHADER_MATH_S2(SHADER_MATH_XYZW, w)
+#define SHADER_MATH_SWIZZLES_REST3_SHADER_MATH_XY
+#define SHADER_MATH_SWIZZLES_REST3_SHADER_MATH_XYZ SHADER_MATH_S3(SHADER_MATH_XYZ, z)
+#define SHADER_MATH_SWIZZLES_REST3_SHADER_MATH_XYZW SHADER_MATH_S3(SHADER_MATH_XYZW, z) SHADER_MATH_S3(SHADER_MATH_XYZW, w)
+#define SHADER_MATH_SWIZZLES_REST4_SHADER_MATH_XY
+#define SHADER_MATH_SWIZZLES_REST4_SHADER_MATH_XYZ SHADER_MATH_S4(SHADER_MATH_XYZ, z)
+#define SHADER_MATH_SWIZZLES_REST4_SHADER_MATH_XYZW SHADER_MATH_S4(SHADER_MATH_XYZW, z) SHADER_MATH_S4(SHADER_MATH_XYZW, w)
+
+    template<typename T>
+    struct Vector2 {
+        T x, y;
+
+        Vector2() = default;
+        Vector2(const T& s) : x(s), y(s) {};
+        Vector2(const T& x_, const T& y_) : x(x_), y(y_) {};
+
+        template<typename U>
+        explicit Vector2(const Vector2<U>& v) : x(T(v.x)), y(T(v.y)) {};
+
+        SHADER_MATH_SWIZZLES(SHADER_MATH_XY)
+    };
+
+    template<typename T>
+    struct Vector3 {
+        T x, y, z;
+
+        Vector3() = default;
+        Vector3(const T& s) : x(s), y(s), z(s) {};
+        Vector3(const T& x_, const T& y_, const T& z_) : x(x_), y(y_), z(z_) {};
+        Vector3(const Vector2<T>& xy, const T& z_) : x(xy.x), y(xy.y), z(z_) {};
+        Vector3(const T& x_, const Vector2<T>& yz) : x(x_), y(yz.x), z(yz.y) {};
+
+        template<typename U>
+        explicit Vector3(const Vector3<U>& v) : x(T(v.x)), y(T(v.y)), z(T(v.z)) {};
+
+        SHADER_MATH_SWIZZLES(SHADER_MATH_XYZ)
+    };
+
+    template<typename T>
+    struct Vector4 {
+        T x, y, z, w;
+
+        Vector4() = default;
+        Vector4(const T& s) : x(s), y(s), z(s), w(s) {};
+        Vector4(const T& x_, const T& y_, const T& z_, const T& w_) : x(x_), y(y_), z(z_), w(w_) {};
+        Vector4(const Vector3<T>& xyz, const T& w_) : x(xyz.x), y(xyz.y), z(xyz.z), w(w_) {};
+        Vector4(const T& x_, const Vector3<T>& yzw) : x(x_), y(yzw.x), z(yzw.y), w(yzw.z) {};
+        Vector4(const Vector2<T>& xy, const Vector2<T>& zw) : x(xy.x), y(xy.y), z(zw.x), w(zw.y) {};
+        Vector4(const Vector2<T>& xy, const T& z_, const T& w_) : x(xy.x), y(xy.y), z(z_), w(w_) {};
+
+        template<typename U>
+        explicit Vector4(const Vector4<U>& v) : x(T(v.x)), y(T(v.y)), z(T(v.z)), w(T(v.w)) {};
+
+        SHADER_MATH_SWIZZLES(SHADER_MATH_XYZW)
+    };
+
+#undef SHADER_MATH_SWIZZLES_REST4_SHADER_MATH_XYZW
+#undef SHADER_MATH_SWIZZLES_REST4_SHADER_MATH_XYZ
+#undef SHADER_MATH_SWIZZLES_REST4_SHADER_MATH_XY
+#undef SHADER_MATH_SWIZZLES_REST3_SHADER_MATH_XYZW
+#undef SHADER_MATH_SWIZZLES_REST3_SHADER_MATH_XYZ
+#undef SHADER_MATH_SWIZZLES_REST3_SHADER_MATH_XY
+#undef SHADER_MATH_SWIZZLES_REST2_SHADER_MATH_XYZW
+#undef SHADER_MATH_SWIZZLES_REST2_SHADER_MATH_XYZ
+#undef SHADER_MATH_SWIZZLES_REST2_SHADER_MATH_XY
+#undef SHADER_MATH_SWIZZLES
+#undef SHADER_MATH_S4B_REST_SHADER_MATH_XYZW
+#undef SHADER_MATH_S4B_REST_SHADER_MATH_XYZ
+#undef SHADER_MATH_S4B_REST_SHADER_MATH_XY
+#undef SHADER_MATH_S4C_REST_SHADER_MATH_XYZW
+#undef SHADER_MATH_S4C_REST_SHADER_MATH_XYZ
+#undef SHADER_MATH_S4C_REST_SHADER_MATH_XY
+#undef SHADER_MATH_S3B_REST_SHADER_MATH_XYZW
+#undef SHADER_MATH_S3B_REST_SHADER_MATH_XYZ
+#undef SHADER_MATH_S3B_REST_SHADER_MATH_XY
+#undef SHADER_MATH_S4
+#undef SHADER_MATH_S4B
+#undef SHADER_MATH_S4C
+#undef SHADER_MATH_S3
+#undef SHADER_MATH_S3B
+#undef SHADER_MATH_S2
+#undef SHADER_MATH_XYZW
+#undef SHADER_MATH_XYZ
+#undef SHADER_MATH_XY
+#undef SHADER_MATH_SWIZZLE4
+#undef SHADER_MATH_SWIZZLE3
+#undef SHADER_MATH_SWIZZLE2
+
+    typedef Vector2<float> float2;
+    typedef Vector3<float> float3;
+    typedef Vector4<float> float4;
+    typedef Vector4<int32_t> int4;
+    // float3 на 4 и 8 дорожек (не матрицы 3x4 и 3x8).
+    typedef Vector3<floatx4> float3x4;
+    typedef Vector3<floatx8> float3x8;
+
+    // Покомпонентные операторы: вектор с вектором, вектор со скаляром и скаляр с вектором.
+#define SHADER_MATH_OPERATOR(op) \
+    template<typename T> Vector2<T> operator op(const Vector2<T>& a, const Vector2<T>& b) { return Vector2<T>(a.x op b.x, a.y op b.y); } \
+    template<typename T> Vector3<T> operator op(const Vector3<T>& a, const Vector3<T>& b) { return Vector3<T>(a.x op b.x, a.y op b.y, a.z op b.z); } \
+    template<typename T> Vector4<T> operator op(const Vector4<T>& a, const Vector4<T>& b) { \
+        return Vector4<T>(a.x op b.x, a.y op b.y, a.z op b.z, a.w op b.w); \
+    } \
+    template<typename T> Vector2<T> operator op(const Vector2<T>& a, const typename NonDeduced<T>::type& s) { return Vector2<T>(a.x op s, a.y op s); } \
+    template<typename T> Vector3<T> operator op(const Vector3<T>& a, const typename NonDeduced<T>::type& s) { return Vector3<T>(a.x op s, a.y op s, a.z op s); } \
+    template<typename T> Vector4<T> operator op(const Vector4<T>& a, const typename NonDeduced<T>::type& s) { \
+        return Vector4<T>(a.x op s, a.y op s, a.z op s, a.w op s); \
+    } \
+    template<typename T> Vector2<T> operator op(const typename NonDeduced<T>::type& s, const Vector2<T>& a) { return Vector2<T>(s op a.x, s op a.y); } \
+    template<typename T> Vector3<T> operator op(const typename NonDeduced<T>::type& s, const Vector3<T>& a) { return Vector3<T>(s op a.x, s op a.y, s op a.z); } \
+    template<typename T> Vector4<T> operator op(const typename NonDeduced<T>::type& s, const Vector4<T>& a) { \
+        return Vector4<T>(s op a.x, s op a.y, s op a.z, s op a.w); \
+    } \
+    template<typename T> Vector2<T>& operator op##=(Vector2<T>& a, const Vector2<T>& b) { return a = a op b; } \
+    template<typename T> Vector3<T>& operator op##=(Vector3<T>& a, const Vector3<T>& b) { return a = a op b; } \
+    template<typename T> Vector4<T>& operator op##=(Vector4<T>& a, const Vector4<T>& b) { return a = a op b; } \
+    template<typename T> Vector2<T>& operator op##=(Vector2<T>& a, const typename NonDeduced<T>::type& s) { return a = a op s; } \
+    template<typename T> Vector3<T>& operator op##=(Vector3<T>& a, const typename NonDeduced<T>::type& s) { return a = a op s; } \
+    template<typename T> Vector4<T>& operator op##=(Vector4<T>& a, const typename NonDeduced<T>::type& s) { return a = a op s; }
+
+    SHADER_MATH_OPERATOR(+)
+    SHADER_MATH_OPERATOR(-)
+    SHADER_MATH_OPERATOR(*)
+    SHADER_MATH_OPERATOR(/)
+    // Для int4 и масок дорожек.
+    SHADER_MATH_OPERATOR(&)
+    SHADER_MATH_OPERATOR(|)
+    SHADER_MATH_OPERATOR(^)
+    SHADER_MATH_OPERATOR(<<)
+    SHADER_MATH_OPERATOR(>>)
+
+#undef SHADER_MATH_OPERATOR
+
+    template<typename T> Vector2<T> operator-(const Vector2<T>& a) { return Vector2<T>(-a.x, -a.y); }
+    template<typename T> Vector3<T> operator-(const Vector3<T>& a) { return Vector3<T>(-a.x, -a.y, -a.z); }
+    template<typename T> Vector4<T> operator-(const Vector4<T>& a) { return Vector4<T>(-a.x, -a.y, -a.z, -a.w); }
+
+    // Покомпонентные функции.
+#define SHADER_MATH_FUNCTION1(name) \
+    template<typename T> Vector2<T> name(const Vector2<T>& a) { return Vector2<T>(name(a.x), name(a.y)); } \
+    template<typename T> Vector3<T> name(const Vector3<T>& a) { return Vector3<T>(name(a.x), name(a.y), name(a.z)); } \
+    template<typename T> Vector4<T> name(const Vector4<T>& a) { return Vector4<T>(name(a.x), name(a.y), name(a.z), name(a.w)); }
+
+#define SHADER_MATH_FUNCTION2(name) \
+    template<typename T> Vector2<T> name(const Vector2<T>& a, const Vector2<T>& b) { return Vector2<T>(name(a.x, b.x), name(a.y, b.y)); } \
+    template<typename T> Vector3<T> name(const Vector3<T>& a, const Vector3<T>& b) { \
+        return Vector3<T>(name(a.x, b.x), name(a.y, b.y), name(a.z, b.z)); \
+    } \
+    template<typename T> Vector4<T> name(const Vector4<T>& a, const Vector4<T>& b) { \
+        return Vector4<T>(name(a.x, b.x), name(a.y, b.y), name(a.z, b.z), name(a.w, b.w)); \
+    }
+
+#define SHADER_MATH_FUNCTION3(name) \
+    template<typename T> Vector2<T> name(const Vector2<T>& a, const Vector2<T>& b, const Vector2<T>& c) { \
+        return Vector2<T>(name(a.x, b.x, c.x), name(a.y, b.y, c.y)); \
+    } \
+    template<typename T> Vector3<T> name(const Vector3<T>& a, const Vector3<T>& b, const Vector3<T>& c) { \
+        return Vector3<T>(name(a.x, b.x, c.x), name(a.y, b.y, c.y), name(a.z, b.z, c.z)); \
+    } \
+    template<typename T> Vector4<T> name(const Vector4<T>& a, const Vector4<T>& b, const Vector4<T>& c) { \
+        return Vector4<T>(name(a.x, b.x, c.x), name(a.y, b.y, c.y), name(a.z, b.z, c.z), name(a.w, b.w, c.w)); \
+    }
+
+    SHADER_MATH_FUNCTION1(abs)
+    SHADER_MATH_FUNCTION1(sqrt)
+    SHADER_MATH_FUNCTION1(rsqrt)
+    SHADER_MATH_FUNCTION1(rcp)
+    SHADER_MATH_FUNCTION1(floor)
+    SHADER_MATH_FUNCTION1(frac)
+    SHADER_MATH_FUNCTION1(sign)
+    SHADER_MATH_FUNCTION1(saturate)
+    SHADER_MATH_FUNCTION1(exp)
+    SHADER_MATH_FUNCTION1(exp2)
+    SHADER_MATH_FUNCTION1(log)
+    SHADER_MATH_FUNCTION1(log2)
+    SHADER_MATH_FUNCTION1(sin)
+    SHADER_MATH_FUNCTION1(cos)
+    SHADER_MATH_FUNCTION1(atan)
+    SHADER_MATH_FUNCTION2(min)
+    SHADER_MATH_FUNCTION2(max)
+    SHADER_MATH_FUNCTION2(pow)
+    SHADER_MATH_FUNCTION2(atan2)
+    SHADER_MATH_FUNCTION2(step)
+    SHADER_MATH_FUNCTION3(clamp)
+    SHADER_MATH_FUNCTION3(lerp)
+    SHADER_MATH_FUNCTION3(smoothstep)
+    SHADER_MATH_FUNCTION3(select)
+
+#undef SHADER_MATH_FUNCTION3
+#undef SHADER_MATH_FUNCTION2
+#undef SHADER_MATH_FUNCTION1
+
+    // lerp с общим для всех компонент параметром, как lerp(a, b, metalness) в шейдерах.
+    template<typename T> Vector2<T> lerp(const Vector2<T>& a, const Vector2<T>& b, const typename NonDeduced<T>::type& t) { return a + (b - a) * t; }
+    template<typename T> Vector3<T> lerp(const Vector3<T>& a, const Vector3<T>& b, const typename NonDeduced<T>::type& t) { return a + (b - a) * t; }
+    template<typename T> Vector4<T> lerp(const Vector4<T>& a, const Vector4<T>& b, const typename NonDeduced<T>::type& t) { return a + (b - a) * t; }
+
+    template<typename T> Vector2<T> select(const T& mask, const Vector2<T>& a, const Vector2<T>& b) {
+        return Vector2<T>(select(mask, a.x, b.x), select(mask, a.y, b.y));
+    }
+
+    template<typename T> Vector3<T> select(const T& mask, const Vector3<T>& a, const Vector3<T>& b) {
+        return Vector3<T>(select(mask, a.x, b.x), select(mask, a.y, b.y), select(mask, a.z, b.z));
+    }
+
+    template<typename T> Vector4<T> select(const T& mask, const Vector4<T>& a, const Vector4<T>& b) {
+        return Vector4<T>(select(mask, a.x, b.x), select(mask, a.y, b.y), select(mask, a.z, b.z), select(mask, a.w, b.w));
+    }
+
+    // Маска для скалярных векторов - bool.
+    inline float2 select(bool mask, const float2& a, const float2& b) { return mask ? a : b; }
+    inline float3 select(bool mask, const float3& a, const float3& b) { return mask ? a : b; }
+    inline float4 select(bool mask, const float4& a, const float4& b) { return mask ? a : b; }
+
+    template<typename T> T dot(const Vector2<T>& a, const Vector2<T>& b) { return a.x * b.x + a.y * b.y; }
+    template<typename T> T dot(const Vector3<T>& a, const Vector3<T>& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    template<typename T> T dot(const Vector4<T>& a, const Vector4<T>& b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+    template<typename T>
+    Vector3<T> cross(const Vector3<T>& a, const Vector3<T>& b) {
+        return Vector3<T>(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+    }
+
+    template<typename V> auto length(const V& v) -> decltype(dot(v, v)) { return sqrt(dot(v, v)); }
+    template<typename V> auto distance(const V& a, const V& b) -> decltype(dot(a, b)) { return length(b - a); }
+    template<typename V> V normalize(const V& v) { return v * rsqrt(dot(v, v)); }
+    // Как в HLSL: i - падающее направление, n - нормаль.
+    template<typename V> V reflect(const V& i, const V& n) { return i - 2.0f * dot(n, i) * n; }
+
+    template<typename V>
+    V refract(const V& i, const V& n, const typename NonDeduced<decltype(dot(i, n))>::type& eta) {
+        typedef decltype(dot(i, n)) T;
+        T cosi = dot(-i, n);
+        T k = T(1.0f) - eta * eta * (T(1.0f) - cosi * cosi);
+        V refracted = eta * i + (eta * cosi - sqrt(max(k, T(0.0f)))) * n;
+        return select(k < T(0.0f), V(T(0.0f)), refracted);
+    }
+
+    // Побитовое преобразование, как asint и asfloat в HLSL.
+    inline int4 asint(const float4& v) {
+        int4 r;
+        memcpy(&r, &v, sizeof(r));
+        return r;
+    }
+
+    inline float4 asfloat(const int4& v) {
+        float4 r;
+        memcpy(&r, &v, sizeof(r));
+        return r;
+    }
+
+    // ---- float4x4 ----
+
+    // Строки матрицы, m[строка][столбец], как float4x4 в HLSL и XMFLOAT4X4.
+    struct float4x4 {
+        float4 rows[4];
+
+        float4x4() = default;
+
+        float4x4(const float4& r0, const float4& r1, const float4& r2, const float4& r3) {
+            rows[0] = r0;
+            rows[1] = r1;
+            rows[2] = r2;
+            rows[3] = r3;
+        };
+
+        float4x4(float m00, float m01, float m02, float m03, float m10, float m11, float m12, float m13,
+                 float m20, float m21, float m22, float m23, float m30, float m31, float m32, float m33) {
+            rows[0] = float4(m00, m01, m02, m03);
+            rows[1] = float4(m10, m11, m12, m13);
+            rows[2] = float4(m20, m21, m22, m23);
+            rows[3] = float4(m30, m31, m32, m33);
+        };
+
+        // 16 float подряд по строкам, например XMFLOAT4X4.
+        explicit float4x4(const float* m) {
+            memcpy(rows, m, sizeof(rows));
+        };
+
+        float4& operator[](int row) {
+            return rows[row];
+        };
+
+        const float4& operator[](int row) const {
+            return rows[row];
+        };
+    };
+
+    inline float4x4 transpose(const float4x4& m) {
+        return float4x4(m[0].x, m[1].x, m[2].x, m[3].x, m[0].y, m[1].y, m[2].y, m[3].y,
+                        m[0].z, m[1].z, m[2].z, m[3].z, m[0].w, m[1].w, m[2].w, m[3].w);
+    }
+
+    // mul(v, m): v - строка.
+    template<typename T>
+    Vector4<T> mul(const Vector4<T>& v, const float4x4& m) {
+        return Vector4<T>(
+            v.x * T(m[0].x) + v.y * T(m[1].x) + v.z * T(m[2].x) + v.w * T(m[3].x),
+            v.x * T(m[0].y) + v.y * T(m[1].y) + v.z * T(m[2].y) + v.w * T(m[3].y),
+            v.x * T(m[0].z) + v.y * T(m[1].z) + v.z * T(m[2].z) + v.w * T(m[3].z),
+            v.x * T(m[0].w) + v.y * T(m[1].w) + v.z * T(m[2].w) + v.w * T(m[3].w));
+    }
+
+    // mul(m, v): v - столбец, как mul(worldMatrix, pos) в VS.hlsl.
+    template<typename T>
+    Vector4<T> mul(const float4x4& m, const Vector4<T>& v) {
+        return Vector4<T>(
+            T(m[0].x) * v.x + T(m[0].y) * v.y + T(m[0].z) * v.z + T(m[0].w) * v.w,
+            T(m[1].x) * v.x + T(m[1].y) * v.y + T(m[1].z) * v.z + T(m[1].w) * v.w,
+            T(m[2].x) * v.x + T(m[2].y) * v.y + T(m[2].z) * v.z + T(m[2].w) * v.w,
+            T(m[3].x) * v.x + T(m[3].y) * v.y + T(m[3].z) * v.z + T(m[3].w) * v.w);
+    }
+
+    // Как HLSL для mul(float4x4, float3): матрица усекается до 3x3 (поворот нормали в VS.hlsl).
+    template<typename T>
+    Vector3<T> mul(const float4x4& m, const Vector3<T>& v) {
+        return Vector3<T>(
+            T(m[0].x) * v.x + T(m[0].y) * v.y + T(m[0].z) * v.z,
+            T(m[1].x) * v.x + T(m[1].y) * v.y + T(m[1].z) * v.z,
+            T(m[2].x) * v.x + T(m[2].y) * v.y + T(m[2].z) * v.z);
+    }
+
+    template<typename T>
+    Vector3<T> mul(const Vector3<T>& v, const float4x4& m) {
+        return Vector3<T>(
+            v.x * T(m[0].x) + v.y * T(m[1].x) + v.z * T(m[2].x),
+            v.x * T(m[0].y) + v.y * T(m[1].y) + v.z * T(m[2].y),
+            v.x * T(m[0].z) + v.y * T(m[1].z) + v.z * T(m[2].z));
+    }
+
+    inline float4x4 mul(const float4x4& a, const float4x4& b) {
+        return float4x4(mul(a[0], b), mul(a[1], b), mul(a[2], b), mul(a[3], b));
+    }
+
+    // ---- Структура массивов ----
+
+    // Вектор из Lane дорожек по компонентам, лежащим в отдельных массивах.
+    template<typename Lane>
+    Vector3<Lane> LoadVector3(const float* x, const float* y, const float* z) {
+        return Vector3<Lane>(LaneTraits<Lane>::Load(x), LaneTraits<Lane>::Load(y), LaneTraits<Lane>::Load(z));
+    }
+
+    template<typename Lane>
+    void StoreVector3(const Vector3<Lane>& v, float* x, float* y, float* z) {
+        LaneTraits<Lane>::Store(v.x, x);
+        LaneTraits<Lane>::Store(v.y, y);
+        LaneTraits<Lane>::Store(v.z, z);
+    }
+}
+
+#pragma pop_macro("max")
+#pragma pop_macro("min")
@@ -0,0 +1,637 @@
+﻿// Замер ShaderMath.h на переносах tonemapPS.hlsl и цикла по источникам CalculateColor из LightCalc.h и проверка
+// трансцендентных функций, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 ShaderMathBenchMain.cpp -o shadermath
+//   g++ -std=c++14 -O2 -mavx2 -mfma ShaderMathBenchMain.cpp -o shadermath_avx2
+// Примеры:
+//   ./shadermath --pixels 1048576 --lights 4 --repeat 5
+//   ./shadermath --accuracy     ошибка exp, exp2, log, log2, pow, sincos, atan2, rsqrt в ULP относительно libm в double
+//   ./shadermath --functions    нс на значение для libm и ShaderMath.h по 1, 4 и 8 дорожек
+#include "ShaderMath.h"
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace {
+    using namespace hlsl;
+
+    const float PI = 3.14159265359f;
+
+    struct Light {
+        float position[3];
+        float color[4];     // w - яркость
+    };
+
+    // Пиксели G-буфера по компонентам.
+    struct Pixels {
+        std::vector<float> px, py, pz, nx, ny, nz, r, g, b, roughness, metalness;
+        std::vector<float> outR, outG, outB;
+
+        void Resize(size_t count) {
+            for (std::vector<float>* v : { &px, &py, &pz, &nx, &ny, &nz, &r, &g, &b, &roughness, &metalness, &outR, &outG, &outB }) {
+                v->assign(count, 0.0f);
+            }
+        };
+    };
+
+    // ---- Перенос шейдеров на ShaderMath.h ----
+
+    // pow(x, 5) FXC разворачивает в умножения, здесь так же.
+    template<typename T>
+    T Pow5(const T& x) {
+        T x2 = x * x;
+        return x2 * x2 * x;
+    }
+
+    template<typename T>
+    Vector3<T> fresnelFunction(const Vector3<T>& objColor, const Vector3<T>& h, const Vector3<T>& v, const T& metalness) {
+        Vector3<T> f = Vector3<T>(T(0.04f)) * (T(1.0f) - metalness) + objColor * metalness;
+        return f + (Vector3<T>(T(1.0f)) - f) * Pow5(T(1.0f) - max(dot(h, v), T(0.0f)));
+    }
+
+    template<typename T>
+    T distributionGGX(const Vector3<T>& n, const Vector3<T>& h, const T& roughness) {
+        T num = roughness * roughness;
+        T denom = max(dot(n, h), T(0.0f));
+        denom = denom * denom * (num - T(1.0f)) + T(1.0f);
+        denom = T(PI) * denom * denom;
+        return num / denom;
+    }
+
+    template<typename T>
+    T geometrySchlickGGX(const T& nv_l, const T& roughness) {
+        T k = roughness + T(1.0f);
+        k = k * k / T(8.0f);
+        return nv_l / (nv_l * (T(1.0f) - k) + k);
+    }
+
+    template<typename T>
+    T geometrySmith(const Vector3<T>& n, const Vector3<T>& v, const Vector3<T>& l, const T& roughness) {
+        return geometrySchlickGGX(max(dot(n, v), T(0.0f)), roughness) * geometrySchlickGGX(max(dot(n, l), T(0.0f)), roughness);
+    }
+
+    // Цикл по источникам CalculateColor в режиме DEFAULT без IBL.
+    template<typename T>
+    Vector3<T> DirectLight(const Vector3<T>& objColor, const Vector3<T>& objNormal, const Vector3<T>& pos, const T& roughness,
+                           const T& metalness, const float3& cameraPos, const std::vector<Light>& lights) {
+        Vector3<T> viewDir = normalize(Vector3<T>(cameraPos) - pos);
+        Vector3<T> finalColor(T(0.0f));
+        for (const Light& light : lights) {
+            Vector3<T> lightDir = Vector3<T>(float3(light.position[0], light.position[1], light.position[2])) - pos;
+            T lightDist = length(lightDir);
+            lightDir /= lightDist;
+            T atten = clamp(T(1.0f) / (lightDist * lightDist), T(0.0f), T(1.0f));
+            Vector3<T> radiance = Vector3<T>(float3(light.color[0], light.color[1], light.color[2]) * light.color[3]) * atten;
+
+            Vector3<T> h = normalize((viewDir + lightDir) / T(2.0f));
+            Vector3<T> F = fresnelFunction(objColor, h, viewDir, metalness);
+            T NDF = distributionGGX(objNormal, h, roughness);
+            T G = geometrySmith(objNormal, viewDir, lightDir, roughness);
+            Vector3<T> kd = Vector3<T>(T(1.0f)) - F;
+            kd *= T(1.0f) - metalness;
+
+            T nl = max(dot(objNormal, lightDir), T(0.0f));
+            finalColor += (kd * objColor / T(PI) +
+                NDF * G * F / max(T(4.0f) * max(dot(objNormal, viewDir), T(0.0f)) * nl, T(0.0001f))) * radiance * nl;
+        }
+        return finalColor;
+    }
+
+    template<typename T>
+    Vector3<T> Uncharted2Tonemap(const Vector3<T>& x) {
+        const T A(0.1f), B(0.50f), C(0.1f), D(0.20f), E(0.02f), F(0.30f);
+        return ((x * (A * x + C * B) + D * E) / (x * (A * x + B) + D * F)) - E / F;
+    }
+
+    // TonemapFilmic с уже прочитанными средней, минимальной и максимальной яркостью.
+    template<typename T>
+    Vector3<T> TonemapFilmic(const Vector3<T>& color, float adaptedAvg, float minLum, float maxLum, float Efactor) {
+        float avg = exp(adaptedAvg) - 1.0f;
+        float keyValue = 1.03f - 2.0f / (2.0f + log(avg + 1.0f));
+        float E = keyValue / clamp(avg, minLum, maxLum) * Efactor;
+        Vector3<T> curr = Uncharted2Tonemap(Vector3<T>(T(E)) * color);
+        Vector3<T> whiteScale = Vector3<T>(T(1.0f)) / Uncharted2Tonemap(Vector3<T>(T(11.2f)));
+        return curr * whiteScale;
+    }
+
+    struct TonemapParams {
+        float adaptedAvg = 0.4f, minLum = 0.05f, maxLum = 4.0f, Efactor = 1.0f;
+    };
+
+    template<typename T>
+    void ShadePixels(Pixels& p, size_t begin, size_t end, const float3& cameraPos, const std::vector<Light>& lights,
+                     const TonemapParams& tonemap) {
+        const int lanes = LaneTraits<T>::count;
+        for (size_t i = begin; i < end; i += lanes) {
+            Vector3<T> pos = LoadVector3<T>(&p.px[i], &p.py[i], &p.pz[i]);
+            Vector3<T> normal = LoadVector3<T>(&p.nx[i], &p.ny[i], &p.nz[i]);
+            Vector3<T> color = LoadVector3<T>(&p.r[i], &p.g[i], &p.b[i]);
+            T roughness = LaneTraits<T>::Load(&p.roughness[i]);
+            T metalness = LaneTraits<T>::Load(&p.metalness[i]);
+            Vector3<T> lit = DirectLight(color, normal, pos, roughness, metalness, cameraPos, lights);
+            Vector3<T> mapped = saturate(TonemapFilmic(lit, tonemap.adaptedAvg, tonemap.minLum, tonemap.maxLum, tonemap.Efactor));
+            StoreVector3(mapped, &p.outR[i], &p.outG[i], &p.outB[i]);
+        }
+    }
+
+    // ---- Та же формула на float без ShaderMath.h ----
+
+    inline float Dot(const float a[3], const float b[3]) {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    inline void Normalize(float v[3]) {
+        float scale = 1.0f / std::sqrt(Dot(v, v));
+        v[0] *= scale;
+        v[1] *= scale;
+        v[2] *= scale;
+    }
+
+    inline float Uncharted2(float x) {
+        return ((x * (0.1f * x + 0.1f * 0.5f) + 0.2f * 0.02f) / (x * (0.1f * x + 0.5f) + 0.2f * 0.3f)) - 0.02f / 0.3f;
+    }
+
+    void ShadeScalar(Pixels& p, size_t begin, size_t end, const float3& cameraPos, const std::vector<Light>& lights,
+                     const TonemapParams& tonemap) {
+        float avg = std::exp(tonemap.adaptedAvg) - 1.0f;
+        float keyValue = 1.03f - 2.0f / (2.0f + std::log(avg + 1.0f));
+        float E = keyValue / std::fmin(std::fmax(avg, tonemap.minLum), tonemap.maxLum) * tonemap.Efactor;
+        float whiteScale = 1.0f / Uncharted2(11.2f);
+
+        for (size_t i = begin; i < end; i++) {
+            float pos[3] = { p.px[i], p.py[i], p.pz[i] };
+            float n[3] = { p.nx[i], p.ny[i], p.nz[i] };
+            float color[3] = { p.r[i], p.g[i], p.b[i] };
+            float roughness = p.roughness[i], metalness = p.metalness[i];
+            float v[3] = { cameraPos.x - pos[0], cameraPos.y - pos[1], cameraPos.z - pos[2] };
+            Normalize(v);
+            float nv = std::fmax(Dot(n, v), 0.0f);
+            float k = (roughness + 1.0f) * (roughness + 1.0f) / 8.0f;
+            float gv = nv / (nv * (1.0f - k) + k);
+            float alpha = roughness * roughness;
+            float f0[3];
+            for (int c = 0; c < 3; c++) {
+                f0[c] = 0.04f * (1.0f - metalness) + color[c] * metalness;
+            }
+
+            float result[3] = { 0.0f, 0.0f, 0.0f };
+            for (const Light& light : lights) {
+                float l[3] = { light.position[0] - pos[0], light.position[1] - pos[1], light.position[2] - pos[2] };
+                float distance = std::sqrt(Dot(l, l));
+                for (float& c : l) {
+                    c /= distance;
+                }
+                float atten = std::fmin(std::fmax(1.0f / (distance * distance), 0.0f), 1.0f);
+                float h[3] = { (v[0] + l[0]) / 2.0f, (v[1] + l[1]) / 2.0f, (v[2] + l[2]) / 2.0f };
+                Normalize(h);
+                float hv = 1.0f - std::fmax(Dot(h, v), 0.0f);
+                float schlick = hv * hv * hv * hv * hv;
+                float nh = std::fmax(Dot(n, h), 0.0f);
+                float denom = nh * nh * (alpha - 1.0f) + 1.0f;
+                float ndf = alpha / (PI * denom * denom);
+                float nl = std::fmax(Dot(n, l), 0.0f);
+                float g = gv * (nl / (nl * (1.0f - k) + k));
+                float specularScale = ndf * g / std::fmax(4.0f * nv * nl, 0.0001f);
+                for (int c = 0; c < 3; c++) {
+                    float F = f0[c] + (1.0f - f0[c]) * schlick;
+                    float kd = (1.0f - F) * (1.0f - metalness);
+                    float radiance = light.color[c] * light.color[3] * atten;
+                    result[c] += (kd * color[c] / PI + specularScale * F) * radiance * nl;
+                }
+            }
+
+            float* out[3] = { &p.outR[i], &p.outG[i], &p.outB[i] };
+            for (int c = 0; c < 3; c++) {
+                *out[c] = std::fmin(std::fmax(Uncharted2(E * result[c]) * whiteScale, 0.0f), 1.0f);
+            }
+        }
+    }
+
+    // ---- Проверки семантики HLSL ----
+
+    bool Near(float a, float b) {
+        return std::fabs(a - b) <= 1e-5f * (1.0f + std::fabs(b));
+    }
+
+    bool CheckSemantics() {
+        bool ok = true;
+        float4 v(1.0f, 2.0f, 3.0f, 4.0f);
+        ok &= v.wzyx().x == 4.0f && v.xxyy().w == 2.0f && v.zxy().y == 1.0f && v.yw().y == 4.0f;
+
+        float4x4 m(1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f, 9.0f, 10.0f, 11.0f, 12.0f, 13.0f, 14.0f, 15.0f, 16.0f);
+        float4 column = mul(m, v), row = mul(v, m), rowT = mul(v, transpose(m));
+        ok &= column.x == 30.0f && column.w == 150.0f && row.x == 90.0f && row.w == 120.0f;
+        ok &= rowT.x == column.x && rowT.y == column.y && rowT.z == column.z && rowT.w == column.w;
+        float3 normal = mul(m, float3(1.0f, 0.0f, 0.0f));
+        ok &= normal.x == 1.0f && normal.y == 5.0f && normal.z == 9.0f;
+        float4x4 product = mul(m, m);
+        ok &= product[0].x == 90.0f && product[3].w == 600.0f;
+
+        float3 reflected = reflect(float3(1.0f, -1.0f, 0.0f), float3(0.0f, 1.0f, 0.0f));
+        ok &= reflected.x == 1.0f && reflected.y == 1.0f && reflected.z == 0.0f;
+        ok &= saturate(-0.5f) == 0.0f && saturate(1.5f) == 1.0f && lerp(2.0f, 4.0f, 0.25f) == 2.5f;
+        ok &= frac(-0.25f) == 0.75f && step(1.0f, 0.5f) == 0.0f && Near(smoothstep(0.0f, 2.0f, 1.0f), 0.5f);
+        int4 bits = asint(float4(1.0f, -2.0f, 0.0f, -0.0f));
+        ok &= bits.x == 0x3F800000 && (bits.y >> 31) == -1 && bits.z == 0 && (uint32_t)bits.w == 0x80000000u;
+        ok &= asfloat(bits).y == -2.0f;
+
+        // Те же функции на дорожках дают те же значения, что и на скалярах.
+        float lanes[8] = { -3.5f, -1.0f, -0.25f, 0.0f, 0.3f, 1.0f, 2.75f, 1e9f };
+        floatx8 x = floatx8::Load(lanes);
+        float3x8 vectors(x, x * 2.0f, x + 1.0f);
+        floatx8 lengths = length(vectors), floors = floor(x), fracs = frac(x), signs = sign(x), masked = select(x > 0.0f, x, -x);
+        floatx8 root = rsqrt(abs(x));
+        for (int i = 0; i < 8; i++) {
+            float s = lanes[i];
+            ok &= Near(lengths.Lane(i), length(float3(s, s * 2.0f, s + 1.0f)));
+            ok &= floors.Lane(i) == std::floor(s) && fracs.Lane(i) == frac(s) && signs.Lane(i) == sign(s);
+            ok &= masked.Lane(i) == std::fabs(s);
+            ok &= s == 0.0f ? std::isinf(root.Lane(i)) : std::fabs(root.Lane(i) - 1.0f / std::sqrt(std::fabs(s))) <= 2e-6f / std::sqrt(std::fabs(s));
+        }
+        ok &= any(x > 2.0f) && !all(x > 2.0f) && all(x < 1e10f) && !any(x > 1e10f);
+        return ok;
+    }
+
+    double Seconds(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // ---- Точность и скорость трансцендентных функций ----
+
+    // Ошибка в ULP float относительно точного значения; переполнение должно дать бесконечность нужного знака.
+    // Для |reference| < floor ошибка считается в ULP значения floor, то есть абсолютной.
+    double UlpError(float value, double reference, double floor) {
+        if (std::isnan(reference)) {
+            return std::isnan(value) ? 0.0 : INFINITY;
+        }
+        if (std::fabs(reference) >= (double)FLT_MAX * (1.0 + 1.0 / (1 << 25))) {
+            return std::isinf(value) && (value > 0) == (reference > 0) ? 0.0 : INFINITY;
+        }
+        if (std::isinf(reference)) {
+            return value == reference ? 0.0 : INFINITY;
+        }
+        int exponent;
+        std::frexp(std::fabs(reference) > floor ? std::fabs(reference) : floor, &exponent);
+        double ulp = std::ldexp(1.0, exponent - 24 > -149 ? exponent - 24 : -149);
+        return std::fabs((double)value - reference) / ulp;
+    }
+
+    // Число в порядке возрастания: соседние float отличаются на 1.
+    int64_t Ordered(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits & 0x80000000u ? -(int64_t)(bits & 0x7FFFFFFFu) : (int64_t)bits;
+    }
+
+    float FromOrdered(int64_t ordered) {
+        uint32_t bits = ordered < 0 ? (uint32_t)(-ordered) | 0x80000000u : (uint32_t)ordered;
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // count значений из [low, high] с равным шагом по представлениям float: каждый диапазон показателей
+    // получает одинаковую долю.
+    std::vector<float> Arguments(float low, float high, size_t count) {
+        int64_t first = Ordered(low), last = Ordered(high);
+        std::vector<float> values(count);
+        for (size_t i = 0; i < count; i++) {
+            values[i] = FromOrdered(first + (int64_t)((double)(last - first) * i / (count - 1)));
+        }
+        return values;
+    }
+
+    struct Accuracy {
+        double maxUlp[3] = {};          // float, floatx4, floatx8
+        float worst[3] = {};
+        double maxAbs = 0.0;
+        uint64_t samples = 0;
+        double floor = 0.0;
+    };
+
+    void Account(Accuracy& accuracy, int path, float argument, float value, double reference) {
+        double error = UlpError(value, reference, accuracy.floor);
+        if (error > accuracy.maxUlp[path] || std::isnan(error)) {
+            accuracy.maxUlp[path] = std::isnan(error) ? INFINITY : error;
+            accuracy.worst[path] = argument;
+        }
+        if (std::isfinite(reference) && std::fabs(value - reference) > accuracy.maxAbs) {
+            accuracy.maxAbs = std::fabs(value - reference);
+        }
+    }
+
+    // Одни и те же аргументы считаются на float, по 4 и по 8 дорожек.
+    template<typename Function, typename Reference>
+    Accuracy Measure1(Function function, Reference reference, const std::vector<float>& arguments, double floor = 0.0) {
+        Accuracy accuracy;
+        accuracy.floor = floor;
+        for (size_t i = 0; i + 8 <= arguments.size(); i += 8) {
+            const float* x = &arguments[i];
+            float lanes4[8], lanes8[8];
+            function(floatx4::Load(x)).Store(lanes4);
+            function(floatx4::Load(x + 4)).Store(lanes4 + 4);
+            function(floatx8::Load(x)).Store(lanes8);
+            for (int k = 0; k < 8; k++) {
+                double exact = reference((double)x[k]);
+                Account(accuracy, 0, x[k], function(x[k]), exact);
+                Account(accuracy, 1, x[k], lanes4[k], exact);
+                Account(accuracy, 2, x[k], lanes8[k], exact);
+            }
+            accuracy.samples += 8;
+        }
+        return accuracy;
+    }
+
+    // Все пары xs * ys, для которых accept(x, y).
+    template<typename Function, typename Reference, typename Accept>
+    Accuracy Measure2(Function function, Reference reference, const std::vector<float>& xs, const std::vector<float>& ys, Accept accept) {
+        Accuracy accuracy;
+        std::vector<float> a, b;
+        for (float x : xs) {
+            for (float y : ys) {
+                if (accept(x, y)) {
+                    a.push_back(x);
+                    b.push_back(y);
+                }
+            }
+        }
+        for (size_t i = 0; i + 8 <= a.size(); i += 8) {
+            float lanes4[8], lanes8[8];
+            function(floatx4::Load(&a[i]), floatx4::Load(&b[i])).Store(lanes4);
+            function(floatx4::Load(&a[i + 4]), floatx4::Load(&b[i + 4])).Store(lanes4 + 4);
+            function(floatx8::Load(&a[i]), floatx8::Load(&b[i])).Store(lanes8);
+            for (int k = 0; k < 8; k++) {
+                double exact = reference((double)a[i + k], (double)b[i + k]);
+                Account(accuracy, 0, a[i + k], function(a[i + k], b[i + k]), exact);
+                Account(accuracy, 1, a[i + k], lanes4[k], exact);
+                Account(accuracy, 2, a[i + k], lanes8[k], exact);
+            }
+            accuracy.samples += 8;
+        }
+        return accuracy;
+    }
+
+    void Report(const char* name, const Accuracy& accuracy) {
+        printf("  %-28s %9llu  %7.2f %7.2f %7.2f ULP  (worst x = %g)  max abs %.2e\n", name, (unsigned long long)accuracy.samples,
+            accuracy.maxUlp[0], accuracy.maxUlp[1], accuracy.maxUlp[2], accuracy.worst[0], accuracy.maxAbs);
+    }
+
+    // Особые значения: результат должен совпасть с libm с точностью до знака нуля у NaN.
+    bool CheckSpecials() {
+        const float inf = INFINITY, nan = NAN;
+        struct Case {
+            const char* name;
+            float result, expected;
+        };
+        Case cases[] = {
+            { "exp(-inf)", hlsl::exp(-inf), 0.0f }, { "exp(inf)", hlsl::exp(inf), inf }, { "exp(nan)", hlsl::exp(nan), nan },
+            { "exp(89)", hlsl::exp(89.0f), inf }, { "exp(-105)", hlsl::exp(-105.0f), 0.0f }, { "exp(0)", hlsl::exp(0.0f), 1.0f },
+            { "exp2(128)", hlsl::exp2(128.0f), inf }, { "exp2(-149)", hlsl::exp2(-149.0f), std::ldexp(1.0f, -149) },
+            { "exp2(10)", hlsl::exp2(10.0f), 1024.0f },
+            { "log(0)", hlsl::log(0.0f), -inf }, { "log(-0)", hlsl::log(-0.0f), -inf }, { "log(-1)", hlsl::log(-1.0f), nan },
+            { "log(inf)", hlsl::log(inf), inf }, { "log(nan)", hlsl::log(nan), nan }, { "log(1)", hlsl::log(1.0f), 0.0f },
+            { "log2(2^-149)", hlsl::log2(std::ldexp(1.0f, -149)), -149.0f }, { "log2(2^127)", hlsl::log2(std::ldexp(1.0f, 127)), 127.0f },
+            { "pow(0, 2)", hlsl::pow(0.0f, 2.0f), 0.0f }, { "pow(2, 10)", hlsl::pow(2.0f, 10.0f), 1024.0f },
+            { "pow(-2, 2)", hlsl::pow(-2.0f, 2.0f), nan }, { "pow(x, 0)", hlsl::pow(3.7f, 0.0f), 1.0f },
+            { "sin(inf)", hlsl::sin(inf), nan }, { "cos(nan)", hlsl::cos(nan), nan }, { "sin(-0)", hlsl::sin(-0.0f), -0.0f },
+            { "cos(0)", hlsl::cos(0.0f), 1.0f },
+            { "atan2(0, 0)", hlsl::atan2(0.0f, 0.0f), 0.0f }, { "atan2(0, -0)", hlsl::atan2(0.0f, -0.0f), std::atan2(0.0f, -0.0f) },
+            { "atan2(-0, -1)", hlsl::atan2(-0.0f, -1.0f), std::atan2(-0.0f, -1.0f) },
+            { "atan2(inf, inf)", hlsl::atan2(inf, inf), std::atan2(inf, inf) },
+            { "atan2(-inf, -inf)", hlsl::atan2(-inf, -inf), std::atan2(-inf, -inf) },
+            { "atan2(1, inf)", hlsl::atan2(1.0f, inf), 0.0f }, { "atan2(nan, 1)", hlsl::atan2(nan, 1.0f), nan },
+            { "atan(inf)", hlsl::atan(inf), std::atan(inf) },
+            { "rsqrt(0)", hlsl::rsqrt(floatx4(0.0f)).Lane(0), inf }, { "rsqrt(inf)", hlsl::rsqrt(floatx8(inf)).Lane(3), 0.0f },
+        };
+        bool ok = true;
+        for (const Case& c : cases) {
+            bool same = std::isnan(c.expected) ? std::isnan(c.result) :
+                c.result == c.expected && std::signbit(c.result) == std::signbit(c.expected);
+            if (!same) {
+                printf("  %s = %g, expected %g\n", c.name, c.result, c.expected);
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    bool CheckAccuracy() {
+        const size_t count = 1 << 24;
+        bool ok = CheckSpecials();
+        printf("Special values: %s\n", ok ? "ok" : "FAILED");
+        printf("  %-28s %9s  %7s %7s %7s\n", "function", "samples", "float", "x4", "x8");
+
+        auto exp = [](auto x) { return hlsl::exp(x); };
+        auto exp2 = [](auto x) { return hlsl::exp2(x); };
+        auto log = [](auto x) { return hlsl::log(x); };
+        auto log2 = [](auto x) { return hlsl::log2(x); };
+        auto sin = [](auto x) { return hlsl::sin(x); };
+        auto cos = [](auto x) { return hlsl::cos(x); };
+        auto sinFromSincos = [](auto x) { decltype(x) s, c; hlsl::sincos(x, s, c); return s + c * 0.0f; };
+        auto atan = [](auto x) { return hlsl::atan(x); };
+        auto rsqrt = [](auto x) { return hlsl::rsqrt(x); };
+        auto pow = [](auto x, auto y) { return hlsl::pow(x, y); };
+        auto atan2 = [](auto y, auto x) { return hlsl::atan2(y, x); };
+
+        Report("exp [-87.3, 88.7]", Measure1(exp, [](double x) { return std::exp(x); }, Arguments(-87.33f, 88.72f, count)));
+        Accuracy denormal = Measure1(exp, [](double x) { return std::exp(x); }, Arguments(-103.9f, -87.34f, count / 16));
+        printf("  %-28s %9llu  max abs %.2e (2^-149 = %.2e)\n", "exp [-103.9, -87.3] denormal",
+            (unsigned long long)denormal.samples, denormal.maxAbs, std::ldexp(1.0, -149));
+        Report("exp2 [-126, 128)", Measure1(exp2, [](double x) { return std::exp2(x); }, Arguments(-126.0f, 127.99f, count)));
+        Report("log (0, inf)", Measure1(log, [](double x) { return std::log(x); }, Arguments(std::numeric_limits<float>::denorm_min(), FLT_MAX, count)));
+        Report("log2 (0, inf)", Measure1(log2, [](double x) { return std::log2(x); }, Arguments(std::numeric_limits<float>::denorm_min(), FLT_MAX, count)));
+        // Около нулей sin и cos ошибка абсолютная, в ULP числа 0.5 (2^-24).
+        Report("sin [-pi, pi]", Measure1(sin, [](double x) { return std::sin(x); }, Arguments(-3.14159265f, 3.14159265f, count), 0.5));
+        Report("cos [-pi, pi]", Measure1(cos, [](double x) { return std::cos(x); }, Arguments(-3.14159265f, 3.14159265f, count), 0.5));
+        Report("sin [-8192, 8192]", Measure1(sin, [](double x) { return std::sin(x); }, Arguments(-8192.0f, 8192.0f, count), 0.5));
+        Report("cos [-8192, 8192]", Measure1(cos, [](double x) { return std::cos(x); }, Arguments(-8192.0f, 8192.0f, count), 0.5));
+        Report("sincos.s [-8192, 8192]", Measure1(sinFromSincos, [](double x) { return std::sin(x); },
+            Arguments(-8192.0f, 8192.0f, count / 4), 0.5));
+        Report("sin [-pi/4, pi/4] relative", Measure1(sin, [](double x) { return std::sin(x); }, Arguments(-0.785f, 0.785f, count)));
+        Report("atan (-inf, inf)", Measure1(atan, [](double x) { return std::atan(x); }, Arguments(-FLT_MAX, FLT_MAX, count)));
+        Report("rsqrt (0, inf)", Measure1(rsqrt, [](double x) { return 1.0 / std::sqrt(x); }, Arguments(FLT_MIN, FLT_MAX, count)));
+
+        std::vector<float> bases = Arguments(FLT_MIN, FLT_MAX, 4096), exponents = Arguments(-64.0f, 64.0f, 4096);
+        auto powReference = [](double x, double y) { return std::pow(x, y); };
+        const float limits[] = { 1.0f, 8.0f, 32.0f, 126.0f };
+        for (float limit : limits) {
+            char name[64];
+            snprintf(name, sizeof(name), "pow |y log2 x| <= %g", limit);
+            Report(name, Measure2(pow, powReference, bases, exponents, [limit](float x, float y) {
+                return std::fabs(y * std::log2((double)x)) <= limit;
+            }));
+        }
+        std::vector<float> coordinates = Arguments(-1e30f, 1e30f, 4096);
+        Report("atan2 (-1e30, 1e30)^2", Measure2(atan2, [](double y, double x) { return std::atan2(y, x); }, coordinates, coordinates,
+            [](float, float) { return true; }));
+        return ok;
+    }
+
+    // Скорость: нс на значение для libm и трех путей ShaderMath.h.
+    template<typename Function, typename Libm>
+    void Throughput(const char* name, Function function, Libm libm, const std::vector<float>& x, const std::vector<float>& y) {
+        const size_t count = x.size();
+        std::vector<float> out(count);
+        auto run = [&](auto body) {
+            double best = 1e30;
+            for (int pass = 0; pass < 5; pass++) {
+                auto start = std::chrono::steady_clock::now();
+                for (int repeat = 0; repeat < 64; repeat++) {
+                    body();
+                }
+                double elapsed = Seconds(start);
+                best = elapsed < best ? elapsed : best;
+            }
+            return best / (64.0 * count) * 1e9;
+        };
+        double times[4] = {
+            run([&] { for (size_t i = 0; i < count; i++) out[i] = libm(x[i], y[i]); }),
+            run([&] { for (size_t i = 0; i < count; i++) out[i] = function(x[i], y[i]); }),
+            run([&] { for (size_t i = 0; i < count; i += 4) function(floatx4::Load(&x[i]), floatx4::Load(&y[i])).Store(&out[i]); }),
+            run([&] { for (size_t i = 0; i < count; i += 8) function(floatx8::Load(&x[i]), floatx8::Load(&y[i])).Store(&out[i]); }),
+        };
+        printf("  %-8s %7.2f %7.2f %7.2f %7.2f   x%.1f\n", name, times[0], times[1], times[2], times[3], times[0] / times[3]);
+    }
+
+    void BenchFunctions() {
+        const size_t count = 4096;
+        std::mt19937 random(11);
+        std::uniform_real_distribution<float> wide(-80.0f, 80.0f), positive(1e-6f, 1e6f), unit(-1.0f, 1.0f);
+        std::vector<float> args(count), positives(count), exponents(count), xs(count), ys(count);
+        for (size_t i = 0; i < count; i++) {
+            args[i] = wide(random);
+            positives[i] = positive(random);
+            exponents[i] = unit(random) * 5.0f;
+            xs[i] = unit(random);
+            ys[i] = unit(random);
+        }
+        printf("ns per value, %zu values in cache%s\n", count,
+#if defined(SHADER_MATH_AVX)
+            ", AVX");
+#else
+            "");
+#endif
+        printf("  %-8s %7s %7s %7s %7s\n", "", "libm", "float", "x4", "x8");
+        Throughput("exp", [](auto x, auto) { return hlsl::exp(x); }, [](float x, float) { return std::exp(x); }, args, args);
+        Throughput("exp2", [](auto x, auto) { return hlsl::exp2(x); }, [](float x, float) { return std::exp2(x); }, args, args);
+        Throughput("log", [](auto x, auto) { return hlsl::log(x); }, [](float x, float) { return std::log(x); }, positives, positives);
+        Throughput("log2", [](auto x, auto) { return hlsl::log2(x); }, [](float x, float) { return std::log2(x); }, positives, positives);
+        Throughput("pow", [](auto x, auto y) { return hlsl::pow(x, y); }, [](float x, float y) { return std::pow(x, y); }, positives, exponents);
+        Throughput("sincos", [](auto x, auto) { decltype(x) s, c; hlsl::sincos(x, s, c); return s + c; },
+            [](float x, float) { return std::sin(x) + std::cos(x); }, args, args);
+        Throughput("atan2", [](auto y, auto x) { return hlsl::atan2(y, x); }, [](float y, float x) { return std::atan2(y, x); }, ys, xs);
+        Throughput("rsqrt", [](auto x, auto) { return hlsl::rsqrt(x); }, [](float x, float) { return 1.0f / std::sqrt(x); }, positives, positives);
+    }
+
+    template<typename Shade>
+    double Measure(Shade shade, Pixels& pixels, unsigned repeat) {
+        double best = 1e30;
+        for (unsigned i = 0; i < repeat; i++) {
+            auto start = std::chrono::steady_clock::now();
+            shade(pixels);
+            double elapsed = Seconds(start);
+            best = elapsed < best ? elapsed : best;
+        }
+        return best;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t count = 1 << 20;
+    unsigned lightCount = 4, repeat = 5;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--pixels") && i + 1 < argc) {
+            count = (size_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--lights") && i + 1 < argc) {
+            lightCount = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) {
+            repeat = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--accuracy")) {
+            return CheckAccuracy() ? 0 : 1;
+        } else if (!strcmp(argv[i], "--functions")) {
+            BenchFunctions();
+            return 0;
+        } else {
+            printf("shadermath [--pixels <n>] [--lights <n>] [--repeat <n>] | --accuracy | --functions\n");
+            return 1;
+        }
+    }
+    count = (count + 7) & ~(size_t)7;
+
+    bool semantics = CheckSemantics();
+    printf("HLSL semantics: %s\n", semantics ? "ok" : "FAILED");
+
+    // Точки на сфере радиуса 1, как сфера сцены Lab5, и источники вокруг нее.
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    Pixels pixels;
+    pixels.Resize(count);
+    for (size_t i = 0; i < count; i++) {
+        float z = unit(random) * 2.0f - 1.0f, phi = unit(random) * 2.0f * PI, radius = std::sqrt(1.0f - z * z);
+        pixels.nx[i] = pixels.px[i] = radius * std::cos(phi);
+        pixels.ny[i] = pixels.py[i] = radius * std::sin(phi);
+        pixels.nz[i] = pixels.pz[i] = z;
+        pixels.r[i] = unit(random);
+        pixels.g[i] = unit(random);
+        pixels.b[i] = unit(random);
+        pixels.roughness[i] = 0.05f + 0.95f * unit(random);
+        pixels.metalness[i] = unit(random);
+    }
+    std::vector<Light> lights(lightCount);
+    for (unsigned i = 0; i < lightCount; i++) {
+        float angle = 2.0f * PI * i / lightCount;
+        lights[i] = { { 3.0f * std::cos(angle), 2.0f, 3.0f * std::sin(angle) }, { 1.0f, 0.9f, 0.8f, 20.0f } };
+    }
+    float3 cameraPos(0.0f, 3.5355339f, -3.5355339f);
+    TonemapParams tonemap;
+
+    auto scalar = [&](Pixels& p) { ShadeScalar(p, 0, count, cameraPos, lights, tonemap); };
+    auto lane1 = [&](Pixels& p) { ShadePixels<float>(p, 0, count, cameraPos, lights, tonemap); };
+    auto lane4 = [&](Pixels& p) { ShadePixels<floatx4>(p, 0, count, cameraPos, lights, tonemap); };
+    auto lane8 = [&](Pixels& p) { ShadePixels<floatx8>(p, 0, count, cameraPos, lights, tonemap); };
+
+    double reference = Measure(scalar, pixels, repeat);
+    std::vector<float> expected[3] = { pixels.outR, pixels.outG, pixels.outB };
+    printf("%zu pixels, %u lights, best of %u%s\n", count, lightCount, repeat,
+#if defined(SHADER_MATH_AVX)
+        ", AVX");
+#else
+        "");
+#endif
+    printf("  %-16s %8.1f Mpix/s\n", "scalar float", count / reference * 1e-6);
+
+    struct Variant {
+        const char* name;
+        double seconds;
+    };
+    Variant variants[] = {
+        { "hlsl float", Measure(lane1, pixels, repeat) },
+        { "hlsl float3x4", Measure(lane4, pixels, repeat) },
+        { "hlsl float3x8", Measure(lane8, pixels, repeat) },
+    };
+    for (Variant& variant : variants) {
+        // Значения от последнего прогона этого варианта.
+        if (&variant == &variants[0]) {
+            lane1(pixels);
+        } else if (&variant == &variants[1]) {
+            lane4(pixels);
+        } else {
+            lane8(pixels);
+        }
+        float maxError = 0.0f;
+        const std::vector<float>* actual[3] = { &pixels.outR, &pixels.outG, &pixels.outB };
+        for (int c = 0; c < 3; c++) {
+            for (size_t i = 0; i < count; i++) {
+                maxError = std::fmax(maxError, std::fabs((*actual[c])[i] - expected[c][i]));
+            }
+        }
+        printf("  %-16s %8.1f Mpix/s  x%.2f  max diff %.2e\n", variant.name, count / variant.seconds * 1e-6,
+            reference / variant.seconds, maxError);
+    }
+    return semantics ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+﻿// Пропускная способность ShadingKernel по источникам и пикселям во всех режимах PS.hlsl и расхождение 8-дорожечной
+// версии с поштучной, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 ShadingBenchMain.cpp ShadingKernel.cpp -o shading
+//   g++ -std=c++14 -O2 -mavx2 -mfma ShadingBenchMain.cpp ShadingKernel.cpp -o shading_avx2
+// Примеры:
+//   ./shading --pixels 262144 --lights 1 4 16 64
+// Сравнение целого кадра с поштучным шейдером и со снимком GPU - SoftwareRenderMain.cpp --scalar-shading и --diff.
+#include "ShadingKernel.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace {
+    const char* modeNames[] = { "DEFAULT", "FRESNEL", "ND", "GEOMETRY" };
+    const soft::ShadingMode modes[] = { soft::ShadingMode::Default, soft::ShadingMode::Fresnel, soft::ShadingMode::ND,
+        soft::ShadingMode::Geometry };
+
+    // Точки на единичной сфере, как сфера сцены Lab5, с разными материалами и произвольными выборками IBL.
+    void MakeBatches(size_t count, std::vector<soft::SurfaceBatch>& batches) {
+        std::mt19937 random(7);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        batches.resize(count / soft::shadingBatch);
+        for (soft::SurfaceBatch& batch : batches) {
+            for (unsigned lane = 0; lane < soft::shadingBatch; lane++) {
+                float z = unit(random) * 2.0f - 1.0f, phi = unit(random) * 6.2831853f;
+                float r = std::sqrt(std::max(1.0f - z * z, 0.0f));
+                float p[3] = { r * std::cos(phi), r * std::sin(phi), z };
+                for (int k = 0; k < 3; k++) {
+                    batch.position[k][lane] = p[k];
+                    batch.normal[k][lane] = p[k];
+                    batch.color[k][lane] = unit(random);
+                    batch.irradiance[k][lane] = unit(random);
+                    batch.prefiltered[k][lane] = unit(random) * 4.0f;
+                }
+                batch.roughness[lane] = std::max(unit(random), 0.0001f);
+                batch.metalness[lane] = unit(random);
+                batch.brdf[0][lane] = unit(random);
+                batch.brdf[1][lane] = unit(random) * 0.1f;
+            }
+        }
+    }
+
+    void MakeLights(unsigned count, soft::LightList& lights) {
+        std::mt19937 random(11);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        lights.Clear();
+        for (unsigned i = 0; i < count; i++) {
+            float z = unit(random) * 2.0f - 1.0f, phi = unit(random) * 6.2831853f;
+            float r = std::sqrt(std::max(1.0f - z * z, 0.0f)), distance = 2.0f + unit(random) * 3.0f;
+            float position[3] = { r * std::cos(phi) * distance, r * std::sin(phi) * distance, z * distance };
+            float color[3] = { unit(random), unit(random), unit(random) };
+            lights.Add(position, color, 5.0f + unit(random) * 20.0f);
+        }
+    }
+
+    template<typename Shade>
+    double Measure(const std::vector<soft::SurfaceBatch>& batches, const soft::LightList& lights, unsigned repeat,
+                   std::vector<float>& colors, Shade shade) {
+        const float camera[3] = { 0.0f, 3.5355339f, -3.5355339f };
+        colors.resize(batches.size() * 3 * soft::shadingBatch);
+        double best = 1e30;
+        for (unsigned r = 0; r < repeat; r++) {
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < batches.size(); i++) {
+                shade(batches[i], camera, lights, reinterpret_cast<float (*)[soft::shadingBatch]>(&colors[i * 3 * soft::shadingBatch]));
+            }
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    }
+
+    // Наибольшее отличие относительно max(|a|, 1e-3): у ND и FRESNEL значения растут до тысяч. В пике GGX при малой
+    // шероховатости знаменатель (nh^2 (r^2 - 1) + 1)^2 теряет разряды, и отличие normalize в последнем бите дает
+    // относительную ошибку порядка 1e-3, поэтому порог 1e-2 - заведомо меньше уровня 8-битного кадра.
+    float MaxRelative(const std::vector<float>& a, const std::vector<float>& b) {
+        float error = 0.0f;
+        for (size_t i = 0; i < a.size(); i++) {
+            error = std::max(error, std::fabs(a[i] - b[i]) / std::max(std::fabs(a[i]), 1e-3f));
+        }
+        return error;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t count = 1 << 18;
+    unsigned repeat = 3;
+    std::vector<unsigned> lightCounts;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--pixels") && i + 1 < argc) {
+            count = (size_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) {
+            repeat = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--lights")) {
+            while (i + 1 < argc && argv[i + 1][0] != '-') {
+                lightCounts.push_back((unsigned)atoi(argv[++i]));
+            }
+        } else {
+            printf("shading [--pixels <n>] [--lights <n>...] [--repeat <n>]\n");
+            return 1;
+        }
+    }
+    if (lightCounts.empty()) {
+        lightCounts = { 1, 4, 16, 64 };
+    }
+    count = std::max<size_t>((count + soft::shadingBatch - 1) / soft::shadingBatch, 1) * soft::shadingBatch;
+    repeat = std::max(repeat, 1u);
+
+    std::vector<soft::SurfaceBatch> batches;
+    MakeBatches(count, batches);
+    soft::LightList lights;
+    std::vector<float> scalarColors, batchColors;
+    bool ok = true;
+    printf("%zu pixels, Mpix/s and Gpix*light/s for the per-pixel and 8-wide kernels\n", count);
+    printf("%-9s %6s %12s %12s %14s %8s %10s\n", "mode", "lights", "scalar", "x8", "x8 pix*light", "speedup", "max rel");
+    for (int m = 0; m < 4; m++) {
+        for (unsigned lightCount : lightCounts) {
+            MakeLights(lightCount, lights);
+            soft::ShadingMode mode = modes[m];
+            double scalar = Measure(batches, lights, repeat, scalarColors,
+                [mode](const soft::SurfaceBatch& batch, const float* camera, const soft::LightList& l, float (*color)[soft::shadingBatch]) {
+                    soft::ShadeBatchScalar(mode, batch, camera, l, color);
+                });
+            double wide = Measure(batches, lights, repeat, batchColors,
+                [mode](const soft::SurfaceBatch& batch, const float* camera, const soft::LightList& l, float (*color)[soft::shadingBatch]) {
+                    soft::ShadeBatch(mode, batch, camera, l, color);
+                });
+            float error = MaxRelative(scalarColors, batchColors);
+            ok = ok && error < 1e-2f;
+            printf("%-9s %6u %12.2f %12.2f %14.3f %7.2fx %10.2e\n", modeNames[m], lightCount, count / scalar * 1e-6,
+                count / wide * 1e-6, count * (double)lightCount / wide * 1e-9, scalar / wide, error);
+        }
+    }
+    printf("x8 vs scalar: %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
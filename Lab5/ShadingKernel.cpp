@@ -0,0 +1,226 @@
+﻿#include "ShadingKernel.h"
+#include "ShaderMath.h"
+
+namespace soft {
+    namespace {
+        using namespace hlsl;
+
+        const float pi = 3.14159265359f;
+
+        // Величины точки, не зависящие от источника.
+        template<typename T>
+        struct Surface {
+            Vector3<T> position, normal, color, view;
+            T roughness, metalness, nv;
+        };
+
+        template<typename T>
+        Surface<T> LoadSurface(const SurfaceBatch& batch, unsigned lane, const float cameraPosition[3]) {
+            Surface<T> s;
+            s.position = Vector3<T>(LaneTraits<T>::Load(&batch.position[0][lane]), LaneTraits<T>::Load(&batch.position[1][lane]),
+                LaneTraits<T>::Load(&batch.position[2][lane]));
+            s.normal = Vector3<T>(LaneTraits<T>::Load(&batch.normal[0][lane]), LaneTraits<T>::Load(&batch.normal[1][lane]),
+                LaneTraits<T>::Load(&batch.normal[2][lane]));
+            s.color = Vector3<T>(LaneTraits<T>::Load(&batch.color[0][lane]), LaneTraits<T>::Load(&batch.color[1][lane]),
+                LaneTraits<T>::Load(&batch.color[2][lane]));
+            s.roughness = LaneTraits<T>::Load(&batch.roughness[lane]);
+            s.metalness = LaneTraits<T>::Load(&batch.metalness[lane]);
+            s.view = normalize(Vector3<T>(T(cameraPosition[0]), T(cameraPosition[1]), T(cameraPosition[2])) - s.position);
+            s.nv = max(dot(s.normal, s.view), T(0.0f));
+            return s;
+        }
+
+        // pow(x, 5) FXC разворачивает в умножения.
+        template<typename T>
+        T Pow5(const T& x) {
+            T x2 = x * x;
+            return x2 * x2 * x;
+        }
+
+        template<typename T>
+        Vector3<T> Fresnel(const Surface<T>& s, const Vector3<T>& h) {
+            Vector3<T> f = Vector3<T>(T(0.04f)) * (T(1.0f) - s.metalness) + s.color * s.metalness;
+            return f + (Vector3<T>(T(1.0f)) - f) * Pow5(T(1.0f) - max(dot(h, s.view), T(0.0f)));
+        }
+
+        template<typename T>
+        T DistributionGGX(const Surface<T>& s, const Vector3<T>& h) {
+            T num = s.roughness * s.roughness;
+            T denom = max(dot(s.normal, h), T(0.0f));
+            denom = denom * denom * (num - T(1.0f)) + T(1.0f);
+            denom = T(pi) * denom * denom;
+            return num / denom;
+        }
+
+        template<typename T>
+        T GeometrySchlickGGX(const T& nv_l, const T& roughness) {
+            T k = roughness + T(1.0f);
+            k = k * k / T(8.0f);
+            return nv_l / (nv_l * (T(1.0f) - k) + k);
+        }
+
+        template<typename T>
+        T GeometrySmith(const Surface<T>& s, const Vector3<T>& l) {
+            return GeometrySchlickGGX(s.nv, s.roughness) * GeometrySchlickGGX(max(dot(s.normal, l), T(0.0f)), s.roughness);
+        }
+
+        // Вклад одного источника: тело цикла CalculateColor для каждого режима.
+        template<ShadingMode mode>
+        struct LightTerm;
+
+        template<>
+        struct LightTerm<ShadingMode::Default> {
+            template<typename T>
+            static Vector3<T> Evaluate(const Surface<T>& s, const Vector3<T>& lightDir, const Vector3<T>& radiance) {
+                Vector3<T> h = normalize((s.view + lightDir) / T(2.0f));
+                Vector3<T> F = Fresnel(s, h);
+                T NDF = DistributionGGX(s, h);
+                T G = GeometrySmith(s, lightDir);
+                Vector3<T> kd = (Vector3<T>(T(1.0f)) - F) * (T(1.0f) - s.metalness);
+                T nl = max(dot(s.normal, lightDir), T(0.0f));
+                return (kd * s.color / T(pi) + NDF * G * F / max(T(4.0f) * s.nv * nl, T(0.0001f))) * radiance * nl;
+            }
+        };
+
+        template<>
+        struct LightTerm<ShadingMode::Fresnel> {
+            template<typename T>
+            static Vector3<T> Evaluate(const Surface<T>& s, const Vector3<T>& lightDir, const Vector3<T>&) {
+                Vector3<T> F = Fresnel(s, normalize((s.view + lightDir) / T(2.0f)));
+                T nl = max(dot(s.normal, lightDir), T(0.0f));
+                return F / max(T(4.0f) * s.nv * nl, T(0.0001f)) * nl;
+            }
+        };
+
+        template<>
+        struct LightTerm<ShadingMode::ND> {
+            template<typename T>
+            static Vector3<T> Evaluate(const Surface<T>& s, const Vector3<T>& lightDir, const Vector3<T>&) {
+                return Vector3<T>(DistributionGGX(s, normalize((s.view + lightDir) / T(2.0f))));
+            }
+        };
+
+        template<>
+        struct LightTerm<ShadingMode::Geometry> {
+            template<typename T>
+            static Vector3<T> Evaluate(const Surface<T>& s, const Vector3<T>& lightDir, const Vector3<T>&) {
+                return Vector3<T>(GeometrySmith(s, lightDir));
+            }
+        };
+
+        // Фоновое освещение есть только в DEFAULT.
+        template<ShadingMode mode>
+        struct AmbientTerm {
+            template<typename T>
+            static Vector3<T> Evaluate(const Surface<T>&, const SurfaceBatch&, unsigned) {
+                return Vector3<T>(T(0.0f));
+            }
+        };
+
+        template<>
+        struct AmbientTerm<ShadingMode::Default> {
+            template<typename T>
+            static Vector3<T> Evaluate(const Surface<T>& s, const SurfaceBatch& batch, unsigned lane) {
+                Vector3<T> prefilteredColor(LaneTraits<T>::Load(&batch.prefiltered[0][lane]),
+                    LaneTraits<T>::Load(&batch.prefiltered[1][lane]), LaneTraits<T>::Load(&batch.prefiltered[2][lane]));
+                Vector3<T> irradiance(LaneTraits<T>::Load(&batch.irradiance[0][lane]), LaneTraits<T>::Load(&batch.irradiance[1][lane]),
+                    LaneTraits<T>::Load(&batch.irradiance[2][lane]));
+                T scale = LaneTraits<T>::Load(&batch.brdf[0][lane]), bias = LaneTraits<T>::Load(&batch.brdf[1][lane]);
+
+                Vector3<T> F0 = lerp(Vector3<T>(T(0.04f)), s.color, s.metalness);
+                Vector3<T> specular = prefilteredColor * (F0 * scale + bias);
+                // fresnelRoughnessFunction
+                Vector3<T> f = Vector3<T>(T(0.04f)) * (T(1.0f) - s.metalness) + s.color * s.metalness;
+                Vector3<T> FR = f + (max(Vector3<T>(T(1.0f) - s.roughness), f) - f) * Pow5(T(1.0f) - s.nv);
+                Vector3<T> kD = (Vector3<T>(T(1.0f)) - FR) * (T(1.0f) - s.metalness);
+                return irradiance * s.color * kD + specular;
+            }
+        };
+
+        // Дорожки lane .. lane + LaneTraits<T>::count - 1.
+        template<ShadingMode mode, typename T>
+        void Shade(const SurfaceBatch& batch, unsigned lane, const float cameraPosition[3], const LightList& lights,
+                   float color[3][shadingBatch]) {
+            Surface<T> s = LoadSurface<T>(batch, lane, cameraPosition);
+            Vector3<T> finalColor = AmbientTerm<mode>::Evaluate(s, batch, lane);
+            for (size_t i = 0; i < lights.Size(); i++) {
+                Vector3<T> lightDir = Vector3<T>(T(lights.position[0][i]), T(lights.position[1][i]), T(lights.position[2][i])) - s.position;
+                T lightDist = length(lightDir);
+                lightDir /= lightDist;
+                T atten = clamp(T(1.0f) / (lightDist * lightDist), T(0.0f), T(1.0f));
+                Vector3<T> radiance = Vector3<T>(T(lights.radiance[0][i]), T(lights.radiance[1][i]), T(lights.radiance[2][i])) * atten;
+                finalColor += LightTerm<mode>::Evaluate(s, lightDir, radiance);
+            }
+            LaneTraits<T>::Store(finalColor.x, &color[0][lane]);
+            LaneTraits<T>::Store(finalColor.y, &color[1][lane]);
+            LaneTraits<T>::Store(finalColor.z, &color[2][lane]);
+        }
+
+        template<ShadingMode mode>
+        void ShadeScalar(const SurfaceBatch& batch, const float cameraPosition[3], const LightList& lights, float color[3][shadingBatch]) {
+            for (unsigned lane = 0; lane < shadingBatch; lane++) {
+                Shade<mode, float>(batch, lane, cameraPosition, lights, color);
+            }
+        }
+    }
+
+    void LightList::Clear() {
+        for (int k = 0; k < 3; k++) {
+            position[k].clear();
+            radiance[k].clear();
+        }
+    }
+
+    void LightList::Add(const float lightPosition[3], const float color[3], float brightness) {
+        for (int k = 0; k < 3; k++) {
+            position[k].push_back(lightPosition[k]);
+            radiance[k].push_back(color[k] * brightness);
+        }
+    }
+
+    void ReflectionVectors(const SurfaceBatch& batch, const float cameraPosition[3], float reflection[3][shadingBatch],
+                           float nv[shadingBatch]) {
+        Surface<floatx8> s = LoadSurface<floatx8>(batch, 0, cameraPosition);
+        float3x8 r = reflect(-s.view, s.normal);
+        r.x.Store(reflection[0]);
+        r.y.Store(reflection[1]);
+        r.z.Store(reflection[2]);
+        s.nv.Store(nv);
+    }
+
+    void ShadeBatch(ShadingMode mode, const SurfaceBatch& batch, const float cameraPosition[3], const LightList& lights,
+                    float color[3][shadingBatch]) {
+        switch (mode) {
+        case ShadingMode::Default:
+            Shade<ShadingMode::Default, floatx8>(batch, 0, cameraPosition, lights, color);
+            break;
+        case ShadingMode::Fresnel:
+            Shade<ShadingMode::Fresnel, floatx8>(batch, 0, cameraPosition, lights, color);
+            break;
+        case ShadingMode::ND:
+            Shade<ShadingMode::ND, floatx8>(batch, 0, cameraPosition, lights, color);
+            break;
+        case ShadingMode::Geometry:
+            Shade<ShadingMode::Geometry, floatx8>(batch, 0, cameraPosition, lights, color);
+            break;
+        }
+    }
+
+    void ShadeBatchScalar(ShadingMode mode, const SurfaceBatch& batch, const float cameraPosition[3], const LightList& lights,
+                          float color[3][shadingBatch]) {
+        switch (mode) {
+        case ShadingMode::Default:
+            ShadeScalar<ShadingMode::Default>(batch, cameraPosition, lights, color);
+            break;
+        case ShadingMode::Fresnel:
+            ShadeScalar<ShadingMode::Fresnel>(batch, cameraPosition, lights, color);
+            break;
+        case ShadingMode::ND:
+            ShadeScalar<ShadingMode::ND>(batch, cameraPosition, lights, color);
+            break;
+        case ShadingMode::Geometry:
+            ShadeScalar<ShadingMode::Geometry>(batch, cameraPosition, lights, color);
+            break;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// CalculateColor из LightCalc.h на CPU сразу для 8 точек поверхности (структура массивов, ShaderMath.h).
+// Режимы - специализации шаблона, поэтому в FRESNEL, ND и GEOMETRY лишние члены не вычисляются. Число источников
+// не ограничено. Текстуры split-sum IBL (режим DEFAULT) выбирает вызывающий: ReflectionVectors дает
+// направления и nv, по которым в шейдере читаются prefilteredTexture и brdfTexture.
+namespace soft {
+    static const unsigned shadingBatch = 8;
+
+    // Макросы DEFAULT, FRESNEL, ND и GEOMETRY, с которыми Renderer компилирует PS.hlsl.
+    enum class ShadingMode {
+        Default,
+        Fresnel,
+        ND,
+        Geometry
+    };
+
+    // Компоненты по дорожкам: position[0][lane] - x точки lane. Нормали нормированы, roughness и metalness
+    // ограничены, как в PS.hlsl. Неиспользуемые дорожки нужно заполнить допустимыми значениями.
+    struct SurfaceBatch {
+        float position[3][shadingBatch];
+        float normal[3][shadingBatch];
+        float color[3][shadingBatch];
+        float roughness[shadingBatch];
+        float metalness[shadingBatch];
+        // Только для DEFAULT: irradianceTexture по нормали, prefilteredTexture по отражению и brdfTexture (масштаб
+        // и смещение F0).
+        float irradiance[3][shadingBatch];
+        float prefiltered[3][shadingBatch];
+        float brdf[2][shadingBatch];
+    };
+
+    // Источники по компонентам; radiance - lightColor.xyz * lightColor.w.
+    struct LightList {
+        std::vector<float> position[3];
+        std::vector<float> radiance[3];
+
+        void Clear();
+        void Add(const float lightPosition[3], const float color[3], float brightness);
+
+        size_t Size() const {
+            return position[0].size();
+        }
+    };
+
+    // reflect(-viewDir, objNormal) и max(dot(objNormal, viewDir), 0) для выборок IBL.
+    void ReflectionVectors(const SurfaceBatch& batch, const float cameraPosition[3], float reflection[3][shadingBatch],
+                           float nv[shadingBatch]);
+
+    // Цвет CalculateColor для 8 точек.
+    void ShadeBatch(ShadingMode mode, const SurfaceBatch& batch, const float cameraPosition[3], const LightList& lights,
+                    float color[3][shadingBatch]);
+    // Та же формула по одной точке без SIMD.
+    void ShadeBatchScalar(ShadingMode mode, const SurfaceBatch& batch, const float cameraPosition[3], const LightList& lights,
+                          float color[3][shadingBatch]);
+}
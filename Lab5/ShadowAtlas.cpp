@@ -0,0 +1,303 @@
+﻿#include "ShadowAtlas.h"
+#include <cmath>
+#include <algorithm>
+
+namespace lighting {
+    namespace {
+        unsigned Log2(unsigned value) {
+            unsigned log = 0;
+            while (value > 1) {
+                value >>= 1;
+                log++;
+            }
+            return log;
+        }
+
+        unsigned FloorPow2(unsigned value) {
+            return value == 0 ? 0 : 1u << Log2(value);
+        }
+
+        void Add(ShadowAtlasStats& to, size_t ShadowAtlasStats::* field, size_t count) {
+            to.*field += count;
+        }
+    }
+
+    void ShadowAtlas::Init(const ShadowAtlasDesc& desc) {
+        desc_ = desc;
+        desc_.size = std::max(FloorPow2(desc.size), 1u);
+        desc_.maxTile = std::min(std::max(FloorPow2(desc.maxTile), 1u), desc_.size);
+        desc_.minTile = std::min(std::max(FloorPow2(desc.minTile), 1u), desc_.maxTile);
+        desc_.budgetTexels = std::min(desc.budgetTexels, (size_t)desc_.size * desc_.size);
+        levels_ = Log2(desc_.size / desc_.minTile) + 1;
+        Clear();
+    }
+
+    void ShadowAtlas::Clear() {
+        states_.assign(levels_, std::vector<uint8_t>());
+        free_.assign(levels_, std::set<uint32_t>());
+        for (unsigned level = 0; level < levels_; level++) {
+            size_t side = (size_t)1 << level;
+            states_[level].assign(side * side, Unused);
+        }
+        states_[0][0] = Free;
+        free_[0].insert(0);
+        entries_.clear();
+        lru_.clear();
+        allocatedTexels_ = 0;
+    }
+
+    unsigned ShadowAtlas::LevelOf(unsigned tileSize) const {
+        tileSize = std::min(std::max(FloorPow2(tileSize), desc_.minTile), desc_.maxTile);
+        return Log2(desc_.size / tileSize);
+    }
+
+    unsigned ShadowAtlas::TileSizeFor(float screenRadius) const {
+        unsigned size = desc_.minTile;
+        while (size < desc_.maxTile && (float)size < screenRadius) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    // Свободный узел уровня или деление ближайшего свободного узла крупнее.
+    bool ShadowAtlas::AllocateNode(unsigned level, uint32_t& node) {
+        unsigned from = level + 1;
+        while (from-- > 0) {
+            if (!free_[from].empty())
+                break;
+        }
+        if (from > level || free_[from].empty())
+            return false;
+        uint32_t current = *free_[from].begin();
+        free_[from].erase(free_[from].begin());
+        for (unsigned l = from; l < level; l++) {
+            states_[l][current] = Split;
+            // Дети узла (x, y) уровня l - (2x + i, 2y + j) уровня l + 1.
+            uint32_t side = 1u << l, x = current % side, y = current / side, childSide = side * 2;
+            uint32_t first = (2 * y) * childSide + 2 * x;
+            uint32_t children[4] = { first, first + 1, first + childSide, first + childSide + 1 };
+            for (int c = 1; c < 4; c++) {
+                states_[l + 1][children[c]] = Free;
+                free_[l + 1].insert(children[c]);
+            }
+            current = children[0];
+        }
+        states_[level][current] = Allocated;
+        node = current;
+        return true;
+    }
+
+    void ShadowAtlas::FreeNode(unsigned level, uint32_t node) {
+        states_[level][node] = Free;
+        free_[level].insert(node);
+        // Слияние с соседями вверх по дереву.
+        while (level > 0) {
+            uint32_t side = 1u << level, x = node % side & ~1u, y = node / side & ~1u;
+            uint32_t first = y * side + x;
+            uint32_t siblings[4] = { first, first + 1, first + side, first + side + 1 };
+            for (uint32_t sibling : siblings) {
+                if (states_[level][sibling] != Free)
+                    return;
+            }
+            for (uint32_t sibling : siblings) {
+                states_[level][sibling] = Unused;
+                free_[level].erase(sibling);
+            }
+            level--;
+            node = (y / 2) * (side / 2) + x / 2;
+            states_[level][node] = Free;
+            free_[level].insert(node);
+        }
+    }
+
+    // Шесть плиток или ни одной.
+    bool ShadowAtlas::AllocateFaces(unsigned level, uint32_t nodes[6]) {
+        for (int face = 0; face < 6; face++) {
+            if (!AllocateNode(level, nodes[face])) {
+                while (face-- > 0) {
+                    FreeNode(level, nodes[face]);
+                }
+                return false;
+            }
+        }
+        size_t tile = desc_.size >> level;
+        allocatedTexels_ += 6 * tile * tile;
+        return true;
+    }
+
+    void ShadowAtlas::FreeEntry(Entry& entry) {
+        for (int face = 0; face < 6; face++) {
+            FreeNode(entry.level, entry.nodes[face]);
+        }
+        size_t tile = desc_.size >> entry.level;
+        allocatedTexels_ -= 6 * tile * tile;
+    }
+
+    bool ShadowAtlas::EvictOldest() {
+        if (lru_.empty())
+            return false;
+        uint32_t light = lru_.front();
+        auto found = entries_.find(light);
+        if (found->second.lastFrame == frame_)
+            return false;
+        FreeEntry(found->second);
+        lru_.pop_front();
+        entries_.erase(found);
+        stats_.evictions++;
+        frameStats_.evictions++;
+        return true;
+    }
+
+    void ShadowAtlas::BeginFrame() {
+        frame_++;
+        frameStats_ = ShadowAtlasStats();
+    }
+
+    bool ShadowAtlas::Request(const ShadowRequest& request, ShadowResult& result) {
+        auto count = [this](size_t ShadowAtlasStats::* field, size_t value) {
+            Add(stats_, field, value);
+            Add(frameStats_, field, value);
+        };
+        count(&ShadowAtlasStats::requests, 1);
+        count(&ShadowAtlasStats::requestedFaces, 6);
+        result.renderMask = 0;
+        result.allocated = false;
+
+        unsigned level = LevelOf(request.tileSize);
+        auto found = entries_.find(request.light);
+        if (found != entries_.end()) {
+            Entry& entry = found->second;
+            lru_.splice(lru_.end(), lru_, entry.lru);
+            entry.lastFrame = frame_;
+            float moved = std::max(std::max(std::fabs(entry.position[0] - request.position[0]),
+                std::fabs(entry.position[1] - request.position[1])), std::max(std::fabs(entry.position[2] - request.position[2]),
+                std::fabs(entry.radius - request.radius)));
+            if (moved > desc_.moveTolerance) {
+                entry.valid = false;
+            }
+            // Плитки вдвое больше нужных остаются, пока хватает места: так источник на границе двух размеров
+            // не перерисовывается каждый кадр.
+            if (entry.level != level && entry.level + 1 != level) {
+                FreeEntry(entry);
+                lru_.erase(entry.lru);
+                entries_.erase(found);
+                found = entries_.end();
+            }
+        }
+
+        if (found == entries_.end()) {
+            size_t need = 6 * (size_t)(desc_.size >> level) * (desc_.size >> level);
+            Entry entry;
+            bool allocated = false;
+            while (!allocated) {
+                if (allocatedTexels_ + need <= desc_.budgetTexels && AllocateFaces(level, entry.nodes)) {
+                    allocated = true;
+                } else if (!EvictOldest()) {
+                    // Вытеснять нечего - плитки меньше, пока есть куда уменьшать.
+                    if (level + 1 >= levels_)
+                        break;
+                    level++;
+                    need /= 4;
+                    count(&ShadowAtlasStats::downgrades, 1);
+                }
+            }
+            if (!allocated) {
+                count(&ShadowAtlasStats::failures, 1);
+                return false;
+            }
+            count(&ShadowAtlasStats::reallocations, 1);
+            std::copy(request.position, request.position + 3, entry.position);
+            entry.radius = request.radius;
+            entry.level = level;
+            entry.valid = false;
+            entry.lastFrame = frame_;
+            entry.lru = lru_.insert(lru_.end(), request.light);
+            found = entries_.emplace(request.light, entry).first;
+        }
+
+        Entry& entry = found->second;
+        uint16_t tile = (uint16_t)(desc_.size >> entry.level);
+        uint32_t side = 1u << entry.level;
+        for (int face = 0; face < 6; face++) {
+            result.faces[face].x = (uint16_t)(entry.nodes[face] % side * tile);
+            result.faces[face].y = (uint16_t)(entry.nodes[face] / side * tile);
+            result.faces[face].size = tile;
+        }
+        result.renderMask = entry.valid ? (uint8_t)(request.dynamicFaces & 0x3F) : (uint8_t)0x3F;
+        result.allocated = true;
+        if (!entry.valid) {
+            std::copy(request.position, request.position + 3, entry.position);
+            entry.radius = request.radius;
+            entry.valid = true;
+        }
+        size_t rendered = 0;
+        for (int face = 0; face < 6; face++) {
+            rendered += (result.renderMask >> face) & 1;
+        }
+        count(&ShadowAtlasStats::renderedFaces, rendered);
+        count(&ShadowAtlasStats::cachedFaces, 6 - rendered);
+        return true;
+    }
+
+    size_t ShadowAtlas::RequestFrame(const ShadowRequest* requests, size_t count, ShadowResult* results) {
+        std::vector<unsigned> levels(levels_, 0);
+        order_.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            order_[i] = (uint32_t)i;
+            levels[LevelOf(requests[i].tileSize)]++;
+        }
+        // Наименьший сдвиг уровней, при котором все грани входят в бюджет.
+        unsigned shift = 0;
+        for (;; shift++) {
+            size_t texels = 0;
+            for (unsigned level = 0; level < levels_; level++) {
+                size_t tile = desc_.size >> std::min(level + shift, levels_ - 1);
+                texels += levels[level] * 6 * tile * tile;
+            }
+            if (texels <= desc_.budgetTexels || shift >= levels_)
+                break;
+        }
+        std::stable_sort(order_.begin(), order_.end(), [requests](uint32_t a, uint32_t b) {
+            return requests[a].tileSize > requests[b].tileSize;
+        });
+        size_t allocated = 0;
+        for (uint32_t i : order_) {
+            ShadowRequest request = requests[i];
+            request.tileSize = desc_.size >> std::min(LevelOf(request.tileSize) + shift, levels_ - 1);
+            allocated += Request(request, results[i]);
+        }
+        return allocated;
+    }
+
+    void ShadowAtlas::Invalidate(uint32_t light) {
+        auto found = entries_.find(light);
+        if (found != entries_.end()) {
+            found->second.valid = false;
+        }
+    }
+
+    void ShadowAtlas::InvalidateBox(const float boxMin[3], const float boxMax[3]) {
+        for (auto& item : entries_) {
+            Entry& entry = item.second;
+            float distance2 = 0.0f;
+            for (int k = 0; k < 3; k++) {
+                float d = std::max(std::max(boxMin[k] - entry.position[k], entry.position[k] - boxMax[k]), 0.0f);
+                distance2 += d * d;
+            }
+            if (entry.valid && distance2 <= entry.radius * entry.radius) {
+                entry.valid = false;
+                stats_.invalidations++;
+                frameStats_.invalidations++;
+            }
+        }
+    }
+
+    void ShadowAtlas::Release(uint32_t light) {
+        auto found = entries_.find(light);
+        if (found == entries_.end())
+            return;
+        FreeEntry(found->second);
+        lru_.erase(found->second.lru);
+        entries_.erase(found);
+    }
+}
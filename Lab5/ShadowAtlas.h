@@ -0,0 +1,141 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+
+// Атлас теней точечных источников: шесть граней куба на источник, все грани источника одного размера. Размер
+// (степень двойки от minTile до maxTile) выбирает вызывающий по важности источника на экране, TileSizeFor.
+// Место выделяется квадродеревом: свободный узел делится на четыре, четыре свободных соседа сливаются обратно.
+//
+// Грани со статической геометрией не перерисовываются, пока не сдвинулся источник, не изменился размер плиток
+// или InvalidateBox не сообщил о движении геометрии в сфере источника. Грани с динамическими объектами
+// (dynamicFaces) рисуются каждый кадр целиком. Источники, не запрошенные в текущем кадре, вытесняются в порядке
+// давности использования, когда не хватает места в атласе или бюджета памяти. Не зависит от D3D и собирается
+// на Linux (см. ShadowAtlasBenchMain.cpp).
+namespace lighting {
+    struct ShadowAtlasDesc {
+        unsigned size = 8192;
+        unsigned minTile = 64;
+        unsigned maxTile = 1024;
+        size_t budgetTexels = 8192u * 8192u;    // не больше size * size
+        float moveTolerance = 1e-4f;            // сдвиг источника или изменение радиуса, после которого грани устаревают
+    };
+
+    struct AtlasRect {
+        uint16_t x;
+        uint16_t y;
+        uint16_t size;
+    };
+
+    struct ShadowRequest {
+        uint32_t light = 0;                     // постоянный номер источника
+        float position[3] = { 0.0f, 0.0f, 0.0f };
+        float radius = 0.0f;
+        unsigned tileSize = 0;                  // TileSizeFor
+        uint8_t dynamicFaces = 0;               // бит i - в грань i попадают движущиеся объекты
+    };
+
+    struct ShadowResult {
+        AtlasRect faces[6];
+        uint8_t renderMask = 0;                 // грани, которые нужно нарисовать в этом кадре
+        bool allocated = false;                 // false - источник в этом кадре без тени
+    };
+
+    struct ShadowAtlasStats {
+        size_t requests = 0;
+        size_t requestedFaces = 0;
+        size_t renderedFaces = 0;
+        size_t cachedFaces = 0;                 // взяты из атласа без перерисовки
+        size_t reallocations = 0;               // новые плитки: первый запрос или другой размер
+        size_t downgrades = 0;                  // плитки меньше запрошенных из-за нехватки места
+        size_t evictions = 0;
+        size_t failures = 0;
+        size_t invalidations = 0;               // источников, устаревших из-за InvalidateBox
+    };
+
+    class ShadowAtlas {
+    public:
+        void Init(const ShadowAtlasDesc& desc);
+
+        // Степень двойки не меньше радиуса источника на экране в пикселях, в пределах [minTile, maxTile].
+        unsigned TileSizeFor(float screenRadius) const;
+
+        // Начало кадра: источники, запрошенные до этого, становятся кандидатами на вытеснение.
+        void BeginFrame();
+        // Плитки граней источника и грани, которые нужно перерисовать. Вызывающий рисует их в этом кадре.
+        bool Request(const ShadowRequest& request, ShadowResult& result);
+        // Все источники кадра после BeginFrame. Если запрошенные плитки не входят в бюджет, все размеры уменьшаются
+        // вдвое (не меньше minTile), пока сумма не войдет. Запросы выполняются от крупных плиток к мелким, так
+        // квадродерево меньше дробится. Возвращает число источников с плитками.
+        size_t RequestFrame(const ShadowRequest* requests, size_t count, ShadowResult* results);
+        void Invalidate(uint32_t light);
+        // Статическая геометрия в параллелепипеде сдвинулась: устаревают источники, чьи сферы его задевают.
+        void InvalidateBox(const float boxMin[3], const float boxMax[3]);
+        void Release(uint32_t light);
+        void Clear();
+
+        const ShadowAtlasStats& GetStats() const {
+            return stats_;
+        };
+
+        // Статистика с начала кадра.
+        const ShadowAtlasStats& GetFrameStats() const {
+            return frameStats_;
+        };
+
+        size_t GetAllocatedTexels() const {
+            return allocatedTexels_;
+        };
+
+        size_t GetLightCount() const {
+            return entries_.size();
+        };
+
+        const ShadowAtlasDesc& GetDesc() const {
+            return desc_;
+        };
+
+    private:
+        struct Entry {
+            float position[3];
+            float radius;
+            unsigned level;                     // уровень квадродерева плиток
+            uint32_t nodes[6];
+            bool valid;                         // статическое содержимое граней нарисовано
+            uint64_t lastFrame;
+            std::list<uint32_t>::iterator lru;
+        };
+
+        enum NodeState : uint8_t {
+            Unused,                             // покрыт выделенным или свободным предком
+            Free,
+            Split,
+            Allocated
+        };
+
+        unsigned LevelOf(unsigned tileSize) const;
+        bool AllocateNode(unsigned level, uint32_t& node);
+        void FreeNode(unsigned level, uint32_t node);
+        bool AllocateFaces(unsigned level, uint32_t nodes[6]);
+        void FreeEntry(Entry& entry);
+        // Вытесняет самый давний источник, не запрошенный в этом кадре. false, если таких нет.
+        bool EvictOldest();
+
+        ShadowAtlasDesc desc_;
+        unsigned levels_ = 0;                   // уровень 0 - весь атлас, уровень l - плитки size >> l
+        std::vector<std::vector<uint8_t>> states_;
+        std::vector<std::set<uint32_t>> free_;  // свободные узлы уровня; первым берется верхний левый
+        std::unordered_map<uint32_t, Entry> entries_;
+        std::list<uint32_t> lru_;               // от давно использованных к недавним
+        std::vector<uint32_t> order_;           // порядок запросов RequestFrame
+        size_t allocatedTexels_ = 0;
+        uint64_t frame_ = 0;
+        ShadowAtlasStats stats_;
+        ShadowAtlasStats frameStats_;
+    };
+}
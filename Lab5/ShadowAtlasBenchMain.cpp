@@ -0,0 +1,311 @@
+﻿// Проверка и замер ShadowAtlas, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 ShadowAtlasBenchMain.cpp ShadowAtlas.cpp -o shadowatlas
+// Примеры:
+//   ./shadowatlas --lights 2000
+//   ./shadowatlas --lights 2000 --moving 0.2 --budget 0.5
+// Сцена - источники на площадке 200 x 200, камера идет по кругу, часть источников движется, у камеры ходит
+// персонаж (динамические грани), раз в секунду сдвигается статический объект. Без кеша каждый видимый
+// источник рисовал бы все шесть граней каждый кадр.
+#include "ShadowAtlas.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace {
+    bool Check(bool condition, const char* what) {
+        if (!condition) {
+            printf("FAILED: %s\n", what);
+        }
+        return condition;
+    }
+
+    lighting::ShadowRequest MakeRequest(uint32_t light, float x, float z, float radius, unsigned tileSize) {
+        lighting::ShadowRequest request;
+        request.light = light;
+        request.position[0] = x;
+        request.position[1] = 2.0f;
+        request.position[2] = z;
+        request.radius = radius;
+        request.tileSize = tileSize;
+        return request;
+    }
+
+    // Плитки выделенных источников внутри атласа и не перекрываются; сумма площадей равна GetAllocatedTexels.
+    bool CheckLayout(const lighting::ShadowAtlas& atlas, const std::vector<lighting::ShadowResult>& results) {
+        const lighting::ShadowAtlasDesc& desc = atlas.GetDesc();
+        unsigned cells = desc.size / desc.minTile;
+        std::vector<uint8_t> used(cells * cells, 0);
+        size_t texels = 0;
+        for (const lighting::ShadowResult& result : results) {
+            if (!result.allocated)
+                continue;
+            for (const lighting::AtlasRect& rect : result.faces) {
+                if (rect.x % rect.size || rect.y % rect.size || rect.x + rect.size > desc.size ||
+                    rect.y + rect.size > desc.size)
+                    return false;
+                texels += (size_t)rect.size * rect.size;
+                for (unsigned y = rect.y / desc.minTile; y < (rect.y + rect.size) / desc.minTile; y++) {
+                    for (unsigned x = rect.x / desc.minTile; x < (rect.x + rect.size) / desc.minTile; x++) {
+                        if (used[y * cells + x]++)
+                            return false;
+                    }
+                }
+            }
+        }
+        return texels == atlas.GetAllocatedTexels() && texels <= desc.budgetTexels;
+    }
+
+    // Случайные запросы, смена размеров и освобождения; после освобождения всего атлас снова собирается в
+    // крупные плитки.
+    bool CheckAllocator() {
+        lighting::ShadowAtlasDesc desc;
+        desc.size = 2048;
+        desc.minTile = 32;
+        desc.maxTile = 512;
+        lighting::ShadowAtlas atlas;
+        atlas.Init(desc);
+        std::mt19937 random(5);
+        const uint32_t lights = 64;
+        std::vector<lighting::ShadowResult> results(lights);
+        bool ok = true;
+        for (int step = 0; step < 4000 && ok; step++) {
+            if (step % 16 == 0) {
+                atlas.BeginFrame();
+            }
+            uint32_t light = random() % lights;
+            if (random() % 4 == 0) {
+                atlas.Release(light);
+                results[light].allocated = false;
+            } else {
+                unsigned tile = desc.minTile << (random() % 5);
+                atlas.Request(MakeRequest(light, 0.0f, 0.0f, 1.0f, tile), results[light]);
+            }
+            if (atlas.GetFrameStats().evictions) {
+                // Плитки вытесненных источников в results устарели: все источники запрашиваются заново в новом
+                // кадре. Вытеснен может быть только еще не запрошенный, он получит плитки позже в этом же проходе.
+                atlas.BeginFrame();
+                for (uint32_t other = 0; other < lights; other++) {
+                    if (results[other].allocated) {
+                        atlas.Request(MakeRequest(other, 0.0f, 0.0f, 1.0f, results[other].faces[0].size), results[other]);
+                    }
+                }
+            }
+            ok = Check(CheckLayout(atlas, results), "tiles overlap or exceed the atlas");
+        }
+        for (uint32_t light = 0; light < lights; light++) {
+            atlas.Release(light);
+        }
+        ok = ok && Check(atlas.GetAllocatedTexels() == 0 && atlas.GetLightCount() == 0, "release leaves tiles");
+        // 2048^2 / (6 * 512^2) - две группы граней 512 без уменьшения, только если все свободные узлы слились.
+        atlas.BeginFrame();
+        lighting::ShadowAtlasStats before = atlas.GetStats();
+        lighting::ShadowResult result;
+        ok = ok && Check(atlas.Request(MakeRequest(1000, 0.0f, 0.0f, 1.0f, 512), result) &&
+            atlas.Request(MakeRequest(1001, 0.0f, 0.0f, 1.0f, 512), result) &&
+            atlas.GetStats().downgrades == before.downgrades, "free tiles did not merge");
+        printf("Allocator: %zu requests, %zu reallocations, %zu downgrades, %zu evictions\n", atlas.GetStats().requests,
+            atlas.GetStats().reallocations, atlas.GetStats().downgrades, atlas.GetStats().evictions);
+        return ok;
+    }
+
+    // Кеш граней: повтор, сдвиг источника, динамические грани, InvalidateBox, смена размера.
+    bool CheckCaching() {
+        lighting::ShadowAtlasDesc desc;
+        desc.size = 4096;
+        lighting::ShadowAtlas atlas;
+        atlas.Init(desc);
+        lighting::ShadowResult result;
+        lighting::ShadowRequest request = MakeRequest(1, 10.0f, 10.0f, 5.0f, 256);
+        atlas.BeginFrame();
+        bool ok = Check(atlas.Request(request, result) && result.renderMask == 0x3F, "first request renders all faces");
+        atlas.BeginFrame();
+        ok = ok && Check(atlas.Request(request, result) && result.renderMask == 0, "static light is not cached");
+        request.dynamicFaces = 0x05;
+        atlas.BeginFrame();
+        ok = ok && Check(atlas.Request(request, result) && result.renderMask == 0x05, "dynamic faces are not rendered");
+        request.dynamicFaces = 0;
+        request.position[0] += 0.5f;
+        atlas.BeginFrame();
+        ok = ok && Check(atlas.Request(request, result) && result.renderMask == 0x3F, "moved light is cached");
+        float farMin[3] = { 30.0f, 0.0f, 30.0f }, farMax[3] = { 31.0f, 1.0f, 31.0f };
+        atlas.InvalidateBox(farMin, farMax);
+        atlas.BeginFrame();
+        ok = ok && Check(atlas.Request(request, result) && result.renderMask == 0, "far box invalidated the light");
+        float nearMin[3] = { 13.0f, 0.0f, 9.0f }, nearMax[3] = { 14.0f, 1.0f, 11.0f };
+        atlas.InvalidateBox(nearMin, nearMax);
+        atlas.BeginFrame();
+        ok = ok && Check(atlas.Request(request, result) && result.renderMask == 0x3F, "near box did not invalidate");
+        // Вдвое меньший размер оставляет плитки, вчетверо меньший - нет.
+        request.tileSize = 128;
+        atlas.BeginFrame();
+        ok = ok && Check(atlas.Request(request, result) && result.renderMask == 0 && result.faces[0].size == 256,
+            "halved tile size reallocated");
+        request.tileSize = 64;
+        atlas.BeginFrame();
+        ok = ok && Check(atlas.Request(request, result) && result.renderMask == 0x3F && result.faces[0].size == 64,
+            "quartered tile size kept old tiles");
+        printf("Caching: %zu faces requested, %zu rendered, %zu cached\n", atlas.GetStats().requestedFaces,
+            atlas.GetStats().renderedFaces, atlas.GetStats().cachedFaces);
+        return ok;
+    }
+
+    // Бюджет на три источника с плитками 256 и один с плитками 128: вытесняется давно не запрошенный,
+    // запрошенные в кадре - никогда, вместо этого плитки уменьшаются, а если некуда - источник остается без тени.
+    bool CheckEviction() {
+        lighting::ShadowAtlasDesc desc;
+        desc.size = 2048;
+        desc.minTile = 64;
+        desc.maxTile = 256;
+        desc.budgetTexels = 3 * 6 * 256 * 256 + 6 * 128 * 128;
+        lighting::ShadowAtlas atlas;
+        atlas.Init(desc);
+        lighting::ShadowResult result;
+        atlas.BeginFrame();
+        for (uint32_t light = 0; light < 3; light++) {
+            atlas.Request(MakeRequest(light, 0.0f, 0.0f, 1.0f, 256), result);
+        }
+        atlas.BeginFrame();
+        atlas.Request(MakeRequest(0, 0.0f, 0.0f, 1.0f, 256), result);
+        atlas.BeginFrame();
+        atlas.Request(MakeRequest(3, 0.0f, 0.0f, 1.0f, 256), result);
+        bool ok = Check(atlas.GetStats().evictions == 1 && atlas.GetLightCount() == 3, "one light evicted");
+        atlas.BeginFrame();
+        ok = ok && Check(atlas.Request(MakeRequest(0, 0.0f, 0.0f, 1.0f, 256), result) && result.renderMask == 0,
+            "recently used light evicted");
+        ok = ok && Check(atlas.Request(MakeRequest(2, 0.0f, 0.0f, 1.0f, 256), result) && result.renderMask == 0,
+            "second oldest light evicted");
+        ok = ok && Check(atlas.Request(MakeRequest(3, 0.0f, 0.0f, 1.0f, 256), result) && result.renderMask == 0,
+            "new light evicted");
+        ok = ok && Check(atlas.Request(MakeRequest(1, 0.0f, 0.0f, 1.0f, 256), result) && result.renderMask == 0x3F &&
+            result.faces[0].size == 128, "oldest light kept or not downgraded");
+        ok = ok && Check(!atlas.Request(MakeRequest(4, 0.0f, 0.0f, 1.0f, 256), result) && !result.allocated,
+            "light beyond the budget got tiles");
+        ok = ok && Check(atlas.GetFrameStats().evictions == 0 && atlas.GetAllocatedTexels() == desc.budgetTexels,
+            "light of this frame evicted");
+        printf("Eviction: %zu evictions, %zu downgrades, %zu of %zu texels\n", atlas.GetStats().evictions,
+            atlas.GetStats().downgrades, atlas.GetAllocatedTexels(), desc.budgetTexels);
+        return ok;
+    }
+
+    struct SceneLight {
+        float x, z, radius;
+        float orbit, speed, phase;
+    };
+
+    struct SceneResult {
+        lighting::ShadowAtlasStats stats;
+        double frameMs;
+        size_t peakTexels;
+        bool ok;
+    };
+
+    SceneResult RunScene(const std::vector<SceneLight>& lights, const lighting::ShadowAtlasDesc& desc, unsigned frames) {
+        lighting::ShadowAtlas atlas;
+        atlas.Init(desc);
+        SceneResult scene = {};
+        scene.ok = true;
+        std::vector<lighting::ShadowRequest> requests;
+        std::vector<lighting::ShadowResult> results;
+        const float focal = 1080.0f / (2.0f * std::tan(3.14159265f / 6.0f));    // fov 60, 1080 строк
+        double total = 0.0;
+        for (unsigned frame = 0; frame < frames; frame++) {
+            float time = frame / 60.0f;
+            float camera[3] = { 60.0f * std::cos(time * 0.1f), 2.0f, 60.0f * std::sin(time * 0.1f) };
+            float forward[2] = { -std::sin(time * 0.1f), std::cos(time * 0.1f) };
+            float character[2] = { camera[0] + forward[0] * 6.0f + std::sin(time * 2.0f), camera[2] + forward[1] * 6.0f };
+            auto start = std::chrono::steady_clock::now();
+            atlas.BeginFrame();
+            requests.clear();
+            if (frame % 60 == 59) {
+                float boxMin[3] = { -5.0f, 0.0f, -5.0f }, boxMax[3] = { 5.0f, 4.0f, 5.0f };
+                atlas.InvalidateBox(boxMin, boxMax);
+            }
+            for (uint32_t i = 0; i < lights.size(); i++) {
+                const SceneLight& light = lights[i];
+                float x = light.x + light.orbit * std::cos(light.speed * time + light.phase);
+                float z = light.z + light.orbit * std::sin(light.speed * time + light.phase);
+                float dx = x - camera[0], dz = z - camera[2];
+                float distance = std::sqrt(dx * dx + dz * dz);
+                // Видимые - впереди камеры или вокруг нее в пределах радиуса.
+                if (distance > 80.0f || (dx * forward[0] + dz * forward[1] < -light.radius))
+                    continue;
+                lighting::ShadowRequest request = MakeRequest(i, x, z, light.radius,
+                    atlas.TileSizeFor(focal * light.radius / std::max(distance, 1.0f)));
+                float cx = character[0] - x, cz = character[1] - z;
+                if (cx * cx + cz * cz < light.radius * light.radius) {
+                    // Грани куба +x -x +y -y +z -z, персонаж виден в грани основной оси направления.
+                    request.dynamicFaces = std::fabs(cx) > std::fabs(cz) ? (cx > 0 ? 0x01 : 0x02) : (cz > 0 ? 0x10 : 0x20);
+                }
+                requests.push_back(request);
+            }
+            results.resize(requests.size());
+            atlas.RequestFrame(requests.data(), requests.size(), results.data());
+            total += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            scene.peakTexels = std::max(scene.peakTexels, atlas.GetAllocatedTexels());
+            scene.ok = scene.ok && atlas.GetAllocatedTexels() <= desc.budgetTexels;
+        }
+        scene.stats = atlas.GetStats();
+        scene.frameMs = total * 1e3 / frames;
+        return scene;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t lightCount = 2000;
+    float moving = 0.1f;
+    float budget = 1.0f;
+    unsigned frames = 600;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--lights") && i + 1 < argc) {
+            lightCount = (size_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--moving") && i + 1 < argc) {
+            moving = (float)atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--budget") && i + 1 < argc) {
+            budget = (float)atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = (unsigned)atoi(argv[++i]);
+        } else {
+            printf("shadowatlas [--lights <n>] [--moving <fraction>] [--budget <fraction of atlas>] [--frames <n>]\n");
+            return 1;
+        }
+    }
+    frames = std::max(frames, 1u);
+
+    bool ok = CheckAllocator();
+    ok = CheckCaching() && ok;
+    ok = CheckEviction() && ok;
+
+    std::mt19937 random(11);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<SceneLight> lights(lightCount);
+    for (size_t i = 0; i < lightCount; i++) {
+        SceneLight& light = lights[i];
+        light.x = unit(random) * 200.0f - 100.0f;
+        light.z = unit(random) * 200.0f - 100.0f;
+        light.radius = 2.0f + unit(random) * 8.0f;
+        light.orbit = i < lightCount * moving ? 0.5f + unit(random) * 2.0f : 0.0f;
+        light.speed = unit(random) * 2.0f - 1.0f;
+        light.phase = unit(random) * 6.2831853f;
+    }
+    lighting::ShadowAtlasDesc desc;
+    desc.budgetTexels = (size_t)(budget * desc.size * desc.size);
+    SceneResult scene = RunScene(lights, desc, frames);
+    const lighting::ShadowAtlasStats& stats = scene.stats;
+    printf("%zu lights, %.0f%% moving, budget %.0f%% of %ux%u, %u frames\n", lightCount, moving * 100.0f,
+        budget * 100.0f, desc.size, desc.size, frames);
+    printf("Faces: %zu requested, %zu rendered, %zu from cache (%.1f%% of re-renders saved), %.1f rendered per frame\n",
+        stats.requestedFaces, stats.renderedFaces, stats.cachedFaces,
+        100.0 * stats.cachedFaces / std::max<size_t>(stats.requestedFaces, 1), (double)stats.renderedFaces / frames);
+    printf("Tiles: %zu reallocations, %zu downgrades, %zu evictions, %zu failures, %zu invalidations, peak %.1f%% of budget\n",
+        stats.reallocations, stats.downgrades, stats.evictions, stats.failures, stats.invalidations,
+        100.0 * scene.peakTexels / std::max<size_t>(desc.budgetTexels, 1));
+    printf("Bookkeeping: %.3f ms per frame\n", scene.frameMs);
+    ok = Check(scene.ok, "budget exceeded") && ok;
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -1,5 +1,6 @@
 #include "SimpleManager.h"
 #include "D3DInclude.h"
+#include "MeshOptimizer.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
@@ -108,14 +109,28 @@ HRESULT SimpleSamplerManager::loadSampler(D3D11_FILTER filter, const std::string
 
 
 HRESULT SimpleGeometryManager::loadGeometry(const void* vertices, UINT verticesBytes, const UINT* indices,
-                                            UINT indicesBytes, const std::string& key) {
+                                            UINT indicesBytes, const std::string& key, UINT optimizeStride) {
     if (check(key))
         return E_FAIL; //      
 
+    std::vector<uint8_t> optimizedVertices;
+    std::vector<uint32_t> optimizedIndices;
+    if (optimizeStride != 0) {
+        optimizedVertices.assign(static_cast<const uint8_t*>(vertices), static_cast<const uint8_t*>(vertices) + verticesBytes);
+        optimizedIndices.assign(indices, indices + indicesBytes / sizeof(UINT));
+        mesh::OptimizeMesh(optimizedVertices, optimizeStride, 0, optimizedIndices);
+
+        vertices = optimizedVertices.data();
+        verticesBytes = (UINT)optimizedVertices.size();
+        indices = optimizedIndices.data();
+        indicesBytes = (UINT)(optimizedIndices.size() * sizeof(UINT));
+    }
+
     ID3D11Buffer* vertexBuffer = nullptr;
     ID3D11Buffer* indexBuffer = nullptr;
 
     D3D11_BUFFER_DESC desc = {};
+
     desc.ByteWidth = verticesBytes;
     desc.Usage = D3D11_USAGE_IMMUTABLE;
     desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
@@ -155,6 +170,50 @@ HRESULT SimpleGeometryManager::loadGeometry(const void* vertices, UINT verticesB
 };
 
 
+HRESULT SimpleGeometryManager::createView(const std::string& source, UINT startIndex, UINT numIndices,
+                                          const std::string& key) {
+    if (check(key))
+        return E_FAIL;
+
+    std::shared_ptr<Geometry> geometry;
+    HRESULT result = get(source, geometry);
+    if (SUCCEEDED(result) && startIndex + numIndices > geometry->getStartIndex() + geometry->getNumIndices())
+        result = E_INVALIDARG;
+
+    if (SUCCEEDED(result)) {
+        //     Geometry,      .
+        ID3D11Buffer* vertexBuffer = geometry->getVertexBuffer();
+        ID3D11Buffer* indexBuffer = geometry->getIndexBuffer();
+        vertexBuffer->AddRef();
+        indexBuffer->AddRef();
+        std::shared_ptr<Geometry> view = std::make_shared<Geometry>(vertexBuffer, indexBuffer, numIndices, startIndex);
+        view->setCpuCopy(geometry->getCpuCopy());
+        objects_.emplace(key, view);
+    }
+
+    return result;
+};
+
+
+HRESULT SimpleGeometryManager::setCpuCopy(const std::string& key, const void* vertices, UINT numVertices, UINT stride,
+                                          UINT positionOffset, const UINT* indices, UINT numIndices) {
+    std::shared_ptr<Geometry> geometry;
+    HRESULT result = get(key, geometry);
+    if (FAILED(result))
+        return result;
+
+    auto copy = std::make_shared<CpuGeometry>();
+    copy->positions.resize((size_t)numVertices * 3);
+    const uint8_t* source = static_cast<const uint8_t*>(vertices) + positionOffset;
+    for (UINT i = 0; i < numVertices; i++) {
+        memcpy(&copy->positions[(size_t)i * 3], source + (size_t)i * stride, 3 * sizeof(float));
+    }
+    copy->indices.assign(indices, indices + numIndices);
+    geometry->setCpuCopy(copy);
+    return S_OK;
+};
+
+
 HRESULT SimpleTextureManager::loadTexture(LPCWSTR filePath, const std::string& key, const std::string& annotationText) {
     if (check(key))
         return E_FAIL; //      
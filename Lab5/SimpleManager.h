@@ -5,6 +5,7 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <vector>
 
 
 //    .
@@ -102,11 +103,18 @@ public:
 };
 
 
+//     CPU     (BVH, ).
+struct CpuGeometry {
+    std::vector<float> positions;   // x, y, z  
+    std::vector<UINT> indices;      //   ,    
+};
+
+
 //  .
 struct Geometry {
 public:
-    Geometry(ID3D11Buffer* vertexBuffer, ID3D11Buffer* indexBuffer, UINT numIndices) :
-        vertexBuffer_(vertexBuffer), indexBuffer_(indexBuffer), numIndices_(numIndices) {};
+    Geometry(ID3D11Buffer* vertexBuffer, ID3D11Buffer* indexBuffer, UINT numIndices, UINT startIndex = 0) :
+        vertexBuffer_(vertexBuffer), indexBuffer_(indexBuffer), numIndices_(numIndices), startIndex_(startIndex) {};
 
     Geometry(Geometry&) = delete;
     Geometry& operator=(Geometry&) = delete;
@@ -123,6 +131,19 @@ public:
         return numIndices_;
     };
 
+    UINT getStartIndex() {
+        return startIndex_;
+    };
+
+    // nullptr,    .
+    const std::shared_ptr<const CpuGeometry>& getCpuCopy() {
+        return cpuCopy_;
+    };
+
+    void setCpuCopy(const std::shared_ptr<const CpuGeometry>& cpuCopy) {
+        cpuCopy_ = cpuCopy;
+    };
+
     ~Geometry() {
         if (vertexBuffer_ != nullptr)
             vertexBuffer_->Release();
@@ -134,6 +155,8 @@ private:
     ID3D11Buffer* vertexBuffer_;
     ID3D11Buffer* indexBuffer_;
     UINT numIndices_;
+    UINT startIndex_;
+    std::shared_ptr<const CpuGeometry> cpuCopy_;
 };
 
 
@@ -142,7 +165,18 @@ class SimpleGeometryManager : public SimpleManagerBase<Geometry> {
 public:
     SimpleGeometryManager(const std::shared_ptr<ID3D11Device>& devicePtr) : SimpleManagerBase(devicePtr) {};
 
-    HRESULT loadGeometry(const void* vertices, UINT verticesBytes, const UINT* indices, UINT indicesBytes, const std::string& key);
+    //     optimizeStride,      mesh::OptimizeMesh
+    // ( -   float ).
+    HRESULT loadGeometry(const void* vertices, UINT verticesBytes, const UINT* indices, UINT indicesBytes, const std::string& key,
+        UINT optimizeStride = 0);
+
+    //   key   (float3   positionOffset    stride)  ,
+    //     . ,   ,     .
+    HRESULT setCpuCopy(const std::string& key, const void* vertices, UINT numVertices, UINT stride, UINT positionOffset,
+        const UINT* indices, UINT numIndices);
+
+    //  ,    source    .
+    HRESULT createView(const std::string& source, UINT startIndex, UINT numIndices, const std::string& key);
 
     ~SimpleGeometryManager() = default;
 };
@@ -4,6 +4,7 @@
 #include "SimpleManager.h"
 #include <string>
 #include <memory>
+#include <vector>
 
 
 struct Vertex {
@@ -25,6 +26,9 @@ struct SimpleObject {
     std::shared_ptr<ID3D11PixelShader> PS;
     std::shared_ptr<Geometry> geometry;
     std::shared_ptr<SimpleTexture> irradianceMap;
+    std::vector<std::shared_ptr<Geometry>> lods; // lods[0]   geometry
+    std::vector<float> lodErrors;
+    UINT lod = 0;
 
     void Cleanup() {
         VS.reset();
@@ -32,6 +36,9 @@ struct SimpleObject {
         IL.reset();
         geometry.reset();
         irradianceMap.reset();
+        lods.clear();
+        lodErrors.clear();
+        lod = 0;
     };
 
     ~SimpleObject() = default;
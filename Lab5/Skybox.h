@@ -1,17 +1,13 @@
-#pragma once
+﻿#pragma once
 
 #include "SimpleManager.h"
-
-
-struct SimpleVertex {
-    XMFLOAT3 pos;
-};
+#include "VertexQuantization.h"
 
 
 struct Skybox {
     XMMATRIX worldMatrix;
     float size;
-    static const UINT vertexSize = sizeof(SimpleVertex);
+    static const UINT vertexSize = sizeof(mesh::QuantizedVertex8); // Скайбокс рисуется из вершинного буфера сферы
     std::shared_ptr<ID3D11VertexShader> VS;
     std::shared_ptr<ID3D11InputLayout> IL;
     std::shared_ptr<ID3D11PixelShader> PS;
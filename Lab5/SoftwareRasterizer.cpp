@@ -0,0 +1,506 @@
+﻿#include "SoftwareRasterizer.h"
+#include "ThreadPool.h"
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define RASTER_SSE
+#endif
+
+namespace soft {
+    namespace {
+        // Запас по x и y за краем экрана (в долях w), внутри которого треугольники не отсекаются:
+        // дальше координаты растут настолько, что краевые функции теряют точность.
+        const float guardBand = 4.0f;
+        // Вершины привязываются к сетке 1/256 пикселя, как в D3D11.
+        const float subpixelScale = 256.0f;
+        const unsigned clipPlaneCount = 6;
+        const unsigned maxClipVertices = 3 + clipPlaneCount;
+
+        // Четыре float: одна SSE операция или цикл из четырех в скалярной сборке. Сравнения возвращают маску дорожек.
+#ifdef RASTER_SSE
+        struct Float4 {
+            __m128 v;
+        };
+
+        inline Float4 Splat(float x) {
+            return { _mm_set1_ps(x) };
+        }
+
+        inline Float4 Set(float a, float b, float c, float d) {
+            return { _mm_setr_ps(a, b, c, d) };
+        }
+
+        inline Float4 LoadUnaligned(const float* p) {
+            return { _mm_loadu_ps(p) };
+        }
+
+        inline void Store(float* p, Float4 a) {
+            _mm_storeu_ps(p, a.v);
+        }
+
+        inline Float4 operator+(Float4 a, Float4 b) {
+            return { _mm_add_ps(a.v, b.v) };
+        }
+
+        inline Float4 operator-(Float4 a, Float4 b) {
+            return { _mm_sub_ps(a.v, b.v) };
+        }
+
+        inline Float4 operator*(Float4 a, Float4 b) {
+            return { _mm_mul_ps(a.v, b.v) };
+        }
+
+        inline unsigned Greater(Float4 a, Float4 b) {
+            return (unsigned)_mm_movemask_ps(_mm_cmpgt_ps(a.v, b.v));
+        }
+
+        inline unsigned GreaterEqual(Float4 a, Float4 b) {
+            return (unsigned)_mm_movemask_ps(_mm_cmpge_ps(a.v, b.v));
+        }
+
+        inline unsigned Equal(Float4 a, Float4 b) {
+            return (unsigned)_mm_movemask_ps(_mm_cmpeq_ps(a.v, b.v));
+        }
+#else
+        struct Float4 {
+            float v[4];
+        };
+
+        template<typename Op>
+        inline Float4 Apply(Float4 a, Float4 b, Op op) {
+            return { { op(a.v[0], b.v[0]), op(a.v[1], b.v[1]), op(a.v[2], b.v[2]), op(a.v[3], b.v[3]) } };
+        }
+
+        template<typename Op>
+        inline unsigned Compare(Float4 a, Float4 b, Op op) {
+            unsigned mask = 0;
+            for (int i = 0; i < 4; i++) {
+                mask |= op(a.v[i], b.v[i]) ? 1u << i : 0u;
+            }
+            return mask;
+        }
+
+        inline Float4 Splat(float x) {
+            return { { x, x, x, x } };
+        }
+
+        inline Float4 Set(float a, float b, float c, float d) {
+            return { { a, b, c, d } };
+        }
+
+        inline Float4 LoadUnaligned(const float* p) {
+            return { { p[0], p[1], p[2], p[3] } };
+        }
+
+        inline void Store(float* p, Float4 a) {
+            memcpy(p, a.v, sizeof(a.v));
+        }
+
+        inline Float4 operator+(Float4 a, Float4 b) {
+            return Apply(a, b, [](float x, float y) { return x + y; });
+        }
+
+        inline Float4 operator-(Float4 a, Float4 b) {
+            return Apply(a, b, [](float x, float y) { return x - y; });
+        }
+
+        inline Float4 operator*(Float4 a, Float4 b) {
+            return Apply(a, b, [](float x, float y) { return x * y; });
+        }
+
+        inline unsigned Greater(Float4 a, Float4 b) {
+            return Compare(a, b, [](float x, float y) { return x > y; });
+        }
+
+        inline unsigned GreaterEqual(Float4 a, Float4 b) {
+            return Compare(a, b, [](float x, float y) { return x >= y; });
+        }
+
+        inline unsigned Equal(Float4 a, Float4 b) {
+            return Compare(a, b, [](float x, float y) { return x == y; });
+        }
+#endif
+
+        // Расстояние до плоскости отсечения: 0 <= z <= w и защитная полоса по x, y.
+        inline float ClipDistance(const float* c, unsigned plane) {
+            switch (plane) {
+            case 0:
+                return c[2];
+            case 1:
+                return c[3] - c[2];
+            case 2:
+                return c[0] + guardBand * c[3];
+            case 3:
+                return guardBand * c[3] - c[0];
+            case 4:
+                return c[1] + guardBand * c[3];
+            default:
+                return guardBand * c[3] - c[1];
+            }
+        }
+
+        struct ClipVertex {
+            float clip[4];
+            float varyings[maxVaryings];
+        };
+
+        // Sutherland-Hodgman для одной плоскости. Возвращает число вершин результата.
+        unsigned ClipPolygon(const ClipVertex* in, unsigned count, unsigned plane, unsigned varyingCount, ClipVertex* out) {
+            unsigned result = 0;
+            for (unsigned i = 0; i < count; i++) {
+                const ClipVertex& a = in[i];
+                const ClipVertex& b = in[(i + 1) % count];
+                float da = ClipDistance(a.clip, plane), db = ClipDistance(b.clip, plane);
+                if (da >= 0.0f) {
+                    out[result++] = a;
+                }
+                if ((da >= 0.0f) != (db >= 0.0f)) {
+                    float t = da / (da - db);
+                    ClipVertex& v = out[result++];
+                    for (int k = 0; k < 4; k++) {
+                        v.clip[k] = a.clip[k] + (b.clip[k] - a.clip[k]) * t;
+                    }
+                    for (unsigned k = 0; k < varyingCount; k++) {
+                        v.varyings[k] = a.varyings[k] + (b.varyings[k] - a.varyings[k]) * t;
+                    }
+                }
+            }
+            return result;
+        }
+
+        inline float Snap(float x) {
+            return std::floor(x * subpixelScale + 0.5f) / subpixelScale;
+        }
+    }
+
+    void PixelShader::ShadeBatch(const float* varyings, unsigned count, float* color) const {
+        float pixel[maxVaryings];
+        for (unsigned i = 0; i < count; i++) {
+            for (unsigned k = 0; k < maxVaryings; k++) {
+                pixel[k] = varyings[k * shadeBatchSize + i];
+            }
+            Shade(pixel, color + i * 4);
+        }
+    }
+
+    void Rasterizer::Begin(unsigned width, unsigned height, const float clearColor[4]) {
+        width_ = width;
+        height_ = height;
+        tilesX_ = (width + tileSize - 1) / tileSize;
+        tilesY_ = (height + tileSize - 1) / tileSize;
+        memcpy(clearColor_, clearColor, sizeof(clearColor_));
+        color_.resize((size_t)width * height * 4);
+        depth_.resize((size_t)width * height);
+        draws_.clear();
+        triangles_.clear();
+        bins_.resize((size_t)tilesX_ * tilesY_);
+        for (std::vector<uint32_t>& bin : bins_) {
+            bin.clear();
+        }
+        stats_ = RasterStats();
+    }
+
+    void Rasterizer::EmitTriangle(const float (*clip)[4], const float (*varyings)[maxVaryings], uint32_t drawIndex,
+                                  unsigned varyingCount, CullMode cullMode, bool frontCounterClockwise, SetupChunk& chunk) const {
+        Triangle t;
+        float x[3], y[3];
+        for (int i = 0; i < 3; i++) {
+            // После отсечения w >= z >= 0; нулевой w остается только у вырожденных треугольников.
+            if (!(clip[i][3] > 0.0f))
+                return;
+            float invW = 1.0f / clip[i][3];
+            x[i] = Snap((clip[i][0] * invW * 0.5f + 0.5f) * width_);
+            y[i] = Snap((0.5f - clip[i][1] * invW * 0.5f) * height_);
+            t.z[i] = std::min(std::max(clip[i][2] * invW, 0.0f), 1.0f);
+            t.invW[i] = invW;
+            for (unsigned k = 0; k < varyingCount; k++) {
+                t.varyings[i][k] = varyings[i][k] * invW;
+            }
+        }
+
+        // Ось y экрана направлена вниз, поэтому обход по часовой стрелке дает положительную площадь.
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (area == 0.0f)
+            return;
+        bool front = frontCounterClockwise ? area < 0.0f : area > 0.0f;
+        if ((cullMode == CullMode::Back && !front) || (cullMode == CullMode::Front && front))
+            return;
+        if (area < 0.0f) {
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            std::swap(t.z[1], t.z[2]);
+            std::swap(t.invW[1], t.invW[2]);
+            for (unsigned k = 0; k < varyingCount; k++) {
+                std::swap(t.varyings[1][k], t.varyings[2][k]);
+            }
+            area = -area;
+        }
+
+        float minX = std::min(x[0], std::min(x[1], x[2])), maxX = std::max(x[0], std::max(x[1], x[2]));
+        float minY = std::min(y[0], std::min(y[1], y[2])), maxY = std::max(y[0], std::max(y[1], y[2]));
+        t.minX = std::max((int)std::ceil(minX - 0.5f), 0);
+        t.maxX = std::min((int)std::floor(maxX - 0.5f), (int)width_ - 1);
+        t.minY = std::max((int)std::ceil(minY - 0.5f), 0);
+        t.maxY = std::min((int)std::floor(maxY - 0.5f), (int)height_ - 1);
+        if (t.minX > t.maxX || t.minY > t.maxY)
+            return;
+
+        for (int i = 0; i < 3; i++) {
+            int a = (i + 1) % 3, b = (i + 2) % 3;
+            float dx = x[b] - x[a], dy = y[b] - y[a];
+            // Верхнее или левое ребро: у соседнего треугольника то же ребро идет в обратную сторону и условие ложно.
+            t.tieMask[i] = dy > 0.0f || (dy == 0.0f && dx < 0.0f) ? 0xFu : 0u;
+            bool swapped = x[a] > x[b] || (x[a] == x[b] && y[a] > y[b]);
+            int start = swapped ? b : a;
+            t.edgeX[i] = x[start];
+            t.edgeY[i] = y[start];
+            t.edgeDX[i] = swapped ? -dx : dx;
+            t.edgeDY[i] = swapped ? -dy : dy;
+            t.edgeSign[i] = swapped ? -1.0f : 1.0f;
+        }
+        t.invArea = 1.0f / area;
+        t.draw = drawIndex;
+
+        uint32_t local = (uint32_t)chunk.triangles.size();
+        chunk.triangles.push_back(t);
+        for (unsigned ty = (unsigned)t.minY / tileSize; ty <= (unsigned)t.maxY / tileSize; ty++) {
+            for (unsigned tx = (unsigned)t.minX / tileSize; tx <= (unsigned)t.maxX / tileSize; tx++) {
+                chunk.tiles.push_back(ty * tilesX_ + tx);
+                chunk.tiles.push_back(local);
+            }
+        }
+    }
+
+    void Rasterizer::SetupTriangles(const DrawCall& draw, uint32_t drawIndex, size_t begin, size_t end, SetupChunk& chunk) const {
+        const unsigned varyingCount = std::min(draw.varyingCount, maxVaryings);
+        ClipVertex polygon[2][maxClipVertices];
+        float clip[3][4];
+        float varyings[3][maxVaryings];
+
+        for (size_t tri = begin; tri < end; tri++) {
+            const uint32_t* index = draw.indices + tri * 3;
+            unsigned outside[clipPlaneCount] = {};
+            bool clipped = false;
+            for (int i = 0; i < 3; i++) {
+                memcpy(clip[i], draw.clipPositions + (size_t)index[i] * 4, sizeof(clip[i]));
+                if (varyingCount > 0) {
+                    memcpy(varyings[i], draw.varyings + (size_t)index[i] * draw.varyingCount, varyingCount * sizeof(float));
+                }
+                for (unsigned p = 0; p < clipPlaneCount; p++) {
+                    if (ClipDistance(clip[i], p) < 0.0f) {
+                        outside[p]++;
+                        clipped = true;
+                    }
+                }
+            }
+            bool rejected = false;
+            for (unsigned p = 0; p < clipPlaneCount; p++) {
+                rejected = rejected || outside[p] == 3;
+            }
+            if (rejected)
+                continue;
+
+            if (!clipped) {
+                EmitTriangle(clip, varyings, drawIndex, varyingCount, draw.cullMode, draw.frontCounterClockwise, chunk);
+                continue;
+            }
+
+            unsigned count = 3;
+            for (int i = 0; i < 3; i++) {
+                memcpy(polygon[0][i].clip, clip[i], sizeof(clip[i]));
+                memcpy(polygon[0][i].varyings, varyings[i], varyingCount * sizeof(float));
+            }
+            int current = 0;
+            for (unsigned p = 0; p < clipPlaneCount && count >= 3; p++) {
+                if (outside[p] == 0)
+                    continue;
+                count = ClipPolygon(polygon[current], count, p, varyingCount, polygon[1 - current]);
+                current = 1 - current;
+            }
+            // Веер из первой вершины многоугольника.
+            for (unsigned i = 1; i + 1 < count; i++) {
+                const ClipVertex* fan[3] = { &polygon[current][0], &polygon[current][i], &polygon[current][i + 1] };
+                for (int k = 0; k < 3; k++) {
+                    memcpy(clip[k], fan[k]->clip, sizeof(clip[k]));
+                    memcpy(varyings[k], fan[k]->varyings, varyingCount * sizeof(float));
+                }
+                EmitTriangle(clip, varyings, drawIndex, varyingCount, draw.cullMode, draw.frontCounterClockwise, chunk);
+            }
+        }
+    }
+
+    void Rasterizer::Draw(const DrawCall& draw, ThreadPool* pool) {
+        if (!draw.shader || !draw.clipPositions || !draw.indices || draw.indexCount < 3 || width_ == 0 || height_ == 0)
+            return;
+        auto start = std::chrono::steady_clock::now();
+
+        uint32_t drawIndex = (uint32_t)draws_.size();
+        draws_.push_back({ draw.shader, std::min(draw.varyingCount, maxVaryings) });
+
+        size_t triangleCount = draw.indexCount / 3;
+        size_t chunkCount = (triangleCount + setupGrain - 1) / setupGrain;
+        std::vector<SetupChunk> chunks(chunkCount);
+        auto setup = [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; c++) {
+                SetupTriangles(draw, drawIndex, c * setupGrain, std::min((c + 1) * setupGrain, triangleCount), chunks[c]);
+            }
+        };
+        if (pool) {
+            pool->ParallelFor(chunkCount, 1, setup);
+        } else {
+            setup(0, chunkCount);
+        }
+
+        // Группы сливаются по порядку, поэтому в корзинах треугольники идут в порядке отправки.
+        for (SetupChunk& chunk : chunks) {
+            uint32_t base = (uint32_t)triangles_.size();
+            triangles_.insert(triangles_.end(), chunk.triangles.begin(), chunk.triangles.end());
+            for (size_t i = 0; i + 1 < chunk.tiles.size(); i += 2) {
+                bins_[chunk.tiles[i]].push_back(base + chunk.tiles[i + 1]);
+            }
+            stats_.trianglesBinned += chunk.triangles.size();
+            stats_.tileEntries += chunk.tiles.size() / 2;
+        }
+        stats_.trianglesSubmitted += triangleCount;
+        stats_.setupSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void Rasterizer::RenderTile(unsigned tile, uint64_t& covered, uint64_t& shaded) {
+        const int x0 = (int)(tile % tilesX_ * tileSize), y0 = (int)(tile / tilesX_ * tileSize);
+        const int x1 = std::min(x0 + (int)tileSize, (int)width_), y1 = std::min(y0 + (int)tileSize, (int)height_);
+        float depth[tileSize * tileSize];
+        uint32_t ids[tileSize * tileSize];
+        std::fill(depth, depth + tileSize * tileSize, 0.0f);
+        std::fill(ids, ids + tileSize * tileSize, ~0u);
+
+        const Float4 zero = Splat(0.0f);
+        const Float4 laneOffset = Set(0.5f, 1.5f, 2.5f, 3.5f);
+        for (uint32_t index : bins_[tile]) {
+            const Triangle& t = triangles_[index];
+            const int bx0 = std::max(t.minX, x0), bx1 = std::min(t.maxX, x1 - 1);
+            const int by0 = std::max(t.minY, y0), by1 = std::min(t.maxY, y1 - 1);
+            // Начало строки выравнивается на 4 пикселя внутри плитки, лишние дорожки отсекаются маской.
+            const int ax0 = x0 + ((bx0 - x0) & ~3);
+            for (int y = by0; y <= by1; y++) {
+                const float py = y + 0.5f;
+                Float4 row[3], dy[3], ex[3], sign[3];
+                for (int i = 0; i < 3; i++) {
+                    row[i] = Splat(t.edgeDX[i] * (py - t.edgeY[i]));
+                    dy[i] = Splat(t.edgeDY[i]);
+                    ex[i] = Splat(t.edgeX[i]);
+                    sign[i] = Splat(t.edgeSign[i]);
+                }
+                float* depthRow = depth + (y - y0) * tileSize;
+                uint32_t* idRow = ids + (y - y0) * tileSize;
+                for (int x = ax0; x <= bx1; x += 4) {
+                    Float4 px = Splat((float)x) + laneOffset;
+                    Float4 e[3];
+                    unsigned inside = 0xFu;
+                    for (int i = 0; i < 3; i++) {
+                        // Тот же порядок операций, что и при закраске: значения на общем ребре совпадают с точностью до знака.
+                        e[i] = (row[i] - dy[i] * (px - ex[i])) * sign[i];
+                        inside &= Greater(e[i], zero) | (Equal(e[i], zero) & t.tieMask[i]);
+                    }
+                    if (x < bx0) {
+                        inside &= 0xFu << (bx0 - x);
+                    }
+                    if (x + 3 > bx1) {
+                        inside &= 0xFu >> (x + 3 - bx1);
+                    }
+                    if (!inside)
+                        continue;
+                    Float4 invArea = Splat(t.invArea);
+                    Float4 z = (e[0] * Splat(t.z[0]) + e[1] * Splat(t.z[1]) + e[2] * Splat(t.z[2])) * invArea;
+                    float* depthPtr = depthRow + (x - x0);
+                    unsigned pass = inside & GreaterEqual(z, LoadUnaligned(depthPtr));
+                    if (!pass)
+                        continue;
+                    float zs[4];
+                    Store(zs, z);
+                    for (int lane = 0; lane < 4; lane++) {
+                        if (pass & (1u << lane)) {
+                            depthPtr[lane] = zs[lane];
+                            idRow[x - x0 + lane] = index;
+                            covered++;
+                        }
+                    }
+                }
+            }
+        }
+
+        // Закраска: каждый видимый пиксель один раз, атрибуты по барицентрическим координатам с делением на 1/w.
+        // Пиксели одного вызова Draw собираются в пакеты для PixelShader::ShadeBatch.
+        float varyings[maxVaryings * shadeBatchSize] = {};
+        float colors[4 * shadeBatchSize];
+        float* targets[shadeBatchSize];
+        unsigned pending = 0;
+        uint32_t pendingDraw = ~0u;
+        auto flush = [&]() {
+            if (!pending)
+                return;
+            draws_[pendingDraw].shader->ShadeBatch(varyings, pending, colors);
+            for (unsigned i = 0; i < pending; i++) {
+                memcpy(targets[i], colors + i * 4, 4 * sizeof(float));
+            }
+            shaded += pending;
+            pending = 0;
+        };
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) {
+                size_t local = (size_t)(y - y0) * tileSize + (x - x0);
+                float* out = &color_[((size_t)y * width_ + x) * 4];
+                depth_[(size_t)y * width_ + x] = depth[local];
+                uint32_t index = ids[local];
+                if (index == ~0u) {
+                    memcpy(out, clearColor_, sizeof(clearColor_));
+                    continue;
+                }
+                const Triangle& t = triangles_[index];
+                if (t.draw != pendingDraw || pending == shadeBatchSize) {
+                    flush();
+                    pendingDraw = t.draw;
+                }
+                const DrawState& draw = draws_[t.draw];
+                float px = x + 0.5f, py = y + 0.5f;
+                float b[3];
+                for (int i = 0; i < 3; i++) {
+                    b[i] = (t.edgeDX[i] * (py - t.edgeY[i]) - t.edgeDY[i] * (px - t.edgeX[i])) * t.edgeSign[i] * t.invArea;
+                }
+                float w = 1.0f / (b[0] * t.invW[0] + b[1] * t.invW[1] + b[2] * t.invW[2]);
+                for (unsigned k = 0; k < draw.varyingCount; k++) {
+                    varyings[k * shadeBatchSize + pending] =
+                        (b[0] * t.varyings[0][k] + b[1] * t.varyings[1][k] + b[2] * t.varyings[2][k]) * w;
+                }
+                targets[pending++] = out;
+            }
+        }
+        flush();
+    }
+
+    void Rasterizer::End(ThreadPool* pool) {
+        auto start = std::chrono::steady_clock::now();
+        std::atomic<uint64_t> covered(0), shaded(0);
+        auto render = [&](size_t begin, size_t end) {
+            uint64_t localCovered = 0, localShaded = 0;
+            for (size_t tile = begin; tile < end; tile++) {
+                RenderTile((unsigned)tile, localCovered, localShaded);
+            }
+            covered += localCovered;
+            shaded += localShaded;
+        };
+        size_t tileCount = bins_.size();
+        if (pool) {
+            pool->ParallelFor(tileCount, 1, render);
+        } else {
+            render(0, tileCount);
+        }
+        stats_.pixelsCovered = covered.load();
+        stats_.pixelsShaded = shaded.load();
+        stats_.rasterSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
@@ -0,0 +1,131 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+
+// Растеризатор на CPU по плиткам. Draw отсекает и готовит треугольники и раскладывает их по корзинам плиток
+// экрана (параллельно по группам треугольников), End растеризует каждую плитку отдельной задачей: сначала
+// буфер видимости (глубина и номер треугольника) с краевыми функциями по четыре пикселя SSE, затем каждый
+// видимый пиксель один раз закрашивается шейдером своего вызова. Правила как у D3D11: центры пикселей, правило
+// верхнего левого ребра, лицевые грани по часовой стрелке. Глубина обратная (ближе - больше), тест GREATER_EQUAL,
+// очистка в 0, так что при равной глубине побеждает более поздний вызов.
+namespace soft {
+    static const unsigned maxVaryings = 8;
+    static const unsigned shadeBatchSize = 8;
+
+    class PixelShader {
+    public:
+        virtual ~PixelShader() = default;
+        // varyings - атрибуты вершин, интерполированные с учетом перспективы; color - RGBA.
+        virtual void Shade(const float* varyings, float color[4]) const = 0;
+        // До shadeBatchSize пикселей одного вызова Draw: varyings[k * shadeBatchSize + i] - атрибут k пикселя i,
+        // color[i * 4 + c] - его цвет. По умолчанию Shade для каждого пикселя.
+        virtual void ShadeBatch(const float* varyings, unsigned count, float* color) const;
+    };
+
+    enum class CullMode {
+        None,
+        Front,
+        Back
+    };
+
+    // Вершины уже в пространстве отсечения. Буферы нужны только на время Draw.
+    struct DrawCall {
+        const float* clipPositions = nullptr;       // xyzw на вершину
+        const float* varyings = nullptr;            // varyingCount float на вершину
+        unsigned varyingCount = 0;
+        const uint32_t* indices = nullptr;
+        size_t indexCount = 0;
+        CullMode cullMode = CullMode::Back;
+        bool frontCounterClockwise = false;
+        const PixelShader* shader = nullptr;
+    };
+
+    struct RasterStats {
+        uint64_t trianglesSubmitted = 0;
+        uint64_t trianglesBinned = 0;       // после отсечения и отбраковки, с учетом разбиения при отсечении
+        uint64_t tileEntries = 0;           // сумма по корзинам плиток
+        uint64_t pixelsCovered = 0;         // прошедшие тест глубины
+        uint64_t pixelsShaded = 0;
+        double setupSeconds = 0.0;
+        double rasterSeconds = 0.0;         // растеризация и закраска плиток
+    };
+
+    class Rasterizer {
+    public:
+        static const unsigned tileSize = 64;
+        static const size_t setupGrain = 2048;     // треугольников на задачу подготовки
+
+        void Begin(unsigned width, unsigned height, const float clearColor[4]);
+        void Draw(const DrawCall& draw, ThreadPool* pool = nullptr);
+        void End(ThreadPool* pool = nullptr);
+
+        unsigned GetWidth() const {
+            return width_;
+        };
+
+        unsigned GetHeight() const {
+            return height_;
+        };
+
+        // RGBA32F по строкам.
+        const std::vector<float>& GetColor() const {
+            return color_;
+        };
+
+        const std::vector<float>& GetDepth() const {
+            return depth_;
+        };
+
+        const RasterStats& GetStats() const {
+            return stats_;
+        };
+
+    private:
+        // Ребро i лежит напротив вершины i. Ребро хранится в каноническом порядке концов (sign = -1, если
+        // переставлены), поэтому у соседних треугольников значения на общем ребре отличаются ровно знаком.
+        struct Triangle {
+            float edgeX[3], edgeY[3];       // начало ребра
+            float edgeDX[3], edgeDY[3];
+            float edgeSign[3];
+            uint32_t tieMask[3];            // ~0u, если пиксель на самом ребре принадлежит треугольнику
+            float z[3];
+            float invW[3];
+            float invArea;
+            int minX, minY, maxX, maxY;
+            uint32_t draw;
+            float varyings[3][maxVaryings]; // атрибут / w
+        };
+
+        struct DrawState {
+            const PixelShader* shader;
+            unsigned varyingCount;
+        };
+
+        struct SetupChunk {
+            std::vector<Triangle> triangles;
+            std::vector<uint32_t> tiles;    // пары (плитка, номер треугольника в группе)
+        };
+
+        void SetupTriangles(const DrawCall& draw, uint32_t drawIndex, size_t begin, size_t end, SetupChunk& chunk) const;
+        void EmitTriangle(const float (*clip)[4], const float (*varyings)[maxVaryings], uint32_t drawIndex,
+                          unsigned varyingCount, CullMode cullMode, bool frontCounterClockwise, SetupChunk& chunk) const;
+        void RenderTile(unsigned tile, uint64_t& covered, uint64_t& shaded);
+
+        unsigned width_ = 0;
+        unsigned height_ = 0;
+        unsigned tilesX_ = 0;
+        unsigned tilesY_ = 0;
+        float clearColor_[4] = {};
+        std::vector<float> color_;
+        std::vector<float> depth_;
+        std::vector<DrawState> draws_;
+        std::vector<Triangle> triangles_;
+        std::vector<std::vector<uint32_t>> bins_;
+        RasterStats stats_;
+    };
+}
@@ -0,0 +1,297 @@
+﻿// Консольный рендер кадра Lab5 программным растеризатором, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 -pthread SoftwareRenderMain.cpp SoftwareRenderer.cpp SoftwareRasterizer.cpp MeshGenerator.cpp
+//       ThreadPool.cpp ImageEncoder.cpp ShadingKernel.cpp -o softrender
+// Примеры:
+//   ./softrender --light 3 3 -3 1 1 1 20 --out frame.png --hdr frame.hdr
+//   ./softrender --bench --frames 10
+//   ./softrender --light 3 3 -3 1 1 1 20 --diff capture.png --diff-out diff.png
+// Для --diff снимок делается в Lab5 (ScreenCapture) с той же сценой и размером окна.
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "SoftwareRenderer.h"
+#include "ThreadPool.h"
+#include "ImageEncoder.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+
+namespace {
+    void Usage() {
+        printf("softrender [options]\n"
+            "  --env <file.hdr>           equirect environment (textures/hdr_text.hdr)\n"
+            "  --out <file.png>           tonemapped frame (frame.png)\n"
+            "  --hdr <file.hdr>           also write the frame before tonemapping\n"
+            "  --width <w> --height <h>   frame size (1280 x 720)\n"
+            "  --sphere <lat> <long>      sphere tessellation (40 40)\n"
+            "  --ibl-samples <n>          GGX samples per texel of the lighting maps (1024)\n"
+            "  --threads <n>              worker count including the main thread (all cores)\n"
+            "  --color <r> <g> <b> --roughness <r> --metalness <m> --exposure <f>\n"
+            "  --light <x> <y> <z> <r> <g> <b> <brightness>   may be repeated\n"
+            "  --camera <px> <py> <pz> <fx> <fy> <fz>         position and focus point\n"
+            "  --mode <m>                 default | fresnel | nd | geometry, as the PS.hlsl macros\n"
+            "  --scalar-shading           per-pixel reference shader instead of 8-wide batches (default mode only)\n"
+            "  --bench                    triangles and pixels per second for 1..threads workers\n"
+            "  --frames <n>               frames per benchmark point (5)\n"
+            "  --diff <file.png>          compare the frame with a capture of the same size\n"
+            "  --diff-tolerance <l> <p>   fail if over p percent of pixels differ by more than l levels (4 0.5)\n"
+            "  --diff-out <file.png>      per-pixel difference scaled by 16\n");
+    }
+
+    bool ParseMode(const char* name, soft::ShadingMode& mode) {
+        const char* names[] = { "default", "fresnel", "nd", "geometry" };
+        const soft::ShadingMode modes[] = { soft::ShadingMode::Default, soft::ShadingMode::Fresnel, soft::ShadingMode::ND,
+            soft::ShadingMode::Geometry };
+        for (int i = 0; i < 4; i++) {
+            if (!strcmp(name, names[i])) {
+                mode = modes[i];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Сравнение с эталонным снимком по каналам RGB. Возвращает false, если доля пикселей с отличием больше
+    // tolerance уровней превышает maxPercent.
+    bool Compare(const std::vector<uint8_t>& frame, unsigned width, unsigned height, const std::string& referencePath,
+                 float tolerance, float maxPercent, const std::string& diffPath) {
+        int refWidth = 0, refHeight = 0, components = 0;
+        uint8_t* reference = stbi_load(referencePath.c_str(), &refWidth, &refHeight, &components, 4);
+        if (!reference) {
+            fprintf(stderr, "Failed to load %s\n", referencePath.c_str());
+            return false;
+        }
+        if ((unsigned)refWidth != width || (unsigned)refHeight != height) {
+            fprintf(stderr, "%s is %dx%d, the frame is %ux%u\n", referencePath.c_str(), refWidth, refHeight, width, height);
+            stbi_image_free(reference);
+            return false;
+        }
+        size_t pixelCount = (size_t)width * height, over = 0;
+        int maxDiff = 0;
+        double sum = 0.0, squares = 0.0;
+        std::vector<uint8_t> diff(diffPath.empty() ? 0 : pixelCount * 4);
+        for (size_t i = 0; i < pixelCount; i++) {
+            int pixelDiff = 0;
+            for (int k = 0; k < 3; k++) {
+                int d = std::abs((int)frame[i * 4 + k] - (int)reference[i * 4 + k]);
+                pixelDiff = std::max(pixelDiff, d);
+                sum += d;
+                squares += (double)d * d;
+                if (!diff.empty()) {
+                    diff[i * 4 + k] = (uint8_t)std::min(d * 16, 255);
+                }
+            }
+            if (!diff.empty()) {
+                diff[i * 4 + 3] = 255;
+            }
+            maxDiff = std::max(maxDiff, pixelDiff);
+            over += pixelDiff > tolerance;
+        }
+        stbi_image_free(reference);
+        double mse = squares / (pixelCount * 3.0);
+        double percent = 100.0 * over / pixelCount;
+        printf("Diff with %s: max %d, mean %.4f, PSNR %.2f dB, %.3f%% of pixels over %g levels\n", referencePath.c_str(), maxDiff,
+            sum / (pixelCount * 3.0), mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : INFINITY, percent, tolerance);
+        if (!diff.empty()) {
+            std::vector<uint8_t> encoded;
+            if (!encoder::EncodePNG(diff.data(), width, height, width * 4, PixelFormat::RGBA8, encoded) ||
+                !encoder::WriteFile(diffPath, encoded)) {
+                fprintf(stderr, "Failed to write %s\n", diffPath.c_str());
+                return false;
+            }
+            printf("Written %s\n", diffPath.c_str());
+        }
+        return percent <= maxPercent;
+    }
+
+    void Normalize(float v[3]) {
+        float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+
+    void Cross(const float a[3], const float b[3], float out[3]) {
+        out[0] = a[1] * b[2] - a[2] * b[1];
+        out[1] = a[2] * b[0] - a[0] * b[2];
+        out[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    void LookAt(const float position[3], const float focus[3], soft::SceneDesc& scene) {
+        for (int k = 0; k < 3; k++) {
+            scene.cameraPosition[k] = position[k];
+            scene.cameraForward[k] = focus[k] - position[k];
+        }
+        Normalize(scene.cameraForward);
+        const float worldUp[3] = { 0.0f, 1.0f, 0.0f };
+        Cross(worldUp, scene.cameraForward, scene.cameraRight);
+        Normalize(scene.cameraRight);
+        Cross(scene.cameraForward, scene.cameraRight, scene.cameraUp);
+    }
+
+    bool ReadFloats(int argc, char** argv, int& i, float* out, int count) {
+        if (i + count >= argc)
+            return false;
+        for (int k = 0; k < count; k++) {
+            out[k] = (float)atof(argv[++i]);
+        }
+        return true;
+    }
+
+    double Seconds(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string envPath = "textures/hdr_text.hdr";
+    std::string outPath = "frame.png";
+    std::string hdrPath;
+    std::string diffPath, diffOutPath;
+    float diffTolerance[2] = { 4.0f, 0.5f };
+    unsigned latLines = 40, longLines = 40, iblSamples = 1024, frames = 5;
+    unsigned threads = std::thread::hardware_concurrency();
+    bool bench = false;
+    soft::SceneDesc scene;
+    // Начальное положение Camera: r = 5, theta = -pi / 4, взгляд в начало координат.
+    float position[3] = { 0.0f, 3.5355339f, -3.5355339f }, focus[3] = { 0.0f, 0.0f, 0.0f };
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool ok = true;
+        if (!strcmp(arg, "--env") && i + 1 < argc) {
+            envPath = argv[++i];
+        } else if (!strcmp(arg, "--out") && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (!strcmp(arg, "--hdr") && i + 1 < argc) {
+            hdrPath = argv[++i];
+        } else if (!strcmp(arg, "--width") && i + 1 < argc) {
+            scene.width = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(arg, "--height") && i + 1 < argc) {
+            scene.height = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(arg, "--sphere") && i + 2 < argc) {
+            latLines = (unsigned)atoi(argv[++i]);
+            longLines = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(arg, "--ibl-samples") && i + 1 < argc) {
+            iblSamples = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(arg, "--threads") && i + 1 < argc) {
+            threads = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(arg, "--frames") && i + 1 < argc) {
+            frames = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(arg, "--color")) {
+            ok = ReadFloats(argc, argv, i, scene.color, 3);
+        } else if (!strcmp(arg, "--roughness")) {
+            ok = ReadFloats(argc, argv, i, &scene.roughness, 1);
+        } else if (!strcmp(arg, "--metalness")) {
+            ok = ReadFloats(argc, argv, i, &scene.metalness, 1);
+        } else if (!strcmp(arg, "--exposure")) {
+            ok = ReadFloats(argc, argv, i, &scene.exposure, 1);
+        } else if (!strcmp(arg, "--light")) {
+            float values[7];
+            ok = ReadFloats(argc, argv, i, values, 7);
+            if (ok) {
+                scene.lights.push_back({ { values[0], values[1], values[2] }, { values[3], values[4], values[5] }, values[6] });
+            }
+        } else if (!strcmp(arg, "--camera")) {
+            float values[6];
+            ok = ReadFloats(argc, argv, i, values, 6);
+            if (ok) {
+                memcpy(position, values, sizeof(position));
+                memcpy(focus, values + 3, sizeof(focus));
+            }
+        } else if (!strcmp(arg, "--mode") && i + 1 < argc) {
+            ok = ParseMode(argv[++i], scene.mode);
+        } else if (!strcmp(arg, "--scalar-shading")) {
+            scene.batchShading = false;
+        } else if (!strcmp(arg, "--diff") && i + 1 < argc) {
+            diffPath = argv[++i];
+        } else if (!strcmp(arg, "--diff-tolerance")) {
+            ok = ReadFloats(argc, argv, i, diffTolerance, 2);
+        } else if (!strcmp(arg, "--diff-out") && i + 1 < argc) {
+            diffOutPath = argv[++i];
+        } else if (!strcmp(arg, "--bench")) {
+            bench = true;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            Usage();
+            return 1;
+        }
+    }
+    if (scene.width == 0 || scene.height == 0) {
+        Usage();
+        return 1;
+    }
+    threads = threads == 0 ? 1 : threads;
+    frames = frames == 0 ? 1 : frames;
+    LookAt(position, focus, scene);
+
+    int envWidth = 0, envHeight = 0, components = 0;
+    float* data = stbi_loadf(envPath.c_str(), &envWidth, &envHeight, &components, 4);
+    if (!data) {
+        fprintf(stderr, "Failed to load %s\n", envPath.c_str());
+        return 1;
+    }
+    std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads - 1) : nullptr);
+    soft::SceneRenderer renderer;
+    auto start = std::chrono::steady_clock::now();
+    renderer.Init(data, (unsigned)envWidth, (unsigned)envHeight, latLines, longLines, iblSamples, pool.get());
+    stbi_image_free(data);
+    printf("Lighting maps: %.3f s\n", Seconds(start));
+
+    if (bench) {
+        // Пул из n - 1 рабочих потоков плюс вызывающий поток; первый кадр прогревает буферы и не учитывается.
+        for (unsigned n = 1; n <= threads; n++) {
+            std::unique_ptr<ThreadPool> benchPool(n > 1 ? new ThreadPool(n - 1) : nullptr);
+            renderer.Render(scene, benchPool.get());
+            double frameSeconds = 0.0, setupSeconds = 0.0, rasterSeconds = 0.0;
+            for (unsigned f = 0; f < frames; f++) {
+                renderer.Render(scene, benchPool.get());
+                frameSeconds += renderer.GetStats().frameSeconds;
+                setupSeconds += renderer.GetStats().raster.setupSeconds;
+                rasterSeconds += renderer.GetStats().raster.rasterSeconds;
+            }
+            const soft::RasterStats& raster = renderer.GetStats().raster;
+            printf("threads %2u: %7.2f ms/frame, setup %6.2f Mtri/s, raster+shade %6.2f Mpix/s (%llu tris, %llu binned, %llu shaded px)\n",
+                n, frameSeconds / frames * 1e3, raster.trianglesSubmitted * frames / setupSeconds * 1e-6,
+                raster.pixelsShaded * frames / rasterSeconds * 1e-6, (unsigned long long)raster.trianglesSubmitted,
+                (unsigned long long)raster.trianglesBinned, (unsigned long long)raster.pixelsShaded);
+        }
+        return 0;
+    }
+
+    renderer.Render(scene, pool.get());
+    const soft::SceneStats& stats = renderer.GetStats();
+    printf("Frame %ux%u: %.2f ms (vertex %.2f, setup %.2f, raster+shade %.2f, tonemap %.2f), %llu triangles, %llu pixels shaded\n",
+        scene.width, scene.height, stats.frameSeconds * 1e3, stats.vertexSeconds * 1e3, stats.raster.setupSeconds * 1e3,
+        stats.raster.rasterSeconds * 1e3, stats.tonemapSeconds * 1e3, (unsigned long long)stats.raster.trianglesSubmitted,
+        (unsigned long long)stats.raster.pixelsShaded);
+
+    std::vector<uint8_t> encoded;
+    if (!encoder::EncodePNG(renderer.GetLdr().data(), scene.width, scene.height, scene.width * 4, PixelFormat::RGBA8, encoded) ||
+        !encoder::WriteFile(outPath, encoded)) {
+        fprintf(stderr, "Failed to write %s\n", outPath.c_str());
+        return 1;
+    }
+    printf("Written %s\n", outPath.c_str());
+    if (!hdrPath.empty()) {
+        if (!encoder::EncodeHDR(renderer.GetHdr().data(), scene.width, scene.height, scene.width * 4 * sizeof(float),
+            PixelFormat::RGBA32F, encoded) || !encoder::WriteFile(hdrPath, encoded)) {
+            fprintf(stderr, "Failed to write %s\n", hdrPath.c_str());
+            return 1;
+        }
+        printf("Written %s\n", hdrPath.c_str());
+    }
+    if (!diffPath.empty() &&
+        !Compare(renderer.GetLdr(), scene.width, scene.height, diffPath, diffTolerance[0], diffTolerance[1], diffOutPath)) {
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,675 @@
+﻿#include "SoftwareRenderer.h"
+#include "ThreadPool.h"
+#include "MeshGenerator.h"
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+namespace soft {
+    namespace {
+        const float pi = 3.14159265359f;
+
+        void For(ThreadPool* pool, size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+            if (pool) {
+                pool->ParallelFor(count, grain, body);
+            } else {
+                body(0, count);
+            }
+        }
+
+        inline float Dot(const float* a, const float* b) {
+            return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        }
+
+        inline void Cross(const float* a, const float* b, float* out) {
+            out[0] = a[1] * b[2] - a[2] * b[1];
+            out[1] = a[2] * b[0] - a[0] * b[2];
+            out[2] = a[0] * b[1] - a[1] * b[0];
+        }
+
+        inline void Normalize(float* v) {
+            float scale = 1.0f / std::sqrt(Dot(v, v));
+            v[0] *= scale;
+            v[1] *= scale;
+            v[2] *= scale;
+        }
+
+        inline float Saturate(float x) {
+            return std::min(std::max(x, 0.0f), 1.0f);
+        }
+
+        // Hammersley и ImportanceSampleGGX из prefilteredColorPS.hlsl и brdfPS.hlsl (a = roughness^2).
+        float RadicalInverse(uint32_t bits) {
+            bits = (bits << 16u) | (bits >> 16u);
+            bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+            bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+            bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+            bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+            return float(bits) * 2.3283064365386963e-10f;
+        }
+
+        void ImportanceSampleGGX(float xi0, float xi1, const float n[3], float roughness, float h[3]) {
+            float a = roughness * roughness;
+            float phi = 2.0f * pi * xi0;
+            float cosTheta = std::sqrt((1.0f - xi1) / (1.0f + (a * a - 1.0f) * xi1));
+            float sinTheta = std::sqrt(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+            float local[3] = { std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta };
+
+            const float up[3] = { std::fabs(n[2]) < 0.999f ? 0.0f : 1.0f, 0.0f, std::fabs(n[2]) < 0.999f ? 1.0f : 0.0f };
+            float tangent[3], bitangent[3];
+            Cross(up, n, tangent);
+            Normalize(tangent);
+            Cross(n, tangent, bitangent);
+            for (int k = 0; k < 3; k++) {
+                h[k] = tangent[k] * local[0] + bitangent[k] * local[1] + n[k] * local[2];
+            }
+        }
+
+        float DistributionGGX(float nh, float roughness) {
+            float num = roughness * roughness;
+            float denom = std::max(nh, 0.0f);
+            denom = denom * denom * (num - 1.0f) + 1.0f;
+            denom = pi * denom * denom;
+            return num / denom;
+        }
+
+        float GeometrySchlick(float x, float k) {
+            return x / (x * (1.0f - k) + k);
+        }
+
+        // Вид Renderer: XMMatrixLookAtLH и XMMatrixPerspectiveFovLH(fovY, aspect, 100, 0.01) с обратной глубиной.
+        struct Projection {
+            float position[3], right[3], up[3], forward[3];
+            float xScale, yScale, zScale, zOffset;
+
+            explicit Projection(const SceneDesc& scene) {
+                memcpy(position, scene.cameraPosition, sizeof(position));
+                memcpy(right, scene.cameraRight, sizeof(right));
+                memcpy(up, scene.cameraUp, sizeof(up));
+                memcpy(forward, scene.cameraForward, sizeof(forward));
+                const float nearZ = 100.0f, farZ = 0.01f;
+                yScale = 1.0f / std::tan(scene.fovY * 0.5f);
+                xScale = yScale * scene.height / (float)scene.width;
+                zScale = farZ / (farZ - nearZ);
+                zOffset = -zScale * nearZ;
+            }
+
+            void Transform(const float world[3], float clip[4]) const {
+                float d[3] = { world[0] - position[0], world[1] - position[1], world[2] - position[2] };
+                float z = Dot(d, forward);
+                clip[0] = Dot(d, right) * xScale;
+                clip[1] = Dot(d, up) * yScale;
+                clip[2] = z * zScale + zOffset;
+                clip[3] = z;
+            }
+        };
+
+        // CubeMapPS.hlsl: цвет окружения по направлению из центра сферы скайбокса.
+        class SkyboxShader : public PixelShader {
+        public:
+            explicit SkyboxShader(const ImageBasedLighting& ibl) : ibl_(ibl) {};
+
+            void Shade(const float* varyings, float color[4]) const override {
+                ibl_.Environment(varyings, color);
+                color[3] = 1.0f;
+            }
+
+        private:
+            const ImageBasedLighting& ibl_;
+        };
+
+        // PS.hlsl и CalculateColor из LightCalc.h в режиме DEFAULT. varyings: мировая позиция, нормаль.
+        class SphereShader : public PixelShader {
+        public:
+            SphereShader(const ImageBasedLighting& ibl, const SceneDesc& scene) : ibl_(ibl), scene_(scene) {
+                roughness_ = std::min(std::max(scene.roughness, 0.0001f), 1.0f);
+                metalness_ = Saturate(scene.metalness);
+                for (int k = 0; k < 3; k++) {
+                    f0_[k] = 0.04f * (1.0f - metalness_) + scene.color[k] * metalness_;
+                }
+            }
+
+            void Shade(const float* varyings, float color[4]) const override {
+                const float* pos = varyings;
+                float n[3] = { varyings[3], varyings[4], varyings[5] };
+                Normalize(n);
+                float v[3] = { scene_.cameraPosition[0] - pos[0], scene_.cameraPosition[1] - pos[1], scene_.cameraPosition[2] - pos[2] };
+                Normalize(v);
+                const float* objColor = scene_.color;
+                float nv = std::max(Dot(n, v), 0.0f);
+
+                float r[3];
+                for (int k = 0; k < 3; k++) {
+                    r[k] = 2.0f * Dot(n, v) * n[k] - v[k];
+                }
+                const float maxReflectionLod = 4.0f;
+                float prefiltered[3], envBrdf[2], irradiance[3];
+                ibl_.Prefiltered(r, roughness_ * maxReflectionLod, prefiltered);
+                ibl_.Brdf(nv, roughness_, envBrdf);
+                ibl_.Irradiance(n, irradiance);
+
+                float m5 = std::pow(1.0f - nv, 5.0f);
+                for (int k = 0; k < 3; k++) {
+                    float specular = prefiltered[k] * (f0_[k] * envBrdf[0] + envBrdf[1]);
+                    float fr = f0_[k] + (std::max(1.0f - roughness_, f0_[k]) - f0_[k]) * m5;
+                    float kd = (1.0f - fr) * (1.0f - metalness_);
+                    color[k] = irradiance[k] * objColor[k] * kd + specular;
+                }
+
+                float k = (roughness_ + 1.0f) * (roughness_ + 1.0f) / 8.0f;
+                for (const SceneLight& light : scene_.lights) {
+                    float l[3] = { light.position[0] - pos[0], light.position[1] - pos[1], light.position[2] - pos[2] };
+                    float distance = std::sqrt(Dot(l, l));
+                    for (int c = 0; c < 3; c++) {
+                        l[c] /= distance;
+                    }
+                    float attenuation = Saturate(1.0f / (distance * distance));
+                    float h[3] = { v[0] + l[0], v[1] + l[1], v[2] + l[2] };
+                    Normalize(h);
+                    float nl = std::max(Dot(n, l), 0.0f);
+                    float hv5 = std::pow(1.0f - std::max(Dot(h, v), 0.0f), 5.0f);
+                    float ndf = DistributionGGX(Dot(n, h), roughness_);
+                    float g = GeometrySchlick(nv, k) * GeometrySchlick(nl, k);
+                    float denom = std::max(4.0f * nv * nl, 0.0001f);
+                    for (int c = 0; c < 3; c++) {
+                        float f = f0_[c] + (1.0f - f0_[c]) * hv5;
+                        float kd = (1.0f - f) * (1.0f - metalness_);
+                        float radiance = light.color[c] * light.brightness * attenuation;
+                        color[c] += (kd * objColor[c] / pi + ndf * g * f / denom) * radiance * nl;
+                    }
+                }
+                color[3] = 1.0f;
+            }
+
+        private:
+            const ImageBasedLighting& ibl_;
+            const SceneDesc& scene_;
+            float roughness_, metalness_;
+            float f0_[3];
+        };
+
+        static_assert(shadeBatchSize == shadingBatch, "ShadeBatch of the rasterizer must match ShadingKernel");
+
+        // Тот же PS.hlsl пакетами по shadingBatch пикселей через ShadingKernel, во всех четырех режимах.
+        class SphereBatchShader : public PixelShader {
+        public:
+            SphereBatchShader(const ImageBasedLighting& ibl, const SceneDesc& scene) : ibl_(ibl), scene_(scene) {
+                roughness_ = std::min(std::max(scene.roughness, 0.0001f), 1.0f);
+                metalness_ = Saturate(scene.metalness);
+                for (const SceneLight& light : scene.lights) {
+                    lights_.Add(light.position, light.color, light.brightness);
+                }
+            }
+
+            void Shade(const float* varyings, float color[4]) const override {
+                float batch[maxVaryings * shadeBatchSize] = {};
+                for (unsigned k = 0; k < 6; k++) {
+                    batch[k * shadeBatchSize] = varyings[k];
+                }
+                float colors[4 * shadeBatchSize];
+                ShadeBatch(batch, 1, colors);
+                memcpy(color, colors, 4 * sizeof(float));
+            }
+
+            void ShadeBatch(const float* varyings, unsigned count, float* color) const override {
+                SurfaceBatch batch;
+                for (unsigned i = 0; i < shadingBatch; i++) {
+                    // Лишние дорожки повторяют первый пиксель.
+                    unsigned src = i < count ? i : 0;
+                    float n[3] = { varyings[3 * shadeBatchSize + src], varyings[4 * shadeBatchSize + src], varyings[5 * shadeBatchSize + src] };
+                    Normalize(n);
+                    for (int k = 0; k < 3; k++) {
+                        batch.position[k][i] = varyings[k * shadeBatchSize + src];
+                        batch.normal[k][i] = n[k];
+                        batch.color[k][i] = scene_.color[k];
+                    }
+                    batch.roughness[i] = roughness_;
+                    batch.metalness[i] = metalness_;
+                }
+                if (scene_.mode == ShadingMode::Default) {
+                    float r[3][shadingBatch], nv[shadingBatch];
+                    ReflectionVectors(batch, scene_.cameraPosition, r, nv);
+                    const float maxReflectionLod = 4.0f;
+                    for (unsigned i = 0; i < shadingBatch; i++) {
+                        unsigned src = i < count ? i : 0;
+                        float direction[3] = { r[0][src], r[1][src], r[2][src] };
+                        float n[3] = { batch.normal[0][src], batch.normal[1][src], batch.normal[2][src] };
+                        float prefiltered[3], envBrdf[2], irradiance[3];
+                        if (i == src) {
+                            ibl_.Prefiltered(direction, roughness_ * maxReflectionLod, prefiltered);
+                            ibl_.Brdf(nv[src], roughness_, envBrdf);
+                            ibl_.Irradiance(n, irradiance);
+                        } else {
+                            for (int k = 0; k < 3; k++) {
+                                prefiltered[k] = batch.prefiltered[k][0];
+                                irradiance[k] = batch.irradiance[k][0];
+                            }
+                            envBrdf[0] = batch.brdf[0][0];
+                            envBrdf[1] = batch.brdf[1][0];
+                        }
+                        for (int k = 0; k < 3; k++) {
+                            batch.prefiltered[k][i] = prefiltered[k];
+                            batch.irradiance[k][i] = irradiance[k];
+                        }
+                        batch.brdf[0][i] = envBrdf[0];
+                        batch.brdf[1][i] = envBrdf[1];
+                    }
+                }
+                float out[3][shadingBatch];
+                soft::ShadeBatch(scene_.mode, batch, scene_.cameraPosition, lights_, out);
+                for (unsigned i = 0; i < count; i++) {
+                    for (int k = 0; k < 3; k++) {
+                        color[i * 4 + k] = out[k][i];
+                    }
+                    color[i * 4 + 3] = 1.0f;
+                }
+            }
+
+        private:
+            const ImageBasedLighting& ibl_;
+            const SceneDesc& scene_;
+            float roughness_, metalness_;
+            LightList lights_;
+        };
+
+        // Uncharted 2 из tonemapPS.hlsl.
+        inline float Uncharted2(float x) {
+            const float A = 0.1f, B = 0.50f, C = 0.1f, D = 0.20f, E = 0.02f, F = 0.30f;
+            return ((x * (A * x + C * B) + D * E) / (x * (A * x + B) + D * F)) - E / F;
+        }
+
+        inline float Luminance(const float* c) {
+            return c[0] * 0.2126f + c[1] * 0.7151f + c[2] * 0.0722f;
+        }
+
+        // Запись в R8G8B8A8_UNORM_SRGB: таблица по 16 битам линейного значения вместо pow на каждый канал.
+        struct SrgbTable {
+            static const unsigned size = 65536;
+            uint8_t values[size];
+
+            SrgbTable() {
+                for (unsigned i = 0; i < size; i++) {
+                    float linear = i / (float)(size - 1);
+                    float s = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+                    values[i] = (uint8_t)(s * 255.0f + 0.5f);
+                }
+            }
+        };
+
+        inline uint8_t ToSrgb8(const SrgbTable& table, float linear) {
+            return table.values[(unsigned)(Saturate(linear) * (SrgbTable::size - 1) + 0.5f)];
+        }
+    }
+
+    void EquirectMap::Resize(unsigned w, unsigned h) {
+        width = w;
+        height = h;
+        rgb.assign((size_t)w * h * 3, 0.0f);
+    }
+
+    void EquirectMap::TexelDirection(unsigned x, unsigned y, float direction[3]) const {
+        float phi = 2.0f * pi * (1.0f - (x + 0.5f) / width);
+        float elevation = pi * (0.5f - (y + 0.5f) / height);
+        direction[0] = std::cos(elevation) * std::cos(phi);
+        direction[1] = std::sin(elevation);
+        direction[2] = std::cos(elevation) * std::sin(phi);
+    }
+
+    void EquirectMap::Sample(const float direction[3], float color[3]) const {
+        float u = 1.0f - std::atan2(direction[2], direction[0]) / (2.0f * pi);
+        float v = 0.5f - std::atan2(direction[1], std::sqrt(direction[0] * direction[0] + direction[2] * direction[2])) / pi;
+        float fx = u * width - 0.5f, fy = v * height - 0.5f;
+        float x0f = std::floor(fx), y0f = std::floor(fy);
+        float tx = fx - x0f, ty = fy - y0f;
+        int x0 = ((int)x0f % (int)width + (int)width) % (int)width;
+        int x1 = (x0 + 1) % (int)width;
+        int y0 = std::min(std::max((int)y0f, 0), (int)height - 1);
+        int y1 = std::min(std::max((int)y0f + 1, 0), (int)height - 1);
+        const float* c00 = &rgb[((size_t)y0 * width + x0) * 3];
+        const float* c10 = &rgb[((size_t)y0 * width + x1) * 3];
+        const float* c01 = &rgb[((size_t)y1 * width + x0) * 3];
+        const float* c11 = &rgb[((size_t)y1 * width + x1) * 3];
+        for (int k = 0; k < 3; k++) {
+            float top = c00[k] + (c10[k] - c00[k]) * tx;
+            float bottom = c01[k] + (c11[k] - c01[k]) * tx;
+            color[k] = top + (bottom - top) * ty;
+        }
+    }
+
+    void EquirectMap::Downsample(const EquirectMap& source) {
+        Resize(std::max(source.width / 2, 1u), std::max(source.height / 2, 1u));
+        for (unsigned y = 0; y < height; y++) {
+            for (unsigned x = 0; x < width; x++) {
+                unsigned sx = std::min(x * 2, source.width - 1), sy = std::min(y * 2, source.height - 1);
+                unsigned sx1 = std::min(sx + 1, source.width - 1), sy1 = std::min(sy + 1, source.height - 1);
+                for (int k = 0; k < 3; k++) {
+                    rgb[((size_t)y * width + x) * 3 + k] = 0.25f * (
+                        source.rgb[((size_t)sy * source.width + sx) * 3 + k] + source.rgb[((size_t)sy * source.width + sx1) * 3 + k] +
+                        source.rgb[((size_t)sy1 * source.width + sx) * 3 + k] + source.rgb[((size_t)sy1 * source.width + sx1) * 3 + k]);
+                }
+            }
+        }
+    }
+
+    void ImageBasedLighting::Init(const float* rgba, unsigned width, unsigned height, unsigned sampleCount, ThreadPool* pool) {
+        sampleCount = std::max(sampleCount, 1u);
+        environment_.assign(1, EquirectMap());
+        environment_[0].Resize(width, height);
+        for (size_t i = 0; i < (size_t)width * height; i++) {
+            memcpy(&environment_[0].rgb[i * 3], rgba + i * 4, 3 * sizeof(float));
+        }
+        while (environment_.back().width > 1 && environment_.back().height > 1) {
+            EquirectMap next;
+            next.Downsample(environment_.back());
+            environment_.push_back(std::move(next));
+        }
+
+        // Облученность (cubemapGeneratorIrradiancePS.hlsl): интеграл L * cos по полусфере, деленный на pi.
+        // Вместо сетки 1000 x 250 направлений суммируются тексели уровня окружения шириной до 128.
+        const EquirectMap* source = &environment_[0];
+        for (const EquirectMap& level : environment_) {
+            source = &level;
+            if (level.width <= 128)
+                break;
+        }
+        std::vector<float> sourceDirections((size_t)source->width * source->height * 4);
+        for (unsigned y = 0; y < source->height; y++) {
+            for (unsigned x = 0; x < source->width; x++) {
+                float* d = &sourceDirections[((size_t)y * source->width + x) * 4];
+                source->TexelDirection(x, y, d);
+                d[3] = (2.0f * pi / source->width) * (pi / source->height) * std::sqrt(d[0] * d[0] + d[2] * d[2]);
+            }
+        }
+        irradiance_.Resize(irradianceWidth, irradianceWidth / 2);
+        For(pool, irradiance_.height, 1, [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; y++) {
+                for (unsigned x = 0; x < irradiance_.width; x++) {
+                    float n[3];
+                    irradiance_.TexelDirection(x, (unsigned)y, n);
+                    double sum[3] = {};
+                    for (size_t i = 0; i < (size_t)source->width * source->height; i++) {
+                        const float* d = &sourceDirections[i * 4];
+                        float weight = Dot(n, d) * d[3];
+                        if (weight <= 0.0f)
+                            continue;
+                        for (int k = 0; k < 3; k++) {
+                            sum[k] += source->rgb[i * 3 + k] * weight;
+                        }
+                    }
+                    for (int k = 0; k < 3; k++) {
+                        irradiance_.rgb[((size_t)y * irradiance_.width + x) * 3 + k] = (float)(sum[k] / pi);
+                    }
+                }
+            }
+        });
+
+        // Префильтрация (prefilteredColorPS.hlsl): выборка по GGX с уровнем детализации по телесному углу отсчета.
+        // Телесный угол текселя берется для исходной развертки, а не для кубической карты 512 x 512.
+        const float texelSolidAngle = 4.0f * pi / ((float)width * height);
+        prefiltered_.assign(prefilteredLevels, EquirectMap());
+        for (unsigned level = 0; level < prefilteredLevels; level++) {
+            EquirectMap& target = prefiltered_[level];
+            target.Resize(std::max(prefilteredWidth >> level, 2u), std::max((prefilteredWidth / 2) >> level, 1u));
+            float roughness = level / (float)(prefilteredLevels - 1);
+            For(pool, target.height, 1, [&](size_t begin, size_t end) {
+                for (size_t y = begin; y < end; y++) {
+                    for (unsigned x = 0; x < target.width; x++) {
+                        float n[3];
+                        target.TexelDirection(x, (unsigned)y, n);
+                        float* out = &target.rgb[((size_t)y * target.width + x) * 3];
+                        // При нулевой шероховатости все отсчеты совпадают с n.
+                        if (roughness == 0.0f) {
+                            SampleEnvironment(n, 0.0f, out);
+                            continue;
+                        }
+                        float sum[3] = {}, totalWeight = 0.0f;
+                        for (unsigned i = 0; i < sampleCount; i++) {
+                            float h[3];
+                            ImportanceSampleGGX(i / (float)sampleCount, RadicalInverse(i), n, roughness, h);
+                            float hv = Dot(n, h);
+                            float l[3] = { 2.0f * hv * h[0] - n[0], 2.0f * hv * h[1] - n[1], 2.0f * hv * h[2] - n[2] };
+                            Normalize(l);
+                            float nl = std::max(Dot(n, l), 0.0f);
+                            if (nl <= 0.0f)
+                                continue;
+                            float nh = std::max(hv, 0.0f);
+                            float pdf = DistributionGGX(nh, roughness) * nh / (4.0f * nh) + 0.0001f;
+                            float sampleSolidAngle = 1.0f / (sampleCount * pdf + 0.0001f);
+                            float mip = std::max(0.5f * std::log2(sampleSolidAngle / texelSolidAngle), 0.0f);
+                            float c[3];
+                            SampleEnvironment(l, mip, c);
+                            for (int k = 0; k < 3; k++) {
+                                sum[k] += c[k] * nl;
+                            }
+                            totalWeight += nl;
+                        }
+                        for (int k = 0; k < 3; k++) {
+                            out[k] = totalWeight > 0.0f ? sum[k] / totalWeight : 0.0f;
+                        }
+                    }
+                }
+            });
+        }
+
+        // Таблица BRDF (brdfPS.hlsl): u - n.v, v - шероховатость, k = roughness^2 / 2.
+        brdf_.assign((size_t)brdfSize * brdfSize * 2, 0.0f);
+        For(pool, brdfSize, 1, [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; y++) {
+                float roughness = (y + 0.5f) / brdfSize;
+                float k = roughness * roughness / 2.0f;
+                for (unsigned x = 0; x < brdfSize; x++) {
+                    float nv = (x + 0.5f) / brdfSize;
+                    float v[3] = { std::sqrt(1.0f - nv * nv), 0.0f, nv };
+                    const float n[3] = { 0.0f, 0.0f, 1.0f };
+                    float a = 0.0f, b = 0.0f;
+                    for (unsigned i = 0; i < sampleCount; i++) {
+                        float h[3];
+                        ImportanceSampleGGX(i / (float)sampleCount, RadicalInverse(i), n, roughness, h);
+                        float vh = Dot(v, h);
+                        float l[3] = { 2.0f * vh * h[0] - v[0], 2.0f * vh * h[1] - v[1], 2.0f * vh * h[2] - v[2] };
+                        Normalize(l);
+                        float nl = std::max(l[2], 0.0f);
+                        if (nl <= 0.0f)
+                            continue;
+                        float nh = std::max(h[2], 0.0f);
+                        vh = std::max(vh, 0.0f);
+                        float g = GeometrySchlick(nv, k) * GeometrySchlick(nl, k);
+                        float gVis = g * vh / (nh * nv);
+                        float fc = std::pow(1.0f - vh, 5.0f);
+                        a += (1.0f - fc) * gVis;
+                        b += fc * gVis;
+                    }
+                    brdf_[(y * brdfSize + x) * 2] = a / sampleCount;
+                    brdf_[(y * brdfSize + x) * 2 + 1] = b / sampleCount;
+                }
+            }
+        });
+    }
+
+    void ImageBasedLighting::SampleEnvironment(const float direction[3], float level, float color[3]) const {
+        level = std::min(std::max(level, 0.0f), (float)(environment_.size() - 1));
+        unsigned l0 = (unsigned)level;
+        unsigned l1 = std::min(l0 + 1, (unsigned)environment_.size() - 1);
+        float t = level - l0;
+        environment_[l0].Sample(direction, color);
+        if (t > 0.0f && l1 != l0) {
+            float c[3];
+            environment_[l1].Sample(direction, c);
+            for (int k = 0; k < 3; k++) {
+                color[k] += (c[k] - color[k]) * t;
+            }
+        }
+    }
+
+    void ImageBasedLighting::Environment(const float direction[3], float color[3]) const {
+        environment_[0].Sample(direction, color);
+    }
+
+    void ImageBasedLighting::Irradiance(const float normal[3], float color[3]) const {
+        irradiance_.Sample(normal, color);
+    }
+
+    void ImageBasedLighting::Prefiltered(const float direction[3], float level, float color[3]) const {
+        level = std::min(std::max(level, 0.0f), (float)(prefilteredLevels - 1));
+        unsigned l0 = (unsigned)level;
+        unsigned l1 = std::min(l0 + 1, prefilteredLevels - 1);
+        float t = level - l0;
+        prefiltered_[l0].Sample(direction, color);
+        if (t > 0.0f && l1 != l0) {
+            float c[3];
+            prefiltered_[l1].Sample(direction, c);
+            for (int k = 0; k < 3; k++) {
+                color[k] += (c[k] - color[k]) * t;
+            }
+        }
+    }
+
+    void ImageBasedLighting::Brdf(float nv, float roughness, float scaleBias[2]) const {
+        float fx = Saturate(nv) * brdfSize - 0.5f, fy = Saturate(roughness) * brdfSize - 0.5f;
+        int x0 = std::min(std::max((int)std::floor(fx), 0), (int)brdfSize - 1);
+        int y0 = std::min(std::max((int)std::floor(fy), 0), (int)brdfSize - 1);
+        int x1 = std::min(x0 + 1, (int)brdfSize - 1), y1 = std::min(y0 + 1, (int)brdfSize - 1);
+        float tx = Saturate(fx - x0), ty = Saturate(fy - y0);
+        for (int k = 0; k < 2; k++) {
+            float top = brdf_[(y0 * brdfSize + x0) * 2 + k] + (brdf_[(y0 * brdfSize + x1) * 2 + k] - brdf_[(y0 * brdfSize + x0) * 2 + k]) * tx;
+            float bottom = brdf_[(y1 * brdfSize + x0) * 2 + k] + (brdf_[(y1 * brdfSize + x1) * 2 + k] - brdf_[(y1 * brdfSize + x0) * 2 + k]) * tx;
+            scaleBias[k] = top + (bottom - top) * ty;
+        }
+    }
+
+    void SceneRenderer::Init(const float* rgba, unsigned width, unsigned height, unsigned latLines, unsigned longLines,
+                             unsigned iblSamples, ThreadPool* pool) {
+        ibl_.Init(rgba, width, height, iblSamples, pool);
+        SetTessellation(latLines, longLines);
+    }
+
+    void SceneRenderer::SetTessellation(unsigned latLines, unsigned longLines) {
+        mesh::MeshData sphere;
+        mesh::UVSphere(latLines, longLines, sphere);
+        size_t vertexCount = sphere.GetVertexCount();
+        spherePositions_.resize(vertexCount * 3);
+        sphereVaryings_.resize(vertexCount * 6);
+        for (size_t i = 0; i < vertexCount; i++) {
+            float p[3] = { sphere.position.x[i], sphere.position.y[i], sphere.position.z[i] };
+            float n[3] = { sphere.normal.x[i], sphere.normal.y[i], sphere.normal.z[i] };
+            memcpy(&spherePositions_[i * 3], p, sizeof(p));
+            memcpy(&sphereVaryings_[i * 6], p, sizeof(p));
+            memcpy(&sphereVaryings_[i * 6 + 3], n, sizeof(n));
+        }
+        sphereIndices_.resize(sphere.indices.size());
+        skyboxIndices_.resize(sphere.indices.size());
+        mesh::WriteIndices(sphere, mesh::Winding::Outward, sphereIndices_.data());
+        mesh::WriteIndices(sphere, mesh::Winding::Inward, skyboxIndices_.data());
+        sphereClip_.resize(vertexCount * 4);
+        skyboxClip_.resize(vertexCount * 4);
+    }
+
+    void SceneRenderer::Render(const SceneDesc& scene, ThreadPool* pool) {
+        auto frameStart = std::chrono::steady_clock::now();
+        stats_ = SceneStats();
+        if (ibl_.IsEmpty() || scene.width == 0 || scene.height == 0)
+            return;
+
+        // Вершинный этап: VS.hlsl (мировая матрица сферы единичная) и CubeMapVS.hlsl с размером как в ResizeSkybox.
+        const Projection projection(scene);
+        const float nearZ = 0.01f;
+        const float halfW = std::tan(scene.fovY * 0.5f) * nearZ;
+        const float halfH = scene.height / (float)scene.width * halfW;
+        const float skyboxSize = std::sqrt(nearZ * nearZ + halfH * halfH + halfW * halfW) * 1.1f;
+        size_t vertexCount = spherePositions_.size() / 3;
+        For(pool, vertexCount, 4096, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const float* p = &spherePositions_[i * 3];
+                projection.Transform(p, &sphereClip_[i * 4]);
+                float sky[3] = { scene.cameraPosition[0] + p[0] * skyboxSize, scene.cameraPosition[1] + p[1] * skyboxSize,
+                    scene.cameraPosition[2] + p[2] * skyboxSize };
+                projection.Transform(sky, &skyboxClip_[i * 4]);
+                skyboxClip_[i * 4 + 2] = 0.0f;
+            }
+        });
+        stats_.vertexSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count();
+
+        const float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        SkyboxShader skyboxShader(ibl_);
+        SphereShader sphereShader(ibl_, scene);
+        SphereBatchShader sphereBatchShader(ibl_, scene);
+        rasterizer_.Begin(scene.width, scene.height, clearColor);
+
+        DrawCall skybox;
+        skybox.clipPositions = skyboxClip_.data();
+        skybox.varyings = spherePositions_.data();
+        skybox.varyingCount = 3;
+        skybox.indices = skyboxIndices_.data();
+        skybox.indexCount = skyboxIndices_.size();
+        skybox.shader = &skyboxShader;
+        rasterizer_.Draw(skybox, pool);
+
+        DrawCall sphere;
+        sphere.clipPositions = sphereClip_.data();
+        sphere.varyings = sphereVaryings_.data();
+        sphere.varyingCount = 6;
+        sphere.indices = sphereIndices_.data();
+        sphere.indexCount = sphereIndices_.size();
+        if (scene.batchShading || scene.mode != ShadingMode::Default) {
+            sphere.shader = &sphereBatchShader;
+        } else {
+            sphere.shader = &sphereShader;
+        }
+        rasterizer_.Draw(sphere, pool);
+
+        rasterizer_.End(pool);
+        stats_.raster = rasterizer_.GetStats();
+
+        auto tonemapStart = std::chrono::steady_clock::now();
+        Tonemap(scene, pool);
+        auto frameEnd = std::chrono::steady_clock::now();
+        stats_.tonemapSeconds = std::chrono::duration<double>(frameEnd - tonemapStart).count();
+        stats_.frameSeconds = std::chrono::duration<double>(frameEnd - frameStart).count();
+    }
+
+    // brightnessPS.hlsl, цепочка downsamplePS.hlsl и tonemapPS.hlsl для одного кадра: адаптация глаза
+    // считается завершенной, то есть средний логарифм яркости берется без сглаживания по времени.
+    void SceneRenderer::Tonemap(const SceneDesc& scene, ThreadPool* pool) {
+        const std::vector<float>& hdr = rasterizer_.GetColor();
+        const size_t pixelCount = (size_t)scene.width * scene.height;
+        const size_t grain = 16384;
+        const size_t blocks = (pixelCount + grain - 1) / grain;
+        std::vector<double> logSums(blocks, 0.0);
+        std::vector<float> minimums(blocks, 1e30f), maximums(blocks, 0.0f);
+        For(pool, blocks, 1, [&](size_t begin, size_t end) {
+            for (size_t block = begin; block < end; block++) {
+                for (size_t i = block * grain; i < std::min((block + 1) * grain, pixelCount); i++) {
+                    float lum = Luminance(&hdr[i * 4]);
+                    logSums[block] += std::log(lum + 1.0f);
+                    minimums[block] = std::min(minimums[block], lum);
+                    maximums[block] = std::max(maximums[block], lum);
+                }
+            }
+        });
+        double logSum = 0.0;
+        float minimum = 1e30f, maximum = 0.0f;
+        for (size_t block = 0; block < blocks; block++) {
+            logSum += logSums[block];
+            minimum = std::min(minimum, minimums[block]);
+            maximum = std::max(maximum, maximums[block]);
+        }
+        float adapted = (float)(logSum / pixelCount);
+        float avg = std::exp(adapted) - 1.0f;
+        float keyValue = 1.03f - 2.0f / (2.0f + std::log(avg + 1.0f));
+        float exposure = keyValue / std::min(std::max(avg, minimum), maximum) * scene.exposure;
+        const float whiteScale = 1.0f / Uncharted2(11.2f);
+        static const SrgbTable srgb;
+
+        ldr_.resize(pixelCount * 4);
+        For(pool, pixelCount, grain, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                for (int k = 0; k < 3; k++) {
+                    ldr_[i * 4 + k] = ToSrgb8(srgb, Uncharted2(exposure * hdr[i * 4 + k]) * whiteScale);
+                }
+                ldr_[i * 4 + 3] = 255;
+            }
+        });
+    }
+}
@@ -0,0 +1,135 @@
+﻿#pragma once
+
+#include "SoftwareRasterizer.h"
+#include "ShadingKernel.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+
+// Кадр Lab5 целиком на CPU через soft::Rasterizer: скайбокс, сфера с затенением CalculateColor (режимы PS.hlsl)
+// и тонмаппинг tonemapPS.hlsl. Карты освещения считаются теми же формулами, что проходы CubemapGenerator,
+// только в развертке окружения вместо кубических карт. Не зависит от D3D и собирается на Linux
+// (см. SoftwareRenderMain.cpp).
+namespace soft {
+    // Прямоугольная развертка окружения в тех же координатах, что cubemapGeneratorPS.hlsl.
+    struct EquirectMap {
+        unsigned width = 0;
+        unsigned height = 0;
+        std::vector<float> rgb;
+
+        void Resize(unsigned w, unsigned h);
+        // Направление через центр текселя.
+        void TexelDirection(unsigned x, unsigned y, float direction[3]) const;
+        // Билинейная выборка: по u с повтором, по v с ограничением.
+        void Sample(const float direction[3], float color[3]) const;
+        // Уменьшение вдвое усреднением 2 x 2.
+        void Downsample(const EquirectMap& source);
+    };
+
+    class ImageBasedLighting {
+    public:
+        static const unsigned irradianceWidth = 64;
+        static const unsigned prefilteredWidth = 256;   // уровень 0, каждый следующий вдвое меньше
+        static const unsigned prefilteredLevels = 5;    // шероховатость 0, 0.25, ..., 1, как prefilteredRoughness
+        static const unsigned brdfSize = 64;
+
+        // rgba - как возвращает stbi_loadf(..., 4). sampleCount - число отсчетов GGX на тексель префильтрации
+        // и таблицы BRDF (в шейдерах 1024).
+        void Init(const float* rgba, unsigned width, unsigned height, unsigned sampleCount = 1024, ThreadPool* pool = nullptr);
+
+        bool IsEmpty() const {
+            return environment_.empty();
+        };
+
+        void Environment(const float direction[3], float color[3]) const;
+        void Irradiance(const float normal[3], float color[3]) const;
+        // Как prefilteredTexture.SampleLevel: трилинейно между уровнями шероховатости.
+        void Prefiltered(const float direction[3], float level, float color[3]) const;
+        // Как brdfTexture.Sample(float2(nv, roughness)): масштаб и смещение F0.
+        void Brdf(float nv, float roughness, float scaleBias[2]) const;
+
+    private:
+        void SampleEnvironment(const float direction[3], float level, float color[3]) const;
+
+        std::vector<EquirectMap> environment_;          // уровни детализации исходной карты
+        EquirectMap irradiance_;
+        std::vector<EquirectMap> prefiltered_;
+        std::vector<float> brdf_;                       // brdfSize x brdfSize пар (масштаб, смещение)
+    };
+
+    struct SceneLight {
+        float position[3];
+        float color[3];
+        float brightness;
+    };
+
+    // Камера как в Renderer: базис из обращенной матрицы вида и XMMatrixPerspectiveFovLH(fovY, w / h, 100, 0.01).
+    struct SceneDesc {
+        unsigned width = 1280;
+        unsigned height = 720;
+        float cameraPosition[3] = { 0.0f, 0.0f, -5.0f };
+        float cameraRight[3] = { 1.0f, 0.0f, 0.0f };
+        float cameraUp[3] = { 0.0f, 1.0f, 0.0f };
+        float cameraForward[3] = { 0.0f, 0.0f, 1.0f };
+        float fovY = 3.14159265f / 3.0f;
+        float color[3] = { 1.0f, 0.71f, 0.29f };
+        float roughness = 0.01f;
+        float metalness = 1.0f;
+        std::vector<SceneLight> lights;
+        ShadingMode mode = ShadingMode::Default;
+        bool batchShading = true;                       // false - эталонный поштучный шейдер, только DEFAULT
+        float exposure = 1.0f;                          // множитель ToneMapping::SetFactor
+    };
+
+    struct SceneStats {
+        RasterStats raster;
+        double vertexSeconds = 0.0;
+        double tonemapSeconds = 0.0;
+        double frameSeconds = 0.0;
+    };
+
+    class SceneRenderer {
+    public:
+        // Окружение и тесселяция сферы задаются один раз, карты освещения строятся здесь же.
+        void Init(const float* rgba, unsigned width, unsigned height, unsigned latLines = 40, unsigned longLines = 40,
+                  unsigned iblSamples = 1024, ThreadPool* pool = nullptr);
+        void SetTessellation(unsigned latLines, unsigned longLines);
+
+        void Render(const SceneDesc& scene, ThreadPool* pool = nullptr);
+
+        // HDR кадр до тонмаппинга, RGBA32F.
+        const std::vector<float>& GetHdr() const {
+            return rasterizer_.GetColor();
+        };
+
+        // Результат тонмаппинга в sRGB, как в back buffer с RTV R8G8B8A8_UNORM_SRGB.
+        const std::vector<uint8_t>& GetLdr() const {
+            return ldr_;
+        };
+
+        size_t GetTriangleCount() const {
+            return sphereIndices_.size() / 3;
+        };
+
+        const SceneStats& GetStats() const {
+            return stats_;
+        };
+
+    private:
+        void Tonemap(const SceneDesc& scene, ThreadPool* pool);
+
+        ImageBasedLighting ibl_;
+        std::vector<float> spherePositions_;    // xyz, единичная сфера, нормаль совпадает с позицией
+        std::vector<uint32_t> sphereIndices_;
+        std::vector<uint32_t> skyboxIndices_;   // та же сфера с обходом внутрь
+        std::vector<float> sphereClip_;
+        std::vector<float> sphereVaryings_;
+        std::vector<float> skyboxClip_;
+        Rasterizer rasterizer_;
+        std::vector<uint8_t> ldr_;
+        SceneStats stats_;
+    };
+}
@@ -0,0 +1,300 @@
+﻿#include "TangentSpace.h"
+#include "MeshGenerator.h"
+#include "MeshOptimizer.h"
+#include "ThreadPool.h"
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+
+namespace mesh {
+    namespace {
+        const float pi = 3.14159265358979f;
+
+        struct Vec3 {
+            float x, y, z;
+        };
+
+        inline Vec3 Sub(const Vec3& a, const Vec3& b) {
+            return { a.x - b.x, a.y - b.y, a.z - b.z };
+        }
+
+        inline Vec3 Scale(const Vec3& a, float s) {
+            return { a.x * s, a.y * s, a.z * s };
+        }
+
+        inline float Dot(const Vec3& a, const Vec3& b) {
+            return a.x * b.x + a.y * b.y + a.z * b.z;
+        }
+
+        inline bool NotZero(float value) {
+            return fabsf(value) > 1e-20f;
+        }
+
+        // Проекция на плоскость с нормалью n и нормализация; нулевой вектор остается нулевым.
+        inline Vec3 Project(const Vec3& v, const Vec3& n) {
+            Vec3 result = Sub(v, Scale(n, Dot(n, v)));
+            float length = sqrtf(Dot(result, result));
+            return NotZero(length) ? Scale(result, 1.0f / length) : result;
+        }
+
+        struct Input {
+            const uint8_t* data;
+            size_t stride;
+            size_t positionOffset;
+            size_t normalOffset;
+            size_t texCoordOffset;
+
+            Vec3 Position(uint32_t i) const {
+                Vec3 p;
+                memcpy(&p, data + i * stride + positionOffset, sizeof(p));
+                return p;
+            }
+
+            Vec3 Normal(uint32_t i) const {
+                Vec3 n;
+                memcpy(&n, data + i * stride + normalOffset, sizeof(n));
+                return n;
+            }
+
+            void TexCoord(uint32_t i, float uv[2]) const {
+                memcpy(uv, data + i * stride + texCoordOffset, 2 * sizeof(float));
+            }
+        };
+
+        enum TriangleFlags : uint32_t {
+            OrientPreserving = 1,   // UV развертка не зеркальная
+            GroupWithAny = 2        // нулевая площадь в UV, ориентация берется у соседей
+        };
+
+        struct TriangleInfo {
+            Vec3 os;                // единичные производные позиции по u и v со знаком ориентации
+            Vec3 ot;
+            uint32_t flags;
+        };
+
+        void For(ThreadPool* pool, size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+            if (pool != nullptr)
+                pool->ParallelFor(count, grain, body);
+            else if (count > 0)
+                body(0, count);
+        }
+    }
+
+    void GenerateTangents(const void* vertices, size_t vertexCount, size_t stride, size_t positionOffset,
+                          size_t normalOffset, size_t texCoordOffset, const uint32_t* indices, size_t indexCount,
+                          const TangentOptions& options, TangentResult& result, ThreadPool* pool) {
+        Input input = { static_cast<const uint8_t*>(vertices), stride, positionOffset, normalOffset, texCoordOffset };
+        size_t triangleCount = indexCount / 3;
+        size_t grain = std::max<size_t>(options.grain, 1);
+
+        // Вершины с одинаковыми позицией, нормалью и UV считаются одной, даже если они продублированы в буфере.
+        std::vector<float> keys(vertexCount * 8);
+        For(pool, vertexCount, grain * 3, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                Vec3 p = input.Position((uint32_t)i), n = input.Normal((uint32_t)i);
+                float* key = &keys[i * 8];
+                key[0] = p.x; key[1] = p.y; key[2] = p.z;
+                key[3] = n.x; key[4] = n.y; key[5] = n.z;
+                input.TexCoord((uint32_t)i, key + 6);
+            }
+        });
+        std::vector<uint32_t> weld;
+        size_t weldedCount = Weld(keys.data(), vertexCount, 8 * sizeof(float), weld);
+        std::vector<float>().swap(keys);
+
+        std::vector<TriangleInfo> triangles(triangleCount);
+        For(pool, triangleCount, grain, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++) {
+                const uint32_t* tri = indices + t * 3;
+                Vec3 d1 = Sub(input.Position(tri[1]), input.Position(tri[0]));
+                Vec3 d2 = Sub(input.Position(tri[2]), input.Position(tri[0]));
+                float uv0[2], uv1[2], uv2[2];
+                input.TexCoord(tri[0], uv0);
+                input.TexCoord(tri[1], uv1);
+                input.TexCoord(tri[2], uv2);
+                float t1x = uv1[0] - uv0[0], t1y = uv1[1] - uv0[1];
+                float t2x = uv2[0] - uv0[0], t2y = uv2[1] - uv0[1];
+                float signedArea = t1x * t2y - t1y * t2x;
+
+                TriangleInfo& info = triangles[t];
+                info.os = Sub(Scale(d1, t2y), Scale(d2, t1y));
+                info.ot = Sub(Scale(d2, t1x), Scale(d1, t2x));
+                info.flags = signedArea > 0.0f ? (uint32_t)OrientPreserving : 0u;
+                if (NotZero(signedArea)) {
+                    float sign = signedArea > 0.0f ? 1.0f : -1.0f;
+                    float lengthS = sqrtf(Dot(info.os, info.os)), lengthT = sqrtf(Dot(info.ot, info.ot));
+                    info.os = NotZero(lengthS) ? Scale(info.os, sign / lengthS) : Vec3{ 0.0f, 0.0f, 0.0f };
+                    info.ot = NotZero(lengthT) ? Scale(info.ot, sign / lengthT) : Vec3{ 0.0f, 0.0f, 0.0f };
+                }
+                else {
+                    info.os = info.ot = { 0.0f, 0.0f, 0.0f };
+                    info.flags |= GroupWithAny;
+                }
+            }
+        });
+
+        // Группа - склеенная вершина и ориентация: (weld * 2 + ориентация). Углы треугольников с нулевой
+        // UV площадью присоединяются к существующей группе вершины.
+        size_t groupCount = weldedCount * 2;
+        std::vector<uint32_t> groupStart(groupCount + 1, 0);
+        for (size_t c = 0; c < triangleCount * 3; c++) {
+            const TriangleInfo& info = triangles[c / 3];
+            if ((info.flags & GroupWithAny) == 0)
+                groupStart[weld[indices[c]] * 2 + (info.flags & OrientPreserving) + 1]++;
+        }
+        std::vector<uint32_t> cornerGroup(triangleCount * 3);
+        for (size_t c = 0; c < triangleCount * 3; c++) {
+            const TriangleInfo& info = triangles[c / 3];
+            size_t group = weld[indices[c]] * 2;
+            if ((info.flags & GroupWithAny) == 0)
+                group += info.flags & OrientPreserving;
+            else if (groupStart[group + 2] > 0 || groupStart[group + 1] == 0)
+                group += 1;
+            cornerGroup[c] = (uint32_t)group;
+        }
+        std::fill(groupStart.begin(), groupStart.end(), 0);
+        for (size_t c = 0; c < triangleCount * 3; c++) {
+            groupStart[cornerGroup[c] + 1]++;
+        }
+        for (size_t g = 0; g < groupCount; g++) {
+            groupStart[g + 1] += groupStart[g];
+        }
+        std::vector<uint32_t> groupCorners(triangleCount * 3);
+        {
+            std::vector<uint32_t> cursor(groupStart.begin(), groupStart.end() - 1);
+            for (size_t c = 0; c < triangleCount * 3; c++) {
+                groupCorners[cursor[cornerGroup[c]]++] = (uint32_t)c;
+            }
+        }
+        std::vector<uint32_t>().swap(cornerGroup);
+
+        // Касательная угла - сумма проекций углов группы, совместимых с ним (обе проекции ближе порога), с весом
+        // угла треугольника при вершине. Как в MikkTSpace, совместимость проверяется от каждого угла, а не от
+        // первого в подгруппе: отношение не транзитивно, и на веере у полюса это меняет результат. Суммы идут в
+        // порядке группы, поэтому углы с одним набором совместимых получают побитово одинаковые касательные.
+        float cosThreshold = cosf(options.angularThreshold * pi / 180.0f);
+        std::vector<float> cornerTangents(triangleCount * 3 * 4, 0.0f);
+        For(pool, groupCount, std::max<size_t>(grain / 2, 1), [&](size_t begin, size_t end) {
+            struct Member {
+                Vec3 os, ot;
+                float angle;
+                bool any;
+            };
+            std::vector<Member> members;
+            for (size_t g = begin; g < end; g++) {
+                uint32_t first = groupStart[g], last = groupStart[g + 1];
+                if (first == last)
+                    continue;
+                members.resize(last - first);
+                for (uint32_t i = first; i < last; i++) {
+                    uint32_t c = groupCorners[i];
+                    const uint32_t* tri = indices + c / 3 * 3;
+                    uint32_t k = c % 3;
+                    const TriangleInfo& info = triangles[c / 3];
+                    Vec3 n = input.Normal(tri[k]);
+                    Vec3 p = input.Position(tri[k]);
+                    Vec3 e1 = Project(Sub(input.Position(tri[(k + 2) % 3]), p), n);
+                    Vec3 e2 = Project(Sub(input.Position(tri[(k + 1) % 3]), p), n);
+                    members[i - first] = { Project(info.os, n), Project(info.ot, n),
+                        acosf(std::min(std::max(Dot(e1, e2), -1.0f), 1.0f)), (info.flags & GroupWithAny) != 0 };
+                }
+
+                auto compatible = [cosThreshold](const Member& a, const Member& b) {
+                    return a.any || b.any || (Dot(a.os, b.os) > cosThreshold && Dot(a.ot, b.ot) > cosThreshold);
+                };
+                // Обычно совместимы все пары, тогда сумма по всей группе одна на все углы.
+                bool allCompatible = true;
+                for (size_t i = 0; i < members.size() && allCompatible; i++) {
+                    for (size_t j = i + 1; j < members.size() && allCompatible; j++) {
+                        allCompatible = compatible(members[i], members[j]);
+                    }
+                }
+                Vec3 total = { 0.0f, 0.0f, 0.0f };
+                for (const Member& member : members) {
+                    total = { total.x + member.os.x * member.angle, total.y + member.os.y * member.angle, total.z + member.os.z * member.angle };
+                }
+                float sign = (g & 1) != 0 ? 1.0f : -1.0f;
+                for (size_t i = 0; i < members.size(); i++) {
+                    Vec3 tangent = total;
+                    if (!allCompatible) {
+                        tangent = { 0.0f, 0.0f, 0.0f };
+                        for (size_t j = 0; j < members.size(); j++) {
+                            const Member& other = members[j];
+                            if (j == i || compatible(members[i], other))
+                                tangent = { tangent.x + other.os.x * other.angle, tangent.y + other.os.y * other.angle, tangent.z + other.os.z * other.angle };
+                        }
+                    }
+                    float length = sqrtf(Dot(tangent, tangent));
+                    if (NotZero(length))
+                        tangent = Scale(tangent, 1.0f / length);
+                    float* out = &cornerTangents[groupCorners[first + i] * 4];
+                    out[0] = tangent.x;
+                    out[1] = tangent.y;
+                    out[2] = tangent.z;
+                    out[3] = sign;
+                }
+            }
+        });
+        std::vector<uint32_t>().swap(groupCorners);
+        std::vector<uint32_t>().swap(groupStart);
+
+        // Вершина с разными касательными в своих углах расщепляется: первая касательная остается на исходном
+        // месте, остальные получают новые вершины в конце буфера. Копии одной вершины связаны в список через next.
+        const uint32_t none = ~0u;
+        result.remap.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++) {
+            result.remap[i] = (uint32_t)i;
+        }
+        result.tangents.assign(vertexCount * 4, 0.0f);
+        result.indices.resize(triangleCount * 3);
+        std::vector<uint32_t> next(vertexCount, none);
+        std::vector<bool> assigned(vertexCount, false);
+        for (size_t c = 0; c < triangleCount * 3; c++) {
+            uint32_t v = indices[c];
+            const float* tangent = &cornerTangents[c * 4];
+            if (!assigned[v]) {
+                assigned[v] = true;
+                memcpy(&result.tangents[v * 4], tangent, 4 * sizeof(float));
+                result.indices[c] = v;
+                continue;
+            }
+            uint32_t copy = v;
+            while (memcmp(&result.tangents[copy * 4], tangent, 4 * sizeof(float)) != 0 && next[copy] != none) {
+                copy = next[copy];
+            }
+            if (memcmp(&result.tangents[copy * 4], tangent, 4 * sizeof(float)) != 0) {
+                uint32_t split = (uint32_t)result.remap.size();
+                next[copy] = split;
+                next.push_back(none);
+                result.remap.push_back(v);
+                result.tangents.insert(result.tangents.end(), tangent, tangent + 4);
+                copy = split;
+            }
+            result.indices[c] = copy;
+        }
+    }
+
+    void GenerateTangents(MeshData& mesh, const TangentOptions& options, ThreadPool* pool) {
+        VertexLayout layout = VertexLayout::Make(Position | Normal | TexCoord);
+        size_t vertexCount = mesh.GetVertexCount();
+        std::vector<uint8_t> vertices(vertexCount * layout.stride);
+        WriteVertices(mesh, layout, vertices.data());
+
+        TangentResult result;
+        GenerateTangents(vertices.data(), vertexCount, layout.stride, layout.positionOffset, layout.normalOffset,
+            layout.texCoordOffset, mesh.indices.data(), mesh.indices.size(), options, result, pool);
+
+        size_t count = result.remap.size();
+        for (std::vector<float>* stream : { &mesh.position.x, &mesh.position.y, &mesh.position.z, &mesh.normal.x,
+                                            &mesh.normal.y, &mesh.normal.z, &mesh.u, &mesh.v }) {
+            stream->resize(count);
+            for (size_t i = vertexCount; i < count; i++) {
+                (*stream)[i] = (*stream)[result.remap[i]];
+            }
+        }
+        mesh.tangent.swap(result.tangents);
+        mesh.indices.swap(result.indices);
+    }
+}
@@ -0,0 +1,35 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+
+// Касательные в соглашении MikkTSpace (Mikkelsen 2008): касательная строится по производным UV треугольника,
+// проецируется на плоскость нормали вершины и усредняется по углам с весом угла при вершине. Углы с разной
+// ориентацией UV (зеркальная развертка) не смешиваются, такие вершины расщепляются.
+namespace mesh {
+    struct MeshData;
+
+    struct TangentOptions {
+        float angularThreshold = 180.0f;    // градусы; при 180 вершины расщепляются только по ориентации, как в MikkTSpace
+        size_t grain = 16384;               // треугольников в одной задаче пула
+    };
+
+    struct TangentResult {
+        std::vector<uint32_t> remap;        // исходная вершина для каждой выходной, первые vertexCount совпадают с исходными
+        std::vector<float> tangents;        // xyz + знак битангенса, 4 float на выходную вершину
+        std::vector<uint32_t> indices;
+    };
+
+    // Позиция и нормаль - float3, UV - float2 по смещениям внутри вершины размера stride.
+    // Без pool вычисления выполняются в вызывающем потоке.
+    void GenerateTangents(const void* vertices, size_t vertexCount, size_t stride, size_t positionOffset,
+                          size_t normalOffset, size_t texCoordOffset, const uint32_t* indices, size_t indexCount,
+                          const TangentOptions& options, TangentResult& result, ThreadPool* pool = nullptr);
+
+    // Заполняет mesh.tangent, добавляя расщепленные вершины в конец потоков и обновляя индексы.
+    void GenerateTangents(MeshData& mesh, const TangentOptions& options, ThreadPool* pool = nullptr);
+}
@@ -0,0 +1,388 @@
+﻿// Замер и проверка TangentSpace, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 -pthread TangentSpaceBenchMain.cpp TangentSpace.cpp MeshOptimizer.cpp MeshGenerator.cpp ThreadPool.cpp -o tangents
+// Сравнение с эталонной библиотекой: mikktspace.c и mikktspace.h (github.com/mmikk/MikkTSpace) кладутся рядом,
+//   gcc -O2 -c mikktspace.c
+//   g++ -std=c++14 -O2 -pthread -DWITH_MIKKTSPACE mikktspace.o TangentSpaceBenchMain.cpp TangentSpace.cpp MeshOptimizer.cpp MeshGenerator.cpp ThreadPool.cpp -o tangents
+// Примеры:
+//   ./tangents
+//   ./tangents --tessellation 1600 --threads 8
+// Проверки: на сфере касательные единичные, ортогональны нормали и идут вдоль параллелей; на плоскости с
+// отраженной по x = 0 разверткой знак битангенса постоянен по каждую сторону шва. Эталон без библиотеки -
+// genTangSpaceDefault, переписанная здесь в double для мешей без вырожденных разверток (ReferenceTangents):
+// на сфере, торе и плоскости с отраженной разверткой касательные углов расходятся с ней не больше чем на
+// 0.05 градуса, знаки совпадают. Замер - UVSphere на 1 .. threads потоках, результат должен совпадать с
+// однопоточным побитово. С WITH_MIKKTSPACE касательные каждого угла сравниваются с самой genTangSpaceDefault,
+// которая работает в одном потоке.
+#include "TangentSpace.h"
+#include "MeshGenerator.h"
+#include "ThreadPool.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+#ifdef WITH_MIKKTSPACE
+#include "mikktspace.h"
+#endif
+
+namespace {
+    double Milliseconds(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool CheckSphere() {
+        mesh::MeshData sphere;
+        mesh::UVSphere(64, 64, sphere);
+        size_t vertexCount = sphere.GetVertexCount();
+        mesh::GenerateTangents(sphere, mesh::TangentOptions());
+
+        double maxDot = 0.0, minAlign = 1.0;
+        size_t badLength = 0;
+        for (size_t i = 0; i < sphere.GetVertexCount(); i++) {
+            const float* t = &sphere.tangent[i * 4];
+            double dot = std::fabs(t[0] * sphere.normal.x[i] + t[1] * sphere.normal.y[i] + t[2] * sphere.normal.z[i]);
+            maxDot = std::max(maxDot, dot);
+            badLength += std::fabs(std::sqrt(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]) - 1.0) > 1e-4;
+            // У полюсов направление параллели не определено.
+            double r = std::hypot(sphere.position.x[i], sphere.position.y[i]);
+            if (r >= 0.2) {
+                minAlign = std::min(minAlign, std::fabs(t[0] * -sphere.position.y[i] / r + t[1] * sphere.position.x[i] / r));
+            }
+        }
+        bool ok = maxDot < 1e-5 && minAlign > 0.99 && badLength == 0;
+        printf("Sphere 64x64: %zu -> %zu vertices, |t.n| <= %.2e, alignment >= %.5f, %zu not unit: %s\n", vertexCount,
+            sphere.GetVertexCount(), maxDot, minAlign, badLength, ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    bool CheckMirroredPlane() {
+        mesh::MeshData plane;
+        mesh::Plane(8, 8, 2.0f, plane);
+        for (size_t i = 0; i < plane.GetVertexCount(); i++) {
+            plane.u[i] = std::fabs(plane.position.x[i]);
+        }
+        size_t vertexCount = plane.GetVertexCount();
+        mesh::GenerateTangents(plane, mesh::TangentOptions());
+
+        size_t mixed = 0;
+        for (size_t t = 0; t < plane.indices.size() / 3; t++) {
+            float centerX = 0.0f;
+            for (int k = 0; k < 3; k++) {
+                centerX += plane.position.x[plane.indices[t * 3 + k]];
+            }
+            // u растет от шва в обе стороны: касательная смотрит от x = 0, знак одинаков у всех углов треугольника.
+            float sign = plane.tangent[plane.indices[t * 3] * 4 + 3];
+            for (int k = 0; k < 3; k++) {
+                const float* tangent = &plane.tangent[plane.indices[t * 3 + k] * 4];
+                mixed += tangent[3] != sign || (tangent[0] > 0.0f) != (centerX > 0.0f);
+            }
+        }
+        bool ok = mixed == 0 && plane.GetVertexCount() > vertexCount;
+        printf("Mirrored plane: %zu -> %zu vertices, %zu wrong corners: %s\n", vertexCount, plane.GetVertexCount(), mixed,
+            ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    typedef std::array<double, 3> Vector;
+
+    Vector Subtract(const Vector& a, const Vector& b) {
+        return { { a[0] - b[0], a[1] - b[1], a[2] - b[2] } };
+    }
+
+    double Dot(const Vector& a, const Vector& b) {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    // Проекция на плоскость с нормалью n, нормированная; нулевой вектор остается нулевым.
+    Vector ProjectNormalized(const Vector& v, const Vector& n) {
+        double d = Dot(v, n);
+        Vector p = { { v[0] - n[0] * d, v[1] - n[1] * d, v[2] - n[2] * d } };
+        double length = std::sqrt(Dot(p, p));
+        if (length > 1e-20) {
+            p = { { p[0] / length, p[1] / length, p[2] / length } };
+        }
+        return p;
+    }
+
+    // genTangSpaceDefault из mikktspace.c по шагам: вершины склеиваются по позиции, нормали и развертке;
+    // у треугольника vOs = t31y * d1 - t21y * d2 и vOt = t21x * d2 - t31x * d1 со знаком площади развертки.
+    // Группа - склеенная вершина и ориентация развертки. Для каждого угла группы берутся углы, у которых
+    // проекции vOs и vOt на нормаль образуют с его собственными косинус больше порога (cos 180 градусов),
+    // касательная - сумма их проекций vOs с весом угла треугольника при вершине. Треугольники с нулевой площадью
+    // развертки mikktspace.c обрабатывает отдельно, здесь они пропускаются. Пропускаются и углы, где исход
+    // решает округление: в группе есть противоположные проекции или сумма почти сокращается (полюс сферы).
+    // Такие углы считаются в skipped, у них знак 0. Пишет 4 числа на угол.
+    std::vector<double> ReferenceTangents(const mesh::MeshData& m, size_t& skipped) {
+        size_t cornerCount = m.indices.size();
+        std::map<std::array<float, 8>, uint32_t> welded;
+        std::vector<uint32_t> weld(m.GetVertexCount());
+        for (size_t i = 0; i < m.GetVertexCount(); i++) {
+            std::array<float, 8> key = { { m.position.x[i], m.position.y[i], m.position.z[i], m.normal.x[i], m.normal.y[i],
+                m.normal.z[i], m.u[i], m.v[i] } };
+            weld[i] = welded.insert(std::make_pair(key, (uint32_t)welded.size())).first->second;
+        }
+        auto position = [&](uint32_t v) { return Vector{ { m.position.x[v], m.position.y[v], m.position.z[v] } }; };
+
+        std::vector<Vector> faceOs(cornerCount / 3), faceOt(cornerCount / 3);
+        std::vector<bool> preserving(cornerCount / 3), degenerate(cornerCount / 3);
+        for (size_t f = 0; f < cornerCount / 3; f++) {
+            const uint32_t* t = &m.indices[f * 3];
+            Vector d1 = Subtract(position(t[1]), position(t[0])), d2 = Subtract(position(t[2]), position(t[0]));
+            double t21x = (double)m.u[t[1]] - m.u[t[0]], t21y = (double)m.v[t[1]] - m.v[t[0]];
+            double t31x = (double)m.u[t[2]] - m.u[t[0]], t31y = (double)m.v[t[2]] - m.v[t[0]];
+            double area = t21x * t31y - t21y * t31x, sign = area > 0.0 ? 1.0 : -1.0;
+            preserving[f] = area > 0.0;
+            degenerate[f] = std::fabs(area) <= 1e-20;
+            for (int j = 0; j < 3; j++) {
+                faceOs[f][j] = (t31y * d1[j] - t21y * d2[j]) * sign;
+                faceOt[f][j] = (t21x * d2[j] - t31x * d1[j]) * sign;
+            }
+        }
+
+        // Проекции на нормаль угла и вес угла, углы собираются по группам.
+        std::vector<Vector> cornerOs(cornerCount), cornerOt(cornerCount);
+        std::vector<double> weights(cornerCount);
+        std::map<std::pair<uint32_t, bool>, std::vector<uint32_t>> groups;
+        for (size_t c = 0; c < cornerCount; c++) {
+            size_t f = c / 3, k = c % 3;
+            if (degenerate[f])
+                continue;
+            const uint32_t* t = &m.indices[f * 3];
+            Vector n = { { m.normal.x[t[k]], m.normal.y[t[k]], m.normal.z[t[k]] } };
+            Vector p = position(t[k]);
+            Vector v1 = ProjectNormalized(Subtract(position(t[(k + 2) % 3]), p), n);
+            Vector v2 = ProjectNormalized(Subtract(position(t[(k + 1) % 3]), p), n);
+            weights[c] = std::acos(std::min(std::max(Dot(v1, v2), -1.0), 1.0));
+            cornerOs[c] = ProjectNormalized(faceOs[f], n);
+            cornerOt[c] = ProjectNormalized(faceOt[f], n);
+            groups[std::make_pair(weld[t[k]], (bool)preserving[f])].push_back((uint32_t)c);
+        }
+
+        const double thresholdCos = std::cos(180.0 * 3.14159265358979 / 180.0);
+        std::vector<double> tangents(cornerCount * 4, 0.0);
+        skipped = 0;
+        for (size_t c = 0; c < cornerCount; c++) {
+            size_t f = c / 3;
+            if (degenerate[f]) {
+                skipped++;
+                continue;
+            }
+            Vector sum = { { 0.0, 0.0, 0.0 } };
+            double weight = 0.0;
+            bool ambiguous = false;
+            for (uint32_t other : groups[std::make_pair(weld[m.indices[c]], (bool)preserving[f])]) {
+                double cosS = Dot(cornerOs[c], cornerOs[other]), cosT = Dot(cornerOt[c], cornerOt[other]);
+                ambiguous = ambiguous || cosS - thresholdCos < 1e-6 || cosT - thresholdCos < 1e-6;
+                if (other / 3 != f && (cosS <= thresholdCos || cosT <= thresholdCos))
+                    continue;
+                for (int j = 0; j < 3; j++) {
+                    sum[j] += cornerOs[other][j] * weights[other];
+                }
+                weight += weights[other];
+            }
+            double length = std::sqrt(Dot(sum, sum));
+            if (ambiguous || length < weight * 0.01) {
+                skipped++;
+                continue;
+            }
+            for (int j = 0; j < 3; j++) {
+                tangents[c * 4 + j] = sum[j] / length;
+            }
+            tangents[c * 4 + 3] = preserving[f] ? 1.0 : -1.0;
+        }
+        return tangents;
+    }
+
+    // Угол между касательными через atan2 в double: acos от скалярного произведения не различает сотые доли градуса.
+    bool CheckReference(const char* name, const mesh::MeshData& m) {
+        size_t skipped = 0;
+        std::vector<double> reference = ReferenceTangents(m, skipped);
+        mesh::VertexLayout layout = mesh::VertexLayout::Make(mesh::Position | mesh::Normal | mesh::TexCoord);
+        std::vector<uint8_t> vertices(m.GetVertexCount() * layout.stride);
+        mesh::WriteVertices(m, layout, vertices.data());
+        mesh::TangentResult result;
+        mesh::GenerateTangents(vertices.data(), m.GetVertexCount(), layout.stride, layout.positionOffset, layout.normalOffset,
+            layout.texCoordOffset, m.indices.data(), m.indices.size(), mesh::TangentOptions(), result);
+
+        double maxAngle = 0.0;
+        size_t signMismatch = 0;
+        for (size_t c = 0; c < m.indices.size(); c++) {
+            if (reference[c * 4 + 3] == 0.0)
+                continue;
+            const float* own = &result.tangents[(size_t)result.indices[c] * 4];
+            const double* r = &reference[c * 4];
+            double cross[3] = { own[1] * r[2] - own[2] * r[1], own[2] * r[0] - own[0] * r[2], own[0] * r[1] - own[1] * r[0] };
+            double angle = std::atan2(std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]),
+                own[0] * r[0] + own[1] * r[1] + own[2] * r[2]);
+            maxAngle = std::max(maxAngle, angle * 180.0 / 3.14159265358979);
+            signMismatch += own[3] != r[3];
+        }
+        bool ok = maxAngle < 0.05 && signMismatch == 0 && skipped * 10 < m.indices.size();
+        printf("Reference MikkTSpace, %s: %zu corners (%zu with an undefined or rounding-dependent tangent skipped), max angle %.2e deg, "
+            "%zu bitangent sign mismatches: %s\n", name, m.indices.size(), skipped, maxAngle, signMismatch, ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+#ifdef WITH_MIKKTSPACE
+    // Грани - треугольники исходного меша, касательные пишутся по углам.
+    struct MikkMesh {
+        const mesh::MeshData* mesh;
+        std::vector<float> tangents;        // 4 float на угол
+    };
+
+    void Corner(const SMikkTSpaceContext* context, const mesh::Stream3& stream, float out[], int face, int corner) {
+        const MikkMesh* data = static_cast<const MikkMesh*>(context->m_pUserData);
+        uint32_t v = data->mesh->indices[(size_t)face * 3 + corner];
+        out[0] = stream.x[v];
+        out[1] = stream.y[v];
+        out[2] = stream.z[v];
+    }
+
+    int GetNumFaces(const SMikkTSpaceContext* context) {
+        return (int)(static_cast<const MikkMesh*>(context->m_pUserData)->mesh->indices.size() / 3);
+    }
+
+    int GetNumVerticesOfFace(const SMikkTSpaceContext*, const int) {
+        return 3;
+    }
+
+    void GetPosition(const SMikkTSpaceContext* context, float out[], const int face, const int corner) {
+        Corner(context, static_cast<const MikkMesh*>(context->m_pUserData)->mesh->position, out, face, corner);
+    }
+
+    void GetNormal(const SMikkTSpaceContext* context, float out[], const int face, const int corner) {
+        Corner(context, static_cast<const MikkMesh*>(context->m_pUserData)->mesh->normal, out, face, corner);
+    }
+
+    void GetTexCoord(const SMikkTSpaceContext* context, float out[], const int face, const int corner) {
+        const mesh::MeshData* m = static_cast<const MikkMesh*>(context->m_pUserData)->mesh;
+        uint32_t v = m->indices[(size_t)face * 3 + corner];
+        out[0] = m->u[v];
+        out[1] = m->v[v];
+    }
+
+    void SetTSpaceBasic(const SMikkTSpaceContext* context, const float tangent[], const float sign, const int face,
+                        const int corner) {
+        float* out = &static_cast<MikkMesh*>(context->m_pUserData)->tangents[((size_t)face * 3 + corner) * 4];
+        out[0] = tangent[0];
+        out[1] = tangent[1];
+        out[2] = tangent[2];
+        out[3] = sign;
+    }
+
+    // Касательные углов сравниваются по углу между ними и по знаку битангенса.
+    void CompareWithMikkTSpace(const mesh::MeshData& sphere, const mesh::TangentResult& result, double ownMilliseconds) {
+        SMikkTSpaceInterface callbacks = {};
+        callbacks.m_getNumFaces = GetNumFaces;
+        callbacks.m_getNumVerticesOfFace = GetNumVerticesOfFace;
+        callbacks.m_getPosition = GetPosition;
+        callbacks.m_getNormal = GetNormal;
+        callbacks.m_getTexCoord = GetTexCoord;
+        callbacks.m_setTSpaceBasic = SetTSpaceBasic;
+        MikkMesh data;
+        data.mesh = &sphere;
+        data.tangents.assign(sphere.indices.size() * 4, 0.0f);
+        SMikkTSpaceContext context;
+        context.m_pInterface = &callbacks;
+        context.m_pUserData = &data;
+
+        double best = 1e30;
+        for (int repeat = 0; repeat < 3; repeat++) {
+            auto start = std::chrono::steady_clock::now();
+            if (!genTangSpaceDefault(&context)) {
+                printf("MikkTSpace: genTangSpaceDefault failed\n");
+                return;
+            }
+            best = std::min(best, Milliseconds(start));
+        }
+
+        double maxAngle = 0.0;
+        size_t overDegree = 0, signMismatch = 0;
+        for (size_t c = 0; c < sphere.indices.size(); c++) {
+            const float* own = &result.tangents[(size_t)result.indices[c] * 4];
+            const float* reference = &data.tangents[c * 4];
+            double dot = own[0] * reference[0] + own[1] * reference[1] + own[2] * reference[2];
+            double lengths = std::sqrt((own[0] * own[0] + own[1] * own[1] + own[2] * own[2]) *
+                (reference[0] * reference[0] + reference[1] * reference[1] + reference[2] * reference[2]));
+            double angle = lengths > 0.0 ? std::acos(std::min(std::max(dot / lengths, -1.0), 1.0)) * 180.0 / 3.14159265358979 : 180.0;
+            maxAngle = std::max(maxAngle, angle);
+            overDegree += angle > 1.0;
+            signMismatch += own[3] != reference[3];
+        }
+        printf("MikkTSpace: %.0f ms single-threaded (%.2fx of the threaded run); %zu corners, max angle %.3f deg, "
+            "%zu over 1 deg, %zu bitangent sign mismatches\n", best, best / ownMilliseconds, sphere.indices.size(), maxAngle,
+            overDegree, signMismatch);
+    }
+#endif
+}
+
+int main(int argc, char** argv) {
+    unsigned tessellation = 1100;
+    unsigned threads = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--tessellation") && i + 1 < argc) {
+            tessellation = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = (unsigned)atoi(argv[++i]);
+        } else {
+            printf("tangents [--tessellation <n>] [--threads <n>]\n");
+            return 1;
+        }
+    }
+    threads = std::max(threads, 1u);
+
+    bool ok = CheckSphere();
+    ok = CheckMirroredPlane() && ok;
+    mesh::MeshData reference;
+    mesh::UVSphere(64, 64, reference);
+    ok = CheckReference("sphere 64x64", reference) && ok;
+    mesh::Torus(1.0f, 0.3f, 48, 24, reference);
+    ok = CheckReference("torus 48x24", reference) && ok;
+    mesh::Plane(8, 8, 2.0f, reference);
+    for (size_t i = 0; i < reference.GetVertexCount(); i++) {
+        reference.u[i] = std::fabs(reference.position.x[i]);
+    }
+    ok = CheckReference("mirrored plane", reference) && ok;
+
+    mesh::MeshData sphere;
+    mesh::UVSphere(tessellation, tessellation, sphere);
+    mesh::VertexLayout layout = mesh::VertexLayout::Make(mesh::Position | mesh::Normal | mesh::TexCoord);
+    std::vector<uint8_t> vertices(sphere.GetVertexCount() * layout.stride);
+    mesh::WriteVertices(sphere, layout, vertices.data());
+    size_t triangles = sphere.indices.size() / 3;
+    printf("UVSphere %ux%u: %zu vertices, %zu triangles\n", tessellation, tessellation, sphere.GetVertexCount(), triangles);
+
+    mesh::TangentResult serial, result;
+    double milliseconds = 0.0;
+    for (unsigned n = 1; n <= threads; n = n < threads ? std::min(n * 2, threads) : n + 1) {
+        std::unique_ptr<ThreadPool> pool(n > 1 ? new ThreadPool(n - 1) : nullptr);
+        milliseconds = 1e30;
+        for (int repeat = 0; repeat < 3; repeat++) {
+            auto start = std::chrono::steady_clock::now();
+            mesh::GenerateTangents(vertices.data(), sphere.GetVertexCount(), layout.stride, layout.positionOffset,
+                layout.normalOffset, layout.texCoordOffset, sphere.indices.data(), sphere.indices.size(), mesh::TangentOptions(),
+                result, pool.get());
+            milliseconds = std::min(milliseconds, Milliseconds(start));
+        }
+        if (n == 1) {
+            serial = result;
+        }
+        bool same = result.remap == serial.remap && result.indices == serial.indices && result.tangents.size() == serial.tangents.size()
+            && memcmp(result.tangents.data(), serial.tangents.data(), result.tangents.size() * sizeof(float)) == 0;
+        ok = ok && same;
+        printf("threads %2u: %.0f ms, %.2f Mtri/s, %zu split vertices, %s\n", n, milliseconds, triangles / milliseconds / 1e3,
+            result.remap.size() - sphere.GetVertexCount(), same ? "same as 1 thread" : "DIFFERS from 1 thread");
+    }
+#ifdef WITH_MIKKTSPACE
+    CompareWithMikkTSpace(sphere, result, milliseconds);
+#else
+    printf("MikkTSpace: not compared, build with -DWITH_MIKKTSPACE and mikktspace.c\n");
+#endif
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+﻿#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+        threadCount = threadCount > 1 ? threadCount - 1 : 1;
+    }
+    for (unsigned i = 0; i < threadCount; i++) {
+        workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    taskReady_.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+    if (count == 0)
+        return;
+    if (grain == 0)
+        grain = 1;
+
+    size_t blocks = (count + grain - 1) / grain;
+    if (blocks == 1) {
+        body(0, count);
+        return;
+    }
+
+    // Состояние живет в shared_ptr: поток пула может получить задачу уже после выхода из ParallelFor.
+    struct State {
+        std::atomic<size_t> next{ 0 };
+        std::atomic<size_t> done{ 0 };
+        std::mutex mutex;
+        std::condition_variable condition;
+    };
+    auto state = std::make_shared<State>();
+    const std::function<void(size_t, size_t)>* bodyPtr = &body;
+
+    auto worker = [state, bodyPtr, blocks, grain, count]() {
+        size_t processed = 0;
+        for (size_t block = state->next++; block < blocks; block = state->next++) {
+            size_t begin = block * grain;
+            size_t end = begin + grain < count ? begin + grain : count;
+            (*bodyPtr)(begin, end);
+            processed++;
+        }
+        if (processed > 0 && state->done.fetch_add(processed) + processed == blocks) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->condition.notify_all();
+        }
+    };
+
+    size_t helpers = blocks - 1 < workers_.size() ? blocks - 1 : workers_.size();
+    for (size_t i = 0; i < helpers; i++) {
+        Submit(worker);
+    }
+    worker();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->condition.wait(lock, [&]() { return state->done.load() == blocks; });
+}
+
+void ThreadPool::Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    taskDone_.wait(lock, [this]() { return tasks_.empty() && running_ == 0; });
+}
+
+size_t ThreadPool::GetPendingCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tasks_.size() + running_;
+}
+
+void ThreadPool::WorkerLoop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            taskReady_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+            if (stop_ && tasks_.empty())
+                return;
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+            running_++;
+        }
+        task();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_--;
+        }
+        taskDone_.notify_all();
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    taskReady_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
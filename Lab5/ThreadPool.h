@@ -0,0 +1,49 @@
+﻿#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+
+// Простой пул рабочих потоков с общей очередью задач.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threadCount = 0);
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void Submit(std::function<void()> task);
+
+    // Разбивает [0, count) на блоки по grain элементов и выполняет body(begin, end) на всех потоках,
+    // включая вызывающий. Возвращает управление после обработки всех блоков.
+    void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+    // Ожидание завершения всех поставленных задач.
+    void Wait();
+
+    unsigned GetThreadCount() const {
+        return (unsigned)workers_.size();
+    };
+
+    size_t GetPendingCount();
+
+    ~ThreadPool();
+
+private:
+    void WorkerLoop();
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable taskReady_;
+    std::condition_variable taskDone_;
+    size_t running_ = 0;
+    bool stop_ = false;
+};
@@ -2,11 +2,15 @@
 
 ToneMapping::~ToneMapping() {
     CleanUpTextures();
+    m_pool.Clear();
+    SAFE_RELEASE(m_readAvgTexture);
     SAFE_RELEASE(m_adaptBuffer);
 }
 
 void ToneMapping::Cleanup() {
     CleanUpTextures();
+    m_pool.Clear();
+    SAFE_RELEASE(m_readAvgTexture);
     SAFE_RELEASE(m_adaptBuffer);
     m_sampler_avg.reset();
     m_sampler_min.reset();
@@ -22,28 +26,30 @@ void ToneMapping::Cleanup() {
 };
 
 void ToneMapping::CleanUpTextures() {
-    SAFE_RELEASE(m_frame.SRV);
-    SAFE_RELEASE(m_frame.RTV);
-    SAFE_RELEASE(m_frame.texture);
+    ReleaseTexture(m_frame, m_frameWidth, m_frameHeight, DXGI_FORMAT_R16G16B16A16_FLOAT);
 
-    for (auto& scaledFrame : m_scaledFrames)
+    for (size_t i = 0; i < m_scaledFrames.size(); i++)
     {
-        SAFE_RELEASE(scaledFrame.avg.SRV);
-        SAFE_RELEASE(scaledFrame.avg.RTV);
-        SAFE_RELEASE(scaledFrame.avg.texture);
-        SAFE_RELEASE(scaledFrame.min.SRV);
-        SAFE_RELEASE(scaledFrame.min.RTV);
-        SAFE_RELEASE(scaledFrame.min.texture);
-        SAFE_RELEASE(scaledFrame.max.SRV);
-        SAFE_RELEASE(scaledFrame.max.RTV);
-        SAFE_RELEASE(scaledFrame.max.texture);
+        int size = 1 << i;
+        ReleaseTexture(m_scaledFrames[i].avg, size, size, DXGI_FORMAT_R32_FLOAT);
+        ReleaseTexture(m_scaledFrames[i].min, size, size, DXGI_FORMAT_R32_FLOAT);
+        ReleaseTexture(m_scaledFrames[i].max, size, size, DXGI_FORMAT_R32_FLOAT);
     }
-    SAFE_RELEASE(m_readAvgTexture);
 
     m_scaledFrames.clear();
     n = 0;
 }
 
+bool ToneMapping::TextureAllocator::Create(const RenderTargetDesc& desc, Handle& texture) {
+    return SUCCEEDED(owner_.CreateTexture(texture, desc.width, desc.height, (DXGI_FORMAT)desc.format));
+}
+
+void ToneMapping::TextureAllocator::Destroy(Handle& texture) {
+    SAFE_RELEASE(texture.SRV);
+    SAFE_RELEASE(texture.RTV);
+    SAFE_RELEASE(texture.texture);
+}
+
 HRESULT ToneMapping::Init(std::shared_ptr <ID3D11Device> device, std::shared_ptr <ID3D11DeviceContext> deviceContext,
                           SimpleVSManager& VSManager, SimplePSManager& PSManager, SimpleSamplerManager& samplerManager,
                           int textureWidth, int textureHeight) {
@@ -52,6 +58,9 @@ HRESULT ToneMapping::Init(std::shared_ptr <ID3D11Device> device, std::shared_ptr
 
     HRESULT result = CreateTextures(textureWidth, textureHeight);
 
+    if (SUCCEEDED(result)) {
+        result = CreateTexture2D(&m_readAvgTexture, 1, 1, DXGI_FORMAT_R32_FLOAT, true);
+    }
     if (SUCCEEDED(result)) {
         result = samplerManager.get("avg", m_sampler_avg);
     }
@@ -72,7 +81,7 @@ HRESULT ToneMapping::Init(std::shared_ptr <ID3D11Device> device, std::shared_ptr
         desc.StructureByteStride = 0;
 
         AdaptBuffer adaptBuffer;
-        adaptBuffer.adapt = XMFLOAT4(0.0f, s, 0.0f, 0.0f);
+        adaptBuffer.adapt = XMFLOAT4(0.0f, s, 1.0f, 1.0f);
 
         D3D11_SUBRESOURCE_DATA data;
         data.pSysMem = &adaptBuffer;
@@ -99,7 +108,14 @@ HRESULT ToneMapping::Init(std::shared_ptr <ID3D11Device> device, std::shared_ptr
 }
 
 HRESULT ToneMapping::CreateTextures(int textureWidth, int textureHeight) {
-    HRESULT result = CreateTexture(m_frame, textureWidth, textureHeight, DXGI_FORMAT_R16G16B16A16_FLOAT);
+    m_targetWidth = textureWidth;
+    m_targetHeight = textureHeight;
+    UpdateRenderSize();
+    // HDR кадр берется с запасом до шага корзины, чтобы при небольших изменениях размера окна переиспользовать текстуру.
+    m_frameWidth = RenderTargetPool<TextureAllocator>::Bucket(textureWidth, frameBucketStep);
+    m_frameHeight = RenderTargetPool<TextureAllocator>::Bucket(textureHeight, frameBucketStep);
+
+    HRESULT result = AcquireTexture(m_frame, m_frameWidth, m_frameHeight, DXGI_FORMAT_R16G16B16A16_FLOAT);
 
     if (SUCCEEDED(result)) {
         int minSide = min(textureWidth, textureHeight);
@@ -112,34 +128,53 @@ HRESULT ToneMapping::CreateTextures(int textureWidth, int textureHeight) {
             ScaledFrame scaledFrame;
 
             result = CreateScaledFrame(scaledFrame, i);
+            m_scaledFrames.push_back(scaledFrame);
             if (!SUCCEEDED(result))
                 break;
-
-            m_scaledFrames.push_back(scaledFrame);
         }
     }
 
-    if (SUCCEEDED(result)) {
-        result = CreateTexture2D(&m_readAvgTexture, 1, 1, DXGI_FORMAT_R32_FLOAT, true);
-    }
+    m_pool.Trim();
 
     return result;
 }
 
+void ToneMapping::UpdateRenderSize() {
+    m_width = max(1, (int)(m_targetWidth * m_scale + 0.5f));
+    m_height = max(1, (int)(m_targetHeight * m_scale + 0.5f));
+}
+
+void ToneMapping::SetRenderScale(float scale) {
+    m_scale = min(max(scale, 0.1f), 1.0f);
+    UpdateRenderSize();
+}
+
 HRESULT ToneMapping::CreateScaledFrame(ScaledFrame& scaledFrame, int num) {
-    int size = pow(2, num);
-    HRESULT result = CreateTexture(scaledFrame.avg, size, size, DXGI_FORMAT_R32_FLOAT);
+    int size = 1 << num;
+    HRESULT result = AcquireTexture(scaledFrame.avg, size, size, DXGI_FORMAT_R32_FLOAT);
     
     if (SUCCEEDED(result)) {
-        result = CreateTexture(scaledFrame.min, size, size, DXGI_FORMAT_R32_FLOAT);
+        result = AcquireTexture(scaledFrame.min, size, size, DXGI_FORMAT_R32_FLOAT);
     }
     if (SUCCEEDED(result)) {
-        result = CreateTexture(scaledFrame.max, size, size, DXGI_FORMAT_R32_FLOAT);
+        result = AcquireTexture(scaledFrame.max, size, size, DXGI_FORMAT_R32_FLOAT);
     }
 
     return result;
 }
 
+HRESULT ToneMapping::AcquireTexture(Texture& texture, int textureWidth, int textureHeight, DXGI_FORMAT format) {
+    RenderTargetDesc desc = { (unsigned)textureWidth, (unsigned)textureHeight, (unsigned)format };
+    return m_pool.Acquire(desc, texture) ? S_OK : E_FAIL;
+}
+
+void ToneMapping::ReleaseTexture(Texture& texture, int textureWidth, int textureHeight, DXGI_FORMAT format) {
+    if (texture.texture == nullptr)
+        return;
+    RenderTargetDesc desc = { (unsigned)textureWidth, (unsigned)textureHeight, (unsigned)format };
+    m_pool.Release(desc, texture);
+}
+
 HRESULT ToneMapping::CreateTexture(Texture& texture, int textureWidth, int textureHeight, DXGI_FORMAT format) {
     HRESULT result = CreateTexture2D(&texture.texture, textureWidth, textureHeight, format);
 
@@ -162,6 +197,12 @@ HRESULT ToneMapping::CreateTexture(Texture& texture, int textureWidth, int textu
         result = m_device->CreateShaderResourceView(texture.texture, &shaderResourceViewDesc, &texture.SRV);
     }
 
+    if (!SUCCEEDED(result)) {
+        SAFE_RELEASE(texture.SRV);
+        SAFE_RELEASE(texture.RTV);
+        SAFE_RELEASE(texture.texture);
+    }
+
     return result;
 }
 
@@ -184,6 +225,15 @@ HRESULT ToneMapping::CreateTexture2D(ID3D11Texture2D** texture, int textureWidth
 
 void ToneMapping::SetRenderTarget() {
     m_deviceContext->OMSetRenderTargets(1, &m_frame.RTV, nullptr);
+
+    D3D11_VIEWPORT viewport;
+    viewport.TopLeftX = 0;
+    viewport.TopLeftY = 0;
+    viewport.Width = (FLOAT)m_width;
+    viewport.Height = (FLOAT)m_height;
+    viewport.MinDepth = 0.0f;
+    viewport.MaxDepth = 1.0f;
+    m_deviceContext->RSSetViewports(1, &viewport);
 }
 
 void ToneMapping::ClearRenderTarget() {
@@ -200,6 +250,11 @@ void ToneMapping::ClearRenderTarget() {
 }
 
 void ToneMapping::RenderBrightness() {
+    AdaptBuffer adaptBuffer;
+    adaptBuffer.adapt = XMFLOAT4(adapt, factor, m_width / (float)m_frameWidth, m_height / (float)m_frameHeight);
+    m_deviceContext->UpdateSubresource(m_adaptBuffer, 0, nullptr, &adaptBuffer, 0, 0);
+    m_deviceContext->PSSetConstantBuffers(0, 1, &m_adaptBuffer);
+
     for (int i = n; i >= 0; i--) {
         ID3D11RenderTargetView* views[] = {
             m_scaledFrames[i].avg.RTV,
@@ -216,8 +271,8 @@ void ToneMapping::RenderBrightness() {
         D3D11_VIEWPORT viewport;
         viewport.TopLeftX = 0;
         viewport.TopLeftY = 0;
-        viewport.Width = (FLOAT)pow(2, i);
-        viewport.Height = (FLOAT)pow(2, i);
+        viewport.Width = (FLOAT)(1 << i);
+        viewport.Height = (FLOAT)(1 << i);
         viewport.MinDepth = 0.0f;
         viewport.MaxDepth = 1.0f;
         m_deviceContext->RSSetViewports(1, &viewport);
@@ -264,7 +319,7 @@ void ToneMapping::RenderTonemap() {
     }
 
     AdaptBuffer adaptBuffer;
-    adaptBuffer.adapt = XMFLOAT4(adapt, factor, 0.0f, 0.0f);
+    adaptBuffer.adapt = XMFLOAT4(adapt, factor, m_width / (float)m_frameWidth, m_height / (float)m_frameHeight);
 
     m_deviceContext->UpdateSubresource(m_adaptBuffer, 0, nullptr, &adaptBuffer, 0, 0);
 
@@ -287,6 +342,9 @@ void ToneMapping::RenderTonemap() {
 }
 
 HRESULT ToneMapping::Resize(int textureWidth, int textureHeight) {
+    if (textureWidth == m_targetWidth && textureHeight == m_targetHeight && m_frame.texture != nullptr)
+        return S_OK;
+
     CleanUpTextures();
     return CreateTextures(textureWidth, textureHeight);
 }
@@ -1,11 +1,15 @@
-#pragma once
+﻿#pragma once
 
 #include "framework.h"
 #include "SimpleManager.h"
+#include "RenderTargetPool.h"
 #include <vector>
 #include <chrono>
 
 class ToneMapping {
+    static const unsigned frameBucketStep = 128;
+    static const size_t maxFreeTargets = 12;
+
     struct Texture {
         ID3D11Texture2D* texture = nullptr;
         ID3D11RenderTargetView* RTV = nullptr;
@@ -18,12 +22,25 @@ class ToneMapping {
         Texture max;
     };
 
+    class TextureAllocator {
+    public:
+        using Handle = Texture;
+
+        TextureAllocator(ToneMapping& owner) : owner_(owner) {};
+
+        bool Create(const RenderTargetDesc& desc, Handle& texture);
+        void Destroy(Handle& texture);
+
+    private:
+        ToneMapping& owner_;
+    };
+
     struct AdaptBuffer {
         XMFLOAT4 adapt;
     };
 
 public:
-    ToneMapping() = default;
+    ToneMapping() : m_allocator(*this), m_pool(m_allocator, maxFreeTargets) {};
     ~ToneMapping();
 
     HRESULT Init(std::shared_ptr <ID3D11Device> device, std::shared_ptr <ID3D11DeviceContext> deviceContext,
@@ -35,6 +52,9 @@ public:
     void RenderTonemap();
     void ResetEyeAdaptation();
     HRESULT Resize(int textureWidth, int textureHeight);
+    // Задает долю разрешения окна, в которую рисуется сцена. HDR кадр не пересоздается, меняется только
+    // область вывода внутри него.
+    void SetRenderScale(float scale);
     void Cleanup();
     void SetFactor(float f) {
         factor = f;
@@ -42,10 +62,28 @@ public:
     float GetFactor() {
         return factor;
     }
+    int GetWidth() {
+        return m_width;
+    }
+    int GetHeight() {
+        return m_height;
+    }
+    float GetRenderScale() {
+        return m_scale;
+    }
+    ID3D11Texture2D* GetFrameTexture() {
+        return m_frame.texture;
+    }
+    ID3D11RenderTargetView* GetFrameTarget() {
+        return m_frame.RTV;
+    }
 
 private:
     HRESULT CreateTextures(int textureWidth, int textureHeight);
+    void UpdateRenderSize();
     HRESULT CreateScaledFrame(ScaledFrame& scaledFrame, int num);
+    HRESULT AcquireTexture(Texture& texture, int textureWidth, int textureHeight, DXGI_FORMAT format);
+    void ReleaseTexture(Texture& texture, int textureWidth, int textureHeight, DXGI_FORMAT format);
     HRESULT CreateTexture(Texture& texture, int textureWidth, int textureHeight, DXGI_FORMAT format);
     HRESULT CreateTexture2D(ID3D11Texture2D** texture, int textureWidth, int textureHeight, DXGI_FORMAT format, bool CPUAccess = false);
     void CleanUpTextures();
@@ -54,7 +92,17 @@ private:
     std::shared_ptr <ID3D11Device> m_device;
     std::shared_ptr <ID3D11DeviceContext> m_deviceContext;
 
+    TextureAllocator m_allocator;
+    RenderTargetPool<TextureAllocator> m_pool;
+
     Texture m_frame;
+    int m_width = 0;
+    int m_height = 0;
+    int m_frameWidth = 0;
+    int m_frameHeight = 0;
+    int m_targetWidth = 0;
+    int m_targetHeight = 0;
+    float m_scale = 1.0f;
     int n = 0;
 
     ID3D11Texture2D* m_readAvgTexture = nullptr;
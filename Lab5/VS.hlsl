@@ -1,5 +1,7 @@
 #include "SceneMatrixBuffer.h"
+#include "QuantizedVertex.h"
 
+// С INSTANCED не используется: матрица мира и материал приходят из вершинного буфера в слоте 1.
 cbuffer WorldMatrixBuffer : register (b0) {
     float4x4 worldMatrix;
     float3 color;
@@ -7,23 +9,56 @@ cbuffer WorldMatrixBuffer : register (b0) {
     float metalness;
 };
 
+// FULL_PRECISION: позиция и нормаль float3 (загруженные модели), иначе QuantizedVertex8.
+// INSTANCED: gfx::InstanceData на инстанс (ObjectInstancing.h) - первые три столбца матрицы мира,
+// цвет с шероховатостью и металличность.
 struct VS_INPUT {
+#ifdef FULL_PRECISION
     float3 position : POSITION;
     float3 normal : NORMAL;
+#else
+    float4 position : POSITION;
+#endif
+#ifdef INSTANCED
+    float4 world0 : WORLD0;
+    float4 world1 : WORLD1;
+    float4 world2 : WORLD2;
+    float4 colorRoughness : COLOR;
+    float metalness : MATERIAL;
+#endif
 };
 
 struct PS_INPUT {
     float4 position : SV_POSITION;
     float4 worldPos : POSITION;
     float3 normal : NORMAL;
+    nointerpolation float3 color : COLOR;
+    nointerpolation float2 material : MATERIAL;     // шероховатость, металличность
 };
 
 PS_INPUT main(VS_INPUT input) {
     PS_INPUT output;
 
-    output.worldPos = mul(worldMatrix, float4(input.position, 1.0f));
+#ifdef FULL_PRECISION
+    float3 position = input.position;
+    float3 normal = input.normal;
+#else
+    float3 position = DecodePosition(input.position);
+    float3 normal = DecodeNormal8(input.position.w);
+#endif
+#ifdef INSTANCED
+    float4 world = float4(position, 1.0f);
+    output.worldPos = float4(dot(world, input.world0), dot(world, input.world1), dot(world, input.world2), 1.0f);
+    output.normal = float3(dot(normal, input.world0.xyz), dot(normal, input.world1.xyz), dot(normal, input.world2.xyz));
+    output.color = input.colorRoughness.rgb;
+    output.material = float2(input.colorRoughness.a, input.metalness);
+#else
+    output.worldPos = mul(worldMatrix, float4(position, 1.0f));
+    output.normal = mul(worldMatrix, normal);
+    output.color = color;
+    output.material = float2(roughness, metalness);
+#endif
     output.position = mul(viewProjectionMatrix, output.worldPos);
-    output.normal = mul(worldMatrix, input.normal);
 
     return output;
 }
\ No newline at end of file
@@ -0,0 +1,334 @@
+﻿#include "VertexQuantization.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define QUANTIZATION_SSE
+#endif
+
+namespace {
+    // Четыре float. Кодирование и декодирование пишутся один раз через эти операции, а без SSE они
+    // сводятся к скалярным циклам.
+#ifdef QUANTIZATION_SSE
+    struct V4 {
+        __m128 v;
+    };
+
+    inline V4 Set(float a, float b, float c, float d) { return { _mm_setr_ps(a, b, c, d) }; }
+    inline V4 Splat(float a) { return { _mm_set1_ps(a) }; }
+    inline void Store(V4 a, float* out) { _mm_storeu_ps(out, a.v); }
+    inline V4 operator+(V4 a, V4 b) { return { _mm_add_ps(a.v, b.v) }; }
+    inline V4 operator-(V4 a, V4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+    inline V4 operator*(V4 a, V4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+    inline V4 operator/(V4 a, V4 b) { return { _mm_div_ps(a.v, b.v) }; }
+    inline V4 Min(V4 a, V4 b) { return { _mm_min_ps(a.v, b.v) }; }
+    inline V4 Max(V4 a, V4 b) { return { _mm_max_ps(a.v, b.v) }; }
+    inline V4 Abs(V4 a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+    inline V4 Sqrt(V4 a) { return { _mm_sqrt_ps(a.v) }; }
+    inline V4 Less(V4 a, V4 b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+    inline V4 Select(V4 mask, V4 a, V4 b) { return { _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)) }; }
+    // Знак с нулем, считающимся положительным: 1 или -1.
+    inline V4 Sign(V4 a) { return { _mm_or_ps(_mm_and_ps(a.v, _mm_set1_ps(-0.0f)), _mm_set1_ps(1.0f)) }; }
+    inline V4 Floor(V4 a) {
+        V4 t = { _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v)) };
+        return t - Select(Less(a, t), Splat(1.0f), Splat(0.0f));
+    }
+#else
+    struct V4 {
+        float v[4];
+    };
+
+    template<typename F>
+    inline V4 Map(V4 a, V4 b, F f) {
+        V4 r;
+        for (int i = 0; i < 4; i++) {
+            r.v[i] = f(a.v[i], b.v[i]);
+        }
+        return r;
+    }
+
+    inline V4 Set(float a, float b, float c, float d) { return { { a, b, c, d } }; }
+    inline V4 Splat(float a) { return { { a, a, a, a } }; }
+    inline void Store(V4 a, float* out) { memcpy(out, a.v, sizeof(a.v)); }
+    inline V4 operator+(V4 a, V4 b) { return Map(a, b, [](float x, float y) { return x + y; }); }
+    inline V4 operator-(V4 a, V4 b) { return Map(a, b, [](float x, float y) { return x - y; }); }
+    inline V4 operator*(V4 a, V4 b) { return Map(a, b, [](float x, float y) { return x * y; }); }
+    inline V4 operator/(V4 a, V4 b) { return Map(a, b, [](float x, float y) { return x / y; }); }
+    inline V4 Min(V4 a, V4 b) { return Map(a, b, [](float x, float y) { return x < y ? x : y; }); }
+    inline V4 Max(V4 a, V4 b) { return Map(a, b, [](float x, float y) { return x > y ? x : y; }); }
+    inline V4 Abs(V4 a) { return Map(a, a, [](float x, float) { return std::fabs(x); }); }
+    inline V4 Sqrt(V4 a) { return Map(a, a, [](float x, float) { return std::sqrt(x); }); }
+    inline V4 Less(V4 a, V4 b) { return Map(a, b, [](float x, float y) { return x < y ? 1.0f : 0.0f; }); }
+    inline V4 Select(V4 mask, V4 a, V4 b) {
+        V4 r;
+        for (int i = 0; i < 4; i++) {
+            r.v[i] = mask.v[i] != 0.0f ? a.v[i] : b.v[i];
+        }
+        return r;
+    }
+    inline V4 Sign(V4 a) { return Map(a, a, [](float x, float) { return std::signbit(x) ? -1.0f : 1.0f; }); }
+    inline V4 Floor(V4 a) { return Map(a, a, [](float x, float) { return std::floor(x); }); }
+#endif
+
+    struct Float3x4 {
+        V4 x;
+        V4 y;
+        V4 z;
+    };
+
+    // Четыре вершины с номерами first..first + 3; за концом массива повторяется последняя вершина.
+    Float3x4 Gather(const uint8_t* vertices, size_t first, size_t count, size_t stride, size_t offset) {
+        float values[4][3];
+        for (size_t lane = 0; lane < 4; lane++) {
+            size_t index = std::min(first + lane, count - 1);
+            memcpy(values[lane], vertices + index * stride + offset, sizeof(values[lane]));
+        }
+        return { Set(values[0][0], values[1][0], values[2][0], values[3][0]),
+                 Set(values[0][1], values[1][1], values[2][1], values[3][1]),
+                 Set(values[0][2], values[1][2], values[2][2], values[3][2]) };
+    }
+
+    Float3x4 Normalize(const Float3x4& n) {
+        V4 length = Sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+        V4 inv = Splat(1.0f) / Max(length, Splat(1e-20f));
+        return { n.x * inv, n.y * inv, n.z * inv };
+    }
+
+    void OctEncode(const Float3x4& n, V4& u, V4& v) {
+        V4 inv = Splat(1.0f) / Max(Abs(n.x) + Abs(n.y) + Abs(n.z), Splat(1e-20f));
+        V4 x = n.x * inv;
+        V4 y = n.y * inv;
+        V4 lower = Less(n.z, Splat(0.0f));
+        u = Select(lower, (Splat(1.0f) - Abs(y)) * Sign(x), x);
+        v = Select(lower, (Splat(1.0f) - Abs(x)) * Sign(y), y);
+    }
+
+    Float3x4 OctDecode(V4 u, V4 v) {
+        Float3x4 n = { u, v, Splat(1.0f) - Abs(u) - Abs(v) };
+        V4 t = Max(Splat(0.0f) - n.z, Splat(0.0f));
+        n.x = n.x - Sign(n.x) * t;
+        n.y = n.y - Sign(n.y) * t;
+        return Normalize(n);
+    }
+
+    // Коды нормали в диапазоне [-levels, levels]. Из четырех соседних кодов берется дающий наименьший угол.
+    void EncodeNormals(const Float3x4& normal, float levels, V4& codeU, V4& codeV) {
+        Float3x4 n = Normalize(normal);
+        V4 u, v;
+        OctEncode(n, u, v);
+
+        V4 scale = Splat(levels);
+        V4 baseU = Floor(u * scale);
+        V4 baseV = Floor(v * scale);
+        V4 best = Splat(-2.0f);
+        codeU = baseU;
+        codeV = baseV;
+        for (int candidate = 0; candidate < 4; candidate++) {
+            V4 cu = Min(Max(baseU + Splat((float)(candidate & 1)), Splat(-levels)), scale);
+            V4 cv = Min(Max(baseV + Splat((float)(candidate >> 1)), Splat(-levels)), scale);
+            Float3x4 d = OctDecode(cu / scale, cv / scale);
+            V4 cosine = d.x * n.x + d.y * n.y + d.z * n.z;
+            V4 better = Less(best, cosine);
+            best = Select(better, cosine, best);
+            codeU = Select(better, cu, codeU);
+            codeV = Select(better, cv, codeV);
+        }
+    }
+
+    void EncodePositions(const Float3x4& p, const mesh::Bounds& bounds, float* x, float* y, float* z) {
+        V4 x0 = Splat(bounds.min[0]), y0 = Splat(bounds.min[1]), z0 = Splat(bounds.min[2]);
+        V4 sx = Splat(bounds.extent[0] > 0.0f ? 65535.0f / bounds.extent[0] : 0.0f);
+        V4 sy = Splat(bounds.extent[1] > 0.0f ? 65535.0f / bounds.extent[1] : 0.0f);
+        V4 sz = Splat(bounds.extent[2] > 0.0f ? 65535.0f / bounds.extent[2] : 0.0f);
+        V4 lo = Splat(0.0f), hi = Splat(65535.0f), half = Splat(0.5f);
+        Store(Min(Max(Floor((p.x - x0) * sx + half), lo), hi), x);
+        Store(Min(Max(Floor((p.y - y0) * sy + half), lo), hi), y);
+        Store(Min(Max(Floor((p.z - z0) * sz + half), lo), hi), z);
+    }
+
+    void DecodePositions(V4 x, V4 y, V4 z, const mesh::Bounds& bounds, float* out, size_t lanes) {
+        V4 inv = Splat(1.0f / 65535.0f);
+        float px[4], py[4], pz[4];
+        Store(x * inv * Splat(bounds.extent[0]) + Splat(bounds.min[0]), px);
+        Store(y * inv * Splat(bounds.extent[1]) + Splat(bounds.min[1]), py);
+        Store(z * inv * Splat(bounds.extent[2]) + Splat(bounds.min[2]), pz);
+        for (size_t lane = 0; lane < lanes; lane++) {
+            out[lane * 3] = px[lane];
+            out[lane * 3 + 1] = py[lane];
+            out[lane * 3 + 2] = pz[lane];
+        }
+    }
+
+    void DecodeNormals(V4 u, V4 v, float levels, float* out, size_t lanes) {
+        V4 inv = Splat(1.0f / levels);
+        Float3x4 n = OctDecode(Max(u * inv, Splat(-1.0f)), Max(v * inv, Splat(-1.0f)));
+        float nx[4], ny[4], nz[4];
+        Store(n.x, nx);
+        Store(n.y, ny);
+        Store(n.z, nz);
+        for (size_t lane = 0; lane < lanes; lane++) {
+            out[lane * 3] = nx[lane];
+            out[lane * 3 + 1] = ny[lane];
+            out[lane * 3 + 2] = nz[lane];
+        }
+    }
+
+    template<typename QuantizedVertex, typename Write>
+    void Quantize(const void* vertices, size_t count, size_t stride, size_t positionOffset, size_t normalOffset,
+                  const mesh::Bounds& bounds, float levels, QuantizedVertex* dst, Write write) {
+        const uint8_t* data = static_cast<const uint8_t*>(vertices);
+        for (size_t first = 0; first < count; first += 4) {
+            float x[4], y[4], z[4], u[4], v[4];
+            EncodePositions(Gather(data, first, count, stride, positionOffset), bounds, x, y, z);
+            V4 codeU, codeV;
+            EncodeNormals(Gather(data, first, count, stride, normalOffset), levels, codeU, codeV);
+            Store(codeU, u);
+            Store(codeV, v);
+
+            for (size_t lane = 0; lane < 4 && first + lane < count; lane++) {
+                QuantizedVertex& out = dst[first + lane];
+                out.position[0] = (uint16_t)x[lane];
+                out.position[1] = (uint16_t)y[lane];
+                out.position[2] = (uint16_t)z[lane];
+                write(out, (int)u[lane], (int)v[lane]);
+            }
+        }
+    }
+
+    float AngleDegrees(const float* a, const float* b) {
+        float la = std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+        float lb = std::sqrt(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]);
+        if (la == 0.0f || lb == 0.0f)
+            return 0.0f;
+        float cosine = (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]) / (la * lb);
+        return std::acos(std::max(-1.0f, std::min(1.0f, cosine))) * 57.29577951f;
+    }
+}
+
+namespace mesh {
+    Bounds ComputeBounds(const void* vertices, size_t count, size_t stride, size_t positionOffset) {
+        const uint8_t* data = static_cast<const uint8_t*>(vertices);
+        float lo[3] = { 0.0f, 0.0f, 0.0f };
+        float hi[3] = { 0.0f, 0.0f, 0.0f };
+        for (size_t i = 0; i < count; i++) {
+            float p[3];
+            memcpy(p, data + i * stride + positionOffset, sizeof(p));
+            for (int k = 0; k < 3; k++) {
+                lo[k] = i == 0 ? p[k] : std::min(lo[k], p[k]);
+                hi[k] = i == 0 ? p[k] : std::max(hi[k], p[k]);
+            }
+        }
+
+        Bounds bounds;
+        for (int k = 0; k < 3; k++) {
+            bounds.min[k] = lo[k];
+            bounds.extent[k] = hi[k] - lo[k];
+        }
+        return bounds;
+    }
+
+    void OctahedralEncode(const float* normal, float* encoded) {
+        Float3x4 n = { Splat(normal[0]), Splat(normal[1]), Splat(normal[2]) };
+        V4 u, v;
+        OctEncode(n, u, v);
+        float lanes[4];
+        Store(u, lanes);
+        encoded[0] = lanes[0];
+        Store(v, lanes);
+        encoded[1] = lanes[0];
+    }
+
+    void OctahedralDecode(const float* encoded, float* normal) {
+        Float3x4 n = OctDecode(Splat(encoded[0]), Splat(encoded[1]));
+        float lanes[4];
+        Store(n.x, lanes);
+        normal[0] = lanes[0];
+        Store(n.y, lanes);
+        normal[1] = lanes[0];
+        Store(n.z, lanes);
+        normal[2] = lanes[0];
+    }
+
+    void QuantizeVertices(const void* vertices, size_t count, size_t stride, size_t positionOffset, size_t normalOffset,
+                          const Bounds& bounds, QuantizedVertex8* dst) {
+        // 8-битный код хранится со смещением 127, чтобы 0 и +-1 представлялись точно.
+        Quantize(vertices, count, stride, positionOffset, normalOffset, bounds, 127.0f, dst,
+            [](QuantizedVertex8& out, int u, int v) {
+                out.normal[0] = (uint8_t)(u + 127);
+                out.normal[1] = (uint8_t)(v + 127);
+            });
+    }
+
+    void QuantizeVertices(const void* vertices, size_t count, size_t stride, size_t positionOffset, size_t normalOffset,
+                          const Bounds& bounds, QuantizedVertex12* dst) {
+        Quantize(vertices, count, stride, positionOffset, normalOffset, bounds, 32767.0f, dst,
+            [](QuantizedVertex12& out, int u, int v) {
+                out.position[3] = 0;
+                out.normal[0] = (int16_t)u;
+                out.normal[1] = (int16_t)v;
+            });
+    }
+
+    void DequantizeVertices(const QuantizedVertex8* src, size_t count, const Bounds& bounds, float* positions, float* normals) {
+        for (size_t first = 0; first < count; first += 4) {
+            size_t lanes = std::min<size_t>(4, count - first);
+            const QuantizedVertex8* q[4];
+            for (size_t lane = 0; lane < 4; lane++) {
+                q[lane] = &src[first + std::min(lane, lanes - 1)];
+            }
+            DecodePositions(Set(q[0]->position[0], q[1]->position[0], q[2]->position[0], q[3]->position[0]),
+                Set(q[0]->position[1], q[1]->position[1], q[2]->position[1], q[3]->position[1]),
+                Set(q[0]->position[2], q[1]->position[2], q[2]->position[2], q[3]->position[2]),
+                bounds, positions + first * 3, lanes);
+            DecodeNormals(Set(q[0]->normal[0], q[1]->normal[0], q[2]->normal[0], q[3]->normal[0]) - Splat(127.0f),
+                Set(q[0]->normal[1], q[1]->normal[1], q[2]->normal[1], q[3]->normal[1]) - Splat(127.0f),
+                127.0f, normals + first * 3, lanes);
+        }
+    }
+
+    void DequantizeVertices(const QuantizedVertex12* src, size_t count, const Bounds& bounds, float* positions, float* normals) {
+        for (size_t first = 0; first < count; first += 4) {
+            size_t lanes = std::min<size_t>(4, count - first);
+            const QuantizedVertex12* q[4];
+            for (size_t lane = 0; lane < 4; lane++) {
+                q[lane] = &src[first + std::min(lane, lanes - 1)];
+            }
+            DecodePositions(Set(q[0]->position[0], q[1]->position[0], q[2]->position[0], q[3]->position[0]),
+                Set(q[0]->position[1], q[1]->position[1], q[2]->position[1], q[3]->position[1]),
+                Set(q[0]->position[2], q[1]->position[2], q[2]->position[2], q[3]->position[2]),
+                bounds, positions + first * 3, lanes);
+            DecodeNormals(Set(q[0]->normal[0], q[1]->normal[0], q[2]->normal[0], q[3]->normal[0]),
+                Set(q[0]->normal[1], q[1]->normal[1], q[2]->normal[1], q[3]->normal[1]),
+                32767.0f, normals + first * 3, lanes);
+        }
+    }
+
+    QuantizationError MeasureError(const void* vertices, size_t count, size_t stride, size_t positionOffset,
+                                   size_t normalOffset, const float* positions, const float* normals) {
+        const uint8_t* data = static_cast<const uint8_t*>(vertices);
+        QuantizationError error;
+        double positionSum = 0.0;
+        double normalSum = 0.0;
+        for (size_t i = 0; i < count; i++) {
+            float p[3], n[3];
+            memcpy(p, data + i * stride + positionOffset, sizeof(p));
+            memcpy(n, data + i * stride + normalOffset, sizeof(n));
+
+            float dx = p[0] - positions[i * 3], dy = p[1] - positions[i * 3 + 1], dz = p[2] - positions[i * 3 + 2];
+            float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            float angle = AngleDegrees(n, normals + i * 3);
+
+            error.maxPosition = std::max(error.maxPosition, distance);
+            error.maxNormalDegrees = std::max(error.maxNormalDegrees, angle);
+            positionSum += distance;
+            normalSum += angle;
+        }
+        if (count > 0) {
+            error.meanPosition = (float)(positionSum / count);
+            error.meanNormalDegrees = (float)(normalSum / count);
+        }
+        return error;
+    }
+}
@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+
+// Сжатие вершин. Позиции хранятся 16-битными нормализованными числами относительно габаритов меша,
+// нормали - в октаэдрической развертке 2 x 8 или 2 x 16 бит. Декодирование на GPU - QuantizedVertex.h.
+namespace mesh {
+    // Позиция восстанавливается как code / 65535 * extent + min.
+    struct Bounds {
+        float min[3];
+        float extent[3];
+    };
+
+    // 8 байт: x, y, z (UNORM16) и нормаль (2 x 8 бит) в четвертой компоненте.
+    // Входной слой: POSITION, R16G16B16A16_UNORM.
+    struct QuantizedVertex8 {
+        uint16_t position[3];
+        uint8_t normal[2];
+    };
+
+    // 12 байт: x, y, z, 0 (UNORM16) и нормаль (SNORM16).
+    // Входной слой: POSITION, R16G16B16A16_UNORM и NORMAL, R16G16_SNORM со смещением 8.
+    struct QuantizedVertex12 {
+        uint16_t position[4];
+        int16_t normal[2];
+    };
+
+    static_assert(sizeof(QuantizedVertex8) == 8, "QuantizedVertex8 must be 8 bytes");
+    static_assert(sizeof(QuantizedVertex12) == 12, "QuantizedVertex12 must be 12 bytes");
+
+    struct QuantizationError {
+        float maxPosition = 0.0f;        // в единицах меша
+        float meanPosition = 0.0f;
+        float maxNormalDegrees = 0.0f;
+        float meanNormalDegrees = 0.0f;
+    };
+
+    // Исходные вершины - float3 позиции и нормали по заданным смещениям в вершине размера stride.
+    Bounds ComputeBounds(const void* vertices, size_t count, size_t stride, size_t positionOffset);
+
+    void OctahedralEncode(const float* normal, float* encoded);
+    void OctahedralDecode(const float* encoded, float* normal);
+
+    // Пакетное кодирование по четыре вершины. Код нормали выбирается из четырех соседних так, чтобы
+    // после декодирования угол с исходной нормалью был наименьшим.
+    void QuantizeVertices(const void* vertices, size_t count, size_t stride, size_t positionOffset, size_t normalOffset,
+                          const Bounds& bounds, QuantizedVertex8* dst);
+    void QuantizeVertices(const void* vertices, size_t count, size_t stride, size_t positionOffset, size_t normalOffset,
+                          const Bounds& bounds, QuantizedVertex12* dst);
+
+    // Декодирование в массивы float3 (как на GPU).
+    void DequantizeVertices(const QuantizedVertex8* src, size_t count, const Bounds& bounds, float* positions, float* normals);
+    void DequantizeVertices(const QuantizedVertex12* src, size_t count, const Bounds& bounds, float* positions, float* normals);
+
+    QuantizationError MeasureError(const void* vertices, size_t count, size_t stride, size_t positionOffset,
+                                   size_t normalOffset, const float* positions, const float* normals);
+}
@@ -0,0 +1,147 @@
+﻿// Замер и проверка VertexQuantization, в проект Lab5 не входит. Сборка на Linux:
+//   g++ -std=c++14 -O2 VertexQuantizationBenchMain.cpp VertexQuantization.cpp MeshGenerator.cpp -o quantize
+// Примеры:
+//   ./quantize
+//   ./quantize --tessellation 2000
+// Проверки: DequantizeVertices совпадает с декодированием в шейдере (QuantizedVertex.h, повторено здесь на C++),
+// ошибка позиции не больше диагонали половины шага 16-битной сетки, ошибка нормали не больше 1 градуса для
+// 2 x 8 бит и 0.01 градуса для 2 x 16 бит, октаэдрическая развертка осей и нижнего полюса точна. Замер - пакетное
+// кодирование и декодирование тора и икосферы, объем вершин до и после.
+#include "VertexQuantization.h"
+#include "MeshGenerator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace {
+    const size_t stride = 24;   // позиция + нормаль
+
+    double Milliseconds(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // DecodePosition и DecodeNormal8 из QuantizedVertex.h: w приходит как UNORM16.
+    void ShaderDecode8(const mesh::QuantizedVertex8& vertex, const mesh::Bounds& bounds, float* position, float* normal) {
+        for (int k = 0; k < 3; k++) {
+            position[k] = vertex.position[k] / 65535.0f * bounds.extent[k] + bounds.min[k];
+        }
+        uint16_t packed;
+        memcpy(&packed, vertex.normal, 2);
+        unsigned bits = (unsigned)std::lround(packed / 65535.0f * 65535.0f);
+        float e[2] = { std::max((float(bits & 0xFF) - 127.0f) / 127.0f, -1.0f), std::max((float(bits >> 8) - 127.0f) / 127.0f, -1.0f) };
+        float n[3] = { e[0], e[1], 1.0f - std::fabs(e[0]) - std::fabs(e[1]) };
+        float t = std::min(std::max(-n[2], 0.0f), 1.0f);
+        n[0] += n[0] >= 0.0f ? -t : t;
+        n[1] += n[1] >= 0.0f ? -t : t;
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        for (int k = 0; k < 3; k++) {
+            normal[k] = n[k] / length;
+        }
+    }
+
+    // Угол через atan2 в double: acos от float скалярного произведения не различает углы меньше ~0.03 градуса.
+    double MaxNormalDegrees(const mesh::MeshData& mesh, const std::vector<float>& normals) {
+        double maxAngle = 0.0;
+        for (size_t i = 0; i < mesh.GetVertexCount(); i++) {
+            double a[3] = { mesh.normal.x[i], mesh.normal.y[i], mesh.normal.z[i] };
+            const float* b = &normals[i * 3];
+            double cross[3] = { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+            double angle = std::atan2(std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]),
+                a[0] * b[0] + a[1] * b[1] + a[2] * b[2]);
+            maxAngle = std::max(maxAngle, angle * 180.0 / 3.14159265358979);
+        }
+        return maxAngle;
+    }
+
+    bool Run(const char* name, const mesh::MeshData& mesh) {
+        size_t count = mesh.GetVertexCount();
+        std::vector<uint8_t> vertices(count * stride);
+        mesh::WriteVertices(mesh, mesh::VertexLayout::Make(mesh::Position | mesh::Normal), vertices.data());
+        mesh::Bounds bounds = mesh::ComputeBounds(vertices.data(), count, stride, 0);
+
+        std::vector<mesh::QuantizedVertex8> compact(count);
+        std::vector<mesh::QuantizedVertex12> precise(count);
+        std::vector<float> positions(count * 3), normals(count * 3);
+        double encodeMs = 1e30, decodeMs = 1e30;
+        for (int repeat = 0; repeat < 3; repeat++) {
+            auto start = std::chrono::steady_clock::now();
+            mesh::QuantizeVertices(vertices.data(), count, stride, 0, 12, bounds, compact.data());
+            encodeMs = std::min(encodeMs, Milliseconds(start));
+            start = std::chrono::steady_clock::now();
+            mesh::DequantizeVertices(compact.data(), count, bounds, positions.data(), normals.data());
+            decodeMs = std::min(decodeMs, Milliseconds(start));
+        }
+        mesh::QuantizationError error8 = mesh::MeasureError(vertices.data(), count, stride, 0, 12, positions.data(), normals.data());
+
+        float shaderDifference = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+            float position[3], normal[3];
+            ShaderDecode8(compact[i], bounds, position, normal);
+            for (int k = 0; k < 3; k++) {
+                shaderDifference = std::max(shaderDifference, std::fabs(position[k] - positions[i * 3 + k]));
+                shaderDifference = std::max(shaderDifference, std::fabs(normal[k] - normals[i * 3 + k]));
+            }
+        }
+
+        mesh::QuantizeVertices(vertices.data(), count, stride, 0, 12, bounds, precise.data());
+        mesh::DequantizeVertices(precise.data(), count, bounds, positions.data(), normals.data());
+        mesh::QuantizationError error16 = mesh::MeasureError(vertices.data(), count, stride, 0, 12, positions.data(), normals.data());
+        double normal16Degrees = MaxNormalDegrees(mesh, normals);
+
+        // Половина шага сетки по самой длинной оси с запасом на округление float; по диагонали ошибка в sqrt(3) раз больше.
+        float halfStep = std::max(std::max(bounds.extent[0], bounds.extent[1]), bounds.extent[2]) / 65535.0f * 0.5f * 1.01f;
+        bool ok = shaderDifference < 1e-5f && error8.maxPosition <= halfStep * 1.75f && error16.maxPosition <= halfStep * 1.75f &&
+            error8.maxNormalDegrees < 1.0f && normal16Degrees < 0.01;
+        printf("%-10s %8zu vertices, %5.1f -> %4.1f MB: 8 bytes position max %.1e mean %.1e, normal max %.3f mean %.3f deg; "
+            "12 bytes normal max %.4f deg; shader decode difference %.1e; encode %.0f, decode %.0f Mvertices/s: %s\n", name, count,
+            count * stride / 1048576.0, count * sizeof(mesh::QuantizedVertex8) / 1048576.0, error8.maxPosition, error8.meanPosition,
+            error8.maxNormalDegrees, error8.meanNormalDegrees, normal16Degrees, shaderDifference, count / encodeMs / 1e3,
+            count / decodeMs / 1e3, ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    bool CheckOctahedral() {
+        const float axes[7][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+            { 0.57735027f, -0.57735027f, -0.57735027f } };
+        float maxError = 0.0f;
+        for (const float* axis : axes) {
+            float encoded[2], decoded[3];
+            mesh::OctahedralEncode(axis, encoded);
+            mesh::OctahedralDecode(encoded, decoded);
+            for (int k = 0; k < 3; k++) {
+                maxError = std::max(maxError, std::fabs(decoded[k] - axis[k]));
+            }
+        }
+        bool ok = maxError < 1e-6f;
+        printf("Octahedral axes and poles: max error %.1e: %s\n", maxError, ok ? "ok" : "FAILED");
+        return ok;
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned tessellation = 1000;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--tessellation") && i + 1 < argc) {
+            tessellation = (unsigned)atoi(argv[++i]);
+        } else {
+            printf("quantize [--tessellation <n>]\n");
+            return 1;
+        }
+    }
+
+    bool ok = CheckOctahedral();
+    mesh::MeshData mesh;
+    mesh::UVSphere(40, 40, mesh);
+    ok = Run("uvsphere", mesh) && ok;
+    mesh::Cube(2.0f, mesh);
+    ok = Run("cube", mesh) && ok;
+    mesh::Icosphere(8, mesh);
+    ok = Run("icosphere", mesh) && ok;
+    mesh::Torus(3.0f, 1.0f, tessellation, tessellation, mesh);
+    ok = Run("torus", mesh) && ok;
+    return ok ? 0 : 1;
+}
@@ -17,15 +17,20 @@ SamplerState minSampler : register(s1);
 Texture2D maxTexture : register (t2);
 SamplerState maxSampler : register(s2);
 
+cbuffer adaptBuffer : register (b0) {
+    float4 adapt;
+};
+
 float calcBrightness(float3 color) {
     return (color[0] * 0.2126f) + (color[1] * 0.7151f) + (color[2] * 0.0722f);
 }
 
 PS_OUTPUT main(PS_INPUT input) : SV_TARGET{
     PS_OUTPUT output;
-    output.avg = log(calcBrightness(avgTexture.Sample(avgSampler, input.uv).xyz) + 1.0f);
-    output.min = calcBrightness(minTexture.Sample(minSampler, input.uv).xyz);
-    output.max = calcBrightness(maxTexture.Sample(maxSampler, input.uv).xyz);
+    float2 uv = input.uv * adapt.zw;
+    output.avg = log(calcBrightness(avgTexture.Sample(avgSampler, uv).xyz) + 1.0f);
+    output.min = calcBrightness(minTexture.Sample(minSampler, uv).xyz);
+    output.max = calcBrightness(maxTexture.Sample(maxSampler, uv).xyz);
 
     return output;
 }
\ No newline at end of file
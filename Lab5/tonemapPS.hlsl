@@ -44,6 +44,6 @@ float3 TonemapFilmic(float3 color, float adaptedAvg, float Efactor) {
 PS_OUTPUT main(PS_INPUT input) : SV_TARGET{
     PS_OUTPUT output;
 
-    output.color = float4(TonemapFilmic(colorTexture.Sample(colorSampler, input.uv).xyz, adapt.x, adapt.y), 1.0f);
+    output.color = float4(TonemapFilmic(colorTexture.Sample(colorSampler, input.uv * adapt.zw).xyz, adapt.x, adapt.y), 1.0f);
     return output;
 }
\ No newline at end of file